@@ -26,7 +26,6 @@
 // Std C Lib headers.
 #include <ctype.h>
 #include <fcntl.h>
-#include <malloc.h>
 #include <math.h>
 #include <pthread.h>
 #include <signal.h>
@@ -41,6 +40,7 @@
 #include <X11/extensions/Xdbe.h>
 #include <X11/extensions/Xinerama.h>
 #include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrandr.h>
 #include <X11/cursorfont.h>
 
 // Other library headers.
@@ -53,6 +53,8 @@
 
 #include "Application.h"
 #include "Aurora.h"
+#include "Backdrop.h"
+#include "Benchmark.h"
 #include "birds.h"
 #include "Blowoff.h"
 #include "clocks.h"
@@ -61,34 +63,55 @@
 #include "docs.h"
 #include "dsimple.h"
 #include "FallenSnow.h"
+#include "FallenSnowState.h"
 #include "Flags.h"
+#include "FrameDamage.h"
+#include "FrameProfiler.h"
+#include "GLRenderer.h"
 #include "Lights.h"
 #include "LoadMeasure.h"
 #include "mainstub.h"
 #include "MainWindow.h"
+#include "MemoryStats.h"
+#include "Metrics.h"
 #include "meteor.h"
 #include "moon.h"
 #include "MsgBox.h"
 #include "mygettext.h"
+#include "Outputs.h"
+#include "PowerPolicy.h"
+#include "Random.h"
+#include "Replay.h"
 #include "safe_malloc.h"
 #include "Santa.h"
 #include "scenery.h"
 #include "selfrep.h"
+#include "ShmPresent.h"
 #include "snow.h"
+#include "SpriteCache.h"
 #include "Stars.h"
 #include "StormWindow.h"
+#include "Suspend.h"
+#include "ThreadPolicy.h"
+#include "TileRaster.h"
 #include "treesnow.h"
 #include "WinInfo.h"
 #include "version.h"
 #include "wind.h"
+#include "WindowNames.h"
 #include "windows.h"
+#include "WorldSnapshot.h"
+#include "XAtoms.h"
 #include "Utils.h"
 #include "vroot.h"
 #include "xdo.h"
+#include "XTraffic.h"
 
 
 // ColorPicker methods.
 void uninitQPickerDialog();
+bool isQPickerActive();
+bool isQPickerVisible();
 
 
 /** *********************************************************************
@@ -103,11 +126,13 @@ char **Argv;
 int Argc;
 
 Bool mMainWindowNeedsReconfiguration = true;
+Bool mOutputsNeedReconfiguration = false;
 Bool mDoRestartDueToDisplayChange = 0;
 
 char* mSnowWindowTitlebarName = NULL;
 
 guint mTransparentWindowGUID = 0;
+guint mTransparentWindowTickId = 0;
 guint mCairoWindowGUID = 0;
 
 GtkWidget *mTransparentWindow = NULL;
@@ -118,6 +143,10 @@ cairo_surface_t *mCairoSurface = NULL;
 
 int xfixes_event_base_ = -1;
 
+// RandR tells of root size and output changes. Without it,
+// onTimerEventDisplayChanged() polls the root size.
+int xrandr_event_base_ = -1;
+
 int mIsSticky = 0;
 
 int wantx = 0;
@@ -136,20 +165,13 @@ int mX11LastErrorCode = 0;
  ** main.c: 
  **/
 int startApplication(int argc, char *argv[]) {
-    struct mallinfo2 m2InfoS = mallinfo2();
-    printf("\n%splasmasnow: Total arena bytes @start     : %li.%s\n",
-        COLOR_YELLOW, m2InfoS.arena, COLOR_NORMAL);
-    printf("%splasmasnow: Total allocated bytes @start : %li.%s\n",
-        COLOR_YELLOW, m2InfoS.uordblks, COLOR_NORMAL);
-    printf("%splasmasnow: Total free bytes @start      : %li.%s\n",
-        COLOR_YELLOW, m2InfoS.fordblks, COLOR_NORMAL);
-
     signal(SIGINT, appShutdownHook);
     signal(SIGTERM, appShutdownHook);
     signal(SIGHUP, appShutdownHook);
 
     // Set up random,
     srand48((int) (fmod(wallcl() * 1.0e6, 1.0e8)));
+    seedRandom((uint64_t) (wallcl() * 1.0e6));
 
     // Cleaar space for app Global struct.
     memset(&mGlobal, 0, sizeof(mGlobal));
@@ -188,7 +210,7 @@ int startApplication(int argc, char *argv[]) {
 
     mGlobal.FsnowFirst = NULL;
 
-    mGlobal.SantaPlowRegion = 0;
+    mGlobal.SantaPlowRect = (cairo_rectangle_int_t) {0, 0, 0, 0};
     mGlobal.SnowOnTrees = NULL;
     mGlobal.OnTrees = 0;
     mGlobal.RemoveFluff = 0;
@@ -253,6 +275,27 @@ int startApplication(int argc, char *argv[]) {
             break;
     }
 
+    // Replays run as a benchmark of the recorded session.
+    if (isReplayActive() && !openReplay()) {
+        return 1;
+    }
+
+    // Benchmarks repeat: fixed seed, no UI, leave rc alone.
+    if (isBenchmarkActive()) {
+        const uint64_t seed = isReplayActive() ?
+            getReplaySeed() : BENCHMARK_SEED;
+        srand48(seed);
+        seedRandom(seed);
+        Flags.NoConfig = 1;
+        Flags.NoMenu = 1;
+
+    } else if (Flags.RecordFile[0]) {
+        const uint64_t seed = (uint64_t) (wallcl() * 1.0e6);
+        srand48(seed);
+        seedRandom(seed);
+        startRecording(seed);
+    }
+
     // Make a copy of all flags, before gtk_init() removes some.
     // We need this at app refresh. remove: -screen n -lang c.
     Argv = (char **) malloc((argc + 1) * sizeof(char **));
@@ -289,7 +332,8 @@ int startApplication(int argc, char *argv[]) {
         COLOR_BLUE, getDesktopSession() ? getDesktopSession() :
         "was not", COLOR_NORMAL);
 
-    // Log Wayland info.
+    // Log Wayland info. Every module draws and tracks windows
+    // through Xlib, there is no layer-shell backend to fall to.
     const bool isWaylandPresent = getenv("WAYLAND_DISPLAY") &&
         getenv("WAYLAND_DISPLAY") [0];
     if (isWaylandPresent) {
@@ -319,6 +363,7 @@ int startApplication(int argc, char *argv[]) {
             "X11 Does not seem to be available - FATAL.");
         return 1;
     }
+    initXAtoms();
 
     mGlobal.xdo = xdo_new_with_opened_display(
         mGlobal.display, NULL, 0);
@@ -399,11 +444,18 @@ int startApplication(int argc, char *argv[]) {
     // Start Main GUI Window.
     InitSnowOnTrees();
 
-    updateWindowsList();
-    getWinInfoForAllWindows();
+    if (isBenchmarkActive()) {
+        StartBenchmarkWindow();
+    } else {
+        // A screensaver owns its whole window, none to track.
+        if (!isXscreensaverRequested() || Flags.FullScreensaver) {
+            updateWindowsList();
+            getWinInfoForAllWindows();
+        }
 
-    if (!StartWindow()) {
-        return 1;
+        if (!StartWindow()) {
+            return 1;
+        }
     }
 
     // Init all Global Flags.
@@ -417,28 +469,77 @@ int startApplication(int argc, char *argv[]) {
     OldFlags.FullScreen = !Flags.FullScreen;
 
     // Request all interesting X11 events.
-    const Window eventWindow = (mGlobal.hasDestopWindow) ?
-        mGlobal.Rootwindow : mGlobal.SnowWin;
+    if (!isBenchmarkActive()) {
+        const Window eventWindow = (mGlobal.hasDestopWindow) ?
+            mGlobal.Rootwindow : mGlobal.SnowWin;
+
+        // A lean screensaver follows only its size.
+        long eventMask = isLeanScreensaverActive() ?
+            StructureNotifyMask :
+            StructureNotifyMask | SubstructureNotifyMask |
+                FocusChangeMask;
+
+        // On the root, property changes tell of workspace
+        // switches, in a snow window too.
+        if (eventWindow == mGlobal.Rootwindow) {
+            eventMask |= PropertyChangeMask;
+        } else {
+            XSelectInput(mGlobal.display, mGlobal.Rootwindow,
+                PropertyChangeMask);
+        }
+        XSelectInput(mGlobal.display, eventWindow, eventMask);
+
+        if (!isLeanScreensaverActive()) {
+            XFixesSelectCursorInput(mGlobal.display, eventWindow,
+                XFixesDisplayCursorNotifyMask);
+        }
 
-    XSelectInput(mGlobal.display, eventWindow,
-        StructureNotifyMask | SubstructureNotifyMask |
-        FocusChangeMask);
+        int xfixes_error_base;
+        if (!XFixesQueryExtension(mGlobal.display,
+            &xfixes_event_base_, &xfixes_error_base)) {
+            xfixes_event_base_ = -1;
+        }
 
-    XFixesSelectCursorInput(mGlobal.display, eventWindow,
-        XFixesDisplayCursorNotifyMask);
+        // Snowing on the desktop, follow the outputs. CRTC and
+        // output events need RandR 1.2.
+        int xrandr_error_base;
+        int xrandr_major = 0;
+        int xrandr_minor = 0;
+        if (mGlobal.hasDestopWindow && XRRQueryExtension(mGlobal.display,
+            &xrandr_event_base_, &xrandr_error_base) &&
+            XRRQueryVersion(mGlobal.display, &xrandr_major, &xrandr_minor)) {
+            const bool hasOutputEvents = xrandr_major > 1 ||
+                (xrandr_major == 1 && xrandr_minor >= 2);
+            XRRSelectInput(mGlobal.display, mGlobal.Rootwindow,
+                hasOutputEvents ? RRScreenChangeNotifyMask |
+                    RRCrtcChangeNotifyMask | RROutputChangeNotifyMask :
+                RRScreenChangeNotifyMask);
+        } else {
+            xrandr_event_base_ = -1;
+        }
+    }
 
     clearGlobalSnowWindow();
 
+    // The menu is built once snow falls, a hidden one later.
+    // Until then, settings live in Flags only.
     if (!Flags.NoMenu && !mGlobal.XscreensaverMode) {
-        createMainWindow();
-        ui_set_sticky(Flags.AllWorkspaces);
+        addMethodToMainloop(PRIORITY_DEFAULT, Flags.HideMenu ?
+            TIME_BEFORE_HIDDEN_MAIN_WINDOW : TIME_BEFORE_MAIN_WINDOW,
+            startMainWindow);
     }
 
     Flags.shutdownRequested = 0;
 
-    addWindowsModuleToMainloop();
+    if (!isLeanScreensaverActive()) {
+        addWindowsModuleToMainloop();
+    }
+
+    // Threads started from here on follow -lowprio.
+    registerMainPolicyThread();
 
     // Init app modules & log window status.
+    initSpriteCache();
     snow_init();
     printf("%splasmasnow: It\'s Snowing in: [0x%08lx]%s\n",
         COLOR_CYAN, mGlobal.SnowWin, COLOR_NORMAL);
@@ -462,15 +563,36 @@ int startApplication(int argc, char *argv[]) {
     initMeteorModule();
     lazyInitAuroraModule();
     moon_init();
+    publishWorldSnapshot();
 
     startLoadMeasureBackgroundThread();
-
-    addMethodToMainloop(PRIORITY_DEFAULT, time_displaychanged,
-        onTimerEventDisplayChanged);
-    addMethodToMainloop(PRIORITY_DEFAULT, CONFIGURE_WINDOW_EVENT_TIME,
-        handlePendingX11Events);
-    addMethodToMainloop(PRIORITY_DEFAULT, time_display_dimensions,
-        handleDisplayConfigurationChange);
+    startFrameProfilerBackgroundThread();
+    startMemoryStatsBackgroundThread();
+    startSuspendMonitor();
+    startPowerPolicy();
+    startMetricsExport();
+    initTileRaster();
+
+    // Benchmarks have a synthetic, fixed desktop.
+    if (isBenchmarkActive()) {
+        startBenchmarkDesktop();
+        if (isReplayActive()) {
+            addMethodToMainloop(PRIORITY_HIGH, REPLAY_POLL_TIME,
+                replaySessionEvents);
+        }
+    } else {
+        if (xrandr_event_base_ < 0) {
+            addMethodToMainloop(PRIORITY_DEFAULT, time_displaychanged,
+                onTimerEventDisplayChanged);
+        }
+        addMethodToMainloop(PRIORITY_DEFAULT, CONFIGURE_WINDOW_EVENT_TIME,
+            handlePendingX11Events);
+        if (isRecordActive()) {
+            addMethodToMainloop(PRIORITY_DEFAULT, RECORD_POLL_TIME,
+                recordSessionState);
+        }
+    }
+    subscribeUISettingsUpdates();
     addMethodToMainloop(PRIORITY_HIGH, TIME_BETWEEEN_UI_SETTINGS_UPDATES,
         doAllUISettingsUpdates);
 
@@ -489,18 +611,25 @@ int startApplication(int argc, char *argv[]) {
     printf("\n%splasmasnow: gtk_main() Starts.%s\n",
         COLOR_BLUE, COLOR_NORMAL);
 
-    struct mallinfo2 m2InfoR = mallinfo2();
-    printf("\n%splasmasnow: Total arena bytes @run      : %li.%s\n",
-        COLOR_YELLOW, m2InfoR.arena, COLOR_NORMAL);
-    printf("%splasmasnow: Total allocated bytes @run  : %li.%s\n",
-        COLOR_YELLOW, m2InfoR.uordblks, COLOR_NORMAL);
-    printf("%splasmasnow: Total free bytes @run       : %li.%s\n",
-        COLOR_YELLOW, m2InfoR.fordblks, COLOR_NORMAL);
+    printMemoryReport("run");
 
-    gtk_main();
+    if (isBenchmarkActive()) {
+        runBenchmark();
+    } else {
+        gtk_main();
+    }
 
     printf("\n%splasmasnow: gtk_main() Finishes.%s\n",
         COLOR_BLUE, COLOR_NORMAL);
+    flushFlagsFile();
+    stopRecording();
+
+    lockFallenSnowSemaphore();
+    saveFallenSnowState();
+    unlockFallenSnowSemaphore();
+
+    closeReplay();
+    stopMetricsExport();
 
     // Display termination messages to MessageBox or STDOUT.
      printf("%s\nThanks for using plasmasnow, you rock !%s\n",
@@ -511,6 +640,9 @@ int startApplication(int argc, char *argv[]) {
         free(mSnowWindowTitlebarName);
     }
 
+    stopTileRaster();
+    destroyShmPresent();
+
     XClearWindow(mGlobal.display, mGlobal.SnowWin);
     XFlush(mGlobal.display);
 
@@ -603,10 +735,11 @@ int StartWindow() {
         mGlobal.SnowWin = mGlobal.Rootwindow;
 
         // User wants a screensaver too.
-        if (getenv("XSCREENSAVER_WINDOW")) {
+        if (isXscreensaverRequested()) {
             mGlobal.XscreensaverMode = true;
             mGlobal.SnowWin = strtol(getenv("XSCREENSAVER_WINDOW"), NULL, 0);
             mGlobal.Rootwindow = mGlobal.SnowWin;
+            setLeanScreensaverFlags();
         }
 
     // Normal Startup.
@@ -644,8 +777,12 @@ int StartWindow() {
             mGlobal.hasDestopWindow = true;
             mGlobal.isDoubleBuffered = true;
 
-            g_signal_connect(mTransparentWindow, "draw",
-                G_CALLBACK(handleTransparentWindowDrawEvents), NULL);
+            // With -gl, a GL area draws the window instead.
+            if (!Flags.UseGL || !createGLRenderer(mTransparentWindow,
+                drawCairoWindowInternal)) {
+                g_signal_connect(mTransparentWindow, "draw",
+                    G_CALLBACK(handleTransparentWindowDrawEvents), NULL);
+            }
         } else {
 
             // xwin might be our rootwindow, pcmanfm or Desktop:
@@ -658,6 +795,7 @@ int StartWindow() {
             } else {
                 xwin = mGlobal.Rootwindow;
             }
+            clearWindowNameIndex();
 
             mGlobal.SnowWin = xwin;
             int winw, winh;
@@ -672,7 +810,7 @@ int StartWindow() {
     // Start window Cairo specific.
     if (mX11CairoEnabled) {
         handleX11CairoDisplayChange();
-        mCairoWindowGUID = addMethodWithArgToMainloop(
+        mCairoWindowGUID = addSimulationMethodWithArgToMainloop(
             PRIORITY_HIGH, time_draw_all, drawCairoWindow, mCairoWindow);
         mGlobal.WindowOffsetX = 0;
         mGlobal.WindowOffsetY = 0;
@@ -715,6 +853,101 @@ int StartWindow() {
     return TRUE;
 }
 
+/** *********************************************************************
+ ** This method builds the menu from ui.glade, off the
+ ** startup path. Runs once.
+ **/
+int startMainWindow() {
+    if (Flags.shutdownRequested) {
+        return FALSE;
+    }
+
+    createMainWindow();
+    ui_set_sticky(Flags.AllWorkspaces);
+    return FALSE;
+}
+
+/** *********************************************************************
+ ** This method tells if xscreensaver has handed us a window
+ ** to draw in.
+ **/
+bool isXscreensaverRequested() {
+    const char* window = getenv("XSCREENSAVER_WINDOW");
+    return Flags.ForceRoot && !Flags.WindowId &&
+        !Flags.XWinInfoHandling && window && window[0];
+}
+
+/** *********************************************************************
+ ** This method tells if the lean screensaver pipeline runs:
+ ** no window tracking, UI or window snow.
+ **/
+bool isLeanScreensaverActive() {
+    return mGlobal.XscreensaverMode && !Flags.FullScreensaver;
+}
+
+/** *********************************************************************
+ ** This method trims a screensaver run to sky, scenery, snow
+ ** and bottom snow. Flags changed here are never written
+ ** back.
+ **/
+void setLeanScreensaverFlags() {
+    if (Flags.FullScreensaver) {
+        return;
+    }
+
+    Flags.NoConfig = 1;
+    Flags.NoMenu = 1;
+
+    Flags.NoSanta = 1;
+    Flags.ShowBirds = 0;
+    Flags.FollowSanta = 0;
+    Flags.NoKeepSnowOnWindows = 1;
+}
+
+/** *********************************************************************
+ ** This method sets up -benchmark drawing: an offscreen cairo
+ ** image of the benchmark size, and an unmapped window for the
+ ** few Xlib calls modules still make.
+ **/
+void StartBenchmarkWindow() {
+    mGlobal.Rootwindow = DefaultRootWindow(mGlobal.display);
+
+    mGlobal.hasDestopWindow = false;
+    mGlobal.hasTransparentWindow = false;
+    mGlobal.useDoubleBuffers = false;
+    mGlobal.isDoubleBuffered = true;
+    mGlobal.xxposures = false;
+    mGlobal.XscreensaverMode = false;
+
+    const int w = Flags.BenchmarkWidth;
+    const int h = Flags.BenchmarkHeight;
+    mGlobal.SnowWin = XCreateSimpleWindow(mGlobal.display,
+        mGlobal.Rootwindow, 0, 0, w, h, 0, 0, 0);
+
+    mX11CairoEnabled = true;
+    mCairoWindow = getBenchmarkCairo();
+
+    mGlobal.Xroot = 0;
+    mGlobal.Yroot = 0;
+    mGlobal.Wroot = w;
+    mGlobal.Hroot = h;
+
+    mGlobal.SnowWinX = 0;
+    mGlobal.SnowWinY = 0;
+    mGlobal.SnowWinWidth = w;
+    mGlobal.SnowWinHeight = h + Flags.OffsetS;
+    mGlobal.SnowWinBorderWidth = 0;
+    mGlobal.SnowWinDepth = DefaultDepth(mGlobal.display, mGlobal.Screen);
+    mGlobal.WindowOffsetX = 0;
+    mGlobal.WindowOffsetY = 0;
+
+    mPrevSnowWinWidth = mGlobal.SnowWinWidth;
+    mPrevSnowWinHeight = mGlobal.SnowWinHeight;
+    mSnowWindowTitlebarName = strdup("benchmark");
+
+    SetWindowScale();
+}
+
 /** *********************************************************************
  ** Cairo specific.
  **/
@@ -728,6 +961,29 @@ void handleX11CairoDisplayChange() {
     unsigned int w, h;
     xdo_get_window_size(mGlobal.xdo, mGlobal.SnowWin, &w, &h);
 
+    // Local displays can rasterize client side and present
+    // only the damage through MIT-SHM, instead of Xdbe.
+    bool doshm = false;
+    if (Flags.UseXShm) {
+        if (mCairoWindow) {
+            cairo_destroy(mCairoWindow);
+            mCairoWindow = NULL;
+        }
+        if (mCairoSurface) {
+            cairo_surface_destroy(mCairoSurface);
+            mCairoSurface = NULL;
+        }
+        doshm = createShmPresent(mGlobal.display, mGlobal.SnowWin, w, h);
+        if (doshm) {
+            mCairoSurface = cairo_surface_reference(getShmPresentSurface());
+            mGlobal.useDoubleBuffers = false;
+            mGlobal.isDoubleBuffered = false;
+            dodouble = 0;
+        } else if (Flags.Noisy) {
+            printf("plasmasnow: MIT-SHM not available, using X11 drawing.\n");
+        }
+    }
+
 #ifdef XDBE_AVAILABLE
     if (dodouble) {
         static Drawable backBuf = 0;
@@ -751,7 +1007,7 @@ void handleX11CairoDisplayChange() {
     }
 #endif
 
-    if (!dodouble) {
+    if (!dodouble && !doshm) {
         Visual *visual = DefaultVisual(mGlobal.display,
             DefaultScreen(mGlobal.display));
         mCairoSurface = cairo_xlib_surface_create(
@@ -763,7 +1019,9 @@ void handleX11CairoDisplayChange() {
             cairo_destroy(mCairoWindow);
         }
         mCairoWindow = cairo_create(mCairoSurface);
-        cairo_xlib_surface_set_size(mCairoSurface, w, h);
+        if (!doshm) {
+            cairo_xlib_surface_set_size(mCairoSurface, w, h);
+        }
     }
 
     mGlobal.SnowWinWidth = w;
@@ -819,46 +1077,110 @@ void respondToWorkspaceSettingsChange() {
 }
 
 /** *********************************************************************
- * here we are handling the buttons in ui
- * Ok, this is a long list, and could be implemented more efficient.
- * But, doAllUISettingsUpdates is called not too frequently, so....
- * Note: if changes != 0, the settings will be written to .plasmasnowrc
+ ** This method subscribes each module's settings update to
+ ** the flags it compares, so ui changes reach only those.
  **/
-int doAllUISettingsUpdates() {
-    if (Flags.shutdownRequested) {
-        gtk_main_quit();
-    }
-
-    if (Flags.NoMenu) {
-        return TRUE;
-    }
+void subscribeUISettingsUpdates() {
+    #define SUBSCRIBE(handler, ...) \
+        subscribeFlagChanges(handler, (const int[]) { \
+            __VA_ARGS__, FLAG_ID_END })
+
+    SUBSCRIBE(Santa_ui, FLAG_ID_SantaSize, FLAG_ID_Rudolf,
+        FLAG_ID_NoSanta, FLAG_ID_SantaSpeedFactor, FLAG_ID_SantaScale,
+        FLAG_ID_Scale, FLAG_EVENT_WINDOW_SCALE);
+    SUBSCRIBE(updateSceneryUserSettings, FLAG_ID_TreeType,
+        FLAG_ID_DesiredNumberOfTrees, FLAG_ID_TreeFill,
+        FLAG_ID_TreeScale, FLAG_ID_NoTrees, FLAG_ID_TreeColor,
+        FLAG_ID_Overlap, FLAG_ID_Scale, FLAG_EVENT_WINDOW_SCALE,
+        FLAG_EVENT_COLOR_PICKER);
+    SUBSCRIBE(birds_ui, FLAG_ID_ShowBirds, FLAG_ID_Neighbours,
+        FLAG_ID_Anarchy, FLAG_ID_PrefDistance, FLAG_ID_ViewingDistance,
+        FLAG_ID_BirdsSpeed, FLAG_ID_AttrFactor, FLAG_ID_DisWeight,
+        FLAG_ID_FollowWeight, FLAG_ID_BirdsScale, FLAG_ID_ShowAttrPoint,
+        FLAG_ID_AttrSpace, FLAG_ID_BirdsColor, FLAG_ID_Nbirds,
+        FLAG_ID_FollowSanta, FLAG_EVENT_COLOR_PICKER);
+    SUBSCRIBE(snow_ui, FLAG_ID_NoSnowFlakes, FLAG_ID_SnowFlakesFactor,
+        FLAG_ID_SnowColor, FLAG_ID_SnowColor2, FLAG_ID_SnowSpeedFactor,
+        FLAG_ID_FlakeCountMax, FLAG_ID_SnowSize, FLAG_ID_Scale,
+        FLAG_EVENT_WINDOW_SCALE, FLAG_EVENT_COLOR_PICKER);
+    SUBSCRIBE(updateMeteorUserSettings, FLAG_ID_NoMeteors,
+        FLAG_ID_MeteorFrequency);
+    SUBSCRIBE(wind_ui, FLAG_ID_WindNow, FLAG_ID_NoWind,
+        FLAG_ID_WhirlFactor, FLAG_ID_WhirlTimer);
+    SUBSCRIBE(updateStarsUserSettings, FLAG_ID_NStars, FLAG_ID_Stars,
+        FLAG_ID_Scale, FLAG_EVENT_WINDOW_SCALE);
+    SUBSCRIBE(updateLightsUserSettings, FLAG_ID_ShowLights,
+        FLAG_ID_ShowLightColorRed, FLAG_ID_ShowLightColorLime,
+        FLAG_ID_ShowLightColorPurple, FLAG_ID_ShowLightColorCyan,
+        FLAG_ID_ShowLightColorGreen, FLAG_ID_ShowLightColorOrange,
+        FLAG_ID_ShowLightColorBlue, FLAG_ID_ShowLightColorPink,
+        FLAG_ID_Scale, FLAG_EVENT_WINDOW_SCALE);
+    SUBSCRIBE(updateFallenSnowUserSettings, FLAG_ID_MaxWinSnowDepth,
+        FLAG_ID_MaxScrSnowDepth, FLAG_ID_NoKeepSnowOnBottom,
+        FLAG_ID_NoKeepSnowOnWindows, FLAG_ID_IgnoreTop,
+        FLAG_ID_IgnoreBottom);
+    SUBSCRIBE(updateBlowoffUserSettings, FLAG_ID_BlowSnow,
+        FLAG_ID_BlowOffFactor);
+    SUBSCRIBE(treesnow_ui, FLAG_ID_MaxOnTrees, FLAG_ID_NoKeepSnowOnTrees);
+    SUBSCRIBE(moon_ui, FLAG_ID_MoonSpeed, FLAG_ID_Halo, FLAG_ID_Moon,
+        FLAG_ID_MoonSize, FLAG_ID_MoonColor, FLAG_ID_HaloBright,
+        FLAG_ID_Scale, FLAG_EVENT_WINDOW_SCALE);
+    SUBSCRIBE(aurora_ui, FLAG_ID_ShowAurora, FLAG_ID_AuroraBase,
+        FLAG_ID_AuroraHeight, FLAG_ID_AuroraWidth,
+        FLAG_ID_AuroraBrightness, FLAG_ID_AuroraSpeed,
+        FLAG_ID_AuroraLeft, FLAG_ID_AuroraMiddle, FLAG_ID_AuroraRight);
+    SUBSCRIBE(updateMainWindowUI, FLAG_ID_mAppTheme, FLAG_ID_Screen,
+        FLAG_ID_Outline, FLAG_ID_Language);
+    SUBSCRIBE(updateAdvancedUserSettings, FLAG_ID_CpuLoad,
+        FLAG_ID_LowPrio, FLAG_ID_Transparency, FLAG_ID_Scale, FLAG_ID_OffsetS,
+        FLAG_ID_OffsetY, FLAG_ID_AllWorkspaces, FLAG_ID_BackgroundFile,
+        FLAG_ID_BlackBackground);
+
+    #undef SUBSCRIBE
+
+    // Settle whatever startup changed.
+    publishAllFlagChanges();
+}
 
-    Santa_ui();
-    updateSceneryUserSettings();
-    birds_ui();
-    snow_ui();
-    updateMeteorUserSettings();
-    wind_ui();
-    updateStarsUserSettings();
-    updateLightsUserSettings();
-    updateFallenSnowUserSettings();
-    updateBlowoffUserSettings();
-    treesnow_ui();
-    moon_ui();
-    aurora_ui();
-    updateMainWindowUI();
-
-    // updateAdvancedUserSettings.
+/** *********************************************************************
+ ** This method handles flags of the advanced settings tab.
+ **/
+void updateAdvancedUserSettings() {
     UIDO(CpuLoad, HandleCpuFactor(););
+    UIDO(LowPrio, applyThreadPolicy(););
     UIDO(Transparency, );
     UIDO(Scale, );
-    UIDO(OffsetS, updateDisplayDimensions(););
+    UIDO(OffsetS, updateDisplayDimensions(); clearAndRedrawScenery(););
     UIDO(OffsetY, lockFallenSnowSemaphore();
         doAllFallenSnowWinInfoUpdates();
         unlockFallenSnowSemaphore(););
     UIDO(AllWorkspaces, respondToWorkspaceSettingsChange(););
     UIDOS(BackgroundFile, );
     UIDO(BlackBackground, );
+}
+
+/** *********************************************************************
+ ** This method runs the settings updates that ui changes
+ ** published since last time. An idle session does nothing.
+ ** Note: if changes != 0, the settings will be written to .plasmasnowrc
+ **/
+int doAllUISettingsUpdates() {
+    if (Flags.shutdownRequested) {
+        gtk_main_quit();
+    }
+
+    if (Flags.NoMenu) {
+        return TRUE;
+    }
+
+    // The Qt color picker has no callback, its result waits.
+    if (isQPickerActive() && !isQPickerVisible()) {
+        publishFlagChange(FLAG_EVENT_COLOR_PICKER);
+    }
+
+    if (!dispatchFlagChanges()) {
+        return TRUE;
+    }
 
     // Write flags prefs if they've changed.
     if (Flags.Changes > 0) {
@@ -873,7 +1195,8 @@ int doAllUISettingsUpdates() {
 /** *********************************************************************
  * If we are snowing in the desktop, we check if the size has changed,
  * this can happen after changing of the displays settings
- * If the size has been changed, we refresh the app.
+ * If the size has been changed, we refresh the app. Only
+ * added without RandR; onScreenChanged() sees the change otherwise.
  **/
 int onTimerEventDisplayChanged() {
     if (Flags.shutdownRequested) {
@@ -884,12 +1207,6 @@ int onTimerEventDisplayChanged() {
         return -1;
     }
 
-    if (mGlobal.ForceRestart) {
-        mDoRestartDueToDisplayChange = 1;
-        Flags.shutdownRequested = 1;
-        return -1;
-    }
-
     Display *display = XOpenDisplay(Flags.DisplayName);
     Screen *screen = DefaultScreenOfDisplay(display);
 
@@ -915,76 +1232,160 @@ int handlePendingX11Events() {
         return FALSE;
     }
 
+    if (mGlobal.hasDestopWindow && mGlobal.ForceRestart) {
+        mDoRestartDueToDisplayChange = 1;
+        Flags.shutdownRequested = 1;
+        return FALSE;
+    }
+
     XFlush(mGlobal.display);
     while (XPending(mGlobal.display)) {
-        XEvent event;
-        XNextEvent(mGlobal.display, &event);
+        // Drain a batch of events before acting on any.
+        XEvent events[X11_EVENT_BATCH_SIZE];
+        int eventCount = 0;
+        while (eventCount < X11_EVENT_BATCH_SIZE &&
+            XPending(mGlobal.display)) {
+            XNextEvent(mGlobal.display, &events[eventCount++]);
+        }
 
-        // Check for Active window change through loop.
+        // Check for Active window change once per batch.
         const Window activeX11Window = getActiveX11Window();
         if (getActiveAppWindow() != activeX11Window) {
             onAppWindowChange(activeX11Window);
         }
 
-        // Perform X11 event action.
-        switch (event.type) {
-            case CreateNotify:
-                onWindowCreated(&event);
-                break;
+        for (int i = 0; i < eventCount; i++) {
+            if (!isConfigureEventSuperseded(events, eventCount, i)) {
+                handleX11Event(&events[i]);
+            }
+        }
+    }
 
-            case ReparentNotify:
-                onWindowReparent(&event);
-                break;
+    // Act on snow window and output changes seen above.
+    handleDisplayConfigurationChange();
 
-            case ConfigureNotify:
-                onWindowChanged(&event);
-                if (!isWindowBeingDragged()) {
-                    mGlobal.WindowsChanged++;
-                    if (event.xconfigure.window == mGlobal.SnowWin) {
-                        mMainWindowNeedsReconfiguration = true;
-                    }
-                }
-                break;
+    return TRUE;
+}
 
-            case MapNotify:
-                mGlobal.WindowsChanged++;
-                onWindowMapped(&event);
-                break;
+/** *********************************************************************
+ ** This method checks if a later ConfigureNotify in the batch
+ ** is for the same window. Only the last one of a drag needs
+ ** handling.
+ **/
+bool isConfigureEventSuperseded(XEvent* events,
+    int eventCount, int index) {
+    if (events[index].type != ConfigureNotify) {
+        return false;
+    }
 
-            case FocusIn:
-                onWindowFocused(&event);
-                break;
+    const Window window = events[index].xconfigure.window;
+    for (int i = index + 1; i < eventCount; i++) {
+        if (events[i].type == ConfigureNotify &&
+            events[i].xconfigure.window == window) {
+            return true;
+        }
+    }
+    return false;
+}
 
-            case FocusOut:
-                onWindowBlurred(&event);
-                break;
+/** *********************************************************************
+ ** This method performs the action for one X11 event.
+ **/
+void handleX11Event(XEvent* event) {
+    switch (event->type) {
+        case CreateNotify:
+            onWindowCreated(event);
+            break;
 
-            case UnmapNotify:
+        case ReparentNotify:
+            onWindowReparent(event);
+            break;
+
+        case ConfigureNotify:
+            onWindowChanged(event);
+            if (!isWindowBeingDragged()) {
                 mGlobal.WindowsChanged++;
-                onWindowUnmapped(&event);
-                break;
+                if (event->xconfigure.window == mGlobal.SnowWin) {
+                    mMainWindowNeedsReconfiguration = true;
+                }
+            }
+            break;
 
-            case DestroyNotify:
-                onWindowDestroyed(&event);
-                break;
+        case MapNotify:
+            mGlobal.WindowsChanged++;
+            onWindowMapped(event);
+            onScreenCoverMapped(event);
+            break;
 
-            default:
-                // Perform XFixes action.
-                int xfixes_event_base;
-                int xfixes_error_base;
-                if (XFixesQueryExtension(mGlobal.display,
-                    &xfixes_event_base, &xfixes_error_base)) {
-                    switch (event.type - xfixes_event_base) {
-                        case XFixesCursorNotify:
-                            onCursorChange(&event);
-                            break;
-                    }
+        case FocusIn:
+            onWindowFocused(event);
+            break;
+
+        case FocusOut:
+            onWindowBlurred(event);
+            break;
+
+        case UnmapNotify:
+            mGlobal.WindowsChanged++;
+            onWindowUnmapped(event);
+            onScreenCoverUnmapped(event);
+            break;
+
+        case DestroyNotify:
+            onWindowDestroyed(event);
+            onScreenCoverUnmapped(event);
+            break;
+
+        case PropertyNotify:
+            onRootPropertyChanged(event);
+            break;
+
+        default:
+            // Perform XFixes action.
+            if (xfixes_event_base_ >= 0) {
+                switch (event->type - xfixes_event_base_) {
+                    case XFixesCursorNotify:
+                        onCursorChange(event);
+                        break;
                 }
-                break;
-        }
+            }
+
+            // Perform RandR action.
+            if (xrandr_event_base_ >= 0) {
+                switch (event->type - xrandr_event_base_) {
+                    case RRScreenChangeNotify:
+                        onScreenChanged(event);
+                        break;
+
+                    case RRNotify:
+                        mOutputsNeedReconfiguration = true;
+                        mMainWindowNeedsReconfiguration = true;
+                        break;
+                }
+            }
+            break;
     }
+}
 
-    return TRUE;
+/** *********************************************************************
+ ** This method handles a RandR root size change. A new root
+ ** size restarts the app, as onTimerEventDisplayChanged() did
+ ** when polling. Otherwise outputs are read again.
+ **/
+void onScreenChanged(XEvent* event) {
+    XRRUpdateConfiguration(event);
+
+    const XRRScreenChangeNotifyEvent* change =
+        (XRRScreenChangeNotifyEvent*) event;
+    if (mGlobal.Wroot != (unsigned int) change->width ||
+        mGlobal.Hroot != (unsigned int) change->height) {
+        mDoRestartDueToDisplayChange = 1;
+        Flags.shutdownRequested = 1;
+        return;
+    }
+
+    mOutputsNeedReconfiguration = true;
+    mMainWindowNeedsReconfiguration = true;
 }
 
 /** *********************************************************************
@@ -993,6 +1394,8 @@ int handlePendingX11Events() {
 void RestartDisplay() {
     fflush(stdout);
 
+    initXAtoms();
+
     clearAllFallenSnowItems();
 
     initStarsModuleArrays();
@@ -1007,6 +1410,7 @@ void RestartDisplay() {
     if (!Flags.NoTrees) {
         cairo_region_destroy(mGlobal.TreeRegion);
         mGlobal.TreeRegion = cairo_region_create();
+        rebuildTreeMask();
     }
 
     if (!mGlobal.isDoubleBuffered) {
@@ -1014,6 +1418,32 @@ void RestartDisplay() {
     }
 }
 
+/** *********************************************************************
+ ** This method follows a snow window resize without the
+ ** teardown of RestartDisplay(). Sprites stay, stars and
+ ** trees move, the bottom snow is resampled to the new
+ ** width, and only size dependent layers are rebuilt, the
+ ** aurora by its own thread.
+ **/
+void resizeDisplay(int oldWidth, int oldHeight) {
+    resizeFallenSnowDesktopItems(oldWidth);
+
+    rescaleStarsModuleArrays(oldWidth, oldHeight);
+    setAllBulbPositions();
+
+    if (!Flags.NoTrees) {
+        rescaleScenery(oldWidth, oldHeight);
+    } else if (!Flags.NoKeepSnowOnTrees) {
+        reinit_treesnow_region();
+    }
+
+    lazyInitAuroraModule();
+
+    if (!mGlobal.isDoubleBuffered) {
+        clearGlobalSnowWindow();
+    }
+}
+
 /** *********************************************************************
  ** This method logs signal event shutdowns as fyi.
  **/
@@ -1078,6 +1508,9 @@ int drawCairoWindow(void* cc) {
  ** anything the first few times this function is called.
  **/
 void drawCairoWindowInternal(cairo_t* cc) {
+    // Background threads act on this frame's state.
+    publishWorldSnapshot();
+
     // Instabilities (?).
     static int counter = 0;
     if (counter * time_draw_all < 1.5) {
@@ -1097,6 +1530,9 @@ void drawCairoWindowInternal(cairo_t* cc) {
 
     } else if (!mGlobal.isDoubleBuffered) {
         XFlush(mGlobal.display);
+
+        // Merge all module erases, then clear them at once.
+        beginFrameDamage();
         moon_erase(0);
         Santa_erase(cc);
         eraseStarsFrame();
@@ -1104,6 +1540,9 @@ void drawCairoWindowInternal(cairo_t* cc) {
         birds_erase(0);
         removeAllStormItemsInItemset();
         eraseAuroraFrame();
+        clearFrameDamage(mGlobal.display, mGlobal.SnowWin,
+            mGlobal.xxposures);
+
         XFlush(mGlobal.display);
     }
 
@@ -1117,24 +1556,36 @@ void drawCairoWindowInternal(cairo_t* cc) {
         ty = mGlobal.SnowWinY;
     }
     cairo_translate(cc, tx, ty);
+    clipToOutputRects(cc);
 
     // Do all module draws.
     if (WorkspaceActive()) {
-        drawStarsFrame(cc);
-        drawLightsFrame(cc);
-        moon_draw(cc);
-        aurora_draw(cc);
-        drawMeteorFrame(cc);
-        drawSceneryFrame(cc);
-        birds_draw(cc);
-        drawFallenSnowFrame(cc);
+        const double frameStart = startProfileSample();
+
+        // Static layers come from cached backdrops, and
+        // only repaint what was cleared.
+        pushFrameDamageClip(cc);
+        drawSkyBackdrop(cc);
+        popFrameDamageClip(cc);
+
+        PROFILE(PROFILE_AURORA, aurora_draw(cc));
+        PROFILE(PROFILE_METEOR, drawMeteorFrame(cc));
+
+        pushFrameDamageClip(cc);
+        drawSceneryBackdrop(cc);
+        popFrameDamageClip(cc);
+
+        PROFILE(PROFILE_BIRDS, birds_draw(cc));
+        PROFILE(PROFILE_FALLENSNOW, drawFallenSnowFrame(cc));
         if (!Flags.ShowBirds || !Flags.FollowSanta) {
             // If Flags.FollowSanta, drawing of Santa
             // is done in Birds module.
-            Santa_draw(cc);
+            PROFILE(PROFILE_SANTA, Santa_draw(cc));
         }
-        treesnow_draw(cc);
-        snow_draw(cc);
+        PROFILE(PROFILE_TREESNOW, treesnow_draw(cc));
+        PROFILE(PROFILE_SNOW, snow_draw(cc));
+
+        endProfileSample(PROFILE_FRAME, frameStart);
     }
 
     // Draw app window outline.
@@ -1143,6 +1594,10 @@ void drawCairoWindowInternal(cairo_t* cc) {
     }
 
     cairo_restore(cc);
+    if (isShmPresentActive()) {
+        presentShmFrame(copyFrameDamage());
+    }
+    endFrameDamage();
     XFlush(mGlobal.display);
 }
 
@@ -1160,6 +1615,7 @@ void SetWindowScale() {
     } else {
         mGlobal.WindowScale = y;
     }
+    publishFlagChange(FLAG_EVENT_WINDOW_SCALE);
     P("WindowScale: %f\n", mGlobal.WindowScale);
 }
 
@@ -1183,11 +1639,17 @@ int handleDisplayConfigurationChange() {
     if (mPrevSnowWinWidth != mGlobal.SnowWinWidth ||
         mPrevSnowWinHeight != mGlobal.SnowWinHeight) {
         updateDisplayDimensions();
-        RestartDisplay();
+        resizeDisplay(mPrevSnowWinWidth, mPrevSnowWinHeight);
         mPrevSnowWinWidth = mGlobal.SnowWinWidth;
         mPrevSnowWinHeight = mGlobal.SnowWinHeight;
         SetWindowScale();
+    } else if (mOutputsNeedReconfiguration) {
+        // Same window, outputs moved within it.
+        lockFallenSnowSemaphore();
+        updateOutputRects();
+        unlockFallenSnowSemaphore();
     }
+    mOutputsNeedReconfiguration = false;
 
     fflush(stdout);
     return TRUE;
@@ -1206,18 +1668,66 @@ int drawTransparentWindow(gpointer widget) {
     return TRUE;
 }
 
+/** *********************************************************************
+ ** This method is the -frameclock tick: queues a draw on
+ ** every FrameClock'th display refresh, so each frame drawn
+ ** is one presented. time_draw_all follows the refresh.
+ **/
+gboolean handleTransparentWindowTick(GtkWidget* widget,
+    GdkFrameClock* clock, __attribute__((unused)) gpointer user_data) {
+    if (Flags.shutdownRequested) {
+        mTransparentWindowTickId = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    gint64 refreshUs = 0;
+    gdk_frame_clock_get_refresh_info(clock,
+        gdk_frame_clock_get_frame_time(clock), &refreshUs, NULL);
+    if (refreshUs <= 0) {
+        refreshUs = 1000000 / 60;
+    }
+    const int divisor = Flags.FrameClock > 0 ? Flags.FrameClock : 1;
+    mGlobal.frameClockInterval = refreshUs * 1.0e-6 * divisor;
+
+    if (gdk_frame_clock_get_frame_counter(clock) % divisor == 0) {
+        gtk_widget_queue_draw(widget);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
 /** *********************************************************************
  ** This method handles callbacks for cpufactor
  **/
 void HandleCpuFactor() {
+    updateCpuFactor();
+
+    addMethodToMainloop(PRIORITY_HIGH, time_init_snow, setKillFlakes);
+
+    addFlakeSystemTickToMainloop();
+    addWindowDrawMethodToMainloop();
+}
+
+/** *********************************************************************
+ ** This method sets cpufactor from -cpuload, stretched
+ ** further by the power policy.
+ **/
+void updateCpuFactor() {
     if (Flags.CpuLoad <= 0) {
         mGlobal.cpufactor = 1;
     } else {
         mGlobal.cpufactor = 100.0 / Flags.CpuLoad;
     }
+    mGlobal.cpufactor *= getPowerPolicyCpuFactor();
+}
 
-    addMethodToMainloop(PRIORITY_HIGH, time_init_snow, setKillFlakes);
+/** *********************************************************************
+ ** This method retimes the flake and draw timers for a new
+ ** power mode. Unlike a -cpuload change, flakes are kept.
+ **/
+void respondToPowerPolicyChange() {
+    updateCpuFactor();
 
+    addFlakeSystemTickToMainloop();
     addWindowDrawMethodToMainloop();
 }
 
@@ -1226,19 +1736,31 @@ void HandleCpuFactor() {
  **/
 void addWindowDrawMethodToMainloop() {
     if (mGlobal.hasTransparentWindow) {
-        if (mTransparentWindowGUID) {
-            g_source_remove(mTransparentWindowGUID);
+        remove_from_mainloop(&mTransparentWindowGUID);
+
+        if (Flags.FrameClock > 0 && !isBenchmarkActive()) {
+            if (!mTransparentWindowTickId) {
+                mTransparentWindowTickId = gtk_widget_add_tick_callback(
+                    mTransparentWindow, handleTransparentWindowTick,
+                    NULL, NULL);
+            }
+            return;
         }
-        mTransparentWindowGUID = addMethodWithArgToMainloop(PRIORITY_HIGH,
+        if (mTransparentWindowTickId) {
+            gtk_widget_remove_tick_callback(mTransparentWindow,
+                mTransparentWindowTickId);
+            mTransparentWindowTickId = 0;
+        }
+        mGlobal.frameClockInterval = 0;
+
+        mTransparentWindowGUID = addSimulationMethodWithArgToMainloop(PRIORITY_HIGH,
             time_draw_all, drawTransparentWindow, mTransparentWindow);
         return;
     }
 
-    if (mCairoWindowGUID) {
-        g_source_remove(mCairoWindowGUID);
-    }
+    remove_from_mainloop(&mCairoWindowGUID);
 
-    mCairoWindowGUID = addMethodWithArgToMainloop(PRIORITY_HIGH,
+    mCairoWindowGUID = addSimulationMethodWithArgToMainloop(PRIORITY_HIGH,
         time_draw_all, drawCairoWindow, mCairoWindow);
 }
 
@@ -20,6 +20,13 @@
 #-# 
 */
 
+/***********************************************************
+ * Module consts.
+ */
+// Most X11 events read before handling a batch.
+#define X11_EVENT_BATCH_SIZE 256
+
+
 /***********************************************************
  * Module Method stubs.
  */
@@ -48,7 +55,10 @@ void setGlobalFlakeColor(GdkRGBA);
 GdkRGBA getRGBFromString(char* colorString);
 
 void HandleCpuFactor();
+void updateCpuFactor();
+void respondToPowerPolicyChange();
 void RestartDisplay();
+void resizeDisplay(int oldWidth, int oldHeight);
 void appShutdownHook(int);
 
 int handleX11ErrorEvent(Display*, XErrorEvent*);
@@ -58,15 +68,26 @@ void handleX11CairoDisplayChange();
 
 void drawCairoWindowInternal(cairo_t* cc);
 int drawTransparentWindow(gpointer);
+gboolean handleTransparentWindowTick(GtkWidget* widget,
+    GdkFrameClock* clock, gpointer user_data);
 void addWindowDrawMethodToMainloop();
 gboolean handleTransparentWindowDrawEvents(
     GtkWidget*, cairo_t*, gpointer);
 void rectangle_draw(cairo_t*);
 
 int StartWindow();
+void StartBenchmarkWindow();
+int startMainWindow();
+bool isXscreensaverRequested();
+bool isLeanScreensaverActive();
+void setLeanScreensaverFlags();
 
 void SetWindowScale();
 int handlePendingX11Events();
+bool isConfigureEventSuperseded(XEvent* events,
+    int eventCount, int index);
+void handleX11Event(XEvent* event);
+void onScreenChanged(XEvent* event);
 int onTimerEventDisplayChanged();
 
 void mybindtestdomain();
@@ -76,6 +97,8 @@ void respondToWorkspaceSettingsChange();
 void setTransparentWindowAbove(GtkWindow* window);
 int updateWindowsList();
 
+void subscribeUISettingsUpdates();
+void updateAdvancedUserSettings();
 int doAllUISettingsUpdates();
 int do_stopafter();
 int handleDisplayConfigurationChange();
@@ -38,12 +38,19 @@
 #include "Aurora.h"
 #include "clocks.h"
 #include "Flags.h"
+#include "LoadMeasure.h"
+#include "MemoryStats.h"
 #include "plasmasnow.h"
+#include "Random.h"
 #include "safe_malloc.h"
 #include "snow.h"
+#define GSL_INTERP_MESSAGE
 #include "spline_interpol.h"
+#include "Suspend.h"
+#include "ThreadPolicy.h"
 #include "Utils.h"
 #include "windows.h"
+#include "WorldSnapshot.h"
 
 
 /** *********************************************************************
@@ -60,12 +67,22 @@ AuroraMap mAuroraMap;
 const double turnfuzz = 0.015;
 double alphamax = 0.7;
 
+// Front surface is drawn by aurora_draw(), the back one is
+// redrawn by the aurora thread, then they swap.
 cairo_surface_t* aurora_surface = NULL;
 cairo_surface_t* aurora_surface1 = NULL;
 
+cairo_t* aurora_front_cr = NULL;
 cairo_t* aurora_cr = NULL;
 
-unsigned short xsubi[3];
+// Vertical gradient strip, all aurora pillars are copies of it.
+cairo_surface_t* mAuroraStrip = NULL;
+int mAuroraStripWidth = 0;
+
+// Uniform noise for the parameter walk, drawn once and read
+// from a random start each cycle. Aurora thread only.
+float mAuroraNoise[AURORA_NOISE_TABLE];
+unsigned int mAuroraNoiseIndex = 0;
 
 
 /** *********************************************************************
@@ -103,6 +120,16 @@ void lazyInitAuroraModule() {
         Flags.AuroraBase = 10;
     }
 
+    // 1, 2 or 4: draw at 1/n of the resolution and upscale
+    if (Flags.AuroraResolution >= AURORA_RESOLUTION_MAX) {
+        Flags.AuroraResolution = AURORA_RESOLUTION_MAX;
+    } else if (Flags.AuroraResolution >= 2) {
+        Flags.AuroraResolution = 2;
+    } else {
+        Flags.AuroraResolution = 1;
+    }
+    mAuroraMap.resolution = Flags.AuroraResolution;
+
     // the aurora surface can be somewhat larger than SnowWinWidth
     // and will be placed somewhat to the left
     const int FUZZ = turnfuzz * mGlobal.SnowWinWidth;
@@ -114,23 +141,33 @@ void lazyInitAuroraModule() {
 
     aurora_setparms(&mAuroraMap);
 
-    // Remove existing surfaces.
-    if (aurora_surface) {
-        cairo_surface_destroy(aurora_surface);
-    }
-    if (aurora_surface1) {
-        cairo_surface_destroy(aurora_surface1);
-    }
-    if (aurora_cr) {
-        cairo_destroy(aurora_cr);
-    }
+    // Reallocate surfaces only if their size changed.
+    const int surfaceWidth = (mAuroraMap.width + mAuroraMap.resolution - 1) /
+        mAuroraMap.resolution;
+    const int surfaceHeight = (mAuroraMap.base + mAuroraMap.resolution - 1) /
+        mAuroraMap.resolution;
+    if (!aurora_surface ||
+        cairo_image_surface_get_width(aurora_surface) != surfaceWidth ||
+        cairo_image_surface_get_height(aurora_surface) != surfaceHeight) {
+        if (aurora_front_cr) {
+            cairo_destroy(aurora_front_cr);
+            cairo_destroy(aurora_cr);
+            cairo_surface_destroy(aurora_surface);
+            cairo_surface_destroy(aurora_surface1);
+        }
 
-    // Create new ones.
-    aurora_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-        mAuroraMap.width, mAuroraMap.base);
-    aurora_surface1 = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-        mAuroraMap.width, mAuroraMap.base);
-    aurora_cr = cairo_create(aurora_surface1);
+        aurora_surface = trackSurface(MEMORY_AURORA,
+            cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                surfaceWidth, surfaceHeight));
+        aurora_surface1 = trackSurface(MEMORY_AURORA,
+            cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                surfaceWidth, surfaceHeight));
+        aurora_front_cr = cairo_create(aurora_surface);
+        aurora_cr = cairo_create(aurora_surface1);
+    } else {
+        clearAuroraSurface(aurora_front_cr);
+        clearAuroraSurface(aurora_cr);
+    }
 
     if (!mAuroraHasBeenInitialized) {
         mAuroraHasBeenInitialized = true;
@@ -140,9 +177,7 @@ void lazyInitAuroraModule() {
         mAuroraMap.zaa = NULL;
         mAuroraMap.fuzz = NULL;
         mAuroraMap.lfuzz = 0;
-        xsubi[0] = drand48() * 100;
-        xsubi[1] = drand48() * 100;
-        xsubi[2] = drand48() * 100;
+        fillAuroraNoise();
         pthread_create(&mThread, NULL, do_aurora, &mAuroraMap);
     }
 
@@ -176,7 +211,14 @@ void aurora_draw(cairo_t *cr) {
     }
 
     lock_copy();
-    cairo_set_source_surface(cr, aurora_surface, mAuroraMap.x, 0);
+    cairo_save(cr);
+    cairo_translate(cr, mAuroraMap.x, 0);
+    cairo_scale(cr, mAuroraMap.resolution, mAuroraMap.resolution);
+    cairo_set_source_surface(cr, aurora_surface, 0, 0);
+    if (mAuroraMap.resolution > 1) {
+        cairo_pattern_set_filter(cairo_get_source(cr),
+            CAIRO_FILTER_BILINEAR);
+    }
 
     double alpha = mAuroraMap.alpha * 0.02 * Flags.AuroraBrightness;
     if (alpha > 1) {
@@ -186,6 +228,7 @@ void aurora_draw(cairo_t *cr) {
     }
 
     cairo_paint_with_alpha(cr, ALPHA * alpha);
+    cairo_restore(cr);
     unlock_copy();
 }
 
@@ -198,16 +241,69 @@ void eraseAuroraFrame() {
         mGlobal.xxposures);
 }
 
+/** *********************************************************************
+ ** This method returns the gradient strip for a step size,
+ ** made once and kept.
+ **/
+cairo_surface_t* getAuroraStrip(int step) {
+    if (mAuroraStrip && mAuroraStripWidth == step) {
+        return mAuroraStrip;
+    }
+    if (mAuroraStrip) {
+        cairo_surface_destroy(mAuroraStrip);
+    }
+
+    cairo_pattern_t* vpattern =
+        cairo_pattern_create_linear(0, 0, 0, AURORA_STRIP_HEIGHT);
+
+    cairo_pattern_add_color_stop_rgba(vpattern, 0.0, 1, 0, 1, 0.05);
+    cairo_pattern_add_color_stop_rgba(vpattern, 0.2, 1, 0, 1, 0.15);
+    cairo_pattern_add_color_stop_rgba(vpattern, 0.3, 0, 1, .8, 0.2);
+    cairo_pattern_add_color_stop_rgba(vpattern, 0.7, 0, 1, .8, 0.6);
+    cairo_pattern_add_color_stop_rgba(vpattern, 0.8, 0.2, 1, 0, 0.8);
+    cairo_pattern_add_color_stop_rgba(vpattern, 1.0, 0.1, 1, 0, 0.0);
+
+    mAuroraStrip = trackSurface(MEMORY_AURORA, cairo_image_surface_create(
+        CAIRO_FORMAT_ARGB32, step, AURORA_STRIP_HEIGHT));
+    mAuroraStripWidth = step;
+
+    cairo_t* vertcr = cairo_create(mAuroraStrip);
+    cairo_set_antialias(vertcr, CAIRO_ANTIALIAS_NONE);
+    cairo_set_source(vertcr, vpattern);
+    cairo_rectangle(vertcr, 0, 0, step, AURORA_STRIP_HEIGHT);
+    cairo_fill(vertcr);
+    cairo_destroy(vertcr);
+
+    cairo_pattern_destroy(vpattern);
+    return mAuroraStrip;
+}
+
+/** *********************************************************************
+ ** This method clears an aurora surface for redraw.
+ **/
+void clearAuroraSurface(cairo_t* cr) {
+    cairo_save(cr);
+    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(cr);
+    cairo_restore(cr);
+}
+
 /** *********************************************************************
  ** This method ...
  **/
 void* do_aurora(void* d) {
+    registerPolicyThread("ps-aurora", -1, false);
+    seedRandomThread(RANDOM_THREAD_AURORA);
+
     while (true) {
         if (Flags.shutdownRequested) {
             pthread_exit(NULL);
         }
+        waitWhileSimulationSuspended();
 
-        if (!Flags.ShowAurora || !WorkspaceActive()) {
+        WorldSnapshot world;
+        readWorldSnapshot(&world);
+        if (!Flags.ShowAurora || !world.isWorkspaceActive) {
             usleep((useconds_t) (1.0e6 * time_aurora /
                 (0.2 * Flags.AuroraSpeed)));
             continue;
@@ -217,9 +313,12 @@ void* do_aurora(void* d) {
         lock_init();
 
         AuroraMap* auroraMap = (AuroraMap*) d;
-        aurora_changeparms(auroraMap);
+        aurora_changeparms(auroraMap, world.snowWinWidth);
 
+        // Pillars are step pixels wide, one surface pixel.
         cairo_save(aurora_cr);
+        cairo_scale(aurora_cr, 1.0 / auroraMap->resolution,
+            1.0 / auroraMap->resolution);
         cairo_set_antialias(aurora_cr, CAIRO_ANTIALIAS_NONE);
         cairo_set_line_cap(aurora_cr, CAIRO_LINE_CAP_BUTT);
         cairo_set_line_cap(aurora_cr, CAIRO_LINE_CAP_SQUARE);
@@ -228,26 +327,10 @@ void* do_aurora(void* d) {
         // see https://www.cairographics.org/operators/
         cairo_set_operator(aurora_cr, CAIRO_OPERATOR_DIFFERENCE);
 
-        const int I_MAX = 100;
-        cairo_set_line_width(aurora_cr, auroraMap->step);
-        cairo_pattern_t* vpattern =
-            cairo_pattern_create_linear(0, 0, 0, I_MAX);
-
-        cairo_pattern_add_color_stop_rgba(vpattern, 0.0, 1, 0, 1, 0.05);
-        cairo_pattern_add_color_stop_rgba(vpattern, 0.2, 1, 0, 1, 0.15);
-        cairo_pattern_add_color_stop_rgba(vpattern, 0.3, 0, 1, .8, 0.2);
-        cairo_pattern_add_color_stop_rgba(vpattern, 0.7, 0, 1, .8, 0.6);
-        cairo_pattern_add_color_stop_rgba(vpattern, 0.8, 0.2, 1, 0, 0.8);
-        cairo_pattern_add_color_stop_rgba(vpattern, 1.0, 0.1, 1, 0, 0.0);
-
-        cairo_surface_t* vertsurf = cairo_image_surface_create(
-            CAIRO_FORMAT_ARGB32, auroraMap->step, I_MAX);
-        cairo_t* vertcr = cairo_create(vertsurf);
+        const int I_MAX = AURORA_STRIP_HEIGHT;
 
-        cairo_set_antialias(vertcr, CAIRO_ANTIALIAS_NONE);
-        cairo_set_source(vertcr, vpattern);
-        cairo_rectangle(vertcr, 0, 0, auroraMap->step, I_MAX);
-        cairo_fill(vertcr);
+        cairo_set_line_width(aurora_cr, auroraMap->step);
+        cairo_surface_t* vertsurf = getAuroraStrip(auroraMap->step);
 
         int zmin = auroraMap->step * auroraMap->z[0].x;
         int zmax = auroraMap->step * auroraMap->z[0].x;
@@ -274,39 +357,42 @@ void* do_aurora(void* d) {
             }
         }
 
-        // draw fuzz
-        for (int j = 0; j < auroraMap->nfuzz; j++) {
+        // draw fuzz, sparser at lower quality
+        const int fuzzStep = getQualityAuroraFuzzStep();
+        for (int j = 0; j < auroraMap->nfuzz; j += fuzzStep) {
             double alpha = 1.0;
             double d = 100;
             double scale = cscale(
                 I_MAX, d, auroraMap->hmax, auroraMap->fuzz[j].h, Flags.AuroraHeight);
             cairo_surface_set_device_scale(vertsurf, 1, scale);
-            if (1) {
-                cairo_set_source_surface(aurora_cr, vertsurf,
-                    auroraMap->step * auroraMap->fuzz[j].x,
-                    auroraMap->fuzz[j].y - I_MAX / scale);
+            cairo_set_source_surface(aurora_cr, vertsurf,
+                auroraMap->step * auroraMap->fuzz[j].x,
+                auroraMap->fuzz[j].y - I_MAX / scale);
+            if (Flags.AuroraFastFuzz) {
+                double fuzzAlpha = 2 * alpha * auroraMap->fuzz[j].a;
+                cairo_paint_with_alpha(aurora_cr,
+                    fuzzAlpha > 1 ? 1 : fuzzAlpha);
+            } else {
                 cairo_paint_with_alpha(aurora_cr, alpha * auroraMap->fuzz[j].a);
-                cairo_set_source_surface(aurora_cr, vertsurf,
-                    auroraMap->step * auroraMap->fuzz[j].x,
-                    auroraMap->fuzz[j].y - I_MAX / scale);
                 cairo_paint_with_alpha(aurora_cr, alpha * auroraMap->fuzz[j].a);
             }
         }
 
-        cairo_destroy(vertcr);
-        cairo_surface_destroy(vertsurf);
-        cairo_pattern_destroy(vpattern);
+        cairo_surface_set_device_scale(vertsurf, 1, 1);
         cairo_restore(aurora_cr);
 
+        // Swap front and back.
         lock_copy();
-            cairo_surface_destroy(aurora_surface);
-            cairo_destroy(aurora_cr);
+            cairo_surface_t* surface = aurora_surface;
             aurora_surface = aurora_surface1;
+            aurora_surface1 = surface;
+
+            cairo_t* cr = aurora_front_cr;
+            aurora_front_cr = aurora_cr;
+            aurora_cr = cr;
         unlock_copy();
 
-        aurora_surface1 = cairo_image_surface_create(
-            CAIRO_FORMAT_ARGB32, auroraMap->width, auroraMap->base);
-        aurora_cr = cairo_create(aurora_surface1);
+        clearAuroraSurface(aurora_cr);
 
         unlock_comp();
         unlock_init();
@@ -337,21 +423,21 @@ void aurora_setparms(AuroraMap* auroraMap) {
     auroraMap->y = 0;
 
     for (int i = 0; i < AURORA_POINTS; i++) {
-        auroraMap->points[i] = 0.2 + 0.4 * drand48();
+        auroraMap->points[i] = 0.2 + 0.4 * randomUniform();
         auroraMap->dpoints[i] = (2 * (i % 2) - 1) * 0.0005;
     }
 
     auroraMap->slantmax = 3;
     for (int i = 0; i < AURORA_S; i++) {
-        auroraMap->slant[i] = auroraMap->slantmax * (2 * drand48() - 1);
+        auroraMap->slant[i] = auroraMap->slantmax * (2 * randomUniform() - 1);
         auroraMap->dslant[i] = (2 * (i % 2) - 1) * 0.02;
     }
 
     auroraMap->fuzzleft = 0.1;
     auroraMap->fuzzright = 0.1;
-    auroraMap->alpha = drand48() * alphamax;
+    auroraMap->alpha = randomUniform() * alphamax;
     auroraMap->dalpha = 0.011;
-    auroraMap->theta = drand48() * 360;
+    auroraMap->theta = randomUniform() * 360;
     auroraMap->dtheta = 0.2;
 
     auroraMap->hmax = 0.6 * auroraMap->base;
@@ -359,26 +445,45 @@ void aurora_setparms(AuroraMap* auroraMap) {
         auroraMap->hmax = 3;
     }
     for (int i = 0; i < AURORA_H; i++) {
-        auroraMap->h[i] = 0.8 * drand48() + 0.2;
+        auroraMap->h[i] = 0.8 * randomUniform() + 0.2;
         auroraMap->dh[i] = (2 * (i % 2) - 1) * 0.01;
     }
     for (int i = 0; i < AURORA_A; i++) {
-        auroraMap->a[i] = 0.5 * drand48() + 0.5;
+        auroraMap->a[i] = 0.5 * randomUniform() + 0.5;
         auroraMap->da[i] = (2 * (i % 2) - 1) * 0.01;
     }
     for (int i = 0; i < AURORA_AA; i++) {
-        auroraMap->aa[i] = drand48();
+        auroraMap->aa[i] = randomUniform();
         auroraMap->daa[i] = (2 * (i % 2) - 1) * 0.01;
     }
 
-    auroraMap->step = 1;
-    aurora_computeparms(auroraMap);
+    auroraMap->step = auroraMap->resolution;
+    aurora_computeparms(auroraMap, mGlobal.SnowWinWidth);
+}
+
+/** *********************************************************************
+ ** This method draws the noise table the parameter walk
+ ** reads in place of a fresh random number per parameter.
+ **/
+void fillAuroraNoise() {
+    randomFill(mAuroraNoise, AURORA_NOISE_TABLE);
+    mAuroraNoiseIndex = 0;
+}
+
+/** *********************************************************************
+ ** This method returns the next uniform [0, 1) noise value.
+ **/
+double getAuroraNoise() {
+    return mAuroraNoise[mAuroraNoiseIndex++ & (AURORA_NOISE_TABLE - 1)];
 }
 
 /** *********************************************************************
  ** This method ...
  **/
-void aurora_changeparms(AuroraMap* auroraMap) {
+void aurora_changeparms(AuroraMap* auroraMap, int snowWinWidth) {
+    // a new start each cycle, so the walk doesn't repeat
+    mAuroraNoiseIndex = randomNext();
+
     auroraMap->alpha += auroraMap->dalpha;
     if (auroraMap->alpha > alphamax) {
         auroraMap->dalpha = -fabs(auroraMap->dalpha);
@@ -388,7 +493,7 @@ void aurora_changeparms(AuroraMap* auroraMap) {
 
     // global shape of aurora
     for (int i = 0; i < AURORA_POINTS; i++) {
-        auroraMap->points[i] += auroraMap->dpoints[i] * erand48(xsubi);
+        auroraMap->points[i] += auroraMap->dpoints[i] * getAuroraNoise();
         if (auroraMap->points[i] > 1) {
             auroraMap->points[i] = 1;
             auroraMap->dpoints[i] = -fabs(auroraMap->dpoints[i]);
@@ -400,7 +505,7 @@ void aurora_changeparms(AuroraMap* auroraMap) {
 
     // rotation angle
     double dt = 0.2;
-    auroraMap->theta += dt * auroraMap->dtheta * (erand48(xsubi) + 0.5);
+    auroraMap->theta += dt * auroraMap->dtheta * (getAuroraNoise() + 0.5);
     if (auroraMap->theta < 175) {
         auroraMap->theta = 175;
         auroraMap->dtheta = fabs(auroraMap->dtheta);
@@ -411,7 +516,7 @@ void aurora_changeparms(AuroraMap* auroraMap) {
 
     // slant
     for (int i = 0; i < AURORA_S; i++) {
-        auroraMap->slant[i] += auroraMap->dslant[i] * erand48(xsubi);
+        auroraMap->slant[i] += auroraMap->dslant[i] * getAuroraNoise();
         if (auroraMap->slant[i] > auroraMap->slantmax) {
             auroraMap->slant[i] = auroraMap->slantmax;
             auroraMap->dslant[i] = -fabs(auroraMap->dslant[i]);
@@ -423,7 +528,7 @@ void aurora_changeparms(AuroraMap* auroraMap) {
 
     // height of aurora
     for (int i = 0; i < AURORA_H; i++) {
-        auroraMap->h[i] += auroraMap->dh[i] * erand48(xsubi);
+        auroraMap->h[i] += auroraMap->dh[i] * getAuroraNoise();
         if (auroraMap->h[i] > 1) {
             auroraMap->h[i] = 1;
             auroraMap->dh[i] = -fabs(auroraMap->dh[i]);
@@ -435,7 +540,7 @@ void aurora_changeparms(AuroraMap* auroraMap) {
 
     // transparency of aurora
     for (int i = 0; i < AURORA_A; i++) {
-        auroraMap->a[i] += auroraMap->da[i] * erand48(xsubi);
+        auroraMap->a[i] += auroraMap->da[i] * getAuroraNoise();
         if (auroraMap->a[i] > 1.2) {
             auroraMap->a[i] = 1.2;
             auroraMap->da[i] = -fabs(auroraMap->da[i]);
@@ -447,7 +552,7 @@ void aurora_changeparms(AuroraMap* auroraMap) {
 
     // high frequency transparency of aurora
     for (int i = 0; i < AURORA_AA; i++) {
-        auroraMap->aa[i] += auroraMap->daa[i] * erand48(xsubi);
+        auroraMap->aa[i] += auroraMap->daa[i] * getAuroraNoise();
         if (auroraMap->aa[i] > 1.2) {
             auroraMap->aa[i] = 1.2;
             auroraMap->daa[i] = -fabs(auroraMap->daa[i]);
@@ -457,13 +562,13 @@ void aurora_changeparms(AuroraMap* auroraMap) {
         }
     }
 
-    aurora_computeparms(auroraMap);
+    aurora_computeparms(auroraMap, snowWinWidth);
 }
 
 /** *********************************************************************
  ** This method ...
  **/
-void aurora_computeparms(AuroraMap* auroraMap) {
+void aurora_computeparms(AuroraMap* auroraMap, int snowWinWidth) {
     if (auroraMap->z) {
         free(auroraMap->z);
         auroraMap->z = NULL;
@@ -484,7 +589,7 @@ void aurora_computeparms(AuroraMap* auroraMap) {
         if (auroraMap->z[i].y > ymax) {
             ymax = auroraMap->z[i].y;
         }
-        auroraMap->z[i].x += auroraMap->xoffset;
+        auroraMap->z[i].x += auroraMap->xoffset / auroraMap->step;
     }
 
     // prevent too large jumps in position of aurora
@@ -593,7 +698,7 @@ void aurora_computeparms(AuroraMap* auroraMap) {
         // add fuzz on turning points, second method
         // add some points with diminishing alpha
         auroraMap->nfuzz = 0;
-        int f = turnfuzz * mGlobal.SnowWinWidth;
+        int f = turnfuzz * snowWinWidth / auroraMap->step;
         int d0 = auroraMap->z[1].x - auroraMap->z[0].x;
 
         int j;
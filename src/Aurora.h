@@ -30,6 +30,9 @@
 #define AURORA_A 5                     // alpha
 #define AURORA_AA 200                  // high-frequency alpha
 #define AURORA_S 2 * AURORA_POINTS + 1 // slant
+#define AURORA_STRIP_HEIGHT 100        // gradient strip
+#define AURORA_NOISE_TABLE 1024        // parameter noise, power of 2
+#define AURORA_RESOLUTION_MAX 4        // coarsest surface divisor
 
 typedef struct _aurora_t {
         double y;
@@ -77,6 +80,7 @@ typedef struct _AuroraMap {
         aurora_t *z; // values computed from 'points'
 
         int step;    // step size in pixels computing aurora
+        int resolution; // surface pixels are resolution x resolution
 
         fuzz_t *fuzz;
         int lfuzz, nfuzz;
@@ -91,11 +95,16 @@ void aurora_draw(cairo_t* cr);
 void eraseAuroraFrame();
 
 void* do_aurora(void*);
+cairo_surface_t* getAuroraStrip(int step);
+void clearAuroraSurface(cairo_t* cr);
 
 
+void fillAuroraNoise();
+double getAuroraNoise();
+
 void aurora_setparms(AuroraMap* a);
-void aurora_changeparms(AuroraMap* a);
-void aurora_computeparms(AuroraMap* a);
+void aurora_changeparms(AuroraMap* a, int snowWinWidth);
+void aurora_computeparms(AuroraMap* a, int snowWinWidth);
 
 void create_aurora_base(const double* y, int n, double* slant,
     int nslant, double theta, int nw, int np, aurora_t** z, int* nz);
@@ -0,0 +1,151 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <gtk/gtk.h>
+
+#include "Backdrop.h"
+#include "Flags.h"
+#include "FrameProfiler.h"
+#include "Lights.h"
+#include "moon.h"
+#include "plasmasnow.h"
+#include "scenery.h"
+#include "Stars.h"
+
+
+/***********************************************************
+ * Module globals and consts.
+ *
+ * Slowly changing layers are drawn once into a window
+ * sized cache surface, and painted with a single blit on
+ * every frame. A layer keys its cache on the version
+ * counters of the modules in it plus the flags they read,
+ * and only redraws when that key changes. Layers keep the
+ * original stacking: sky (stars, lights, moon) below the
+ * aurora & meteors, scenery above them.
+ */
+typedef struct _BackdropLayer {
+        cairo_surface_t* surface;
+        int width, height;
+
+        uint64_t key;
+        bool isValid;
+} BackdropLayer;
+
+BackdropLayer mSkyBackdrop;
+BackdropLayer mSceneryBackdrop;
+
+
+/** *********************************************************************
+ ** This method folds one value into a layer key.
+ **/
+static uint64_t addToBackdropKey(uint64_t key, int64_t value) {
+    return (key ^ (uint64_t) value) * 1099511628211ULL;
+}
+
+/** *********************************************************************
+ ** This method paints a layer, redrawing its cache first
+ ** if the key changed or the window was resized.
+ **/
+static void drawBackdropLayer(cairo_t* cc, BackdropLayer* layer,
+    uint64_t key, void (*drawLayer)(cairo_t*)) {
+    const int width = mGlobal.SnowWinWidth;
+    const int height = mGlobal.SnowWinHeight;
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    // Window resized, recreate like the target.
+    if (!layer->surface || layer->width != width ||
+        layer->height != height) {
+        if (layer->surface) {
+            cairo_surface_destroy(layer->surface);
+        }
+        layer->surface = cairo_surface_create_similar(
+            cairo_get_target(cc), CAIRO_CONTENT_COLOR_ALPHA,
+            width, height);
+        layer->width = width;
+        layer->height = height;
+        layer->isValid = false;
+    }
+
+    if (!layer->isValid || layer->key != key) {
+        cairo_t* layerCR = cairo_create(layer->surface);
+        cairo_set_operator(layerCR, CAIRO_OPERATOR_CLEAR);
+        cairo_paint(layerCR);
+        cairo_set_operator(layerCR, CAIRO_OPERATOR_OVER);
+
+        drawLayer(layerCR);
+        cairo_destroy(layerCR);
+
+        layer->key = key;
+        layer->isValid = true;
+    }
+
+    // OVER is associative, so one blit of the layer equals
+    // drawing its modules one by one.
+    cairo_set_source_surface(cc, layer->surface, 0, 0);
+    cairo_paint(cc);
+}
+
+/** *********************************************************************
+ ** Sky layer: stars, lights & moon.
+ **/
+static void drawSkyLayer(cairo_t* cc) {
+    PROFILE(PROFILE_STARS, drawStarsFrame(cc));
+    PROFILE(PROFILE_LIGHTS, drawLightsFrame(cc));
+    PROFILE(PROFILE_MOON, moon_draw(cc));
+}
+
+void drawSkyBackdrop(cairo_t* cc) {
+    uint64_t key = 14695981039346656037ULL;
+    key = addToBackdropKey(key, getStarsVersion());
+    key = addToBackdropKey(key, getLightsVersion());
+    key = addToBackdropKey(key, getMoonVersion());
+    key = addToBackdropKey(key, Flags.Stars);
+    key = addToBackdropKey(key, Flags.ShowLights);
+    key = addToBackdropKey(key, Flags.Moon);
+    key = addToBackdropKey(key, Flags.Halo);
+    key = addToBackdropKey(key, Flags.Transparency);
+
+    PROFILE(PROFILE_BACKDROP, drawBackdropLayer(cc,
+        &mSkyBackdrop, key, drawSkyLayer));
+}
+
+/** *********************************************************************
+ ** Scenery layer: trees.
+ **/
+static void drawSceneryLayer(cairo_t* cc) {
+    PROFILE(PROFILE_SCENERY, drawSceneryFrame(cc));
+}
+
+void drawSceneryBackdrop(cairo_t* cc) {
+    uint64_t key = 14695981039346656037ULL;
+    key = addToBackdropKey(key, getSceneryVersion());
+    key = addToBackdropKey(key, Flags.NoTrees);
+    key = addToBackdropKey(key, Flags.Transparency);
+
+    PROFILE(PROFILE_BACKDROP, drawBackdropLayer(cc,
+        &mSceneryBackdrop, key, drawSceneryLayer));
+}
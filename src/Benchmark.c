@@ -0,0 +1,265 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "Benchmark.h"
+#include "ColorCodes.h"
+#include "FallenSnow.h"
+#include "Flags.h"
+#include "FrameProfiler.h"
+#include "plasmasnow.h"
+#include "safe_malloc.h"
+#include "Utils.h"
+#include "WinInfo.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+// A mainloop method on the simulated clock.
+typedef struct _BenchmarkTimer {
+        guint id;
+        gint priority;
+
+        double interval;
+        double due;
+
+        GSourceFunc func;
+        gpointer data;
+} BenchmarkTimer;
+
+BenchmarkTimer* mBenchmarkTimers = NULL;
+int mBenchmarkTimerCount = 0;
+int mBenchmarkTimerCapacity = 0;
+guint mBenchmarkNextTimerId = 1;
+
+double mBenchmarkClock = BENCHMARK_CLOCK_START;
+
+cairo_surface_t* mBenchmarkSurface = NULL;
+cairo_t* mBenchmarkCairo = NULL;
+
+
+/** *********************************************************************
+ ** This method returns if we run as a benchmark, rendering
+ ** offscreen on a simulated clock.
+ **/
+bool isBenchmarkActive() {
+    return Flags.Benchmark > 0;
+}
+
+/** *********************************************************************
+ ** This method returns the simulated clock, in seconds.
+ **/
+double getBenchmarkClock() {
+    return mBenchmarkClock;
+}
+
+/** *********************************************************************
+ ** This method adds a mainloop method to the simulated
+ ** clock, without the live timer jitter.
+ **/
+guint addBenchmarkTimer(gint priority, float time,
+    GSourceFunc func, gpointer data) {
+    if (mBenchmarkTimerCount == mBenchmarkTimerCapacity) {
+        mBenchmarkTimerCapacity = mBenchmarkTimerCapacity ?
+            2 * mBenchmarkTimerCapacity : 64;
+        mBenchmarkTimers = (BenchmarkTimer*) realloc(mBenchmarkTimers,
+            mBenchmarkTimerCapacity * sizeof(BenchmarkTimer));
+        REALLOC_CHECK(mBenchmarkTimers);
+    }
+
+    // Same ms resolution as g_timeout_add_full().
+    double interval = (int) (1000 * time) * 0.001;
+    if (interval < 0.001) {
+        interval = 0.001;
+    }
+
+    BenchmarkTimer* timer = &mBenchmarkTimers[mBenchmarkTimerCount++];
+    timer->id = mBenchmarkNextTimerId++;
+    timer->priority = priority;
+    timer->interval = interval;
+    timer->due = mBenchmarkClock + interval;
+    timer->func = func;
+    timer->data = data;
+
+    return timer->id;
+}
+
+/** *********************************************************************
+ ** This method removes a simulated clock method, if present.
+ **/
+void removeBenchmarkTimer(guint id) {
+    for (int i = 0; i < mBenchmarkTimerCount; i++) {
+        if (mBenchmarkTimers[i].id == id) {
+            mBenchmarkTimers[i] =
+                mBenchmarkTimers[--mBenchmarkTimerCount];
+            return;
+        }
+    }
+}
+
+/** *********************************************************************
+ ** This method returns the offscreen cairo context the
+ ** benchmark draws into.
+ **/
+cairo_t* getBenchmarkCairo() {
+    if (!mBenchmarkCairo) {
+        mBenchmarkSurface = cairo_image_surface_create(
+            CAIRO_FORMAT_ARGB32, Flags.BenchmarkWidth,
+            Flags.BenchmarkHeight);
+        mBenchmarkCairo = cairo_create(mBenchmarkSurface);
+    }
+
+    return mBenchmarkCairo;
+}
+
+/** *********************************************************************
+ ** This method installs a synthetic desktop of windows in
+ ** place of X queries, laid out from the fixed seed.
+ **/
+void startBenchmarkDesktop() {
+    const int count = Flags.BenchmarkWindows;
+
+    WinInfo* list = (WinInfo*) calloc(count > 0 ? count : 1,
+        sizeof(WinInfo));
+    MALLOC_CHECK(list);
+
+    for (int i = 0; i < count; i++) {
+        WinInfo* winInfo = &list[i];
+        winInfo->window = (Window) (0x7f000001 + i);
+        winInfo->frame = None;
+        winInfo->ws = mGlobal.currentWorkspace;
+
+        winInfo->w = mGlobal.SnowWinWidth * (0.20 + 0.25 * drand48());
+        winInfo->h = mGlobal.SnowWinHeight * (0.15 + 0.30 * drand48());
+        winInfo->x = drand48() * (mGlobal.SnowWinWidth - winInfo->w);
+        winInfo->y = mGlobal.SnowWinHeight * (0.15 + 0.70 * drand48());
+        winInfo->xa = winInfo->x;
+        winInfo->ya = winInfo->y;
+    }
+
+    lockFallenSnowSemaphore();
+    setWinInfoList(list, count);
+    doAllFallenSnowWinInfoUpdates();
+    unlockFallenSnowSemaphore();
+}
+
+/** *********************************************************************
+ ** This method returns the index of the next method due.
+ ** Ties go to higher priority, then to the older method.
+ **/
+static int getNextBenchmarkTimer() {
+    int next = 0;
+    for (int i = 1; i < mBenchmarkTimerCount; i++) {
+        const BenchmarkTimer* timer = &mBenchmarkTimers[i];
+        const BenchmarkTimer* best = &mBenchmarkTimers[next];
+
+        if (timer->due < best->due ||
+            (timer->due == best->due &&
+             (timer->priority < best->priority ||
+              (timer->priority == best->priority &&
+               timer->id < best->id)))) {
+            next = i;
+        }
+    }
+    return next;
+}
+
+/** *********************************************************************
+ ** This method reports the benchmark run to stdout.
+ **/
+static void logBenchmarkReport(double wallSeconds,
+    const struct mallinfo2* heapStart) {
+    const struct mallinfo2 heapEnd = mallinfo2();
+
+    double frameMs;
+    long frames;
+    getProfileTotals(PROFILE_FRAME, &frameMs, &frames);
+
+    printf("\n%splasmasnow: benchmark %d simulated seconds in %.3f s, "
+        "%dx%d, %d windows.%s\n", COLOR_YELLOW, Flags.Benchmark,
+        wallSeconds, Flags.BenchmarkWidth, Flags.BenchmarkHeight,
+        Flags.BenchmarkWindows, COLOR_NORMAL);
+    printf("plasmasnow: frames %ld, %.1f fps, %.1fx real time.\n",
+        frames, wallSeconds > 0 ? frames / wallSeconds : 0,
+        wallSeconds > 0 ? Flags.Benchmark / wallSeconds : 0);
+    printf("plasmasnow: heap in use %li -> %li bytes, arena %li -> "
+        "%li bytes.\n", heapStart->uordblks, heapEnd.uordblks,
+        heapStart->arena, heapEnd.arena);
+
+    printf("plasmasnow: %-16s %8s %10s %8s %8s\n", "module",
+        "calls", "total ms", "mean ms", "p95 ms");
+    for (int slot = 0; slot < PROFILE_SLOT_COUNT; slot++) {
+        double totalMs;
+        long count;
+        getProfileTotals(slot, &totalMs, &count);
+        if (count == 0) {
+            continue;
+        }
+
+        printf("plasmasnow: %-16s %8ld %10.1f %8.3f %8.3f\n",
+            getProfileSlotName(slot), count, totalMs, totalMs / count,
+            getProfilePercentile(slot, 0.95));
+    }
+    fflush(stdout);
+}
+
+/** *********************************************************************
+ ** This method runs all mainloop methods on the simulated
+ ** clock for -benchmark seconds, as fast as possible, then
+ ** reports and requests shutdown.
+ **/
+void runBenchmark() {
+    const struct mallinfo2 heapStart = mallinfo2();
+    const double wallStart = startProfileSample();
+    const double clockEnd = mBenchmarkClock + Flags.Benchmark;
+
+    while (!Flags.shutdownRequested && mBenchmarkTimerCount > 0) {
+        const int next = getNextBenchmarkTimer();
+        if (mBenchmarkTimers[next].due > clockEnd) {
+            break;
+        }
+
+        // Methods may add or remove methods, so call a copy.
+        const BenchmarkTimer timer = mBenchmarkTimers[next];
+        mBenchmarkTimers[next].due += timer.interval;
+        mBenchmarkClock = timer.due;
+
+        if (!timer.func(timer.data)) {
+            removeBenchmarkTimer(timer.id);
+        }
+    }
+
+    logBenchmarkReport(startProfileSample() - wallStart, &heapStart);
+
+    Flags.shutdownRequested = 1;
+
+    cairo_destroy(mBenchmarkCairo);
+    cairo_surface_destroy(mBenchmarkSurface);
+    mBenchmarkCairo = NULL;
+    mBenchmarkSurface = NULL;
+}
@@ -29,8 +29,10 @@
 #include "FallenSnow.h"
 #include "plasmasnow.h"
 #include "Flags.h"
+#include "snow.h"
 #include "Utils.h"
 #include "windows.h"
+#include "WorldSnapshot.h"
 
 
 /** *********************************************************************
@@ -43,7 +45,7 @@ int mBlowOffLockCounter = 0;
  ** This method initializes the Blowoff module.
  **/
 void initBlowoffModule() {
-    addMethodToMainloop(PRIORITY_DEFAULT,
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT,
         TIME_BETWEEN_BLOWOFF_FRAMES,
         updateBlowoffFrame);
 }
@@ -83,23 +85,32 @@ int updateBlowoffFrame() {
         return true;
     }
 
-    if (softLockFallenSnowBaseSemaphore(3, &mBlowOffLockCounter)) {
+    if (softReadLockFallenSnowList(3, &mBlowOffLockCounter)) {
         return true;
     }
 
-    // Loop through all fallen.
+    // Loop through all fallen, erosion goes into one batch.
+    FlakeSpawnBatch batch;
+    initFlakeSpawnBatch(&batch);
+    WorldSnapshot world;
+    readWorldSnapshot(&world);
+
     FallenSnow *fsnow = mGlobal.FsnowFirst;
     while (fsnow) {
         if (canSnowCollectOnFallen(fsnow)) {
             if (fsnow->winInfo.window == 0 ||
                 (!fsnow->winInfo.hidden &&
                 (isFallenSnowVisibleOnWorkspace(fsnow) || fsnow->winInfo.sticky))) {
-                updateFallenSnowWithWind(fsnow, fsnow->w / 4, fsnow->h / 4);
+                lockFallenSnowItem(fsnow);
+                updateFallenSnowWithWind(fsnow, fsnow->h / 4, &batch, &world);
+                unlockFallenSnowItem(fsnow);
             }
         }
         fsnow = fsnow->next;
     }
 
     unlockFallenSnowSemaphore();
+
+    flushFlakeSpawnBatch(&batch);
     return true;
 }
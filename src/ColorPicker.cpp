@@ -115,19 +115,29 @@ class PlasmaColorDialog : public QColorDialog {
 
 /***********************************************************
  ** Main Globals & initialization.
+ **
+ ** Built as a module of its own, loaded by ColorPickerLoader.c
+ ** the first time a color is picked. Until then, plasmasnow
+ ** pays nothing for Qt.
  **/
 static int argc = 1;
-static std::string argv[] = { "plasmasnowpicker" };
-static QApplication* mColorApp = new QApplication(argc, (char**) argv);
+static char* argv[] = { (char*) "plasmasnowpicker", nullptr };
+static QApplication* mColorApp = nullptr;
 
-static PlasmaColorDialog* mColorDialog = new PlasmaColorDialog();
+static PlasmaColorDialog* mColorDialog = nullptr;
 
 
 /***********************************************************
  ** Show the main dialog box, allow user interaction.
  **/
-extern "C"
-bool startQPickerDialog(char* colorTAG, char* colorAsString) {
+static bool startQPickerModuleDialog(char* colorTAG,
+    char* colorAsString) {
+    // Qt starts on the first pick.
+    if (mColorApp == nullptr) {
+        mColorApp = new QApplication(argc, argv);
+        mColorDialog = new PlasmaColorDialog();
+    }
+
     // Early out if we're alreaady active.
     if (mColorDialog->isQPickerActive()) {
         return false;
@@ -157,8 +167,7 @@ bool startQPickerDialog(char* colorTAG, char* colorAsString) {
 /***********************************************************
  ** Close the main dialog box.
  **/
-extern "C"
-void endQPickerDialog() {
+static void endQPickerModuleDialog() {
     mColorDialog->setQPickerActive(false);
     mColorDialog->setQPickerElementTAG(nullptr);
 }
@@ -167,10 +176,9 @@ void endQPickerDialog() {
 /***********************************************************
  ** Uninit all and terminate.
  **/
-extern "C"
-void uninitQPickerDialog() {
+static void uninitQPickerModuleDialog() {
     if (mColorApp != nullptr) {
-        endQPickerDialog();
+        endQPickerModuleDialog();
         mColorDialog->setAlreadyTerminated(true);
 
         mColorApp->closeAllWindows();
@@ -181,40 +189,54 @@ void uninitQPickerDialog() {
 /***********************************************************
  ** Getters for picker status.
  **/
-extern "C"
-char* getQPickerColorTAG() {
+static char* getQPickerModuleColorTAG() {
     return mColorDialog->getQPickerColorTAG();
 }
 
-extern "C"
-bool isQPickerActive() {
+static bool isQPickerModuleActive() {
     return mColorDialog->isQPickerActive();
 };
 
-extern "C"
-bool isQPickerVisible() {
+static bool isQPickerModuleVisible() {
     return mColorDialog->isVisible();
 }
 
-extern "C"
-bool isQPickerTerminated() {
+static bool isQPickerModuleTerminated() {
     return mColorDialog->isAlreadyTerminated();
 };
 
 /***********************************************************
  ** Getters for dialog results.
  **/
-extern "C"
-int getQPickerRed() {
+static int getQPickerModuleRed() {
     return mColorDialog->getPlasmaColor().red();
 };
 
-extern "C"
-int getQPickerGreen() {
+static int getQPickerModuleGreen() {
     return mColorDialog->getPlasmaColor().green();
 };
 
-extern "C"
-int getQPickerBlue() {
+static int getQPickerModuleBlue() {
     return mColorDialog->getPlasmaColor().blue();
 };
+
+/***********************************************************
+ ** Module entry point, the only symbol looked up.
+ **/
+static const QPickerModule mQPickerModule = {
+    startQPickerModuleDialog,
+    endQPickerModuleDialog,
+    uninitQPickerModuleDialog,
+    getQPickerModuleColorTAG,
+    isQPickerModuleActive,
+    isQPickerModuleVisible,
+    isQPickerModuleTerminated,
+    getQPickerModuleRed,
+    getQPickerModuleGreen,
+    getQPickerModuleBlue
+};
+
+extern "C"
+const QPickerModule* getQPickerModule() {
+    return &mQPickerModule;
+}
@@ -21,6 +21,42 @@
 */
 #pragma once
 
+#include <stdbool.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+// The Qt picker module, and its one entry point.
+#define QPICKER_MODULE_NAME  "plasmasnowpicker.so"
+#define QPICKER_MODULE_ENTRY "getQPickerModule"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _QPickerModule {
+        bool (*startDialog)(char* colorTAG, char* colorAsString);
+        void (*endDialog)();
+        void (*uninitDialog)();
+
+        char* (*getColorTAG)();
+
+        bool (*isActive)();
+        bool (*isVisible)();
+        bool (*isTerminated)();
+
+        int (*getRed)();
+        int (*getGreen)();
+        int (*getBlue)();
+} QPickerModule;
+
+typedef const QPickerModule* (*QPickerModuleEntry)();
+
+#ifdef __cplusplus
+}
+#endif
+
 
 /***********************************************************
  * Module Method stubs.
@@ -46,6 +82,9 @@ extern "C" {
      int getQPickerGreen();
      int getQPickerBlue();
 
+     // Exported by the Qt picker module only.
+     const QPickerModule* getQPickerModule();
+
 #ifdef __cplusplus
 }
 #endif
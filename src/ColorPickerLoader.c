@@ -0,0 +1,216 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+
+/***********************************************************
+ ** Color picker front end. The Qt picker is a module of its
+ ** own, loaded with dlopen() the first time a color is
+ ** picked; without it, a GTK color chooser stands in.
+ **/
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "ColorPicker.h"
+
+
+/***********************************************************
+ * Module globals.
+ */
+#ifndef PICKERDIR
+#define PICKERDIR "/usr/local/lib/plasmasnow"
+#endif
+
+// Qt module, once loaded.
+static bool mQPickerModuleTried = false;
+static const QPickerModule* mQPickerModule = NULL;
+
+// GTK stand in state, same life cycle as the Qt dialog.
+static GtkWidget* mGtkPickerDialog = NULL;
+static char* mGtkPickerColorTAG = NULL;
+static bool mGtkPickerActive = false;
+static bool mGtkPickerVisible = false;
+static GdkRGBA mGtkPickerColor = { 0, 0, 0, 1 };
+
+
+/** *********************************************************************
+ ** This method loads the Qt picker module, once. Installed
+ ** module first, then the library search path.
+ **/
+static const QPickerModule* getLoadedQPickerModule() {
+    if (mQPickerModuleTried) {
+        return mQPickerModule;
+    }
+    mQPickerModuleTried = true;
+
+    void* handle = dlopen(PICKERDIR "/" QPICKER_MODULE_NAME,
+        RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        handle = dlopen(QPICKER_MODULE_NAME, RTLD_NOW | RTLD_LOCAL);
+    }
+    if (!handle) {
+        fprintf(stderr, "plasmasnow: %s, using the GTK color "
+            "chooser.\n", dlerror());
+        return NULL;
+    }
+
+    QPickerModuleEntry entry = (QPickerModuleEntry)
+        dlsym(handle, QPICKER_MODULE_ENTRY);
+    if (!entry) {
+        fprintf(stderr, "plasmasnow: %s, using the GTK color "
+            "chooser.\n", dlerror());
+        dlclose(handle);
+        return NULL;
+    }
+
+    mQPickerModule = entry();
+    return mQPickerModule;
+}
+
+/** *********************************************************************
+ ** This method keeps the GTK chooser result. Cancel keeps the
+ ** color it was opened with, as the Qt dialog does.
+ **/
+static void onGtkPickerResponse(GtkDialog* dialog, gint response,
+    __attribute__((unused)) gpointer data) {
+    if (response == GTK_RESPONSE_OK) {
+        gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(dialog),
+            &mGtkPickerColor);
+    }
+
+    gtk_widget_hide(GTK_WIDGET(dialog));
+    mGtkPickerVisible = false;
+}
+
+/** *********************************************************************
+ ** This method opens the GTK stand in dialog.
+ **/
+static bool startGtkPickerDialog(char* colorTAG, char* colorAsString) {
+    if (mGtkPickerActive) {
+        return false;
+    }
+
+    if (!mGtkPickerDialog) {
+        mGtkPickerDialog = gtk_color_chooser_dialog_new(
+            "Select Color", NULL);
+        g_signal_connect(mGtkPickerDialog, "response",
+            G_CALLBACK(onGtkPickerResponse), NULL);
+        g_signal_connect(mGtkPickerDialog, "delete-event",
+            G_CALLBACK(gtk_widget_hide_on_delete), NULL);
+    }
+
+    GdkRGBA inColor;
+    if (gdk_rgba_parse(&inColor, colorAsString)) {
+        mGtkPickerColor = inColor;
+    }
+    gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(mGtkPickerDialog),
+        &mGtkPickerColor);
+
+    mGtkPickerColorTAG = colorTAG;
+    mGtkPickerActive = true;
+    mGtkPickerVisible = true;
+    gtk_widget_show(mGtkPickerDialog);
+    return true;
+}
+
+/***********************************************************
+ ** Show the main dialog box, allow user interaction.
+ **/
+bool startQPickerDialog(char* colorTAG, char* colorAsString) {
+    const QPickerModule* module = getLoadedQPickerModule();
+    return module ?
+        module->startDialog(colorTAG, colorAsString) :
+        startGtkPickerDialog(colorTAG, colorAsString);
+}
+
+/***********************************************************
+ ** Close the main dialog box.
+ **/
+void endQPickerDialog() {
+    if (mQPickerModule) {
+        mQPickerModule->endDialog();
+        return;
+    }
+
+    mGtkPickerActive = false;
+    mGtkPickerColorTAG = NULL;
+}
+
+/***********************************************************
+ ** Uninit all and terminate. Never loads Qt just for this.
+ **/
+void uninitQPickerDialog() {
+    if (mQPickerModule) {
+        mQPickerModule->uninitDialog();
+        return;
+    }
+
+    endQPickerDialog();
+    if (mGtkPickerDialog) {
+        gtk_widget_destroy(mGtkPickerDialog);
+        mGtkPickerDialog = NULL;
+    }
+}
+
+/***********************************************************
+ ** Getters for picker status. Polled all the time, so they
+ ** never load the module.
+ **/
+char* getQPickerColorTAG() {
+    return mQPickerModule ?
+        mQPickerModule->getColorTAG() : mGtkPickerColorTAG;
+}
+
+bool isQPickerActive() {
+    return mQPickerModule ?
+        mQPickerModule->isActive() : mGtkPickerActive;
+}
+
+bool isQPickerVisible() {
+    return mQPickerModule ?
+        mQPickerModule->isVisible() : mGtkPickerVisible;
+}
+
+bool isQPickerTerminated() {
+    return mQPickerModule ?
+        mQPickerModule->isTerminated() : false;
+}
+
+/***********************************************************
+ ** Getters for dialog results.
+ **/
+int getQPickerRed() {
+    return mQPickerModule ? mQPickerModule->getRed() :
+        (int) (mGtkPickerColor.red * 255 + 0.5);
+}
+
+int getQPickerGreen() {
+    return mQPickerModule ? mQPickerModule->getGreen() :
+        (int) (mGtkPickerColor.green * 255 + 0.5);
+}
+
+int getQPickerBlue() {
+    return mQPickerModule ? mQPickerModule->getBlue() :
+        (int) (mGtkPickerColor.blue * 255 + 0.5);
+}
@@ -0,0 +1,94 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+
+#include "DebrisPool.h"
+
+
+/** *********************************************************************
+ ** This method empties the pool.
+ **/
+void debrisPoolClear(DebrisPool* p) {
+    p->mHead = 0;
+    p->mCount = 0;
+    p->mLiveCount = 0;
+}
+
+/** *********************************************************************
+ ** This method adds a particle that drifts at vx, vy, and
+ ** fades out over life seconds.
+ **/
+void debrisPoolAdd(DebrisPool* p, float x, float y,
+    float vx, float vy, float life, unsigned int whatFlake) {
+    const int i = p->mHead;
+    p->mHead = (p->mHead + 1) % DEBRIS_POOL_CAPACITY;
+    if (p->mCount < DEBRIS_POOL_CAPACITY) {
+        p->mCount++;
+    }
+    p->mLiveCount++;
+
+    p->x[i] = x;
+    p->y[i] = y;
+    p->vx[i] = vx;
+    p->vy[i] = vy;
+    p->age[i] = 0;
+    p->life[i] = (life > 0.01f) ? life : 0.01f;
+    p->whatFlake[i] = whatFlake;
+}
+
+/** *********************************************************************
+ ** This method steps all particles by dt seconds in one
+ ** batch. Positions move dt * speedFactor. Once all have
+ ** faded, the ring starts over empty.
+ **/
+void debrisPoolStep(DebrisPool* p, float dt, float speedFactor) {
+    float* restrict x = p->x;
+    float* restrict y = p->y;
+    const float* restrict vx = p->vx;
+    const float* restrict vy = p->vy;
+    float* restrict age = p->age;
+    const float* restrict life = p->life;
+
+    const int n = p->mCount;
+    const float ds = dt * speedFactor;
+
+    int live = 0;
+    for (int i = 0; i < n; i++) {
+        x[i] += vx[i] * ds;
+        y[i] += vy[i] * ds;
+        age[i] += dt;
+        live += (age[i] < life[i]);
+    }
+
+    p->mLiveCount = live;
+    if (live == 0) {
+        debrisPoolClear(p);
+    }
+}
+
+/** *********************************************************************
+ ** This method returns how opaque a particle still is, from
+ ** 1 new to 0 faded out.
+ **/
+float debrisPoolAlpha(const DebrisPool* p, int i) {
+    const float alpha = 1 - p->age[i] / p->life[i];
+    return (alpha > 0) ? alpha : 0;
+}
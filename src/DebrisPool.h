@@ -0,0 +1,64 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdint.h>
+
+
+/***********************************************************
+ * DebrisPool consts.
+ */
+#define DEBRIS_POOL_CAPACITY 4096
+
+/***********************************************************
+ * Ring buffer of short-lived particles: fluff, and snow
+ * frozen on trees. They only drift and fade, so they carry
+ * none of a flake's state, and skip its step.
+ *
+ * Adding past capacity overwrites the oldest particle.
+ */
+typedef struct {
+    int mHead;                // next slot to fill
+    int mCount;               // slots in use, [0 .. mCount)
+    int mLiveCount;           // of those, not yet faded out
+
+    float x[DEBRIS_POOL_CAPACITY];
+    float y[DEBRIS_POOL_CAPACITY];
+    float vx[DEBRIS_POOL_CAPACITY];
+    float vy[DEBRIS_POOL_CAPACITY];
+
+    float age[DEBRIS_POOL_CAPACITY];
+    float life[DEBRIS_POOL_CAPACITY];
+
+    uint16_t whatFlake[DEBRIS_POOL_CAPACITY];
+} DebrisPool;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void debrisPoolClear(DebrisPool*);
+void debrisPoolAdd(DebrisPool*, float x, float y,
+    float vx, float vy, float life, unsigned int whatFlake);
+void debrisPoolStep(DebrisPool*, float dt, float speedFactor);
+
+float debrisPoolAlpha(const DebrisPool*, int);
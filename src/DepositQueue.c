@@ -0,0 +1,134 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "DepositQueue.h"
+#include "safe_malloc.h"
+
+
+/** *********************************************************************
+ ** DepositQueue lifecycle methods.
+ **/
+void depositQueueInit(DepositQueue* q, size_t capacity) {
+    // Round up to a power of two.
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    q->mMask = size - 1;
+    q->mCells = (DepositQueueCell*)
+        malloc(sizeof(DepositQueueCell) * size);
+    MALLOC_CHECK(q->mCells);
+
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->mCells[i].mSequence, i);
+    }
+
+    atomic_init(&q->mEnqueuePos, 0);
+    atomic_init(&q->mDequeuePos, 0);
+    atomic_init(&q->mDroppedCount, 0);
+}
+
+void depositQueueFree(DepositQueue* q) {
+    free(q->mCells);
+    q->mCells = NULL;
+}
+
+/** *********************************************************************
+ ** This method adds a deposit. Returns false, and counts a drop,
+ ** if the queue is full. Never blocks.
+ **/
+bool depositQueuePush(DepositQueue* q, void* item, int x, int w) {
+    DepositQueueCell* cell;
+    size_t pos = atomic_load_explicit(&q->mEnqueuePos,
+        memory_order_relaxed);
+
+    while (true) {
+        cell = &q->mCells[pos & q->mMask];
+        const size_t seq = atomic_load_explicit(&cell->mSequence,
+            memory_order_acquire);
+        const long diff = (long) seq - (long) pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->mEnqueuePos,
+                &pos, pos + 1, memory_order_relaxed,
+                memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&q->mDroppedCount, 1,
+                memory_order_relaxed);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->mEnqueuePos,
+                memory_order_relaxed);
+        }
+    }
+
+    cell->mItem = item;
+    cell->mX = x;
+    cell->mW = w;
+    atomic_store_explicit(&cell->mSequence, pos + 1,
+        memory_order_release);
+    return true;
+}
+
+/** *********************************************************************
+ ** This method takes the oldest deposit. Returns false if the
+ ** queue is empty.
+ **/
+bool depositQueuePop(DepositQueue* q, void** item, int* x, int* w) {
+    DepositQueueCell* cell;
+    size_t pos = atomic_load_explicit(&q->mDequeuePos,
+        memory_order_relaxed);
+
+    while (true) {
+        cell = &q->mCells[pos & q->mMask];
+        const size_t seq = atomic_load_explicit(&cell->mSequence,
+            memory_order_acquire);
+        const long diff = (long) seq - (long) (pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->mDequeuePos,
+                &pos, pos + 1, memory_order_relaxed,
+                memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->mDequeuePos,
+                memory_order_relaxed);
+        }
+    }
+
+    *item = cell->mItem;
+    *x = cell->mX;
+    *w = cell->mW;
+    atomic_store_explicit(&cell->mSequence, pos + q->mMask + 1,
+        memory_order_release);
+    return true;
+}
@@ -0,0 +1,62 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/***********************************************************
+ * Bounded lock-free multi-producer queue of snow deposits.
+ *
+ * Each cell carries a sequence number, so producers only
+ * race on the enqueue position, and a consumer never sees
+ * a half-written cell. Capacity is a power of two.
+ */
+typedef struct {
+    atomic_size_t mSequence;
+
+    void* mItem;
+    int mX;
+    int mW;
+} DepositQueueCell;
+
+typedef struct {
+    size_t mMask;
+    DepositQueueCell* mCells;
+
+    atomic_size_t mEnqueuePos;
+    atomic_size_t mDequeuePos;
+
+    atomic_size_t mDroppedCount;
+} DepositQueue;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void depositQueueInit(DepositQueue*, size_t capacity);
+void depositQueueFree(DepositQueue*);
+
+bool depositQueuePush(DepositQueue*, void* item, int x, int w);
+bool depositQueuePop(DepositQueue*, void** item, int* x, int* w);
@@ -19,41 +19,61 @@
 #-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #-# 
 */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE       // pthread_rwlockattr_setkind_np().
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
 #include <ctype.h>
+#include <limits.h>
 #include <math.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <X11/Intrinsic.h>
 #include <X11/Xlib.h>
 
-#include <gsl/gsl_errno.h>
-#include <gsl/gsl_sort.h>
-#include <gsl/gsl_spline.h>
-
 #include <gtk/gtk.h>
 
+#include "Benchmark.h"
 #include "Blowoff.h"
 #include "ColorCodes.h"
+#include "DepositQueue.h"
 #include "FallenSnow.h"
+#include "FallenSnowState.h"
+#include "FlakeKernels.h"
+#include "FrameDamage.h"
 #include "Flags.h"
+#include "FrameProfiler.h"
+#include "hashtable.h"
+#include "LoadMeasure.h"
+#include "MemoryStats.h"
+#include "Occlusion.h"
+#include "Outputs.h"
+#include "Random.h"
 #include "safe_malloc.h"
 #include "Santa.h"
 #include "snow.h"
 #include "spline_interpol.h"
+#include "Suspend.h"
+#include "ThreadPolicy.h"
+#include "TileRaster.h"
 #include "Utils.h"
 #include "WindowVector.h"
 #include "wind.h"
 #include "windows.h"
 #include "WinInfo.h"
+#include "WorldSnapshot.h"
+#include "XTraffic.h"
 
 
 /** *********************************************************************
@@ -63,44 +83,159 @@
 // Must stay snowfree area on display :)
 const int MAX_DESKTOP_SNOWFREE_HEIGHT = 25;
 const int MINIMUM_SPLINE_WIDTH = 3;
+const int NUMBER_OF_POINTS_FOR_AVERAGE = 10;
 
-// Semaphore & lock members.
+// Semaphore & lock members. The list lock is taken for
+// writing to change the list or item geometry, and for
+// reading to change snow heights, each item then being
+// guarded by its own lock.
 sem_t mFallenSnowSwapSemaphore;
-sem_t mFallenSnowBaseSemaphore;
+pthread_rwlock_t mFallenSnowListLock;
+
+// Lock attempts that found the lock taken.
+atomic_uint mFallenSnowListContention;
+atomic_uint mFallenSnowItemContention;
 
 pthread_t mFallenSnowBackgroundThread;
 
+// Pass counter for the quality governor render interval.
+unsigned int mFallenSnowPassCount = 0;
+bool mRenderFallenSnowThisPass = true;
+
 WindowVector mDeferredWindowRemovesList;
 
+// Window whose snow was moved by a drag, and may be a few
+// pixels off where its WinInfo settles.
+Window mDragSettleWindow = None;
+
+// Snow deposits from flake physics, drained by the lock holder.
+const int SNOW_DEPOSIT_QUEUE_CAPACITY = 8192;
+DepositQueue mSnowDepositQueue;
+
+// Deposits drained together, sorted by item and x.
+typedef struct _SnowDeposit {
+        FallenSnow* fsnow;
+        int x, w;
+} SnowDeposit;
+
+SnowDeposit* mSnowDepositBatch = NULL;
+int mSnowDepositBatchCapacity = 0;
+
+// Screen column index, x-span to candidate FallenSnow items.
+// Buckets hold items in FsnowFirst list order (CSR layout).
+const int COLUMN_INDEX_BUCKET_WIDTH = 64;
+
+bool mColumnIndexIsStale = true;
+int mColumnIndexBuckets = 0;
+int* mColumnIndexStart = NULL;
+FallenSnow** mColumnIndexItems = NULL;
+
+// Highest possible snow top per bucket, and a count of
+// rebuilds, for landing predictions.
+short int* mColumnIndexTop = NULL;
+unsigned int mColumnIndexEpoch = 0;
+
+// Surfaces to re-render this pass, split over a pool of
+// workers. Worker 0 is the FallenSnow thread itself, the
+// others pick the next task until the list is done.
+typedef struct _FallenSnowRenderWorker {
+        pthread_t thread;
+        sem_t startSemaphore;
+} FallenSnowRenderWorker;
+
+FallenSnow** mFallenSnowRenderTasks = NULL;
+int mFallenSnowRenderTaskCount = 0;
+int mFallenSnowRenderTaskCapacity = 0;
+atomic_int mFallenSnowRenderNextTask;
+
+FallenSnowRenderWorker mFallenSnowRenderWorkers
+    [FALLEN_SNOW_MAX_RENDER_WORKERS];
+int mFallenSnowRenderWorkerCount = 0;
+sem_t mFallenSnowRenderWorkersDone;
+
+// Items with a column over its max, so the desh adjust pass
+// can skip idle lists without taking a lock.
+atomic_int mFallenSnowOverMaxItems;
+
+// Window id to its FallenSnow item, kept with FsnowFirst.
+WindowMap* mFallenSnowIndex = NULL;
+
+// FallenSnow records live in pool chunks that never move, so
+// item pointers stay valid handles. A freed slot keeps its
+// column slab and surfaces for the next item to take.
+typedef struct _FallenSnowSlot {
+        FallenSnow item;          // first, slots cast to items.
+
+        void* slab;               // column arrays of the item.
+        size_t slabSize;
+
+        cairo_surface_t* spareSurfaceA;
+        cairo_surface_t* spareSurfaceB;
+} FallenSnowSlot;
+
+ObjectPool mFallenSnowSlots = OBJECT_POOL_INIT(FallenSnowSlot,
+    FALLEN_SNOW_ARENA_CHUNK, MEMORY_FALLENSNOW);
+
 
 /** *********************************************************************
  ** This method initializes the FallenSnow module.
  **/
 void initFallenSnowModule() {
+    depositQueueInit(&mSnowDepositQueue,
+        SNOW_DEPOSIT_QUEUE_CAPACITY);
     clearAllFallenSnowItems();
 
-    addMethodToMainloop(PRIORITY_DEFAULT,
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT,
         time_change_bottom, do_change_deshes);
 
-    addMethodToMainloop(PRIORITY_DEFAULT,
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT,
         time_adjust_bottom, do_adjust_deshes);
 
-    // Start main background thread looper & exit.
+    // Start main background thread looper & exit. A benchmark
+    // steps it on the simulated clock instead.
+    if (isBenchmarkActive()) {
+        addSimulationMethodToMainloop(PRIORITY_DEFAULT,
+            TIME_BETWWEEN_FALLENSNOW_THREADS,
+            stepFallenSnowBackgroundThread);
+        return;
+    }
     pthread_create(&mFallenSnowBackgroundThread, NULL,
         startFallenSnowBackgroundThread, NULL);
 }
 
+/** *********************************************************************
+ ** This method is one FallenSnow background pass, from
+ ** the mainloop.
+ **/
+int stepFallenSnowBackgroundThread() {
+    if (Flags.shutdownRequested) {
+        return false;
+    }
+
+    PROFILE(PROFILE_FALLENSNOW_TICK,
+        execFallenSnowBackgroundThread());
+    return true;
+}
+
 /** *********************************************************************
  ** This method is FallenSnow background thread looper.
  **/
 void* startFallenSnowBackgroundThread() {
+    registerPolicyThread("ps-fallen", -1, false);
+    seedRandomThread(RANDOM_THREAD_FALLENSNOW);
+    const int xtrafficSlot = getXTrafficSlot("fallensnow thread");
+
     while (true) {
         if (Flags.shutdownRequested) {
             pthread_exit(NULL);
         }
+        waitWhileSimulationSuspended();
 
         // Main thread method.
-        execFallenSnowBackgroundThread();
+        const int outerSlot = beginXTraffic(xtrafficSlot);
+        PROFILE(PROFILE_FALLENSNOW_TICK,
+            execFallenSnowBackgroundThread());
+        endXTraffic(outerSlot);
         usleep((useconds_t)
             TIME_BETWWEEN_FALLENSNOW_THREADS * 1000000);
     }
@@ -112,7 +247,10 @@ void* startFallenSnowBackgroundThread() {
  ** This method is FallenSnow background thread executor.
  **/
 int execFallenSnowBackgroundThread() {
-    if (!WorkspaceActive()) {
+    // One consistent copy of main thread state per pass.
+    WorldSnapshot world;
+    readWorldSnapshot(&world);
+    if (!world.isWorkspaceActive) {
         return 0;
     }
 
@@ -125,16 +263,27 @@ int execFallenSnowBackgroundThread() {
         return 0;
     }
 
-    lockFallenSnowSemaphore();
+    readLockFallenSnowList();
+
+    // Apply snow that landed since last time.
+    drainFallenSnowDeposits();
+
+    // The quality governor may render less often.
+    mFallenSnowPassCount++;
+    mRenderFallenSnowThisPass = (mFallenSnowPassCount %
+        getQualityFallenSnowRenderInterval()) == 0;
 
-    // Draw all fallen snow areas.
+    // Draw all changed fallen snow areas.
+    mFallenSnowRenderTaskCount = 0;
     FallenSnow* fallenSnowItem = mGlobal.FsnowFirst;
     while (fallenSnowItem) {
-        if (canSnowCollectOnFallen(fallenSnowItem)) {
-            collectSnowOnFallen(fallenSnowItem);
+        if (canSnowCollectOnFallenOnWorkspaces(fallenSnowItem,
+            world.visWorkSpaces, world.visWorkSpaceCount)) {
+            collectSnowOnFallen(fallenSnowItem, &world);
         }
         fallenSnowItem = fallenSnowItem->next;
     }
+    runFallenSnowRenderTasks();
 
     XFlush(mGlobal.display);
     swapFallenSnowRenderedSurfacesBToA();
@@ -150,9 +299,12 @@ void swapFallenSnowRenderedSurfacesBToA() {
 
     FallenSnow* fsnow = mGlobal.FsnowFirst;
     while (fsnow) {
-        cairo_surface_t* tempSurface = fsnow->renderedSurfaceB;
-        fsnow->renderedSurfaceB = fsnow->renderedSurfaceA;
-        fsnow->renderedSurfaceA = tempSurface;
+        if (fsnow->swapPending) {
+            cairo_surface_t* tempSurface = fsnow->renderedSurfaceB;
+            fsnow->renderedSurfaceB = fsnow->renderedSurfaceA;
+            fsnow->renderedSurfaceA = tempSurface;
+            fsnow->swapPending = false;
+        }
 
         fsnow = fsnow->next;
     }
@@ -160,6 +312,94 @@ void swapFallenSnowRenderedSurfacesBToA() {
     unlockFallenSnowSwapSemaphore();
 }
 
+/** *********************************************************************
+ ** This method queues snow landing on a fallensnow item, without
+ ** locking. It's applied later by drainFallenSnowDeposits().
+ **/
+void queueFallenSnowDeposit(FallenSnow* fsnow, int x, int w) {
+    depositQueuePush(&mSnowDepositQueue, fsnow, x, w);
+}
+
+/** *********************************************************************
+ ** This method applies all queued snow deposits. Deposits on
+ ** one item are raised one by one, then each run of
+ ** overlapping spans is smoothed once.
+ ** threads: locking by caller
+ **/
+static int compareSnowDeposits(const void* a, const void* b) {
+    const SnowDeposit* da = (const SnowDeposit*) a;
+    const SnowDeposit* db = (const SnowDeposit*) b;
+    if (da->fsnow != db->fsnow) {
+        return (da->fsnow < db->fsnow) ? -1 : 1;
+    }
+    return da->x - db->x;
+}
+
+void drainFallenSnowDeposits() {
+    int count = 0;
+
+    void* item;
+    int x, w;
+    while (depositQueuePop(&mSnowDepositQueue, &item, &x, &w)) {
+        if (count >= mSnowDepositBatchCapacity) {
+            mSnowDepositBatchCapacity = 2 * count + 64;
+            mSnowDepositBatch = (SnowDeposit*) realloc(mSnowDepositBatch,
+                mSnowDepositBatchCapacity * sizeof(SnowDeposit));
+            REALLOC_CHECK(mSnowDepositBatch);
+        }
+        mSnowDepositBatch[count++] = (SnowDeposit) {
+            (FallenSnow*) item, x, w };
+    }
+    if (!count) {
+        return;
+    }
+
+    if (!WorkspaceActive() || Flags.NoSnowFlakes ||
+        (Flags.NoKeepSnowOnWindows && Flags.NoKeepSnowOnBottom)) {
+        return;
+    }
+
+    qsort(mSnowDepositBatch, count, sizeof(SnowDeposit),
+        compareSnowDeposits);
+
+    for (int first = 0; first < count; ) {
+        FallenSnow* fsnow = mSnowDepositBatch[first].fsnow;
+        int last = first;
+        while (last < count && mSnowDepositBatch[last].fsnow == fsnow) {
+            last++;
+        }
+
+        if (canSnowCollectOnFallen(fsnow)) {
+            lockFallenSnowItem(fsnow);
+            for (int i = first; i < last; i++) {
+                raiseFallenSnowSpan(fsnow,
+                    mSnowDepositBatch[i].x, mSnowDepositBatch[i].w);
+            }
+
+            // Spans are sorted by x, merge the overlapping ones.
+            int spanStart = mSnowDepositBatch[first].x;
+            int spanEnd = spanStart + mSnowDepositBatch[first].w;
+            for (int i = first + 1; i <= last; i++) {
+                if (i < last && mSnowDepositBatch[i].x <= spanEnd) {
+                    const int end = mSnowDepositBatch[i].x +
+                        mSnowDepositBatch[i].w;
+                    if (end > spanEnd) {
+                        spanEnd = end;
+                    }
+                    continue;
+                }
+                smoothFallenSnowSpan(fsnow, spanStart, spanEnd - spanStart);
+                if (i < last) {
+                    spanStart = mSnowDepositBatch[i].x;
+                    spanEnd = spanStart + mSnowDepositBatch[i].w;
+                }
+            }
+            unlockFallenSnowItem(fsnow);
+        }
+        first = last;
+    }
+}
+
 /** *********************************************************************
  ** This method checks for & performs user changes of
  ** FallenSnow module settings.
@@ -177,11 +417,11 @@ void updateFallenSnowUserSettings() {
         clearGlobalSnowWindow();
     );
     UIDO(NoKeepSnowOnBottom,
-        clearAllFallenSnowItems();
+        discardAllFallenSnowItems();
         clearGlobalSnowWindow();
     );
     UIDO(NoKeepSnowOnWindows,
-        clearAllFallenSnowItems();
+        discardAllFallenSnowItems();
         clearGlobalSnowWindow();
     );
 
@@ -205,10 +445,14 @@ void updateFallenSnowDesktopItemDepth() {
  ** This method sets sets desktops fallensnow item maximum height.
  **/
 void updateFallenSnowDesktopItemHeight() {
-    FallenSnow* fsnow = findFallenSnowItemByWindow(None);
-    if (fsnow) {
-        fsnow->y = mGlobal.SnowWinHeight;
+    for (FallenSnow* fsnow = mGlobal.FsnowFirst; fsnow;
+        fsnow = fsnow->next) {
+        if (fsnow->winInfo.window == None) {
+            fsnow->y = getOutputBottom(fsnow->x, fsnow->w,
+                mGlobal.SnowWinHeight);
+        }
     }
+    invalidateFallenSnowColumnIndex();
 }
 
 /** *********************************************************************
@@ -227,31 +471,71 @@ void updateFallenSnowWithSnow(FallenSnow* fsnow,
         return;
     }
 
-    // tempHeightArray will contain the snowHeight values
-    // corresponding with position-1 .. position+width (inclusive).
-    short int* tempHeightArray;
-    tempHeightArray = (short int*)
-        malloc(sizeof(* tempHeightArray) * (width + 2));
+    raiseFallenSnowSpan(fsnow, position, width);
+    smoothFallenSnowSpan(fsnow, position, width);
+}
 
-    int imin = position;
-    if (imin < 0) {
-        imin = 0;
-    }
-    int imax = position + width;
-    if (imax > fsnow->w) {
-        imax = fsnow->w;
-    }
+/** *********************************************************************
+ ** Helper methods for deposits. The pad columns at [-1] and
+ ** [w] repeat the edge heights, so span copies need no
+ ** bounds checks.
+ **/
+static inline void padFallenSnowHeights(FallenSnow* fsnow) {
+    fsnow->snowHeight[-1] = fsnow->snowHeight[0];
+    fsnow->snowHeight[fsnow->w] = fsnow->snowHeight[fsnow->w - 1];
+}
 
-    int k = 0;
-    for (int i = imin - 1; i <= imax; i++) {
-        if (i < 0) {
-            tempHeightArray[k++] = fsnow->snowHeight[0];
-        } else if (i >= fsnow->w) {
-            tempHeightArray[k++] = fsnow->snowHeight[fsnow->w - 1];
-        } else {
-            tempHeightArray[k++] = fsnow->snowHeight[i];
+// Clip position .. position + width to the item.
+static inline bool clipFallenSnowSpan(FallenSnow* fsnow,
+    int position, int width, int* imin, int* imax) {
+    *imin = position < 0 ? 0 : position;
+    *imax = position + width > fsnow->w ? fsnow->w : position + width;
+    return *imin < *imax;
+}
+
+/** *********************************************************************
+ ** This method updates which columns of a span are above
+ ** their maximum, for do_adjust_deshes(). Heights only go
+ ** over by raises and by lower maximums; a bit left set by
+ ** snow removed otherwise is cleared by the next adjust.
+ ** threads: locking by caller
+ **/
+void trackFallenSnowOverMax(FallenSnow* fsnow, int imin, int imax) {
+    for (int i = imin; i < imax; i++) {
+        uint32_t* word = &fsnow->overMaxBits[i / 32];
+        const uint32_t bit = 1u << (i % 32);
+
+        const bool isOverMax =
+            fsnow->snowHeight[i] > fsnow->maxSnowHeight[i];
+        if (isOverMax != ((*word & bit) != 0)) {
+            *word ^= bit;
+            fsnow->overMaxCount += isOverMax ? 1 : -1;
+
+            if (isOverMax && fsnow->overMaxCount == 1) {
+                atomic_fetch_add(&mFallenSnowOverMaxItems, 1);
+            } else if (!isOverMax && fsnow->overMaxCount == 0) {
+                atomic_fetch_sub(&mFallenSnowOverMaxItems, 1);
+            }
         }
     }
+}
+
+/** *********************************************************************
+ ** This method raises the snow of a span, where it is low
+ ** compared to its neighbours.
+ ** threads: locking by caller
+ **/
+void raiseFallenSnowSpan(FallenSnow* fsnow, int position, int width) {
+    int imin, imax;
+    if (!clipFallenSnowSpan(fsnow, position, width, &imin, &imax)) {
+        return;
+    }
+
+    // heightScratch[k] is the height at imin - 1 + k.
+    padFallenSnowHeights(fsnow);
+    short int* tempHeightArray = fsnow->heightScratch;
+    memcpy(tempHeightArray, &fsnow->snowHeight[imin - 1],
+        (imax - imin + 2) * sizeof(short int));
 
     // Raise FallenSnow values.
     int amountToRaiseHeight;
@@ -263,7 +547,7 @@ void updateFallenSnowWithSnow(FallenSnow* fsnow,
         amountToRaiseHeight = 1;
     }
 
-    k = 1;
+    int k = 1;
     for (int i = imin; i < imax; i++) {
         if ((fsnow->maxSnowHeight[i] > tempHeightArray[k]) &&
             (tempHeightArray[k - 1] >= tempHeightArray[k] ||
@@ -274,37 +558,44 @@ void updateFallenSnowWithSnow(FallenSnow* fsnow,
         k++;
     }
 
-    // tempHeightArray will contain the new snowHeight values
-    // corresponding with position-1..position+width.
-    k = 0;
-    for (int i = imin - 1; i <= imax; i++) {
-        if (i < 0) {
-            tempHeightArray[k++] = fsnow->snowHeight[0];
-        } else if (i >= fsnow->w) {
-            tempHeightArray[k++] = fsnow->snowHeight[fsnow->w - 1];
-        } else {
-            tempHeightArray[k++] = fsnow->snowHeight[i];
-        }
-    }
+    trackFallenSnowOverMax(fsnow, imin, imax);
+}
 
-    // And now some smoothing.
-    k = 1;
-    for (int i = imin; i < imax; i++) {
-        int sum = 0;
-        for (int j = k - 1; j <= k + 1; j++) {
-            sum += tempHeightArray[j];
-        }
-        fsnow->snowHeight[i] = sum / 3;
-        k++;
+/** *********************************************************************
+ ** This method box smooths the snow of a span.
+ ** threads: locking by caller
+ **/
+void smoothFallenSnowSpan(FallenSnow* fsnow, int position, int width) {
+    int imin, imax;
+    if (!clipFallenSnowSpan(fsnow, position, width, &imin, &imax)) {
+        return;
     }
 
-    free(tempHeightArray);
+    padFallenSnowHeights(fsnow);
+    memcpy(fsnow->heightScratch, &fsnow->snowHeight[imin - 1],
+        (imax - imin + 2) * sizeof(short int));
+    flakeKernelsSmoothHeights(&fsnow->snowHeight[imin],
+        fsnow->heightScratch, imax - imin);
+
+    markFallenSnowDirty(fsnow, imin, imax - imin);
+    trackFallenSnowOverMax(fsnow, imin, imax);
 }
 
 /** *********************************************************************
  ** This method determines if a fallensnow item can collect snow.
+ ** Main thread only.
  **/
 int canSnowCollectOnFallen(FallenSnow* fsnow) {
+    return canSnowCollectOnFallenOnWorkspaces(fsnow,
+        mGlobal.VisWorkSpaces, mGlobal.NVisWorkSpaces);
+}
+
+/** *********************************************************************
+ ** This method determines if a fallensnow item can collect snow,
+ ** with the given workspaces visible.
+ **/
+int canSnowCollectOnFallenOnWorkspaces(FallenSnow* fsnow,
+    const long* visWorkSpaces, int visWorkSpaceCount) {
     // Is collecting for the desktop?
     if (fsnow->winInfo.window == None) {
         return !Flags.NoKeepSnowOnBottom;
@@ -314,8 +605,8 @@ int canSnowCollectOnFallen(FallenSnow* fsnow) {
         return false;
     }
 
-    if (!fsnow->winInfo.sticky &&
-        !isFallenSnowVisibleOnWorkspace(fsnow)) {
+    if (!fsnow->winInfo.sticky && !isFallenSnowOnWorkspaces(fsnow,
+        visWorkSpaces, visWorkSpaceCount)) {
         return false;
     }
 
@@ -324,12 +615,22 @@ int canSnowCollectOnFallen(FallenSnow* fsnow) {
 
 /** *********************************************************************
  ** This method determines if the fallensnow item is
- ** visible on the current workspace.
+ ** visible on the current workspace. Main thread only.
  **/
 int isFallenSnowVisibleOnWorkspace(FallenSnow* fsnow) {
+    return isFallenSnowOnWorkspaces(fsnow,
+        mGlobal.VisWorkSpaces, mGlobal.NVisWorkSpaces);
+}
+
+/** *********************************************************************
+ ** This method determines if the fallensnow item is on
+ ** one of the given workspaces.
+ **/
+int isFallenSnowOnWorkspaces(FallenSnow* fsnow,
+    const long* visWorkSpaces, int visWorkSpaceCount) {
     if (fsnow) {
-        for (int i = 0; i < mGlobal.NVisWorkSpaces; i++) {
-            if (mGlobal.VisWorkSpaces[i] == fsnow->winInfo.ws) {
+        for (int i = 0; i < visWorkSpaceCount; i++) {
+            if (visWorkSpaces[i] == fsnow->winInfo.ws) {
                 return true;
             }
         }
@@ -340,20 +641,168 @@ int isFallenSnowVisibleOnWorkspace(FallenSnow* fsnow) {
 
 /** *********************************************************************
  ** This method collects a fallen snow item from the display &
- ** performs Santa collision detection & actions.
+ ** performs Santa collision detection & actions, as of the
+ ** world state given.
  **/
-void collectSnowOnFallen(FallenSnow* fsnow) {
+void collectSnowOnFallen(FallenSnow* fsnow, const WorldSnapshot* world) {
     if (fsnow->winInfo.window == None ||
         (!fsnow->winInfo.hidden && (fsnow->winInfo.sticky ||
-        isFallenSnowVisibleOnWorkspace(fsnow)))) {
+        isFallenSnowOnWorkspaces(fsnow, world->visWorkSpaces,
+            world->visWorkSpaceCount)))) {
 
         // Check for Santa interaction.
-        if (!Flags.NoSanta && mGlobal.SantaPlowRegion) {
-            updateFallenSnowWithSanta(fsnow);
+        lockFallenSnowItem(fsnow);
+        if (!Flags.NoSanta && world->santaPlowRect.width > 0) {
+            updateFallenSnowWithSanta(fsnow, world);
+        }
+
+        // Nothing changed, keep current rendering. Changes
+        // skipped this pass stay dirty until the next one.
+        const bool isDirty = fsnow->dirtyStart < fsnow->dirtyEnd;
+        unlockFallenSnowItem(fsnow);
+        if (!isDirty || !mRenderFallenSnowThisPass) {
+            return;
+        }
+
+        // Hidden behind windows, render once exposed.
+        lockOcclusion();
+        const bool isOccluded = isAreaOccluded(fsnow->x,
+            fsnow->y - fsnow->h, fsnow->w, fsnow->h);
+        unlockOcclusion();
+        if (isOccluded) {
+            return;
         }
 
+        queueFallenSnowRender(fsnow);
+    }
+}
+
+/** *********************************************************************
+ ** This method adds a fallensnow item to this pass's
+ ** render tasks.
+ ** threads: locking by caller
+ **/
+void queueFallenSnowRender(FallenSnow* fsnow) {
+    if (mFallenSnowRenderTaskCount >= mFallenSnowRenderTaskCapacity) {
+        mFallenSnowRenderTaskCapacity =
+            MAX(2 * mFallenSnowRenderTaskCapacity, 16);
+        mFallenSnowRenderTasks = (FallenSnow**) realloc(
+            mFallenSnowRenderTasks, sizeof(FallenSnow*) *
+            mFallenSnowRenderTaskCapacity);
+        REALLOC_CHECK(mFallenSnowRenderTasks);
+    }
+
+    mFallenSnowRenderTasks[mFallenSnowRenderTaskCount++] = fsnow;
+}
+
+/** *********************************************************************
+ ** This method renders queued items until none are left.
+ ** Every item owns its surfaces and spline workspace, so
+ ** workers never touch the same one. The item lock keeps
+ ** main thread blow-off out of a render in progress.
+ **/
+void renderFallenSnowTasks() {
+    while (true) {
+        const int i = atomic_fetch_add(&mFallenSnowRenderNextTask, 1);
+        if (i >= mFallenSnowRenderTaskCount) {
+            return;
+        }
+
+        FallenSnow* fsnow = mFallenSnowRenderTasks[i];
+        lockFallenSnowItem(fsnow);
         renderFallenSnowSurfaceB(fsnow);
+        fsnow->dirtyStart = fsnow->dirtyEnd = 0;
+        fsnow->swapPending = true;
+        unlockFallenSnowItem(fsnow);
+    }
+}
+
+/** *********************************************************************
+ ** This method is a FallenSnow render worker looper.
+ **/
+void* execFallenSnowRenderWorker(void* arg) {
+    FallenSnowRenderWorker* worker = (FallenSnowRenderWorker*) arg;
+    registerPolicyThread("ps-fallen",
+        (int) (worker - mFallenSnowRenderWorkers), false);
+
+    while (true) {
+        sem_wait(&worker->startSemaphore);
+        renderFallenSnowTasks();
+        sem_post(&mFallenSnowRenderWorkersDone);
+    }
+    return NULL;
+}
+
+/** *********************************************************************
+ ** This method starts the render workers, one per cpu.
+ **/
+void initFallenSnowRenderWorkers() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    mFallenSnowRenderWorkerCount = cpus < 1 ? 1 :
+        (cpus > FALLEN_SNOW_MAX_RENDER_WORKERS ?
+        FALLEN_SNOW_MAX_RENDER_WORKERS : cpus);
+
+    sem_init(&mFallenSnowRenderWorkersDone, 0, 0);
+    for (int i = 1; i < mFallenSnowRenderWorkerCount; i++) {
+        FallenSnowRenderWorker* worker = &mFallenSnowRenderWorkers[i];
+        sem_init(&worker->startSemaphore, 0, 0);
+        if (pthread_create(&worker->thread, NULL,
+            execFallenSnowRenderWorker, worker) != 0) {
+            mFallenSnowRenderWorkerCount = i;
+            break;
+        }
+    }
+}
+
+/** *********************************************************************
+ ** This method renders this pass's queued items, on the
+ ** worker pool when there are enough of them. Benchmarks
+ ** render in place.
+ ** threads: locking by caller
+ **/
+void runFallenSnowRenderTasks() {
+    if (mFallenSnowRenderTaskCount == 0) {
+        return;
+    }
+    atomic_store(&mFallenSnowRenderNextTask, 0);
+
+    int workers = 1;
+    if (!isBenchmarkActive()) {
+        if (mFallenSnowRenderWorkerCount == 0) {
+            initFallenSnowRenderWorkers();
+        }
+        workers = MIN(mFallenSnowRenderWorkerCount,
+            mFallenSnowRenderTaskCount);
+    }
+
+    for (int w = 1; w < workers; w++) {
+        sem_post(&mFallenSnowRenderWorkers[w].startSemaphore);
+    }
+    renderFallenSnowTasks();
+    for (int w = 1; w < workers; w++) {
+        sem_wait(&mFallenSnowRenderWorkersDone);
+    }
+}
+
+/** *********************************************************************
+ ** This method marks an x-span of a fallensnow item as changed,
+ ** so the next FallenSnow thread pass re-renders it.
+ ** threads: locking by caller
+ **/
+void markFallenSnowDirty(FallenSnow* fsnow, int x, int w) {
+    int start = MAX(x, 0);
+    int end = MIN(x + w, fsnow->w);
+    if (start >= end) {
+        return;
     }
+
+    if (fsnow->dirtyStart < fsnow->dirtyEnd) {
+        start = MIN(start, fsnow->dirtyStart);
+        end = MAX(end, fsnow->dirtyEnd);
+    }
+
+    fsnow->dirtyStart = start;
+    fsnow->dirtyEnd = end;
 }
 
 /** *********************************************************************
@@ -380,17 +829,17 @@ void renderFallenSnowSurfaceB(FallenSnow* fsnow) {
 
     const short int* FALLEN_SNOW_HEIGHT = fsnow->snowHeight;
 
-    const int NUMBER_OF_POINTS_FOR_AVERAGE = 10;
     const int NUMBER_OF_AVERAGE_POINTS = MINIMUM_SPLINE_WIDTH +
         (FALLEN_WIDTH - 2) / NUMBER_OF_POINTS_FOR_AVERAGE;
 
-    // Allocate array.
-    double* averageHeightList = (double*)
-        malloc(NUMBER_OF_AVERAGE_POINTS * sizeof(double));
+    // Use the items persistent spline points.
+    SplineWorkspace* spline = &fsnow->splineWorkspace;
+    splineWorkspaceResize(spline, NUMBER_OF_AVERAGE_POINTS);
+
+    double* averageHeightList = spline->y;
     averageHeightList[0] = 0;
 
-    double* averageXPosList  = (double*)
-        malloc(NUMBER_OF_AVERAGE_POINTS * sizeof(double));
+    double* averageXPosList = spline->x;
     averageXPosList[0] = 0;
 
     for (int i = 0; i < NUMBER_OF_AVERAGE_POINTS -
@@ -438,15 +887,10 @@ void renderFallenSnowSurfaceB(FallenSnow* fsnow) {
     cairo_set_line_width(cr, 1);
     cairo_set_antialias(cr, CAIRO_ANTIALIAS_DEFAULT);
 
-    gsl_interp_accel* accelerator = gsl_interp_accel_alloc();
-
-    gsl_spline* spline = gsl_spline_alloc(SPLINE_INTERP,
-        NUMBER_OF_AVERAGE_POINTS);
-    gsl_spline_init(spline, averageXPosList, averageHeightList,
-        NUMBER_OF_AVERAGE_POINTS);
+    splineWorkspaceBuild(spline, NUMBER_OF_AVERAGE_POINTS);
 
-    cairo_set_source_rgb(cr, fsnow->columnColor[0].red,
-        fsnow->columnColor[0].green, fsnow->columnColor[0].blue);
+    // Coverage only, drawFallenSnowFrame() adds the color.
+    cairo_set_source_rgba(cr, 0, 0, 0, 1);
 
     enum { SEARCHING, DRAWING };
     int state = SEARCHING;
@@ -454,7 +898,7 @@ void renderFallenSnowSurfaceB(FallenSnow* fsnow) {
 
     for (int i = 0; i < FALLEN_WIDTH; ++i) {
         const int nextValue =
-            gsl_spline_eval(spline, i, accelerator);
+            splineWorkspaceEval(spline, i);
 
         switch (state) {
             case SEARCHING:
@@ -481,12 +925,6 @@ void renderFallenSnowSurfaceB(FallenSnow* fsnow) {
         }
     }
 
-    gsl_spline_free(spline);
-    gsl_interp_accel_free(accelerator);
-
-    free(averageXPosList);
-    free(averageHeightList);
-
     cairo_destroy(cr);
 }
 
@@ -494,23 +932,25 @@ void renderFallenSnowSurfaceB(FallenSnow* fsnow) {
  ** This method updates fallensnow items with impact
  ** of Santas sled ploughing.
  **/
-void updateFallenSnowWithSanta(FallenSnow* fsnow) {
+void updateFallenSnowWithSanta(FallenSnow* fsnow,
+    const WorldSnapshot* world) {
     const int SNOW_TO_PLOW = 5;
 
-    const bool IS_IT_IN = XRectInRegion(mGlobal.SantaPlowRegion,
-        fsnow->x, fsnow->y - fsnow->h, fsnow->w, fsnow->h);
-    if (IS_IT_IN != RectangleIn && IS_IT_IN != RectanglePart) {
+    // Plow rectangle must overlap the fallensnow area.
+    const cairo_rectangle_int_t PLOW = world->santaPlowRect;
+    if (PLOW.x >= fsnow->x + fsnow->w || PLOW.x + PLOW.width <= fsnow->x ||
+        PLOW.y >= fsnow->y || PLOW.y + PLOW.height <= fsnow->y - fsnow->h) {
         return;
     }
 
-    const int SANTA_FRONT = (mGlobal.SantaDirection == 0) ?
-        mGlobal.SantaX + mGlobal.SantaWidth - fsnow->x :
-        mGlobal.SantaX - fsnow->x;
-    const int SANTA_REAR = (mGlobal.SantaDirection == 0) ?
-        SANTA_FRONT - mGlobal.SantaWidth :
-        SANTA_FRONT + mGlobal.SantaWidth;
+    const int SANTA_FRONT = (world->santaDirection == 0) ?
+        world->santaX + world->santaWidth - fsnow->x :
+        world->santaX - fsnow->x;
+    const int SANTA_REAR = (world->santaDirection == 0) ?
+        SANTA_FRONT - world->santaWidth :
+        SANTA_FRONT + world->santaWidth;
 
-    float vy = -1.5 * mGlobal.ActualSantaSpeed;
+    float vy = -1.5 * world->actualSantaSpeed;
     if (vy > 0) {
         vy = -vy;
     }
@@ -519,31 +959,23 @@ void updateFallenSnowWithSanta(FallenSnow* fsnow) {
     }
 
     // Santa plows facing forward.
-    if (mGlobal.ActualSantaSpeed > 0) {
-        if (mGlobal.SantaDirection == 0) {
+    if (world->actualSantaSpeed > 0) {
+        if (world->santaDirection == 0) {
             generateFallenSnowFlakes(fsnow, SANTA_FRONT,
-                SNOW_TO_PLOW, vy, true);
+                SNOW_TO_PLOW, vy, world->newWind, true);
             eraseFallenSnowPartial(fsnow, SANTA_REAR -
-                SNOW_TO_PLOW, mGlobal.SantaWidth + 2 *
+                SNOW_TO_PLOW, world->santaWidth + 2 *
                 SNOW_TO_PLOW);
-            for (int i = 0; i < fsnow->w; i++) {
-                if (i < SANTA_FRONT + SNOW_TO_PLOW &&
-                    i >= SANTA_REAR - SNOW_TO_PLOW) {
-                    fsnow->snowHeight[i] = 0;
-                }
-            }
+            plowFallenSnowSpan(fsnow, SANTA_REAR - SNOW_TO_PLOW,
+                SANTA_FRONT + SNOW_TO_PLOW);
         } else {
             generateFallenSnowFlakes(fsnow, SANTA_FRONT -
-                SNOW_TO_PLOW, SNOW_TO_PLOW, vy, true);
+                SNOW_TO_PLOW, SNOW_TO_PLOW, vy, world->newWind, true);
             eraseFallenSnowPartial(fsnow, SANTA_REAR +
-                SNOW_TO_PLOW, mGlobal.SantaWidth + 2 *
+                SNOW_TO_PLOW, world->santaWidth + 2 *
                 SNOW_TO_PLOW);
-            for (int i = 0; i < fsnow->w; i++) {
-                if (i > SANTA_FRONT - SNOW_TO_PLOW &&
-                    i <= SANTA_REAR + SNOW_TO_PLOW) {
-                    fsnow->snowHeight[i] = 0;
-                }
-            }
+            plowFallenSnowSpan(fsnow, SANTA_FRONT - SNOW_TO_PLOW + 1,
+                SANTA_REAR + SNOW_TO_PLOW + 1);
         }
     }
 
@@ -551,32 +983,77 @@ void updateFallenSnowWithSanta(FallenSnow* fsnow) {
 }
 
 /** *********************************************************************
- ** This method updates fallensnow items with impact
- ** of wind.
+ ** This method clears the snow in columns [start, end),
+ ** marking only the part that held snow as dirty.
+ ** threads: locking by caller
  **/
-void updateFallenSnowWithWind(FallenSnow* fsnow,
-    int w, int h) {
-    const int x = randint(fsnow->w - w);
+void plowFallenSnowSpan(FallenSnow* fsnow, int start, int end) {
+    start = MAX(start, 0);
+    end = MIN(end, fsnow->w);
 
-    for (int i = x; i < x + w; i++) {
-        if (fsnow->snowHeight[i] > h) {
+    while (start < end && fsnow->snowHeight[start] == 0) {
+        start++;
+    }
+    while (end > start && fsnow->snowHeight[end - 1] == 0) {
+        end--;
+    }
+    if (start >= end) {
+        return;
+    }
 
-            if (!Flags.NoWind && mGlobal.Wind != 0 && drand48() > 0.5) {
-                const int numberOfFlakesToMake = getNumberOfFlakesToBlowoff();
-                for (int j = 0; j < numberOfFlakesToMake; j++) {
-                    SnowFlake* flake = MakeFlake(-1);
+    memset(&fsnow->snowHeight[start], 0,
+        sizeof(*fsnow->snowHeight) * (end - start));
+    markFallenSnowDirty(fsnow, start, end - start);
+}
 
-                    flake->rx = fsnow->x + i;
-                    flake->ry = fsnow->y - fsnow->snowHeight[i] - drand48() * 4;
-                    flake->vx = 0.25 * fsignf(mGlobal.NewWind) * mGlobal.WindMax;
-                    flake->vy = -10;
+/** *********************************************************************
+ ** This method erodes fallensnow in the wind. A cursor sweeps
+ ** the columns downwind, as fast as the wind blows. Blown
+ ** flakes go into the callers batch, spawned after the lock
+ ** is released; a full batch holds the cursor till next time.
+ ** Columns up to h deep keep their snow.
+ ** threads: locking by caller
+ **/
+void updateFallenSnowWithWind(FallenSnow* fsnow, int h,
+    FlakeSpawnBatch* batch, const WorldSnapshot* world) {
 
-                    // Not cyclic for Windows, cyclic for bottom.
-                    flake->cyclic = (fsnow->winInfo.window == 0);
-                }
-                eraseFallenSnowWindPixel(fsnow, i);
-            }
+    if (Flags.NoWind || world->wind == 0 ||
+        world->windMax <= 0 || fsnow->w <= 0) {
+        return;
+    }
+
+    const double strength = MIN(1.0,
+        fabs(world->newWind) / world->windMax);
+    fsnow->erosionCarry = MIN(fsnow->w, fsnow->erosionCarry +
+        strength * FALLEN_SNOW_EROSION_SHARE * fsnow->w);
+
+    const int direction = (world->newWind < 0) ? -1 : 1;
+    while (fsnow->erosionCarry >= 1) {
+        const int numberOfFlakesToMake = getNumberOfFlakesToBlowoff();
+        if (batch->count + numberOfFlakesToMake > FLAKE_SPAWN_BATCH) {
+            return;
+        }
+        fsnow->erosionCarry--;
+
+        const int i = fsnow->erosionCursor;
+        fsnow->erosionCursor = (i + direction + fsnow->w) % fsnow->w;
+        if (fsnow->snowHeight[i] <= h) {
+            continue;
+        }
+
+        for (int j = 0; j < numberOfFlakesToMake; j++) {
+            FlakeSpawn* spawn = addFlakeSpawn(batch);
+            spawn->rx = fsnow->x + i;
+            spawn->ry = fsnow->y - fsnow->snowHeight[i] -
+                randomUniform() * 4;
+            spawn->vx = 0.25 * fsignf(world->newWind) *
+                world->windMax;
+            spawn->vy = -10;
+
+            // Not cyclic for Windows, cyclic for bottom.
+            spawn->cyclic = (fsnow->winInfo.window == 0);
         }
+        eraseFallenSnowWindPixel(fsnow, i);
     }
 }
 
@@ -596,6 +1073,7 @@ void eraseFallenSnowWindPixel(FallenSnow *fsnow, int x) {
     }
 
     fsnow->snowHeight[x]--;
+    markFallenSnowDirty(fsnow, x, 1);
 }
 
 /** *********************************************************************
@@ -613,6 +1091,40 @@ int getFallenSnowItemcount() {
     return numberFallen;
 }
 
+/** *********************************************************************
+ ** This method returns the pixel bytes of a rendered surface,
+ ** none when it is missing or not an image.
+ **/
+static long getFallenSnowSurfaceBytes(cairo_surface_t* surface) {
+    if (!surface ||
+        cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+        return 0;
+    }
+    return (long) cairo_image_surface_get_stride(surface) *
+        cairo_image_surface_get_height(surface);
+}
+
+/** *********************************************************************
+ ** This method counts FallenSnow items, and their rendered
+ ** surfaces and the bytes those hold. Takes the list read lock.
+ **/
+void getFallenSnowSurfaceCounts(int* items, int* surfaces, long* bytes) {
+    *items = 0;
+    *surfaces = 0;
+    *bytes = 0;
+
+    readLockFallenSnowList();
+    for (FallenSnow* fsnow = mGlobal.FsnowFirst;
+        fsnow; fsnow = fsnow->next) {
+        (*items)++;
+        *surfaces += (fsnow->renderedSurfaceA != NULL) +
+            (fsnow->renderedSurfaceB != NULL);
+        *bytes += getFallenSnowSurfaceBytes(fsnow->renderedSurfaceA) +
+            getFallenSnowSurfaceBytes(fsnow->renderedSurfaceB);
+    }
+    unlockFallenSnowSemaphore();
+}
+
 /** *********************************************************************
  ** This method clears and inits the FallenSnow list.
  ** The initial list contains a single FallenSnow for Desktop.
@@ -620,19 +1132,109 @@ int getFallenSnowItemcount() {
 void clearAllFallenSnowItems() {
     lockFallenSnowSemaphore();
 
+    // Items pushed again below pick up their snow.
+    saveFallenSnowState();
+
     // Clear all fallen snow areas.
     while (mGlobal.FsnowFirst) {
         popAndFreeFallenSnowItem(&mGlobal.FsnowFirst);
     }
+    pushFallenSnowDesktopItems();
 
-    // Push Desktop FallenSnow with dummy WinInfo.
-    WinInfo* tempWinInfo = (WinInfo*) malloc(sizeof(WinInfo));
-    memset(tempWinInfo, 0, sizeof(WinInfo));
+    unlockFallenSnowSemaphore();
+}
+
+/** *********************************************************************
+ ** This method clears the FallenSnow list for settings that
+ ** remove the snow: unlike clearAllFallenSnowItems(), the
+ ** saved state is dropped, so the snow doesn't come back.
+ **/
+void discardAllFallenSnowItems() {
+    lockFallenSnowSemaphore();
 
-    pushFallenSnowItem(&mGlobal.FsnowFirst,
-        tempWinInfo, 0, mGlobal.SnowWinHeight,
-        mGlobal.SnowWinWidth, mGlobal.MaxScrSnowDepth);
-    free(tempWinInfo);
+    discardFallenSnowState();
+    while (mGlobal.FsnowFirst) {
+        popAndFreeFallenSnowItem(&mGlobal.FsnowFirst);
+    }
+    pushFallenSnowDesktopItems();
+
+    unlockFallenSnowSemaphore();
+}
+
+/** *********************************************************************
+ ** This method pushes the Desktop FallenSnow with dummy
+ ** WinInfo, one per output with -peroutput.
+ ** threads: locking by caller
+ **/
+void pushFallenSnowDesktopItems() {
+    WinInfo tempWinInfo;
+    memset(&tempWinInfo, 0, sizeof(WinInfo));
+
+    if (!hasOutputRects()) {
+        pushFallenSnowItem(&mGlobal.FsnowFirst,
+            &tempWinInfo, 0, mGlobal.SnowWinHeight,
+            mGlobal.SnowWinWidth, mGlobal.MaxScrSnowDepth);
+    }
+    for (int i = 0; i < getOutputRectCount(); i++) {
+        const OutputRect* rect = getOutputRect(i);
+        pushFallenSnowItem(&mGlobal.FsnowFirst,
+            &tempWinInfo, rect->x, rect->y + rect->height,
+            rect->width, MIN(mGlobal.MaxScrSnowDepth,
+                rect->height - MAX_DESKTOP_SNOWFREE_HEIGHT));
+    }
+}
+
+/** *********************************************************************
+ ** This method fits the Desktop FallenSnow to a resized
+ ** window, keeping its snow. New columns take the height
+ ** of the old column at the same relative x, window snow
+ ** stays as it is.
+ **/
+void resizeFallenSnowDesktopItems(int oldWidth) {
+    lockFallenSnowSemaphore();
+
+    // No queued deposit may land on a detached item.
+    drainFallenSnowDeposits();
+
+    // Detach the old Desktop items.
+    FallenSnow* oldItems = NULL;
+    for (FallenSnow** link = &mGlobal.FsnowFirst; *link;) {
+        FallenSnow* fsnow = *link;
+        if (fsnow->winInfo.window != None) {
+            link = &fsnow->next;
+            continue;
+        }
+        *link = fsnow->next;
+        fsnow->next = oldItems;
+        oldItems = fsnow;
+    }
+
+    pushFallenSnowDesktopItems();
+
+    for (FallenSnow* fsnow = mGlobal.FsnowFirst; fsnow;
+        fsnow = fsnow->next) {
+        if (fsnow->winInfo.window != None || oldWidth < 1) {
+            continue;
+        }
+
+        for (int i = 0; i < fsnow->w; i++) {
+            const int oldX = (long) (fsnow->x + i) * oldWidth /
+                mGlobal.SnowWinWidth;
+            for (FallenSnow* old = oldItems; old; old = old->next) {
+                if (oldX >= old->x && oldX < old->x + old->w) {
+                    fsnow->snowHeight[i] = MIN(
+                        old->snowHeight[oldX - old->x], fsnow->h);
+                    break;
+                }
+            }
+        }
+        padFallenSnowHeights(fsnow);
+        trackFallenSnowOverMax(fsnow, 0, fsnow->w);
+    }
+
+    while (oldItems) {
+        popAndFreeFallenSnowItem(&oldItems);
+    }
 
     unlockFallenSnowSemaphore();
 }
@@ -656,6 +1258,46 @@ void logAllFallenSnowItems() {
     printf("\n");
 }
 
+/** *********************************************************************
+ ** This method returns the window index of FsnowFirst. Items
+ ** come and go from updateWindowsList() before module init.
+ ** threads: locking by caller
+ **/
+static WindowMap* getFallenSnowIndex() {
+    if (!mFallenSnowIndex) {
+        mFallenSnowIndex = windowMapCreate();
+    }
+    return mFallenSnowIndex;
+}
+
+/** *********************************************************************
+ ** This method returns a cleared A8 mask of a size, reusing
+ ** a spare one when it fits. Fallen snow is one color, so
+ ** only its coverage is kept, and the color goes on at draw.
+ **/
+static cairo_surface_t* takeFallenSnowSurface(cairo_surface_t** spare,
+    cairo_surface_t* similar, int w, int h) {
+    cairo_surface_t* surface = *spare;
+    *spare = NULL;
+
+    if (surface && cairo_image_surface_get_width(surface) == w &&
+        cairo_image_surface_get_height(surface) == h) {
+        cairo_t* cr = cairo_create(surface);
+        cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+        cairo_paint(cr);
+        cairo_destroy(cr);
+        return surface;
+    }
+    if (surface) {
+        cairo_surface_destroy(surface);
+    }
+
+    return trackSurface(MEMORY_FALLENSNOW, similar ?
+        cairo_surface_create_similar(similar,
+            CAIRO_CONTENT_ALPHA, w, h) :
+        cairo_image_surface_create(CAIRO_FORMAT_A8, w, h));
+}
+
 /** *********************************************************************
  ** This method creates and adds a new FallenSnow item
  ** onto the linked-list.
@@ -667,9 +1309,11 @@ void pushFallenSnowItem(FallenSnow** fallenSnowArray,
         return;
     }
 
-    // Allocate new object.
-    FallenSnow* fallenSnowListItem = (FallenSnow*)
-        malloc(sizeof(FallenSnow));
+    // Take an arena slot.
+    FallenSnowSlot* slot = (FallenSnowSlot*)
+        object_pool_take(&mFallenSnowSlots);
+    MALLOC_CHECK(slot);
+    FallenSnow* fallenSnowListItem = &slot->item;
 
     fallenSnowListItem->winInfo = *winInfo;
 
@@ -683,19 +1327,35 @@ void pushFallenSnowItem(FallenSnow** fallenSnowArray,
     fallenSnowListItem->prevw = 10;
     fallenSnowListItem->prevh = 10;
 
-    fallenSnowListItem->renderedSurfaceA =
-        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
-    fallenSnowListItem->renderedSurfaceB =
-        cairo_surface_create_similar(fallenSnowListItem->renderedSurfaceA,
-        CAIRO_CONTENT_COLOR_ALPHA, w, h);
+    fallenSnowListItem->renderedSurfaceA = takeFallenSnowSurface(
+        &slot->spareSurfaceA, NULL, w, h);
+    fallenSnowListItem->renderedSurfaceB = takeFallenSnowSurface(
+        &slot->spareSurfaceB, fallenSnowListItem->renderedSurfaceA, w, h);
+
+    // Carve arrays from one slab: colors, over max bits, then
+    // max, next max, padded and scratch heights.
+    const int overMaxWords = (w + 31) / 32;
+    const size_t slabSize = sizeof(GdkRGBA) * w +
+        sizeof(uint32_t) * overMaxWords +
+        sizeof(short int) * (w + w + (w + 2) + (w + 2));
+    if (slot->slabSize < slabSize) {
+        tracked_free(slot->slab);
+        slot->slab = tracked_malloc(MEMORY_FALLENSNOW, slabSize);
+        MALLOC_CHECK(slot->slab);
+        slot->slabSize = slabSize;
+    }
 
-    // Allocate arrays.
-    fallenSnowListItem->columnColor   = (GdkRGBA *)
-        malloc(sizeof(*(fallenSnowListItem->columnColor)) * w);
-    fallenSnowListItem->snowHeight    = (short int *)
-        malloc(sizeof(*(fallenSnowListItem->snowHeight)) * w);
-    fallenSnowListItem->maxSnowHeight = (short int *)
-        malloc(sizeof(*(fallenSnowListItem->maxSnowHeight)) * w);
+    fallenSnowListItem->columnColor = (GdkRGBA*) slot->slab;
+    fallenSnowListItem->overMaxBits =
+        (uint32_t*) (fallenSnowListItem->columnColor + w);
+    fallenSnowListItem->maxSnowHeight =
+        (short int*) (fallenSnowListItem->overMaxBits + overMaxWords);
+    fallenSnowListItem->nextMaxSnowHeight =
+        fallenSnowListItem->maxSnowHeight + w;
+    fallenSnowListItem->snowHeight =
+        fallenSnowListItem->nextMaxSnowHeight + w + 1;
+    fallenSnowListItem->heightScratch =
+        fallenSnowListItem->snowHeight + w + 1;
 
     // Fill arrays.
     for (int i = 0; i < w; i++) {
@@ -704,11 +1364,36 @@ void pushFallenSnowItem(FallenSnow** fallenSnowArray,
         fallenSnowListItem->snowHeight[i] = 0;
         fallenSnowListItem->maxSnowHeight[i] = h;
     }
+    fallenSnowListItem->snowHeight[-1] = 0;
+    fallenSnowListItem->snowHeight[w] = 0;
+
+    memset(fallenSnowListItem->overMaxBits, 0,
+        sizeof(uint32_t) * overMaxWords);
+    fallenSnowListItem->overMaxCount = 0;
 
     CreateDesh(fallenSnowListItem);
+    restoreFallenSnowState(fallenSnowListItem);
+
+    // Spline points for rendering, sized once.
+    splineWorkspaceInit(&fallenSnowListItem->splineWorkspace,
+        MINIMUM_SPLINE_WIDTH + (w - 2) / NUMBER_OF_POINTS_FOR_AVERAGE);
+
+    pthread_mutex_init(&fallenSnowListItem->lock, NULL);
+
+    fallenSnowListItem->erosionCursor = randint(w);
+    fallenSnowListItem->erosionCarry = 0;
+
+    // Render once, even without snow.
+    fallenSnowListItem->dirtyStart = 0;
+    fallenSnowListItem->dirtyEnd = w;
+    fallenSnowListItem->swapPending = false;
 
     fallenSnowListItem->next = *fallenSnowArray;
     *fallenSnowArray = fallenSnowListItem;
+
+    windowMapInsert(getFallenSnowIndex(), winInfo->window,
+        fallenSnowListItem);
+    invalidateFallenSnowColumnIndex();
 }
 
 /** *********************************************************************
@@ -728,28 +1413,42 @@ void popAndFreeFallenSnowItem(FallenSnow** list) {
  ** This method frees all of a fallensnows memory allocations.
  **/
 void freeFallenSnowItem(FallenSnow* fallen) {
-    free(fallen->columnColor);
-    free(fallen->snowHeight);
-    free(fallen->maxSnowHeight);
+    // No queued deposit may outlive its item.
+    drainFallenSnowDeposits();
+    invalidateFallenSnowColumnIndex();
+
+    WindowMap* index = getFallenSnowIndex();
+    if (windowMapGet(index, fallen->winInfo.window) == fallen) {
+        windowMapRemove(index, fallen->winInfo.window);
+    }
+
+    if (fallen->overMaxCount > 0) {
+        atomic_fetch_sub(&mFallenSnowOverMaxItems, 1);
+    }
 
-    cairo_surface_destroy(fallen->renderedSurfaceA);
-    cairo_surface_destroy(fallen->renderedSurfaceB);
+    splineWorkspaceFree(&fallen->splineWorkspace);
+    pthread_mutex_destroy(&fallen->lock);
 
-    free(fallen);
+    // Back to the arena, keeping slab and surfaces.
+    FallenSnowSlot* slot = (FallenSnowSlot*) fallen;
+    slot->spareSurfaceA = fallen->renderedSurfaceA;
+    slot->spareSurfaceB = fallen->renderedSurfaceB;
+
+    object_pool_give(&mFallenSnowSlots, slot);
 }
 
 /** *********************************************************************
- ** This method creates a fallen snow items desh.
- ** threads: locking by caller
+ ** This method computes a new random desh for a fallen snow
+ ** item into maxSnowHeight. It only reads the items size and
+ ** window, so the thread changing the list needs no lock.
  **/
-void CreateDesh(FallenSnow* fallen) {
+void buildFallenSnowDesh(FallenSnow* fallen, short int* maxSnowHeight) {
     #define N 6
 
     int w = fallen->w;
     int h = fallen->h;
 
     int id = fallen->winInfo.window;
-    short int *maxSnowHeight = fallen->maxSnowHeight;
 
     double splinex[N];
     double spliney[N];
@@ -757,7 +1456,7 @@ void CreateDesh(FallenSnow* fallen) {
     randomuniqarray(splinex, N, 0.0000001, NULL);
     for (int i = 0; i < N; i++) {
         splinex[i] *= (w - 1);
-        spliney[i] = drand48();
+        spliney[i] = randomUniform();
     }
 
     splinex[0] = 0;
@@ -770,36 +1469,51 @@ void CreateDesh(FallenSnow* fallen) {
         spliney[N - 1] = 0;
     }
 
-    double *x = (double *) malloc(w * sizeof(double));
-    for (int i = 0; i < w; i++) {
-        x[i] = i;
-    }
-
-    double *y = (double *) malloc(w * sizeof(double));
-    spline_interpol(splinex, N, spliney, x, w, y);
-    free(x);
+    // Evaluate the knots straight into the heights.
+    double splinea[N];
+    double splineb[N];
+    double splinec[N];
+    SplineWorkspace spline = {
+        .mCapacity = N, .mPointCount = N, .mSegment = 0,
+        .x = splinex, .y = spliney,
+        .a = splinea, .b = splineb, .c = splinec
+    };
+    splineWorkspaceBuild(&spline, N);
+    splineWorkspaceEvalColumns(&spline, h, 2, maxSnowHeight, w);
+}
 
-    for (int i = 0; i < w; i++) {
-        maxSnowHeight[i] = h * y[i];
-        if (maxSnowHeight[i] < 2) {
-            maxSnowHeight[i] = 2;
-        }
-    }
-    free(y);
+/** *********************************************************************
+ ** This method creates a fallen snow items desh.
+ ** threads: locking by caller
+ **/
+void CreateDesh(FallenSnow* fallen) {
+    buildFallenSnowDesh(fallen, fallen->maxSnowHeight);
+    trackFallenSnowOverMax(fallen, 0, fallen->w);
 }
 
 /** *********************************************************************
- ** This method changes a fallen snow items desh.
+ ** This method changes a fallen snow items desh. New deshes
+ ** are built without locking, the list only changing on this
+ ** thread, then swapped in under the item lock.
  **/
 int do_change_deshes() {
-    static int mBlowOffLockCounter;
-    if (softLockFallenSnowBaseSemaphore(3, &mBlowOffLockCounter)) {
-        return true;
+    FallenSnow* fsnow = mGlobal.FsnowFirst;
+    while (fsnow) {
+        buildFallenSnowDesh(fsnow, fsnow->nextMaxSnowHeight);
+        fsnow = fsnow->next;
     }
 
-    FallenSnow* fsnow = mGlobal.FsnowFirst;
+    readLockFallenSnowList();
+
+    fsnow = mGlobal.FsnowFirst;
     while (fsnow) {
-        CreateDesh(fsnow);
+        lockFallenSnowItem(fsnow);
+        short int* maxSnowHeight = fsnow->maxSnowHeight;
+        fsnow->maxSnowHeight = fsnow->nextMaxSnowHeight;
+        fsnow->nextMaxSnowHeight = maxSnowHeight;
+        trackFallenSnowOverMax(fsnow, 0, fsnow->w);
+        unlockFallenSnowItem(fsnow);
+
         fsnow = fsnow->next;
     }
 
@@ -811,17 +1525,42 @@ int do_change_deshes() {
  ** This method changes a fallen snow items desh height down.
  **/
 int do_adjust_deshes(__attribute__((unused))void* dummy) {
-    lockFallenSnowSemaphore();
+    // Almost always, no column is over its max.
+    if (atomic_load(&mFallenSnowOverMaxItems) == 0) {
+        return true;
+    }
+
+    readLockFallenSnowList();
 
     FallenSnow *fsnow = mGlobal.FsnowFirst;
     while (fsnow) {
-        for (int i = 0; i < fsnow->w; i++) {
-            const int HEIGHT_ABOVE_MAX = fsnow->snowHeight[i] -
-                fsnow->maxSnowHeight[i];
-            if (HEIGHT_ABOVE_MAX > 0) {
-                fsnow->snowHeight[i]--;
+        lockFallenSnowItem(fsnow);
+        if (fsnow->overMaxCount == 0) {
+            unlockFallenSnowItem(fsnow);
+            fsnow = fsnow->next;
+            continue;
+        }
+
+        // Visit only the columns marked over max.
+        const int words = (fsnow->w + 31) / 32;
+        for (int k = 0; k < words; k++) {
+            if (!fsnow->overMaxBits[k]) {
+                continue;
+            }
+
+            const int last = MIN(32 * k + 32, fsnow->w);
+            for (int i = 32 * k; i < last; i++) {
+                if (!(fsnow->overMaxBits[k] & (1u << (i % 32)))) {
+                    continue;
+                }
+                if (fsnow->snowHeight[i] > fsnow->maxSnowHeight[i]) {
+                    fsnow->snowHeight[i]--;
+                    markFallenSnowDirty(fsnow, i, 1);
+                }
+                trackFallenSnowOverMax(fsnow, i, i + 1);
             }
         }
+        unlockFallenSnowItem(fsnow);
 
         fsnow = fsnow->next;
     }
@@ -834,16 +1573,153 @@ int do_adjust_deshes(__attribute__((unused))void* dummy) {
  ** This method returns a fallensnow area for a window.
  **/
 FallenSnow* findFallenSnowItemByWindow(Window window) {
-    FallenSnow* fallenSnow = mGlobal.FsnowFirst;
+    return (FallenSnow*) windowMapGet(getFallenSnowIndex(), window);
+}
 
-    while (fallenSnow) {
-        if (fallenSnow->winInfo.window == window) {
-            return fallenSnow;
+/** *********************************************************************
+ ** This method marks the screen column index for rebuild, after
+ ** the FallenSnow set or an item x-span has changed.
+ ** threads: locking by caller
+ **/
+void invalidateFallenSnowColumnIndex() {
+    mColumnIndexIsStale = true;
+}
+
+/** *********************************************************************
+ ** This method rebuilds the screen column index.
+ ** threads: main thread only, it's the only one changing the list.
+ **/
+void rebuildFallenSnowColumnIndex() {
+    mColumnIndexBuckets = mGlobal.SnowWinWidth /
+        COLUMN_INDEX_BUCKET_WIDTH + 1;
+
+    mColumnIndexStart = (int*) tracked_realloc(MEMORY_FALLENSNOW,
+        mColumnIndexStart,
+        sizeof(int) * (mColumnIndexBuckets + 1));
+    REALLOC_CHECK(mColumnIndexStart);
+    memset(mColumnIndexStart, 0,
+        sizeof(int) * (mColumnIndexBuckets + 1));
+
+    // Count items per bucket.
+    for (FallenSnow* fsnow = mGlobal.FsnowFirst;
+        fsnow; fsnow = fsnow->next) {
+        int first, last;
+        getFallenSnowColumnIndexSpan(fsnow, &first, &last);
+        for (int b = first; b <= last; b++) {
+            mColumnIndexStart[b + 1]++;
         }
-        fallenSnow = fallenSnow->next;
+    }
+    for (int b = 0; b < mColumnIndexBuckets; b++) {
+        mColumnIndexStart[b + 1] += mColumnIndexStart[b];
     }
 
-    return NULL;
+    // Fill buckets, keeping list order.
+    const int totalItems = mColumnIndexStart[mColumnIndexBuckets];
+    mColumnIndexItems = (FallenSnow**) tracked_realloc(MEMORY_FALLENSNOW,
+        mColumnIndexItems,
+        sizeof(FallenSnow*) * (totalItems + 1));
+    REALLOC_CHECK(mColumnIndexItems);
+
+    const ScratchMark mark = scratch_mark();
+    int* fill = (int*) scratch_alloc(sizeof(int) * mColumnIndexBuckets);
+    MALLOC_CHECK(fill);
+    memcpy(fill, mColumnIndexStart, sizeof(int) * mColumnIndexBuckets);
+    for (FallenSnow* fsnow = mGlobal.FsnowFirst;
+        fsnow; fsnow = fsnow->next) {
+        int first, last;
+        getFallenSnowColumnIndexSpan(fsnow, &first, &last);
+        for (int b = first; b <= last; b++) {
+            mColumnIndexItems[fill[b]++] = fsnow;
+        }
+    }
+    scratch_release(mark);
+
+    // A full item reaches up to y - h.
+    mColumnIndexTop = (short int*) tracked_realloc(MEMORY_FALLENSNOW,
+        mColumnIndexTop, sizeof(short int) * mColumnIndexBuckets);
+    REALLOC_CHECK(mColumnIndexTop);
+    for (int b = 0; b < mColumnIndexBuckets; b++) {
+        mColumnIndexTop[b] = SHRT_MAX;
+    }
+    for (FallenSnow* fsnow = mGlobal.FsnowFirst;
+        fsnow; fsnow = fsnow->next) {
+        int first, last;
+        getFallenSnowColumnIndexSpan(fsnow, &first, &last);
+        const int top = fsnow->y - fsnow->h;
+        for (int b = first; b <= last; b++) {
+            if (top < mColumnIndexTop[b]) {
+                mColumnIndexTop[b] = top;
+            }
+        }
+    }
+
+    mColumnIndexIsStale = false;
+    mColumnIndexEpoch++;
+}
+
+/** *********************************************************************
+ ** This method returns the first & last index bucket covered
+ ** by an items x-span, clamped to the screen.
+ **/
+void getFallenSnowColumnIndexSpan(FallenSnow* fsnow,
+    int* first, int* last) {
+    *first = getFallenSnowColumnIndexBucket(fsnow->x);
+    *last = getFallenSnowColumnIndexBucket(fsnow->x + fsnow->w);
+}
+
+int getFallenSnowColumnIndexBucket(int x) {
+    const int bucket = (x < 0) ? 0 :
+        x / COLUMN_INDEX_BUCKET_WIDTH;
+    return (bucket >= mColumnIndexBuckets) ?
+        mColumnIndexBuckets - 1 : bucket;
+}
+
+/** *********************************************************************
+ ** This method rebuilds a stale index, and returns how often
+ ** it was built. Column tops hold until the count changes.
+ ** threads: main thread only, it's the only one changing the list.
+ **/
+unsigned int getFallenSnowColumnIndexEpoch() {
+    if (mColumnIndexIsStale || mColumnIndexBuckets !=
+        mGlobal.SnowWinWidth / COLUMN_INDEX_BUCKET_WIDTH + 1) {
+        rebuildFallenSnowColumnIndex();
+    }
+    return mColumnIndexEpoch;
+}
+
+/** *********************************************************************
+ ** This method returns the highest y fallen snow may reach
+ ** between screen columns x0 and x1, SHRT_MAX if none.
+ ** threads: main thread only, it's the only one changing the list.
+ **/
+int getFallenSnowColumnTop(int x0, int x1) {
+    getFallenSnowColumnIndexEpoch();
+
+    int top = SHRT_MAX;
+    const int last = getFallenSnowColumnIndexBucket(x1);
+    for (int b = getFallenSnowColumnIndexBucket(x0); b <= last; b++) {
+        if (mColumnIndexTop[b] < top) {
+            top = mColumnIndexTop[b];
+        }
+    }
+    return top;
+}
+
+/** *********************************************************************
+ ** This method returns the FallenSnow items whose x-span may
+ ** contain screen column x, in FsnowFirst list order.
+ ** threads: main thread only, it's the only one changing the list.
+ **/
+FallenSnow** getFallenSnowItemsAtColumn(int x, int* count) {
+    if (mColumnIndexIsStale || mColumnIndexBuckets !=
+        mGlobal.SnowWinWidth / COLUMN_INDEX_BUCKET_WIDTH + 1) {
+        rebuildFallenSnowColumnIndex();
+    }
+
+    const int bucket = getFallenSnowColumnIndexBucket(x);
+    *count = mColumnIndexStart[bucket + 1] -
+        mColumnIndexStart[bucket];
+    return &mColumnIndexItems[mColumnIndexStart[bucket]];
 }
 
 /** *********************************************************************
@@ -857,6 +1733,36 @@ void removeFallenSnowFromAllWindows() {
     }
 }
 
+/** *********************************************************************
+ ** This method moves the fallen snow of a dragged window with
+ ** it. The rendered surface is drawn at the new place as is;
+ ** only a shake drops the snow.
+ **/
+void translateFallenSnowForWindow(Window window, int dx, int dy) {
+    if (dx == 0 && dy == 0) {
+        return;
+    }
+
+    if (abs(dx) > FALLEN_SNOW_DRAG_SHAKE_DELTA ||
+        abs(dy) > FALLEN_SNOW_DRAG_SHAKE_DELTA) {
+        removeFallenSnowFromWindow(window);
+        return;
+    }
+
+    lockFallenSnowSemaphore();
+
+    FallenSnow* fsnow = findFallenSnowItemByWindow(window);
+    if (fsnow) {
+        eraseFallenSnowPartial(fsnow, 0, fsnow->w);
+        fsnow->x += dx;
+        fsnow->y += dy;
+        invalidateFallenSnowColumnIndex();
+        mDragSettleWindow = window;
+    }
+
+    unlockFallenSnowSemaphore();
+}
+
 /** *********************************************************************
  ** This method shakes the fallen snow off a window.
  **/
@@ -870,7 +1776,7 @@ void removeFallenSnowFromWindow(Window window) {
     lockFallenSnowSemaphore();
 
     generateFallenSnowFlakes(fallenListItem, 0,
-        fallenListItem->w, -15.0, false);
+        fallenListItem->w, -15.0, mGlobal.NewWind, false);
     eraseFallenSnowPartial(fallenListItem, 0,
         fallenListItem->w);
     removeAndFreeFallenSnowForWindow(&mGlobal.FsnowFirst,
@@ -1011,7 +1917,7 @@ void doWinInfoRemoves() {
                 fsnow->winInfo.window)) {
                 eraseFallenSnowPartial(fsnow, 0, fsnow->w);
                 generateFallenSnowFlakes(fsnow, 0, fsnow->w,
-                    15.0, false);
+                    15.0, mGlobal.NewWind, false);
                 removeAndFreeFallenSnowForWindow(
                     &mGlobal.FsnowFirst, fsnow->winInfo.window);
             }
@@ -1027,7 +1933,7 @@ void doWinInfoRemoves() {
                 fsnow->winInfo.window)) {
                 eraseFallenSnowPartial(fsnow, 0, fsnow->w);
                 generateFallenSnowFlakes(fsnow, 0, fsnow->w,
-                    15.0, false);
+                    15.0, mGlobal.NewWind, false);
                 removeAndFreeFallenSnowForWindow(
                     &mGlobal.FsnowFirst, fsnow->winInfo.window);
             }
@@ -1045,7 +1951,7 @@ void doWinInfoRemoves() {
                 fsnow->winInfo.window)) {
                 eraseFallenSnowPartial(fsnow, 0, fsnow->w);
                 generateFallenSnowFlakes(fsnow, 0, fsnow->w,
-                    -15.0, false);
+                    -15.0, mGlobal.NewWind, false);
                 removeAndFreeFallenSnowForWindow(
                     &mGlobal.FsnowFirst, fsnow->winInfo.window);
             }
@@ -1063,7 +1969,7 @@ void doWinInfoRemoves() {
                 fsnow->winInfo.window)) {
                 eraseFallenSnowPartial(fsnow, 0, fsnow->w);
                 generateFallenSnowFlakes(fsnow, 0, fsnow->w,
-                    -15.0, false);
+                    -15.0, mGlobal.NewWind, false);
                 removeAndFreeFallenSnowForWindow(
                     &mGlobal.FsnowFirst, fsnow->winInfo.window);
             }
@@ -1086,6 +1992,27 @@ void doWinInfoProgrammaticRemoves() {
         FallenSnow* fsnow = findFallenSnowItemByWindow(
             removeWinInfo->window);
 
+        // A dragged window's snow moves with it, and lands
+        // where its WinInfo does when the drag ends.
+        if (fsnow && fsnow->winInfo.window == getWindowBeingDragged()) {
+            fsnow = NULL;
+        }
+        if (fsnow && fsnow->winInfo.window == mDragSettleWindow &&
+            !isWindowBeingDragged()) {
+            mDragSettleWindow = None;
+            if ((unsigned int) fsnow->w ==
+                    removeWinInfo->w + Flags.OffsetW &&
+                abs(fsnow->x - (removeWinInfo->x + Flags.OffsetX)) <=
+                    FALLEN_SNOW_DRAG_SHAKE_DELTA &&
+                abs(fsnow->y - (removeWinInfo->y + Flags.OffsetY)) <=
+                    FALLEN_SNOW_DRAG_SHAKE_DELTA) {
+                eraseFallenSnowPartial(fsnow, 0, fsnow->w);
+                fsnow->x = removeWinInfo->x + Flags.OffsetX;
+                fsnow->y = removeWinInfo->y + Flags.OffsetY;
+                invalidateFallenSnowColumnIndex();
+            }
+        }
+
         if (fsnow) {
             if (fsnow->x != removeWinInfo->x + Flags.OffsetX ||
                 fsnow->y != removeWinInfo->y + Flags.OffsetY ||
@@ -1096,12 +2023,13 @@ void doWinInfoProgrammaticRemoves() {
                     fsnow->winInfo.window)) {
                     eraseFallenSnowPartial(fsnow, 0, fsnow->w);
                     generateFallenSnowFlakes(fsnow, 0, fsnow->w,
-                        20.0, false);
+                        20.0, mGlobal.NewWind, false);
                     removeAndFreeFallenSnowForWindow(
                         &mGlobal.FsnowFirst, fsnow->winInfo.window);
                 }
                 fsnow->x = removeWinInfo->x + Flags.OffsetX;
                 fsnow->y = removeWinInfo->y + Flags.OffsetY;
+                invalidateFallenSnowColumnIndex();
             }
         }
 
@@ -1110,11 +2038,12 @@ void doWinInfoProgrammaticRemoves() {
 }
 
 /** *********************************************************************
- ** This method generates snow blowoff and drops.
+ ** This method generates snow blowoff and drops, blown
+ ** along by newWind.
  ** threads: locking by caller
  **/
 void generateFallenSnowFlakes(FallenSnow* fsnow,
-    int xPos, int xWidth, float vy, bool limitToMax) {
+    int xPos, int xWidth, float vy, float newWind, bool limitToMax) {
     if (!Flags.BlowSnow || Flags.NoSnowFlakes) {
         return;
     }
@@ -1123,33 +2052,41 @@ void generateFallenSnowFlakes(FallenSnow* fsnow,
     const int xRightPos = MIN(MAX(0, xPos + xWidth), fsnow->w);
 
     const int MAX_FLAKES_TO_GENERATE =
-        (int) ((float) Flags.FlakeCountMax * 0.9);
+        (int) ((float) getQualityFlakeCountMax() * 0.9);
 
-    for (int i = xLeftPos; i < xRightPos; i++) {
-        for (int j = 0; j < fsnow->snowHeight[i]; j++) {
+    // Avoid runaway flake generation during plowing.
+    int flakesAllowed = limitToMax ?
+        MAX_FLAKES_TO_GENERATE - mGlobal.FlakeCount : INT_MAX;
 
-            const int kMax = getNumberOfFlakesToBlowoff();
-            for (int k = 0; k < kMax; k++) {
-                if (drand48() >= 0.15) {
-                    continue;
-                }
+    FlakeSpawnBatch batch;
+    initFlakeSpawnBatch(&batch);
 
-                // Avoid runaway flake generation during plowing.
-                if (limitToMax &&
-                    mGlobal.FlakeCount >= MAX_FLAKES_TO_GENERATE) {
-                    return;
-                }
+    for (int i = xLeftPos; i < xRightPos && flakesAllowed > 0; i++) {
+        const int height = fsnow->snowHeight[i];
+        if (height <= 0) {
+            continue;
+        }
 
-                SnowFlake* flake = MakeFlake(-1);
-                flake->cyclic = 0;
-                flake->rx = fsnow->x + i + 16 * (drand48() - 0.5);
-                flake->ry = fsnow->y - j - 8;
-                flake->vx = (Flags.NoWind) ?
-                    0 : mGlobal.NewWind / 8;
-                flake->vy = vy;
-            }
+        // Each unit of height has a few 15% chances to blow
+        // off, drawn as one count per column.
+        const int trials = height * getNumberOfFlakesToBlowoff();
+        const int count = MIN(randomBinomial(trials, 0.15),
+            flakesAllowed);
+        flakesAllowed -= count;
+
+        for (int k = 0; k < count; k++) {
+            const int j = randomUniform() * height;
+
+            FlakeSpawn* spawn = addFlakeSpawn(&batch);
+            spawn->rx = fsnow->x + i + 16 * (randomUniform() - 0.5);
+            spawn->ry = fsnow->y - j - 8;
+            spawn->vx = (Flags.NoWind) ? 0 : newWind / 8;
+            spawn->vy = vy;
+            spawn->cyclic = false;
         }
     }
+
+    flushFlakeSpawnBatch(&batch);
 }
 
 /** *********************************************************************
@@ -1177,14 +2114,47 @@ void drawFallenSnowFrame(cairo_t* cr) {
         return;
     }
 
+    // Held until tiles are drawn too, so the FallenSnow
+    // thread can not swap surfaces out from under them.
     lockFallenSnowSwapSemaphore();
 
+    const bool isTiled = isTileRasterActive(cr);
+    if (isTiled) {
+        beginTileLayer(cr);
+    }
+
+    const bool isOccluding = hasOcclusion();
     FallenSnow *fsnow = mGlobal.FsnowFirst;
     while (fsnow) {
         if (canSnowCollectOnFallen(fsnow)) {
-            cairo_set_source_surface(cr, fsnow->renderedSurfaceA,
-                fsnow->x, fsnow->y - fsnow->h);
-            my_cairo_paint_with_alpha(cr, ALPHA);
+            // Hidden behind windows, nothing to paint.
+            const bool isHidden = isOccluding && isAreaOccluded(
+                fsnow->x, fsnow->y - fsnow->h, fsnow->w, fsnow->h);
+
+            const GdkRGBA* color = &fsnow->columnColor[0];
+            if (isHidden) {
+                // Skipped, damage below still tracks it.
+            } else if (isTiled) {
+                addTileMaskBlit(fsnow->renderedSurfaceA, 0, 0,
+                    fsnow->x, fsnow->y - fsnow->h,
+                    cairo_image_surface_get_width(fsnow->renderedSurfaceA),
+                    cairo_image_surface_get_height(fsnow->renderedSurfaceA),
+                    color, ALPHA);
+            } else {
+                cairo_set_source_rgba(cr, color->red, color->green,
+                    color->blue, ALPHA > 0.9 ? 1 : ALPHA);
+                cairo_mask_surface(cr, fsnow->renderedSurfaceA,
+                    fsnow->x, fsnow->y - fsnow->h);
+            }
+
+            // Changes in place come with their clears, a
+            // move (of its window) must be presented here.
+            if (fsnow->prevx != fsnow->x ||
+                fsnow->prevy != fsnow->y - fsnow->h + 1) {
+                addDrawnDamage(fsnow->x, fsnow->y - fsnow->h,
+                    cairo_image_surface_get_width(fsnow->renderedSurfaceA),
+                    fsnow->h + mGlobal.MaxFlakeHeight);
+            }
 
             fsnow->prevx = fsnow->x;
             fsnow->prevy = fsnow->y - fsnow->h + 1;
@@ -1197,6 +2167,10 @@ void drawFallenSnowFrame(cairo_t* cr) {
         fsnow = fsnow->next;
     }
 
+    if (isTiled) {
+        drawTileLayer();
+    }
+
     unlockFallenSnowSwapSemaphore();
 }
 
@@ -1204,16 +2178,30 @@ void drawFallenSnowFrame(cairo_t* cr) {
  * Helper methods for Thread locking.
  */
 void initFallenSnowSemaphores() {
-    sem_init(&mFallenSnowBaseSemaphore, 0, 1);
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+#ifdef __GLIBC__
+    // The FallenSnow thread reads every pass; don't let it
+    // starve main thread list updates.
+    pthread_rwlockattr_setkind_np(&attributes,
+        PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&mFallenSnowListLock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+
     sem_init(&mFallenSnowSwapSemaphore, 0, 1);
 }
 
-// Base semaphores.
+// Base semaphores, the list lock taken for writing.
 int lockFallenSnowBaseSemaphore() {
-    return sem_wait(&mFallenSnowBaseSemaphore);
+    if (pthread_rwlock_trywrlock(&mFallenSnowListLock) == 0) {
+        return 0;
+    }
+    atomic_fetch_add(&mFallenSnowListContention, 1);
+    return pthread_rwlock_wrlock(&mFallenSnowListLock);
 }
 int unlockFallenSnowBaseSemaphore() {
-    return sem_post(&mFallenSnowBaseSemaphore);
+    return pthread_rwlock_unlock(&mFallenSnowListLock);
 }
 int softLockFallenSnowBaseSemaphore(
     int maxSoftTries, int* tryCount) {
@@ -1227,17 +2215,67 @@ int softLockFallenSnowBaseSemaphore(
 
     // Set resultCode from soft or hard wait.
     resultCode = (*tryCount > maxSoftTries) ?
-        sem_wait(&mFallenSnowBaseSemaphore) :
-        sem_trywait(&mFallenSnowBaseSemaphore);
+        lockFallenSnowBaseSemaphore() :
+        pthread_rwlock_trywrlock(&mFallenSnowListLock);
 
     // Success clears tryCount for next time.
     if (resultCode == 0) {
         *tryCount = 0;
+    } else {
+        atomic_fetch_add(&mFallenSnowListContention, 1);
+    }
+
+    return resultCode;
+}
+
+// List read locks, released with unlockFallenSnowSemaphore().
+int readLockFallenSnowList() {
+    if (pthread_rwlock_tryrdlock(&mFallenSnowListLock) == 0) {
+        return 0;
+    }
+    atomic_fetch_add(&mFallenSnowListContention, 1);
+    return pthread_rwlock_rdlock(&mFallenSnowListLock);
+}
+int softReadLockFallenSnowList(int maxSoftTries, int* tryCount) {
+    if (*tryCount < 0) {
+        *tryCount = 0;
+    }
+    (*tryCount)++;
+
+    const int resultCode = (*tryCount > maxSoftTries) ?
+        readLockFallenSnowList() :
+        pthread_rwlock_tryrdlock(&mFallenSnowListLock);
+
+    if (resultCode == 0) {
+        *tryCount = 0;
+    } else {
+        atomic_fetch_add(&mFallenSnowListContention, 1);
     }
 
     return resultCode;
 }
 
+// Item locks, taken with the list read locked. Never hold
+// two at once.
+void lockFallenSnowItem(FallenSnow* fsnow) {
+    if (pthread_mutex_trylock(&fsnow->lock) == 0) {
+        return;
+    }
+    atomic_fetch_add(&mFallenSnowItemContention, 1);
+    pthread_mutex_lock(&fsnow->lock);
+}
+void unlockFallenSnowItem(FallenSnow* fsnow) {
+    pthread_mutex_unlock(&fsnow->lock);
+}
+
+// Contention counters, for the performance stats.
+unsigned int getFallenSnowListContention() {
+    return atomic_load(&mFallenSnowListContention);
+}
+unsigned int getFallenSnowItemContention() {
+    return atomic_load(&mFallenSnowItemContention);
+}
+
 // Swap semaphores.
 int lockFallenSnowSwapSemaphore() {
     return sem_wait(&mFallenSnowSwapSemaphore);
@@ -32,12 +32,33 @@
 #include <gtk/gtk.h>
 
 #include "plasmasnow.h"
+#include "snow.h"
+#include "WorldSnapshot.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+// FallenSnow records allocated together.
+#define FALLEN_SNOW_ARENA_CHUNK 32
+
+// A dragged window moving further than this between two
+// ConfigureNotify events is shaken, and drops its snow.
+#define FALLEN_SNOW_DRAG_SHAKE_DELTA 40
+
+// Most threads rendering fallensnow surfaces at once.
+#define FALLEN_SNOW_MAX_RENDER_WORKERS 8
+
+// Share of an items columns the wind erodes per blow-off
+// frame, at full wind strength.
+#define FALLEN_SNOW_EROSION_SHARE 0.125
 
 
 // Fallensnow lifecycle helpers.
 void initFallenSnowModule();
 
 void* startFallenSnowBackgroundThread();
+int stepFallenSnowBackgroundThread();
 int execFallenSnowBackgroundThread();
 void swapFallenSnowRenderedSurfacesBToA();
 
@@ -47,22 +68,43 @@ void updateFallenSnowDesktopItemDepth();
 void updateFallenSnowDesktopItemHeight();
 
 // Snow interactions.
+void queueFallenSnowDeposit(FallenSnow*, int x, int w);
+void drainFallenSnowDeposits();
 void updateFallenSnowWithSnow(FallenSnow*, int x, int w);
+void raiseFallenSnowSpan(FallenSnow*, int x, int w);
+void smoothFallenSnowSpan(FallenSnow*, int x, int w);
 int canSnowCollectOnFallen(FallenSnow*);
+int canSnowCollectOnFallenOnWorkspaces(FallenSnow*,
+    const long* visWorkSpaces, int visWorkSpaceCount);
 int isFallenSnowVisibleOnWorkspace(FallenSnow*);
-void collectSnowOnFallen(FallenSnow*);
+int isFallenSnowOnWorkspaces(FallenSnow*,
+    const long* visWorkSpaces, int visWorkSpaceCount);
+void collectSnowOnFallen(FallenSnow*, const WorldSnapshot*);
+void markFallenSnowDirty(FallenSnow*, int x, int w);
 void renderFallenSnowSurfaceB(FallenSnow*);
+void trackFallenSnowOverMax(FallenSnow*, int imin, int imax);
+void queueFallenSnowRender(FallenSnow*);
+void renderFallenSnowTasks();
+void* execFallenSnowRenderWorker(void* arg);
+void initFallenSnowRenderWorkers();
+void runFallenSnowRenderTasks();
 
 // Santa interactions.
-void updateFallenSnowWithSanta(FallenSnow*);
+void updateFallenSnowWithSanta(FallenSnow*, const WorldSnapshot*);
+void plowFallenSnowSpan(FallenSnow*, int start, int end);
 
 // Wind interactions.
-void updateFallenSnowWithWind(FallenSnow*, int w, int h);
+void updateFallenSnowWithWind(FallenSnow*, int h,
+    FlakeSpawnBatch* batch, const WorldSnapshot* world);
 void eraseFallenSnowWindPixel(FallenSnow*, int x);
 
 // FallenSnow Linked list Helpers.
 int getFallenSnowItemcount();
+void getFallenSnowSurfaceCounts(int* items, int* surfaces, long* bytes);
 void clearAllFallenSnowItems();
+void discardAllFallenSnowItems();
+void pushFallenSnowDesktopItems();
+void resizeFallenSnowDesktopItems(int oldWidth);
 void logAllFallenSnowItems();
 
 void pushFallenSnowItem(FallenSnow**, WinInfo*,
@@ -71,15 +113,27 @@ void popAndFreeFallenSnowItem(FallenSnow**);
 void freeFallenSnowItem(FallenSnow*);
 
 // Desh method helpers.
+void buildFallenSnowDesh(FallenSnow*, short int* maxSnowHeight);
 void CreateDesh(FallenSnow*);
 int do_change_deshes();
 int do_adjust_deshes();
 
 // Fallensnow by Window helpers.
 FallenSnow* findFallenSnowItemByWindow(Window);
+
+// Fallensnow by screen column helpers.
+void invalidateFallenSnowColumnIndex();
+void rebuildFallenSnowColumnIndex();
+void getFallenSnowColumnIndexSpan(FallenSnow*,
+    int* first, int* last);
+int getFallenSnowColumnIndexBucket(int x);
+FallenSnow** getFallenSnowItemsAtColumn(int x, int* count);
+unsigned int getFallenSnowColumnIndexEpoch();
+int getFallenSnowColumnTop(int x0, int x1);
 void eraseFallenSnowPartial(FallenSnow*, int x, int w);
 void removeFallenSnowFromAllWindows();
 void removeFallenSnowFromWindow(Window);
+void translateFallenSnowForWindow(Window, int dx, int dy);
 int removeAndFreeFallenSnowForWindow(FallenSnow**,
     Window);
 
@@ -92,7 +146,7 @@ void doWinInfoProgrammaticRemoves();
 
 // Helper for Blown, Dropped, and Plowed Snow.
 void generateFallenSnowFlakes(FallenSnow* fsnow,
-    int xPos, int xWidth, float vy, bool limitToMax);
+    int xPos, int xWidth, float vy, float newWind, bool limitToMax);
 
 // Main "draw frame" routine for fallen snow.
 void drawFallenSnowFrame(cairo_t*);
@@ -104,6 +158,14 @@ int softLockFallenSnowBaseSemaphore(
     int maxSoftTries, int* tryCount);
 int unlockFallenSnowBaseSemaphore();
 
+int readLockFallenSnowList();
+int softReadLockFallenSnowList(int maxSoftTries, int* tryCount);
+void lockFallenSnowItem(FallenSnow* fsnow);
+void unlockFallenSnowItem(FallenSnow* fsnow);
+
+unsigned int getFallenSnowListContention();
+unsigned int getFallenSnowItemContention();
+
 #ifndef __GNUC__
     #define lockFallenSnowSemaphore() \
         lockFallenSnowBaseSemaphore()
@@ -0,0 +1,415 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+
+#include "Benchmark.h"
+#include "FallenSnow.h"
+#include "FallenSnowState.h"
+#include "Flags.h"
+#include "plasmasnow.h"
+#include "safe_malloc.h"
+#include "SpriteCache.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define FALLEN_SNOW_STATE_MAGIC "PLSNFSS"
+
+// The mapped state last saved, and which of its records an
+// item took already, so each restores once.
+static bool mIsStateOpened = false;
+static void* mStateAddress = NULL;
+static size_t mStateSize = 0;
+static uint32_t mStateCount = 0;
+static bool* mStateConsumed = NULL;
+
+static bool isFallenSnowStateActive();
+static char* getFallenSnowStatePath();
+static void openFallenSnowState();
+static uint64_t getFallenSnowStateKey(FallenSnow* fsnow);
+static size_t getFallenSnowStateRecordSize(int w);
+static FallenSnowStateRecord* getNextFallenSnowStateRecord(
+    FallenSnowStateRecord* record);
+static bool isFallenSnowStateEmpty(FallenSnow* fsnow);
+static uint64_t getFallenSnowStateOldest();
+
+
+/** *********************************************************************
+ ** This method tells if state is kept this run. Benchmarks
+ ** start from bare windows.
+ **/
+bool isFallenSnowStateActive() {
+    return !Flags.NoSnowState && !isBenchmarkActive();
+}
+
+/** *********************************************************************
+ ** This method returns the state file of this display, and
+ ** creates its directory. NULL without a home. The caller
+ ** frees.
+ **/
+char* getFallenSnowStatePath() {
+    const char* base = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    char dir[PATH_MAX];
+    if (base && base[0] == '/') {
+        snprintf(dir, sizeof(dir), "%s/%s", base, FALLEN_SNOW_STATE_DIR);
+    } else if (home) {
+        snprintf(dir, sizeof(dir), "%s/.cache/%s", home,
+            FALLEN_SNOW_STATE_DIR);
+    } else {
+        return NULL;
+    }
+    mkdir(dir, 0700);
+
+    const char* display = DisplayString(mGlobal.display);
+    const uint64_t displayHash = hashSpriteBytes(SPRITE_HASH_SEED,
+        display, strlen(display) + 1);
+
+    const size_t size = strlen(dir) + 40;
+    char* path = (char*) malloc(size);
+    MALLOC_CHECK(path);
+    snprintf(path, size, "%s/fallensnow-%016" PRIx64 ".state",
+        dir, displayHash);
+    return path;
+}
+
+/** *********************************************************************
+ ** This method maps the last saved state, if it validates
+ ** and is recent. Once per save.
+ **/
+void openFallenSnowState() {
+    if (mIsStateOpened) {
+        return;
+    }
+    mIsStateOpened = true;
+
+    char* path = getFallenSnowStatePath();
+    if (!path) {
+        return;
+    }
+    const int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        st.st_size < (off_t) sizeof(FallenSnowStateHeader)) {
+        close(fd);
+        return;
+    }
+
+    const size_t size = st.st_size;
+    void* address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        return;
+    }
+
+    const FallenSnowStateHeader* header =
+        (const FallenSnowStateHeader*) address;
+    const unsigned char* records = (const unsigned char*) (header + 1);
+    const size_t recordsSize = size - sizeof(FallenSnowStateHeader);
+    const uint64_t oldest = getFallenSnowStateOldest();
+
+    const bool isValid =
+        !memcmp(header->magic, FALLEN_SNOW_STATE_MAGIC,
+            sizeof(header->magic)) &&
+        header->format == FALLEN_SNOW_STATE_FORMAT &&
+        header->savedAt >= oldest &&
+        header->checksum == hashSpriteBytes(SPRITE_HASH_SEED,
+            records, recordsSize);
+    if (!isValid) {
+        munmap(address, size);
+        return;
+    }
+
+    // Every record must lie inside the file.
+    size_t offset = 0;
+    for (uint32_t i = 0; i < header->count; i++) {
+        const FallenSnowStateRecord* record =
+            (const FallenSnowStateRecord*) (records + offset);
+        if (offset + sizeof(FallenSnowStateRecord) > recordsSize ||
+            record->w < 1 || offset +
+            getFallenSnowStateRecordSize(record->w) > recordsSize) {
+            munmap(address, size);
+            return;
+        }
+        offset += getFallenSnowStateRecordSize(record->w);
+    }
+
+    mStateAddress = address;
+    mStateSize = size;
+    mStateCount = header->count;
+    mStateConsumed = (bool*) calloc(mStateCount ? mStateCount : 1,
+        sizeof(bool));
+    MALLOC_CHECK(mStateConsumed);
+}
+
+/** *********************************************************************
+ ** This method unmaps the last saved state.
+ **/
+void closeFallenSnowState() {
+    if (mStateAddress) {
+        munmap(mStateAddress, mStateSize);
+    }
+    free(mStateConsumed);
+
+    mStateAddress = NULL;
+    mStateSize = 0;
+    mStateCount = 0;
+    mStateConsumed = NULL;
+    mIsStateOpened = false;
+}
+
+/** *********************************************************************
+ ** This method drops the last saved state, for settings
+ ** that clear the fallen snow, so nothing restores from it,
+ ** this run or the next. Later saves start afresh.
+ **/
+void discardFallenSnowState() {
+    if (!isFallenSnowStateActive()) {
+        return;
+    }
+    closeFallenSnowState();
+    mIsStateOpened = true;
+
+    char* path = getFallenSnowStatePath();
+    if (path) {
+        unlink(path);
+        free(path);
+    }
+}
+
+/** *********************************************************************
+ ** These methods walk the records of a state.
+ **/
+size_t getFallenSnowStateRecordSize(int w) {
+    return sizeof(FallenSnowStateRecord) +
+        (((size_t) w * sizeof(short int) + 7) & ~(size_t) 7);
+}
+
+FallenSnowStateRecord* getNextFallenSnowStateRecord(
+    FallenSnowStateRecord* record) {
+    return (FallenSnowStateRecord*) ((unsigned char*) record +
+        getFallenSnowStateRecordSize(record->w));
+}
+
+/** *********************************************************************
+ ** This method returns the key of an item, from its window
+ ** (None for the bottom) and geometry.
+ **/
+uint64_t getFallenSnowStateKey(FallenSnow* fsnow) {
+    const uint64_t window = fsnow->winInfo.window;
+    const int32_t geometry[] = {fsnow->x, fsnow->y, fsnow->w, fsnow->h};
+
+    uint64_t hash = SPRITE_HASH_SEED;
+    hash = hashSpriteBytes(hash, &window, sizeof(window));
+    hash = hashSpriteBytes(hash, geometry, sizeof(geometry));
+    return hash;
+}
+
+/** *********************************************************************
+ ** This method returns the time() before which a saved
+ ** state or record is too old to restore.
+ **/
+uint64_t getFallenSnowStateOldest() {
+    return time(NULL) -
+        (uint64_t) FALLEN_SNOW_STATE_MAX_AGE_HOURS * 60 * 60;
+}
+
+/** *********************************************************************
+ ** This method tells if an item holds no snow.
+ **/
+bool isFallenSnowStateEmpty(FallenSnow* fsnow) {
+    for (int i = 0; i < fsnow->w; i++) {
+        if (fsnow->snowHeight[i] > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** *********************************************************************
+ ** This method gives a new item the snow it had when last
+ ** saved, at most its own depth.
+ **/
+void restoreFallenSnowState(FallenSnow* fsnow) {
+    if (!isFallenSnowStateActive()) {
+        return;
+    }
+    openFallenSnowState();
+    if (!mStateAddress) {
+        return;
+    }
+
+    const uint64_t key = getFallenSnowStateKey(fsnow);
+    const uint64_t oldest = getFallenSnowStateOldest();
+    FallenSnowStateRecord* record = (FallenSnowStateRecord*)
+        ((FallenSnowStateHeader*) mStateAddress + 1);
+    for (uint32_t i = 0; i < mStateCount; i++,
+        record = getNextFallenSnowStateRecord(record)) {
+        if (mStateConsumed[i] || record->key != key ||
+            record->w != fsnow->w || record->savedAt < oldest) {
+            continue;
+        }
+        mStateConsumed[i] = true;
+
+        const short int* heights = (const short int*) (record + 1);
+        for (int x = 0; x < fsnow->w; x++) {
+            fsnow->snowHeight[x] = MAX(0, MIN(heights[x], fsnow->h));
+        }
+        trackFallenSnowOverMax(fsnow, 0, fsnow->w);
+        return;
+    }
+}
+
+/** *********************************************************************
+ ** This method saves the heights of every item that holds
+ ** snow, plus the recent records not restored yet, so items
+ ** not pushed this run keep theirs. Records age out, and at
+ ** most FALLEN_SNOW_STATE_MAX_CARRIED are carried. Written to
+ ** a temporary file and renamed, so a reader never sees half
+ ** a state.
+ **/
+void saveFallenSnowState() {
+    if (!isFallenSnowStateActive()) {
+        return;
+    }
+    openFallenSnowState();
+
+    size_t size = 0;
+    uint32_t count = 0;
+    for (FallenSnow* fsnow = mGlobal.FsnowFirst; fsnow;
+        fsnow = fsnow->next) {
+        size += getFallenSnowStateRecordSize(fsnow->w);
+    }
+    FallenSnowStateRecord* record = mStateAddress ?
+        (FallenSnowStateRecord*) ((FallenSnowStateHeader*)
+            mStateAddress + 1) : NULL;
+    for (uint32_t i = 0; i < mStateCount; i++,
+        record = getNextFallenSnowStateRecord(record)) {
+        size += getFallenSnowStateRecordSize(record->w);
+    }
+
+    unsigned char* records = (unsigned char*) calloc(size ? size : 1, 1);
+    MALLOC_CHECK(records);
+    size_t offset = 0;
+    const uint64_t now = time(NULL);
+
+    // Items on screen, their heights as they are now.
+    for (FallenSnow* fsnow = mGlobal.FsnowFirst; fsnow;
+        fsnow = fsnow->next) {
+        lockFallenSnowItem(fsnow);
+        if (!isFallenSnowStateEmpty(fsnow)) {
+            FallenSnowStateRecord* out =
+                (FallenSnowStateRecord*) (records + offset);
+            out->key = getFallenSnowStateKey(fsnow);
+            out->w = fsnow->w;
+            out->h = fsnow->h;
+            out->savedAt = now;
+            memcpy(out + 1, fsnow->snowHeight,
+                (size_t) fsnow->w * sizeof(short int));
+            offset += getFallenSnowStateRecordSize(fsnow->w);
+            count++;
+        }
+        unlockFallenSnowItem(fsnow);
+    }
+
+    // Recent records of items not on screen, unless one is now.
+    const uint64_t oldest = getFallenSnowStateOldest();
+    uint32_t carried = 0;
+    record = mStateAddress ? (FallenSnowStateRecord*)
+        ((FallenSnowStateHeader*) mStateAddress + 1) : NULL;
+    for (uint32_t i = 0; i < mStateCount &&
+        carried < FALLEN_SNOW_STATE_MAX_CARRIED; i++,
+        record = getNextFallenSnowStateRecord(record)) {
+        if (mStateConsumed[i] || record->savedAt < oldest) {
+            continue;
+        }
+        bool isOnScreen = false;
+        for (FallenSnow* fsnow = mGlobal.FsnowFirst; fsnow;
+            fsnow = fsnow->next) {
+            if (getFallenSnowStateKey(fsnow) == record->key) {
+                isOnScreen = true;
+                break;
+            }
+        }
+        if (!isOnScreen) {
+            const size_t recordSize =
+                getFallenSnowStateRecordSize(record->w);
+            memcpy(records + offset, record, recordSize);
+            offset += recordSize;
+            count++;
+            carried++;
+        }
+    }
+
+    FallenSnowStateHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FALLEN_SNOW_STATE_MAGIC, sizeof(header.magic));
+    header.format = FALLEN_SNOW_STATE_FORMAT;
+    header.count = count;
+    header.savedAt = now;
+    header.checksum = hashSpriteBytes(SPRITE_HASH_SEED, records, offset);
+
+    char* path = getFallenSnowStatePath();
+    if (path) {
+        const size_t tmpSize = strlen(path) + 24;
+        char* tmpPath = (char*) malloc(tmpSize);
+        MALLOC_CHECK(tmpPath);
+        snprintf(tmpPath, tmpSize, "%s.%d.tmp", path, (int) getpid());
+
+        FILE* file = fopen(tmpPath, "wb");
+        bool isWritten = false;
+        if (file) {
+            isWritten =
+                fwrite(&header, sizeof(header), 1, file) == 1 &&
+                (offset == 0 || fwrite(records, offset, 1, file) == 1);
+            isWritten = (fclose(file) == 0) && isWritten;
+        }
+        if (!isWritten || rename(tmpPath, path) != 0) {
+            unlink(tmpPath);
+        }
+        free(tmpPath);
+        free(path);
+    }
+    free(records);
+
+    // Items pushed from now on restore from this save.
+    closeFallenSnowState();
+}
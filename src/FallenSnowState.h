@@ -0,0 +1,72 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include "plasmasnow.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+// Below $XDG_CACHE_HOME, or $HOME/.cache, one file per display.
+#define FALLEN_SNOW_STATE_DIR "plasmasnow"
+
+// Bump when the file layout changes.
+#define FALLEN_SNOW_STATE_FORMAT 2
+
+// Older records are not restored, nor carried into a save.
+#define FALLEN_SNOW_STATE_MAX_AGE_HOURS 24
+
+// Most records of items not on screen carried into a save.
+#define FALLEN_SNOW_STATE_MAX_CARRIED 256
+
+typedef struct _FallenSnowStateHeader {
+        char magic[8];
+        uint32_t format;
+        uint32_t count;    // records following the header
+        uint64_t savedAt;  // time() of the save
+        uint64_t checksum; // of the records
+} FallenSnowStateHeader;
+
+// Followed by w heights, padded to 8 bytes.
+typedef struct _FallenSnowStateRecord {
+        uint64_t key;
+        int32_t w;
+        int32_t h;
+        uint64_t savedAt;  // time() the heights were taken
+} FallenSnowStateRecord;
+
+
+/***********************************************************
+ * Module Method stubs.
+ *
+ * Fallen snow heights, kept across restarts and display
+ * changes. Keyed by window and geometry, so an item pushed
+ * again where it was picks up its snow. threads: locking by
+ * caller, as for the FallenSnow list.
+ */
+void saveFallenSnowState();
+void restoreFallenSnowState(FallenSnow* fsnow);
+void closeFallenSnowState();
+void discardFallenSnowState();
@@ -29,9 +29,13 @@
 #include "windows.h"
 #include "plasmasnow.h"
 #include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "debug.h"
 
@@ -42,7 +46,9 @@ FLAGS VintageFlags;
 
 static void ReadFlags(void);
 static void SetDefaultFlags(void);
-static void findflag(FILE *f, const char *x, char **value);
+static void *execFlagsWriteThread();
+static void writePendingFlagsImage(void);
+static double getFlagsWriteClock(void);
 
 static long int S2Int(char *s) // string to integer
 {
@@ -60,6 +66,29 @@ static long int S2PosInt(char *s) // string to positive integer
 static char *FlagsFile = NULL;
 static int FlagsFileAvailable = 1;
 
+// Flags file writer, see WriteFlags(). Guarded by
+// mFlagsWriteMutex.
+#define FLAGS_WRITE_DELAY 1.0
+#define FLAGS_WRITE_MAX_DELAY 5.0
+
+static pthread_mutex_t mFlagsWriteMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mFlagsWriteCondition = PTHREAD_COND_INITIALIZER;
+static bool mFlagsWriteThreadStarted = false;
+static bool mFlagsWriteBusy = false;
+
+static char *mPendingFlagsImage = NULL;
+static double mFirstPendingFlagsTime = 0;
+static double mLastPendingFlagsTime = 0;
+
+// What the flags file holds, as last read or written.
+static char *mWrittenFlagsImage = NULL;
+
+// Flag change subscribers, a bit per handler. Main thread only.
+static FlagChangeHandler mFlagChangeHandlers[FLAG_CHANGE_HANDLERS_MAX];
+static int mFlagChangeHandlerCount = 0;
+static unsigned int mFlagChangeSubscribers[FLAG_ID_COUNT];
+static unsigned int mPendingFlagChanges = 0;
+
 void SetDefaultFlags() {
 #define DOIT_I(x, d, v) Flags.x = DefaultFlags.x;
 #define DOIT_S(x, d, v)                                                        \
@@ -224,6 +253,7 @@ int HandleFlags(int argc, char *argv[]) {
             handle_ia(-aurorawidth, AuroraWidth);
             handle_ia(-auroraheight, AuroraHeight);
             handle_ia(-aurorabase, AuroraBase);
+            handle_ia(-auroraresolution, AuroraResolution);
 
             handle_ia(-blowofffactor, BlowOffFactor);
             handle_ia(-cpuload, CpuLoad);
@@ -233,6 +263,12 @@ int HandleFlags(int argc, char *argv[]) {
             handle_ia(-window - id, WindowId);
             handle_ia(--window - id, WindowId);
             handle_ia(-maxontrees, MaxOnTrees);
+            handle_ia(-tilethreads, TileThreads);
+            handle_ia(-frameclock, FrameClock);
+            handle_ia(-benchmark, Benchmark);
+            handle_ia(-benchmarkwidth, BenchmarkWidth);
+            handle_ia(-benchmarkheight, BenchmarkHeight);
+            handle_ia(-benchmarkwindows, BenchmarkWindows);
             handle_ia(-meteorfrequency, MeteorFrequency);
             handle_ia(-moon, Moon);
             handle_ia(-mooncolor, MoonColor);
@@ -264,6 +300,10 @@ int HandleFlags(int argc, char *argv[]) {
             handle_ia(-ignoretop, IgnoreTop);
             handle_ia(-ignorebottom, IgnoreBottom);
             handle_ia(-transparency, Transparency);
+            handle_ia(-threadnice, ThreadNice);
+            handle_ia(-lowfps, LowFps);
+            handle_ia(-idletime, IdleTime);
+            handle_ia(-threadaffinity, ThreadAffinity);
 
             handle_im(-screen, Screen);
             handle_ia(-outline, Outline);
@@ -277,13 +317,31 @@ int HandleFlags(int argc, char *argv[]) {
             handle_is(-treetype, TreeType);
             handle_is(-bg, BackgroundFile);
             handle_is(-lang, Language);
+            handle_is(-metricsfile, MetricsFile);
+            handle_is(-record, RecordFile);
+            handle_is(-replay, ReplayFile);
 
             handle_iv(-defaults, Defaults, 1);
             handle_iv(-noblowsnow, BlowSnow, 0);
             handle_iv(-blowsnow, BlowSnow, 1);
             handle_iv(-noconfig, NoConfig, 1);
+            handle_iv(-noocclusion, NoOcclusion, 1);
+            handle_iv(-nopowerpolicy, NoPowerPolicy, 1);
+            handle_iv(-nosnowstate, NoSnowState, 1);
+            handle_iv(-nospritecache, NoSpriteCache, 1);
             handle_iv(-hidemenu, HideMenu, 1);
             handle_iv(-noisy, Noisy, 1);
+            handle_iv(-lowprio, LowPrio, 1);
+            handle_iv(-nolowprio, LowPrio, 0);
+            handle_iv(-lowpriorender, LowPrioRender, 1);
+            handle_iv(-schedidle, SchedIdle, 1);
+            handle_iv(-peroutput, PerOutput, 1);
+            handle_iv(-perfstats, PerfStats, 1);
+            handle_iv(-metricsdbus, MetricsDBus, 1);
+            handle_iv(-pixelraster, PixelRaster, 1);
+            handle_iv(-xshm, UseXShm, 1);
+            handle_iv(-gl, UseGL, 1);
+            handle_iv(-aurorafastfuzz, AuroraFastFuzz, 1);
             handle_iv(-nokeepsnowonscreen, NoKeepSnowOnBottom, 1);
             handle_iv(-keepsnowonscreen, NoKeepSnowOnBottom, 0);
             handle_iv(-nokeepsnowontrees, NoKeepSnowOnTrees, 1);
@@ -298,6 +356,7 @@ int HandleFlags(int argc, char *argv[]) {
             handle_iv(-nosanta, NoSanta, 1);
             handle_iv(-root, ForceRoot, 1);
             handle_iv(--root, ForceRoot, 1);
+            handle_iv(-fullscreensaver, FullScreensaver, 1);
             handle_iv(-showsanta, NoSanta, 0);
             handle_iv(-snow, NoSnowFlakes, 0);
             handle_iv(-nosnow, NoSnowFlakes, 1);
@@ -375,106 +434,134 @@ static void makeflagsfile() {
     P("FlagsFile: %s\n", FlagsFile);
 }
 
-void findflag(FILE *f, const char *x, char **value) {
-    char *line = NULL;
-    char *flag = NULL;
+/** *********************************************************************
+ ** Flags file entries, to find a flag by its name.
+ **/
+typedef struct _FlagsFileEntry {
+        const char *name;
+        char type;
+        size_t offset;
+} FlagsFileEntry;
+
+static const FlagsFileEntry FLAGS_FILE_ENTRIES[] = {
+#define DOIT_I(x, d, v) {#x, 'i', offsetof(FLAGS, x)},
+#define DOIT_L(x, d, v) {#x, 'l', offsetof(FLAGS, x)},
+#define DOIT_S(x, d, v) {#x, 's', offsetof(FLAGS, x)},
+    DOIT
+#include "undefall.inc"
+};
+
+#define FLAGS_FILE_ENTRY_COUNT \
+    (sizeof(FLAGS_FILE_ENTRIES) / sizeof(FLAGS_FILE_ENTRIES[0]))
+
+/** *********************************************************************
+ ** This method sets one flag from a "name value" line. Only
+ ** the first line naming a flag counts.
+ **/
+static void parseFlagsLine(char *line, bool *seen) {
+    char *name = line;
+    while (*name == ' ' || *name == '\t') {
+        name++;
+    }
+    char *rest = name;
+    while (*rest && *rest != ' ' && *rest != '\t') {
+        rest++;
+    }
+    if (rest == name) {
+        return;
+    }
+    if (*rest) {
+        *rest++ = 0;
+    }
 
-    *value = NULL;
-    rewind(f);
-    while (1) {
-        if (line) {
-            free(line);
-            line = NULL;
-        }
-        if (flag) {
-            free(flag);
-            flag = NULL;
-        }
-        size_t n = 0;
-        int m = getline(&line, &n, f);
-        if (m < 0) {
-            break;
-        }
-        flag = (char *)malloc((strlen(line) + 1) * sizeof(char));
-        m = sscanf(line, "%s", flag);
-        if (strcmp(flag, x)) {
-            continue;
-        }
-        if (m == EOF || m == 0) {
+    while (*rest == ' ' || *rest == '\t') {
+        rest++;
+    }
+    char *end = rest + strlen(rest);
+    while (end > rest && (end[-1] == ' ' || end[-1] == '\t' ||
+        end[-1] == '\r')) {
+        end--;
+    }
+    *end = 0;
+
+    for (size_t i = 0; i < FLAGS_FILE_ENTRY_COUNT; i++) {
+        const FlagsFileEntry *entry = &FLAGS_FILE_ENTRIES[i];
+        if (seen[i] || strcmp(entry->name, name)) {
             continue;
         }
-        char *rest = line + strlen(flag);
-        char *p;
-        p = rest;
-        while (*p == ' ' || *p == '\t' || *p == '\n') {
-            p++;
+        seen[i] = true;
+
+        char *flag = (char *) &Flags + entry->offset;
+        if (entry->type == 'i') {
+            *(int *) flag = strtol(rest, NULL, 0);
+        } else if (entry->type == 'l') {
+            *(long *) flag = strtol(rest, NULL, 0);
+        } else {
+            free(*(char **) flag);
+            *(char **) flag = strdup(rest);
         }
-        rest = p;
-        p = &line[strlen(line) - 1];
-        while (*p == ' ' || *p == '\t' || *p == '\n') {
-            p--;
-        }
-        *(p + 1) = 0;
-        *value = strdup(rest);
-        break;
-    }
-    if (line) {
-        free(line);
-        line = NULL;
-    }
-    if (flag) {
-        free(flag);
-        line = NULL;
+        return;
     }
 }
 
+/** *********************************************************************
+ ** This method reads the flags file in one pass. What it
+ ** holds is kept, so unchanged flags are never written back.
+ **/
 void ReadFlags() {
-    FILE *f;
-    long int intval;
     makeflagsfile();
     if (!FlagsFileAvailable) {
         return;
     }
-    f = fopen(FlagsFile, "r");
+    FILE *f = fopen(FlagsFile, "r");
     if (f == NULL) {
         I("Cannot read %s\n", FlagsFile);
         return;
     }
-    char *value = NULL;
-    ;
-#define DOIT_I(x, d, v)                                                        \
-    findflag(f, #x, &value);                                                   \
-    if (value) {                                                               \
-        intval = strtol(value, NULL, 0);                                       \
-        Flags.x = intval;                                                      \
-        free(value);                                                           \
-        value = NULL;                                                          \
+
+    char *image = NULL;
+    size_t imageSize = 0;
+    FILE *imageStream = open_memstream(&image, &imageSize);
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        fwrite(buffer, 1, n, imageStream);
     }
+    fclose(imageStream);
+    fclose(f);
 
-#define DOIT_L(x, d, v) DOIT_I(x, d, v)
-#define DOIT_S(x, d, v)                                                        \
-    findflag(f, #x, &value);                                                   \
-    if (value) {                                                               \
-        free(Flags.x);                                                         \
-        Flags.x = strdup(value);                                               \
-        free(value);                                                           \
-        value = NULL;                                                          \
+    bool seen[FLAGS_FILE_ENTRY_COUNT];
+    memset(seen, 0, sizeof(seen));
+
+    char *lines = strdup(image);
+    for (char *line = strtok(lines, "\n"); line;
+        line = strtok(NULL, "\n")) {
+        parseFlagsLine(line, seen);
     }
+    free(lines);
 
-    DOIT;
-#include "undefall.inc"
-    fclose(f);
+    pthread_mutex_lock(&mFlagsWriteMutex);
+    free(mWrittenFlagsImage);
+    mWrittenFlagsImage = image;
+    pthread_mutex_unlock(&mFlagsWriteMutex);
 }
 
+/** *********************************************************************
+ ** This method queues the flags for writing. A background
+ ** thread writes the newest image once changes pause for
+ ** FLAGS_WRITE_DELAY, or at the latest FLAGS_WRITE_MAX_DELAY
+ ** after the first one, so slider drags coalesce.
+ **/
 void WriteFlags() {
-    FILE *f;
     makeflagsfile();
     if (!FlagsFileAvailable) {
         return;
     }
-    f = fopen(FlagsFile, "w");
+
+    char *image = NULL;
+    size_t imageSize = 0;
+    FILE *f = open_memstream(&image, &imageSize);
     if (f == NULL) {
-        I("Cannot write %s\n", FlagsFile);
         return;
     }
 #define DOIT_I(x, d, v) fprintf(f, "%s %d\n", #x, Flags.x);
@@ -483,4 +570,179 @@ void WriteFlags() {
     DOIT;
 #include "undefall.inc"
     fclose(f);
+
+    const double now = getFlagsWriteClock();
+
+    pthread_mutex_lock(&mFlagsWriteMutex);
+    if (!mPendingFlagsImage) {
+        mFirstPendingFlagsTime = now;
+    }
+    free(mPendingFlagsImage);
+    mPendingFlagsImage = image;
+    mLastPendingFlagsTime = now;
+
+    if (!mFlagsWriteThreadStarted) {
+        mFlagsWriteThreadStarted = true;
+        pthread_t thread;
+        pthread_create(&thread, NULL, execFlagsWriteThread, NULL);
+        pthread_detach(thread);
+        atexit(flushFlagsFile);
+    }
+    pthread_cond_broadcast(&mFlagsWriteCondition);
+    pthread_mutex_unlock(&mFlagsWriteMutex);
+}
+
+/** *********************************************************************
+ ** This method is the flags writer thread looper.
+ **/
+void *execFlagsWriteThread() {
+    pthread_mutex_lock(&mFlagsWriteMutex);
+
+    while (true) {
+        if (!mPendingFlagsImage || mFlagsWriteBusy) {
+            pthread_cond_wait(&mFlagsWriteCondition, &mFlagsWriteMutex);
+            continue;
+        }
+
+        double due = mLastPendingFlagsTime + FLAGS_WRITE_DELAY;
+        if (due > mFirstPendingFlagsTime + FLAGS_WRITE_MAX_DELAY) {
+            due = mFirstPendingFlagsTime + FLAGS_WRITE_MAX_DELAY;
+        }
+        if (getFlagsWriteClock() < due) {
+            struct timespec deadline;
+            deadline.tv_sec = (time_t) due;
+            deadline.tv_nsec = (long) ((due - deadline.tv_sec) * 1e9);
+            pthread_cond_timedwait(&mFlagsWriteCondition,
+                &mFlagsWriteMutex, &deadline);
+            continue;
+        }
+
+        writePendingFlagsImage();
+    }
+
+    pthread_mutex_unlock(&mFlagsWriteMutex);
+    return NULL;
+}
+
+/** *********************************************************************
+ ** This method writes any queued flags now. Called at exit,
+ ** and before re-exec.
+ **/
+void flushFlagsFile() {
+    pthread_mutex_lock(&mFlagsWriteMutex);
+    while (mFlagsWriteBusy) {
+        pthread_cond_wait(&mFlagsWriteCondition, &mFlagsWriteMutex);
+    }
+    if (mPendingFlagsImage) {
+        writePendingFlagsImage();
+    }
+    pthread_mutex_unlock(&mFlagsWriteMutex);
+}
+
+/** *********************************************************************
+ ** This method takes the queued image and, unless the file
+ ** already holds it, writes it to a temp file renamed over
+ ** the flags file, so readers never see half of one.
+ ** threads: mFlagsWriteMutex held, dropped while writing.
+ **/
+static void writePendingFlagsImage() {
+    char *image = mPendingFlagsImage;
+    mPendingFlagsImage = NULL;
+
+    if (mWrittenFlagsImage && !strcmp(image, mWrittenFlagsImage)) {
+        free(image);
+        return;
+    }
+    mFlagsWriteBusy = true;
+    pthread_mutex_unlock(&mFlagsWriteMutex);
+
+    const size_t pathLength = strlen(FlagsFile) + 32;
+    char *tempPath = (char *) malloc(pathLength);
+    snprintf(tempPath, pathLength, "%s.%d.tmp", FlagsFile, (int) getpid());
+
+    bool isWritten = false;
+    FILE *f = fopen(tempPath, "w");
+    if (f) {
+        const size_t length = strlen(image);
+        isWritten = fwrite(image, 1, length, f) == length;
+        isWritten = (fflush(f) == 0) && isWritten;
+        isWritten = (fsync(fileno(f)) == 0) && isWritten;
+        isWritten = (fclose(f) == 0) && isWritten;
+        isWritten = isWritten && rename(tempPath, FlagsFile) == 0;
+        if (!isWritten) {
+            unlink(tempPath);
+        }
+    }
+    if (!isWritten) {
+        I("Cannot write %s\n", FlagsFile);
+    }
+    free(tempPath);
+
+    pthread_mutex_lock(&mFlagsWriteMutex);
+    if (isWritten) {
+        free(mWrittenFlagsImage);
+        mWrittenFlagsImage = image;
+    } else {
+        free(image);
+    }
+    mFlagsWriteBusy = false;
+    pthread_cond_broadcast(&mFlagsWriteCondition);
+}
+
+/** *********************************************************************
+ ** Clock of the flags writer deadlines.
+ **/
+static double getFlagsWriteClock() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+/** *********************************************************************
+ ** This method subscribes a handler to a list of flag ids,
+ ** ended by FLAG_ID_END. Handlers run in subscribe order.
+ **/
+void subscribeFlagChanges(FlagChangeHandler handler, const int *flagIds) {
+    if (mFlagChangeHandlerCount >= FLAG_CHANGE_HANDLERS_MAX) {
+        fprintf(stderr, "plasmasnow: too many flag change handlers.\n");
+        return;
+    }
+    const unsigned int bit = 1u << mFlagChangeHandlerCount;
+    mFlagChangeHandlers[mFlagChangeHandlerCount++] = handler;
+
+    for (const int *id = flagIds; *id != FLAG_ID_END; id++) {
+        mFlagChangeSubscribers[*id] |= bit;
+    }
+}
+
+/** *********************************************************************
+ ** These methods mark the subscribers of a flag, or all of
+ ** them, for the next dispatch.
+ **/
+void publishFlagChange(int flagId) {
+    mPendingFlagChanges |= mFlagChangeSubscribers[flagId];
+}
+
+void publishAllFlagChanges() {
+    mPendingFlagChanges = ~0u;
+}
+
+/** *********************************************************************
+ ** This method runs each marked handler once. Returns
+ ** whether any ran. Changes handlers publish wait for the
+ ** next dispatch.
+ **/
+int dispatchFlagChanges() {
+    const unsigned int pending = mPendingFlagChanges;
+    mPendingFlagChanges = 0;
+    if (!pending) {
+        return false;
+    }
+
+    for (int i = 0; i < mFlagChangeHandlerCount; i++) {
+        if (pending & (1u << i)) {
+            mFlagChangeHandlers[i]();
+        }
+    }
+    return true;
 }
@@ -65,6 +65,35 @@ extern FLAGS OldFlags;
 extern FLAGS DefaultFlags;
 extern FLAGS VintageFlags;
 
+// Flag change events: one per flag, plus changes that
+// aren't of one flag.
+typedef enum {
+#define DOIT_I(x, d, v) FLAG_ID_##x,
+#define DOIT_L(x, d, v) FLAG_ID_##x,
+#define DOIT_S(x, d, v) FLAG_ID_##x,
+        DOITALL
+#undef DOIT_I
+#undef DOIT_L
+#undef DOIT_S
+
+        FLAG_EVENT_WINDOW_SCALE,  // mGlobal.WindowScale changed.
+        FLAG_EVENT_COLOR_PICKER,  // the color picker closed.
+
+        FLAG_ID_COUNT
+} FLAG_ID;
+
+#define FLAG_ID_END (-1)
+#define FLAG_CHANGE_HANDLERS_MAX 32
+
+typedef void (*FlagChangeHandler)(void);
+
+extern void subscribeFlagChanges(FlagChangeHandler handler,
+    const int *flagIds);
+extern void publishFlagChange(int flagId);
+extern void publishAllFlagChanges(void);
+extern int dispatchFlagChanges(void);
+
 extern int HandleFlags(int argc, char *argv[]);
 extern void InitFlags(void);
 extern void WriteFlags(void);
+extern void flushFlagsFile(void);
@@ -0,0 +1,310 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "FlakeKernels.h"
+
+
+/***********************************************************
+ * Batched flake and bird kernels.
+ *
+ * The loops below are written branch-free so the compiler
+ * can vectorize them. On x86_64 GCC builds an AVX2 and a
+ * baseline (SSE2) clone of each kernel, and picks one at
+ * load time from the running CPU. Elsewhere the plain
+ * (scalar or autovectorized) version is used.
+ */
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    !defined(__clang__)
+    #define FLAKEKERNEL __attribute__((target_clones("avx2", "default")))
+#else
+    #define FLAKEKERNEL
+#endif
+
+
+/***********************************************************
+ * This method updates vx / vy of flakes 0 .. n-1, with
+ * (gx, gy) the wind grid sampled at the flake:
+ *
+ *     vx += clamp(dt * wsens / m, 0.9) * (newWind + gx - vx)
+ *     vx  = clamp(vx, xVelMax)
+ *     vy += jitterScale * (random - 0.4)
+ *         + clamp(dt * wsens / m, 0.9) * gy
+ *     vy  = min(vy, 1.5 * ivy)
+ */
+FLAKEKERNEL
+void flakeKernelsIntegrateVelocities(FlakePool* p, int n,
+    float dt, float newWind, const WindGrid* grid, float xVelMax,
+    bool applyWind, float jitterScale, const float* random) {
+
+    float* restrict vx = p->vx;
+    float* restrict vy = p->vy;
+    const float* restrict rx = p->rx;
+    const float* restrict ry = p->ry;
+    const float* restrict m = p->m;
+    const float* restrict ivy = p->ivy;
+    const float* restrict wsens = p->wsens;
+
+    const float windOn = applyWind ? 1.0f : 0.0f;
+
+    // No grid samples a zero cell.
+    static const WindGrid NO_WIND_GRID;
+    const WindGrid* restrict g = grid ? grid : &NO_WIND_GRID;
+    const float maxCol = WIND_GRID_COLUMNS - 1.001f;
+    const float maxRow = WIND_GRID_ROWS - 1.001f;
+
+    for (int i = 0; i < n; i++) {
+        // Grid look-up, clamped to the outer cell centers.
+        float gcol = rx[i] * g->invCellWidth - 0.5f;
+        float grow = ry[i] * g->invCellHeight - 0.5f;
+        gcol = gcol < 0.0f ? 0.0f : gcol > maxCol ? maxCol : gcol;
+        grow = grow < 0.0f ? 0.0f : grow > maxRow ? maxRow : grow;
+        const int col = (int) gcol;
+        const int row = (int) grow;
+        const float fc = gcol - col;
+        const float fr = grow - row;
+        const float w00 = (1 - fc) * (1 - fr);
+        const float w01 = fc * (1 - fr);
+        const float w10 = (1 - fc) * fr;
+        const float w11 = fc * fr;
+        const float gx = w00 * g->wx[row][col] +
+            w01 * g->wx[row][col + 1] +
+            w10 * g->wx[row + 1][col] + w11 * g->wx[row + 1][col + 1];
+        const float gy = w00 * g->wy[row][col] +
+            w01 * g->wy[row][col + 1] +
+            w10 * g->wy[row + 1][col] + w11 * g->wy[row + 1][col + 1];
+
+        // X Direction.
+        float pull = dt * wsens[i] / m[i];
+        pull = pull > 0.9f ? 0.9f : pull;
+        pull = pull < -0.9f ? -0.9f : pull;
+
+        float newVx = vx[i] + pull * (newWind + gx - vx[i]);
+        newVx = newVx > xVelMax ? xVelMax : newVx;
+        newVx = newVx < -xVelMax ? -xVelMax : newVx;
+
+        // Y Direction.
+        float newVy = vy[i] + jitterScale * (random[i] - 0.4f) +
+            windOn * pull * gy;
+        const float vyMax = 1.5f * ivy[i];
+        newVy = newVy > vyMax ? vyMax : newVy;
+
+        vx[i] += windOn * (newVx - vx[i]);
+        vy[i] = newVy;
+    }
+}
+
+/***********************************************************
+ * This method is the 3-tap box filter of fallen snow
+ * heights: out[i] = (in[i] + in[i + 1] + in[i + 2]) / 3,
+ * for i in 0 .. n-1. in holds n + 2 values.
+ */
+FLAKEKERNEL
+void flakeKernelsSmoothHeights(short int* out,
+    const short int* in, int n) {
+    for (int i = 0; i < n; i++) {
+        out[i] = ((int) in[i] + in[i + 1] + in[i + 2]) / 3;
+    }
+}
+
+/***********************************************************
+ * This method blends a w x h box of pre-multiplied ARGB32
+ * pixels, scaled by alpha (0 .. 256), over dst:
+ *
+ *     s    = src * alpha / 256
+ *     dst  = s + dst * (255 - s.a) / 255
+ *
+ * Strides are in pixels. Two 8 bit channels are done per
+ * 32 bit multiply, and rows vectorize across pixels.
+ */
+FLAKEKERNEL
+void flakeKernelsBlendOver(uint32_t* dst, int dstStride,
+    const uint32_t* src, int srcStride, int w, int h, int alpha) {
+    for (int y = 0; y < h; y++) {
+        uint32_t* restrict d = dst + (size_t) y * dstStride;
+        const uint32_t* restrict s = src + (size_t) y * srcStride;
+
+        for (int x = 0; x < w; x++) {
+            const uint32_t sp = s[x];
+            const uint32_t dp = d[x];
+
+            const uint32_t srb = ((sp & 0x00ff00ffu) * alpha >> 8) &
+                0x00ff00ffu;
+            const uint32_t sag = (((sp >> 8) & 0x00ff00ffu) * alpha) &
+                0xff00ff00u;
+            const uint32_t sPixel = srb | sag;
+            const uint32_t inverse = 255 - (sPixel >> 24);
+
+            // x / 255 as (x + 128 + (x + 128) / 256) / 256.
+            uint32_t drb = (dp & 0x00ff00ffu) * inverse + 0x00800080u;
+            drb = ((drb + ((drb >> 8) & 0x00ff00ffu)) >> 8) & 0x00ff00ffu;
+            uint32_t dag = ((dp >> 8) & 0x00ff00ffu) * inverse +
+                0x00800080u;
+            dag = (dag + ((dag >> 8) & 0x00ff00ffu)) & 0xff00ff00u;
+
+            d[x] = sPixel + (drb | dag);
+        }
+    }
+}
+
+/***********************************************************
+ * This method blends a solid pre-multiplied, opaque ARGB32
+ * color through a w x h box of an A8 mask, scaled by alpha
+ * (0 .. 256), over dst. Each pixel is the over of
+ * flakeKernelsBlendOver() with the color at mask coverage.
+ * Strides are in pixels, the mask one in bytes.
+ */
+FLAKEKERNEL
+void flakeKernelsBlendMask(uint32_t* dst, int dstStride,
+    const uint8_t* mask, int maskStride, int w, int h,
+    uint32_t color, int alpha) {
+    const uint32_t crb = color & 0x00ff00ffu;
+    const uint32_t cag = (color >> 8) & 0x00ff00ffu;
+
+    for (int y = 0; y < h; y++) {
+        uint32_t* restrict d = dst + (size_t) y * dstStride;
+        const uint8_t* restrict m = mask + (size_t) y * maskStride;
+
+        for (int x = 0; x < w; x++) {
+            // Coverage 0 .. 255 as a scale 0 .. 256.
+            uint32_t scale = m[x] * alpha >> 8;
+            scale += scale >> 7;
+
+            const uint32_t srb = (crb * scale >> 8) & 0x00ff00ffu;
+            const uint32_t sag = (cag * scale) & 0xff00ff00u;
+            const uint32_t sPixel = srb | sag;
+            const uint32_t inverse = 255 - (sPixel >> 24);
+
+            const uint32_t dp = d[x];
+            uint32_t drb = (dp & 0x00ff00ffu) * inverse + 0x00800080u;
+            drb = ((drb + ((drb >> 8) & 0x00ff00ffu)) >> 8) & 0x00ff00ffu;
+            uint32_t dag = ((dp >> 8) & 0x00ff00ffu) * inverse +
+                0x00800080u;
+            dag = (dag + ((dag >> 8) & 0x00ff00ffu)) & 0xff00ff00u;
+
+            d[x] = sPixel + (drb | dag);
+        }
+    }
+}
+
+/***********************************************************
+ * This method is 1 / sqrt(v), from the bit level estimate
+ * and two Newton steps (relative error below 1e-5). Unlike
+ * sqrtf(), it vectorizes without -fno-math-errno.
+ */
+static inline float getFastInverseSqrt(float v) {
+    union {
+        float f;
+        uint32_t i;
+    } bits = { v };
+    bits.i = 0x5f3759dfu - (bits.i >> 1);
+
+    float y = bits.f;
+    y *= 1.5f - 0.5f * v * y * y;
+    y *= 1.5f - 0.5f * v * y * y;
+    return y;
+}
+
+// Partial sums of flakeKernelsSumNeighbours(), per lane.
+typedef struct {
+    float sx[NEIGHBOUR_LANES];
+    float sy[NEIGHBOUR_LANES];
+    float sz[NEIGHBOUR_LANES];
+    float prefx[NEIGHBOUR_LANES];
+    float prefy[NEIGHBOUR_LANES];
+    float prefz[NEIGHBOUR_LANES];
+    float dist[NEIGHBOUR_LANES];
+} NeighbourLanes;
+
+/***********************************************************
+ * This method adds neighbour k of the bird at (bx, by, bz)
+ * into lane j.
+ */
+static inline void addNeighbourLane(NeighbourLanes* lanes, int j,
+    const float* x, const float* y, const float* z, const float* sx,
+    const float* sy, const float* sz, int k, float bx, float by,
+    float bz, float prefDistance) {
+    const float dx = bx - x[k];
+    const float dy = by - y[k];
+    const float dz = bz - z[k];
+    const float d2 = dx * dx + dy * dy + dz * dz;
+    const float inverse = getFastInverseSqrt(d2);
+    const float dist = d2 * inverse;
+
+    const bool isApart = dist > 1e-6f;
+    const float e = isApart ? prefDistance * inverse : 0;
+    const float keep = isApart ? 1 : 0;
+
+    lanes->sx[j] += sx[k];
+    lanes->sy[j] += sy[k];
+    lanes->sz[j] += sz[k];
+    lanes->prefx[j] += e * dx + keep * x[k];
+    lanes->prefy[j] += e * dy + keep * y[k];
+    lanes->prefz[j] += e * dz + keep * z[k];
+    lanes->dist[j] += dist;
+}
+
+/***********************************************************
+ * This method sums, over n neighbours of the bird at
+ * (bx, by, bz), their speeds, distances, and the positions
+ * at prefDistance from each on the line to the bird:
+ *
+ *     pref = prefDistance * (b - p) / |b - p| + p
+ *
+ * Neighbours closer than 1e-6 add no preferred position.
+ * Sums go into NEIGHBOUR_LANES partial sums, so the lane
+ * loop vectorizes without reassociating a float reduction,
+ * and are added up at the end.
+ */
+FLAKEKERNEL
+void flakeKernelsSumNeighbours(const float* x, const float* y,
+    const float* z, const float* sx, const float* sy, const float* sz,
+    int n, float bx, float by, float bz, float prefDistance,
+    NeighbourSums* sums) {
+    NeighbourLanes lanes = { 0 };
+
+    int i = 0;
+    for (; i + NEIGHBOUR_LANES <= n; i += NEIGHBOUR_LANES) {
+        for (int j = 0; j < NEIGHBOUR_LANES; j++) {
+            addNeighbourLane(&lanes, j, x, y, z, sx, sy, sz, i + j,
+                bx, by, bz, prefDistance);
+        }
+    }
+    for (int j = 0; i + j < n; j++) {
+        addNeighbourLane(&lanes, j, x, y, z, sx, sy, sz, i + j,
+            bx, by, bz, prefDistance);
+    }
+
+    *sums = (NeighbourSums) { 0 };
+    for (int j = 0; j < NEIGHBOUR_LANES; j++) {
+        sums->sx += lanes.sx[j];
+        sums->sy += lanes.sy[j];
+        sums->sz += lanes.sz[j];
+        sums->prefx += lanes.prefx[j];
+        sums->prefy += lanes.prefy[j];
+        sums->prefz += lanes.prefz[j];
+        sums->dist += lanes.dist[j];
+    }
+}
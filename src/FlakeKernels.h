@@ -0,0 +1,79 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FlakePool.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define WIND_GRID_COLUMNS 16
+#define WIND_GRID_ROWS 10
+
+// Coarse wind field over the snow window, added to the
+// global wind. Values sit at cell centers, flakes sample
+// it bilinearly.
+typedef struct {
+    float invCellWidth;       // cells per pixel
+    float invCellHeight;
+
+    float wx[WIND_GRID_ROWS][WIND_GRID_COLUMNS];   // pixels/second
+    float wy[WIND_GRID_ROWS][WIND_GRID_COLUMNS];
+} WindGrid;
+
+
+// Partial sums flakeKernelsSumNeighbours() keeps, one
+// AVX2 register (two SSE / NEON ones) of floats.
+#define NEIGHBOUR_LANES 8
+
+// What steering a bird needs from its neighbours.
+typedef struct {
+    float sx, sy, sz;         // summed speeds
+    float prefx, prefy, prefz; // summed preferred positions
+    float dist;               // summed distances
+} NeighbourSums;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void flakeKernelsIntegrateVelocities(FlakePool* p, int n,
+    float dt, float newWind, const WindGrid* grid, float xVelMax,
+    bool applyWind, float jitterScale, const float* random);
+
+void flakeKernelsSmoothHeights(short int* out,
+    const short int* in, int n);
+
+void flakeKernelsBlendOver(uint32_t* dst, int dstStride,
+    const uint32_t* src, int srcStride, int w, int h, int alpha);
+void flakeKernelsBlendMask(uint32_t* dst, int dstStride,
+    const uint8_t* mask, int maskStride, int w, int h,
+    uint32_t color, int alpha);
+
+void flakeKernelsSumNeighbours(const float* x, const float* y,
+    const float* z, const float* sx, const float* sy, const float* sz,
+    int n, float bx, float by, float bz, float prefDistance,
+    NeighbourSums* sums);
@@ -0,0 +1,201 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FlakePool.h"
+#include "safe_malloc.h"
+
+
+/** *********************************************************************
+ ** FlakePool lifecycle methods.
+ **/
+void flakePoolInit(FlakePool* p) {
+    memset(p, 0, sizeof(FlakePool));
+    flakePoolResize(p, FLAKEPOOL_INIT_CAPACITY);
+}
+
+int flakePoolSize(FlakePool* p) {
+    return p->mItemSize;
+}
+
+void flakePoolResize(FlakePool* p, int newCapacity) {
+    if (newCapacity < p->mItemSize) {
+        return;
+    }
+
+    #define FLAKEPOOL_RESIZE(array) \
+        p->array = tracked_realloc(MEMORY_FLAKES, p->array, \
+            sizeof(*p->array) * newCapacity); \
+        REALLOC_CHECK(p->array);
+
+    FLAKEPOOL_RESIZE(rx);
+    FLAKEPOOL_RESIZE(ry);
+    FLAKEPOOL_RESIZE(px);
+    FLAKEPOOL_RESIZE(py);
+    FLAKEPOOL_RESIZE(vx);
+    FLAKEPOOL_RESIZE(vy);
+    FLAKEPOOL_RESIZE(m);
+    FLAKEPOOL_RESIZE(ivy);
+    FLAKEPOOL_RESIZE(wsens);
+    FLAKEPOOL_RESIZE(contactIn);
+    FLAKEPOOL_RESIZE(ix);
+    FLAKEPOOL_RESIZE(iy);
+    FLAKEPOOL_RESIZE(whatFlake);
+    FLAKEPOOL_RESIZE(state);
+
+    #undef FLAKEPOOL_RESIZE
+
+    p->mCapacity = newCapacity;
+}
+
+void flakePoolFree(FlakePool* p) {
+    tracked_free(p->rx);
+    tracked_free(p->ry);
+    tracked_free(p->px);
+    tracked_free(p->py);
+    tracked_free(p->vx);
+    tracked_free(p->vy);
+    tracked_free(p->m);
+    tracked_free(p->ivy);
+    tracked_free(p->wsens);
+    tracked_free(p->contactIn);
+    tracked_free(p->ix);
+    tracked_free(p->iy);
+    tracked_free(p->whatFlake);
+    tracked_free(p->state);
+
+    memset(p, 0, sizeof(FlakePool));
+}
+
+/** *********************************************************************
+ ** This method appends a zeroed flake, and returns its index.
+ **/
+int flakePoolAdd(FlakePool* p) {
+    return flakePoolAddRange(p, 1);
+}
+
+/** *********************************************************************
+ ** This method appends n zeroed flakes in one step, and
+ ** returns the index of the first. The rest follow it.
+ **/
+int flakePoolAddRange(FlakePool* p, int n) {
+    if (p->mItemSize + n > p->mCapacity) {
+        int newCapacity = (p->mCapacity > 0) ?
+            p->mCapacity * 2 : FLAKEPOOL_INIT_CAPACITY;
+        while (newCapacity < p->mItemSize + n) {
+            newCapacity *= 2;
+        }
+        flakePoolResize(p, newCapacity);
+    }
+
+    const int first = p->mItemSize;
+    p->mItemSize += n;
+
+    #define FLAKEPOOL_CLEAR(array) \
+        memset(&p->array[first], 0, sizeof(*p->array) * n);
+
+    FLAKEPOOL_CLEAR(rx);
+    FLAKEPOOL_CLEAR(ry);
+    FLAKEPOOL_CLEAR(vx);
+    FLAKEPOOL_CLEAR(vy);
+    FLAKEPOOL_CLEAR(m);
+    FLAKEPOOL_CLEAR(ivy);
+    FLAKEPOOL_CLEAR(wsens);
+    FLAKEPOOL_CLEAR(contactIn);
+    FLAKEPOOL_CLEAR(ix);
+    FLAKEPOOL_CLEAR(iy);
+    FLAKEPOOL_CLEAR(whatFlake);
+    FLAKEPOOL_CLEAR(state);
+
+    #undef FLAKEPOOL_CLEAR
+
+    for (int i = first; i < first + n; i++) {
+        p->px[i] = NAN;
+        p->py[i] = NAN;
+    }
+
+    return first;
+}
+
+/** *********************************************************************
+ ** This method removes a flake by moving the last flake
+ ** into its slot.
+ **/
+void flakePoolDelete(FlakePool* p, int i) {
+    if (i < 0 || i >= p->mItemSize) {
+        return;
+    }
+
+    const int last = --p->mItemSize;
+    if (i != last) {
+        p->rx[i] = p->rx[last];
+        p->ry[i] = p->ry[last];
+        p->px[i] = p->px[last];
+        p->py[i] = p->py[last];
+        p->vx[i] = p->vx[last];
+        p->vy[i] = p->vy[last];
+        p->m[i] = p->m[last];
+        p->ivy[i] = p->ivy[last];
+        p->wsens[i] = p->wsens[last];
+        p->contactIn[i] = p->contactIn[last];
+        p->ix[i] = p->ix[last];
+        p->iy[i] = p->iy[last];
+        p->whatFlake[i] = p->whatFlake[last];
+        p->state[i] = p->state[last];
+    }
+
+    // Re-claim down, but never below the initial capacity.
+    if (p->mCapacity > FLAKEPOOL_INIT_CAPACITY &&
+        p->mItemSize == p->mCapacity / 4) {
+        flakePoolResize(p, p->mCapacity / 2);
+    }
+}
+
+/** *********************************************************************
+ ** This method keeps every position as the one before the
+ ** step about to be taken, for drawing in between.
+ **/
+void flakePoolSavePositions(FlakePool* p) {
+    memcpy(p->px, p->rx, sizeof(float) * p->mItemSize);
+    memcpy(p->py, p->ry, sizeof(float) * p->mItemSize);
+}
+
+/** *********************************************************************
+ ** FlakePool state bit helpers.
+ **/
+bool flakePoolHasState(FlakePool* p, int i, unsigned char bit) {
+    return (p->state[i] & bit) != 0;
+}
+
+void flakePoolSetState(FlakePool* p, int i, unsigned char bit,
+    bool value) {
+    if (value) {
+        p->state[i] |= bit;
+    } else {
+        p->state[i] &= ~bit;
+    }
+}
@@ -0,0 +1,91 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/***********************************************************
+ * FlakePool consts.
+ */
+#define FLAKEPOOL_INIT_CAPACITY 1024
+
+// Flake types a 16 bit whatFlake indexes.
+#define FLAKE_TYPES_MAX 65536
+
+// Flake state bits.
+#define FLAKE_CYCLIC 0x01 // flake wraps around left / right
+
+/***********************************************************
+ * Contiguous structure-of-arrays flake storage.
+ *
+ * A flake is an index into the arrays. Deleting swaps the
+ * last flake into the hole, so indexes are only stable
+ * until the next flakePoolDelete().
+ *
+ * Color and size come from the flake type, so a flake keeps
+ * only its 16 bit index. Fluff lifetimes live in DebrisPool.
+ */
+typedef struct {
+    int mCapacity;
+    int mItemSize;
+
+    float* rx;                // x position
+    float* ry;                // y position
+
+    float* px;                // position before the last step,
+    float* py;                // NAN until first stepped
+
+    float* vx;                // speed in x-direction, pixels/second
+    float* vy;                // speed in y-direction, pixels/second
+
+    float* m;                 // mass of flake
+    float* ivy;               // initial speed in y direction
+    float* wsens;             // wind dependency factor
+
+    float* contactIn;         // seconds it can't land in, 0:
+                              // test for landing this step
+
+    int* ix;                  // position after draw
+    int* iy;
+
+    uint16_t* whatFlake;      // snowflake index, into snowPix[]
+    unsigned char* state;     // FLAKE_* bits
+} FlakePool;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void flakePoolInit(FlakePool*);
+int flakePoolSize(FlakePool*);
+void flakePoolResize(FlakePool*, int);
+void flakePoolFree(FlakePool*);
+
+int flakePoolAdd(FlakePool*);
+int flakePoolAddRange(FlakePool*, int);
+void flakePoolDelete(FlakePool*, int);
+void flakePoolSavePositions(FlakePool*);
+
+bool flakePoolHasState(FlakePool*, int, unsigned char);
+void flakePoolSetState(FlakePool*, int, unsigned char, bool);
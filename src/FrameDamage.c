@@ -0,0 +1,331 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <X11/Xlib.h>
+#include <gtk/gtk.h>
+
+#include "FrameDamage.h"
+#include "plasmasnow.h"
+#include "safe_malloc.h"
+#include "ShmPresent.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * Only used on the non double buffered X11 path: all module
+ * erases of one frame are merged into mFrameDamage, cleared
+ * with as few XClearArea requests as possible (or restored
+ * in the MIT-SHM frame image, see ShmPresent.c), and static
+ * layers repaint clipped to it. Clears made outside a frame
+ * (settings changes, the FallenSnow thread) collect into
+ * mPendingDamage and join the next frame.
+ *
+ * Presenters that send only what changed also need where
+ * sprites were drawn this frame, not only where they were
+ * erased: modules report their new boxes into mDrawnBoxes
+ * while drawing.
+ */
+cairo_region_t* mFrameDamage = NULL;
+cairo_region_t* mPendingDamage = NULL;
+
+// Cleared since the last synthetic Expose, see
+// sendExposeDamage().
+cairo_region_t* mExposeDamage = NULL;
+
+// Between beginFrameDamage() and clearFrameDamage().
+bool mFrameDamageCollecting = false;
+
+int mFrameDamageFrameCount = 0;
+
+// Between clearFrameDamage() and endFrameDamage(), and only
+// with a presenter that needs them.
+bool mDrawnDamageCollecting = false;
+cairo_rectangle_int_t* mDrawnBoxes = NULL;
+int mDrawnBoxCount = 0;
+int mDrawnBoxCapacity = 0;
+
+pthread_mutex_t mFrameDamageMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/** *********************************************************************
+ ** This method starts collecting a frame. Pending damage
+ ** is taken over, and now and then the whole window.
+ **/
+void beginFrameDamage() {
+    pthread_mutex_lock(&mFrameDamageMutex);
+
+    if (mFrameDamage) {
+        cairo_region_destroy(mFrameDamage);
+    }
+    mFrameDamage = mPendingDamage ?
+        mPendingDamage : cairo_region_create();
+    mPendingDamage = NULL;
+
+    if (mFrameDamageFrameCount++ % FRAME_DAMAGE_REFRESH_FRAMES == 0) {
+        const cairo_rectangle_int_t window = {
+            0, 0, mGlobal.SnowWinWidth, mGlobal.SnowWinHeight
+        };
+        cairo_region_union_rectangle(mFrameDamage, &window);
+    }
+    mFrameDamageCollecting = true;
+
+    pthread_mutex_unlock(&mFrameDamageMutex);
+}
+
+bool isCollectingFrameDamage() {
+    return mFrameDamageCollecting;
+}
+
+/** *********************************************************************
+ ** These methods merge one box into the frame, or into
+ ** the pending damage for the next frame.
+ **/
+void addFrameDamage(int x, int y, int w, int h) {
+    const cairo_rectangle_int_t box = { x, y, w, h };
+
+    pthread_mutex_lock(&mFrameDamageMutex);
+    if (mFrameDamage && mFrameDamageCollecting) {
+        cairo_region_union_rectangle(mFrameDamage, &box);
+    }
+    pthread_mutex_unlock(&mFrameDamageMutex);
+}
+
+void addPendingDamage(int x, int y, int w, int h) {
+    const cairo_rectangle_int_t box = { x, y, w, h };
+
+    pthread_mutex_lock(&mFrameDamageMutex);
+    if (!mPendingDamage) {
+        mPendingDamage = cairo_region_create();
+    }
+    cairo_region_union_rectangle(mPendingDamage, &box);
+    pthread_mutex_unlock(&mFrameDamageMutex);
+}
+
+/** *********************************************************************
+ ** This method records the box a module just drew into,
+ ** the same box it will erase next frame. Boxes are only
+ ** kept as a list here, and merged once at present. Main
+ ** thread only, as all module draws.
+ **/
+void addDrawnDamage(int x, int y, int w, int h) {
+    if (!mDrawnDamageCollecting || w <= 0 || h <= 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&mFrameDamageMutex);
+    if (mDrawnDamageCollecting) {
+        if (mDrawnBoxCount == mDrawnBoxCapacity) {
+            mDrawnBoxCapacity = mDrawnBoxCapacity ?
+                2 * mDrawnBoxCapacity : 256;
+            mDrawnBoxes = realloc(mDrawnBoxes,
+                sizeof(*mDrawnBoxes) * mDrawnBoxCapacity);
+            REALLOC_CHECK(mDrawnBoxes);
+        }
+        const cairo_rectangle_int_t box = { x, y, w, h };
+        mDrawnBoxes[mDrawnBoxCount++] = box;
+    }
+    pthread_mutex_unlock(&mFrameDamageMutex);
+}
+
+/** *********************************************************************
+ ** This method snaps a region outward to the tile grid,
+ ** which merges clusters of small boxes.
+ **/
+static cairo_region_t* getTiledRegion(cairo_region_t* region) {
+    cairo_region_t* tiled = cairo_region_create();
+
+    const int count = cairo_region_num_rectangles(region);
+    for (int i = 0; i < count; i++) {
+        cairo_rectangle_int_t box;
+        cairo_region_get_rectangle(region, i, &box);
+
+        const int x0 = box.x / FRAME_DAMAGE_TILE_SIZE;
+        const int y0 = box.y / FRAME_DAMAGE_TILE_SIZE;
+        const int x1 = (box.x + box.width - 1) / FRAME_DAMAGE_TILE_SIZE;
+        const int y1 = (box.y + box.height - 1) / FRAME_DAMAGE_TILE_SIZE;
+
+        const cairo_rectangle_int_t tile = {
+            x0 * FRAME_DAMAGE_TILE_SIZE, y0 * FRAME_DAMAGE_TILE_SIZE,
+            (x1 - x0 + 1) * FRAME_DAMAGE_TILE_SIZE,
+            (y1 - y0 + 1) * FRAME_DAMAGE_TILE_SIZE
+        };
+        cairo_region_union_rectangle(tiled, &tile);
+    }
+
+    return tiled;
+}
+
+/** *********************************************************************
+ ** This method coarsens a region to at most so many boxes,
+ ** first on the tile grid, then to its bounding box.
+ **/
+static void coarsenRegion(cairo_region_t** region, int maxBoxes) {
+    if (cairo_region_num_rectangles(*region) > maxBoxes) {
+        cairo_region_t* tiled = getTiledRegion(*region);
+        cairo_region_destroy(*region);
+        *region = tiled;
+    }
+    if (cairo_region_num_rectangles(*region) > maxBoxes) {
+        cairo_rectangle_int_t extents;
+        cairo_region_get_extents(*region, &extents);
+        cairo_region_destroy(*region);
+        *region = cairo_region_create_rectangle(&extents);
+    }
+}
+
+/** *********************************************************************
+ ** This method clears the frame damage from the window.
+ ** The (possibly coarsened) region is kept for clipping.
+ **/
+void clearFrameDamage(Display* display, Window window,
+    Bool exposures) {
+    pthread_mutex_lock(&mFrameDamageMutex);
+    mFrameDamageCollecting = false;
+    if (!mFrameDamage) {
+        pthread_mutex_unlock(&mFrameDamageMutex);
+        return;
+    }
+
+    coarsenRegion(&mFrameDamage, FRAME_DAMAGE_MAX_CLEARS);
+
+    const int count = cairo_region_num_rectangles(mFrameDamage);
+    for (int i = 0; i < count; i++) {
+        cairo_rectangle_int_t box;
+        cairo_region_get_rectangle(mFrameDamage, i, &box);
+        if (isShmPresentActive()) {
+            restoreShmPresentArea(box.x, box.y, box.width, box.height);
+        } else {
+            XClearArea(display, window, box.x, box.y,
+                box.width, box.height, exposures);
+        }
+    }
+
+    if (!mExposeDamage) {
+        mExposeDamage = cairo_region_create();
+    }
+    cairo_region_union(mExposeDamage, mFrameDamage);
+
+    mDrawnBoxCount = 0;
+    mDrawnDamageCollecting = isShmPresentActive();
+
+    pthread_mutex_unlock(&mFrameDamageMutex);
+}
+
+/** *********************************************************************
+ ** This method returns a copy of the frame damage, with
+ ** the boxes drawn since it was cleared, for presenters
+ ** that send only what changed: old and new places of all
+ ** that moved.
+ **/
+cairo_region_t* copyFrameDamage() {
+    pthread_mutex_lock(&mFrameDamageMutex);
+    cairo_region_t* damage = mFrameDamage ?
+        cairo_region_copy(mFrameDamage) : NULL;
+    if (damage && mDrawnBoxCount > 0) {
+        cairo_region_t* drawn = cairo_region_create_rectangles(
+            mDrawnBoxes, mDrawnBoxCount);
+        cairo_region_union(damage, drawn);
+        cairo_region_destroy(drawn);
+    }
+    pthread_mutex_unlock(&mFrameDamageMutex);
+
+    return damage;
+}
+
+/** *********************************************************************
+ ** This method sends one synthetic Expose per box cleared
+ ** since the last call, and nothing for a static scene.
+ **/
+void sendExposeDamage(Display* display, Window window) {
+    pthread_mutex_lock(&mFrameDamageMutex);
+    cairo_region_t* damage = mExposeDamage;
+    mExposeDamage = NULL;
+    pthread_mutex_unlock(&mFrameDamageMutex);
+
+    if (!damage) {
+        return;
+    }
+    coarsenRegion(&damage, FRAME_DAMAGE_MAX_EXPOSES);
+
+    const int count = cairo_region_num_rectangles(damage);
+    for (int i = 0; i < count; i++) {
+        cairo_rectangle_int_t box;
+        cairo_region_get_rectangle(damage, i, &box);
+
+        XExposeEvent event;
+        event.type = Expose;
+        event.send_event = True;
+        event.display = display;
+        event.window = window;
+        event.x = box.x;
+        event.y = box.y;
+        event.width = box.width;
+        event.height = box.height;
+        event.count = count - 1 - i;
+
+        XSendEvent(display, window, True, Expose, (XEvent*) &event);
+    }
+
+    cairo_region_destroy(damage);
+}
+
+/** *********************************************************************
+ ** This method ends the frame.
+ **/
+void endFrameDamage() {
+    pthread_mutex_lock(&mFrameDamageMutex);
+    mDrawnDamageCollecting = false;
+    mDrawnBoxCount = 0;
+    if (mFrameDamage) {
+        cairo_region_destroy(mFrameDamage);
+        mFrameDamage = NULL;
+    }
+    pthread_mutex_unlock(&mFrameDamageMutex);
+}
+
+/** *********************************************************************
+ ** These methods clip a static layer draw to the frame
+ ** damage. Without an active frame they only save/restore.
+ **/
+void pushFrameDamageClip(cairo_t* cc) {
+    cairo_save(cc);
+
+    pthread_mutex_lock(&mFrameDamageMutex);
+    if (mFrameDamage) {
+        const int count = cairo_region_num_rectangles(mFrameDamage);
+        for (int i = 0; i < count; i++) {
+            cairo_rectangle_int_t box;
+            cairo_region_get_rectangle(mFrameDamage, i, &box);
+            cairo_rectangle(cc, box.x, box.y, box.width, box.height);
+        }
+        cairo_clip(cc);
+    }
+    pthread_mutex_unlock(&mFrameDamageMutex);
+}
+
+void popFrameDamageClip(cairo_t* cc) {
+    cairo_restore(cc);
+}
@@ -0,0 +1,61 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+#include <gtk/gtk.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+// Above this many clears, damage snaps to a coarse tile
+// grid, and above it again, to its bounding box.
+#define FRAME_DAMAGE_MAX_CLEARS 48
+#define FRAME_DAMAGE_TILE_SIZE  64
+
+// Most synthetic Expose events sent per time_sendevent.
+#define FRAME_DAMAGE_MAX_EXPOSES 16
+
+// Repaint all static layers every so many frames, in case
+// the server lost window content we were not told about.
+#define FRAME_DAMAGE_REFRESH_FRAMES 50
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void beginFrameDamage();
+bool isCollectingFrameDamage();
+void addFrameDamage(int x, int y, int w, int h);
+void addPendingDamage(int x, int y, int w, int h);
+void addDrawnDamage(int x, int y, int w, int h);
+void clearFrameDamage(Display* display, Window window,
+    Bool exposures);
+cairo_region_t* copyFrameDamage();
+void sendExposeDamage(Display* display, Window window);
+void endFrameDamage();
+
+void pushFrameDamageClip(cairo_t* cc);
+void popFrameDamageClip(cairo_t* cc);
@@ -0,0 +1,214 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gtk/gtk.h>
+
+#include "FallenSnow.h"
+#include "Flags.h"
+#include "FrameProfiler.h"
+#include "MainWindow.h"
+#include "plasmasnow.h"
+#include "PowerPolicy.h"
+#include "Scheduler.h"
+#include "Utils.h"
+#include "XTraffic.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+static const char* PROFILE_SLOT_NAMES[PROFILE_SLOT_COUNT] = {
+    "stars", "lights", "moon", "aurora", "meteor", "scenery",
+    "birds", "fallensnow", "santa", "treesnow", "snow", "frame",
+    "backdrop",
+    "flake tick", "genflakes tick", "fallensnow tick"
+};
+
+// Per slot ring buffer of recent samples, in ms.
+typedef struct _ProfileRing {
+        float samples[PROFILE_RING_SIZE];
+        int nextSample;
+        int sampleCount;
+
+        // Since start, for benchmark reports.
+        double totalMs;
+        long totalCount;
+} ProfileRing;
+
+ProfileRing mProfileRings[PROFILE_SLOT_COUNT];
+
+// The FallenSnow thread records too.
+pthread_mutex_t mProfileMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/** *********************************************************************
+ ** Add report method to mainloop.
+ **/
+void startFrameProfilerBackgroundThread() {
+    addMethodToMainloop(PRIORITY_DEFAULT,
+        TIME_BETWEEN_PROFILER_REPORTS,
+        execFrameProfilerBackgroundThread);
+}
+
+/** *********************************************************************
+ ** Periodically publish the report, to stdout
+ ** if -perfstats, and to the UI panel.
+ **/
+int execFrameProfilerBackgroundThread() {
+    if (Flags.shutdownRequested) {
+        return false;
+    }
+
+    char report[PROFILE_SLOT_COUNT * 64];
+    getProfileReport(report, sizeof(report));
+
+    if (Flags.PerfStats) {
+        printf("plasmasnow: frame profile (ms)\n%s", report);
+
+        char schedule[1024];
+        getSchedulerReport(schedule, sizeof(schedule));
+        printf("plasmasnow: timers (ms)\n%s", schedule);
+
+        char power[256];
+        getPowerPolicyReport(power, sizeof(power));
+        printf("plasmasnow: power policy\n%s", power);
+
+        char traffic[XTRAFFIC_SLOT_COUNT * 80];
+        getXTrafficReport(traffic, sizeof(traffic));
+        printf("plasmasnow: x traffic\n%s", traffic);
+        printf("plasmasnow: fallensnow lock waits: list %u, item %u\n",
+            getFallenSnowListContention(), getFallenSnowItemContention());
+        fflush(stdout);
+    }
+    ui_set_perfstats_text(report);
+
+    return true;
+}
+
+/** *********************************************************************
+ ** Sample helpers, monotonic clock.
+ **/
+double startProfileSample() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+void endProfileSample(PROFILE_SLOT slot, double start) {
+    const float elapsedMs = (startProfileSample() - start) * 1000.0;
+
+    pthread_mutex_lock(&mProfileMutex);
+    ProfileRing* ring = &mProfileRings[slot];
+    ring->samples[ring->nextSample] = elapsedMs;
+    ring->nextSample = (ring->nextSample + 1) % PROFILE_RING_SIZE;
+    if (ring->sampleCount < PROFILE_RING_SIZE) {
+        ring->sampleCount++;
+    }
+    ring->totalMs += elapsedMs;
+    ring->totalCount++;
+    pthread_mutex_unlock(&mProfileMutex);
+}
+
+/** *********************************************************************
+ ** This method returns a slot's time and sample count
+ ** since start.
+ **/
+void getProfileTotals(PROFILE_SLOT slot, double* totalMs, long* count) {
+    pthread_mutex_lock(&mProfileMutex);
+    *totalMs = mProfileRings[slot].totalMs;
+    *count = mProfileRings[slot].totalCount;
+    pthread_mutex_unlock(&mProfileMutex);
+}
+
+const char* getProfileSlotName(PROFILE_SLOT slot) {
+    return PROFILE_SLOT_NAMES[slot];
+}
+
+/** *********************************************************************
+ ** This method formats p50 / p95 / p99 of each slot
+ ** that has samples, one line per slot.
+ **/
+static int compareProfileSamples(const void* a, const void* b) {
+    const float fa = *(const float*) a;
+    const float fb = *(const float*) b;
+    return (fa > fb) - (fa < fb);
+}
+
+static float getSortedPercentile(const float* sorted,
+    int count, float percentile) {
+    const int index = lrintf(percentile * (count - 1));
+    return sorted[index];
+}
+
+static int getSortedProfileSamples(PROFILE_SLOT slot,
+    float* sorted) {
+    pthread_mutex_lock(&mProfileMutex);
+    const int count = mProfileRings[slot].sampleCount;
+    memcpy(sorted, mProfileRings[slot].samples,
+        count * sizeof(float));
+    pthread_mutex_unlock(&mProfileMutex);
+
+    qsort(sorted, count, sizeof(float), compareProfileSamples);
+    return count;
+}
+
+/** *********************************************************************
+ ** This method returns one percentile of a slot,
+ ** in ms, or 0 while it has no samples.
+ **/
+float getProfilePercentile(PROFILE_SLOT slot, float percentile) {
+    float sorted[PROFILE_RING_SIZE];
+    const int count = getSortedProfileSamples(slot, sorted);
+
+    return count == 0 ? 0 :
+        getSortedPercentile(sorted, count, percentile);
+}
+
+void getProfileReport(char* buffer, size_t size) {
+    buffer[0] = '\0';
+    size_t used = 0;
+
+    for (int slot = 0; slot < PROFILE_SLOT_COUNT; slot++) {
+        float sorted[PROFILE_RING_SIZE];
+        const int count = getSortedProfileSamples(slot, sorted);
+        if (count == 0) {
+            continue;
+        }
+
+        const int written = snprintf(buffer + used, size - used,
+            "%-16s p50 %7.3f  p95 %7.3f  p99 %7.3f\n",
+            PROFILE_SLOT_NAMES[slot],
+            getSortedPercentile(sorted, count, 0.50),
+            getSortedPercentile(sorted, count, 0.95),
+            getSortedPercentile(sorted, count, 0.99));
+        if (written < 0 || (size_t) written >= size - used) {
+            break;
+        }
+        used += written;
+    }
+}
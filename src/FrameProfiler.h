@@ -0,0 +1,77 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stddef.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define PROFILE_RING_SIZE 256
+
+// One slot per module draw & background tick.
+typedef enum {
+    PROFILE_STARS = 0,
+    PROFILE_LIGHTS,
+    PROFILE_MOON,
+    PROFILE_AURORA,
+    PROFILE_METEOR,
+    PROFILE_SCENERY,
+    PROFILE_BIRDS,
+    PROFILE_FALLENSNOW,
+    PROFILE_SANTA,
+    PROFILE_TREESNOW,
+    PROFILE_SNOW,
+    PROFILE_FRAME,
+    PROFILE_BACKDROP,
+
+    PROFILE_FLAKE_TICK,
+    PROFILE_GENFLAKES_TICK,
+    PROFILE_FALLENSNOW_TICK,
+
+    PROFILE_SLOT_COUNT
+} PROFILE_SLOT;
+
+// Time one statement into a profile slot.
+#define PROFILE(slot, statement) \
+    do { \
+        const double profileStart = startProfileSample(); \
+        statement; \
+        endProfileSample(slot, profileStart); \
+    } while (0)
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void startFrameProfilerBackgroundThread();
+int execFrameProfilerBackgroundThread();
+
+double startProfileSample();
+void endProfileSample(PROFILE_SLOT slot, double start);
+
+void getProfileTotals(PROFILE_SLOT slot, double* totalMs, long* count);
+const char* getProfileSlotName(PROFILE_SLOT slot);
+
+float getProfilePercentile(PROFILE_SLOT slot, float percentile);
+void getProfileReport(char* buffer, size_t size);
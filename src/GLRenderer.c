@@ -0,0 +1,561 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gtk/gtk.h>
+
+#include "plasmasnow.h"
+
+#ifdef HAVE_EPOXY
+#include <epoxy/gl.h>
+#endif
+
+#include "debug.h"
+#include "GLRenderer.h"
+#include "safe_malloc.h"
+
+
+#ifdef HAVE_EPOXY
+
+/***********************************************************
+ * Module globals.
+ *
+ * Optional GPU backend for the transparent GTK window. A
+ * GtkGLArea fills the window. Each frame, every module but
+ * the flakes still draws with cairo into one window sized
+ * image, which goes up as a texture. Flakes don't rasterize
+ * at all: snow_draw() hands their atlas boxes here, and the
+ * whole pool is drawn over that layer in one instanced
+ * call, sampling the flake atlas, which is only uploaded
+ * again when snow rebuilds it.
+ *
+ * Without a usable context, the window falls back to the
+ * cairo draw handler.
+ */
+void (*mGLDrawLayer)(cairo_t* cr) = NULL;
+GtkWidget* mGLWindow = NULL;
+GtkWidget* mGLArea = NULL;
+
+// Usable context, and a frame collecting sprites.
+bool mGLIsReady = false;
+bool mGLIsCollecting = false;
+
+GLuint mGLProgram = 0;
+GLint mGLViewSizeLocation = -1;
+GLint mGLTextureSizeLocation = -1;
+
+GLuint mGLVertexArray = 0;
+GLuint mGLCornerBuffer = 0;
+GLuint mGLInstanceBuffer = 0;
+GLsizeiptr mGLInstanceBufferSize = 0;
+
+// The cairo layer, and its texture.
+cairo_surface_t* mGLLayer = NULL;
+GLuint mGLLayerTexture = 0;
+
+// Atlas snow_draw() last set, and the version on the GPU.
+cairo_surface_t* mGLAtlas = NULL;
+unsigned int mGLAtlasVersion = 0;
+unsigned int mGLAtlasUploadedVersion = 0;
+GLuint mGLAtlasTexture = 0;
+
+// Per instance: x, y, then atlas x, y, width, height. The
+// first instance is the layer itself.
+#define GL_SPRITE_FLOATS 6
+
+GLfloat* mGLSprites = NULL;
+int mGLSpriteCount = 0;
+int mGLSpriteCapacity = 0;
+
+// One sprite, a quad stretched over its atlas box.
+const char* mGLVertexShader =
+    "#version 330 core\n"
+    "layout(location = 0) in vec2 aCorner;\n"
+    "layout(location = 1) in vec2 aPosition;\n"
+    "layout(location = 2) in vec4 aSource;\n"
+    "uniform vec2 uViewSize;\n"
+    "uniform vec2 uTextureSize;\n"
+    "out vec2 vTexCoord;\n"
+    "void main() {\n"
+    "    vec2 pixel = aPosition + aCorner * aSource.zw;\n"
+    "    vTexCoord = (aSource.xy + aCorner * aSource.zw) /\n"
+    "        uTextureSize;\n"
+    "    gl_Position = vec4(pixel.x / uViewSize.x * 2.0 - 1.0,\n"
+    "        1.0 - pixel.y / uViewSize.y * 2.0, 0.0, 1.0);\n"
+    "}\n";
+
+// Cairo surfaces are pre-multiplied already.
+const char* mGLFragmentShader =
+    "#version 330 core\n"
+    "in vec2 vTexCoord;\n"
+    "uniform sampler2D uTexture;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    fragColor = texture(uTexture, vTexCoord);\n"
+    "}\n";
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+static void handleGLAreaRealize(GtkGLArea* area, gpointer user_data);
+static void handleGLAreaUnrealize(GtkGLArea* area, gpointer user_data);
+static void handleGLAreaDestroy(GtkWidget* widget, gpointer user_data);
+static gboolean handleGLAreaRender(GtkGLArea* area,
+    GdkGLContext* context, gpointer user_data);
+static gboolean handleGLFallbackDraw(GtkWidget* widget, cairo_t* cr,
+    gpointer user_data);
+static int removeGLArea(gpointer user_data);
+
+static bool initGLObjects();
+static GLuint compileGLShader(GLenum type, const char* source);
+static GLuint createGLTexture();
+static void uploadGLTexture(GLuint texture, cairo_surface_t* surface,
+    bool isResized);
+static void drawGLSprites(GLuint texture, cairo_surface_t* surface,
+    int first, int count);
+
+
+/** *********************************************************************
+ ** This method puts a GL area in the transparent window, which
+ ** from then on draws through handleGLAreaRender(). drawLayer
+ ** is the cairo frame, called for the layer texture, or on the
+ ** window itself if GL turns out not to work.
+ **/
+bool createGLRenderer(GtkWidget* window,
+    void (*drawLayer)(cairo_t* cr)) {
+
+    mGLDrawLayer = drawLayer;
+    mGLWindow = window;
+
+    mGLArea = gtk_gl_area_new();
+    gtk_gl_area_set_required_version(GTK_GL_AREA(mGLArea), 3, 3);
+    gtk_gl_area_set_has_alpha(GTK_GL_AREA(mGLArea), TRUE);
+    gtk_gl_area_set_auto_render(GTK_GL_AREA(mGLArea), TRUE);
+
+    g_signal_connect(mGLArea, "realize",
+        G_CALLBACK(handleGLAreaRealize), NULL);
+    g_signal_connect(mGLArea, "unrealize",
+        G_CALLBACK(handleGLAreaUnrealize), NULL);
+    g_signal_connect(mGLArea, "destroy",
+        G_CALLBACK(handleGLAreaDestroy), NULL);
+    g_signal_connect(mGLArea, "render",
+        G_CALLBACK(handleGLAreaRender), NULL);
+
+    gtk_container_add(GTK_CONTAINER(window), mGLArea);
+    gtk_widget_show(mGLArea);
+    return true;
+}
+
+/** *********************************************************************
+ ** This method is true while a GL frame draws its cairo layer,
+ ** so flakes are to go to addGLSprite() instead.
+ **/
+bool isGLRendererActive() {
+    return mGLIsCollecting;
+}
+
+/** *********************************************************************
+ ** This method sets the atlas sprites come from. A new version
+ ** is uploaded at the next frame.
+ **/
+void setGLSpriteAtlas(cairo_surface_t* atlas, unsigned int version) {
+    mGLAtlas = atlas;
+    mGLAtlasVersion = version;
+}
+
+/** *********************************************************************
+ ** This method queues one atlas box, drawn at x, y.
+ **/
+void addGLSprite(int atlasX, int atlasY, int width, int height,
+    int x, int y) {
+
+    if (mGLSpriteCount >= mGLSpriteCapacity) {
+        mGLSpriteCapacity = MAX(GL_SPRITES_INITIAL,
+            2 * mGLSpriteCapacity);
+        mGLSprites = (GLfloat*) realloc(mGLSprites,
+            mGLSpriteCapacity * GL_SPRITE_FLOATS * sizeof(GLfloat));
+        REALLOC_CHECK(mGLSprites);
+    }
+
+    GLfloat* sprite = &mGLSprites[mGLSpriteCount * GL_SPRITE_FLOATS];
+    sprite[0] = x;
+    sprite[1] = y;
+    sprite[2] = atlasX;
+    sprite[3] = atlasY;
+    sprite[4] = width;
+    sprite[5] = height;
+    mGLSpriteCount++;
+}
+
+/** *********************************************************************
+ ** This method sets up the context, or falls back to cairo.
+ **/
+void handleGLAreaRealize(GtkGLArea* area,
+    __attribute__((unused)) gpointer user_data) {
+
+    gtk_gl_area_make_current(area);
+    if (gtk_gl_area_get_error(area) || !initGLObjects()) {
+        printf("plasmasnow: OpenGL not available, using cairo drawing.\n");
+        g_signal_connect(mGLWindow, "draw",
+            G_CALLBACK(handleGLFallbackDraw), NULL);
+        g_idle_add_full(G_PRIORITY_DEFAULT, (GSourceFunc) removeGLArea,
+            NULL, NULL);
+        return;
+    }
+
+    mGLIsReady = true;
+}
+
+/** *********************************************************************
+ ** This method frees GL objects while the context is current.
+ **/
+void handleGLAreaUnrealize(GtkGLArea* area,
+    __attribute__((unused)) gpointer user_data) {
+
+    mGLIsReady = false;
+
+    gtk_gl_area_make_current(area);
+    if (gtk_gl_area_get_error(area)) {
+        return;
+    }
+
+    glDeleteTextures(1, &mGLLayerTexture);
+    glDeleteTextures(1, &mGLAtlasTexture);
+    glDeleteBuffers(1, &mGLCornerBuffer);
+    glDeleteBuffers(1, &mGLInstanceBuffer);
+    glDeleteVertexArrays(1, &mGLVertexArray);
+    glDeleteProgram(mGLProgram);
+
+    mGLLayerTexture = mGLAtlasTexture = 0;
+    mGLCornerBuffer = mGLInstanceBuffer = 0;
+    mGLVertexArray = mGLProgram = 0;
+    mGLInstanceBufferSize = 0;
+    mGLAtlasUploadedVersion = 0;
+}
+
+/** *********************************************************************
+ ** This method forgets the area, as a restart of the window
+ ** removes its child.
+ **/
+void handleGLAreaDestroy(__attribute__((unused)) GtkWidget* widget,
+    __attribute__((unused)) gpointer user_data) {
+
+    mGLArea = NULL;
+    mGLIsReady = false;
+
+    if (mGLLayer) {
+        cairo_surface_destroy(mGLLayer);
+        mGLLayer = NULL;
+    }
+}
+
+/** *********************************************************************
+ ** This method is the idle call that takes a failed area out
+ ** of the window.
+ **/
+int removeGLArea(__attribute__((unused)) gpointer user_data) {
+    if (mGLArea) {
+        gtk_widget_destroy(mGLArea);
+    }
+    gtk_widget_queue_draw(mGLWindow);
+    return FALSE;
+}
+
+/** *********************************************************************
+ ** This method is the window draw callback once GL failed.
+ **/
+gboolean handleGLFallbackDraw(__attribute__((unused)) GtkWidget* widget,
+    cairo_t* cr, __attribute__((unused)) gpointer user_data) {
+
+    mGLDrawLayer(cr);
+    return FALSE;
+}
+
+/** *********************************************************************
+ ** This method draws a frame: the cairo layer, flakes queued
+ ** while it drew, then both through the one sprite program.
+ **/
+gboolean handleGLAreaRender(GtkGLArea* area,
+    __attribute__((unused)) GdkGLContext* context,
+    __attribute__((unused)) gpointer user_data) {
+
+    if (!mGLIsReady) {
+        return FALSE;
+    }
+
+    const int width = MAX(1, gtk_widget_get_allocated_width(
+        GTK_WIDGET(area)));
+    const int height = MAX(1, gtk_widget_get_allocated_height(
+        GTK_WIDGET(area)));
+
+    bool isLayerResized = false;
+    if (!mGLLayer ||
+        cairo_image_surface_get_width(mGLLayer) != width ||
+        cairo_image_surface_get_height(mGLLayer) != height) {
+        if (mGLLayer) {
+            cairo_surface_destroy(mGLLayer);
+        }
+        mGLLayer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            width, height);
+        isLayerResized = true;
+    }
+
+    // The layer goes first, flakes after it.
+    mGLSpriteCount = 0;
+    addGLSprite(0, 0, width, height, 0, 0);
+
+    cairo_t* cr = cairo_create(mGLLayer);
+    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(cr);
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+    mGLIsCollecting = true;
+    mGLDrawLayer(cr);
+    mGLIsCollecting = false;
+
+    cairo_destroy(cr);
+    cairo_surface_flush(mGLLayer);
+
+    // Upload.
+    uploadGLTexture(mGLLayerTexture, mGLLayer, isLayerResized);
+    if (mGLAtlas && mGLAtlasUploadedVersion != mGLAtlasVersion) {
+        uploadGLTexture(mGLAtlasTexture, mGLAtlas, true);
+        mGLAtlasUploadedVersion = mGLAtlasVersion;
+    }
+
+    const GLsizeiptr instanceSize = (GLsizeiptr) mGLSpriteCount *
+        GL_SPRITE_FLOATS * sizeof(GLfloat);
+    glBindBuffer(GL_ARRAY_BUFFER, mGLInstanceBuffer);
+    if (instanceSize > mGLInstanceBufferSize) {
+        mGLInstanceBufferSize = (GLsizeiptr) mGLSpriteCapacity *
+            GL_SPRITE_FLOATS * sizeof(GLfloat);
+        glBufferData(GL_ARRAY_BUFFER, mGLInstanceBufferSize, NULL,
+            GL_STREAM_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instanceSize, mGLSprites);
+
+    // Draw.
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(mGLProgram);
+    glUniform2f(mGLViewSizeLocation, width, height);
+    glBindVertexArray(mGLVertexArray);
+
+    drawGLSprites(mGLLayerTexture, mGLLayer, 0, 1);
+    if (mGLAtlas && mGLSpriteCount > 1) {
+        drawGLSprites(mGLAtlasTexture, mGLAtlas, 1,
+            mGLSpriteCount - 1);
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    return TRUE;
+}
+
+/** *********************************************************************
+ ** This method draws count sprites from instance first on, out
+ ** of the texture holding surface.
+ **/
+void drawGLSprites(GLuint texture, cairo_surface_t* surface,
+    int first, int count) {
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform2f(mGLTextureSizeLocation,
+        cairo_image_surface_get_width(surface),
+        cairo_image_surface_get_height(surface));
+
+    const GLsizei stride = GL_SPRITE_FLOATS * sizeof(GLfloat);
+    const char* base = (const char*) NULL + (size_t) first * stride;
+
+    glBindBuffer(GL_ARRAY_BUFFER, mGLInstanceBuffer);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, base);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride,
+        base + 2 * sizeof(GLfloat));
+
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+}
+
+/** *********************************************************************
+ ** This method builds the program, buffers and textures.
+ **/
+bool initGLObjects() {
+    const GLuint vertexShader = compileGLShader(GL_VERTEX_SHADER,
+        mGLVertexShader);
+    const GLuint fragmentShader = compileGLShader(GL_FRAGMENT_SHADER,
+        mGLFragmentShader);
+    if (!vertexShader || !fragmentShader) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return false;
+    }
+
+    mGLProgram = glCreateProgram();
+    glAttachShader(mGLProgram, vertexShader);
+    glAttachShader(mGLProgram, fragmentShader);
+    glLinkProgram(mGLProgram);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv(mGLProgram, GL_LINK_STATUS, &isLinked);
+    if (!isLinked) {
+        glDeleteProgram(mGLProgram);
+        mGLProgram = 0;
+        return false;
+    }
+
+    glUseProgram(mGLProgram);
+    mGLViewSizeLocation = glGetUniformLocation(mGLProgram, "uViewSize");
+    mGLTextureSizeLocation = glGetUniformLocation(mGLProgram,
+        "uTextureSize");
+    glUniform1i(glGetUniformLocation(mGLProgram, "uTexture"), 0);
+    glUseProgram(0);
+
+    // Quad corners, per vertex. The instance
+    // attributes are pointed at per draw.
+    static const GLfloat corners[] = {
+        0, 0, 1, 0, 0, 1, 1, 1,
+    };
+
+    glGenVertexArrays(1, &mGLVertexArray);
+    glBindVertexArray(mGLVertexArray);
+
+    glGenBuffers(1, &mGLCornerBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mGLCornerBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners,
+        GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+
+    glGenBuffers(1, &mGLInstanceBuffer);
+    mGLInstanceBufferSize = 0;
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mGLLayerTexture = createGLTexture();
+    mGLAtlasTexture = createGLTexture();
+    mGLAtlasUploadedVersion = 0;
+    return true;
+}
+
+/** *********************************************************************
+ ** This method compiles one shader, 0 on error.
+ **/
+GLuint compileGLShader(GLenum type, const char* source) {
+    const GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint isCompiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+    if (!isCompiled) {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "plasmasnow: GL shader: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+/** *********************************************************************
+ ** This method makes a texture for pixel exact blits.
+ **/
+GLuint createGLTexture() {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+/** *********************************************************************
+ ** This method copies an ARGB32 image surface into a texture,
+ ** sizing it anew if asked. Rows go up top first, which the
+ ** vertex shader's texture coordinates expect.
+ **/
+void uploadGLTexture(GLuint texture, cairo_surface_t* surface,
+    bool isResized) {
+
+    const int width = cairo_image_surface_get_width(surface);
+    const int height = cairo_image_surface_get_height(surface);
+    const unsigned char* data = cairo_image_surface_get_data(surface);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,
+        cairo_image_surface_get_stride(surface) / 4);
+
+    // Native endian 32 bit ARGB.
+    if (isResized) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,
+            GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, data);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+            GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, data);
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+#else
+
+/** *********************************************************************
+ ** Built without epoxy, the window keeps drawing with cairo.
+ **/
+bool createGLRenderer(__attribute__((unused)) GtkWidget* window,
+    __attribute__((unused)) void (*drawLayer)(cairo_t* cr)) {
+
+    printf("plasmasnow: built without OpenGL, using cairo drawing.\n");
+    return false;
+}
+
+bool isGLRendererActive() {
+    return false;
+}
+
+void setGLSpriteAtlas(__attribute__((unused)) cairo_surface_t* atlas,
+    __attribute__((unused)) unsigned int version) {
+}
+
+void addGLSprite(__attribute__((unused)) int atlasX,
+    __attribute__((unused)) int atlasY,
+    __attribute__((unused)) int width,
+    __attribute__((unused)) int height,
+    __attribute__((unused)) int x, __attribute__((unused)) int y) {
+}
+
+#endif
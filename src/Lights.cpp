@@ -93,10 +93,19 @@ int mCurrentAppScale = 100;
 std::vector<int> mLightXPos;
 std::vector<int> mLightYPos;
 
-// Bulb color arrays.
-std::vector<GdkRGBA> mBulbColorBright;
-std::vector<GdkRGBA> mBulbColorNormal;
-std::vector<GdkRGBA> mBulbColorDark;
+// Bulb color arrays, color type & twinkle variant.
+std::vector<BULB_COLOR_TYPE> mBulbColorType;
+std::vector<int> mBulbTwinkleState;
+
+// Bumped whenever the bulbs would draw differently,
+// for the backdrop cache.
+int mLightsVersion = 0;
+
+// Pre-built bulb surfaces, [colorType + 1][twinkleState],
+// each one a fixed random 3-color twinkle of its type.
+const int LIGHTS_TWINKLE_STATES = 6;
+cairo_surface_t* mBulbSurfaceCache
+    [MAX_BULB_COLOR_TYPES + 1][LIGHTS_TWINKLE_STATES];
 
 
 /** ***********************************************************
@@ -106,7 +115,7 @@ void initLightsModule() {
     setAllBulbPositions();
     setAllBulbColors();
 
-    addMethodToMainloop(PRIORITY_DEFAULT,
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT,
         TIME_BETWEEN_LIGHTS_FRAMES,
         twinkleLightsFrame);
 }
@@ -127,30 +136,28 @@ void setAllBulbPositions() {
         mLightXPos.push_back(xPos);
         mLightYPos.push_back(yPos);
     }
+    mLightsVersion++;
 }
 
 /** ***********************************************************
  ** This method sets each bulbs initial 3-color theme.
  **/
 void setAllBulbColors() {
-    mBulbColorBright.clear();
-    mBulbColorNormal.clear();
-    mBulbColorDark.clear();
+    mBulbColorType.clear();
+    mBulbTwinkleState.clear();
 
     int colorType = getFirstUserSelectedColor();
 
     for (int i = 0; i < getBulbCount(); i++) {
-        mBulbColorBright.push_back(
-            getTwinklingBright(colorType));
-        mBulbColorNormal.push_back(
-            getTwinklingNormal(colorType));
-        mBulbColorDark.push_back(
-            getTwinklingDark(colorType));
+        mBulbColorType.push_back(colorType);
+        mBulbTwinkleState.push_back(
+            randint(LIGHTS_TWINKLE_STATES));
 
         if (colorType != GRAYED) {
             colorType = getNextUserSelectedColorAfter(colorType);
         }
     }
+    mLightsVersion++;
 }
 
 /** ***********************************************************
@@ -161,25 +168,26 @@ void updateLightsUserSettings() {
     // Update pref.
     UIDO(ShowLights,);
 
-    UIDO(ShowLightColorRed,
-        eraseLightsFrame(); setAllBulbColors(););
-    UIDO(ShowLightColorLime,
-        eraseLightsFrame(); setAllBulbColors(););
-    UIDO(ShowLightColorPurple,
-        eraseLightsFrame(); setAllBulbColors(););
-    UIDO(ShowLightColorCyan,
-        eraseLightsFrame(); setAllBulbColors(););
-    UIDO(ShowLightColorGreen,
-        eraseLightsFrame(); setAllBulbColors(););
-    UIDO(ShowLightColorOrange,
-        eraseLightsFrame(); setAllBulbColors(););
-    UIDO(ShowLightColorBlue,
-        eraseLightsFrame(); setAllBulbColors(););
-    UIDO(ShowLightColorPink,
-        eraseLightsFrame(); setAllBulbColors(););
+    UIDO(ShowLightColorRed, eraseLightsFrame();
+        clearBulbSurfaceCache(); setAllBulbColors(););
+    UIDO(ShowLightColorLime, eraseLightsFrame();
+        clearBulbSurfaceCache(); setAllBulbColors(););
+    UIDO(ShowLightColorPurple, eraseLightsFrame();
+        clearBulbSurfaceCache(); setAllBulbColors(););
+    UIDO(ShowLightColorCyan, eraseLightsFrame();
+        clearBulbSurfaceCache(); setAllBulbColors(););
+    UIDO(ShowLightColorGreen, eraseLightsFrame();
+        clearBulbSurfaceCache(); setAllBulbColors(););
+    UIDO(ShowLightColorOrange, eraseLightsFrame();
+        clearBulbSurfaceCache(); setAllBulbColors(););
+    UIDO(ShowLightColorBlue, eraseLightsFrame();
+        clearBulbSurfaceCache(); setAllBulbColors(););
+    UIDO(ShowLightColorPink, eraseLightsFrame();
+        clearBulbSurfaceCache(); setAllBulbColors(););
 
     // Detect app scale change.
     if (appScalesHaveChanged(&mCurrentAppScale)) {
+        clearBulbSurfaceCache();
         setAllBulbPositions(); setAllBulbColors();
     }
 }
@@ -197,36 +205,65 @@ void drawLightsFrame(cairo_t* cc) {
     cairo_set_antialias(cc, CAIRO_ANTIALIAS_NONE);
 
     for (int i = 0; i < getBulbCount(); i++) {
-        // Create XPM from 3-color themed bulb.
-        char** tempBulbXPM;
-        int unusedLineCount;
-
-        createColoredBulb(mBulbColorBright[i],
-            mBulbColorNormal[i], mBulbColorDark[i],
-            &tempBulbXPM, &unusedLineCount);
-
-        // Create colored surface from XPM.
-        GdkPixbuf* tempBulbPixbuf =
-            gdk_pixbuf_new_from_xpm_data(
-                (const char**) tempBulbXPM);
-        destroyColoredBulb(tempBulbXPM);
-
-        cairo_surface_t* coloredLightSurface =
-            gdk_cairo_surface_create_from_pixbuf(
-                tempBulbPixbuf, 0, NULL);
-        g_clear_object(&tempBulbPixbuf);
-
-        // Draw colored surface.
-        cairo_set_source_surface(cc, coloredLightSurface,
+        // Draw cached colored surface.
+        cairo_set_source_surface(cc,
+            getBulbSurface(mBulbColorType[i], mBulbTwinkleState[i]),
             mLightXPos[i], mLightYPos[i]);
         my_cairo_paint_with_alpha(cc, (0.01 *
             (100 - Flags.Transparency)));
-        cairo_surface_destroy(coloredLightSurface);
     }
 
     cairo_restore(cc);
 }
 
+/** ***********************************************************
+ ** This method returns the cached bulb surface for a
+ ** color type & twinkle state, creating it on first use.
+ **/
+cairo_surface_t* getBulbSurface(BULB_COLOR_TYPE colorType,
+    int twinkleState) {
+    cairo_surface_t** cacheEntry =
+        &mBulbSurfaceCache[colorType + 1][twinkleState];
+    if (*cacheEntry) {
+        return *cacheEntry;
+    }
+
+    // Create XPM from 3-color themed bulb.
+    char** tempBulbXPM;
+    int unusedLineCount;
+
+    createColoredBulb(getTwinklingBright(colorType),
+        getTwinklingNormal(colorType), getTwinklingDark(colorType),
+        &tempBulbXPM, &unusedLineCount);
+
+    // Create colored surface from XPM.
+    GdkPixbuf* tempBulbPixbuf =
+        gdk_pixbuf_new_from_xpm_data(
+            (const char**) tempBulbXPM);
+    destroyColoredBulb(tempBulbXPM);
+
+    *cacheEntry = gdk_cairo_surface_create_from_pixbuf(
+        tempBulbPixbuf, 0, NULL);
+    g_clear_object(&tempBulbPixbuf);
+
+    return *cacheEntry;
+}
+
+/** ***********************************************************
+ ** This method destroys all cached bulb surfaces.
+ **/
+void clearBulbSurfaceCache() {
+    for (int type = 0; type < MAX_BULB_COLOR_TYPES + 1; type++) {
+        for (int state = 0; state < LIGHTS_TWINKLE_STATES; state++) {
+            if (mBulbSurfaceCache[type][state]) {
+                cairo_surface_destroy(mBulbSurfaceCache[type][state]);
+                mBulbSurfaceCache[type][state] = NULL;
+            }
+        }
+    }
+    mLightsVersion++;
+}
+
 /** ***********************************************************
  ** This method changes the bulbs randomly to produce
  ** blinking effect.
@@ -242,17 +279,26 @@ gboolean twinkleLightsFrame(__attribute__
     if (colorType != GRAYED) {
         for (int i = 0; i < getBulbCount(); i++) {
             if (randint(5) == 0) {
-                mBulbColorBright[i] = getTwinklingBright(colorType);
-                mBulbColorNormal[i] = getTwinklingNormal(colorType);
-                mBulbColorDark[i] = getTwinklingDark(colorType);
+                mBulbColorType[i] = colorType;
+                mBulbTwinkleState[i] =
+                    randint(LIGHTS_TWINKLE_STATES);
             }
             colorType = getNextUserSelectedColorAfter(colorType);
         }
+        mLightsVersion++;
     }
 
     return true;
 }
 
+/** ***********************************************************
+ ** This method returns the Lights version, which changes
+ ** whenever drawLightsFrame() would draw differently.
+ **/
+int getLightsVersion() {
+    return mLightsVersion;
+}
+
 /** ***********************************************************
  ** This method erases the bulbs from the display screen.
  **/
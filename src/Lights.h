@@ -42,6 +42,10 @@ extern "C" {
      void updateLightsUserSettings();
 
      void drawLightsFrame(cairo_t* cc);
+     int getLightsVersion();
+     cairo_surface_t* getBulbSurface(BULB_COLOR_TYPE colorType,
+          int twinkleState);
+     void clearBulbSurfaceCache();
      gboolean twinkleLightsFrame(void*);
      void eraseLightsFrame();
 
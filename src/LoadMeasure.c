@@ -25,11 +25,14 @@
 
 #include <gtk/gtk.h>
 
+#include "Benchmark.h"
 #include "clocks.h"
 #include "Flags.h"
+#include "FrameProfiler.h"
 #include "LoadMeasure.h"
 #include "MainWindow.h"
 #include "plasmasnow.h"
+#include "PowerPolicy.h"
 #include "Utils.h"
 
 
@@ -43,6 +46,32 @@ int mLoadPressure = 0;
 
 double mLoadMeasurePrevThreadStart = 0;
 
+// Quality levels, each one cheaper than the last.
+typedef struct _QualityLevel {
+        float flakeCountFactor;       // of Flags.FlakeCountMax.
+        float fluffTimeFactor;        // of fluff lifetimes.
+        int auroraFuzzStep;           // draw every n-th fuzz.
+        float birdCountFactor;        // of drawn birds.
+        int fallenSnowRenderInterval; // render every n-th pass.
+} QualityLevel;
+
+static const QualityLevel QUALITY_LEVELS[] = {
+    { 1.00, 1.00, 1, 1.00, 1 },
+    { 0.75, 0.75, 2, 0.75, 2 },
+    { 0.50, 0.50, 3, 0.50, 3 },
+    { 0.35, 0.35, 4, 0.35, 5 },
+    { 0.25, 0.25, 6, 0.25, 8 },
+};
+static const int QUALITY_LEVEL_MAX = sizeof(QUALITY_LEVELS) /
+    sizeof(QUALITY_LEVELS[0]) - 1;
+
+// Read without locking by the Aurora & FallenSnow threads.
+int mQualityLevel = 0;
+
+int mQualityOverBudgetCount = 0;
+int mQualityUnderBudgetCount = 0;
+int mQualitySettleCount = 0;
+
 
 /** *********************************************************************
  ** Add update method to mainloop.
@@ -50,6 +79,8 @@ double mLoadMeasurePrevThreadStart = 0;
 void startLoadMeasureBackgroundThread() {
     addMethodToMainloop(PRIORITY_DEFAULT, TIME_BETWEEN_LOAD_MONITOR_EVENTS,
         execLoadMeasureBackgroundThread);
+    addMethodToMainloop(PRIORITY_DEFAULT, TIME_BETWEEN_QUALITY_UPDATES,
+        execQualityGovernor);
 }
 
 /** *********************************************************************
@@ -94,3 +125,103 @@ int execLoadMeasureBackgroundThread() {
 
     return true;
 }
+
+/** *********************************************************************
+ ** Periodically compare measured main loop cost with the
+ ** budget, and step the quality level down or back up.
+ **
+ ** Load is the share of one core spent in frame draws and
+ ** flake ticks, from their median profile times. Stepping
+ ** down takes a few late checks in a row, stepping up many
+ ** more, and after each step the governor lets the profile
+ ** rings refill before it judges again.
+ **/
+int execQualityGovernor() {
+    if (Flags.shutdownRequested) {
+        return false;
+    }
+
+    // Benchmarks measure at full quality.
+    if (isBenchmarkActive()) {
+        return true;
+    }
+
+    if (mQualitySettleCount > 0) {
+        mQualitySettleCount--;
+        return true;
+    }
+
+    const double load =
+        getProfilePercentile(PROFILE_FRAME, 0.5) * 0.001 /
+            time_draw_all +
+        getProfilePercentile(PROFILE_FLAKE_TICK, 0.5) * 0.001 /
+            time_snowflakes;
+    // On battery, quality steps down sooner.
+    const double budget = QUALITY_BUDGET_LOAD * 0.01 * Flags.CpuLoad *
+        getPowerPolicyBudgetFactor();
+
+    if (load > budget) {
+        mQualityUnderBudgetCount = 0;
+        mQualityOverBudgetCount++;
+    } else if (load < budget * QUALITY_BUDGET_FREED_PCT) {
+        mQualityOverBudgetCount = 0;
+        mQualityUnderBudgetCount++;
+    } else {
+        mQualityOverBudgetCount = 0;
+        mQualityUnderBudgetCount = 0;
+    }
+
+    int newLevel = mQualityLevel;
+    if (mQualityOverBudgetCount >= QUALITY_STEP_DOWN_COUNT &&
+        mQualityLevel < QUALITY_LEVEL_MAX) {
+        newLevel++;
+    }
+    if (mQualityUnderBudgetCount >= QUALITY_STEP_UP_COUNT &&
+        mQualityLevel > 0) {
+        newLevel--;
+    }
+
+    if (newLevel != mQualityLevel) {
+        if (Flags.Noisy) {
+            printf("plasmasnow: load %.2f of budget %.2f, "
+                "quality level %d -> %d\n", load, budget,
+                mQualityLevel, newLevel);
+        }
+        mQualityLevel = newLevel;
+        mQualityOverBudgetCount = 0;
+        mQualityUnderBudgetCount = 0;
+        mQualitySettleCount = QUALITY_SETTLE_COUNT;
+    }
+
+    return true;
+}
+
+/** *********************************************************************
+ ** Quality governor helpers.
+ **/
+int getQualityLevel() {
+    return mQualityLevel;
+}
+
+int getQualityFlakeCountMax() {
+    return Flags.FlakeCountMax *
+        QUALITY_LEVELS[mQualityLevel].flakeCountFactor;
+}
+
+float getQualityFluffTimeFactor() {
+    return QUALITY_LEVELS[mQualityLevel].fluffTimeFactor;
+}
+
+int getQualityAuroraFuzzStep() {
+    return QUALITY_LEVELS[mQualityLevel].auroraFuzzStep;
+}
+
+int getQualityBirdCount(int birdCount) {
+    const int count = birdCount *
+        QUALITY_LEVELS[mQualityLevel].birdCountFactor;
+    return count < 1 ? MIN(birdCount, 1) : count;
+}
+
+int getQualityFallenSnowRenderInterval() {
+    return QUALITY_LEVELS[mQualityLevel].fallenSnowRenderInterval;
+}
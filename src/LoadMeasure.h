@@ -25,8 +25,25 @@
 
 extern void startLoadMeasureBackgroundThread(void);
 int  execLoadMeasureBackgroundThread();
+int  execQualityGovernor();
+
+// Quality governor, 0 is full quality.
+int getQualityLevel();
+int getQualityFlakeCountMax();
+float getQualityFluffTimeFactor();
+int getQualityAuroraFuzzStep();
+int getQualityBirdCount(int birdCount);
+int getQualityFallenSnowRenderInterval();
 
 static const int   LOAD_PRESSURE_LOW  = -10;
 static const int   LOAD_PRESSURE_HIGH =  10;
 static const int   WARNING_COUNT_MAX = 3;
 static const float EXCESSIVE_LOAD_MONITOR_TIME_PCT = 1.2;
+
+// Fraction of one core the main loop may use at CpuLoad 100,
+// and the fraction of that below which quality steps back up.
+static const float QUALITY_BUDGET_LOAD = 0.5;
+static const float QUALITY_BUDGET_FREED_PCT = 0.6;
+static const int   QUALITY_STEP_DOWN_COUNT = 3;
+static const int   QUALITY_STEP_UP_COUNT = 8;
+static const int   QUALITY_SETTLE_COUNT = 6;
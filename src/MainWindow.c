@@ -128,6 +128,11 @@
  *     related with the 'scenery' tab. If Flags.Changes > 0, the flags are
  * written to .plasmasnowrc.
  *
+ *     Those update methods only run when a flag they subscribed to was
+ *     published: the button callbacks here call publishFlagChange() with
+ *     the FLAG_ID_ of the flag they set. Code that sets a flag elsewhere
+ *     should publish it too. Subscriptions are in Application.c.
+ *
  *   Documentation of flags
  *
  *     This is taken care of in 'docs.c'.
@@ -389,6 +394,8 @@ void button_santa(GtkWidget *w) {
 
     Flags.SantaSize = santa_type;
     Flags.Rudolf = have_rudolf;
+    publishFlagChange(FLAG_ID_SantaSize);
+    publishFlagChange(FLAG_ID_Rudolf);
 
     SantaVisible();
 }
@@ -533,6 +540,7 @@ static void getAllButtonFormIDs() {
         NEWLINE if (active) Flags.name = TRUE;                                 \
         else Flags.name = FALSE;                                               \
         NEWLINE if (m < 0) Flags.name = !Flags.name;                           \
+        NEWLINE publishFlagChange(FLAG_ID_##name);                             \
         NEWLINE                                                                \
     }
 
@@ -542,6 +550,7 @@ static void getAllButtonFormIDs() {
         NEWLINE gdouble value;                                                 \
         NEWLINE value = gtk_range_get_value(GTK_RANGE(w));                     \
         NEWLINE Flags.name = m * lrint(value);                                 \
+        NEWLINE publishFlagChange(FLAG_ID_##name);                             \
         NEWLINE                                                                \
     }
 
@@ -556,6 +565,7 @@ static void getAllButtonFormIDs() {
         NEWLINE gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(w), &color);      \
         NEWLINE free(Flags.name);                                              \
         NEWLINE rgba2color(&color, &Flags.name);                               \
+        NEWLINE publishFlagChange(FLAG_ID_##name);                             \
         NEWLINE                                                                \
     }
 
@@ -567,6 +577,7 @@ static void getAllButtonFormIDs() {
         NEWLINE free(Flags.name);                                              \
         NEWLINE Flags.name = strdup(filename);                                 \
         NEWLINE g_free(filename);                                              \
+        NEWLINE publishFlagChange(FLAG_ID_##name);                             \
         NEWLINE                                                                \
     }
 
@@ -609,41 +620,49 @@ void onClickedTreeColor() {
 void onClickedLightColorRed() {
     if (human_interaction) {
         Flags.ShowLightColorRed = !Flags.ShowLightColorRed;
+        publishFlagChange(FLAG_ID_ShowLightColorRed);
     }
 }
 void onClickedLightColorLime() {
     if (human_interaction) {
         Flags.ShowLightColorLime = !Flags.ShowLightColorLime;
+        publishFlagChange(FLAG_ID_ShowLightColorLime);
     }
 }
 void onClickedLightColorPurple() {
     if (human_interaction) {
         Flags.ShowLightColorPurple = !Flags.ShowLightColorPurple;
+        publishFlagChange(FLAG_ID_ShowLightColorPurple);
     }
 }
 void onClickedLightColorCyan() {
     if (human_interaction) {
         Flags.ShowLightColorCyan = !Flags.ShowLightColorCyan;
+        publishFlagChange(FLAG_ID_ShowLightColorCyan);
     }
 }
 void onClickedLightColorGreen() {
     if (human_interaction) {
         Flags.ShowLightColorGreen = !Flags.ShowLightColorGreen;
+        publishFlagChange(FLAG_ID_ShowLightColorGreen);
     }
 }
 void onClickedLightColorOrange() {
     if (human_interaction) {
         Flags.ShowLightColorOrange = !Flags.ShowLightColorOrange;
+        publishFlagChange(FLAG_ID_ShowLightColorOrange);
     }
 }
 void onClickedLightColorBlue() {
     if (human_interaction) {
         Flags.ShowLightColorBlue = !Flags.ShowLightColorBlue;
+        publishFlagChange(FLAG_ID_ShowLightColorBlue);
     }
 }
 void onClickedLightColorPink() {
     if (human_interaction) {
         Flags.ShowLightColorPink = !Flags.ShowLightColorPink;
+        publishFlagChange(FLAG_ID_ShowLightColorPink);
     }
 }
 
@@ -985,6 +1004,7 @@ void combo_screen(GtkComboBoxText *combo, gpointer data) {
         GTK_COMBO_BOX(combo));
 
     Flags.Screen = num - 1;
+    publishFlagChange(FLAG_ID_Screen);
 }
 
 MODULE_EXPORT
@@ -993,6 +1013,7 @@ void onSelectedLanguageButton(GtkComboBoxText *combo, gpointer data) {
         GTK_COMBO_BOX(combo));
 
     Flags.Language = strdup(lang[num]);
+    publishFlagChange(FLAG_ID_Language);
 }
 
 /***********************************************************
@@ -1023,6 +1044,24 @@ void ui_set_birds_header(const char *text) {
     setLabelText(GTK_LABEL(birds_header), text);
 }
 
+void ui_set_perfstats_text(const char *text) {
+    if (!ui_running) {
+        return;
+    }
+    GtkWidget *perfstats =
+        GTK_WIDGET(gtk_builder_get_object(builder, "id-PerfStats"));
+    setLabelText(GTK_LABEL(perfstats), text);
+}
+
+void ui_set_memorystats_text(const char *text) {
+    if (!ui_running) {
+        return;
+    }
+    GtkWidget *memorystats =
+        GTK_WIDGET(gtk_builder_get_object(builder, "id-MemoryStats"));
+    setLabelText(GTK_LABEL(memorystats), text);
+}
+
 void ui_set_celestials_header(const char *text) {
     if (!ui_running) {
         return;
@@ -1174,6 +1213,8 @@ void setTabDefaults(int tab) {
     set_buttons();
     human_interaction = h;
     free(background);
+
+    publishAllFlagChanges();
 }
 
 /***********************************************************
@@ -1191,6 +1232,9 @@ static void init_buttons() {
 }
 
 void set_buttons() {
+    if (!ui_running) {
+        return;
+    }
     human_interaction = 0;
 
     initAllButtonValues();
@@ -1620,6 +1664,7 @@ void onClickedTreeButton(GtkWidget *w) {
 
     free(Flags.TreeType);
     vsc(&Flags.TreeType, b, m);
+    publishFlagChange(FLAG_ID_TreeType);
 
     free(a);
     free(b);
@@ -1633,6 +1678,7 @@ void onClickedQuitApplication() {
 MODULE_EXPORT
 void onClickedActivateWind() {
     Flags.WindNow = 1;
+    publishFlagChange(FLAG_ID_WindNow);
 }
 
 MODULE_EXPORT
@@ -33,6 +33,8 @@ void createMainWindow();
 
 void ui_set_birds_header(const char *text);
 void ui_set_celestials_header(const char *text);
+void ui_set_perfstats_text(const char *text);
+void ui_set_memorystats_text(const char *text);
 
 void ui_set_sticky(int x);
 
@@ -0,0 +1,162 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "ColorCodes.h"
+#include "Flags.h"
+#include "MainWindow.h"
+#include "MemoryStats.h"
+#include "plasmasnow.h"
+#include "Utils.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+
+// Owner & size of a tracked surface, freed with it.
+typedef struct _TrackedSurface {
+        MEMORY_OWNER owner;
+        long bytes;
+} TrackedSurface;
+
+static cairo_user_data_key_t mTrackedSurfaceKey;
+
+// Bytes held at the previous report, for growth.
+static long mReportedBytes[MEMORY_OWNER_COUNT];
+
+
+/** *********************************************************************
+ ** Add report method to mainloop.
+ **/
+void startMemoryStatsBackgroundThread() {
+    addMethodToMainloop(PRIORITY_DEFAULT,
+        TIME_BETWEEN_MEMORY_REPORTS,
+        execMemoryStatsBackgroundThread);
+}
+
+/** *********************************************************************
+ ** Periodically publish the report, to stdout
+ ** if -noisy or -perfstats, and to the UI panel.
+ **/
+int execMemoryStatsBackgroundThread() {
+    if (Flags.shutdownRequested) {
+        return false;
+    }
+
+    char report[(MEMORY_OWNER_COUNT + 3) * 64];
+    getMemoryReport(report, sizeof(report));
+
+    if (Flags.Noisy || Flags.PerfStats) {
+        printf("plasmasnow: memory (KiB)\n%s", report);
+        fflush(stdout);
+    }
+    ui_set_memorystats_text(report);
+
+    return true;
+}
+
+/** *********************************************************************
+ ** This method counts an image surface against an owner
+ ** until it's destroyed. Returns the surface.
+ **/
+static void releaseTrackedSurface(void* data) {
+    TrackedSurface* tracked = (TrackedSurface*) data;
+    track_memory(tracked->owner, -tracked->bytes, -1);
+    free(tracked);
+}
+
+cairo_surface_t* trackSurface(MEMORY_OWNER owner,
+    cairo_surface_t* surface) {
+
+    if (!surface || cairo_surface_get_type(surface) !=
+        CAIRO_SURFACE_TYPE_IMAGE) {
+        return surface;
+    }
+    // Already counted, e.g. shared from a cache.
+    if (cairo_surface_get_user_data(surface, &mTrackedSurfaceKey)) {
+        return surface;
+    }
+
+    TrackedSurface* tracked = (TrackedSurface*)
+        malloc(sizeof(TrackedSurface));
+    if (!tracked) {
+        return surface;
+    }
+    tracked->owner = owner;
+    tracked->bytes = (long) cairo_image_surface_get_stride(surface) *
+        cairo_image_surface_get_height(surface);
+
+    if (cairo_surface_set_user_data(surface, &mTrackedSurfaceKey,
+        tracked, releaseTrackedSurface) != CAIRO_STATUS_SUCCESS) {
+        free(tracked);
+        return surface;
+    }
+    track_memory(owner, tracked->bytes, 1);
+    return surface;
+}
+
+/** *********************************************************************
+ ** This method formats each owner's bytes now, peak, and
+ ** growth since the previous report, then the heap totals.
+ **/
+void getMemoryReport(char* buffer, size_t size) {
+    size_t used = snprintf(buffer, size,
+        "%-12s %9s %9s %9s %7s\n",
+        "", "now", "peak", "growth", "blocks");
+
+    for (int i = 0; i < MEMORY_OWNER_COUNT && used < size; i++) {
+        long bytes, blocks, peakBytes;
+        get_memory_use(i, &bytes, &blocks, &peakBytes);
+
+        used += snprintf(buffer + used, size - used,
+            "%-12s %9.1f %9.1f %+9.1f %7ld\n",
+            get_memory_owner_name(i), bytes / 1024.0,
+            peakBytes / 1024.0, (bytes - mReportedBytes[i]) / 1024.0,
+            blocks);
+        mReportedBytes[i] = bytes;
+    }
+
+    if (used < size) {
+        struct mallinfo2 heap = mallinfo2();
+        snprintf(buffer + used, size - used,
+            "heap: %.1f in use, %.1f free, %.1f arena\n",
+            heap.uordblks / 1024.0, heap.fordblks / 1024.0,
+            heap.arena / 1024.0);
+    }
+}
+
+/** *********************************************************************
+ ** This method prints the report once, e.g. at startup.
+ **/
+void printMemoryReport(const char* when) {
+    char report[(MEMORY_OWNER_COUNT + 3) * 64];
+    getMemoryReport(report, sizeof(report));
+
+    printf("\n%splasmasnow: memory (KiB) @%s\n%s%s", COLOR_YELLOW,
+        when, report, COLOR_NORMAL);
+}
@@ -0,0 +1,47 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stddef.h>
+
+#include <cairo.h>
+
+#include "safe_malloc.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define TIME_BETWEEN_MEMORY_REPORTS 10.0
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void startMemoryStatsBackgroundThread();
+int execMemoryStatsBackgroundThread();
+
+cairo_surface_t* trackSurface(MEMORY_OWNER owner,
+    cairo_surface_t* surface);
+
+void getMemoryReport(char* buffer, size_t size);
+void printMemoryReport(const char* when);
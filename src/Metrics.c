@@ -0,0 +1,455 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <dirent.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gtk/gtk.h>
+
+#include "FallenSnow.h"
+#include "Flags.h"
+#include "FrameProfiler.h"
+#include "Metrics.h"
+#include "plasmasnow.h"
+#include "PowerPolicy.h"
+#include "safe_malloc.h"
+#include "Scheduler.h"
+#include "snow.h"
+#include "Utils.h"
+#include "XTraffic.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define METRICS_THREAD_COUNT 64
+
+// Cpu time of all threads sharing one name.
+typedef struct _MetricsThread {
+        char name[32];
+        double seconds;
+} MetricsThread;
+
+// Text being built, never past its size.
+typedef struct _MetricsText {
+        char* buffer;
+        size_t size;
+        size_t used;
+} MetricsText;
+
+static const gchar mMetricsDBusXml[] =
+    "<node>"
+    "  <interface name='" METRICS_DBUS_NAME "'>"
+    "    <method name='GetMetrics'>"
+    "      <arg type='s' name='text' direction='out'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * Only touched on the main thread, where the export timer
+ * and the D-Bus calls both run.
+ */
+static GDBusNodeInfo* mMetricsDBusInfo = NULL;
+static guint mMetricsDBusOwnerId = 0;
+
+
+/** *********************************************************************
+ ** This method appends formatted text, dropping what no
+ ** longer fits.
+ **/
+static void appendMetrics(MetricsText* text, const char* format, ...) {
+    if (text->used >= text->size) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    const int written = vsnprintf(text->buffer + text->used,
+        text->size - text->used, format, args);
+    va_end(args);
+
+    // Drop the partial line cut short, so every sample is whole.
+    if (written < 0 || (size_t) written >= text->size - text->used) {
+        text->buffer[text->used] = '\0';
+        char* lastLine = strrchr(text->buffer, '\n');
+        text->buffer[lastLine ? lastLine - text->buffer + 1 : 0] = '\0';
+        text->used = text->size;
+        return;
+    }
+    text->used += written;
+}
+
+/** *********************************************************************
+ ** This method escapes a label value, as the text format
+ ** asks for backslash, double quote and newline.
+ **/
+static void escapeMetricsLabel(const char* value, char* escaped,
+    size_t size) {
+    size_t used = 0;
+    for (; *value && used + 3 <= size; value++) {
+        if (*value == '\\' || *value == '"') {
+            escaped[used++] = '\\';
+            escaped[used++] = *value;
+        } else if (*value == '\n') {
+            escaped[used++] = '\\';
+            escaped[used++] = 'n';
+        } else {
+            escaped[used++] = *value;
+        }
+    }
+    escaped[used] = '\0';
+}
+
+/** *********************************************************************
+ ** This method appends the help and type lines of a metric.
+ **/
+static void appendMetricsHeader(MetricsText* text, const char* name,
+    const char* type, const char* help) {
+    appendMetrics(text, "# HELP plasmasnow_%s %s\n", name, help);
+    appendMetrics(text, "# TYPE plasmasnow_%s %s\n", name, type);
+}
+
+/** *********************************************************************
+ ** This method sums user and system cpu time of this
+ ** process's threads by thread name, from /proc. Returns
+ ** the number of names found.
+ **/
+static int getThreadCpuTimes(MetricsThread* threads, int count) {
+    DIR* tasks = opendir("/proc/self/task");
+    if (!tasks) {
+        return 0;
+    }
+
+    const double ticksPerSecond = sysconf(_SC_CLK_TCK);
+    int found = 0;
+
+    struct dirent* task;
+    while ((task = readdir(tasks))) {
+        if (task->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/task/%s/stat",
+            task->d_name);
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        char stat[512];
+        const bool isRead = fgets(stat, sizeof(stat), file) != NULL;
+        fclose(file);
+        if (!isRead) {
+            continue;
+        }
+
+        // The name sits in parentheses, and may hold some.
+        char* nameStart = strchr(stat, '(');
+        char* nameEnd = strrchr(stat, ')');
+        if (!nameStart || !nameEnd || nameEnd < nameStart) {
+            continue;
+        }
+        unsigned long userTicks, systemTicks;
+        if (sscanf(nameEnd + 2, "%*c %*d %*d %*d %*d %*d "
+            "%*u %*u %*u %*u %*u %lu %lu",
+            &userTicks, &systemTicks) != 2) {
+            continue;
+        }
+        *nameEnd = '\0';
+        nameStart++;
+
+        int i = 0;
+        while (i < found && strcmp(threads[i].name, nameStart)) {
+            i++;
+        }
+        if (i == found) {
+            if (found == count) {
+                continue;
+            }
+            snprintf(threads[i].name, sizeof(threads[i].name),
+                "%s", nameStart);
+            threads[i].seconds = 0;
+            found++;
+        }
+        threads[i].seconds += (userTicks + systemTicks) /
+            ticksPerSecond;
+    }
+
+    closedir(tasks);
+    return found;
+}
+
+/** *********************************************************************
+ ** This method formats the live metrics in Prometheus
+ ** text exposition format. Rates are left to the reader,
+ ** as _total counters.
+ **/
+void getMetricsText(char* buffer, size_t size) {
+    MetricsText text = { buffer, size, 0 };
+    buffer[0] = '\0';
+
+    appendMetricsHeader(&text, "profile_seconds", "gauge",
+        "Draw and tick times per module over the recent samples.");
+    const float quantiles[] = { 0.5, 0.95, 0.99 };
+    for (int slot = 0; slot < PROFILE_SLOT_COUNT; slot++) {
+        for (int i = 0; i < 3; i++) {
+            appendMetrics(&text,
+                "plasmasnow_profile_seconds{slot=\"%s\",quantile=\"%g\"} "
+                "%.6f\n", getProfileSlotName(slot), quantiles[i],
+                getProfilePercentile(slot, quantiles[i]) * 0.001);
+        }
+    }
+
+    appendMetricsHeader(&text, "flakes", "gauge",
+        "Flakes alive now.");
+    appendMetrics(&text, "plasmasnow_flakes{kind=\"flake\"} %d\n",
+        mGlobal.FlakeCount);
+    appendMetrics(&text, "plasmasnow_flakes{kind=\"fluff\"} %d\n",
+        mGlobal.FluffCount);
+
+    unsigned long spawned, removed;
+    getFlakeTotals(&spawned, &removed);
+    appendMetricsHeader(&text, "flakes_spawned_total", "counter",
+        "Flakes made since start.");
+    appendMetrics(&text, "plasmasnow_flakes_spawned_total %lu\n",
+        spawned);
+    appendMetricsHeader(&text, "flakes_removed_total", "counter",
+        "Flakes removed since start.");
+    appendMetrics(&text, "plasmasnow_flakes_removed_total %lu\n",
+        removed);
+
+    int items, surfaces;
+    long surfaceBytes;
+    getFallenSnowSurfaceCounts(&items, &surfaces, &surfaceBytes);
+    appendMetricsHeader(&text, "fallensnow_items", "gauge",
+        "Fallen snow areas, on windows and the bottom.");
+    appendMetrics(&text, "plasmasnow_fallensnow_items %d\n", items);
+    appendMetricsHeader(&text, "fallensnow_surfaces", "gauge",
+        "Fallen snow areas holding a drawn surface.");
+    appendMetrics(&text, "plasmasnow_fallensnow_surfaces %d\n",
+        surfaces);
+    appendMetricsHeader(&text, "fallensnow_surface_bytes", "gauge",
+        "Pixel bytes held by fallen snow drawn surfaces.");
+    appendMetrics(&text, "plasmasnow_fallensnow_surface_bytes %ld\n",
+        surfaceBytes);
+
+    appendMetricsHeader(&text, "fallensnow_lock_waits_total", "counter",
+        "Times a fallen snow lock was found taken.");
+    appendMetrics(&text,
+        "plasmasnow_fallensnow_lock_waits_total{lock=\"list\"} %u\n",
+        getFallenSnowListContention());
+    appendMetrics(&text,
+        "plasmasnow_fallensnow_lock_waits_total{lock=\"item\"} %u\n",
+        getFallenSnowItemContention());
+
+    appendMetricsHeader(&text, "memory_bytes", "gauge",
+        "Bytes held per module.");
+    for (int i = 0; i < MEMORY_OWNER_COUNT; i++) {
+        long bytes, blocks, peakBytes;
+        get_memory_use(i, &bytes, &blocks, &peakBytes);
+        appendMetrics(&text,
+            "plasmasnow_memory_bytes{owner=\"%s\"} %ld\n",
+            get_memory_owner_name(i), bytes);
+    }
+
+    MetricsThread threads[METRICS_THREAD_COUNT];
+    const int threadCount = getThreadCpuTimes(threads,
+        METRICS_THREAD_COUNT);
+    appendMetricsHeader(&text, "thread_cpu_seconds_total", "counter",
+        "User and system cpu time per thread name.");
+    for (int i = 0; i < threadCount; i++) {
+        char name[2 * sizeof(threads[i].name)];
+        escapeMetricsLabel(threads[i].name, name, sizeof(name));
+        appendMetrics(&text,
+            "plasmasnow_thread_cpu_seconds_total{thread=\"%s\"} %.2f\n",
+            name, threads[i].seconds);
+    }
+
+    unsigned long requests, roundTrips, flushes;
+    getXTrafficTotals(&requests, &roundTrips, &flushes);
+    appendMetricsHeader(&text, "x_requests_total", "counter",
+        "X requests sent since start.");
+    appendMetrics(&text, "plasmasnow_x_requests_total %lu\n", requests);
+    appendMetricsHeader(&text, "x_round_trips_total", "counter",
+        "X calls that waited for a reply.");
+    appendMetrics(&text, "plasmasnow_x_round_trips_total %lu\n",
+        roundTrips);
+    appendMetricsHeader(&text, "x_flushes_total", "counter",
+        "X output buffer flushes.");
+    appendMetrics(&text, "plasmasnow_x_flushes_total %lu\n", flushes);
+
+    appendMetricsHeader(&text, "scheduler_wakeups_total", "counter",
+        "Main loop timer wakeups since start.");
+    appendMetrics(&text, "plasmasnow_scheduler_wakeups_total %lu\n",
+        getSchedulerWakeupTotal());
+
+    appendMetricsHeader(&text, "power_mode", "gauge",
+        "0 full frame rate, 1 low frame rate, 2 paused.");
+    appendMetrics(&text, "plasmasnow_power_mode %d\n", getPowerMode());
+}
+
+/** *********************************************************************
+ ** This method answers D-Bus calls on the metrics object.
+ **/
+static void handleMetricsDBusCall(GDBusConnection* connection,
+    const gchar* sender, const gchar* objectPath,
+    const gchar* interfaceName, const gchar* methodName,
+    GVariant* parameters, GDBusMethodInvocation* invocation,
+    gpointer userData) {
+    (void) connection;
+    (void) sender;
+    (void) objectPath;
+    (void) interfaceName;
+    (void) parameters;
+    (void) userData;
+
+    if (strcmp(methodName, "GetMetrics")) {
+        g_dbus_method_invocation_return_error(invocation,
+            G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+            "No method %s", methodName);
+        return;
+    }
+
+    char* metrics = (char*) malloc(METRICS_TEXT_SIZE);
+    if (!metrics) {
+        g_dbus_method_invocation_return_error(invocation,
+            G_DBUS_ERROR, G_DBUS_ERROR_NO_MEMORY, "No memory");
+        return;
+    }
+    getMetricsText(metrics, METRICS_TEXT_SIZE);
+    g_dbus_method_invocation_return_value(invocation,
+        g_variant_new("(s)", metrics));
+    free(metrics);
+}
+
+static const GDBusInterfaceVTable mMetricsDBusVTable = {
+    handleMetricsDBusCall, NULL, NULL, { 0 }
+};
+
+/** *********************************************************************
+ ** This method registers the metrics object once the
+ ** session bus is reached.
+ **/
+static void onMetricsBusAcquired(GDBusConnection* connection,
+    const gchar* name, gpointer userData) {
+    (void) name;
+    (void) userData;
+
+    GError* error = NULL;
+    if (!g_dbus_connection_register_object(connection,
+        METRICS_DBUS_PATH, mMetricsDBusInfo->interfaces[0],
+        &mMetricsDBusVTable, NULL, NULL, &error)) {
+        fprintf(stderr, "plasmasnow: cannot serve metrics on D-Bus: %s\n",
+            error->message);
+        g_error_free(error);
+    }
+}
+
+/** *********************************************************************
+ ** This method reports a D-Bus name taken by another
+ ** instance, or no session bus at all.
+ **/
+static void onMetricsNameLost(GDBusConnection* connection,
+    const gchar* name, gpointer userData) {
+    (void) userData;
+
+    fprintf(stderr, "plasmasnow: %s D-Bus name %s, metrics not served.\n",
+        connection ? "cannot own" : "no session bus for", name);
+}
+
+/** *********************************************************************
+ ** Add export method to mainloop, and the D-Bus service,
+ ** as asked for by -metricsfile and -metricsdbus.
+ **/
+void startMetricsExport() {
+    if (Flags.MetricsFile[0]) {
+        addMethodToMainloop(PRIORITY_DEFAULT,
+            TIME_BETWEEN_METRICS_EXPORTS, execMetricsExport);
+    }
+
+    if (Flags.MetricsDBus) {
+        GError* error = NULL;
+        mMetricsDBusInfo = g_dbus_node_info_new_for_xml(
+            mMetricsDBusXml, &error);
+        if (!mMetricsDBusInfo) {
+            fprintf(stderr, "plasmasnow: bad metrics interface: %s\n",
+                error->message);
+            g_error_free(error);
+            return;
+        }
+
+        mMetricsDBusOwnerId = g_bus_own_name(G_BUS_TYPE_SESSION,
+            METRICS_DBUS_NAME, G_BUS_NAME_OWNER_FLAGS_NONE,
+            onMetricsBusAcquired, NULL, onMetricsNameLost, NULL, NULL);
+    }
+}
+
+/** *********************************************************************
+ ** This method releases the D-Bus name at shutdown, so a
+ ** restart can own it again.
+ **/
+void stopMetricsExport() {
+    if (mMetricsDBusOwnerId) {
+        g_bus_unown_name(mMetricsDBusOwnerId);
+        mMetricsDBusOwnerId = 0;
+    }
+}
+
+/** *********************************************************************
+ ** Periodically write the metrics file. Written aside and
+ ** renamed over, so a collector never reads half a file.
+ **/
+int execMetricsExport() {
+    if (Flags.shutdownRequested) {
+        return false;
+    }
+
+    char* metrics = (char*) malloc(METRICS_TEXT_SIZE);
+    if (!metrics) {
+        return true;
+    }
+    getMetricsText(metrics, METRICS_TEXT_SIZE);
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.tmp", Flags.MetricsFile);
+
+    FILE* file = fopen(path, "w");
+    if (file) {
+        const bool isWritten = fputs(metrics, file) >= 0;
+        if (fclose(file) == 0 && isWritten) {
+            rename(path, Flags.MetricsFile);
+        } else {
+            unlink(path);
+        }
+    }
+
+    free(metrics);
+    return true;
+}
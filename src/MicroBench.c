@@ -0,0 +1,520 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gtk/gtk.h>
+
+#include "FlakeKernels.h"
+#include "FlakePool.h"
+#include "NeighborGrid.h"
+#include "OccupancyMask.h"
+#include "Random.h"
+#include "safe_malloc.h"
+#include "spline_interpol.h"
+
+
+/***********************************************************
+ * Standalone micro benchmarks of the hot kernels, for
+ * "make bench". Each runs the inner loop of its module entry
+ * point over the same kernels, without the app globals, and
+ * results are written as one JSON object to stdout.
+ *
+ *     plasmasnow-bench [-count n] [-width n] [-height n]
+ *         [-iterations n]
+ */
+typedef struct _MicroBench {
+        int count;
+        int width;
+        int height;
+        int iterations;
+} MicroBench;
+
+typedef void (*MicroBenchMethod)(const MicroBench*, int iteration);
+
+// Keeps results alive, so loops are not optimized away.
+static volatile double mMicroBenchSink = 0;
+
+// Shared fixtures.
+static FlakePool mFlakes;
+static WindGrid mWindGrid;
+static float* mRandoms = NULL;
+
+static OccupancyMask mMask;
+static int* mFlakeSizes = NULL;
+
+static short int* mHeights = NULL;
+static short int* mHeightScratch = NULL;
+static int* mDepositX = NULL;
+
+static cairo_surface_t* mFallenSurface = NULL;
+static SplineWorkspace mSpline;
+
+static float* mBirds = NULL;
+static float* mBirdSpeeds = NULL;
+static float* mGathered = NULL;
+static int* mNeighbours = NULL;
+static NeighborGrid mGrid;
+
+static cairo_surface_t* mScreen = NULL;
+#define MICROBENCH_SPRITES 8
+static cairo_surface_t* mSprites[MICROBENCH_SPRITES];
+
+
+/** *********************************************************************
+ ** Timing helper, monotonic seconds.
+ **/
+static double getMicroBenchTime() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+/** *********************************************************************
+ ** Flake stepping: velocity kernel, then positions, as in
+ ** execFlakeSystemTick().
+ **/
+static void initFlakeStep(const MicroBench* bench) {
+    flakePoolInit(&mFlakes);
+    for (int i = 0; i < bench->count; i++) {
+        const int flake = flakePoolAdd(&mFlakes);
+        mFlakes.rx[flake] = drand48() * bench->width;
+        mFlakes.ry[flake] = drand48() * bench->height;
+        mFlakes.vx[flake] = 40 * (drand48() - 0.5);
+        mFlakes.vy[flake] = 20 + 40 * drand48();
+        mFlakes.ivy[flake] = mFlakes.vy[flake];
+        mFlakes.m[flake] = 1 + drand48();
+        mFlakes.wsens[flake] = 0.4 + 0.2 * drand48();
+        mFlakes.state[flake] = 0;
+    }
+
+    mRandoms = (float*) malloc(bench->count * sizeof(float));
+    MALLOC_CHECK(mRandoms);
+
+    // Some gusts, so the grid look-up is measured.
+    mWindGrid.invCellWidth = (float) WIND_GRID_COLUMNS / bench->width;
+    mWindGrid.invCellHeight = (float) WIND_GRID_ROWS / bench->height;
+    for (int row = 0; row < WIND_GRID_ROWS; row++) {
+        for (int col = 0; col < WIND_GRID_COLUMNS; col++) {
+            mWindGrid.wx[row][col] = 100 * (drand48() - 0.5);
+            mWindGrid.wy[row][col] = 20 * (drand48() - 0.5);
+        }
+    }
+}
+
+static void runFlakeStep(const MicroBench* bench,
+    __attribute__((unused)) int iteration) {
+    const float dt = 0.02;
+    const int n = mFlakes.mItemSize;
+
+    randomFill(mRandoms, n);
+    flakeKernelsIntegrateVelocities(&mFlakes, n, dt,
+        100, &mWindGrid, 500, true, 8, mRandoms);
+
+    for (int i = 0; i < n; i++) {
+        float x = mFlakes.rx[i] + dt * mFlakes.vx[i];
+        float y = mFlakes.ry[i] + dt * mFlakes.vy[i];
+        x = (x < 0) ? x + bench->width :
+            (x >= bench->width) ? x - bench->width : x;
+        y = (y >= bench->height) ? 0 : y;
+        mFlakes.rx[i] = x;
+        mFlakes.ry[i] = y;
+        mFlakes.ix[i] = lrintf(x);
+        mFlakes.iy[i] = lrintf(y);
+    }
+    mMicroBenchSink += mFlakes.rx[0];
+}
+
+/** *********************************************************************
+ ** Flake collision: each flake box against the occupancy
+ ** mask of trees and snow, as updateFallenSurfacesWithFlake()
+ ** and the tree tests do.
+ **/
+static void initFlakeCollision(const MicroBench* bench) {
+    if (!mFlakes.mItemSize) {
+        initFlakeStep(bench);
+    }
+
+    occupancyMaskInit(&mMask);
+    occupancyMaskResize(&mMask, bench->width, bench->height);
+    for (int i = 0; i < 48; i++) {
+        const int w = 40 + drand48() * 160;
+        const int h = 40 + drand48() * 200;
+        occupancyMaskSetRect(&mMask, drand48() * (bench->width - w),
+            bench->height - h - drand48() * bench->height * 0.3, w, h);
+    }
+
+    mFlakeSizes = (int*) malloc(bench->count * sizeof(int));
+    MALLOC_CHECK(mFlakeSizes);
+    for (int i = 0; i < bench->count; i++) {
+        mFlakeSizes[i] = 3 + drand48() * 10;
+    }
+}
+
+static void runFlakeCollision(
+    __attribute__((unused)) const MicroBench* bench,
+    __attribute__((unused)) int iteration) {
+    int hits = 0;
+    for (int i = 0; i < mFlakes.mItemSize; i++) {
+        const int size = mFlakeSizes[i];
+        hits += occupancyMaskOverlap(&mMask, mFlakes.ix[i],
+            mFlakes.iy[i], size, size) != CAIRO_REGION_OVERLAP_OUT;
+    }
+    mMicroBenchSink += hits;
+}
+
+/** *********************************************************************
+ ** Fallen snow smoothing: -count deposits, each smoothing its
+ ** span, as smoothFallenSnowSpan().
+ **/
+static void initFallenSmooth(const MicroBench* bench) {
+    // Padded, [-1] .. [width] valid.
+    short int* heights = (short int*) calloc(bench->width + 2,
+        sizeof(short int));
+    mHeightScratch = (short int*) calloc(bench->width + 2,
+        sizeof(short int));
+    mDepositX = (int*) malloc(bench->count * sizeof(int));
+    MALLOC_CHECK(heights);
+    MALLOC_CHECK(mHeightScratch);
+    MALLOC_CHECK(mDepositX);
+    mHeights = heights + 1;
+
+    for (int i = 0; i < bench->width; i++) {
+        mHeights[i] = 20 + 10 * sin(i * 0.01) + 4 * drand48();
+    }
+    for (int i = 0; i < bench->count; i++) {
+        mDepositX[i] = drand48() * (bench->width - 8);
+    }
+}
+
+static void runFallenSmooth(const MicroBench* bench,
+    __attribute__((unused)) int iteration) {
+    const int span = 8;
+    for (int i = 0; i < bench->count; i++) {
+        const int x = mDepositX[i];
+        mHeights[x + span / 2]++;
+        memcpy(mHeightScratch, &mHeights[x - 1],
+            (span + 2) * sizeof(short int));
+        flakeKernelsSmoothHeights(&mHeights[x], mHeightScratch, span);
+    }
+    mMicroBenchSink += mHeights[bench->width / 2];
+}
+
+/** *********************************************************************
+ ** Fallen snow rendering: spline through 10 column averages,
+ ** filled and stroked, as renderFallenSnowSurfaceB().
+ **/
+static void initFallenRender(const MicroBench* bench) {
+    if (!mHeights) {
+        initFallenSmooth(bench);
+    }
+
+    mFallenSurface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+        bench->width, 80);
+    splineWorkspaceInit(&mSpline, 2 + bench->width / 10);
+}
+
+static void runFallenRender(const MicroBench* bench,
+    __attribute__((unused)) int iteration) {
+    const int w = bench->width;
+    const int h = cairo_image_surface_get_height(mFallenSurface);
+    const int points = 2 + (w - 2) / 10;
+
+    splineWorkspaceResize(&mSpline, points);
+    mSpline.x[0] = 0;
+    mSpline.y[0] = mHeights[0];
+    for (int i = 0; i < points - 2; i++) {
+        double sum = 0;
+        for (int j = 0; j < 10; j++) {
+            sum += mHeights[10 * i + j];
+        }
+        mSpline.x[i + 1] = 10 * i + 5;
+        mSpline.y[i + 1] = sum / 10;
+    }
+    mSpline.x[points - 1] = w - 1;
+    mSpline.y[points - 1] = mSpline.y[points - 2];
+    splineWorkspaceBuild(&mSpline, points);
+
+    cairo_t* cr = cairo_create(mFallenSurface);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_rgba(cr, 0, 0, 0, 0);
+    cairo_paint(cr);
+
+    cairo_set_line_width(cr, 1);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_move_to(cr, 0, h);
+    for (int i = 0; i < w; i++) {
+        cairo_line_to(cr, i, h - splineWorkspaceEval(&mSpline, i));
+    }
+    cairo_line_to(cr, w - 1, h);
+    cairo_close_path(cr);
+    cairo_stroke_preserve(cr);
+    cairo_fill(cr);
+    cairo_destroy(cr);
+
+    cairo_surface_flush(mFallenSurface);
+    mMicroBenchSink += cairo_image_surface_get_data(mFallenSurface)[0];
+}
+
+/** *********************************************************************
+ ** Flocking: neighbour grid build, then one range query and
+ ** neighbour sum per bird, as steerBirds().
+ **/
+static void initFlocking(const MicroBench* bench) {
+    mBirds = (float*) malloc(3 * bench->count * sizeof(float));
+    mBirdSpeeds = (float*) malloc(3 * bench->count * sizeof(float));
+    mGathered = (float*) malloc(6 * bench->count * sizeof(float));
+    mNeighbours = (int*) malloc(bench->count * sizeof(int));
+    MALLOC_CHECK(mBirds);
+    MALLOC_CHECK(mBirdSpeeds);
+    MALLOC_CHECK(mGathered);
+    MALLOC_CHECK(mNeighbours);
+
+    for (int i = 0; i < bench->count; i++) {
+        mBirds[3 * i + 0] = drand48() * bench->width;
+        mBirds[3 * i + 1] = drand48() * bench->height;
+        mBirds[3 * i + 2] = drand48() * bench->width;
+        mBirdSpeeds[3 * i + 0] = 20 * (drand48() - 0.5);
+        mBirdSpeeds[3 * i + 1] = 20 * (drand48() - 0.5);
+        mBirdSpeeds[3 * i + 2] = 20 * (drand48() - 0.5);
+    }
+    neighborGridInit(&mGrid);
+}
+
+static void runFlocking(const MicroBench* bench, int iteration) {
+    const float range = 0.05 * bench->width;
+
+    // Birds drift a little between ticks.
+    const float drift = (iteration & 1) ? 1.0 : -1.0;
+    for (int i = 0; i < 3 * bench->count; i++) {
+        mBirds[i] += drift;
+    }
+
+    neighborGridBuild(&mGrid, mBirds, 3 * sizeof(float),
+        bench->count, range);
+
+    const int n = bench->count;
+    long found = 0;
+    float sumdist = 0;
+    for (int i = 0; i < n; i++) {
+        const int numFound = neighborGridQuery(&mGrid, mBirds,
+            3 * sizeof(float), mBirds[3 * i], mBirds[3 * i + 1],
+            mBirds[3 * i + 2], range, mNeighbours, n);
+        found += numFound;
+
+        for (int k = 0; k < numFound; k++) {
+            const int b = mNeighbours[k];
+            mGathered[k] = mBirds[3 * b];
+            mGathered[n + k] = mBirds[3 * b + 1];
+            mGathered[2 * n + k] = mBirds[3 * b + 2];
+            mGathered[3 * n + k] = mBirdSpeeds[3 * b];
+            mGathered[4 * n + k] = mBirdSpeeds[3 * b + 1];
+            mGathered[5 * n + k] = mBirdSpeeds[3 * b + 2];
+        }
+
+        NeighbourSums sums;
+        flakeKernelsSumNeighbours(mGathered, mGathered + n,
+            mGathered + 2 * n, mGathered + 3 * n, mGathered + 4 * n,
+            mGathered + 5 * n, numFound, mBirds[3 * i],
+            mBirds[3 * i + 1], mBirds[3 * i + 2], 0.5 * range, &sums);
+        sumdist += sums.dist;
+    }
+    mMicroBenchSink += found + sumdist;
+}
+
+/** *********************************************************************
+ ** Snow compositing: every flake sprite painted onto the
+ ** screen image, as snow_draw().
+ **/
+static void initSnowDraw(const MicroBench* bench) {
+    if (!mFlakes.mItemSize) {
+        initFlakeStep(bench);
+    }
+
+    mScreen = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+        bench->width, bench->height);
+
+    for (int i = 0; i < MICROBENCH_SPRITES; i++) {
+        const int size = 4 + 2 * i;
+        mSprites[i] = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            size, size);
+        cairo_t* cr = cairo_create(mSprites[i]);
+        cairo_set_source_rgba(cr, 1, 1, 1, 0.9);
+        cairo_arc(cr, size / 2.0, size / 2.0, size / 2.0, 0, 2 * M_PI);
+        cairo_fill(cr);
+        cairo_destroy(cr);
+    }
+    for (int i = 0; i < mFlakes.mItemSize; i++) {
+        mFlakes.whatFlake[i] = i % MICROBENCH_SPRITES;
+    }
+}
+
+static void initSnowBlend(const MicroBench* bench) {
+    if (!mScreen) {
+        initSnowDraw(bench);
+    }
+}
+
+static void runSnowDraw(
+    __attribute__((unused)) const MicroBench* bench,
+    __attribute__((unused)) int iteration) {
+    cairo_t* cr = cairo_create(mScreen);
+
+    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(cr);
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+    for (int i = 0; i < mFlakes.mItemSize; i++) {
+        cairo_set_source_surface(cr, mSprites[mFlakes.whatFlake[i]],
+            mFlakes.ix[i], mFlakes.iy[i]);
+        cairo_paint(cr);
+    }
+    cairo_destroy(cr);
+
+    cairo_surface_flush(mScreen);
+    mMicroBenchSink += cairo_image_surface_get_data(mScreen)[0];
+}
+
+/** *********************************************************************
+ ** Snow compositing as -pixelraster: every flake sprite
+ ** blended into the screen memory by hand.
+ **/
+static void runSnowBlend(
+    __attribute__((unused)) const MicroBench* bench,
+    __attribute__((unused)) int iteration) {
+    cairo_surface_flush(mScreen);
+    uint32_t* screen = (uint32_t*) cairo_image_surface_get_data(mScreen);
+    const int screenStride = cairo_image_surface_get_stride(mScreen) / 4;
+    const int screenWidth = cairo_image_surface_get_width(mScreen);
+    const int screenHeight = cairo_image_surface_get_height(mScreen);
+    memset(screen, 0, (size_t) screenStride * 4 * screenHeight);
+
+    for (int i = 0; i < mFlakes.mItemSize; i++) {
+        cairo_surface_t* sprite = mSprites[mFlakes.whatFlake[i]];
+        const int size = cairo_image_surface_get_width(sprite);
+        const int x = mFlakes.ix[i];
+        const int y = mFlakes.iy[i];
+        if (x < 0 || y < 0 || x + size > screenWidth ||
+            y + size > screenHeight) {
+            continue;
+        }
+
+        flakeKernelsBlendOver(screen + (size_t) y * screenStride + x,
+            screenStride, (const uint32_t*)
+                cairo_image_surface_get_data(sprite),
+            cairo_image_surface_get_stride(sprite) / 4,
+            size, size, 256);
+    }
+
+    cairo_surface_mark_dirty(mScreen);
+    mMicroBenchSink += screen[0];
+}
+
+/** *********************************************************************
+ ** This method times one benchmark and writes its JSON.
+ **/
+static void runMicroBench(const MicroBench* bench, const char* name,
+    int items, void (*init)(const MicroBench*), MicroBenchMethod run,
+    bool isLast) {
+    init(bench);
+    run(bench, 0);
+
+    const double start = getMicroBenchTime();
+    for (int i = 1; i <= bench->iterations; i++) {
+        run(bench, i);
+    }
+    const double elapsed = getMicroBenchTime() - start;
+
+    const double nsPerIteration = 1.0e9 * elapsed / bench->iterations;
+    printf("    {\"name\": \"%s\", \"items\": %d, "
+        "\"ns_per_iteration\": %.1f, \"ns_per_item\": %.3f}%s\n",
+        name, items, nsPerIteration,
+        items > 0 ? nsPerIteration / items : 0, isLast ? "" : ",");
+}
+
+/** *********************************************************************
+ ** This method parses one positive int argument.
+ **/
+static bool getMicroBenchArg(int argc, char* argv[], int* index,
+    const char* name, int* value) {
+    if (strcmp(argv[*index], name) || *index + 1 >= argc) {
+        return false;
+    }
+
+    const int parsed = atoi(argv[++(*index)]);
+    if (parsed > 0) {
+        *value = parsed;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    MicroBench bench = {
+        .count = 4000,
+        .width = 1920,
+        .height = 1080,
+        .iterations = 200,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (getMicroBenchArg(argc, argv, &i, "-count", &bench.count) ||
+            getMicroBenchArg(argc, argv, &i, "-width", &bench.width) ||
+            getMicroBenchArg(argc, argv, &i, "-height", &bench.height) ||
+            getMicroBenchArg(argc, argv, &i, "-iterations",
+                &bench.iterations)) {
+            continue;
+        }
+
+        fprintf(stderr, "usage: %s [-count n] [-width n] [-height n] "
+            "[-iterations n]\n", argv[0]);
+        return 1;
+    }
+
+    // Fixed seed, so runs compare.
+    srand48(20241224);
+    seedRandom(20241224);
+
+    printf("{\n  \"count\": %d, \"width\": %d, \"height\": %d, "
+        "\"iterations\": %d,\n  \"results\": [\n", bench.count,
+        bench.width, bench.height, bench.iterations);
+
+    runMicroBench(&bench, "flake_step", bench.count,
+        initFlakeStep, runFlakeStep, false);
+    runMicroBench(&bench, "flake_collision", bench.count,
+        initFlakeCollision, runFlakeCollision, false);
+    runMicroBench(&bench, "fallensnow_smooth", bench.count,
+        initFallenSmooth, runFallenSmooth, false);
+    runMicroBench(&bench, "fallensnow_render", bench.width,
+        initFallenRender, runFallenRender, false);
+    runMicroBench(&bench, "birds_flocking", bench.count,
+        initFlocking, runFlocking, false);
+    runMicroBench(&bench, "snow_draw", bench.count,
+        initSnowDraw, runSnowDraw, false);
+    runMicroBench(&bench, "snow_blend", bench.count,
+        initSnowBlend, runSnowBlend, true);
+
+    printf("  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NeighborGrid.h"
+#include "safe_malloc.h"
+
+
+/** *********************************************************************
+ ** Helper methods.
+ **/
+// Position of item i; x, y and z are consecutive floats.
+static inline const float* itemPosition(const float* positions,
+    size_t stride, int i) {
+    return (const float*) ((const char*) positions + i * stride);
+}
+
+static inline int clampCell(int cell, int max) {
+    return cell < 0 ? 0 : (cell >= max ? max - 1 : cell);
+}
+
+static inline int cellOf(NeighborGrid* grid, int cx, int cy, int cz) {
+    return (cz * grid->ny + cy) * grid->nx + cx;
+}
+
+/** *********************************************************************
+ ** This method inits an empty grid.
+ **/
+void neighborGridInit(NeighborGrid* grid) {
+    memset(grid, 0, sizeof(NeighborGrid));
+    grid->cellSize = 1;
+    grid->nx = grid->ny = grid->nz = 1;
+}
+
+/** *********************************************************************
+ ** This method frees the grid arrays.
+ **/
+void neighborGridFree(NeighborGrid* grid) {
+    tracked_free(grid->cellStart);
+    tracked_free(grid->cellItems);
+    tracked_free(grid->itemCell);
+    neighborGridInit(grid);
+}
+
+/** *********************************************************************
+ ** This method (re)builds the grid over count items, in
+ ** O(count + cells).
+ **/
+void neighborGridBuild(NeighborGrid* grid, const float* positions,
+    size_t stride, int count, float cellSize) {
+    grid->itemCount = count;
+
+    // Bounding box of the items.
+    float minx = 0, miny = 0, minz = 0;
+    float maxx = 0, maxy = 0, maxz = 0;
+    for (int i = 0; i < count; i++) {
+        const float* p = itemPosition(positions, stride, i);
+        if (i == 0 || p[0] < minx) minx = p[0];
+        if (i == 0 || p[1] < miny) miny = p[1];
+        if (i == 0 || p[2] < minz) minz = p[2];
+        if (i == 0 || p[0] > maxx) maxx = p[0];
+        if (i == 0 || p[1] > maxy) maxy = p[1];
+        if (i == 0 || p[2] > maxz) maxz = p[2];
+    }
+
+    if (!(cellSize > 1.0e-6f)) {
+        cellSize = 1.0e-6f;
+    }
+    while (1) {
+        const double cells = (floor((maxx - minx) / cellSize) + 1) *
+            (floor((maxy - miny) / cellSize) + 1) *
+            (floor((maxz - minz) / cellSize) + 1);
+        if (cells <= NEIGHBORGRID_MAX_CELLS) {
+            break;
+        }
+        cellSize *= 1.25f;
+    }
+
+    grid->cellSize = cellSize;
+    grid->ox = minx;
+    grid->oy = miny;
+    grid->oz = minz;
+    grid->nx = (int) ((maxx - minx) / cellSize) + 1;
+    grid->ny = (int) ((maxy - miny) / cellSize) + 1;
+    grid->nz = (int) ((maxz - minz) / cellSize) + 1;
+
+    // Size the arrays, they never shrink.
+    const int cellCount = grid->nx * grid->ny * grid->nz;
+    if (cellCount + 1 > grid->cellCapacity) {
+        grid->cellCapacity = cellCount + 1;
+        grid->cellStart = (int*) tracked_realloc(MEMORY_BIRDS,
+            grid->cellStart,
+            grid->cellCapacity * sizeof(int));
+        REALLOC_CHECK(grid->cellStart);
+    }
+    if (count + 1 > grid->itemCapacity) {
+        grid->itemCapacity = count + 1;
+        grid->cellItems = (int*) tracked_realloc(MEMORY_BIRDS,
+            grid->cellItems,
+            grid->itemCapacity * sizeof(int));
+        REALLOC_CHECK(grid->cellItems);
+        grid->itemCell = (int*) tracked_realloc(MEMORY_BIRDS,
+            grid->itemCell,
+            grid->itemCapacity * sizeof(int));
+        REALLOC_CHECK(grid->itemCell);
+    }
+
+    // Counting sort of items over cells: count, sum to cell
+    // ends, then place back to front so each end becomes the
+    // start of its cell.
+    memset(grid->cellStart, 0, (cellCount + 1) * sizeof(int));
+    for (int i = 0; i < count; i++) {
+        const float* p = itemPosition(positions, stride, i);
+        const int cell = cellOf(grid,
+            clampCell((p[0] - minx) / cellSize, grid->nx),
+            clampCell((p[1] - miny) / cellSize, grid->ny),
+            clampCell((p[2] - minz) / cellSize, grid->nz));
+        grid->itemCell[i] = cell;
+        grid->cellStart[cell]++;
+    }
+    for (int c = 1; c < cellCount; c++) {
+        grid->cellStart[c] += grid->cellStart[c - 1];
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        grid->cellItems[--grid->cellStart[grid->itemCell[i]]] = i;
+    }
+    grid->cellStart[cellCount] = count;
+}
+
+/** *********************************************************************
+ ** This method finds the items within range of x, y, z and
+ ** stores up to maxResults of their indexes in result.
+ ** Returns the number stored. Only reads the grid, so
+ ** concurrent queries are fine.
+ **/
+int neighborGridQuery(NeighborGrid* grid, const float* positions,
+    size_t stride, float x, float y, float z, float range,
+    int* result, int maxResults) {
+    if (grid->itemCount <= 0) {
+        return 0;
+    }
+
+    const float cellSize = grid->cellSize;
+    const int x0 = clampCell(floorf((x - range - grid->ox) / cellSize), grid->nx);
+    const int x1 = clampCell(floorf((x + range - grid->ox) / cellSize), grid->nx);
+    const int y0 = clampCell(floorf((y - range - grid->oy) / cellSize), grid->ny);
+    const int y1 = clampCell(floorf((y + range - grid->oy) / cellSize), grid->ny);
+    const int z0 = clampCell(floorf((z - range - grid->oz) / cellSize), grid->nz);
+    const int z1 = clampCell(floorf((z + range - grid->oz) / cellSize), grid->nz);
+
+    const float range2 = range * range;
+    int resultCount = 0;
+    for (int cz = z0; cz <= z1; cz++) {
+        for (int cy = y0; cy <= y1; cy++) {
+            for (int cx = x0; cx <= x1; cx++) {
+                const int cell = cellOf(grid, cx, cy, cz);
+                for (int k = grid->cellStart[cell];
+                    k < grid->cellStart[cell + 1]; k++) {
+                    const int i = grid->cellItems[k];
+                    const float* p = itemPosition(positions, stride, i);
+                    const float dx = p[0] - x;
+                    const float dy = p[1] - y;
+                    const float dz = p[2] - z;
+                    if (dx * dx + dy * dy + dz * dz > range2) {
+                        continue;
+                    }
+                    if (resultCount >= maxResults) {
+                        return resultCount;
+                    }
+                    result[resultCount++] = i;
+                }
+            }
+        }
+    }
+
+    return resultCount;
+}
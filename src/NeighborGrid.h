@@ -0,0 +1,67 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stddef.h>
+
+
+/***********************************************************
+ * NeighborGrid consts.
+ */
+// Upper bound of cells, the cell size grows to keep to it.
+#define NEIGHBORGRID_MAX_CELLS (64 * 64 * 64)
+
+/***********************************************************
+ * 3D uniform grid (cell list) for fixed radius neighbor
+ * search.
+ *
+ * Items are indexes into the caller's array of positions.
+ * A build is a counting sort of the items over the cells,
+ * into arrays that only grow, so rebuilding every tick and
+ * querying never allocate once sized.
+ */
+typedef struct {
+    float cellSize;
+    float ox, oy, oz;        // origin of cell (0, 0, 0)
+    int nx, ny, nz;          // cells per axis
+
+    int itemCount;
+    int itemCapacity;
+    int cellCapacity;
+
+    int* cellStart;          // per cell, first index into cellItems
+    int* cellItems;          // item indexes, grouped by cell
+    int* itemCell;           // per item, its cell
+} NeighborGrid;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void neighborGridInit(NeighborGrid*);
+void neighborGridFree(NeighborGrid*);
+
+void neighborGridBuild(NeighborGrid*, const float* positions,
+    size_t stride, int count, float cellSize);
+int neighborGridQuery(NeighborGrid*, const float* positions,
+    size_t stride, float x, float y, float z, float range,
+    int* result, int maxResults);
@@ -0,0 +1,144 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <pthread.h>
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+#include <gtk/gtk.h>
+
+#include "Flags.h"
+#include "Occlusion.h"
+#include "plasmasnow.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * The transparent snow window always sits below all other
+ * windows, so whatever a visible window covers can not be
+ * seen. mOcclusionRegion is the union of those windows, in
+ * snow window coordinates, rebuilt on the main thread from
+ * the WinInfo list whenever it changes. Windows are taken
+ * as opaque; the simulation under them runs unchanged, only
+ * painting is skipped.
+ */
+static cairo_region_t* mOcclusionRegion = NULL;
+
+// Swaps of mOcclusionRegion, for readers off the main thread.
+static pthread_mutex_t mOcclusionMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/** *********************************************************************
+ ** This method rebuilds the occluded region from the current
+ ** WinInfo list. Main thread only.
+ **/
+void updateOcclusionRegion() {
+    if (!mGlobal.hasTransparentWindow || Flags.NoOcclusion) {
+        clearOcclusionRegion();
+        return;
+    }
+
+    cairo_region_t* region = cairo_region_create();
+    for (int i = 0; i < mGlobal.winInfoListLength; i++) {
+        const WinInfo* winInfo = &mGlobal.winInfoList[i];
+        if (winInfo->hidden || winInfo->desktop ||
+            winInfo->window == mGlobal.SnowWin ||
+            winInfo->w == 0 || winInfo->h == 0) {
+            continue;
+        }
+
+        bool isVisible = winInfo->sticky;
+        for (int j = 0; !isVisible && j < mGlobal.NVisWorkSpaces; j++) {
+            isVisible = mGlobal.VisWorkSpaces[j] == winInfo->ws;
+        }
+        if (!isVisible) {
+            continue;
+        }
+
+        const cairo_rectangle_int_t rect = {
+            winInfo->x, winInfo->y, winInfo->w, winInfo->h
+        };
+        cairo_region_union_rectangle(region, &rect);
+    }
+
+    pthread_mutex_lock(&mOcclusionMutex);
+    cairo_region_t* old = mOcclusionRegion;
+    mOcclusionRegion = region;
+    pthread_mutex_unlock(&mOcclusionMutex);
+
+    if (old) {
+        cairo_region_destroy(old);
+    }
+}
+
+/** *********************************************************************
+ ** This method drops the occluded region, so everything is
+ ** drawn. Used while a window is dragged, when the list is
+ ** not kept up to date. Main thread only.
+ **/
+void clearOcclusionRegion() {
+    pthread_mutex_lock(&mOcclusionMutex);
+    cairo_region_t* old = mOcclusionRegion;
+    mOcclusionRegion = NULL;
+    pthread_mutex_unlock(&mOcclusionMutex);
+
+    if (old) {
+        cairo_region_destroy(old);
+    }
+}
+
+/** *********************************************************************
+ ** These methods guard the occluded region for threads
+ ** other than the main one.
+ **/
+void lockOcclusion() {
+    pthread_mutex_lock(&mOcclusionMutex);
+}
+
+void unlockOcclusion() {
+    pthread_mutex_unlock(&mOcclusionMutex);
+}
+
+/** *********************************************************************
+ ** This method checks if anything is occluded at all, so
+ ** callers can skip per item tests.
+ ** threads: main thread, or holding lockOcclusion()
+ **/
+bool hasOcclusion() {
+    return mOcclusionRegion &&
+        !cairo_region_is_empty(mOcclusionRegion);
+}
+
+/** *********************************************************************
+ ** This method checks if an area is fully hidden behind
+ ** windows.
+ ** threads: main thread, or holding lockOcclusion()
+ **/
+bool isAreaOccluded(int x, int y, int w, int h) {
+    if (!mOcclusionRegion) {
+        return false;
+    }
+
+    const cairo_rectangle_int_t rect = { x, y, w, h };
+    return cairo_region_contains_rectangle(mOcclusionRegion,
+        &rect) == CAIRO_REGION_OVERLAP_IN;
+}
@@ -0,0 +1,203 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "OccupancyMask.h"
+#include "safe_malloc.h"
+
+
+/** *********************************************************************
+ ** Helper methods.
+ **/
+static inline uint64_t* maskRow(OccupancyMask* mask, int y) {
+    return mask->bits + (size_t) y * mask->stride;
+}
+
+// Bits x0 .. x1 (inclusive) of one word.
+static inline uint64_t wordBits(int x0, int x1) {
+    const uint64_t high = (x1 == 63) ? ~0ULL : ((1ULL << (x1 + 1)) - 1);
+    return high & ~((1ULL << x0) - 1);
+}
+
+// Clip a rectangle to the mask, false if nothing is left.
+static bool clipRect(OccupancyMask* mask, int* x, int* y, int* w, int* h) {
+    if (*x < 0) {
+        *w += *x;
+        *x = 0;
+    }
+    if (*y < 0) {
+        *h += *y;
+        *y = 0;
+    }
+    if (*x + *w > mask->width) {
+        *w = mask->width - *x;
+    }
+    if (*y + *h > mask->height) {
+        *h = mask->height - *y;
+    }
+    return *w > 0 && *h > 0;
+}
+
+// States found in a row span: bit 1 for a set pixel, bit 2
+// for a clear one.
+static int spanStates(uint64_t* row, int x0, int x1) {
+    int states = 0;
+    const int w0 = x0 >> 6;
+    const int w1 = x1 >> 6;
+    for (int w = w0; w <= w1 && states != 3; w++) {
+        const uint64_t bits = wordBits(w == w0 ? (x0 & 63) : 0,
+            w == w1 ? (x1 & 63) : 63);
+        const uint64_t set = row[w] & bits;
+        if (set) {
+            states |= 1;
+        }
+        if (set != bits) {
+            states |= 2;
+        }
+    }
+    return states;
+}
+
+/** *********************************************************************
+ ** This method inits an empty mask.
+ **/
+void occupancyMaskInit(OccupancyMask* mask) {
+    memset(mask, 0, sizeof(OccupancyMask));
+}
+
+void occupancyMaskFree(OccupancyMask* mask) {
+    free(mask->bits);
+    occupancyMaskInit(mask);
+}
+
+/** *********************************************************************
+ ** This method sizes the mask, and clears it.
+ **/
+void occupancyMaskResize(OccupancyMask* mask, int width, int height) {
+    if (width < 0) {
+        width = 0;
+    }
+    if (height < 0) {
+        height = 0;
+    }
+
+    const int stride = (width + 63) / 64;
+    if (stride * height > mask->stride * mask->height || !mask->bits) {
+        free(mask->bits);
+        mask->bits = (uint64_t*) malloc(
+            ((size_t) stride * height + 1) * sizeof(uint64_t));
+        MALLOC_CHECK(mask->bits);
+    }
+
+    mask->width = width;
+    mask->height = height;
+    mask->stride = stride;
+    occupancyMaskClear(mask);
+}
+
+void occupancyMaskClear(OccupancyMask* mask) {
+    if (mask->bits) {
+        memset(mask->bits, 0,
+            (size_t) mask->stride * mask->height * sizeof(uint64_t));
+    }
+}
+
+/** *********************************************************************
+ ** This method tests one pixel.
+ **/
+bool occupancyMaskTest(OccupancyMask* mask, int x, int y) {
+    if (x < 0 || y < 0 || x >= mask->width || y >= mask->height) {
+        return false;
+    }
+    return (maskRow(mask, y)[x >> 6] >> (x & 63)) & 1;
+}
+
+/** *********************************************************************
+ ** This method sets all pixels of a rectangle.
+ **/
+void occupancyMaskSetRect(OccupancyMask* mask, int x, int y, int w, int h) {
+    if (!clipRect(mask, &x, &y, &w, &h)) {
+        return;
+    }
+
+    const int x1 = x + w - 1;
+    const int w0 = x >> 6;
+    const int w1 = x1 >> 6;
+    for (int j = y; j < y + h; j++) {
+        uint64_t* row = maskRow(mask, j);
+        for (int k = w0; k <= w1; k++) {
+            row[k] |= wordBits(k == w0 ? (x & 63) : 0,
+                k == w1 ? (x1 & 63) : 63);
+        }
+    }
+}
+
+/** *********************************************************************
+ ** This method sets all pixels of a region.
+ **/
+void occupancyMaskSetRegion(OccupancyMask* mask, cairo_region_t* region) {
+    const int count = cairo_region_num_rectangles(region);
+    for (int i = 0; i < count; i++) {
+        cairo_rectangle_int_t rect;
+        cairo_region_get_rectangle(region, i, &rect);
+        occupancyMaskSetRect(mask, rect.x, rect.y, rect.width, rect.height);
+    }
+}
+
+/** *********************************************************************
+ ** This method tells how a rectangle overlaps the set pixels,
+ ** like cairo_region_contains_rectangle().
+ **/
+cairo_region_overlap_t occupancyMaskOverlap(OccupancyMask* mask,
+    int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0) {
+        return CAIRO_REGION_OVERLAP_OUT;
+    }
+
+    // Parts outside the mask are clear.
+    int states = 0;
+    const int fullW = w, fullH = h;
+    if (!clipRect(mask, &x, &y, &w, &h)) {
+        return CAIRO_REGION_OVERLAP_OUT;
+    }
+    if (w != fullW || h != fullH) {
+        states |= 2;
+    }
+
+    for (int j = y; j < y + h && states != 3; j++) {
+        states |= spanStates(maskRow(mask, j), x, x + w - 1);
+    }
+
+    switch (states) {
+        case 1:
+            return CAIRO_REGION_OVERLAP_IN;
+        case 3:
+            return CAIRO_REGION_OVERLAP_PART;
+        default:
+            return CAIRO_REGION_OVERLAP_OUT;
+    }
+}
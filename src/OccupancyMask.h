@@ -0,0 +1,59 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <gtk/gtk.h>
+
+
+/***********************************************************
+ * Packed 1-bit screen occupancy mask.
+ *
+ * Bit x of row y is set when pixel (x, y) is covered. Rows
+ * are arrays of 64 bit words, so testing a span of a row is
+ * a few word compares instead of a region search. Pixels
+ * outside the mask read as clear and writes there are
+ * dropped.
+ */
+typedef struct {
+    int width, height;
+    int stride;              // words per row
+    uint64_t* bits;
+} OccupancyMask;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void occupancyMaskInit(OccupancyMask*);
+void occupancyMaskFree(OccupancyMask*);
+void occupancyMaskResize(OccupancyMask*, int width, int height);
+void occupancyMaskClear(OccupancyMask*);
+
+bool occupancyMaskTest(OccupancyMask*, int x, int y);
+void occupancyMaskSetRect(OccupancyMask*, int x, int y, int w, int h);
+void occupancyMaskSetRegion(OccupancyMask*, cairo_region_t*);
+
+cairo_region_overlap_t occupancyMaskOverlap(OccupancyMask*,
+    int x, int y, int w, int h);
@@ -0,0 +1,171 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xinerama.h>
+
+#include <gtk/gtk.h>
+
+#include "Flags.h"
+#include "Outputs.h"
+#include "plasmasnow.h"
+#include "Random.h"
+#include "Utils.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+
+// Outputs clipped to the snow window. Empty if the window
+// is drawn as one box, which is the default.
+static OutputRect mOutputRects[MAX_OUTPUTS];
+static int mOutputRectCount = 0;
+static int mOutputRectTotalWidth = 0;
+
+
+/** *********************************************************************
+ ** This method reads the outputs from Xinerama and clips
+ ** them to the snow window. With -peroutput, snow falls from
+ ** the top of, and settles on the bottom of, each of them.
+ **/
+void updateOutputRects() {
+    mOutputRectCount = 0;
+    mOutputRectTotalWidth = 0;
+
+    if (!Flags.PerOutput) {
+        return;
+    }
+
+    int infoArrayLength;
+    XineramaScreenInfo* infoArray = XineramaQueryScreens(
+        mGlobal.display, &infoArrayLength);
+    if (infoArray == NULL) {
+        return;
+    }
+
+    // The window height includes the bottom offset, so the
+    // outputs reaching the window bottom do as well.
+    const int windowBottom = mGlobal.SnowWinHeight - Flags.OffsetS;
+
+    for (int i = 0; i < infoArrayLength &&
+        mOutputRectCount < MAX_OUTPUTS; i++) {
+        const int left = MAX(0,
+            infoArray[i].x_org - mGlobal.SnowWinX);
+        const int top = MAX(0,
+            infoArray[i].y_org - mGlobal.SnowWinY);
+        const int right = MIN(mGlobal.SnowWinWidth,
+            infoArray[i].x_org + infoArray[i].width - mGlobal.SnowWinX);
+        int bottom = MIN(windowBottom,
+            infoArray[i].y_org + infoArray[i].height - mGlobal.SnowWinY);
+        if (right <= left || bottom <= top) {
+            continue;
+        }
+        if (bottom == windowBottom) {
+            bottom = mGlobal.SnowWinHeight;
+        }
+
+        OutputRect* rect = &mOutputRects[mOutputRectCount++];
+        rect->x = left;
+        rect->y = top;
+        rect->width = right - left;
+        rect->height = bottom - top;
+        mOutputRectTotalWidth += rect->width;
+    }
+    XFree(infoArray);
+
+    // One output is the whole window.
+    if (mOutputRectCount < 2) {
+        mOutputRectCount = 0;
+        mOutputRectTotalWidth = 0;
+    }
+
+    if (Flags.Noisy) {
+        for (int i = 0; i < mOutputRectCount; i++) {
+            printf("plasmasnow: output %d: %dx%d+%d+%d\n", i,
+                mOutputRects[i].width, mOutputRects[i].height,
+                mOutputRects[i].x, mOutputRects[i].y);
+        }
+    }
+}
+
+/** *********************************************************************
+ ** Helpers.
+ **/
+bool hasOutputRects() {
+    return mOutputRectCount > 0;
+}
+
+int getOutputRectCount() {
+    return mOutputRectCount;
+}
+
+const OutputRect* getOutputRect(int index) {
+    return &mOutputRects[index];
+}
+
+/** *********************************************************************
+ ** This method picks an output for a new flake, weighted
+ ** by width so snow is as dense on a small one as a large.
+ **/
+const OutputRect* getRandomOutputRect() {
+    int column = randomUniform() * mOutputRectTotalWidth;
+
+    for (int i = 0; i < mOutputRectCount - 1; i++) {
+        if (column < mOutputRects[i].width) {
+            return &mOutputRects[i];
+        }
+        column -= mOutputRects[i].width;
+    }
+    return &mOutputRects[mOutputRectCount - 1];
+}
+
+/** *********************************************************************
+ ** This method returns the bottom of the output spanning
+ ** exactly the given columns, or the default if none does.
+ **/
+int getOutputBottom(int x, int width, int defaultBottom) {
+    for (int i = 0; i < mOutputRectCount; i++) {
+        if (mOutputRects[i].x == x && mOutputRects[i].width == width) {
+            return mOutputRects[i].y + mOutputRects[i].height;
+        }
+    }
+    return defaultBottom;
+}
+
+/** *********************************************************************
+ ** This method clips drawing to the outputs, so nothing is
+ ** painted where no monitor shows it.
+ **/
+void clipToOutputRects(cairo_t* cc) {
+    if (!hasOutputRects()) {
+        return;
+    }
+
+    for (int i = 0; i < mOutputRectCount; i++) {
+        cairo_rectangle(cc, mOutputRects[i].x, mOutputRects[i].y,
+            mOutputRects[i].width, mOutputRects[i].height);
+    }
+    cairo_clip(cc);
+}
@@ -0,0 +1,55 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+#include <gtk/gtk.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define MAX_OUTPUTS 16
+
+// An output (monitor) rectangle, in snow window coords.
+typedef struct _OutputRect {
+        int x;
+        int y;
+        int width;
+        int height;
+} OutputRect;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void updateOutputRects();
+
+bool hasOutputRects();
+int getOutputRectCount();
+const OutputRect* getOutputRect(int index);
+const OutputRect* getRandomOutputRect();
+
+int getOutputBottom(int x, int width, int defaultBottom);
+void clipToOutputRects(cairo_t* cc);
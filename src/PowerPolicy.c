@@ -0,0 +1,331 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/scrnsaver.h>
+
+#include <gtk/gtk.h>
+
+#include "Application.h"
+#include "Benchmark.h"
+#include "clocks.h"
+#include "Flags.h"
+#include "plasmasnow.h"
+#include "PowerPolicy.h"
+#include "Scheduler.h"
+#include "Utils.h"
+#include "windows.h"
+#include "WinInfo.h"
+#include "XTraffic.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * Every few seconds, the policy checks for battery power,
+ * a full screen window in front, and an idle user. Battery
+ * and idle drop the draw and flake timers to -lowfps, a
+ * full screen window, or -lowfps 0, pauses the simulation
+ * as Suspend.c does for a hidden workspace. Wakeups are
+ * counted per mode, for -perfstats.
+ */
+static POWER_MODE mPowerMode = POWER_MODE_FULL;
+static bool mIsOnBattery = false;
+
+// Idle: MIT-SCREEN-SAVER idle time, which counts keys too.
+// Without it, the pointer where it was and the active window
+// unchanged.
+static bool mIsIdleInfoChecked = false;
+static XScreenSaverInfo* mIdleInfo = NULL;
+static int mIdlePointerX = -1;
+static int mIdlePointerY = -1;
+static Window mIdleActiveWindow = None;
+static double mIdleSince = 0;
+
+// Scheduler wakeups and seconds spent in each mode.
+static unsigned long mModeWakeups[POWER_MODE_COUNT];
+static double mModeSeconds[POWER_MODE_COUNT];
+static unsigned long mModeStartWakeups = 0;
+static double mModeStartTime = 0;
+
+static const char* POWER_MODE_NAMES[POWER_MODE_COUNT] = {
+    "full", "low", "paused"
+};
+
+
+/** *********************************************************************
+ ** Add policy check to mainloop. It keeps running while
+ ** the simulation timers are parked.
+ **/
+void startPowerPolicy() {
+    mIdleSince = wallclock();
+    mModeStartTime = mIdleSince;
+    mModeStartWakeups = getSchedulerWakeupTotal();
+
+    if (isBenchmarkActive() || mGlobal.XscreensaverMode ||
+        Flags.NoPowerPolicy) {
+        return;
+    }
+    addMethodToMainloop(PRIORITY_DEFAULT,
+        TIME_BETWEEN_POWER_POLICY_CHECKS, execPowerPolicy);
+}
+
+/** *********************************************************************
+ ** This method picks the power mode, and retimes or pauses
+ ** the simulation when it changes.
+ **/
+int execPowerPolicy() {
+    if (Flags.shutdownRequested) {
+        return false;
+    }
+
+    mIsOnBattery = isOnBatteryPower();
+
+    POWER_MODE mode = POWER_MODE_FULL;
+    if (isFullScreenWindowActive()) {
+        mode = POWER_MODE_PAUSED;
+    } else if (mIsOnBattery || isUserIdle()) {
+        mode = Flags.LowFps > 0 ? POWER_MODE_LOW : POWER_MODE_PAUSED;
+    }
+    if (mode == mPowerMode) {
+        return true;
+    }
+
+    // Close the books on the mode left.
+    const double now = wallclock();
+    const unsigned long wakeups = getSchedulerWakeupTotal();
+    mModeWakeups[mPowerMode] += wakeups - mModeStartWakeups;
+    mModeSeconds[mPowerMode] += now - mModeStartTime;
+    mModeStartWakeups = wakeups;
+    mModeStartTime = now;
+
+    if (Flags.Noisy) {
+        printf("plasmasnow: power mode %s -> %s%s.\n",
+            POWER_MODE_NAMES[mPowerMode], POWER_MODE_NAMES[mode],
+            mIsOnBattery ? ", on battery" : "");
+    }
+
+    const bool wasLow = mPowerMode == POWER_MODE_LOW;
+    mPowerMode = mode;
+
+    // Suspend.c sees pauses on its next check.
+    if (wasLow || mode == POWER_MODE_LOW) {
+        respondToPowerPolicyChange();
+    }
+    return true;
+}
+
+/** *********************************************************************
+ ** Helpers.
+ **/
+POWER_MODE getPowerMode() {
+    return mPowerMode;
+}
+
+bool isPowerPolicyPaused() {
+    return mPowerMode == POWER_MODE_PAUSED;
+}
+
+// Multiplies mGlobal.cpufactor, stretching the timers.
+double getPowerPolicyCpuFactor() {
+    if (mPowerMode != POWER_MODE_LOW ||
+        Flags.LowFps >= POWER_POLICY_FULL_FPS) {
+        return 1.0;
+    }
+    return (double) POWER_POLICY_FULL_FPS / Flags.LowFps;
+}
+
+// Multiplies the quality governor budget.
+double getPowerPolicyBudgetFactor() {
+    return mIsOnBattery ? POWER_POLICY_BATTERY_BUDGET_PCT : 1.0;
+}
+
+/** *********************************************************************
+ ** This method reads the power supplies, as UPower does: on
+ ** battery if there is a system battery, and no mains or usb
+ ** supply is online. Batteries of mice, keyboards and pads
+ ** have device scope, and don't count.
+ **/
+bool isOnBatteryPower() {
+    DIR* dir = opendir(POWER_SUPPLY_PATH);
+    if (!dir) {
+        return false;
+    }
+
+    bool hasBattery = false;
+    bool isExternalOnline = false;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s/type",
+            POWER_SUPPLY_PATH, entry->d_name);
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        char type[32] = "";
+        if (!fgets(type, sizeof(type), file)) {
+            type[0] = '\0';
+        }
+        fclose(file);
+
+        if (!strncmp(type, "Battery", 7)) {
+            snprintf(path, sizeof(path), "%s/%s/scope",
+                POWER_SUPPLY_PATH, entry->d_name);
+            char scope[32] = "";
+            file = fopen(path, "r");
+            if (file) {
+                if (!fgets(scope, sizeof(scope), file)) {
+                    scope[0] = '\0';
+                }
+                fclose(file);
+            }
+            if (strncmp(scope, "Device", 6)) {
+                hasBattery = true;
+            }
+            continue;
+        }
+        if (strncmp(type, "Mains", 5) && strncmp(type, "USB", 3)) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s/online",
+            POWER_SUPPLY_PATH, entry->d_name);
+        file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        if (fgetc(file) == '1') {
+            isExternalOnline = true;
+        }
+        fclose(file);
+    }
+    closedir(dir);
+
+    return hasBattery && !isExternalOnline;
+}
+
+/** *********************************************************************
+ ** This method checks if the active window covers the whole
+ ** snow window, like a full screen video or game. From the
+ ** WinInfo list, no round trips.
+ **/
+bool isFullScreenWindowActive() {
+    const Window active = getActiveAppWindow();
+    if (active == None || active == mGlobal.SnowWin) {
+        return false;
+    }
+
+    const WinInfo* winInfo = getWinInfoForWindow(active);
+    if (!winInfo) {
+        winInfo = getWinInfoForFrame(active);
+    }
+    if (!winInfo || winInfo->hidden || winInfo->desktop) {
+        return false;
+    }
+
+    return winInfo->x <= 0 && winInfo->y <= 0 &&
+        winInfo->x + (int) winInfo->w >= mGlobal.SnowWinWidth &&
+        winInfo->y + (int) winInfo->h >= mGlobal.SnowWinHeight;
+}
+
+/** *********************************************************************
+ ** This method checks if the user has been idle for
+ ** -idletime seconds, from the server's idle time. Without
+ ** MIT-SCREEN-SAVER: the pointer has not moved, and the
+ ** active window not changed. 0 turns it off.
+ **/
+bool isUserIdle() {
+    if (Flags.IdleTime <= 0) {
+        return false;
+    }
+
+    if (!mIsIdleInfoChecked) {
+        mIsIdleInfoChecked = true;
+        int eventBase, errorBase;
+        if (XScreenSaverQueryExtension(mGlobal.display,
+            &eventBase, &errorBase)) {
+            mIdleInfo = XScreenSaverAllocInfo();
+        }
+    }
+    if (mIdleInfo && XScreenSaverQueryInfo(mGlobal.display,
+        mGlobal.Rootwindow, mIdleInfo)) {
+        return mIdleInfo->idle >= (unsigned long) Flags.IdleTime * 1000;
+    }
+
+    Window root, child;
+    int x, y, windowX, windowY;
+    unsigned int mask;
+    XQueryPointer(mGlobal.display, mGlobal.Rootwindow, &root, &child,
+        &x, &y, &windowX, &windowY, &mask);
+
+    const double now = wallclock();
+    const Window active = getActiveAppWindow();
+    if (x != mIdlePointerX || y != mIdlePointerY ||
+        active != mIdleActiveWindow) {
+        mIdlePointerX = x;
+        mIdlePointerY = y;
+        mIdleActiveWindow = active;
+        mIdleSince = now;
+        return false;
+    }
+
+    return now - mIdleSince >= Flags.IdleTime;
+}
+
+/** *********************************************************************
+ ** This method formats the current mode, and scheduler
+ ** wakeups per second in each mode so far.
+ **/
+void getPowerPolicyReport(char* buffer, size_t size) {
+    const double now = wallclock();
+    const unsigned long wakeups = getSchedulerWakeupTotal();
+
+    int written = snprintf(buffer, size, "mode %s%s\n",
+        POWER_MODE_NAMES[mPowerMode], mIsOnBattery ? ", on battery" : "");
+    for (int mode = 0; mode < POWER_MODE_COUNT; mode++) {
+        if (written < 0 || (size_t) written >= size) {
+            return;
+        }
+
+        unsigned long modeWakeups = mModeWakeups[mode];
+        double modeSeconds = mModeSeconds[mode];
+        if (mode == (int) mPowerMode) {
+            modeWakeups += wakeups - mModeStartWakeups;
+            modeSeconds += now - mModeStartTime;
+        }
+        if (modeSeconds <= 0) {
+            continue;
+        }
+        written += snprintf(buffer + written, size - written,
+            "%-8s wakeups/s %6.1f over %.0f s\n", POWER_MODE_NAMES[mode],
+            modeWakeups / modeSeconds, modeSeconds);
+    }
+}
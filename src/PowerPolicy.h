@@ -0,0 +1,65 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define TIME_BETWEEN_POWER_POLICY_CHECKS 2.0
+
+// Frame rate the draw and flake timers are made for, at
+// cpufactor 1.
+#define POWER_POLICY_FULL_FPS 25
+
+// Share of the quality budget while on battery.
+#define POWER_POLICY_BATTERY_BUDGET_PCT 0.5
+
+#define POWER_SUPPLY_PATH "/sys/class/power_supply"
+
+typedef enum {
+    POWER_MODE_FULL = 0,
+    POWER_MODE_LOW,
+    POWER_MODE_PAUSED,
+    POWER_MODE_COUNT
+} POWER_MODE;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void startPowerPolicy();
+int execPowerPolicy();
+
+POWER_MODE getPowerMode();
+bool isPowerPolicyPaused();
+double getPowerPolicyCpuFactor();
+double getPowerPolicyBudgetFactor();
+
+bool isOnBatteryPower();
+bool isFullScreenWindowActive();
+bool isUserIdle();
+
+void getPowerPolicyReport(char* buffer, size_t size);
@@ -0,0 +1,226 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Random.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+
+// As the flake kernels: GCC builds an AVX2 and a baseline
+// clone of the batch fill on x86_64.
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    !defined(__clang__)
+    #define RANDOMKERNEL __attribute__((target_clones("avx2", "default")))
+#else
+    #define RANDOMKERNEL
+#endif
+
+// Independent xorshift32 lanes for the batch fill.
+#define RANDOM_LANES 8
+
+typedef struct {
+        bool isSeeded;
+        uint32_t s[4];
+        uint32_t lanes[RANDOM_LANES];
+} RandomState;
+
+static _Thread_local RandomState mRandom;
+
+// Threads seed from this and their index, see seedRandomThread().
+// Threads without one take the next index from
+// RANDOM_THREAD_OTHERS on, in order of their first draw.
+static atomic_uint_fast64_t mRandomSeed = 0x853c49e6748fea9bULL;
+static atomic_uint_fast64_t mRandomThreadSerial = 0;
+
+
+/** *********************************************************************
+ ** Helpers.
+ **/
+static uint64_t splitMix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint32_t rotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+/** *********************************************************************
+ ** This method seeds the calling thread's generator and
+ ** batch lanes from one 64 bit value.
+ **/
+static void seedThisThread(uint64_t seed) {
+    for (int i = 0; i < 4; i += 2) {
+        const uint64_t z = splitMix64(&seed);
+        mRandom.s[i] = (uint32_t) z;
+        mRandom.s[i + 1] = (uint32_t) (z >> 32);
+    }
+    for (int l = 0; l < RANDOM_LANES; l++) {
+        // xorshift32 must not be 0.
+        mRandom.lanes[l] = (uint32_t) splitMix64(&seed) | 1;
+    }
+    mRandom.isSeeded = true;
+}
+
+static void seedThisThreadIndex(uint64_t index) {
+    uint64_t seed = atomic_load(&mRandomSeed) ^
+        (index + 1) * 0xd1b54a32d192ed03ULL;
+    seedThisThread(splitMix64(&seed));
+}
+
+static void ensureSeeded() {
+    if (mRandom.isSeeded) {
+        return;
+    }
+    seedThisThreadIndex(RANDOM_THREAD_OTHERS +
+        atomic_fetch_add(&mRandomThreadSerial, 1));
+}
+
+/** *********************************************************************
+ ** This method sets the seed. The calling thread restarts
+ ** from it at once, other threads when they first draw. A
+ ** benchmark gets the same main thread sequence every run.
+ **/
+void seedRandom(uint64_t seed) {
+    atomic_store(&mRandomSeed, seed);
+    atomic_store(&mRandomThreadSerial, 0);
+
+    uint64_t z = seed;
+    seedThisThread(splitMix64(&z));
+}
+
+/** *********************************************************************
+ ** This method seeds the calling thread from the seed and a
+ ** fixed index, given where the thread is made. A seeded run
+ ** then repeats however its threads are scheduled.
+ **/
+void seedRandomThread(unsigned int index) {
+    seedThisThreadIndex(index);
+}
+
+/** *********************************************************************
+ ** This method returns 32 random bits, xoshiro128+.
+ **/
+uint32_t randomNext() {
+    ensureSeeded();
+
+    uint32_t* s = mRandom.s;
+    const uint32_t result = s[0] + s[3];
+    const uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 11);
+
+    return result;
+}
+
+/** *********************************************************************
+ ** This method returns a uniform random in [0, 1), where
+ ** drand48() was. The low bits of xoshiro128+ are its
+ ** weakest, so only the top 24 are used.
+ **/
+double randomUniform() {
+    return (randomNext() >> 8) * (1.0 / 16777216.0);
+}
+
+/** *********************************************************************
+ ** This method fills out[0 .. n-1] with uniform randoms in
+ ** [0, 1), lane by lane so the loop vectorizes.
+ **/
+RANDOMKERNEL
+void randomFill(float* out, int n) {
+    ensureSeeded();
+
+    uint32_t s[RANDOM_LANES];
+    memcpy(s, mRandom.lanes, sizeof(s));
+
+    int i = 0;
+    for (; i + RANDOM_LANES <= n; i += RANDOM_LANES) {
+        for (int l = 0; l < RANDOM_LANES; l++) {
+            uint32_t x = s[l];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            s[l] = x;
+            out[i + l] = (x >> 8) * (1.0f / 16777216.0f);
+        }
+    }
+
+    // Tail.
+    for (int l = 0; i < n; i++, l++) {
+        uint32_t x = s[l];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        s[l] = x;
+        out[i] = (x >> 8) * (1.0f / 16777216.0f);
+    }
+
+    memcpy(mRandom.lanes, s, sizeof(s));
+}
+
+/** *********************************************************************
+ ** This method returns how many of n trials of chance p hit,
+ ** without a draw per trial once n is large. Many trials use
+ ** the normal approximation, which is close once n * p is
+ ** more than a few.
+ **/
+int randomBinomial(int n, double p) {
+    if (n <= 0 || p <= 0) {
+        return 0;
+    }
+    if (p >= 1) {
+        return n;
+    }
+
+    if (n <= RANDOM_BINOMIAL_DIRECT_TRIALS) {
+        int hits = 0;
+        for (int i = 0; i < n; i++) {
+            if (randomUniform() < p) {
+                hits++;
+            }
+        }
+        return hits;
+    }
+
+    // Box-Muller, u1 in (0, 1] keeps log() finite.
+    const double u1 = 1.0 - randomUniform();
+    const double u2 = randomUniform();
+    const double z = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+
+    const double mean = n * p;
+    const long hits = lround(mean + sqrt(mean * (1.0 - p)) * z);
+    return (hits < 0) ? 0 : (hits > n) ? n : (int) hits;
+}
@@ -0,0 +1,55 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdint.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+// Up to this many trials, randomBinomial() counts each.
+#define RANDOM_BINOMIAL_DIRECT_TRIALS 32
+
+// Fixed indexes of the threads that draw, for seedRandomThread().
+#define RANDOM_THREAD_FALLENSNOW 1
+#define RANDOM_THREAD_AURORA 2
+#define RANDOM_THREAD_BIRDS 3
+#define RANDOM_THREAD_BIRD_WORKERS 16
+#define RANDOM_THREAD_OTHERS 256
+
+
+/***********************************************************
+ * Module Method stubs.
+ *
+ * Fast per-thread random numbers, in place of drand48() and
+ * its one shared state. Each thread draws from its own
+ * xoshiro128+ generator, seeded from seedRandom() and its
+ * index from seedRandomThread(), or on its first draw.
+ */
+void seedRandom(uint64_t seed);
+void seedRandomThread(unsigned int index);
+
+uint32_t randomNext();
+double randomUniform();
+void randomFill(float* out, int n);
+int randomBinomial(int n, double p);
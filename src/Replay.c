@@ -0,0 +1,597 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Benchmark.h"
+#include "clocks.h"
+#include "ColorCodes.h"
+#include "FallenSnow.h"
+#include "Flags.h"
+#include "plasmasnow.h"
+#include "Replay.h"
+#include "safe_malloc.h"
+#include "WinInfo.h"
+
+
+/***********************************************************
+ * Module globals and consts.
+ *
+ * -record writes what comes from outside the simulation:
+ * the seed, screen size, window snapshots, workspace, wind
+ * and ui flag changes. Each is polled and only written when
+ * it differs from what was last written, so a quiet session
+ * records next to nothing. -replay reads it back as a
+ * -benchmark run, applying each record when the simulated
+ * clock reaches its time.
+ *
+ * The stream is in native byte order, for replay on the
+ * machine type it was recorded on.
+ */
+FILE* mRecordFile = NULL;
+double mRecordStart = 0;
+
+// What was last written.
+FLAGS mRecordedFlags;
+int mRecordedWidth = -1;
+int mRecordedHeight = -1;
+long mRecordedWorkspace = -1;
+int mRecordedWind = -1;
+int mRecordedDirection = 0;
+float mRecordedNewWind = 0;
+
+ReplayWindow* mRecordedWindows = NULL;
+int mRecordedWindowCount = -1;
+ReplayWindow* mRecordWindowScratch = NULL;
+int mRecordWindowCapacity = 0;
+
+// The replay, read whole.
+unsigned char* mReplayData = NULL;
+size_t mReplaySize = 0;
+size_t mReplayCursor = 0;
+uint64_t mReplaySeed = 0;
+
+
+/** *********************************************************************
+ ** These methods return if this session records or replays.
+ **/
+bool isRecordActive() {
+    return mRecordFile != NULL;
+}
+
+bool isReplayActive() {
+    return Flags.ReplayFile && Flags.ReplayFile[0];
+}
+
+/** *********************************************************************
+ ** These methods write the parts of a record.
+ **/
+static void writeRecordBytes(const void* data, size_t size) {
+    if (fwrite(data, 1, size, mRecordFile) != size) {
+        fprintf(stderr, "%splasmasnow: -record write failed, recording "
+            "stopped.%s\n", COLOR_RED, COLOR_NORMAL);
+        fclose(mRecordFile);
+        mRecordFile = NULL;
+    }
+}
+
+static void writeRecordStart(ReplayRecordType type) {
+    const uint8_t code = type;
+    const double time = wallcl() - mRecordStart;
+    writeRecordBytes(&code, sizeof(code));
+    if (mRecordFile) {
+        writeRecordBytes(&time, sizeof(time));
+    }
+}
+
+static void writeRecordString(const char* string) {
+    const uint16_t length = strlen(string);
+    writeRecordBytes(&length, sizeof(length));
+    if (mRecordFile) {
+        writeRecordBytes(string, length);
+    }
+}
+
+/** *********************************************************************
+ ** This method opens the -record file and writes its
+ ** header. The caller has seeded random with seed.
+ **/
+void startRecording(uint64_t seed) {
+    mRecordFile = fopen(Flags.RecordFile, "wb");
+    if (!mRecordFile) {
+        fprintf(stderr, "%splasmasnow: cannot open -record file %s.%s\n",
+            COLOR_RED, Flags.RecordFile, COLOR_NORMAL);
+        return;
+    }
+    mRecordStart = wallcl();
+
+    const uint32_t version = REPLAY_VERSION;
+    writeRecordBytes(REPLAY_MAGIC, strlen(REPLAY_MAGIC));
+    if (mRecordFile) {
+        writeRecordBytes(&version, sizeof(version));
+    }
+    if (mRecordFile) {
+        writeRecordBytes(&seed, sizeof(seed));
+    }
+
+    // Flags differ from these at start, so all are written
+    // on the first poll.
+    #define DOIT_I(x, d, v) mRecordedFlags.x = ~Flags.x;
+    #define DOIT_L(x, d, v) mRecordedFlags.x = ~Flags.x;
+    #define DOIT_S(x, d, v) mRecordedFlags.x = NULL;
+        DOIT
+    #include "undefall.inc"
+
+    printf("%splasmasnow: recording to %s.%s\n", COLOR_YELLOW,
+        Flags.RecordFile, COLOR_NORMAL);
+}
+
+/** *********************************************************************
+ ** This method records the ui flags that changed since the
+ ** last poll.
+ **/
+static void recordFlagChanges() {
+    #define DOIT_I(x, d, v) \
+        if (mRecordFile && Flags.x != mRecordedFlags.x) { \
+            const int64_t value = Flags.x; \
+            writeRecordStart(REPLAY_RECORD_FLAG); \
+            writeRecordString(#x); \
+            writeRecordBytes(&value, sizeof(value)); \
+            mRecordedFlags.x = Flags.x; \
+        }
+    #define DOIT_L(x, d, v) DOIT_I(x, d, v)
+    #define DOIT_S(x, d, v) \
+        if (mRecordFile && (!mRecordedFlags.x || \
+            strcmp(Flags.x, mRecordedFlags.x))) { \
+            writeRecordStart(REPLAY_RECORD_FLAG_STRING); \
+            writeRecordString(#x); \
+            writeRecordString(Flags.x); \
+            free(mRecordedFlags.x); \
+            mRecordedFlags.x = strdup(Flags.x); \
+        }
+        DOIT
+    #include "undefall.inc"
+}
+
+/** *********************************************************************
+ ** This method records the window list, when it differs
+ ** from the last one recorded.
+ **/
+static void recordWindows() {
+    const int count = mGlobal.winInfoListLength;
+    if (count > mRecordWindowCapacity) {
+        mRecordWindowCapacity = count + count / 2;
+        mRecordWindowScratch = (ReplayWindow*) realloc(
+            mRecordWindowScratch,
+            mRecordWindowCapacity * sizeof(ReplayWindow));
+        REALLOC_CHECK(mRecordWindowScratch);
+        mRecordedWindows = (ReplayWindow*) realloc(mRecordedWindows,
+            mRecordWindowCapacity * sizeof(ReplayWindow));
+        REALLOC_CHECK(mRecordedWindows);
+    }
+
+    for (int i = 0; i < count; i++) {
+        const WinInfo* winInfo = &mGlobal.winInfoList[i];
+        ReplayWindow* window = &mRecordWindowScratch[i];
+        window->window = winInfo->window;
+        window->ws = winInfo->ws;
+        window->x = winInfo->x;
+        window->y = winInfo->y;
+        window->xa = winInfo->xa;
+        window->ya = winInfo->ya;
+        window->w = winInfo->w;
+        window->h = winInfo->h;
+        window->state = winInfo->sticky | winInfo->dock << 1 |
+            winInfo->hidden << 2;
+    }
+
+    if (count == mRecordedWindowCount && !memcmp(mRecordWindowScratch,
+        mRecordedWindows, count * sizeof(ReplayWindow))) {
+        return;
+    }
+
+    const int32_t stored = count;
+    writeRecordStart(REPLAY_RECORD_WINDOWS);
+    if (mRecordFile) {
+        writeRecordBytes(&stored, sizeof(stored));
+    }
+    if (mRecordFile) {
+        writeRecordBytes(mRecordWindowScratch,
+            count * sizeof(ReplayWindow));
+    }
+
+    ReplayWindow* swap = mRecordedWindows;
+    mRecordedWindows = mRecordWindowScratch;
+    mRecordWindowScratch = swap;
+    mRecordedWindowCount = count;
+}
+
+/** *********************************************************************
+ ** This method is the -record mainloop poll: writes what
+ ** changed of the session since the last one.
+ **/
+int recordSessionState() {
+    if (Flags.shutdownRequested || !mRecordFile) {
+        return FALSE;
+    }
+
+    if (mGlobal.SnowWinWidth != mRecordedWidth ||
+        mGlobal.SnowWinHeight != mRecordedHeight) {
+        const int32_t size[2] = { mGlobal.SnowWinWidth,
+            mGlobal.SnowWinHeight };
+        writeRecordStart(REPLAY_RECORD_SCREEN);
+        if (mRecordFile) {
+            writeRecordBytes(size, sizeof(size));
+        }
+        mRecordedWidth = mGlobal.SnowWinWidth;
+        mRecordedHeight = mGlobal.SnowWinHeight;
+    }
+
+    if (mRecordFile) {
+        recordWindows();
+    }
+
+    if (mRecordFile && mGlobal.currentWorkspace != mRecordedWorkspace) {
+        const int64_t workspace = mGlobal.currentWorkspace;
+        writeRecordStart(REPLAY_RECORD_WORKSPACE);
+        if (mRecordFile) {
+            writeRecordBytes(&workspace, sizeof(workspace));
+        }
+        mRecordedWorkspace = mGlobal.currentWorkspace;
+    }
+
+    if (mRecordFile && (mGlobal.Wind != mRecordedWind ||
+        mGlobal.Direction != mRecordedDirection ||
+        mGlobal.NewWind != mRecordedNewWind)) {
+        const int32_t state[2] = { mGlobal.Wind, mGlobal.Direction };
+        const float newWind = mGlobal.NewWind;
+        writeRecordStart(REPLAY_RECORD_WIND);
+        if (mRecordFile) {
+            writeRecordBytes(state, sizeof(state));
+        }
+        if (mRecordFile) {
+            writeRecordBytes(&newWind, sizeof(newWind));
+        }
+        mRecordedWind = mGlobal.Wind;
+        mRecordedDirection = mGlobal.Direction;
+        mRecordedNewWind = mGlobal.NewWind;
+    }
+
+    if (mRecordFile) {
+        recordFlagChanges();
+    }
+    return TRUE;
+}
+
+/** *********************************************************************
+ ** This method ends the record with the session length, at
+ ** shutdown.
+ **/
+void stopRecording() {
+    if (!mRecordFile) {
+        return;
+    }
+
+    writeRecordStart(REPLAY_RECORD_END);
+    if (mRecordFile) {
+        fclose(mRecordFile);
+        mRecordFile = NULL;
+    }
+}
+
+/** *********************************************************************
+ ** These methods read the parts of a record. They fail at
+ ** the end of the data.
+ **/
+static bool readReplayBytes(void* data, size_t size) {
+    if (mReplaySize - mReplayCursor < size) {
+        return false;
+    }
+    memcpy(data, mReplayData + mReplayCursor, size);
+    mReplayCursor += size;
+    return true;
+}
+
+static bool readReplayString(char* string, size_t capacity) {
+    uint16_t length;
+    if (!readReplayBytes(&length, sizeof(length)) ||
+        length >= capacity || !readReplayBytes(string, length)) {
+        return false;
+    }
+    string[length] = '\0';
+    return true;
+}
+
+static bool readReplayStart(uint8_t* type, double* time) {
+    return readReplayBytes(type, sizeof(*type)) &&
+        readReplayBytes(time, sizeof(*time));
+}
+
+/** *********************************************************************
+ ** This method skips the body of a record, for the scan.
+ **/
+static bool skipReplayRecord(uint8_t type) {
+    char string[1024];
+    int32_t count;
+    int64_t value;
+
+    switch (type) {
+        case REPLAY_RECORD_SCREEN:
+        case REPLAY_RECORD_WIND:
+            mReplayCursor += type == REPLAY_RECORD_SCREEN ?
+                2 * sizeof(int32_t) : 2 * sizeof(int32_t) + sizeof(float);
+            return mReplayCursor <= mReplaySize;
+        case REPLAY_RECORD_WINDOWS:
+            if (!readReplayBytes(&count, sizeof(count)) || count < 0) {
+                return false;
+            }
+            mReplayCursor += (size_t) count * sizeof(ReplayWindow);
+            return mReplayCursor <= mReplaySize;
+        case REPLAY_RECORD_WORKSPACE:
+            return readReplayBytes(&value, sizeof(value));
+        case REPLAY_RECORD_FLAG:
+            return readReplayString(string, sizeof(string)) &&
+                readReplayBytes(&value, sizeof(value));
+        case REPLAY_RECORD_FLAG_STRING:
+            return readReplayString(string, sizeof(string)) &&
+                readReplayString(string, sizeof(string));
+        case REPLAY_RECORD_END:
+            return true;
+    }
+    return false;
+}
+
+/** *********************************************************************
+ ** This method reads the -replay file, and sets up the
+ ** -benchmark run replaying it: its length, its first
+ ** screen size. Returns false if it can't be read.
+ **/
+bool openReplay() {
+    FILE* file = fopen(Flags.ReplayFile, "rb");
+    if (!file) {
+        fprintf(stderr, "%splasmasnow: cannot open -replay file %s.%s\n",
+            COLOR_RED, Flags.ReplayFile, COLOR_NORMAL);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    mReplayData = (unsigned char*) malloc(size > 0 ? size : 1);
+    MALLOC_CHECK(mReplayData);
+    mReplaySize = size > 0 &&
+        fread(mReplayData, 1, size, file) == (size_t) size ? size : 0;
+    fclose(file);
+
+    char magic[sizeof(REPLAY_MAGIC)] = "";
+    uint32_t version = 0;
+    if (!readReplayBytes(magic, strlen(REPLAY_MAGIC)) ||
+        strcmp(magic, REPLAY_MAGIC) ||
+        !readReplayBytes(&version, sizeof(version)) ||
+        version != REPLAY_VERSION ||
+        !readReplayBytes(&mReplaySeed, sizeof(mReplaySeed))) {
+        fprintf(stderr, "%splasmasnow: %s is not a plasmasnow record.%s\n",
+            COLOR_RED, Flags.ReplayFile, COLOR_NORMAL);
+        closeReplay();
+        return false;
+    }
+    const size_t firstRecord = mReplayCursor;
+
+    // Scan for the length and first screen size. A record cut
+    // short by a crash replays up to its last whole record.
+    double length = 0;
+    bool hasScreen = false;
+    uint8_t type;
+    double time;
+    while (readReplayStart(&type, &time)) {
+        if (type == REPLAY_RECORD_SCREEN && !hasScreen) {
+            int32_t screenSize[2];
+            if (!readReplayBytes(screenSize, sizeof(screenSize))) {
+                break;
+            }
+            Flags.BenchmarkWidth = screenSize[0];
+            Flags.BenchmarkHeight = screenSize[1];
+            hasScreen = true;
+        } else if (!skipReplayRecord(type)) {
+            break;
+        }
+        length = time;
+    }
+    mReplayCursor = firstRecord;
+
+    Flags.Benchmark = length > 1 ? (int) (length + 0.5) : 1;
+    Flags.BenchmarkWindows = 0;
+
+    printf("%splasmasnow: replaying %s, %d seconds.%s\n", COLOR_YELLOW,
+        Flags.ReplayFile, Flags.Benchmark, COLOR_NORMAL);
+    return true;
+}
+
+uint64_t getReplaySeed() {
+    return mReplaySeed;
+}
+
+/** *********************************************************************
+ ** This method installs a recorded window list.
+ **/
+static bool replayWindows() {
+    int32_t count;
+    if (!readReplayBytes(&count, sizeof(count)) || count < 0 ||
+        mReplaySize - mReplayCursor < count * sizeof(ReplayWindow)) {
+        return false;
+    }
+
+    WinInfo* list = (WinInfo*) calloc(count > 0 ? count : 1,
+        sizeof(WinInfo));
+    MALLOC_CHECK(list);
+
+    for (int i = 0; i < count; i++) {
+        ReplayWindow window;
+        readReplayBytes(&window, sizeof(window));
+
+        WinInfo* winInfo = &list[i];
+        winInfo->window = window.window;
+        winInfo->frame = None;
+        winInfo->ws = window.ws;
+        winInfo->x = window.x;
+        winInfo->y = window.y;
+        winInfo->xa = window.xa;
+        winInfo->ya = window.ya;
+        winInfo->w = window.w;
+        winInfo->h = window.h;
+        winInfo->sticky = window.state & 1;
+        winInfo->dock = (window.state >> 1) & 1;
+        winInfo->hidden = (window.state >> 2) & 1;
+    }
+
+    lockFallenSnowSemaphore();
+    setWinInfoList(list, count);
+    doAllFallenSnowWinInfoUpdates();
+    unlockFallenSnowSemaphore();
+    return true;
+}
+
+/** *********************************************************************
+ ** This method sets a recorded ui flag, and marks its
+ ** subscribers.
+ **/
+static bool replayFlag(bool isString) {
+    char name[256];
+    char string[1024];
+    int64_t value = 0;
+    if (!readReplayString(name, sizeof(name)) || (isString ?
+        !readReplayString(string, sizeof(string)) :
+        !readReplayBytes(&value, sizeof(value)))) {
+        return false;
+    }
+
+    #define DOIT_I(x, d, v) \
+        if (!isString && !strcmp(name, #x)) { \
+            Flags.x = value; \
+            publishFlagChange(FLAG_ID_##x); \
+            return true; \
+        }
+    #define DOIT_L(x, d, v) DOIT_I(x, d, v)
+    #define DOIT_S(x, d, v) \
+        if (isString && !strcmp(name, #x)) { \
+            free(Flags.x); \
+            Flags.x = strdup(string); \
+            publishFlagChange(FLAG_ID_##x); \
+            return true; \
+        }
+        DOIT
+    #include "undefall.inc"
+
+    // A flag of another version, ignored.
+    return true;
+}
+
+/** *********************************************************************
+ ** This method is the -replay mainloop method: applies all
+ ** records due by the simulated clock.
+ **/
+int replaySessionEvents() {
+    if (Flags.shutdownRequested || !mReplayData) {
+        return FALSE;
+    }
+
+    const double now = getBenchmarkClock() - BENCHMARK_CLOCK_START;
+    bool hasFlagChanges = false;
+
+    while (true) {
+        const size_t recordStart = mReplayCursor;
+        uint8_t type;
+        double time;
+        if (!readReplayStart(&type, &time)) {
+            break;
+        }
+        if (time > now) {
+            mReplayCursor = recordStart;
+            break;
+        }
+
+        bool isRead = true;
+        switch (type) {
+            case REPLAY_RECORD_WINDOWS:
+                isRead = replayWindows();
+                break;
+
+            case REPLAY_RECORD_WORKSPACE: {
+                int64_t workspace;
+                isRead = readReplayBytes(&workspace, sizeof(workspace));
+                if (isRead) {
+                    lockFallenSnowSemaphore();
+                    mGlobal.currentWorkspace = workspace;
+                    doAllFallenSnowWinInfoUpdates();
+                    unlockFallenSnowSemaphore();
+                }
+                break;
+            }
+
+            case REPLAY_RECORD_WIND: {
+                int32_t state[2];
+                float newWind;
+                isRead = readReplayBytes(state, sizeof(state)) &&
+                    readReplayBytes(&newWind, sizeof(newWind));
+                if (isRead) {
+                    mGlobal.Wind = state[0];
+                    mGlobal.Direction = state[1];
+                    mGlobal.NewWind = newWind;
+                }
+                break;
+            }
+
+            case REPLAY_RECORD_FLAG:
+            case REPLAY_RECORD_FLAG_STRING:
+                isRead = replayFlag(type == REPLAY_RECORD_FLAG_STRING);
+                hasFlagChanges = true;
+                break;
+
+            default:
+                // The screen is set up front, and only once.
+                isRead = skipReplayRecord(type);
+                break;
+        }
+        if (!isRead) {
+            mReplayCursor = mReplaySize;
+            break;
+        }
+    }
+
+    // Benchmarks have no menu, whose poll would dispatch.
+    if (hasFlagChanges) {
+        dispatchFlagChanges();
+    }
+    return TRUE;
+}
+
+/** *********************************************************************
+ ** This method frees the replay.
+ **/
+void closeReplay() {
+    free(mReplayData);
+    mReplayData = NULL;
+    mReplaySize = 0;
+    mReplayCursor = 0;
+}
@@ -0,0 +1,77 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+// File starts with magic, version and the session seed.
+#define REPLAY_MAGIC "PSREPLAY"
+#define REPLAY_VERSION 1
+
+// How often a live session is compared against what was
+// last recorded, and how often a replay looks for the next
+// record, seconds.
+#define RECORD_POLL_TIME 0.1
+#define REPLAY_POLL_TIME 0.01
+
+// Record types, each followed by its time in seconds since
+// the session start.
+typedef enum {
+    REPLAY_RECORD_SCREEN = 1,  // width, height.
+    REPLAY_RECORD_WINDOWS,     // count, then ReplayWindow each.
+    REPLAY_RECORD_WORKSPACE,   // workspace.
+    REPLAY_RECORD_WIND,        // Wind, Direction, NewWind.
+    REPLAY_RECORD_FLAG,        // name, value.
+    REPLAY_RECORD_FLAG_STRING, // name, string.
+    REPLAY_RECORD_END          // none, time is the session length.
+} ReplayRecordType;
+
+// One window of a WinInfo snapshot, as stored.
+typedef struct _ReplayWindow {
+        uint32_t window;
+        int32_t ws;
+        int32_t x, y;
+        int32_t xa, ya;
+        uint32_t w, h;
+        uint32_t state;    // sticky 1, dock 2, hidden 4.
+} ReplayWindow;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+bool isRecordActive();
+bool isReplayActive();
+
+void startRecording(uint64_t seed);
+int recordSessionState();
+void stopRecording();
+
+bool openReplay();
+uint64_t getReplaySeed();
+int replaySessionEvents();
+void closeReplay();
@@ -31,11 +31,16 @@
 
 #include "debug.h"
 #include "Flags.h"
+#include "FrameDamage.h"
 #include "ixpm.h"
+#include "MemoryStats.h"
 #include "moon.h"
 #include "pixmaps.h"
 #include "safe_malloc.h"
 #include "Santa.h"
+#include "SpriteCache.h"
+#include "StartupTasks.h"
+#include "ThreadPolicy.h"
 #include "Utils.h"
 #include "wind.h"
 #include "windows.h"
@@ -48,7 +53,7 @@ int CurrentSanta;
 Pixmap SantaMaskPixmap[PIXINANIMATION];
 Pixmap SantaPixmap[PIXINANIMATION];
 
-Region SantaRegion = 0;
+cairo_rectangle_int_t SantaRect = {0, 0, 0, 0};
 
 float SantaSpeed;
 float SantaXr;
@@ -62,8 +67,33 @@ int OldSantaY = 0;
 
 int MoonSeeking = 1;
 
-static cairo_surface_t* Santa_surfaces
-    [MAXSANTA + 1][2][2][PIXINANIMATION];
+// Scaled Santa frames: size, Rudolf, frame. All face right,
+// Santa_draw() mirrors them for direction 1.
+typedef struct _SantaSurfaceSet {
+        cairo_surface_t* surfaces
+            [MAXSANTA + 1][2][PIXINANIMATION];
+        bool isCustomSanta;
+} SantaSurfaceSet;
+
+// Scales a surface set is built for.
+typedef struct _SantaSurfaceJob {
+        double scale;
+        double santaScale;
+} SantaSurfaceJob;
+
+// Set in use, main thread only.
+static SantaSurfaceSet* mSantaSurfaces = NULL;
+
+// Background preparation, guarded by mSantaJobMutex.
+static pthread_mutex_t mSantaJobMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mSantaJobCondition = PTHREAD_COND_INITIALIZER;
+static pthread_t mSantaJobThread;
+static bool mSantaJobThreadStarted = false;
+
+static SantaSurfaceJob mSantaJob;
+static unsigned int mSantaJobSerial = 0;
+static unsigned int mSantaJobDoneSerial = 0;
+static SantaSurfaceSet* mSantaReadySurfaces = NULL;
 
 // Speed for each Santa  in pixels/second.
 static float Speed[] = {
@@ -80,12 +110,11 @@ void Santa_ui() {
     UIDO(Rudolf, SetSantaSizeSpeed(););
     UIDO(NoSanta, );
     UIDO(SantaSpeedFactor, SetSantaSizeSpeed(););
-    UIDO(SantaScale, init_Santa_surfaces(); SetSantaSizeSpeed(););
+    UIDO(SantaScale, requestSantaSurfaces(););
 
     static int prev = 100;
     if (appScalesHaveChanged(&prev)) {
-        init_Santa_surfaces();
-        SetSantaSizeSpeed();
+        requestSantaSurfaces();
     }
 }
 
@@ -97,13 +126,29 @@ int Santa_draw(cairo_t *cr) {
         return TRUE;
     }
 
+    if (!mSantaSurfaces) {
+        return TRUE;
+    }
+
     cairo_surface_t *surface;
-    surface = Santa_surfaces[Flags.SantaSize][Flags.Rudolf]
-                            [mGlobal.SantaDirection][CurrentSanta];
-    cairo_set_source_surface(cr, surface, mGlobal.SantaX, mGlobal.SantaY);
-    my_cairo_paint_with_alpha(cr, ALPHA);
+    surface = mSantaSurfaces->surfaces[Flags.SantaSize][Flags.Rudolf]
+                                      [CurrentSanta];
+    if (mGlobal.SantaDirection == 0) {
+        cairo_set_source_surface(cr, surface, mGlobal.SantaX, mGlobal.SantaY);
+        my_cairo_paint_with_alpha(cr, ALPHA);
+    } else {
+        cairo_save(cr);
+        cairo_translate(cr, mGlobal.SantaX +
+            cairo_image_surface_get_width(surface), mGlobal.SantaY);
+        cairo_scale(cr, -1, 1);
+        cairo_set_source_surface(cr, surface, 0, 0);
+        my_cairo_paint_with_alpha(cr, ALPHA);
+        cairo_restore(cr);
+    }
     OldSantaX = mGlobal.SantaX;
     OldSantaY = mGlobal.SantaY;
+    addDrawnDamage(OldSantaX, OldSantaY,
+        mGlobal.SantaWidth + 1, mGlobal.SantaHeight);
     return TRUE;
 }
 
@@ -127,20 +172,12 @@ void Santa_init() {
         SantaMaskPixmap[i] = 0;
     }
 
-    for (int i = 0; i < MAXSANTA + 1; i++) {
-        for (int j = 0; j < 2; j++) {
-            for (int k = 0; k < PIXINANIMATION; k++) {
-                Santa_surfaces[i][j][0][k] = NULL;
-                Santa_surfaces[i][j][1][k] = NULL;
-            }
-        }
-    }
-
-    SantaRegion = XCreateRegion();
-    mGlobal.SantaPlowRegion = XCreateRegion();
-
-    init_Santa_surfaces();
-    SetSantaSizeSpeed();
+    // First set comes from the startup pool, later ones from
+    // the Santa thread. Santa shows once his set is in.
+    static SantaSurfaceJob job;
+    getSantaSurfaceJob(&job);
+    addStartupTask(buildStartupSantaSurfaces,
+        installStartupSantaSurfaces, &job);
 
     if (drand48() > 0.5) {
         mGlobal.SantaDirection = 0;
@@ -149,59 +186,84 @@ void Santa_init() {
     }
 
     ResetSanta();
-    addMethodToMainloop(PRIORITY_HIGH, time_usanta, do_usanta);
+    addSimulationMethodToMainloop(PRIORITY_HIGH, time_usanta, do_usanta);
 }
 
 /** *********************************************************************
- ** This method ...
+ ** This method captures the scales a Santa set is built for.
+ **/
+void getSantaSurfaceJob(SantaSurfaceJob* job) {
+    job->scale = 0.01 * Flags.Scale * LocalScale * mGlobal.WindowScale;
+    job->santaScale = 0.01 * Flags.SantaScale;
+}
+
+/** *********************************************************************
+ ** This method creates a Santa surface from a pixbuf, scaled.
+ **/
+cairo_surface_t* createSantaSurface(GdkPixbuf* pixbuf, int w, int h) {
+    if (w < 1) {
+        w = 1;
+    }
+    if (h < 1) {
+        h = 1;
+    }
+    if (w == 1 && h == 1) {
+        h = 2;
+    }
+
+    GdkPixbuf* pixbufscaled = gdk_pixbuf_scale_simple(
+        pixbuf, w, h, GDK_INTERP_HYPER);
+
+    cairo_surface_t* surface = trackSurface(MEMORY_SPRITES,
+        gdk_cairo_surface_create_from_pixbuf(pixbufscaled, 0, NULL));
+    g_clear_object(&pixbufscaled);
+    return surface;
+}
+
+/** *********************************************************************
+ ** This method creates a Santa frame, from the sprite cache
+ ** when an earlier run left it there.
+ **/
+cairo_surface_t* createSantaSurfaceFromXpm(const char** xpm,
+    int w, int h) {
+
+    uint64_t key = 0;
+    if (isSpriteCacheActive()) {
+        key = getSpriteCacheKey(hashSpriteXpm(xpm), w, h, 0, "");
+        cairo_surface_t* surface = loadCachedSprite(key);
+        if (surface) {
+            return surface;
+        }
+    }
+
+    GdkPixbuf* pixbuf = gdk_pixbuf_new_from_xpm_data(xpm);
+    cairo_surface_t* surface = createSantaSurface(pixbuf, w, h);
+    g_clear_object(&pixbuf);
+
+    storeCachedSprite(key, surface);
+    return surface;
+}
+
+/** *********************************************************************
+ ** This method decodes and scales every Santa frame into
+ ** a new set. Touches no shared state, so it runs on any
+ ** thread.
  **/
-void init_Santa_surfaces() {
+SantaSurfaceSet* createSantaSurfaceSet(const SantaSurfaceJob* job) {
+    SantaSurfaceSet* set = (SantaSurfaceSet*)
+        calloc(1, sizeof(SantaSurfaceSet));
+    MALLOC_CHECK(set);
 
     for (int i = 0; i < MAXSANTA + 1; i++) {
         for (int j = 0; j < 2; j++) {
             for (int k = 0; k < PIXINANIMATION; k++) {
-
                 int w, h;
                 sscanf(Santas[i][j][k][0], "%d %d", &w, &h);
-                w *= 0.01 * Flags.Scale * LocalScale * mGlobal.WindowScale *
-                     0.01 * Flags.SantaScale;
-                h *= 0.01 * Flags.Scale * LocalScale * mGlobal.WindowScale *
-                     0.01 * Flags.SantaScale;
-
-                if (w < 1) {
-                    w = 1;
-                }
-                if (h < 1) {
-                    h = 1;
-                }
-                if (w == 1 && h == 1) {
-                    h = 2;
-                }
-
-                GdkPixbuf* pixbuf = gdk_pixbuf_new_from_xpm_data(
-                    (const char**) Santas[i][j][k]);
-
-                GdkPixbuf* pixbufscaled0 = gdk_pixbuf_scale_simple(
-                    pixbuf, w, h, GDK_INTERP_HYPER);
-                g_clear_object(&pixbuf);
-
-                GdkPixbuf* pixbufscaled1 =
-                    gdk_pixbuf_flip(pixbufscaled0, TRUE);
-
-                if (Santa_surfaces[i][j][0][k]) {
-                    cairo_surface_destroy(Santa_surfaces[i][j][0][k]);
-                    cairo_surface_destroy(Santa_surfaces[i][j][1][k]);
-                }
-
-                Santa_surfaces[i][j][0][k] =
-                    gdk_cairo_surface_create_from_pixbuf(
-                        pixbufscaled0, 0, NULL);
-                g_clear_object(&pixbufscaled0);
-
-                Santa_surfaces[i][j][1][k] =
-                    gdk_cairo_surface_create_from_pixbuf(
-                        pixbufscaled1, 0, NULL);
-                g_clear_object(&pixbufscaled1);
+                w *= job->scale * job->santaScale;
+                h *= job->scale * job->santaScale;
+
+                set->surfaces[i][j][k] = createSantaSurfaceFromXpm(
+                    (const char**) Santas[i][j][k], w, h);
             }
         }
     }
@@ -214,69 +276,163 @@ void init_Santa_surfaces() {
         "plasmasnow/pixmaps/santa4.xpm",
     };
 
-    for (int  i = 0; i < PIXINANIMATION; i++) {
+    for (int i = 0; i < PIXINANIMATION; i++) {
         path[i] = NULL;
         FILE* file = HomeOpen(filenames[i], "r", &path[i]);
         if (!file) {
-            if (path[i]) {
-                free(path[i]);
+            for (int j = 0; j <= i; j++) {
+                free(path[j]);
             }
-            setSantaRegions();
-            return;
+            return set;
         }
 
         fclose(file);
     }
 
-    int rc, i;
-    char **santaxpm;
-
-    for (i = 0; i < PIXINANIMATION; i++) {
-        rc = XpmReadFileToData(path[i], &santaxpm);
+    for (int i = 0; i < PIXINANIMATION; i++) {
+        char** santaxpm;
+        XpmReadFileToData(path[i], &santaxpm);
+        free(path[i]);
 
         int w, h;
         sscanf(santaxpm[0], "%d %d", &w, &h);
-        w *= 0.01 * Flags.Scale * LocalScale * mGlobal.WindowScale;
-        h *= 0.01 * Flags.Scale * LocalScale * mGlobal.WindowScale;
+        w *= job->scale;
+        h *= job->scale;
 
-        if (w < 1) {
-            w = 1;
-        }
-        if (h < 1) {
-            h = 1;
-        }
-        if (w == 1 && h == 1) {
-            h = 2;
+        cairo_surface_destroy(set->surfaces[0][0][i]);
+        set->surfaces[0][0][i] = createSantaSurfaceFromXpm(
+            (const char**) santaxpm, w, h);
+        XpmFree(santaxpm);
+    }
+
+    set->isCustomSanta = true;
+    return set;
+}
+
+/** *********************************************************************
+ ** This method frees a Santa surface set.
+ **/
+void destroySantaSurfaceSet(SantaSurfaceSet* set) {
+    if (!set) {
+        return;
+    }
+
+    for (int i = 0; i < MAXSANTA + 1; i++) {
+        for (int j = 0; j < 2; j++) {
+            for (int k = 0; k < PIXINANIMATION; k++) {
+                cairo_surface_destroy(set->surfaces[i][j][k]);
+            }
         }
+    }
+    free(set);
+}
 
-        GdkPixbuf* pixbuf = gdk_pixbuf_new_from_xpm_data(
-            (const char**) santaxpm);
-        XpmFree(santaxpm);
+/** *********************************************************************
+ ** This method makes a finished set the one drawn, and
+ ** resizes Santa and his regions to it. Main thread only.
+ **/
+void installSantaSurfaces(SantaSurfaceSet* set) {
+    destroySantaSurfaceSet(mSantaSurfaces);
+    mSantaSurfaces = set;
+
+    if (set->isCustomSanta) {
+        Flags.SantaSize = 0;
+        Flags.Rudolf = 0;
+        publishFlagChange(FLAG_ID_SantaSize);
+        publishFlagChange(FLAG_ID_Rudolf);
+    }
+    SetSantaSizeSpeed();
+}
 
-        GdkPixbuf* pixbufscaled0 =
-            gdk_pixbuf_scale_simple(pixbuf, w, h, GDK_INTERP_HYPER);
-        g_clear_object(&pixbuf);
+/** *********************************************************************
+ ** These methods build the first Santa set on the startup
+ ** pool. A set the Santa thread published meanwhile is newer,
+ ** and wins.
+ **/
+void* buildStartupSantaSurfaces(void* arg) {
+    return createSantaSurfaceSet((const SantaSurfaceJob*) arg);
+}
 
-        GdkPixbuf* pixbufscaled1 = gdk_pixbuf_flip(pixbufscaled0, TRUE);
+void installStartupSantaSurfaces(void* result, void* arg) {
+    (void) arg;
+    SantaSurfaceSet* set = (SantaSurfaceSet*) result;
 
-        cairo_surface_destroy(Santa_surfaces[0][0][0][i]);
-        cairo_surface_destroy(Santa_surfaces[0][0][1][i]);
+    if (mSantaSurfaces) {
+        destroySantaSurfaceSet(set);
+        return;
+    }
+    installSantaSurfaces(set);
+}
 
-        Santa_surfaces[0][0][0][i] = gdk_cairo_surface_create_from_pixbuf(
-            pixbufscaled0, 0, NULL);
-        Santa_surfaces[0][0][1][i] = gdk_cairo_surface_create_from_pixbuf(
-            pixbufscaled1, 0, NULL);
+/** *********************************************************************
+ ** This method queues a rebuild of the Santa surfaces for
+ ** the current scales. The set in use stays drawn until the
+ ** new one is published.
+ **/
+void requestSantaSurfaces() {
+    pthread_mutex_lock(&mSantaJobMutex);
 
-        g_clear_object(&pixbufscaled0);
-        g_clear_object(&pixbufscaled1);
+    getSantaSurfaceJob(&mSantaJob);
+    mSantaJobSerial++;
 
-        free(path[i]);
+    if (!mSantaJobThreadStarted) {
+        mSantaJobThreadStarted = true;
+        pthread_create(&mSantaJobThread, NULL,
+            execSantaSurfaceThread, NULL);
+        pthread_detach(mSantaJobThread);
     }
+    pthread_cond_signal(&mSantaJobCondition);
 
-    Flags.SantaSize = 0;
-    Flags.Rudolf = 0;
+    pthread_mutex_unlock(&mSantaJobMutex);
+}
 
-    setSantaRegions();
+/** *********************************************************************
+ ** This method is the Santa surface background thread
+ ** looper. Only the set for the latest request is kept.
+ **/
+void* execSantaSurfaceThread() {
+    registerPolicyThread("ps-santa", -1, false);
+    pthread_mutex_lock(&mSantaJobMutex);
+
+    while (!Flags.shutdownRequested) {
+        if (mSantaJobDoneSerial == mSantaJobSerial) {
+            pthread_cond_wait(&mSantaJobCondition, &mSantaJobMutex);
+            continue;
+        }
+
+        const SantaSurfaceJob job = mSantaJob;
+        const unsigned int serial = mSantaJobSerial;
+        pthread_mutex_unlock(&mSantaJobMutex);
+
+        SantaSurfaceSet* set = createSantaSurfaceSet(&job);
+
+        pthread_mutex_lock(&mSantaJobMutex);
+        mSantaJobDoneSerial = serial;
+        if (serial == mSantaJobSerial) {
+            destroySantaSurfaceSet(mSantaReadySurfaces);
+            mSantaReadySurfaces = set;
+        } else {
+            destroySantaSurfaceSet(set);
+        }
+    }
+
+    pthread_mutex_unlock(&mSantaJobMutex);
+    return NULL;
+}
+
+/** *********************************************************************
+ ** This method installs a set finished in background,
+ ** if any. Main thread only.
+ **/
+void publishSantaSurfaces() {
+    pthread_mutex_lock(&mSantaJobMutex);
+    SantaSurfaceSet* set = mSantaReadySurfaces;
+    mSantaReadySurfaces = NULL;
+    pthread_mutex_unlock(&mSantaJobMutex);
+
+    if (set) {
+        installSantaSurfaces(set);
+    }
 }
 
 /** *********************************************************************
@@ -290,10 +446,13 @@ void SetSantaSizeSpeed() {
         SantaSpeed = 0.01 * Flags.SantaSpeedFactor * SantaSpeed;
     }
     mGlobal.ActualSantaSpeed = SantaSpeed;
-    // init_Santa_surfaces();
+    if (!mSantaSurfaces) {
+        return;
+    }
+
     cairo_surface_t *surface =
-        Santa_surfaces[Flags.SantaSize][Flags.Rudolf][mGlobal.SantaDirection]
-                      [CurrentSanta];
+        mSantaSurfaces->surfaces[Flags.SantaSize][Flags.Rudolf]
+                                [CurrentSanta];
     mGlobal.SantaWidth = cairo_image_surface_get_width(surface);
     mGlobal.SantaHeight = cairo_image_surface_get_height(surface);
     setSantaRegions();
@@ -307,6 +466,7 @@ int do_usanta() {
     if (Flags.shutdownRequested) {
         return FALSE;
     }
+    publishSantaSurfaces();
 
 #define RETURN \
     do { \
@@ -424,9 +584,10 @@ int do_usanta() {
     }
     mGlobal.SantaY = lrintf(SantaYr);
 
-    XOffsetRegion(SantaRegion, mGlobal.SantaX - oldx, mGlobal.SantaY - oldy);
-    XOffsetRegion(mGlobal.SantaPlowRegion, mGlobal.SantaX - oldx,
-        mGlobal.SantaY - oldy);
+    SantaRect.x += mGlobal.SantaX - oldx;
+    SantaRect.y += mGlobal.SantaY - oldy;
+    mGlobal.SantaPlowRect.x += mGlobal.SantaX - oldx;
+    mGlobal.SantaPlowRect.y += mGlobal.SantaY - oldy;
 
     RETURN;
 }
@@ -488,44 +649,18 @@ void SantaVisible() {
 }
 
 /** *********************************************************************
- ** This method ...
+ ** This method sets Santa's rectangle, and the one column
+ ** plow rectangle in front of the sled.
  **/
 void setSantaRegions() {
-    if (SantaRegion) {
-        XDestroyRegion(SantaRegion);
-    }
-
-    SantaRegion = RegionCreateRectangle(
-        mGlobal.SantaX, mGlobal.SantaY, mGlobal.SantaWidth, mGlobal.SantaHeight);
-
-    if (mGlobal.SantaPlowRegion) {
-        XDestroyRegion(mGlobal.SantaPlowRegion);
-    }
-
-    if (mGlobal.SantaDirection == 0) {
-        mGlobal.SantaPlowRegion =
-            RegionCreateRectangle(mGlobal.SantaX + mGlobal.SantaWidth,
-                mGlobal.SantaY, 1, mGlobal.SantaHeight);
-    } else {
-        mGlobal.SantaPlowRegion = RegionCreateRectangle(
-            mGlobal.SantaX - 1, mGlobal.SantaY, 1, mGlobal.SantaHeight);
-    }
-}
+    SantaRect = (cairo_rectangle_int_t) {
+        mGlobal.SantaX, mGlobal.SantaY,
+        mGlobal.SantaWidth, mGlobal.SantaHeight
+    };
 
-/** *********************************************************************
- ** This method ...
- **/
-Region RegionCreateRectangle(int x, int y, int w, int h) {
-    XPoint p[5];
-    p[0].x = x;
-    p[0].y = y;
-    p[1].x = x + w;
-    p[1].y = y;
-    p[2].x = x + w;
-    p[2].y = y + h;
-    p[3].x = x;
-    p[3].y = y + h;
-    p[4].x = x;
-    p[4].y = y;
-    return XPolygonRegion(p, 5, EvenOddRule);
+    mGlobal.SantaPlowRect = (cairo_rectangle_int_t) {
+        (mGlobal.SantaDirection == 0) ?
+            mGlobal.SantaX + mGlobal.SantaWidth : mGlobal.SantaX - 1,
+        mGlobal.SantaY, 1, mGlobal.SantaHeight
+    };
 }
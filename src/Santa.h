@@ -30,9 +30,23 @@ extern void Santa_ui(void);
 extern void SantaVisible(void);
 static int do_usanta();
 
-static void init_Santa_surfaces(void);
-static Region RegionCreateRectangle(
-    int x, int y, int w, int h);
+typedef struct _SantaSurfaceSet SantaSurfaceSet;
+typedef struct _SantaSurfaceJob SantaSurfaceJob;
+
+static void getSantaSurfaceJob(SantaSurfaceJob* job);
+static cairo_surface_t* createSantaSurface(GdkPixbuf* pixbuf,
+    int w, int h);
+static cairo_surface_t* createSantaSurfaceFromXpm(const char** xpm,
+    int w, int h);
+static SantaSurfaceSet* createSantaSurfaceSet(
+    const SantaSurfaceJob* job);
+static void destroySantaSurfaceSet(SantaSurfaceSet* set);
+static void installSantaSurfaces(SantaSurfaceSet* set);
+static void* buildStartupSantaSurfaces(void* arg);
+static void installStartupSantaSurfaces(void* result, void* arg);
+static void requestSantaSurfaces(void);
+static void* execSantaSurfaceThread();
+static void publishSantaSurfaces(void);
 static void ResetSanta(void);
 static void SetSantaSizeSpeed(void);
 static void setSantaRegions(void);
\ No newline at end of file
@@ -0,0 +1,544 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "safe_malloc.h"
+#include "Scheduler.h"
+#include "Utils.h"
+#include "XTraffic.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+
+// A periodic task. Wheel slots hold tasks by the first tick
+// they may run at; the wakeup is set by the earliest due.
+typedef struct _SchedulerTask {
+        struct _SchedulerSlot* slot;   // NULL off the wheel.
+        struct _SchedulerTask* prev;   // wheel slot or batch.
+        struct _SchedulerTask* next;
+        struct _SchedulerTask* nextTask;   // all tasks.
+
+        guint id;
+        gint priority;
+        GSourceFunc func;
+        gpointer data;
+        const char* name;
+        int xtrafficSlot;   // X traffic is charged by name.
+
+        uint64_t intervalTicks;
+        uint64_t slackTicks;
+        uint64_t dueTick;
+
+        bool isInWheel;
+        bool isCancelled;
+        bool isSuspendable;   // parked while suspended.
+        bool isParked;
+
+        // Budget accounting.
+        long runCount;
+        long overBudgetCount;
+        double totalMs;
+        double worstMs;
+} SchedulerTask;
+
+typedef struct _SchedulerSlot {
+        SchedulerTask* first;
+} SchedulerSlot;
+
+// One wakeup source per priority class, high priority tasks
+// at PRIORITY_HIGH, the rest at PRIORITY_DEFAULT, so those
+// stay below GTK redraw and input. Due tasks wait in their
+// class until its source runs.
+typedef struct _SchedulerSource {
+        GSource source;
+        int taskClass;
+} SchedulerSource;
+
+static SchedulerSlot mWheel[SCHEDULER_WHEEL_LEVELS][SCHEDULER_WHEEL_SLOTS];
+static uint64_t mWheelTick = 0;
+static gint64 mEpochUs = 0;
+
+static SchedulerTask* mTasks = NULL;
+static guint mNextTaskId = 1;
+static bool mIsSuspended = false;
+
+static GSource* mSchedulerSources[SCHEDULER_CLASS_COUNT];
+static SchedulerTask* mPendingTasks[SCHEDULER_CLASS_COUNT];
+static long mWakeupCount = 0;
+static unsigned long mWakeupTotal = 0;
+static gint64 mWakeupCountSinceUs = 0;
+
+static ObjectPool mTaskPool = OBJECT_POOL_INIT(SchedulerTask,
+    32, MEMORY_SCRATCH);
+
+
+/** *********************************************************************
+ ** Helpers, clock in ticks since the scheduler started.
+ **/
+static uint64_t getSchedulerTick() {
+    return (g_get_monotonic_time() - mEpochUs) / SCHEDULER_TICK_US;
+}
+
+static int getTaskClass(const SchedulerTask* task) {
+    return task->priority <= PRIORITY_HIGH ? 0 : 1;
+}
+
+static uint64_t getEarliestTick(const SchedulerTask* task) {
+    return task->dueTick - task->slackTicks;
+}
+
+static void unlinkTask(SchedulerTask** first, SchedulerTask* task) {
+    if (task->prev) {
+        task->prev->next = task->next;
+    } else {
+        *first = task->next;
+    }
+    if (task->next) {
+        task->next->prev = task->prev;
+    }
+    task->prev = task->next = NULL;
+}
+
+static void linkTask(SchedulerTask** first, SchedulerTask* task) {
+    task->prev = NULL;
+    task->next = *first;
+    if (*first) {
+        (*first)->prev = task;
+    }
+    *first = task;
+}
+
+/** *********************************************************************
+ ** This method files a task in the wheel by its earliest
+ ** tick, but no sooner than minTick, at the finest level
+ ** whose span still holds it.
+ **/
+static void fileTask(SchedulerTask* task, uint64_t minTick) {
+    uint64_t earliest = getEarliestTick(task);
+    if (earliest < minTick) {
+        earliest = minTick;
+    }
+
+    // Past the last level, park a full turn out and refile.
+    const uint64_t span = (uint64_t) 1 <<
+        (SCHEDULER_WHEEL_LEVELS * SCHEDULER_WHEEL_BITS);
+    if (earliest - mWheelTick >= span) {
+        earliest = mWheelTick + span - 1;
+    }
+
+    int level = 0;
+    while (level < SCHEDULER_WHEEL_LEVELS - 1 && earliest - mWheelTick >=
+        (uint64_t) 1 << ((level + 1) * SCHEDULER_WHEEL_BITS)) {
+        level++;
+    }
+    SchedulerSlot* slot = &mWheel[level][(earliest >>
+        (level * SCHEDULER_WHEEL_BITS)) & (SCHEDULER_WHEEL_SLOTS - 1)];
+
+    linkTask(&slot->first, task);
+    task->slot = slot;
+    task->isInWheel = true;
+}
+
+/** *********************************************************************
+ ** This method takes a task out of its wheel slot.
+ **/
+static void removeFromWheel(SchedulerTask* task) {
+    unlinkTask(&task->slot->first, task);
+    task->slot = NULL;
+    task->isInWheel = false;
+}
+
+/** *********************************************************************
+ ** This method files a task after the tick being walked.
+ **/
+static void insertTask(SchedulerTask* task) {
+    fileTask(task, mWheelTick + 1);
+}
+
+/** *********************************************************************
+ ** This method sets each class wakeup to its earliest due
+ ** task, or to now while tasks of it wait.
+ **/
+static void armSchedulerSources() {
+    uint64_t nextTick[SCHEDULER_CLASS_COUNT];
+    for (int taskClass = 0; taskClass < SCHEDULER_CLASS_COUNT;
+        taskClass++) {
+        nextTick[taskClass] = UINT64_MAX;
+    }
+    for (SchedulerTask* task = mTasks; task; task = task->nextTask) {
+        const int taskClass = getTaskClass(task);
+        if (task->isInWheel && task->dueTick < nextTick[taskClass]) {
+            nextTick[taskClass] = task->dueTick;
+        }
+    }
+
+    for (int taskClass = 0; taskClass < SCHEDULER_CLASS_COUNT;
+        taskClass++) {
+        gint64 readyUs = -1;
+        if (mPendingTasks[taskClass]) {
+            readyUs = 0;
+        } else if (nextTick[taskClass] != UINT64_MAX) {
+            readyUs = mEpochUs +
+                (gint64) nextTick[taskClass] * SCHEDULER_TICK_US;
+        }
+        g_source_set_ready_time(mSchedulerSources[taskClass], readyUs);
+    }
+}
+
+/** *********************************************************************
+ ** This method walks the wheel up to now, refiling coarse
+ ** slots as their turn comes, and moves tasks that may run
+ ** into a batch.
+ **/
+static void collectDueTasks(uint64_t nowTick, SchedulerTask** batch) {
+    while (mWheelTick < nowTick) {
+        mWheelTick++;
+
+        for (int level = SCHEDULER_WHEEL_LEVELS - 1; level > 0; level--) {
+            const int shift = level * SCHEDULER_WHEEL_BITS;
+            if (mWheelTick & (((uint64_t) 1 << shift) - 1)) {
+                continue;
+            }
+            SchedulerSlot* slot = &mWheel[level]
+                [(mWheelTick >> shift) & (SCHEDULER_WHEEL_SLOTS - 1)];
+            SchedulerTask* task = slot->first;
+            slot->first = NULL;
+            while (task) {
+                SchedulerTask* next = task->next;
+                task->prev = task->next = NULL;
+                task->slot = NULL;
+                fileTask(task, mWheelTick);
+                task = next;
+            }
+        }
+
+        SchedulerSlot* slot =
+            &mWheel[0][mWheelTick & (SCHEDULER_WHEEL_SLOTS - 1)];
+        SchedulerTask* task = slot->first;
+        slot->first = NULL;
+        while (task) {
+            SchedulerTask* next = task->next;
+            task->prev = task->next = NULL;
+            task->slot = NULL;
+            task->isInWheel = false;
+            linkTask(batch, task);
+            task = next;
+        }
+    }
+}
+
+/** *********************************************************************
+ ** This method frees a task, off every list.
+ **/
+static void freeTask(SchedulerTask* task) {
+    for (SchedulerTask** link = &mTasks; *link;
+        link = &(*link)->nextTask) {
+        if (*link == task) {
+            *link = task->nextTask;
+            break;
+        }
+    }
+    object_pool_give(&mTaskPool, task);
+}
+
+/** *********************************************************************
+ ** This method runs one task and files it for its next turn,
+ ** keeping its phase unless it fell a whole interval behind.
+ **/
+static void runTask(SchedulerTask* task, uint64_t nowTick) {
+    const gint64 startUs = g_get_monotonic_time();
+    const int outerSlot = beginXTraffic(task->xtrafficSlot);
+    const gboolean keep = task->func(task->data);
+    endXTraffic(outerSlot);
+    const double elapsedMs = (g_get_monotonic_time() - startUs) / 1000.0;
+
+    task->runCount++;
+    task->totalMs += elapsedMs;
+    if (elapsedMs > task->worstMs) {
+        task->worstMs = elapsedMs;
+    }
+    if (elapsedMs > SCHEDULER_TASK_BUDGET_MS) {
+        task->overBudgetCount++;
+    }
+
+    if (!keep || task->isCancelled) {
+        freeTask(task);
+        return;
+    }
+
+    task->dueTick += task->intervalTicks;
+    if (task->dueTick <= nowTick) {
+        task->dueTick = nowTick + task->intervalTicks;
+    }
+    if (mIsSuspended && task->isSuspendable) {
+        task->isParked = true;
+        return;
+    }
+    insertTask(task);
+}
+
+/** *********************************************************************
+ ** This method is a class wakeup: hands due tasks to their
+ ** class, and runs those of its own.
+ **/
+static gboolean dispatchScheduler(GSource* source,
+    GSourceFunc callback, gpointer data) {
+    mWakeupCount++;
+    mWakeupTotal++;
+
+    const uint64_t nowTick = getSchedulerTick();
+    SchedulerTask* batch = NULL;
+    collectDueTasks(nowTick, &batch);
+    while (batch) {
+        SchedulerTask* task = batch;
+        unlinkTask(&batch, task);
+        linkTask(&mPendingTasks[getTaskClass(task)], task);
+    }
+
+    const int taskClass = ((SchedulerSource*) source)->taskClass;
+    SchedulerTask* task = mPendingTasks[taskClass];
+    mPendingTasks[taskClass] = NULL;
+    while (task) {
+        SchedulerTask* next = task->next;
+        task->prev = task->next = NULL;
+        if (task->isCancelled) {
+            freeTask(task);
+        } else if (mIsSuspended && task->isSuspendable) {
+            task->isParked = true;
+        } else {
+            runTask(task, nowTick);
+        }
+        task = next;
+    }
+
+    armSchedulerSources();
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs mSchedulerSourceFuncs = {
+    NULL, NULL, dispatchScheduler, NULL, NULL, NULL
+};
+
+/** *********************************************************************
+ ** This method adds a periodic task. Like g_timeout_add, it
+ ** repeats while func returns TRUE. Main thread only.
+ **/
+guint addSchedulerTask(gint priority, float time,
+    GSourceFunc func, gpointer data, const char* name,
+    bool isSuspendable) {
+    if (!mSchedulerSources[0]) {
+        mEpochUs = g_get_monotonic_time();
+        mWakeupCountSinceUs = mEpochUs;
+        const gint priorities[SCHEDULER_CLASS_COUNT] = {
+            PRIORITY_HIGH, PRIORITY_DEFAULT
+        };
+        for (int taskClass = 0; taskClass < SCHEDULER_CLASS_COUNT;
+            taskClass++) {
+            GSource* source = g_source_new(&mSchedulerSourceFuncs,
+                sizeof(SchedulerSource));
+            ((SchedulerSource*) source)->taskClass = taskClass;
+            g_source_set_priority(source, priorities[taskClass]);
+            g_source_attach(source, NULL);
+            mSchedulerSources[taskClass] = source;
+        }
+    }
+
+    SchedulerTask* task = (SchedulerTask*) object_pool_take(&mTaskPool);
+    MALLOC_CHECK(task);
+    memset(task, 0, sizeof(SchedulerTask));
+
+    task->id = mNextTaskId++;
+    task->priority = priority;
+    task->func = func;
+    task->data = data;
+    task->name = name;
+    task->xtrafficSlot = getXTrafficSlot(name);
+
+    const double intervalUs = time * 1.0e6;
+    task->intervalTicks = (uint64_t) (intervalUs / SCHEDULER_TICK_US + 0.5);
+    if (task->intervalTicks < 1) {
+        task->intervalTicks = 1;
+    }
+    double slackUs = intervalUs * SCHEDULER_SLACK_FRACTION;
+    if (slackUs > SCHEDULER_SLACK_MAX_US) {
+        slackUs = SCHEDULER_SLACK_MAX_US;
+    }
+    task->slackTicks = (uint64_t) (slackUs / SCHEDULER_TICK_US);
+    if (task->slackTicks >= task->intervalTicks) {
+        task->slackTicks = task->intervalTicks - 1;
+    }
+
+    const uint64_t nowTick = getSchedulerTick();
+    task->dueTick = nowTick + task->intervalTicks;
+
+    task->isSuspendable = isSuspendable;
+
+    task->nextTask = mTasks;
+    mTasks = task;
+    if (mIsSuspended && isSuspendable) {
+        task->isParked = true;
+        return task->id;
+    }
+    insertTask(task);
+    armSchedulerSources();
+
+    return task->id;
+}
+
+/** *********************************************************************
+ ** This method removes a task, also from inside a run.
+ **/
+void removeSchedulerTask(guint id) {
+    for (SchedulerTask* task = mTasks; task; task = task->nextTask) {
+        if (task->id != id || task->isCancelled) {
+            continue;
+        }
+
+        task->isCancelled = true;
+        if (task->isParked) {
+            freeTask(task);
+        } else if (task->isInWheel) {
+            removeFromWheel(task);
+            freeTask(task);
+            armSchedulerSources();
+        }
+        // Else running or batched, freed when its turn comes.
+        return;
+    }
+}
+
+/** *********************************************************************
+ ** This method parks every suspendable task, out of the
+ ** wheel, so nothing of the simulation wakes the process.
+ **/
+void suspendSchedulerTasks() {
+    if (mIsSuspended) {
+        return;
+    }
+    mIsSuspended = true;
+
+    for (SchedulerTask* task = mTasks; task; task = task->nextTask) {
+        if (!task->isSuspendable || !task->isInWheel) {
+            continue;
+        }
+        removeFromWheel(task);
+        task->isParked = true;
+    }
+    if (mSchedulerSources[0]) {
+        armSchedulerSources();
+    }
+}
+
+/** *********************************************************************
+ ** This method puts parked tasks back, each due within a
+ ** few ticks, spread so they don't all run in one wakeup.
+ **/
+void resumeSchedulerTasks() {
+    if (!mIsSuspended) {
+        return;
+    }
+    mIsSuspended = false;
+
+    const uint64_t nowTick = getSchedulerTick();
+    int spread = 0;
+    for (SchedulerTask* task = mTasks; task; task = task->nextTask) {
+        if (!task->isParked) {
+            continue;
+        }
+        task->isParked = false;
+
+        uint64_t delay = 1 + spread++ % SCHEDULER_RESUME_SPREAD_TICKS;
+        if (delay > task->intervalTicks) {
+            delay = task->intervalTicks;
+        }
+        task->dueTick = nowTick + delay;
+        insertTask(task);
+    }
+    if (mSchedulerSources[0]) {
+        armSchedulerSources();
+    }
+}
+
+/** *********************************************************************
+ ** This method formats wakeups per second, then the tasks
+ ** costing most time: runs, mean and worst ms, and runs over
+ ** budget.
+ **/
+void getSchedulerReport(char* buffer, size_t size) {
+    const gint64 nowUs = g_get_monotonic_time();
+    const double seconds = (nowUs - mWakeupCountSinceUs) * 1.0e-6;
+    int written = snprintf(buffer, size, "wakeups/s %.1f\n",
+        seconds > 0 ? mWakeupCount / seconds : 0.0);
+    if (written < 0 || (size_t) written >= size) {
+        return;
+    }
+    size_t used = written;
+    mWakeupCount = 0;
+    mWakeupCountSinceUs = nowUs;
+
+    // Top few by total time, by selection.
+    enum { TOP_TASKS = 8 };
+    const SchedulerTask* shown[TOP_TASKS];
+    int shownCount = 0;
+    while (shownCount < TOP_TASKS) {
+        const SchedulerTask* best = NULL;
+        for (const SchedulerTask* task = mTasks; task;
+            task = task->nextTask) {
+            bool isShown = false;
+            for (int i = 0; i < shownCount; i++) {
+                isShown = isShown || shown[i] == task;
+            }
+            if (!isShown && task->runCount > 0 &&
+                (!best || task->totalMs > best->totalMs)) {
+                best = task;
+            }
+        }
+        if (!best) {
+            break;
+        }
+        shown[shownCount++] = best;
+
+        written = snprintf(buffer + used, size - used,
+            "%-28.28s runs %6ld  mean %7.3f  worst %7.3f  over %4ld\n",
+            best->name, best->runCount, best->totalMs / best->runCount,
+            best->worstMs, best->overBudgetCount);
+        if (written < 0 || (size_t) written >= size - used) {
+            break;
+        }
+        used += written;
+    }
+}
+
+/** *********************************************************************
+ ** This method returns all wakeups so far, never reset.
+ **/
+unsigned long getSchedulerWakeupTotal() {
+    return mWakeupTotal;
+}
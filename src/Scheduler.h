@@ -0,0 +1,70 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <glib.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+
+// Wheel resolution. Tasks due in the same tick run in the
+// same wakeup.
+#define SCHEDULER_TICK_US 5000
+
+// Three levels of 64 slots: 0.32 s, 20 s, 22 min.
+#define SCHEDULER_WHEEL_BITS 6
+#define SCHEDULER_WHEEL_SLOTS (1 << SCHEDULER_WHEEL_BITS)
+#define SCHEDULER_WHEEL_LEVELS 3
+
+// A task may run this much of its interval early, so it
+// joins a wakeup that's happening anyway.
+#define SCHEDULER_SLACK_FRACTION 0.05
+#define SCHEDULER_SLACK_MAX_US 20000
+
+// Resumed tasks are spread over this many ticks.
+#define SCHEDULER_RESUME_SPREAD_TICKS 8
+
+// Priority classes, each woken by its own source.
+#define SCHEDULER_CLASS_COUNT 2
+
+// A run over this counts against a task's budget.
+#define SCHEDULER_TASK_BUDGET_MS 4.0
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+guint addSchedulerTask(gint priority, float time,
+    GSourceFunc func, gpointer data, const char* name,
+    bool isSuspendable);
+void removeSchedulerTask(guint id);
+
+void suspendSchedulerTasks(void);
+void resumeSchedulerTasks(void);
+
+void getSchedulerReport(char* buffer, size_t size);
+unsigned long getSchedulerWakeupTotal(void);
@@ -0,0 +1,376 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <gtk/gtk.h>
+
+#include "debug.h"
+#include "ShmPresent.h"
+#include "XTraffic.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * Optional presenter for the X11 cairo window on local
+ * displays. Frames rasterize into a client side image in a
+ * MIT-SHM segment, and only the damaged boxes are sent to
+ * the window with XShmPutImage, instead of every cairo
+ * primitive going over the protocol.
+ *
+ * Erases copy from a snapshot of the window background
+ * taken when the segment is made. A frame presents where
+ * it erased and where it drew, see copyFrameDamage().
+ */
+typedef struct _ShmImage {
+        XShmSegmentInfo segment;
+        XImage* image;
+        bool isAttached;
+} ShmImage;
+
+Display* mShmDisplay = NULL;
+Window mShmWindow = None;
+GC mShmGC = NULL;
+
+ShmImage mShmFrame;
+ShmImage mShmBackground;
+
+cairo_surface_t* mShmSurface = NULL;
+
+bool mShmActive = false;
+bool mShmAttachFailed = false;
+
+
+/** *********************************************************************
+ ** Helper methods.
+ **/
+static int handleShmAttachError(Display* display, XErrorEvent* event) {
+    (void) display;
+    (void) event;
+    mShmAttachFailed = true;
+    return 0;
+}
+
+/** *********************************************************************
+ ** This method decides if a display name is local, MIT-SHM
+ ** segments can not be shared over the network.
+ **/
+static bool isLocalDisplay(Display* display) {
+    const char* name = DisplayString(display);
+    return name[0] == ':' || !strncmp(name, "unix:", 5);
+}
+
+/** *********************************************************************
+ ** This method decides if cairo can draw straight into images
+ ** of this visual, 32 bit xRGB in host byte order.
+ **/
+static bool getShmCairoFormat(Display* display, cairo_format_t* format) {
+    const int screen = DefaultScreen(display);
+    const Visual* visual = DefaultVisual(display, screen);
+    const int depth = DefaultDepth(display, screen);
+
+    if (visual->red_mask != 0xff0000 || visual->green_mask != 0xff00 ||
+        visual->blue_mask != 0xff) {
+        return false;
+    }
+
+    const int one = 1;
+    const int hostOrder = *(const char*) &one ? LSBFirst : MSBFirst;
+    if (ImageByteOrder(display) != hostOrder) {
+        return false;
+    }
+
+    if (depth == 24) {
+        *format = CAIRO_FORMAT_RGB24;
+        return true;
+    }
+    if (depth == 32) {
+        *format = CAIRO_FORMAT_ARGB32;
+        return true;
+    }
+    return false;
+}
+
+/** *********************************************************************
+ ** These methods make and free one image in a shared segment.
+ **/
+static bool createShmImage(Display* display, ShmImage* shm,
+    int width, int height) {
+    const int screen = DefaultScreen(display);
+
+    memset(shm, 0, sizeof(*shm));
+    shm->segment.shmid = -1;
+
+    shm->image = XShmCreateImage(display, DefaultVisual(display, screen),
+        DefaultDepth(display, screen), ZPixmap, NULL, &shm->segment,
+        width, height);
+    if (!shm->image || shm->image->bits_per_pixel != 32) {
+        return false;
+    }
+
+    shm->segment.shmid = shmget(IPC_PRIVATE,
+        shm->image->bytes_per_line * shm->image->height,
+        IPC_CREAT | 0600);
+    if (shm->segment.shmid < 0) {
+        return false;
+    }
+
+    shm->segment.shmaddr = shmat(shm->segment.shmid, NULL, 0);
+    if (shm->segment.shmaddr == (char*) -1) {
+        shm->segment.shmaddr = NULL;
+        shmctl(shm->segment.shmid, IPC_RMID, NULL);
+        return false;
+    }
+    shm->image->data = shm->segment.shmaddr;
+    shm->segment.readOnly = False;
+
+    // Attach errors arrive asynchronously, catch them here.
+    mShmAttachFailed = false;
+    XErrorHandler previousHandler = XSetErrorHandler(handleShmAttachError);
+    const Status attached = XShmAttach(display, &shm->segment);
+    XSync(display, False);
+    XSetErrorHandler(previousHandler);
+
+    // Segment goes away with its last detach.
+    shmctl(shm->segment.shmid, IPC_RMID, NULL);
+
+    if (!attached || mShmAttachFailed) {
+        return false;
+    }
+    shm->isAttached = true;
+    return true;
+}
+
+static void destroyShmImage(Display* display, ShmImage* shm) {
+    if (shm->segment.shmaddr) {
+        if (shm->isAttached) {
+            XShmDetach(display, &shm->segment);
+        }
+        shmdt(shm->segment.shmaddr);
+    }
+    if (shm->image) {
+        shm->image->data = NULL;
+        XDestroyImage(shm->image);
+    }
+    memset(shm, 0, sizeof(*shm));
+}
+
+/** *********************************************************************
+ ** This method uploads a 32 bit image of the visuals pixel
+ ** layout to a drawable, through a one-off shared segment.
+ ** False if MIT-SHM can't be used here, the caller then
+ ** falls back to XPutImage().
+ **/
+bool putImageThroughShm(Display* display, Drawable drawable, GC gc,
+    const unsigned char* data, int stride, int width, int height) {
+    cairo_format_t format;
+    if (!isLocalDisplay(display) || !XShmQueryExtension(display) ||
+        !getShmCairoFormat(display, &format)) {
+        return false;
+    }
+
+    ShmImage shm;
+    if (!createShmImage(display, &shm, width, height)) {
+        destroyShmImage(display, &shm);
+        return false;
+    }
+
+    for (int y = 0; y < height; y++) {
+        memcpy(shm.image->data + y * shm.image->bytes_per_line,
+            data + y * stride, width * 4);
+    }
+    XShmPutImage(display, drawable, gc, shm.image,
+        0, 0, 0, 0, width, height, False);
+
+    // The segment must outlive the request.
+    XSync(display, False);
+    destroyShmImage(display, &shm);
+    return true;
+}
+
+/** *********************************************************************
+ ** This method sets up presenting a window through MIT-SHM.
+ ** On any failure the caller stays on the xlib surface.
+ **/
+bool createShmPresent(Display* display, Window window,
+    int width, int height) {
+    destroyShmPresent();
+
+    cairo_format_t format;
+    if (!isLocalDisplay(display) || !XShmQueryExtension(display) ||
+        !getShmCairoFormat(display, &format)) {
+        return false;
+    }
+
+    if (!createShmImage(display, &mShmFrame, width, height) ||
+        !createShmImage(display, &mShmBackground, width, height)) {
+        destroyShmImage(display, &mShmFrame);
+        destroyShmImage(display, &mShmBackground);
+        return false;
+    }
+
+    if (mShmFrame.image->bytes_per_line !=
+        cairo_format_stride_for_width(format, width)) {
+        destroyShmImage(display, &mShmFrame);
+        destroyShmImage(display, &mShmBackground);
+        return false;
+    }
+
+    // Snapshot the bare window as background for erases.
+    XClearWindow(display, window);
+    XSync(display, False);
+    XShmGetImage(display, window, mShmBackground.image,
+        0, 0, AllPlanes);
+    memcpy(mShmFrame.image->data, mShmBackground.image->data,
+        mShmFrame.image->bytes_per_line * height);
+
+    mShmSurface = cairo_image_surface_create_for_data(
+        (unsigned char*) mShmFrame.image->data, format,
+        width, height, mShmFrame.image->bytes_per_line);
+
+    mShmDisplay = display;
+    mShmWindow = window;
+    mShmGC = XCreateGC(display, window, 0, NULL);
+    mShmActive = true;
+
+    P("MIT-SHM present %dx%d\n", width, height);
+    return true;
+}
+
+void destroyShmPresent() {
+    if (mShmSurface) {
+        cairo_surface_destroy(mShmSurface);
+        mShmSurface = NULL;
+    }
+
+    if (mShmDisplay) {
+        XSync(mShmDisplay, False);
+        destroyShmImage(mShmDisplay, &mShmFrame);
+        destroyShmImage(mShmDisplay, &mShmBackground);
+        if (mShmGC) {
+            XFreeGC(mShmDisplay, mShmGC);
+            mShmGC = NULL;
+        }
+    }
+
+    mShmDisplay = NULL;
+    mShmWindow = None;
+    mShmActive = false;
+}
+
+bool isShmPresentActive() {
+    return mShmActive;
+}
+
+cairo_surface_t* getShmPresentSurface() {
+    return mShmSurface;
+}
+
+/** *********************************************************************
+ ** This method erases one box of the frame image back to
+ ** the window background.
+ **/
+void restoreShmPresentArea(int x, int y, int w, int h) {
+    if (!mShmActive) {
+        return;
+    }
+
+    const XImage* frame = mShmFrame.image;
+    if (x < 0) {
+        w += x;
+        x = 0;
+    }
+    if (y < 0) {
+        h += y;
+        y = 0;
+    }
+    if (x + w > frame->width) {
+        w = frame->width - x;
+    }
+    if (y + h > frame->height) {
+        h = frame->height - y;
+    }
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    cairo_surface_flush(mShmSurface);
+
+    const int stride = frame->bytes_per_line;
+    const size_t offset = (size_t) y * stride + (size_t) x * 4;
+    for (int row = 0; row < h; row++) {
+        memcpy(frame->data + offset + (size_t) row * stride,
+            mShmBackground.image->data + offset + (size_t) row * stride,
+            (size_t) w * 4);
+    }
+
+    cairo_surface_mark_dirty_rectangle(mShmSurface, x, y, w, h);
+}
+
+/** *********************************************************************
+ ** This method sends the damaged part of a finished frame
+ ** to the window. Takes ownership of damage.
+ **/
+void presentShmFrame(cairo_region_t* damage) {
+    if (!mShmActive || !damage) {
+        if (damage) {
+            cairo_region_destroy(damage);
+        }
+        return;
+    }
+
+    cairo_surface_flush(mShmSurface);
+
+    cairo_region_t* present = damage;
+
+    if (cairo_region_num_rectangles(present) > SHM_PRESENT_MAX_PUTS) {
+        cairo_rectangle_int_t extents;
+        cairo_region_get_extents(present, &extents);
+        cairo_region_destroy(present);
+        present = cairo_region_create_rectangle(&extents);
+    }
+
+    const cairo_rectangle_int_t window = {
+        0, 0, mShmFrame.image->width, mShmFrame.image->height
+    };
+    cairo_region_intersect_rectangle(present, &window);
+
+    const int count = cairo_region_num_rectangles(present);
+    for (int i = 0; i < count; i++) {
+        cairo_rectangle_int_t box;
+        cairo_region_get_rectangle(present, i, &box);
+        XShmPutImage(mShmDisplay, mShmWindow, mShmGC, mShmFrame.image,
+            box.x, box.y, box.x, box.y, box.width, box.height, False);
+    }
+    cairo_region_destroy(present);
+
+    // The server reads the segment later, so wait before
+    // the next frame writes into it.
+    XSync(mShmDisplay, False);
+}
@@ -0,0 +1,369 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <gtk/gtk.h>
+
+#include "Benchmark.h"
+#include "Flags.h"
+#include "MemoryStats.h"
+#include "safe_malloc.h"
+#include "SpriteCache.h"
+#include "version.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define SPRITE_CACHE_MAGIC "PLSNSPR"
+
+#define FNV_PRIME 0x100000001b3ULL
+
+// Set once by initSpriteCache(), read only afterwards, so
+// any thread may load and store.
+static char* mSpriteCacheDir = NULL;
+
+// Key for the user data of mapped surfaces.
+static cairo_user_data_key_t mSpriteCacheMapKey;
+
+typedef struct _SpriteCacheMap {
+        void* address;
+        size_t size;
+} SpriteCacheMap;
+
+static void makeSpriteCacheDir(char* path);
+static void pruneSpriteCache();
+static char* getSpriteCachePath(uint64_t key, const char* suffix);
+static void unmapCachedSprite(void* data);
+
+
+/** *********************************************************************
+ ** This method finds and creates the cache directory, and
+ ** drops sprites not used in a while. Call once, before any
+ ** thread loads sprites. Benchmarks and -nospritecache run
+ ** without a cache.
+ **/
+void initSpriteCache() {
+    if (Flags.NoSpriteCache || isBenchmarkActive()) {
+        return;
+    }
+
+    const char* base = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    char* path;
+    if (base && base[0] == '/') {
+        path = (char*) malloc(strlen(base) +
+            strlen(SPRITE_CACHE_DIR) + 2);
+        MALLOC_CHECK(path);
+        sprintf(path, "%s/%s", base, SPRITE_CACHE_DIR);
+    } else if (home) {
+        path = (char*) malloc(strlen(home) +
+            strlen(SPRITE_CACHE_DIR) + 9);
+        MALLOC_CHECK(path);
+        sprintf(path, "%s/.cache/%s", home, SPRITE_CACHE_DIR);
+    } else {
+        return;
+    }
+
+    makeSpriteCacheDir(path);
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode) ||
+        access(path, R_OK | W_OK | X_OK) != 0) {
+        free(path);
+        return;
+    }
+
+    mSpriteCacheDir = path;
+    pruneSpriteCache();
+}
+
+/** *********************************************************************
+ ** This method is like mkdir -p.
+ **/
+void makeSpriteCacheDir(char* path) {
+    for (char* p = path + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(path, 0700);
+            *p = '/';
+        }
+    }
+    mkdir(path, 0700);
+}
+
+/** *********************************************************************
+ ** This method removes old sprites, and temporary files a
+ ** killed writer left behind.
+ **/
+void pruneSpriteCache() {
+    DIR* dir = opendir(mSpriteCacheDir);
+    if (!dir) {
+        return;
+    }
+
+    const time_t oldest = time(NULL) -
+        (time_t) SPRITE_CACHE_MAX_AGE_DAYS * 24 * 60 * 60;
+    const int dirFd = dirfd(dir);
+
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        const char* suffix = strrchr(entry->d_name, '.');
+        if (!suffix || (strcmp(suffix, ".sprite") &&
+            strcmp(suffix, ".tmp"))) {
+            continue;
+        }
+
+        struct stat st;
+        if (fstatat(dirFd, entry->d_name, &st, 0) != 0) {
+            continue;
+        }
+        if (st.st_mtime < oldest || (!strcmp(suffix, ".tmp") &&
+            st.st_mtime < time(NULL) - 60)) {
+            unlinkat(dirFd, entry->d_name, 0);
+        }
+    }
+    closedir(dir);
+}
+
+/** *********************************************************************
+ ** This method tells if sprites are cached this run.
+ **/
+bool isSpriteCacheActive() {
+    return mSpriteCacheDir != NULL;
+}
+
+/** *********************************************************************
+ ** These methods hash (FNV-1a) sprite sources and keys.
+ **/
+uint64_t hashSpriteBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t hashSpriteXpm(const char** xpm) {
+    int w, h, ncolors;
+    if (sscanf(xpm[0], "%d %d %d", &w, &h, &ncolors) != 3) {
+        return 0;
+    }
+
+    uint64_t hash = SPRITE_HASH_SEED;
+    for (int i = 0; i < 1 + ncolors + h; i++) {
+        // Include the terminator, so lines can't run together.
+        hash = hashSpriteBytes(hash, xpm[i], strlen(xpm[i]) + 1);
+    }
+    return hash;
+}
+
+/** *********************************************************************
+ ** This method combines everything a scaled sprite depends
+ ** on into its cache key.
+ **/
+uint64_t getSpriteCacheKey(uint64_t assetHash, int width, int height,
+    int flip, const char* color) {
+    const int32_t values[] = {SPRITE_CACHE_FORMAT, width, height, flip};
+
+    uint64_t hash = SPRITE_HASH_SEED;
+    hash = hashSpriteBytes(hash, &assetHash, sizeof(assetHash));
+    hash = hashSpriteBytes(hash, values, sizeof(values));
+    hash = hashSpriteBytes(hash, color, strlen(color) + 1);
+    hash = hashSpriteBytes(hash, VERSION, strlen(VERSION) + 1);
+    return hash;
+}
+
+/** *********************************************************************
+ ** This method returns the file for a key, the caller frees.
+ **/
+char* getSpriteCachePath(uint64_t key, const char* suffix) {
+    const size_t size = strlen(mSpriteCacheDir) + strlen(suffix) + 20;
+    char* path = (char*) malloc(size);
+    MALLOC_CHECK(path);
+
+    snprintf(path, size, "%s/%016" PRIx64 "%s",
+        mSpriteCacheDir, key, suffix);
+    return path;
+}
+
+/** *********************************************************************
+ ** This method maps a cached sprite, NULL when it is missing
+ ** or does not validate. The surface points into the mapping,
+ ** which goes when the surface does.
+ **/
+cairo_surface_t* loadCachedSprite(uint64_t key) {
+    if (!mSpriteCacheDir) {
+        return NULL;
+    }
+
+    char* path = getSpriteCachePath(key, ".sprite");
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        st.st_size < SPRITE_CACHE_HEADER_SIZE) {
+        close(fd);
+        free(path);
+        return NULL;
+    }
+
+    // Private and writable, so cairo may touch its copy.
+    const size_t size = st.st_size;
+    void* address = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        free(path);
+        return NULL;
+    }
+
+    const SpriteCacheHeader* header = (const SpriteCacheHeader*) address;
+    unsigned char* pixels = (unsigned char*) address +
+        SPRITE_CACHE_HEADER_SIZE;
+
+    const bool isValid =
+        !memcmp(header->magic, SPRITE_CACHE_MAGIC,
+            sizeof(header->magic)) &&
+        header->key == key &&
+        header->format == CAIRO_FORMAT_ARGB32 &&
+        header->width > 0 && header->height > 0 &&
+        (int) header->stride == cairo_format_stride_for_width(
+            CAIRO_FORMAT_ARGB32, header->width) &&
+        size == SPRITE_CACHE_HEADER_SIZE +
+            (size_t) header->stride * header->height &&
+        header->checksum == hashSpriteBytes(SPRITE_HASH_SEED,
+            pixels, (size_t) header->stride * header->height);
+
+    if (!isValid) {
+        munmap(address, size);
+        unlink(path);
+        free(path);
+        return NULL;
+    }
+
+    // Mark used, for pruning.
+    utimensat(AT_FDCWD, path, NULL, 0);
+    free(path);
+
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(
+        pixels, CAIRO_FORMAT_ARGB32, header->width, header->height,
+        header->stride);
+
+    SpriteCacheMap* map = (SpriteCacheMap*) malloc(sizeof(SpriteCacheMap));
+    MALLOC_CHECK(map);
+    map->address = address;
+    map->size = size;
+
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS ||
+        cairo_surface_set_user_data(surface, &mSpriteCacheMapKey,
+            map, unmapCachedSprite) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        unmapCachedSprite(map);
+        return NULL;
+    }
+    return trackSurface(MEMORY_SPRITES, surface);
+}
+
+/** *********************************************************************
+ ** This method unmaps a sprite with its last surface.
+ **/
+void unmapCachedSprite(void* data) {
+    SpriteCacheMap* map = (SpriteCacheMap*) data;
+    munmap(map->address, map->size);
+    free(map);
+}
+
+/** *********************************************************************
+ ** This method writes a sprite for next time. Written to a
+ ** temporary file and renamed, so readers never see half a
+ ** sprite, and concurrent writers of one key are harmless.
+ **/
+void storeCachedSprite(uint64_t key, cairo_surface_t* surface) {
+    if (!mSpriteCacheDir || !surface ||
+        cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE ||
+        cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32) {
+        return;
+    }
+
+    cairo_surface_flush(surface);
+    const unsigned char* pixels = cairo_image_surface_get_data(surface);
+    const int width = cairo_image_surface_get_width(surface);
+    const int height = cairo_image_surface_get_height(surface);
+    const int stride = cairo_image_surface_get_stride(surface);
+    if (!pixels || width < 1 || height < 1) {
+        return;
+    }
+
+    union {
+        SpriteCacheHeader header;
+        unsigned char bytes[SPRITE_CACHE_HEADER_SIZE];
+    } block;
+    memset(&block, 0, sizeof(block));
+
+    SpriteCacheHeader* header = &block.header;
+    memcpy(header->magic, SPRITE_CACHE_MAGIC, sizeof(header->magic));
+    header->key = key;
+    header->format = CAIRO_FORMAT_ARGB32;
+    header->width = width;
+    header->height = height;
+    header->stride = stride;
+    header->checksum = hashSpriteBytes(SPRITE_HASH_SEED,
+        pixels, (size_t) stride * height);
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.%p.tmp",
+        (int) getpid(), (void*) surface);
+    char* tmpPath = getSpriteCachePath(key, suffix);
+    char* path = getSpriteCachePath(key, ".sprite");
+
+    FILE* file = fopen(tmpPath, "wb");
+    bool isWritten = false;
+    if (file) {
+        isWritten =
+            fwrite(block.bytes, sizeof(block.bytes), 1, file) == 1 &&
+            fwrite(pixels, (size_t) stride * height, 1, file) == 1;
+        isWritten = (fclose(file) == 0) && isWritten;
+    }
+
+    if (!isWritten || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+    }
+    free(tmpPath);
+    free(path);
+}
@@ -0,0 +1,74 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <gtk/gtk.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+// Below $XDG_CACHE_HOME, or $HOME/.cache.
+#define SPRITE_CACHE_DIR "plasmasnow/sprites"
+
+// Bump when the file layout or the scaling changes.
+#define SPRITE_CACHE_FORMAT 1
+
+// Pixels start here, so they stay 64 byte aligned.
+#define SPRITE_CACHE_HEADER_SIZE 64
+
+// Start value for hashSpriteBytes() (FNV-1a).
+#define SPRITE_HASH_SEED 0xcbf29ce484222325ULL
+
+// Sprites not used for this long are removed.
+#define SPRITE_CACHE_MAX_AGE_DAYS 30
+
+typedef struct _SpriteCacheHeader {
+        char magic[8];
+        uint64_t key;
+
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+
+        uint64_t checksum;
+} SpriteCacheHeader;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void initSpriteCache();
+bool isSpriteCacheActive();
+
+uint64_t hashSpriteBytes(uint64_t hash, const void* data, size_t size);
+uint64_t hashSpriteXpm(const char** xpm);
+uint64_t getSpriteCacheKey(uint64_t assetHash, int width, int height,
+    int flip, const char* color);
+
+cairo_surface_t* loadCachedSprite(uint64_t key);
+void storeCachedSprite(uint64_t key, cairo_surface_t* surface);
@@ -28,8 +28,10 @@
 
 #include "Flags.h"
 #include "pixmaps.h"
+#include "Random.h"
 #include "safe_malloc.h"
 #include "Stars.h"
+#include "StartupTasks.h"
 #include "Utils.h"
 #include "windows.h"
 
@@ -53,6 +55,37 @@ char* mStarColorArray[STARANIMATIONS] =
 
 cairo_surface_t* mStarSurfaceArray[STARANIMATIONS];
 
+// Star surfaces built on the startup pool.
+typedef struct _StarsJob {
+        float sizes[STARANIMATIONS];
+        int serial;
+
+        cairo_surface_t* surfaces[STARANIMATIONS];
+} StarsJob;
+
+StarsJob mStarsJob;
+
+// Bumped on every rebuild in place, so a startup job
+// finishing late never overwrites newer surfaces.
+int mStarsSurfaceSerial = 0;
+
+// Bumped on every visible change, for the backdrop cache.
+int mStarsVersion = 0;
+
+// All stars drawn into one layer over the sky band. A tick
+// redraws only the areas of stars that changed, collected
+// in mStarsDirtyRegion, so the cost of a tick follows the
+// stars changed, not the stars in the sky. The same areas
+// collect in mStarsEraseRegion, for the next erase.
+cairo_surface_t* mStarsLayer = NULL;
+int mStarsLayerWidth = 0;
+int mStarsLayerHeight = 0;
+int mStarsLayerTransparency = -1;
+bool mStarsLayerIsValid = false;
+
+cairo_region_t* mStarsDirtyRegion = NULL;
+cairo_region_t* mStarsEraseRegion = NULL;
+
 
 /** *********************************************************************
  ** This method initializes the Stars module.
@@ -63,10 +96,12 @@ void initStarsModule() {
     // Clear and set mStarSurfaceArray.
     for (int i = 0; i < STARANIMATIONS; i++) {
         mStarSurfaceArray[i] = NULL;
+        mStarsJob.sizes[i] = getStarSurfaceSize();
     }
-    initStarsModuleSurfaces();
+    mStarsJob.serial = mStarsSurfaceSerial;
+    addStartupTask(buildStarsJob, installStarsJob, &mStarsJob);
 
-    addMethodToMainloop(PRIORITY_DEFAULT, time_ustar,
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT, time_ustar,
         updateStarsFrame);
 }
 
@@ -87,6 +122,72 @@ void initStarsModuleArrays() {
         star->y = randint(mGlobal.SnowWinHeight / 4);
         star->color = randint(STARANIMATIONS);
     }
+    mStarsLayerIsValid = false;
+    mStarsVersion++;
+}
+
+/** *********************************************************************
+ ** This method moves the stars with a window resize, so
+ ** the sky keeps its pattern.
+ **/
+void rescaleStarsModuleArrays(int oldWidth, int oldHeight) {
+    if (oldWidth < 1 || oldHeight < 1) {
+        initStarsModuleArrays();
+        return;
+    }
+
+    for (int i = 0; i < mNumberOfStars; i++) {
+        StarCoordinate* star = &mStarCoordinates[i];
+        star->x = (long) star->x * mGlobal.SnowWinWidth / oldWidth;
+        star->y = (long) star->y * mGlobal.SnowWinHeight / oldHeight;
+    }
+    mStarsLayerIsValid = false;
+    mStarsVersion++;
+}
+
+/** *********************************************************************
+ ** This method picks a random star surface size.
+ **/
+float getStarSurfaceSize() {
+    float size = LOCAL_SCALE * mGlobal.WindowScale *
+        0.01 * Flags.Scale * STAR_SIZE;
+
+    size *= 0.2 * (1 + 4 * drand48());
+    if (size < 1) {
+        size = 1;
+    }
+    return size;
+}
+
+/** *********************************************************************
+ ** This method draws one star surface. Touches no shared
+ ** state, so it runs on any thread.
+ **/
+cairo_surface_t* createStarSurface(float size, const char* colorName) {
+    cairo_surface_t* surface = cairo_image_surface_create(
+        CAIRO_FORMAT_ARGB32, size, size);
+
+    cairo_t *cr = cairo_create(surface);
+    cairo_set_line_width(cr, 1.0 * size / STAR_SIZE);
+
+    GdkRGBA color;
+    gdk_rgba_parse(&color, colorName);
+
+    cairo_set_source_rgba(cr, color.red,
+        color.green, color.blue, color.alpha);
+
+    cairo_move_to(cr, 0, 0);
+    cairo_line_to(cr, size, size);
+    cairo_move_to(cr, 0, size);
+    cairo_line_to(cr, size, 0);
+    cairo_move_to(cr, 0, size / 2);
+    cairo_line_to(cr, size, size / 2);
+    cairo_move_to(cr, size / 2, 0);
+    cairo_line_to(cr, size / 2, size);
+    cairo_stroke(cr);
+
+    cairo_destroy(cr);
+    return surface;
 }
 
 /** *********************************************************************
@@ -94,57 +195,122 @@ void initStarsModuleArrays() {
  **/
 void initStarsModuleSurfaces() {
     for (int i = 0; i < STARANIMATIONS; i++) {
-        float size = LOCAL_SCALE * mGlobal.WindowScale *
-            0.01 * Flags.Scale * STAR_SIZE;
-
-        size *= 0.2 * (1 + 4 * drand48());
-        if (size < 1) {
-            size = 1;
-        }
+        const float size = getStarSurfaceSize();
 
         // Release and recreate surfaces.
         if (mStarSurfaceArray[i]) {
             cairo_surface_destroy(mStarSurfaceArray[i]);
         }
-        mStarSurfaceArray[i] = cairo_image_surface_create(
-            CAIRO_FORMAT_ARGB32, size, size);
+        mStarSurfaceArray[i] = createStarSurface(size,
+            mStarColorArray[i]);
+    }
+    mStarsSurfaceSerial++;
+    mStarsLayerIsValid = false;
+    mStarsVersion++;
+}
+
+/** *********************************************************************
+ ** These methods build the star surfaces on the startup
+ ** pool, and install them on the main thread.
+ **/
+void* buildStarsJob(void* arg) {
+    StarsJob* job = (StarsJob*) arg;
+    for (int i = 0; i < STARANIMATIONS; i++) {
+        job->surfaces[i] = createStarSurface(job->sizes[i],
+            mStarColorArray[i]);
+    }
+    return job;
+}
+
+void installStarsJob(void* result, void* arg) {
+    (void) arg;
+    StarsJob* job = (StarsJob*) result;
 
-        cairo_t *cr = cairo_create(mStarSurfaceArray[i]);
-        cairo_set_line_width(cr, 1.0 * size / STAR_SIZE);
+    for (int i = 0; i < STARANIMATIONS; i++) {
+        if (job->serial == mStarsSurfaceSerial) {
+            mStarSurfaceArray[i] = job->surfaces[i];
+        } else {
+            cairo_surface_destroy(job->surfaces[i]);
+        }
+    }
+    mStarsLayerIsValid = false;
+    mStarsVersion++;
+}
 
-        GdkRGBA color;
-        gdk_rgba_parse(&color, mStarColorArray[i]);
+/** *********************************************************************
+ ** This method returns the largest star surface side, the
+ ** area one star can cover.
+ **/
+int getStarExtent() {
+    int extent = STAR_SIZE;
+    for (int i = 0; i < STARANIMATIONS; i++) {
+        if (mStarSurfaceArray[i]) {
+            extent = MAX(extent,
+                cairo_image_surface_get_width(mStarSurfaceArray[i]));
+        }
+    }
+    return extent;
+}
 
-        cairo_set_source_rgba(cr, color.red,
-            color.green, color.blue, color.alpha);
+/** *********************************************************************
+ ** This method marks the area of a star for redraw in the
+ ** stars layer.
+ **/
+void addStarToDirtyRegion(const StarCoordinate* star, int extent) {
+    if (!mStarsDirtyRegion) {
+        mStarsDirtyRegion = cairo_region_create();
+    }
 
-        cairo_move_to(cr, 0, 0);
-        cairo_line_to(cr, size, size);
-        cairo_move_to(cr, 0, size);
-        cairo_line_to(cr, size, 0);
-        cairo_move_to(cr, 0, size / 2);
-        cairo_line_to(cr, size, size / 2);
-        cairo_move_to(cr, size / 2, 0);
-        cairo_line_to(cr, size / 2, size);
-        cairo_stroke(cr);
+    const cairo_rectangle_int_t rect =
+        { star->x, star->y, extent, extent };
+    cairo_region_union_rectangle(mStarsDirtyRegion, &rect);
 
-        cairo_destroy(cr);
+    // Only frames that erase use it, see eraseStarsFrame().
+    if (mGlobal.useDoubleBuffers || mGlobal.isDoubleBuffered) {
+        return;
+    }
+    if (!mStarsEraseRegion) {
+        mStarsEraseRegion = cairo_region_create();
     }
+    cairo_region_union_rectangle(mStarsEraseRegion, &rect);
 }
 
 /** *********************************************************************
- ** This method erases a single Stars frame.
+ ** This method returns the height of the sky band stars
+ ** can cover.
+ **/
+int getStarsBandHeight() {
+    return mGlobal.SnowWinHeight / 4 + getStarExtent();
+}
+
+/** *********************************************************************
+ ** This method erases a single Stars frame: the old and new
+ ** places of stars changed since the last one, or the whole
+ ** band when the layer is repainted anyway.
  **/
 void eraseStarsFrame() {
-    if (!Flags.Stars) {
+    if (!Flags.Stars || mNumberOfStars <= 0) {
         return;
     }
 
-    for (int i = 0; i < mNumberOfStars; i++) {
-        StarCoordinate* star = &mStarCoordinates[i];
-        clearDisplayArea(mGlobal.display, mGlobal.SnowWin,
-            star->x, star->y, STAR_SIZE, STAR_SIZE,
+    if (!mStarsLayerIsValid) {
+        clearDisplayArea(mGlobal.display, mGlobal.SnowWin, 0, 0,
+            mGlobal.SnowWinWidth, getStarsBandHeight(),
             mGlobal.xxposures);
+    } else if (mStarsEraseRegion) {
+        const int count = cairo_region_num_rectangles(mStarsEraseRegion);
+        for (int i = 0; i < count; i++) {
+            cairo_rectangle_int_t rect;
+            cairo_region_get_rectangle(mStarsEraseRegion, i, &rect);
+            clearDisplayArea(mGlobal.display, mGlobal.SnowWin,
+                rect.x, rect.y, rect.width, rect.height,
+                mGlobal.xxposures);
+        }
+    }
+
+    if (mStarsEraseRegion) {
+        cairo_region_destroy(mStarsEraseRegion);
+        mStarsEraseRegion = NULL;
     }
 }
 
@@ -160,49 +326,155 @@ int updateStarsFrame() {
         return TRUE;
     }
 
-    // Change color of 1/5 stars.
-    for (int i = 0; i < mNumberOfStars; i++) {
-        if (randint(5) == 0) {
-            StarCoordinate* star = &mStarCoordinates[i];
-            star->color = randint(STARANIMATIONS);
-        }
+    if (mNumberOfStars <= 0) {
+        return TRUE;
+    }
+    if (!Flags.Stars) {
+        mStarsLayerIsValid = false;
+        return TRUE;
+    }
+    const int extent = getStarExtent();
+
+    // Change color of 1/5 stars. Draw how many, then which,
+    // rather than a draw per star.
+    const int colorChanges = randomBinomial(mNumberOfStars, 0.2);
+    for (int i = 0; i < colorChanges; i++) {
+        StarCoordinate* star =
+            &mStarCoordinates[randomNext() % mNumberOfStars];
+        star->color = randomNext() % STARANIMATIONS;
+        addStarToDirtyRegion(star, extent);
     }
 
     // Change position of 1/50 stars.
-    for (int i = 0; i < mNumberOfStars; i++) {
-        if (randint(50) == 0) {
-            StarCoordinate* star = &mStarCoordinates[i];
-            star->x = randint(mGlobal.SnowWinWidth);
-            star->y = randint(mGlobal.SnowWinHeight / 4);
-        }
+    const int moves = randomBinomial(mNumberOfStars, 0.02);
+    const int skyWidth = MAX(mGlobal.SnowWinWidth, 1);
+    const int skyHeight = MAX(mGlobal.SnowWinHeight / 4, 1);
+    for (int i = 0; i < moves; i++) {
+        StarCoordinate* star =
+            &mStarCoordinates[randomNext() % mNumberOfStars];
+        addStarToDirtyRegion(star, extent);
+        star->x = randomNext() % skyWidth;
+        star->y = randomNext() % skyHeight;
+        addStarToDirtyRegion(star, extent);
     }
 
+    if (colorChanges > 0 || moves > 0) {
+        mStarsVersion++;
+    }
     return TRUE;
 }
 
 /** *********************************************************************
- ** This method draws a single Stars frame.
+ ** This method returns the Stars version, which changes
+ ** whenever drawStarsFrame() would draw differently.
  **/
-void drawStarsFrame(cairo_t *cr) {
-    if (!Flags.Stars) {
-        return;
-    }
+int getStarsVersion() {
+    return mStarsVersion;
+}
 
-    cairo_save(cr);
+/** *********************************************************************
+ ** This method paints the stars into the stars layer. With
+ ** a dirty region, only stars touching it are painted, into
+ ** it cleared first. Without, the layer is redrawn whole.
+ **/
+void paintStarsLayer(const cairo_region_t* dirty) {
+    cairo_t* cr = cairo_create(mStarsLayer);
+
+    if (dirty) {
+        const int count = cairo_region_num_rectangles(dirty);
+        for (int i = 0; i < count; i++) {
+            cairo_rectangle_int_t rect;
+            cairo_region_get_rectangle(dirty, i, &rect);
+            cairo_rectangle(cr, rect.x, rect.y, rect.width, rect.height);
+        }
+        cairo_clip(cr);
+    }
+    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(cr);
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
 
     cairo_set_line_width(cr, 1);
     cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
 
+    const int extent = getStarExtent();
+    const double alpha = 0.01 * (100 - Flags.Transparency);
     for (int i = 0; i < mNumberOfStars; i++) {
         StarCoordinate* star = &mStarCoordinates[i];
+        if (!mStarSurfaceArray[star->color]) {
+            continue;
+        }
+        if (dirty) {
+            const cairo_rectangle_int_t rect =
+                { star->x, star->y, extent, extent };
+            if (cairo_region_contains_rectangle(dirty, &rect) ==
+                CAIRO_REGION_OVERLAP_OUT) {
+                continue;
+            }
+        }
 
         cairo_set_source_surface(cr,
             mStarSurfaceArray[star->color], star->x, star->y);
-        my_cairo_paint_with_alpha(cr,
-            (0.01 * (100 - Flags.Transparency)));
+        my_cairo_paint_with_alpha(cr, alpha);
+    }
+
+    cairo_destroy(cr);
+}
+
+/** *********************************************************************
+ ** This method brings the stars layer up to date, recreating
+ ** it like the target when the window or the stars were
+ ** resized.
+ **/
+void updateStarsLayer(cairo_t* cr) {
+    const int width = mGlobal.SnowWinWidth;
+    const int height = getStarsBandHeight();
+
+    if (!mStarsLayer || mStarsLayerWidth != width ||
+        mStarsLayerHeight != height) {
+        if (mStarsLayer) {
+            cairo_surface_destroy(mStarsLayer);
+        }
+        mStarsLayer = cairo_surface_create_similar(
+            cairo_get_target(cr), CAIRO_CONTENT_COLOR_ALPHA,
+            width, height);
+        mStarsLayerWidth = width;
+        mStarsLayerHeight = height;
+        mStarsLayerIsValid = false;
+    }
+    if (mStarsLayerTransparency != Flags.Transparency) {
+        mStarsLayerTransparency = Flags.Transparency;
+        mStarsLayerIsValid = false;
     }
 
-    cairo_restore(cr);
+    if (!mStarsLayerIsValid) {
+        paintStarsLayer(NULL);
+        mStarsLayerIsValid = true;
+    } else if (mStarsDirtyRegion &&
+        !cairo_region_is_empty(mStarsDirtyRegion)) {
+        paintStarsLayer(mStarsDirtyRegion);
+    }
+
+    if (mStarsDirtyRegion) {
+        cairo_region_destroy(mStarsDirtyRegion);
+        mStarsDirtyRegion = NULL;
+    }
+}
+
+/** *********************************************************************
+ ** This method draws a single Stars frame.
+ **/
+void drawStarsFrame(cairo_t *cr) {
+    if (!Flags.Stars) {
+        return;
+    }
+    if (mGlobal.SnowWinWidth <= 0 || mGlobal.SnowWinHeight <= 0) {
+        return;
+    }
+
+    updateStarsLayer(cr);
+
+    cairo_set_source_surface(cr, mStarsLayer, 0, 0);
+    cairo_paint(cr);
 }
 
 /** *********************************************************************
@@ -23,6 +23,8 @@
 
 #include <gtk/gtk.h>
 
+#include "plasmasnow.h"
+
 
 /***********************************************************
  * Module Method stubs.
@@ -30,10 +32,23 @@
 
 void initStarsModule();
 void initStarsModuleArrays();
+void rescaleStarsModuleArrays(int oldWidth, int oldHeight);
 void initStarsModuleSurfaces();
 
+float getStarSurfaceSize();
+cairo_surface_t* createStarSurface(float size, const char* colorName);
+void* buildStarsJob(void* arg);
+void installStarsJob(void* result, void* arg);
+
+int getStarExtent();
+void addStarToDirtyRegion(const StarCoordinate* star, int extent);
+int getStarsBandHeight();
+void paintStarsLayer(const cairo_region_t* dirty);
+void updateStarsLayer(cairo_t* cr);
+
 int updateStarsFrame();
 void eraseStarsFrame();
 void drawStarsFrame(cairo_t *cr);
+int getStarsVersion();
 
 void updateStarsUserSettings();
@@ -0,0 +1,178 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <gtk/gtk.h>
+
+#include "Benchmark.h"
+#include "Flags.h"
+#include "plasmasnow.h"
+#include "StartupTasks.h"
+#include "ThreadPolicy.h"
+#include "Utils.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+typedef struct _StartupTask {
+        StartupBuildMethod build;
+        StartupInstallMethod install;
+        void* arg;
+
+        void* result;
+        bool isBuilt;
+        bool isInstalled;
+} StartupTask;
+
+// Task list, guarded by mStartupTaskMutex.
+static pthread_mutex_t mStartupTaskMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mStartupTaskCondition = PTHREAD_COND_INITIALIZER;
+
+static StartupTask mStartupTasks[STARTUP_TASKS_MAX];
+static int mStartupTaskCount = 0;
+static int mStartupTaskNextBuild = 0;
+
+static int mStartupTaskThreadCount = 0;
+static bool mIsInstallTimerAdded = false;
+
+
+/** *********************************************************************
+ ** This method queues a task whose build step runs on the
+ ** startup thread pool, and whose install step runs later on
+ ** the main thread. Main thread only.
+ **
+ ** Benchmarks build and install in place, so results never
+ ** depend on thread timing. So does a full task list.
+ **/
+void addStartupTask(StartupBuildMethod build,
+    StartupInstallMethod install, void* arg) {
+
+    pthread_mutex_lock(&mStartupTaskMutex);
+
+    // One more thread per task, up to one per cpu.
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > STARTUP_TASKS_MAX_THREADS) {
+        cpus = STARTUP_TASKS_MAX_THREADS;
+    }
+    if (!isBenchmarkActive() && mStartupTaskThreadCount < cpus) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL,
+            execStartupTaskThread, NULL) == 0) {
+            pthread_detach(thread);
+            mStartupTaskThreadCount++;
+        }
+    }
+
+    const bool isInline = isBenchmarkActive() ||
+        mStartupTaskThreadCount == 0 ||
+        mStartupTaskCount >= STARTUP_TASKS_MAX;
+    if (isInline) {
+        pthread_mutex_unlock(&mStartupTaskMutex);
+        install(build(arg), arg);
+        return;
+    }
+
+    StartupTask* task = &mStartupTasks[mStartupTaskCount++];
+    task->build = build;
+    task->install = install;
+    task->arg = arg;
+    task->result = NULL;
+    task->isBuilt = false;
+    task->isInstalled = false;
+
+    pthread_cond_signal(&mStartupTaskCondition);
+    pthread_mutex_unlock(&mStartupTaskMutex);
+
+    if (!mIsInstallTimerAdded) {
+        mIsInstallTimerAdded = true;
+        addMethodToMainloop(PRIORITY_HIGH,
+            time_install_startup_tasks, installStartupTasks);
+    }
+}
+
+/** *********************************************************************
+ ** This method is the startup pool thread looper. Threads
+ ** park once every task is built.
+ **/
+void* execStartupTaskThread() {
+    registerPolicyThread("ps-startup", -1, false);
+    pthread_mutex_lock(&mStartupTaskMutex);
+
+    while (!Flags.shutdownRequested) {
+        if (mStartupTaskNextBuild >= mStartupTaskCount) {
+            pthread_cond_wait(&mStartupTaskCondition,
+                &mStartupTaskMutex);
+            continue;
+        }
+
+        StartupTask* task = &mStartupTasks[mStartupTaskNextBuild++];
+        pthread_mutex_unlock(&mStartupTaskMutex);
+
+        void* result = task->build(task->arg);
+
+        pthread_mutex_lock(&mStartupTaskMutex);
+        task->result = result;
+        task->isBuilt = true;
+    }
+
+    pthread_mutex_unlock(&mStartupTaskMutex);
+    return NULL;
+}
+
+/** *********************************************************************
+ ** This method installs every finished task, so fast ones
+ ** never wait on slow ones. Mainloop method, removed once
+ ** all are in.
+ **/
+int installStartupTasks() {
+    pthread_mutex_lock(&mStartupTaskMutex);
+
+    bool isAllInstalled = true;
+    for (int i = 0; i < mStartupTaskCount; i++) {
+        StartupTask* task = &mStartupTasks[i];
+        if (task->isInstalled) {
+            continue;
+        }
+        if (!task->isBuilt) {
+            isAllInstalled = false;
+            continue;
+        }
+
+        task->isInstalled = true;
+        pthread_mutex_unlock(&mStartupTaskMutex);
+        task->install(task->result, task->arg);
+        pthread_mutex_lock(&mStartupTaskMutex);
+    }
+
+    // Recycle the list, later tasks start a new timer.
+    if (isAllInstalled) {
+        mStartupTaskCount = 0;
+        mStartupTaskNextBuild = 0;
+        mIsInstallTimerAdded = false;
+    }
+    pthread_mutex_unlock(&mStartupTaskMutex);
+
+    return !isAllInstalled;
+}
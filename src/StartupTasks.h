@@ -0,0 +1,50 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <gtk/gtk.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define STARTUP_TASKS_MAX 32
+#define STARTUP_TASKS_MAX_THREADS 4
+
+// Time between installs of finished tasks.
+#define time_install_startup_tasks 0.02
+
+// Builds a result off the main thread. No X or GTK calls.
+typedef void* (*StartupBuildMethod)(void* arg);
+
+// Installs a built result, on the main thread.
+typedef void (*StartupInstallMethod)(void* result, void* arg);
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void addStartupTask(StartupBuildMethod build,
+    StartupInstallMethod install, void* arg);
+
+void* execStartupTaskThread();
+int installStartupTasks();
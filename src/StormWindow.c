@@ -32,6 +32,7 @@
 #include "debug.h"
 #include "StormWindow.h"
 #include "windows.h"
+#include "XTraffic.h"
 
 
 /** *********************************************************************
@@ -0,0 +1,151 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <X11/Xlib.h>
+
+#include <gtk/gtk.h>
+
+#include "Benchmark.h"
+#include "Flags.h"
+#include "plasmasnow.h"
+#include "PowerPolicy.h"
+#include "Scheduler.h"
+#include "Suspend.h"
+#include "Utils.h"
+#include "windows.h"
+#include "XTraffic.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+
+// Set on the main thread; threads park on the condition.
+static pthread_mutex_t mSuspendMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mSuspendCondition = PTHREAD_COND_INITIALIZER;
+static bool mIsSuspended = false;
+
+// A full screen override-redirect window, a screen locker
+// or screensaver, covering the snow.
+static Window mScreenCoverWindow = None;
+
+
+/** *********************************************************************
+ ** Add suspend check to mainloop. It keeps running while
+ ** the simulation timers are parked.
+ **/
+void startSuspendMonitor() {
+    if (isBenchmarkActive()) {
+        return;
+    }
+    addMethodToMainloop(PRIORITY_DEFAULT,
+        TIME_BETWEEN_SUSPEND_CHECKS, execSuspendMonitor);
+}
+
+/** *********************************************************************
+ ** This method suspends the simulation while its workspace
+ ** isn't shown, the screen is covered, or the power policy
+ ** pauses it, and resumes it.
+ **/
+int execSuspendMonitor() {
+    const bool isShutdown = Flags.shutdownRequested;
+    const bool wantSuspended = !isShutdown && !mGlobal.XscreensaverMode &&
+        (!WorkspaceActive() || mScreenCoverWindow != None ||
+        isPowerPolicyPaused());
+
+    if (wantSuspended != mIsSuspended) {
+        if (Flags.Noisy) {
+            printf("plasmasnow: simulation %s.\n",
+                wantSuspended ? "suspended" : "resumed");
+        }
+        if (wantSuspended) {
+            suspendSchedulerTasks();
+        } else {
+            resumeSchedulerTasks();
+        }
+
+        pthread_mutex_lock(&mSuspendMutex);
+        mIsSuspended = wantSuspended;
+        pthread_cond_broadcast(&mSuspendCondition);
+        pthread_mutex_unlock(&mSuspendMutex);
+    }
+
+    return !isShutdown;
+}
+
+/** *********************************************************************
+ ** Helpers.
+ **/
+bool isSimulationSuspended() {
+    return mIsSuspended;
+}
+
+/** *********************************************************************
+ ** This method parks the calling thread until the simulation
+ ** resumes, or shuts down.
+ **/
+void waitWhileSimulationSuspended() {
+    pthread_mutex_lock(&mSuspendMutex);
+    while (mIsSuspended && !Flags.shutdownRequested) {
+        pthread_cond_wait(&mSuspendCondition, &mSuspendMutex);
+    }
+    pthread_mutex_unlock(&mSuspendMutex);
+}
+
+/** *********************************************************************
+ ** This method notes a mapped window that covers the screen
+ ** and no window manager manages, the usual way a screen
+ ** locker or screensaver shows.
+ **/
+void onScreenCoverMapped(XEvent* event) {
+    const Window window = event->xmap.window;
+    if (!event->xmap.override_redirect || window == mGlobal.SnowWin) {
+        return;
+    }
+
+    XWindowAttributes attributes;
+    if (!XGetWindowAttributes(mGlobal.display, window, &attributes)) {
+        return;
+    }
+    if (attributes.x <= 0 && attributes.y <= 0 &&
+        attributes.x + attributes.width >=
+            DisplayWidth(mGlobal.display, mGlobal.Screen) &&
+        attributes.y + attributes.height >=
+            DisplayHeight(mGlobal.display, mGlobal.Screen)) {
+        mScreenCoverWindow = window;
+    }
+}
+
+/** *********************************************************************
+ ** This method drops the screen cover when it's unmapped
+ ** or destroyed.
+ **/
+void onScreenCoverUnmapped(XEvent* event) {
+    const Window window = (event->type == UnmapNotify) ?
+        event->xunmap.window : event->xdestroywindow.window;
+    if (window == mScreenCoverWindow) {
+        mScreenCoverWindow = None;
+    }
+}
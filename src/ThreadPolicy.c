@@ -0,0 +1,163 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE       // pthread_setname_np(), sched_setaffinity().
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "Flags.h"
+#include "plasmasnow.h"
+#include "ThreadPolicy.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * Threads register themselves from their own start, so
+ * their kernel thread ids are known. -lowprio then gives the
+ * background ones, and with -lowpriorender the drawing ones
+ * too, SCHED_IDLE or a niceness, and -threadaffinity a cpu
+ * mask. Default threads are left as created.
+ */
+typedef struct _PolicyThread {
+        pid_t tid;
+        bool isRender;
+} PolicyThread;
+
+static PolicyThread mPolicyThreads[THREAD_POLICY_MAX_THREADS];
+static int mPolicyThreadCount = 0;
+
+// Once a policy was applied, turning it off restores defaults.
+static bool mPolicyApplied = false;
+
+static pthread_mutex_t mPolicyMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/** *********************************************************************
+ ** This method applies the current policy to one thread.
+ ** Failures, like a niceness the user may not lower again,
+ ** are reported with -noisy only.
+ ** threads: locking by caller
+ **/
+static void applyThreadPolicyTo(const PolicyThread* thread) {
+    const bool isLow = (Flags.LowPrio || Flags.SchedIdle) &&
+        (!thread->isRender || Flags.LowPrioRender);
+    if (!isLow && !mPolicyApplied && !Flags.ThreadAffinity) {
+        return;
+    }
+
+    struct sched_param param = { 0 };
+    int policy = SCHED_OTHER;
+#ifdef SCHED_IDLE
+    if (isLow && Flags.SchedIdle) {
+        policy = SCHED_IDLE;
+    }
+#endif
+    if (sched_setscheduler(thread->tid, policy, &param) != 0 &&
+        Flags.Noisy) {
+        perror("plasmasnow: sched_setscheduler");
+    }
+
+    const int nice = isLow && !Flags.SchedIdle ? Flags.ThreadNice : 0;
+    if (setpriority(PRIO_PROCESS, thread->tid, nice) != 0 &&
+        Flags.Noisy) {
+        perror("plasmasnow: setpriority");
+    }
+
+    // The mask holds for background threads, and for drawing
+    // ones when they are low priority too.
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    const bool isMasked = Flags.ThreadAffinity &&
+        (!thread->isRender || Flags.LowPrioRender);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!isMasked || (cpu < (int) (8 * sizeof(int)) &&
+            (Flags.ThreadAffinity >> cpu) & 1)) {
+            CPU_SET(cpu, &cpus);
+        }
+    }
+    if (sched_setaffinity(thread->tid, sizeof(cpus), &cpus) != 0 &&
+        Flags.Noisy) {
+        perror("plasmasnow: sched_setaffinity");
+    }
+
+    mPolicyApplied = true;
+}
+
+/** *********************************************************************
+ ** This method names the calling thread, as shown by top -H
+ ** and perf, and puts it under the thread policy. An index
+ ** of -1 adds none to the name.
+ **/
+void registerPolicyThread(const char* name, int index, bool isRender) {
+    char threadName[THREAD_POLICY_NAME_LENGTH];
+    if (index < 0) {
+        snprintf(threadName, sizeof(threadName), "%s", name);
+    } else {
+        snprintf(threadName, sizeof(threadName), "%s-%d", name, index);
+    }
+    pthread_setname_np(pthread_self(), threadName);
+
+    pthread_mutex_lock(&mPolicyMutex);
+    if (mPolicyThreadCount < THREAD_POLICY_MAX_THREADS) {
+        PolicyThread* thread = &mPolicyThreads[mPolicyThreadCount++];
+        thread->tid = (pid_t) syscall(SYS_gettid);
+        thread->isRender = isRender;
+        applyThreadPolicyTo(thread);
+    }
+    pthread_mutex_unlock(&mPolicyMutex);
+}
+
+/** *********************************************************************
+ ** This method puts the main thread, which draws, under the
+ ** thread policy. Its name is left as is.
+ **/
+void registerMainPolicyThread() {
+    pthread_mutex_lock(&mPolicyMutex);
+    if (mPolicyThreadCount < THREAD_POLICY_MAX_THREADS) {
+        PolicyThread* thread = &mPolicyThreads[mPolicyThreadCount++];
+        thread->tid = (pid_t) syscall(SYS_gettid);
+        thread->isRender = true;
+        applyThreadPolicyTo(thread);
+    }
+    pthread_mutex_unlock(&mPolicyMutex);
+}
+
+/** *********************************************************************
+ ** This method applies a changed policy to all registered
+ ** threads.
+ **/
+void applyThreadPolicy() {
+    pthread_mutex_lock(&mPolicyMutex);
+    for (int i = 0; i < mPolicyThreadCount; i++) {
+        applyThreadPolicyTo(&mPolicyThreads[i]);
+    }
+    pthread_mutex_unlock(&mPolicyMutex);
+}
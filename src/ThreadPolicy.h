@@ -0,0 +1,42 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+// Most threads the policy is kept for.
+#define THREAD_POLICY_MAX_THREADS 64
+
+// Linux keeps thread names to 15 chars.
+#define THREAD_POLICY_NAME_LENGTH 16
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void registerPolicyThread(const char* name, int index, bool isRender);
+void registerMainPolicyThread();
+void applyThreadPolicy();
@@ -0,0 +1,435 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <gtk/gtk.h>
+
+#include "debug.h"
+#include "FlakeKernels.h"
+#include "Flags.h"
+#include "plasmasnow.h"
+#include "safe_malloc.h"
+#include "ThreadPolicy.h"
+#include "TileRaster.h"
+#include "Utils.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * Optional parallel rasterizer for layers made of many
+ * small blits (flakes, fallen snow). It only runs when the
+ * frame target is a client side image, the MIT-SHM path.
+ * The frame is split into horizontal tiles, each blit is
+ * bucketed into the tiles it touches, and a fixed pool of
+ * workers draws one tile each into its own image surface
+ * over that band of the frame memory. The main thread
+ * waits for all tiles, so layers keep their stacking order.
+ *
+ * Blits only reference their source surfaces, so a caller
+ * keeps them stable (e.g. hold the FallenSnow swap
+ * semaphore) from beginTileLayer() to drawTileLayer().
+ *
+ * With -pixelraster, ARGB32 blits and A8 mask blits skip
+ * cairo and blend straight into the frame memory, and
+ * without worker threads the one tile is drawn inline.
+ */
+typedef struct _RasterTile {
+        pthread_t thread;
+        sem_t startSemaphore;
+
+        int y, height;
+        cairo_surface_t* surface;
+
+        uint32_t* data;           // band of the frame memory
+        int stride;               // in pixels
+
+        TileBlit* blits;
+        int blitCount;
+        int blitCapacity;
+} RasterTile;
+
+RasterTile mRasterTiles[TILE_RASTER_MAX_THREADS];
+int mRasterThreadCount = 0;
+sem_t mRasterDoneSemaphore;
+
+// Blend ARGB32 blits by hand, -pixelraster.
+bool mRasterIsDirect = false;
+
+// Current layer, set by beginTileLayer().
+int mRasterTileCount = 0;
+int mRasterOffsetX = 0;
+int mRasterOffsetY = 0;
+int mRasterClipX = 0;
+int mRasterClipWidth = 0;
+int mRasterTargetWidth = 0;
+cairo_surface_t* mRasterTarget = NULL;
+
+// Set by the main thread, read by the workers.
+atomic_bool mRasterStopping = false;
+
+
+/** *********************************************************************
+ ** This method blends one blit into the band of a tile by
+ ** hand, clipped to the tile and the source. Returns false
+ ** if the source isn't ARGB32 (A8 for a mask), for cairo to
+ ** draw it.
+ **/
+static bool blendRasterBlit(RasterTile* tile, const TileBlit* blit,
+    int x, int y) {
+    cairo_surface_t* source = blit->source;
+    const cairo_format_t format = blit->isMask ?
+        CAIRO_FORMAT_A8 : CAIRO_FORMAT_ARGB32;
+    if (cairo_surface_get_type(source) != CAIRO_SURFACE_TYPE_IMAGE ||
+        cairo_image_surface_get_format(source) != format) {
+        return false;
+    }
+
+    int left = x;
+    int top = y;
+    int right = x + blit->w;
+    int bottom = y + blit->h;
+
+    // Clip to the layer and the tile band.
+    const int clipRight = mRasterClipX + mRasterClipWidth;
+    left = left > mRasterClipX ? left : mRasterClipX;
+    left = left > 0 ? left : 0;
+    top = top > 0 ? top : 0;
+    right = right < clipRight ? right : clipRight;
+    right = right < mRasterTargetWidth ? right : mRasterTargetWidth;
+    bottom = bottom < tile->height ? bottom : tile->height;
+
+    // And to the source.
+    const int sourceRight = x - blit->sourceX +
+        cairo_image_surface_get_width(source);
+    const int sourceBottom = y - blit->sourceY +
+        cairo_image_surface_get_height(source);
+    left = left > x - blit->sourceX ? left : x - blit->sourceX;
+    top = top > y - blit->sourceY ? top : y - blit->sourceY;
+    right = right < sourceRight ? right : sourceRight;
+    bottom = bottom < sourceBottom ? bottom : sourceBottom;
+
+    if (right <= left || bottom <= top) {
+        return true;
+    }
+
+    uint32_t* dst = tile->data + (size_t) top * tile->stride + left;
+    if (blit->isMask) {
+        const int maskStride = cairo_image_surface_get_stride(source);
+        const uint8_t* maskData = cairo_image_surface_get_data(source) +
+            (size_t) (blit->sourceY + top - y) * maskStride +
+            (blit->sourceX + left - x);
+
+        const uint32_t color = 0xff000000u |
+            (uint32_t) lrint(blit->color.red * 255) << 16 |
+            (uint32_t) lrint(blit->color.green * 255) << 8 |
+            (uint32_t) lrint(blit->color.blue * 255);
+
+        flakeKernelsBlendMask(dst, tile->stride, maskData, maskStride,
+            right - left, bottom - top, color, lrint(blit->alpha * 256));
+        return true;
+    }
+
+    const int sourceStride = cairo_image_surface_get_stride(source) / 4;
+    const uint32_t* sourceData =
+        (const uint32_t*) cairo_image_surface_get_data(source) +
+        (size_t) (blit->sourceY + top - y) * sourceStride +
+        (blit->sourceX + left - x);
+
+    flakeKernelsBlendOver(dst, tile->stride, sourceData, sourceStride,
+        right - left, bottom - top, lrint(blit->alpha * 256));
+    return true;
+}
+
+/** *********************************************************************
+ ** Worker. Draws the blits of one tile into its band.
+ **/
+static void drawRasterTile(RasterTile* tile) {
+    if (!tile->blitCount) {
+        return;
+    }
+
+    cairo_t* cr = cairo_create(tile->surface);
+    cairo_rectangle(cr, mRasterClipX, 0, mRasterClipWidth, tile->height);
+    cairo_clip(cr);
+
+    // Hand blending and cairo take turns on the band, each
+    // sees what the other wrote.
+    bool isBlended = false;
+    bool isPainted = false;
+    for (int i = 0; i < tile->blitCount; i++) {
+        const TileBlit* blit = &tile->blits[i];
+        const int x = blit->x + mRasterOffsetX;
+        const int y = blit->y + mRasterOffsetY - tile->y;
+
+        if (mRasterIsDirect && tile->data) {
+            if (isPainted) {
+                cairo_surface_flush(tile->surface);
+                isPainted = false;
+            }
+            if (blendRasterBlit(tile, blit, x, y)) {
+                isBlended = true;
+                continue;
+            }
+        }
+
+        if (isBlended) {
+            cairo_surface_mark_dirty(tile->surface);
+            isBlended = false;
+        }
+        isPainted = true;
+
+        if (blit->isMask) {
+            cairo_save(cr);
+            cairo_set_source_rgba(cr, blit->color.red, blit->color.green,
+                blit->color.blue, blit->alpha);
+            cairo_rectangle(cr, x, y, blit->w, blit->h);
+            cairo_clip(cr);
+            cairo_mask_surface(cr, blit->source,
+                x - blit->sourceX, y - blit->sourceY);
+            cairo_restore(cr);
+            continue;
+        }
+
+        cairo_set_source_surface(cr, blit->source,
+            x - blit->sourceX, y - blit->sourceY);
+        cairo_pattern_set_filter(cairo_get_source(cr),
+            CAIRO_FILTER_NEAREST);
+
+        cairo_save(cr);
+        cairo_rectangle(cr, x, y, blit->w, blit->h);
+        cairo_clip(cr);
+        my_cairo_paint_with_alpha(cr, blit->alpha);
+        cairo_restore(cr);
+    }
+
+    cairo_destroy(cr);
+    cairo_surface_flush(tile->surface);
+}
+
+static void* execRasterThread(void* arg) {
+    RasterTile* tile = (RasterTile*) arg;
+    registerPolicyThread("ps-tile", (int) (tile - mRasterTiles), true);
+
+    while (true) {
+        sem_wait(&tile->startSemaphore);
+        if (atomic_load(&mRasterStopping)) {
+            break;
+        }
+        drawRasterTile(tile);
+        sem_post(&mRasterDoneSemaphore);
+    }
+
+    return NULL;
+}
+
+/** *********************************************************************
+ ** This method starts the worker pool, sized by -tilethreads.
+ **/
+void initTileRaster() {
+    mRasterIsDirect = Flags.PixelRaster;
+
+    mRasterThreadCount = Flags.TileThreads;
+    if (mRasterThreadCount > TILE_RASTER_MAX_THREADS) {
+        mRasterThreadCount = TILE_RASTER_MAX_THREADS;
+    }
+    if (mRasterThreadCount < 2) {
+        mRasterThreadCount = 0;
+        return;
+    }
+
+    sem_init(&mRasterDoneSemaphore, 0, 0);
+    for (int i = 0; i < mRasterThreadCount; i++) {
+        RasterTile* tile = &mRasterTiles[i];
+        sem_init(&tile->startSemaphore, 0, 0);
+        pthread_create(&tile->thread, NULL, execRasterThread, tile);
+    }
+    P("tile raster: %d threads\n", mRasterThreadCount);
+}
+
+void stopTileRaster() {
+    if (!mRasterThreadCount) {
+        return;
+    }
+
+    atomic_store(&mRasterStopping, true);
+    for (int i = 0; i < mRasterThreadCount; i++) {
+        sem_post(&mRasterTiles[i].startSemaphore);
+    }
+    for (int i = 0; i < mRasterThreadCount; i++) {
+        pthread_join(mRasterTiles[i].thread, NULL);
+        free(mRasterTiles[i].blits);
+        mRasterTiles[i].blits = NULL;
+    }
+    mRasterThreadCount = 0;
+}
+
+/** *********************************************************************
+ ** This method decides if a frame is tiled: workers
+ ** running and an image surface to split.
+ **/
+bool isTileRasterActive(cairo_t* cc) {
+    return (mRasterThreadCount > 0 || mRasterIsDirect) &&
+        cairo_surface_get_type(cairo_get_target(cc)) ==
+            CAIRO_SURFACE_TYPE_IMAGE;
+}
+
+/** *********************************************************************
+ ** This method starts a layer. Tiles cover the clip of cc,
+ ** blits are given in the user coordinates of cc.
+ **/
+void beginTileLayer(cairo_t* cc) {
+    mRasterTarget = cairo_get_target(cc);
+    cairo_surface_flush(mRasterTarget);
+
+    double dx = 0, dy = 0;
+    cairo_user_to_device(cc, &dx, &dy);
+    mRasterOffsetX = lrint(dx);
+    mRasterOffsetY = lrint(dy);
+
+    double x1, y1, x2, y2;
+    cairo_clip_extents(cc, &x1, &y1, &x2, &y2);
+    cairo_user_to_device(cc, &x1, &y1);
+    cairo_user_to_device(cc, &x2, &y2);
+
+    const int targetHeight = cairo_image_surface_get_height(mRasterTarget);
+    const int top = y1 < 0 ? 0 : lrint(y1);
+    int bottom = lrint(y2);
+    if (bottom > targetHeight) {
+        bottom = targetHeight;
+    }
+    mRasterClipX = lrint(x1);
+    mRasterClipWidth = lrint(x2 - x1);
+
+    // Equal bands, but not too thin. Inline, just one.
+    mRasterTileCount = mRasterThreadCount > 0 ? mRasterThreadCount : 1;
+    const int clipHeight = bottom > top ? bottom - top : 1;
+    while (mRasterTileCount > 1 && clipHeight / mRasterTileCount <
+        TILE_RASTER_MIN_TILE_HEIGHT) {
+        mRasterTileCount--;
+    }
+
+    unsigned char* data = cairo_image_surface_get_data(mRasterTarget);
+    const cairo_format_t format =
+        cairo_image_surface_get_format(mRasterTarget);
+    const int width = cairo_image_surface_get_width(mRasterTarget);
+    const int stride = cairo_image_surface_get_stride(mRasterTarget);
+    mRasterTargetWidth = width;
+
+    for (int i = 0; i < mRasterTileCount; i++) {
+        RasterTile* tile = &mRasterTiles[i];
+        tile->y = top + clipHeight * i / mRasterTileCount;
+        tile->height = top + clipHeight * (i + 1) / mRasterTileCount -
+            tile->y;
+        tile->blitCount = 0;
+
+        if (tile->surface) {
+            cairo_surface_destroy(tile->surface);
+        }
+        tile->surface = cairo_image_surface_create_for_data(
+            data + (size_t) tile->y * stride, format, width,
+            tile->height, stride);
+
+        // Hand blending needs 32 bit pixels.
+        const bool is32Bit = format == CAIRO_FORMAT_ARGB32 ||
+            format == CAIRO_FORMAT_RGB24;
+        tile->data = is32Bit ?
+            (uint32_t*) (data + (size_t) tile->y * stride) : NULL;
+        tile->stride = stride / 4;
+    }
+}
+
+/** *********************************************************************
+ ** This method buckets one blit into every tile it touches.
+ **/
+static void bucketTileBlit(const TileBlit* blit) {
+    const int top = blit->y + mRasterOffsetY;
+    const int bottom = top + blit->h;
+
+    for (int i = 0; i < mRasterTileCount; i++) {
+        RasterTile* tile = &mRasterTiles[i];
+        if (bottom <= tile->y || top >= tile->y + tile->height) {
+            continue;
+        }
+
+        if (tile->blitCount == tile->blitCapacity) {
+            tile->blitCapacity = tile->blitCapacity ?
+                2 * tile->blitCapacity : 256;
+            tile->blits = realloc(tile->blits,
+                sizeof(*tile->blits) * tile->blitCapacity);
+            REALLOC_CHECK(tile->blits);
+        }
+
+        tile->blits[tile->blitCount++] = *blit;
+    }
+}
+
+/** *********************************************************************
+ ** This method adds a box copied from source.
+ **/
+void addTileBlit(cairo_surface_t* source, int sourceX, int sourceY,
+    int x, int y, int w, int h, double alpha) {
+    const TileBlit blit = {
+        .source = source, .sourceX = sourceX, .sourceY = sourceY,
+        .x = x, .y = y, .w = w, .h = h, .alpha = alpha,
+        .isMask = false,
+    };
+    bucketTileBlit(&blit);
+}
+
+/** *********************************************************************
+ ** This method adds a box of color painted through an A8 mask.
+ **/
+void addTileMaskBlit(cairo_surface_t* mask, int sourceX, int sourceY,
+    int x, int y, int w, int h, const GdkRGBA* color, double alpha) {
+    const TileBlit blit = {
+        .source = mask, .sourceX = sourceX, .sourceY = sourceY,
+        .x = x, .y = y, .w = w, .h = h, .alpha = alpha,
+        .isMask = true, .color = *color,
+    };
+    bucketTileBlit(&blit);
+}
+
+/** *********************************************************************
+ ** This method draws the layer on all tiles, and returns
+ ** when they are done.
+ **/
+void drawTileLayer() {
+    if (mRasterThreadCount == 0) {
+        drawRasterTile(&mRasterTiles[0]);
+    } else {
+        for (int i = 0; i < mRasterTileCount; i++) {
+            sem_post(&mRasterTiles[i].startSemaphore);
+        }
+        for (int i = 0; i < mRasterTileCount; i++) {
+            sem_wait(&mRasterDoneSemaphore);
+        }
+    }
+
+    cairo_surface_mark_dirty(mRasterTarget);
+    mRasterTileCount = 0;
+}
@@ -0,0 +1,67 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#include <gtk/gtk.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define TILE_RASTER_MAX_THREADS 16
+
+// Tiles thinner than this are not worth a thread.
+#define TILE_RASTER_MIN_TILE_HEIGHT 64
+
+
+/***********************************************************
+ * One box copied from a source surface, in user
+ * coordinates of the frame context. A mask blit paints
+ * color through an A8 source instead.
+ */
+typedef struct _TileBlit {
+        cairo_surface_t* source;
+        int sourceX, sourceY;
+
+        int x, y, w, h;
+        double alpha;
+
+        bool isMask;
+        GdkRGBA color;
+} TileBlit;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void initTileRaster();
+void stopTileRaster();
+
+bool isTileRasterActive(cairo_t* cc);
+void beginTileLayer(cairo_t* cc);
+void addTileBlit(cairo_surface_t* source, int sourceX, int sourceY,
+    int x, int y, int w, int h, double alpha);
+void addTileMaskBlit(cairo_surface_t* mask, int sourceX, int sourceY,
+    int x, int y, int w, int h, const GdkRGBA* color, double alpha);
+void drawTileLayer();
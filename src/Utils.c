@@ -33,16 +33,22 @@
 
 #include <gtk/gtk.h>
 
+#include "Benchmark.h"
 #include "debug.h"
 #include "Flags.h"
+#include "FrameDamage.h"
 #include "meteor.h"
 #include "mygettext.h"
 #include "plasmasnow.h"
+#include "Random.h"
 #include "safe_malloc.h"
+#include "Scheduler.h"
 #include "Utils.h"
 #include "version.h"
+#include "WindowNames.h"
 #include "windows.h"
 #include "xdo.h"
+#include "XTraffic.h"
 
 void traceback()
 #ifdef TRACEBACK_AVAILALBLE
@@ -124,6 +130,16 @@ void clearDisplayArea(Display *dsp, Window win,
         return;
     }
 
+    // Frame erases merge into one damage region, other
+    // clears go out now and repaint static layers next frame.
+    if (win == mGlobal.SnowWin && !mGlobal.isDoubleBuffered) {
+        if (isCollectingFrameDamage()) {
+            addFrameDamage(x, y, w, h);
+            return;
+        }
+        addPendingDamage(x, y, w, h);
+    }
+
     XClearArea(dsp, win, x, y, w, h, exposures);
 }
 
@@ -170,7 +186,7 @@ int randint(int m) {
     if (m <= 0) {
         return 0;
     }
-    return drand48() * m;
+    return randomUniform() * m;
 }
 // https://www.alanzucconi.com/2015/09/16/how-to-sample-from-a-gaussian-distribution/
 // Interesting but not used now in app
@@ -179,8 +195,8 @@ double gaussian(double mean, double std, double min, double max) {
     do {
         double v1, v2, s;
         do {
-            v1 = 2.0 * drand48() - 1.0;
-            v2 = 2.0 * drand48() - 1.0;
+            v1 = 2.0 * randomUniform() - 1.0;
+            v2 = 2.0 * randomUniform() - 1.0;
             s = v1 * v1 + v2 * v2;
         } while (s >= 1.0 || s == 0);
         x = mean + v1 * sqrt((-2.0 * log(s)) / s) * std;
@@ -188,20 +204,48 @@ double gaussian(double mean, double std, double min, double max) {
     return x;
 }
 
-guint addMethodToMainloop(gint prio, float time, GSourceFunc func) {
-    return g_timeout_add_full(prio, (int) 1000 * (time *
-        (0.95 + 0.1 * drand48())), func, NULL, NULL);
+/** *********************************************************************
+ ** These methods add repeating timers. All share the one
+ ** Scheduler wakeup, named by their method for -perfstats.
+ ** Simulation timers stop while the simulation is suspended.
+ **/
+guint addNamedMethodToMainloop(gint prio, float time,
+    GSourceFunc func, const char* name) {
+    if (isBenchmarkActive()) {
+        return addBenchmarkTimer(prio, time, func, NULL);
+    }
+    return addSchedulerTask(prio, time, func, NULL, name, false);
+}
+
+guint addNamedMethodWithArgToMainloop(gint prio, float time,
+    GSourceFunc func, gpointer datap, const char* name) {
+    if (isBenchmarkActive()) {
+        return addBenchmarkTimer(prio, time, func, datap);
+    }
+    return addSchedulerTask(prio, time, func, datap, name, false);
+}
+
+guint addNamedSimulationMethodToMainloop(gint prio, float time,
+    GSourceFunc func, const char* name) {
+    if (isBenchmarkActive()) {
+        return addBenchmarkTimer(prio, time, func, NULL);
+    }
+    return addSchedulerTask(prio, time, func, NULL, name, true);
 }
 
-guint addMethodWithArgToMainloop(
-    gint prio, float time, GSourceFunc func, gpointer datap) {
-    return g_timeout_add_full(
-        prio, (int)1000 * (time) * (0.95 + 0.1 * drand48()), func, datap, NULL);
+guint addNamedSimulationMethodWithArgToMainloop(gint prio, float time,
+    GSourceFunc func, gpointer datap, const char* name) {
+    if (isBenchmarkActive()) {
+        return addBenchmarkTimer(prio, time, func, datap);
+    }
+    return addSchedulerTask(prio, time, func, datap, name, true);
 }
 
 void remove_from_mainloop(guint *tag) {
-    if (*tag) {
-        g_source_remove(*tag);
+    if (*tag && isBenchmarkActive()) {
+        removeBenchmarkTimer(*tag);
+    } else if (*tag) {
+        removeSchedulerTask(*tag);
     }
     *tag = 0;
 }
@@ -271,7 +315,7 @@ int appScalesHaveChanged(int* prevscale) {
 // double *a: the array to be filled
 // int n:     number of items in array
 // double d:  minimum difference between items
-// unsigned short *seed: NULL: use drand48()
+// unsigned short *seed: NULL: use randomUniform()
 //                       pointer to array of 3 unsigned shorts: use erand48()
 //                       see man drand48
 //
@@ -287,7 +331,7 @@ void randomuniqarray(double *a, int n, double d, unsigned short *seed) {
     } else {
         P("seed = NULL\n");
         for (i = 0; i < n; i++) {
-            a[i] = drand48();
+            a[i] = randomUniform();
         }
     }
     gsl_sort(a, 1, n);
@@ -311,7 +355,7 @@ void randomuniqarray(double *a, int n, double d, unsigned short *seed) {
                 if (seed) {
                     a[i] = erand48(seed);
                 } else {
-                    a[i] = drand48();
+                    a[i] = randomUniform();
                 }
             }
         }
@@ -370,45 +414,10 @@ char *guess_language() {
     return NULL;
 }
 
-// find largest window with name
-Window largest_window_with_name(xdo_t *myxdo, const char *name) {
-    xdo_search_t search;
-
-    memset(&search, 0, sizeof(xdo_search_t));
-
-    search.searchmask = SEARCH_NAME;
-    search.winname = name;
-    search.require = SEARCH_ANY;
-    search.max_depth = 4;
-    search.limit = 0;
-
-    Window *windows = NULL;
-    unsigned int nwindows;
-    xdo_search_windows(myxdo, &search, &windows, &nwindows);
-    P("nwindows: %s %d\n", search.winname, nwindows);
-
-    Window w = 0;
-    unsigned int maxsize = 0;
-    for (unsigned int i = 0; i < nwindows; i++) {
-        unsigned int width, height;
-        xdo_get_window_size(myxdo, windows[i], &width, &height);
-        P("window: 0x%lx %d %d\n", windows[i], width, height);
-
-        unsigned int size = width * height;
-        P("width %d height %d size %d prev maxsize %d\n",
-            width, height, size, maxsize);
-
-        if (size <= maxsize) {
-            continue;
-        }
-        maxsize = size;
-
-        w = windows[i];
-    }
-
-    if (windows) {
-        free(windows);
-    }
-
+// find largest window with name, from the window name index.
+Window largest_window_with_name(__attribute__((unused)) xdo_t *myxdo,
+    const char *name) {
+    const Window w = findLargestWindowWithName(name);
+    P("largest window: %s 0x%lx\n", name, w);
     return w;
 }
@@ -42,8 +42,15 @@
 
 #include "xdo.h"
 
-extern guint addMethodWithArgToMainloop(
-    gint prio, float time, GSourceFunc func, gpointer datap);
+extern guint addNamedMethodWithArgToMainloop(gint prio, float time,
+    GSourceFunc func, gpointer datap, const char *name);
+#define addMethodWithArgToMainloop(prio, time, func, datap) \
+    addNamedMethodWithArgToMainloop(prio, time, func, datap, #func)
+extern guint addNamedSimulationMethodWithArgToMainloop(gint prio,
+    float time, GSourceFunc func, gpointer datap, const char *name);
+#define addSimulationMethodWithArgToMainloop(prio, time, func, datap) \
+    addNamedSimulationMethodWithArgToMainloop(prio, time, func, datap, \
+        #func)
 
 extern void remove_from_mainloop(guint *tag);
 extern void clearGlobalSnowWindow(void);
@@ -60,8 +67,10 @@ extern Pixel AllocNamedColor(const char *colorName, Pixel dfltPix);
 #ifdef __cplusplus
 extern "C" {
 #endif
-    guint addMethodToMainloop(gint prio, float time,
-        GSourceFunc func);
+    guint addNamedMethodToMainloop(gint prio, float time,
+        GSourceFunc func, const char* name);
+    guint addNamedSimulationMethodToMainloop(gint prio, float time,
+        GSourceFunc func, const char* name);
     int randint(int m);
     void clearDisplayArea(Display* display,
         Window win, int x, int y, int w, int h,
@@ -71,6 +80,10 @@ extern "C" {
 #ifdef __cplusplus
 }
 #endif
+#define addMethodToMainloop(prio, time, func) \
+    addNamedMethodToMainloop(prio, time, func, #func)
+#define addSimulationMethodToMainloop(prio, time, func) \
+    addNamedSimulationMethodToMainloop(prio, time, func, #func)
 
 extern void rgba2color(GdkRGBA* c, char** s);
 
@@ -32,20 +32,27 @@
 #include <ctype.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xutil.h>
+#include <xcb/xcb.h>
 
 #include "ColorCodes.h"
 #include "dsimple.h"
+#include "hashtable.h"
 #include "safe_malloc.h"
 #include "windows.h"
 #include "WinInfo.h"
+#include "XAtoms.h"
 #include "vroot.h"
+#include "XTraffic.h"
 
 
 /** *********************************************************************
@@ -54,41 +61,177 @@
 #define MAX_TITLE_STRING_LENGTH 40
 char mWinInfoTitleOfWindow[MAX_TITLE_STRING_LENGTH + 1];
 
+// X events queue the windows that changed, and the list
+// is patched from them. Only changes of the client list
+// (sync) or lost track (rescan) re-read more than that.
+#define MAX_PENDING_WININFO_UPDATES 64
+
+Window mPendingWinInfoWindows[MAX_PENDING_WININFO_UPDATES];
+int mPendingWinInfoCount = 0;
+
+bool mWinInfoSyncNeeded = false;
+bool mWinInfoRescanNeeded = false;
+
+// Outstanding XCB requests of one window in a batch.
+typedef struct _WinInfoCookies {
+        xcb_get_window_attributes_cookie_t attributes;
+        xcb_get_geometry_cookie_t geometry;
+        xcb_translate_coordinates_cookie_t toRoot;
+        xcb_translate_coordinates_cookie_t toSnowWin;
+
+        xcb_get_property_cookie_t netDesktop;
+        xcb_get_property_cookie_t winWorkspace;
+        xcb_get_property_cookie_t netState;
+        xcb_get_property_cookie_t wmState;
+        xcb_get_property_cookie_t windowType;
+        xcb_get_property_cookie_t gtkExtents;
+        xcb_get_property_cookie_t netExtents;
+} WinInfoCookies;
+
+// Window and frame ids to their winInfoList entry, rebuilt
+// whenever the list is replaced.
+WindowMap* mWinInfoIndex = NULL;
+WindowMap* mWinInfoFrameIndex = NULL;
+
+// The list in use and a spare one that re-reads fill, swapped
+// on install so rescans reuse memory instead of mallocing.
+int mWinInfoListCapacity = 0;
+WinInfo* mSpareWinInfoList = NULL;
+int mSpareWinInfoCapacity = 0;
+
 
 /** *********************************************************************
- ** This method scans all WinInfos for a requested ID.
+ ** These methods look up a WinInfo by its window, or by
+ ** the frame around it.
  **/
 WinInfo* getWinInfoForWindow(Window window) {
+    if (!mWinInfoIndex) {
+        return NULL;
+    }
+    return (WinInfo*) windowMapGet(mWinInfoIndex, window);
+}
+
+WinInfo* getWinInfoForFrame(Window frame) {
+    if (!mWinInfoFrameIndex || frame == None) {
+        return NULL;
+    }
+    return (WinInfo*) windowMapGet(mWinInfoFrameIndex, frame);
+}
+
+/** *********************************************************************
+ ** This method re-indexes the global WinInfo list.
+ **/
+static void rebuildWinInfoIndex() {
+    if (!mWinInfoIndex) {
+        mWinInfoIndex = windowMapCreate();
+        mWinInfoFrameIndex = windowMapCreate();
+    }
+    windowMapClear(mWinInfoIndex);
+    windowMapClear(mWinInfoFrameIndex);
+    windowMapReserve(mWinInfoIndex, mGlobal.winInfoListLength);
+    windowMapReserve(mWinInfoFrameIndex, mGlobal.winInfoListLength);
+
     WinInfo* winInfoItem = mGlobal.winInfoList;
     for (int i = 0; i < mGlobal.winInfoListLength; i++) {
-        if (winInfoItem->window == window) {
-            return winInfoItem;
+        windowMapInsert(mWinInfoIndex, winInfoItem->window, winInfoItem);
+        if (winInfoItem->frame != None &&
+            winInfoItem->frame != winInfoItem->window) {
+            windowMapInsert(mWinInfoFrameIndex, winInfoItem->frame,
+                winInfoItem);
         }
         winInfoItem++;
     }
+}
+
+/** *********************************************************************
+ ** This method makes a list the global one. The list is
+ ** either the spare one, or caller owned. The old list
+ ** becomes the spare.
+ **/
+static void installWinInfoList(WinInfo* winInfoList, int listCount) {
+    WinInfo* oldList = mGlobal.winInfoList;
+    const int oldCapacity = mWinInfoListCapacity;
+
+    if (winInfoList == mSpareWinInfoList) {
+        mWinInfoListCapacity = mSpareWinInfoCapacity;
+    } else {
+        free(mSpareWinInfoList);
+        mWinInfoListCapacity = listCount;
+    }
+    mSpareWinInfoList = oldList;
+    mSpareWinInfoCapacity = oldCapacity;
 
-    return NULL;
+    mGlobal.winInfoList = winInfoList;
+    mGlobal.winInfoListLength = listCount;
 }
 
 /** *********************************************************************
- ** This method populates the global WinInfo list.
+ ** This method populates the global WinInfo list, re-reading
+ ** every window. Known frames are kept, they never change.
  **/
 void getWinInfoForAllWindows() {
-    if (mGlobal.winInfoList) {
-        free(mGlobal.winInfoList);
+    WinInfo* newList = NULL;
+    int newListLength = 0;
+    getInitialWinInfoList(&newList, &newListLength);
+
+    for (int i = 0; i < newListLength; i++) {
+        const WinInfo* oldItem = getWinInfoForWindow(newList[i].window);
+        newList[i].frame = oldItem ? oldItem->frame : None;
     }
 
-    getInitialWinInfoList(&mGlobal.winInfoList,
-        &mGlobal.winInfoListLength);
+    installWinInfoList(newList, newListLength);
+
     getFinalWinInfoList(&mGlobal.winInfoList,
         &mGlobal.winInfoListLength);
+    rebuildWinInfoIndex();
+
+    mPendingWinInfoCount = 0;
+    mWinInfoSyncNeeded = false;
+    mWinInfoRescanNeeded = false;
+}
+
+/** *********************************************************************
+ ** This method installs a caller built WinInfo list, taking
+ ** ownership, in place of X queries. Used by -benchmark.
+ **/
+void setWinInfoList(WinInfo* winInfoList, int listCount) {
+    installWinInfoList(winInfoList, listCount);
+    rebuildWinInfoIndex();
+
+    mPendingWinInfoCount = 0;
+    mWinInfoSyncNeeded = false;
+    mWinInfoRescanNeeded = false;
 }
 
 /** *********************************************************************
- ** This method gets our initial winInfoList list from 1 of 3 places.
+ ** This method copies one window list into the spare WinInfo
+ ** list, growing it when needed.
+ **/
+static void setWinInfoListWindows(WinInfo** winInfoList,
+    int* numberOfWindows, const Window* windows, int windowCount) {
+    if (windowCount > mSpareWinInfoCapacity) {
+        mSpareWinInfoCapacity = windowCount + windowCount / 2;
+        mSpareWinInfoList = (WinInfo*) realloc(mSpareWinInfoList,
+            mSpareWinInfoCapacity * sizeof(WinInfo));
+        REALLOC_CHECK(mSpareWinInfoList);
+    }
+    (*winInfoList) = mSpareWinInfoList;
+    (*numberOfWindows) = windowCount;
+
+    for (int i = 0; i < windowCount; i++) {
+        (*winInfoList)[i].window = windows[i];
+        (*winInfoList)[i].frame = None;
+    }
+}
+
+/** *********************************************************************
+ ** This method gets our initial winInfoList list from 1 of 3 places,
+ ** into the spare list. Install it before the next call.
  **/
 void getInitialWinInfoList(WinInfo** winInfoList,
     int* numberOfWindows) {
+    (*winInfoList) = NULL;
+    (*numberOfWindows) = 0;
 
     // #1 Look for list in NET_CLIENT.
     Atom type;
@@ -98,22 +241,13 @@ void getInitialWinInfoList(WinInfo** winInfoList,
     Window* children;
 
     XGetWindowProperty(mGlobal.display, DefaultRootWindow(mGlobal.display),
-        XInternAtom(mGlobal.display, "_NET_CLIENT_LIST", False),
+        getXAtom(ATOM_NET_CLIENT_LIST),
         0, 1000000, False, AnyPropertyType, &type,
         &format, &nchildren, &unusedBytes, (unsigned char **) &children);
 
     if (type == XA_WINDOW && nchildren > 0) {
-        (*winInfoList) = (WinInfo*) malloc(nchildren* sizeof(WinInfo));
-        (*numberOfWindows) = nchildren;
-
-        WinInfo* addWinInfo = *winInfoList;
-        Window* addWindow = children;
-        for (long unsigned int i = 0; i <= nchildren; i++) {
-            addWinInfo->window = *addWindow;
-            addWinInfo++;
-            addWindow++;
-        }
-
+        setWinInfoListWindows(winInfoList, numberOfWindows,
+            children, nchildren);
         XFree(children);
         return;
     }
@@ -122,22 +256,13 @@ void getInitialWinInfoList(WinInfo** winInfoList,
     // #2, Else look for list in WIN_CLIENT.
     children = NULL;
     XGetWindowProperty(mGlobal.display, DefaultRootWindow(mGlobal.display),
-        XInternAtom(mGlobal.display, "_WIN_CLIENT_LIST", False),
+        getXAtom(ATOM_WIN_CLIENT_LIST),
         0, 1000000, False, AnyPropertyType, &type,
         &format, &nchildren, &unusedBytes, (unsigned char **) &children);
 
     if (type == XA_WINDOW && nchildren > 0) {
-        (*winInfoList) = (WinInfo*) malloc(nchildren* sizeof(WinInfo));
-        (*numberOfWindows) = nchildren;
-
-        WinInfo* addWinInfo = *winInfoList;
-        Window* addWindow = children;
-        for (long unsigned int i = 0; i <= nchildren; i++) {
-            addWinInfo->window = *addWindow;
-            addWinInfo++;
-            addWindow++;
-        }
-
+        setWinInfoListWindows(winInfoList, numberOfWindows,
+            children, nchildren);
         XFree(children);
         return;
     }
@@ -152,17 +277,8 @@ void getInitialWinInfoList(WinInfo** winInfoList,
         &unused, &unused, &children, &queryChildrenCount);
 
     if (queryChildrenCount > 0) {
-        (*winInfoList) = (WinInfo*)
-            malloc(queryChildrenCount* sizeof(WinInfo));
-        (*numberOfWindows) = queryChildrenCount;
-
-        WinInfo* addWinInfo = *winInfoList;
-        Window* addWindow = children;
-        for (long unsigned int i = 0; i <= nchildren; i++) {
-            addWinInfo->window = *addWindow;
-            addWinInfo++;
-            addWindow++;
-        }
+        setWinInfoListWindows(winInfoList, numberOfWindows,
+            children, queryChildrenCount);
     }
     XFree(children);
 }
@@ -172,95 +288,432 @@ void getInitialWinInfoList(WinInfo** winInfoList,
  **/
 void getFinalWinInfoList(WinInfo** winInfoList,
     int* numberOfWindows) {
+    const ScratchMark mark = scratch_mark();
+    WinInfo** items = (WinInfo**) scratch_alloc(
+        (*numberOfWindows + 1) * sizeof(WinInfo*));
+    bool* filled = (bool*) scratch_alloc(
+        (*numberOfWindows + 1) * sizeof(bool));
+    MALLOC_CHECK(items);
+    MALLOC_CHECK(filled);
 
-    WinInfo *winInfoItem = (*winInfoList);
     for (int i = 0; i < *numberOfWindows; i++) {
-        // Set WinInfo "workspace", "sticky", and "dock" attributes.
-        winInfoItem->ws = getWorkspaceOfWindow(winInfoItem->window);
-        winInfoItem->sticky = isWindowSticky(winInfoItem->ws,
-            winInfoItem);
-        winInfoItem->dock = isWindowDock(winInfoItem);
-
-        // Set WinInfo "X pos", "Y pos", and "hidden" attribute.
-        XWindowAttributes windowAttributes;
-        XGetWindowAttributes(mGlobal.display, winInfoItem->window,
-            &windowAttributes);
-        winInfoItem->w = windowAttributes.width;
-        winInfoItem->h = windowAttributes.height;
-        winInfoItem->hidden = isWindowHidden(winInfoItem->window,
-            windowAttributes.map_state);
-
-        // Save for later frame extent calculations.
-        int initialWinAttr_XPos = windowAttributes.x;
-        int initialWinAttr_YPos = windowAttributes.y;
-
-        // Set WinInfo "X / Y actual" attributes.
-        int xr, yr;
-        Window child_return;
-        XTranslateCoordinates(mGlobal.display, winInfoItem->window,
-            mGlobal.Rootwindow, 0, 0, &xr, &yr, &child_return);
-        winInfoItem->xa = xr - initialWinAttr_XPos;
-        winInfoItem->ya = yr - initialWinAttr_YPos;
-
-        // Set WinInfo "X / Y position" attributes.
-        XTranslateCoordinates(mGlobal.display, winInfoItem->window,
-            mGlobal.SnowWin, 0, 0, &(winInfoItem->x),
-            &(winInfoItem->y), &child_return);
-
-        // Apply WinInfo frame extent adjustments.
-        enum { NET, GTK };
-        int wintype = GTK;
-
-        Atom type;
-        int format;
-        unsigned long nitems = 0;
-        unsigned long unusedBytes;
-        unsigned char* properties;
-
-        XGetWindowProperty(mGlobal.display, winInfoItem->window,
-            XInternAtom(mGlobal.display, "_GTK_FRAME_EXTENTS", False),
-            0, 4, False, AnyPropertyType, &type, &format,
-            &nitems, &unusedBytes, &properties);
-
-        if (nitems != 4) {
-            XFree(properties);
-            properties = NULL;
-
-            wintype = NET;
-            XGetWindowProperty(mGlobal.display, winInfoItem->window,
-                XInternAtom(mGlobal.display, "_NET_FRAME_EXTENTS", False),
-                0, 4, False, AnyPropertyType, &type, &format,
-                &nitems, &unusedBytes, &properties);
+        items[i] = &(*winInfoList)[i];
+    }
+    fillWinInfos(items, *numberOfWindows, filled);
+
+    // Windows gone since the list was read are dropped.
+    int keptLength = 0;
+    for (int i = 0; i < *numberOfWindows; i++) {
+        if (filled[i]) {
+            (*winInfoList)[keptLength++] = (*winInfoList)[i];
         }
+    }
+    (*numberOfWindows) = keptLength;
 
-        if (nitems == 4 && format == 32 && type) {
-            long* frameExtent;
-            frameExtent = (long *) (void *) properties;
-            switch (wintype) {
-                case NET:
-                    winInfoItem->x -= frameExtent[0];
-                    winInfoItem->y -= frameExtent[2];
-                    winInfoItem->w += frameExtent[0] + frameExtent[1];
-                    winInfoItem->h += frameExtent[2] + frameExtent[3];
-                    break;
-                case GTK:
+    scratch_release(mark);
+}
+
+/** *********************************************************************
+ ** Helper methods for batched XCB fetching.
+ **/
+static xcb_get_property_cookie_t requestProperty(xcb_connection_t* xcb,
+    xcb_window_t window, XAtomId atom, uint32_t length) {
+    return xcb_get_property(xcb, 0, window, getXAtom(atom),
+        XCB_GET_PROPERTY_TYPE_ANY, 0, length);
+}
+
+// Is an atom in a format 32 atom list property.
+static bool hasPropertyAtom(xcb_get_property_reply_t* reply,
+    XAtomId atom) {
+    if (!reply || reply->format != 32) {
+        return false;
+    }
+
+    const xcb_atom_t* atoms = (xcb_atom_t*) xcb_get_property_value(reply);
+    const int count = xcb_get_property_value_length(reply) / 4;
+    for (int i = 0; i < count; i++) {
+        if (atoms[i] == getXAtom(atom)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// First value of a format 32 property, sign extended.
+static bool getPropertyLong(xcb_get_property_reply_t* reply,
+    long* value) {
+    if (!reply || reply->format != 32 ||
+        xcb_get_property_value_length(reply) < 4) {
+        return false;
+    }
+    *value = *(int32_t*) xcb_get_property_value(reply);
+    return true;
+}
+
+/** *********************************************************************
+ ** This method finds, for all items without one, the child of
+ ** the root window holding them. With a reparenting window
+ ** manager that is the frame, which root SubstructureNotify
+ ** events name. Walks up one tree level per batch.
+ **/
+static void fetchWinInfoFrames(xcb_connection_t* xcb,
+    WinInfo** items, int count) {
+    const ScratchMark mark = scratch_mark();
+    xcb_window_t* nodes = (xcb_window_t*) scratch_alloc(
+        (count + 1) * sizeof(xcb_window_t));
+    xcb_query_tree_cookie_t* cookies = (xcb_query_tree_cookie_t*)
+        scratch_alloc((count + 1) * sizeof(xcb_query_tree_cookie_t));
+    MALLOC_CHECK(nodes);
+    MALLOC_CHECK(cookies);
+
+    for (int i = 0; i < count; i++) {
+        nodes[i] = items[i]->frame == None ? items[i]->window : None;
+    }
+
+    bool isWalking = true;
+    while (isWalking) {
+        isWalking = false;
+        bool isQuerying = false;
+        for (int i = 0; i < count; i++) {
+            if (nodes[i] != None) {
+                cookies[i] = xcb_query_tree(xcb, nodes[i]);
+                isQuerying = true;
+            }
+        }
+        if (isQuerying) {
+            countXRoundTrip();
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (nodes[i] == None) {
+                continue;
+            }
+            xcb_query_tree_reply_t* reply =
+                xcb_query_tree_reply(xcb, cookies[i], NULL);
+            if (!reply) {
+                nodes[i] = None;
+                continue;
+            }
+
+            if (reply->parent == reply->root ||
+                reply->parent == XCB_WINDOW_NONE) {
+                items[i]->frame = nodes[i];
+                nodes[i] = None;
+            } else {
+                nodes[i] = reply->parent;
+                isWalking = true;
+            }
+            free(reply);
+        }
+    }
+
+    scratch_release(mark);
+}
+
+/** *********************************************************************
+ ** This method (re)reads all attributes of a batch of
+ ** WinInfos. All requests go out before the first reply is
+ ** read, so a batch costs about one round trip, not several
+ ** per window. filled[i] is false if the window has gone.
+ **/
+void fillWinInfos(WinInfo** items, int count, bool* filled) {
+    if (count <= 0) {
+        return;
+    }
+
+    xcb_connection_t* xcb = XGetXCBConnection(mGlobal.display);
+    XFlush(mGlobal.display);
+
+    const ScratchMark mark = scratch_mark();
+    WinInfoCookies* cookies = (WinInfoCookies*)
+        scratch_alloc(count * sizeof(WinInfoCookies));
+    MALLOC_CHECK(cookies);
+
+    const xcb_get_property_cookie_t showingDesktopCookie =
+        requestProperty(xcb, mGlobal.Rootwindow,
+            ATOM_NET_SHOWING_DESKTOP, 1);
+
+    for (int i = 0; i < count; i++) {
+        const xcb_window_t window = items[i]->window;
+        WinInfoCookies* cookie = &cookies[i];
+
+        cookie->attributes = xcb_get_window_attributes(xcb, window);
+        cookie->geometry = xcb_get_geometry(xcb, window);
+        cookie->toRoot = xcb_translate_coordinates(xcb, window,
+            mGlobal.Rootwindow, 0, 0);
+        cookie->toSnowWin = xcb_translate_coordinates(xcb, window,
+            mGlobal.SnowWin, 0, 0);
+
+        cookie->netDesktop = requestProperty(xcb, window,
+            ATOM_NET_WM_DESKTOP, 1);
+        cookie->winWorkspace = requestProperty(xcb, window,
+            ATOM_WIN_WORKSPACE, 1);
+        cookie->netState = requestProperty(xcb, window,
+            ATOM_NET_WM_STATE, 1024);
+        cookie->wmState = requestProperty(xcb, window,
+            ATOM_WM_STATE, 1);
+        cookie->windowType = requestProperty(xcb, window,
+            ATOM_NET_WM_WINDOW_TYPE, 1024);
+        cookie->gtkExtents = requestProperty(xcb, window,
+            ATOM_GTK_FRAME_EXTENTS, 4);
+        cookie->netExtents = requestProperty(xcb, window,
+            ATOM_NET_FRAME_EXTENTS, 4);
+    }
+
+    // If desktop isn't visible, all windows are hidden. The
+    // batch waits once.
+    countXRoundTrip();
+    xcb_get_property_reply_t* showingDesktop =
+        xcb_get_property_reply(xcb, showingDesktopCookie, NULL);
+    long showingDesktopValue = 0;
+    const bool isDesktopHidden =
+        getPropertyLong(showingDesktop, &showingDesktopValue) &&
+        showingDesktopValue == 1;
+    free(showingDesktop);
+
+    for (int i = 0; i < count; i++) {
+        WinInfo* winInfoItem = items[i];
+        WinInfoCookies* cookie = &cookies[i];
+
+        xcb_get_window_attributes_reply_t* attributes =
+            xcb_get_window_attributes_reply(xcb, cookie->attributes, NULL);
+        xcb_get_geometry_reply_t* geometry =
+            xcb_get_geometry_reply(xcb, cookie->geometry, NULL);
+        xcb_translate_coordinates_reply_t* toRoot =
+            xcb_translate_coordinates_reply(xcb, cookie->toRoot, NULL);
+        xcb_translate_coordinates_reply_t* toSnowWin =
+            xcb_translate_coordinates_reply(xcb, cookie->toSnowWin, NULL);
+        xcb_get_property_reply_t* netDesktop =
+            xcb_get_property_reply(xcb, cookie->netDesktop, NULL);
+        xcb_get_property_reply_t* winWorkspace =
+            xcb_get_property_reply(xcb, cookie->winWorkspace, NULL);
+        xcb_get_property_reply_t* netState =
+            xcb_get_property_reply(xcb, cookie->netState, NULL);
+        xcb_get_property_reply_t* wmState =
+            xcb_get_property_reply(xcb, cookie->wmState, NULL);
+        xcb_get_property_reply_t* windowType =
+            xcb_get_property_reply(xcb, cookie->windowType, NULL);
+        xcb_get_property_reply_t* gtkExtents =
+            xcb_get_property_reply(xcb, cookie->gtkExtents, NULL);
+        xcb_get_property_reply_t* netExtents =
+            xcb_get_property_reply(xcb, cookie->netExtents, NULL);
+
+        filled[i] = attributes && geometry && toRoot && toSnowWin;
+        if (filled[i]) {
+            // Set WinInfo "workspace", "sticky", "dock" and "desktop" attributes.
+            long workSpace = 0;
+            if (!(netDesktop && netDesktop->type == XCB_ATOM_CARDINAL &&
+                getPropertyLong(netDesktop, &workSpace))) {
+                workSpace = 0;
+                getPropertyLong(winWorkspace, &workSpace);
+            }
+            winInfoItem->ws = workSpace;
+
+            // Needed in KDE and LXDE.
+            winInfoItem->sticky = workSpace == -1 ||
+                (netState && netState->type == XCB_ATOM_ATOM &&
+                hasPropertyAtom(netState, ATOM_NET_WM_STATE_STICKY));
+            winInfoItem->dock = hasPropertyAtom(windowType,
+                ATOM_NET_WM_WINDOW_TYPE_DOCK);
+            winInfoItem->desktop = hasPropertyAtom(windowType,
+                ATOM_NET_WM_WINDOW_TYPE_DESKTOP);
+
+            // Set WinInfo "W / H", and "hidden" attribute.
+            winInfoItem->w = geometry->width;
+            winInfoItem->h = geometry->height;
+
+            long wmStateValue = NormalState;
+            winInfoItem->hidden = isDesktopHidden ||
+                attributes->map_state != XCB_MAP_STATE_VIEWABLE ||
+                hasPropertyAtom(netState, ATOM_NET_WM_STATE_HIDDEN) ||
+                (getPropertyLong(wmState, &wmStateValue) &&
+                wmStateValue != NormalState);
+
+            // Set WinInfo "X / Y actual" attributes.
+            winInfoItem->xa = toRoot->dst_x - geometry->x;
+            winInfoItem->ya = toRoot->dst_y - geometry->y;
+
+            // Set WinInfo "X / Y position" attributes.
+            winInfoItem->x = toSnowWin->dst_x;
+            winInfoItem->y = toSnowWin->dst_y;
+
+            // Apply WinInfo frame extent adjustments.
+            const bool hasGtkExtents = gtkExtents &&
+                xcb_get_property_value_length(gtkExtents) == 16;
+            xcb_get_property_reply_t* extents = hasGtkExtents ?
+                gtkExtents : netExtents;
+
+            if (extents && extents->format == 32 && extents->type &&
+                xcb_get_property_value_length(extents) == 16) {
+                const int32_t* frameExtent =
+                    (int32_t*) xcb_get_property_value(extents);
+                if (hasGtkExtents) {
                     winInfoItem->x += frameExtent[0];
                     winInfoItem->y += frameExtent[2];
                     winInfoItem->w -= (frameExtent[0] + frameExtent[1]);
                     winInfoItem->h -= (frameExtent[2] + frameExtent[3]);
-                    break;
+                } else {
+                    winInfoItem->x -= frameExtent[0];
+                    winInfoItem->y -= frameExtent[2];
+                    winInfoItem->w += frameExtent[0] + frameExtent[1];
+                    winInfoItem->h += frameExtent[2] + frameExtent[3];
+                }
+            } else {
+                winInfoItem->x = geometry->x;
+                winInfoItem->y = geometry->y;
             }
+
+            // Relative to the snow window.
+            winInfoItem->x += mGlobal.WindowOffsetX - mGlobal.SnowWinX;
+            winInfoItem->y += mGlobal.WindowOffsetY - mGlobal.SnowWinY;
+        }
+
+        free(attributes);
+        free(geometry);
+        free(toRoot);
+        free(toSnowWin);
+        free(netDesktop);
+        free(winWorkspace);
+        free(netState);
+        free(wmState);
+        free(windowType);
+        free(gtkExtents);
+        free(netExtents);
+    }
+    scratch_release(mark);
+
+    fetchWinInfoFrames(xcb, items, count);
+}
+
+/** *********************************************************************
+ ** This method (re)reads all attributes of one WinInfo.
+ ** Returns false if the window has gone.
+ **/
+bool fillWinInfo(WinInfo* winInfoItem) {
+    bool filled = false;
+    fillWinInfos(&winInfoItem, 1, &filled);
+    return filled;
+}
+
+/** *********************************************************************
+ ** This method re-reads the client list. Windows we know
+ ** keep their WinInfo, only new ones are queried.
+ **/
+void syncWinInfoList() {
+    WinInfo* newList = NULL;
+    int newListLength = 0;
+    getInitialWinInfoList(&newList, &newListLength);
+
+    const ScratchMark mark = scratch_mark();
+    WinInfo** items = (WinInfo**) scratch_alloc(
+        (newListLength + 1) * sizeof(WinInfo*));
+    bool* filled = (bool*) scratch_alloc(
+        (newListLength + 1) * sizeof(bool));
+    MALLOC_CHECK(items);
+    MALLOC_CHECK(filled);
+
+    // Fetch the new windows in one batch.
+    int newItemCount = 0;
+    for (int i = 0; i < newListLength; i++) {
+        const WinInfo* oldItem = getWinInfoForWindow(newList[i].window);
+        if (oldItem) {
+            newList[i] = *oldItem;
         } else {
-            winInfoItem->x = initialWinAttr_XPos;
-            winInfoItem->y = initialWinAttr_YPos;
+            items[newItemCount++] = &newList[i];
+        }
+    }
+    fillWinInfos(items, newItemCount, filled);
+
+    int keptLength = 0;
+    int newItem = 0;
+    for (int i = 0; i < newListLength; i++) {
+        if (newItem < newItemCount && items[newItem] == &newList[i]) {
+            if (!filled[newItem++]) {
+                continue;
+            }
         }
+        newList[keptLength++] = newList[i];
+    }
 
-        // Free resources, bump pointer, loop.
-        XFree(properties);
-        winInfoItem++;
+    scratch_release(mark);
+
+    installWinInfoList(newList, keptLength);
+    rebuildWinInfoIndex();
+
+    mWinInfoSyncNeeded = false;
+}
+
+/** *********************************************************************
+ ** These methods queue work for doPendingWinInfoUpdates().
+ ** A window may be a client, or the frame around one.
+ **/
+void queueWinInfoUpdate(Window window) {
+    mGlobal.WindowsChanged++;
+
+    for (int i = 0; i < mPendingWinInfoCount; i++) {
+        if (mPendingWinInfoWindows[i] == window) {
+            return;
+        }
     }
 
-    return;
+    if (mPendingWinInfoCount == MAX_PENDING_WININFO_UPDATES) {
+        mWinInfoRescanNeeded = true;
+        return;
+    }
+    mPendingWinInfoWindows[mPendingWinInfoCount++] = window;
+}
+
+void queueWinInfoSync() {
+    mGlobal.WindowsChanged++;
+    mWinInfoSyncNeeded = true;
+}
+
+void queueWinInfoRescan() {
+    mGlobal.WindowsChanged++;
+    mWinInfoRescanNeeded = true;
+}
+
+/** *********************************************************************
+ ** This method applies queued window changes to the list.
+ ** A window that went away without us being told is an
+ ** anomaly, and falls back to a full rescan.
+ **
+ ** threads: main thread only
+ **/
+void doPendingWinInfoUpdates() {
+    if (mWinInfoRescanNeeded) {
+        getWinInfoForAllWindows();
+        return;
+    }
+
+    if (mWinInfoSyncNeeded) {
+        syncWinInfoList();
+    }
+
+    WinInfo* items[MAX_PENDING_WININFO_UPDATES];
+    bool filled[MAX_PENDING_WININFO_UPDATES];
+
+    int itemCount = 0;
+    for (int p = 0; p < mPendingWinInfoCount; p++) {
+        const Window window = mPendingWinInfoWindows[p];
+
+        WinInfo* winInfoItem = getWinInfoForWindow(window);
+        if (!winInfoItem) {
+            winInfoItem = getWinInfoForFrame(window);
+        }
+        if (winInfoItem) {
+            items[itemCount++] = winInfoItem;
+        }
+    }
+
+    fillWinInfos(items, itemCount, filled);
+    for (int i = 0; i < itemCount; i++) {
+        if (!filled[i]) {
+            getWinInfoForAllWindows();
+            return;
+        }
+    }
+    mPendingWinInfoCount = 0;
 }
 
 /** *********************************************************************
@@ -275,7 +728,7 @@ long int getWorkspaceOfWindow(Window window) {
     unsigned char *properties = NULL;
 
     XGetWindowProperty(mGlobal.display, window,
-        XInternAtom(mGlobal.display, "_NET_WM_DESKTOP", False),
+        getXAtom(ATOM_NET_WM_DESKTOP),
         0, 1, False, AnyPropertyType, &type, &format, &nitems,
         &unusedBytes, &properties);
 
@@ -284,7 +737,7 @@ long int getWorkspaceOfWindow(Window window) {
         properties = NULL;
 
         XGetWindowProperty(mGlobal.display, window,
-            XInternAtom(mGlobal.display, "_WIN_WORKSPACE", False),
+            getXAtom(ATOM_WIN_WORKSPACE),
             0, 1, False, AnyPropertyType, &type, &format, &nitems,
             &unusedBytes, &properties);
     }
@@ -311,7 +764,7 @@ long int getCurrentWorkspaceNumber() {
         properties = NULL;
         XGetWindowProperty(mGlobal.display,
             DefaultRootWindow(mGlobal.display),
-            XInternAtom(mGlobal.display, "_NET_DESKTOP_VIEWPORT", False),
+            getXAtom(ATOM_NET_DESKTOP_VIEWPORT),
             0, 2, False, AnyPropertyType, &type,
             &format, &nitems, &unusedBytes, &properties);
 
@@ -331,7 +784,7 @@ long int getCurrentWorkspaceNumber() {
     // we return zero if the workspace number cannot be determined.
     XGetWindowProperty(mGlobal.display,
         DefaultRootWindow(mGlobal.display),
-        XInternAtom(mGlobal.display, "_NET_CURRENT_DESKTOP", False),
+        getXAtom(ATOM_NET_CURRENT_DESKTOP),
         0, 1, False, AnyPropertyType, &type, &format, &nitems,
         &unusedBytes, &properties);
 
@@ -339,7 +792,7 @@ long int getCurrentWorkspaceNumber() {
         XFree(properties);
         XGetWindowProperty(mGlobal.display,
             DefaultRootWindow(mGlobal.display),
-            XInternAtom(mGlobal.display, "_WIN_WORKSPACE", False),
+            getXAtom(ATOM_WIN_WORKSPACE),
             0, 1, False, AnyPropertyType, &type, &format, &nitems,
             &unusedBytes, &properties);
     }
@@ -392,7 +845,7 @@ bool isDesktopVisible() {
     unsigned char *properties = NULL;
 
     XGetWindowProperty(mGlobal.display, mGlobal.Rootwindow,
-        XInternAtom(mGlobal.display, "_NET_SHOWING_DESKTOP", False),
+        getXAtom(ATOM_NET_SHOWING_DESKTOP),
         0, (~0L), False, AnyPropertyType, &type, &format,
         &nitems, &unusedBytes, &properties);
 
@@ -418,20 +871,17 @@ bool isWindowHiddenByNetWMState(Window window) {
     unsigned char *properties = NULL;
 
     XGetWindowProperty(mGlobal.display, window,
-        XInternAtom(mGlobal.display, "_NET_WM_STATE", False),
+        getXAtom(ATOM_NET_WM_STATE),
         0, (~0L), False, AnyPropertyType, &type, &format,
         &nitems, &unusedBytes, &properties);
 
     if (format == 32) {
         for (unsigned long i = 0; i < nitems; i++) {
-            char *nameString = XGetAtomName(mGlobal.display,
-                ((Atom *) (void *) properties) [i]);
-            if (strcmp(nameString, "_NET_WM_STATE_HIDDEN") == 0) {
+            if (((Atom*) (void*) properties)[i] ==
+                getXAtom(ATOM_NET_WM_STATE_HIDDEN)) {
                 result = true;
-                XFree(nameString);
                 break;
             }
-            XFree(nameString);
         }
     }
     XFree(properties);
@@ -451,7 +901,7 @@ bool isWindowHiddenByWMState(Window window) {
     unsigned char *properties = NULL;
 
     XGetWindowProperty(mGlobal.display, window,
-        XInternAtom(mGlobal.display, "WM_STATE", False),
+        getXAtom(ATOM_WM_STATE),
         0, (~0L), False, AnyPropertyType, &type, &format,
         &nitems, &unusedBytes, &properties);
 
@@ -482,20 +932,17 @@ bool isWindowSticky(long workSpace, WinInfo* winInfoItem) {
     unsigned char *properties = NULL;
 
     XGetWindowProperty(mGlobal.display, winInfoItem->window,
-        XInternAtom(mGlobal.display, "_NET_WM_STATE", False),
+        getXAtom(ATOM_NET_WM_STATE),
         0, (~0L), False, AnyPropertyType, &type, &format,
         &nitems, &unusedBytes, &properties);
 
     if (type == XA_ATOM) {
         for (unsigned long int i = 0; i < nitems; i++) {
-            char *nameString = XGetAtomName(mGlobal.display,
-                ((Atom *) (void *) properties) [i]);
-            if (strcmp(nameString, "_NET_WM_STATE_STICKY") == 0) {
+            if (((Atom*) (void*) properties)[i] ==
+                getXAtom(ATOM_NET_WM_STATE_STICKY)) {
                 result = true;
-                XFree(nameString);
                 break;
             }
-            XFree(nameString);
         }
     }
     XFree(properties);
@@ -515,20 +962,17 @@ bool isWindowDock(WinInfo* winInfoItem) {
     unsigned char *properties = NULL;
 
     XGetWindowProperty(mGlobal.display, winInfoItem->window,
-        XInternAtom(mGlobal.display, "_NET_WM_WINDOW_TYPE", False),
+        getXAtom(ATOM_NET_WM_WINDOW_TYPE),
         0, (~0L), False, AnyPropertyType, &type, &format,
         &nitems, &unusedBytes, &properties);
 
     if (format == 32) {
         for (int i = 0; (unsigned long)i < nitems; i++) {
-            char *nameString = XGetAtomName(mGlobal.display,
-                ((Atom *) (void *) properties) [i]);
-            if (strcmp(nameString, "_NET_WM_WINDOW_TYPE_DOCK") == 0) {
+            if (((Atom*) (void*) properties)[i] ==
+                getXAtom(ATOM_NET_WM_WINDOW_TYPE_DOCK)) {
                 result = true;
-                XFree(nameString);
                 break;
             }
-            XFree(nameString);
         }
     }
     XFree(properties);
@@ -575,13 +1019,14 @@ void logWinInfoForWindow(Window window) {
 
     // Print it.
     printf("[0x%08lx]  %s  %2li  "
-        " %5d , %-5d %5d x %-5d  %s%s%s\n",
+        " %5d , %-5d %5d x %-5d  %s%s%s%s\n",
         winInfoItem->window,
         getWinInfoTitleOfWindow(),
         winInfoItem->ws,
         winInfoItem->xa, winInfoItem->ya,
         winInfoItem->w, winInfoItem->h,
         winInfoItem->dock ? "dock " : "",
+        winInfoItem->desktop ? "desktop " : "",
         winInfoItem->sticky ? "sticky " : "",
         winInfoItem->hidden ? "hidden" : "");
 }
@@ -32,10 +32,20 @@
  * Module Method stubs.
  */
 WinInfo* getWinInfoForWindow(Window id);
+WinInfo* getWinInfoForFrame(Window frame);
 
 void getWinInfoForAllWindows();
+void setWinInfoList(WinInfo* winInfoList, int listCount);
 void getInitialWinInfoList(WinInfo** winInfolist, int* listCount);
 void getFinalWinInfoList(WinInfo** winInfolist, int* listCount);
+bool fillWinInfo(WinInfo*);
+void fillWinInfos(WinInfo** items, int count, bool* filled);
+void syncWinInfoList();
+
+void queueWinInfoUpdate(Window window);
+void queueWinInfoSync();
+void queueWinInfoRescan();
+void doPendingWinInfoUpdates();
 
 long int getWorkspaceOfWindow(Window window);
 long int getCurrentWorkspaceNumber();
@@ -0,0 +1,281 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+
+#include <gtk/gtk.h>
+
+#include "plasmasnow.h"
+#include "safe_malloc.h"
+#include "WindowNames.h"
+#include "XAtoms.h"
+#include "XTraffic.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * Window names and sizes, read in one pipelined walk of the
+ * window tree: one round trip per tree level for the
+ * children, and one for their names and geometry. Lookups
+ * then match in memory, with patterns compiled once, where
+ * the xdo search made several round trips per window and
+ * compiled its patterns for each. Only startup looks windows
+ * up by name, before any window events are selected, so the
+ * index is a snapshot, dropped when StartWindow() is done.
+ */
+typedef struct _WindowNameEntry {
+        Window window;
+        char* name;      // WM_NAME, "" if none.
+        char* netName;   // _NET_WM_NAME, "" if none.
+        unsigned long area;
+} WindowNameEntry;
+
+static WindowNameEntry* mWindowNames = NULL;
+static int mWindowNameCount = 0;
+static int mWindowNameCapacity = 0;
+static bool mIsWindowNameIndexBuilt = false;
+
+static char* mPatterns[WINDOW_NAME_PATTERN_COUNT];
+static regex_t mPatternRegexes[WINDOW_NAME_PATTERN_COUNT];
+static int mPatternCount = 0;
+
+
+/** *********************************************************************
+ ** This method returns a property reply as a new string.
+ **/
+static char* getPropertyString(xcb_get_property_reply_t* reply) {
+    if (!reply || reply->format != 8) {
+        return strdup("");
+    }
+    return strndup((const char*) xcb_get_property_value(reply),
+        xcb_get_property_value_length(reply));
+}
+
+/** *********************************************************************
+ ** This method adds a batch of windows to the index. All
+ ** requests go out before the first reply is read.
+ **/
+static void addWindowNameEntries(xcb_connection_t* xcb,
+    const xcb_window_t* windows, int count) {
+    if (count <= 0) {
+        return;
+    }
+
+    xcb_get_property_cookie_t* nameCookies = (xcb_get_property_cookie_t*)
+        malloc(count * sizeof(xcb_get_property_cookie_t));
+    xcb_get_property_cookie_t* netNameCookies = (xcb_get_property_cookie_t*)
+        malloc(count * sizeof(xcb_get_property_cookie_t));
+    xcb_get_geometry_cookie_t* geometryCookies = (xcb_get_geometry_cookie_t*)
+        malloc(count * sizeof(xcb_get_geometry_cookie_t));
+    MALLOC_CHECK(nameCookies);
+    MALLOC_CHECK(netNameCookies);
+    MALLOC_CHECK(geometryCookies);
+
+    for (int i = 0; i < count; i++) {
+        nameCookies[i] = xcb_get_property(xcb, 0, windows[i],
+            XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, 256);
+        netNameCookies[i] = xcb_get_property(xcb, 0, windows[i],
+            getXAtom(ATOM_NET_WM_NAME), XCB_GET_PROPERTY_TYPE_ANY, 0, 256);
+        geometryCookies[i] = xcb_get_geometry(xcb, windows[i]);
+    }
+    countXRoundTrip();
+
+    if (mWindowNameCount + count > mWindowNameCapacity) {
+        mWindowNameCapacity = (mWindowNameCount + count) * 2;
+        mWindowNames = (WindowNameEntry*) realloc(mWindowNames,
+            mWindowNameCapacity * sizeof(WindowNameEntry));
+        MALLOC_CHECK(mWindowNames);
+    }
+
+    for (int i = 0; i < count; i++) {
+        xcb_get_property_reply_t* name =
+            xcb_get_property_reply(xcb, nameCookies[i], NULL);
+        xcb_get_property_reply_t* netName =
+            xcb_get_property_reply(xcb, netNameCookies[i], NULL);
+        xcb_get_geometry_reply_t* geometry =
+            xcb_get_geometry_reply(xcb, geometryCookies[i], NULL);
+
+        // Gone since its parent was read.
+        if (geometry) {
+            WindowNameEntry* entry = &mWindowNames[mWindowNameCount++];
+            entry->window = windows[i];
+            entry->name = getPropertyString(name);
+            entry->netName = getPropertyString(netName);
+            entry->area = (unsigned long) geometry->width *
+                geometry->height;
+        }
+
+        free(name);
+        free(netName);
+        free(geometry);
+    }
+
+    free(nameCookies);
+    free(netNameCookies);
+    free(geometryCookies);
+}
+
+/** *********************************************************************
+ ** This method reads the root and its descendants down to
+ ** WINDOW_NAME_INDEX_DEPTH levels, one level per batch.
+ **/
+void buildWindowNameIndex() {
+    clearWindowNameIndex();
+    mIsWindowNameIndexBuilt = true;
+
+    xcb_connection_t* xcb = XGetXCBConnection(mGlobal.display);
+    XFlush(mGlobal.display);
+
+    int levelCount = 1;
+    xcb_window_t* level = (xcb_window_t*) malloc(sizeof(xcb_window_t));
+    MALLOC_CHECK(level);
+    level[0] = DefaultRootWindow(mGlobal.display);
+    addWindowNameEntries(xcb, level, levelCount);
+
+    for (int depth = 1; depth <= WINDOW_NAME_INDEX_DEPTH &&
+        levelCount > 0; depth++) {
+        xcb_query_tree_cookie_t* cookies = (xcb_query_tree_cookie_t*)
+            malloc(levelCount * sizeof(xcb_query_tree_cookie_t));
+        MALLOC_CHECK(cookies);
+        for (int i = 0; i < levelCount; i++) {
+            cookies[i] = xcb_query_tree(xcb, level[i]);
+        }
+        countXRoundTrip();
+
+        int childCount = 0;
+        xcb_window_t* children = NULL;
+        for (int i = 0; i < levelCount; i++) {
+            xcb_query_tree_reply_t* reply =
+                xcb_query_tree_reply(xcb, cookies[i], NULL);
+            if (!reply) {
+                continue;
+            }
+
+            const int count = xcb_query_tree_children_length(reply);
+            if (count > 0) {
+                children = (xcb_window_t*) realloc(children,
+                    (childCount + count) * sizeof(xcb_window_t));
+                MALLOC_CHECK(children);
+                memcpy(children + childCount,
+                    xcb_query_tree_children(reply),
+                    count * sizeof(xcb_window_t));
+                childCount += count;
+            }
+            free(reply);
+        }
+        free(cookies);
+
+        addWindowNameEntries(xcb, children, childCount);
+
+        free(level);
+        level = children;
+        levelCount = childCount;
+    }
+
+    free(level);
+}
+
+/** *********************************************************************
+ ** This method frees the index. The next lookup reads the
+ ** window tree again.
+ **/
+void clearWindowNameIndex() {
+    for (int i = 0; i < mWindowNameCount; i++) {
+        free(mWindowNames[i].name);
+        free(mWindowNames[i].netName);
+    }
+    free(mWindowNames);
+
+    mWindowNames = NULL;
+    mWindowNameCount = 0;
+    mWindowNameCapacity = 0;
+    mIsWindowNameIndexBuilt = false;
+}
+
+/** *********************************************************************
+ ** This method returns a pattern compiled, as xdo does:
+ ** extended and ignoring case. NULL if it does not compile.
+ **/
+static regex_t* getWindowNamePattern(const char* pattern) {
+    for (int i = 0; i < mPatternCount; i++) {
+        if (!strcmp(mPatterns[i], pattern)) {
+            return &mPatternRegexes[i];
+        }
+    }
+
+    // Full, start over.
+    if (mPatternCount == WINDOW_NAME_PATTERN_COUNT) {
+        for (int i = 0; i < mPatternCount; i++) {
+            free(mPatterns[i]);
+            regfree(&mPatternRegexes[i]);
+        }
+        mPatternCount = 0;
+    }
+
+    regex_t* regex = &mPatternRegexes[mPatternCount];
+    if (regcomp(regex, pattern, REG_EXTENDED | REG_ICASE | REG_NOSUB)) {
+        printf("plasmasnow: Failed to compile regex: '%s'\n", pattern);
+        return NULL;
+    }
+    mPatterns[mPatternCount++] = strdup(pattern);
+    return regex;
+}
+
+/** *********************************************************************
+ ** This method returns the largest window whose WM_NAME or
+ ** _NET_WM_NAME matches pattern, None if none does. Reads
+ ** the window tree on first use. Main thread only.
+ **/
+Window findLargestWindowWithName(const char* pattern) {
+    regex_t* regex = getWindowNamePattern(pattern);
+    if (!regex) {
+        return None;
+    }
+
+    if (!mIsWindowNameIndexBuilt) {
+        buildWindowNameIndex();
+    }
+
+    Window largest = None;
+    unsigned long largestArea = 0;
+    for (int i = 0; i < mWindowNameCount; i++) {
+        const WindowNameEntry* entry = &mWindowNames[i];
+        if (entry->area <= largestArea) {
+            continue;
+        }
+        if (!regexec(regex, entry->name, 0, NULL, 0) ||
+            !regexec(regex, entry->netName, 0, NULL, 0)) {
+            largest = entry->window;
+            largestArea = entry->area;
+        }
+    }
+
+    return largest;
+}
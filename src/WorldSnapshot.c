@@ -0,0 +1,106 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "plasmasnow.h"
+#include "windows.h"
+#include "WorldSnapshot.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * A seqlock: the sequence is odd while the main thread
+ * writes, and readers retry until they copied between two
+ * equal, even reads of it. The sequence and the copy sit on
+ * cache lines of their own, apart from the mGlobal fields
+ * the main thread keeps writing.
+ */
+static _Alignas(WORLD_SNAPSHOT_CACHE_LINE)
+    atomic_uint mWorldSnapshotSequence = 0;
+
+static _Alignas(WORLD_SNAPSHOT_CACHE_LINE)
+    WorldSnapshot mWorldSnapshot;
+
+
+/** *********************************************************************
+ ** This method copies the current state for background
+ ** threads. Main thread only, once per frame.
+ **/
+void publishWorldSnapshot() {
+    const unsigned int sequence = atomic_load_explicit(
+        &mWorldSnapshotSequence, memory_order_relaxed);
+    atomic_store_explicit(&mWorldSnapshotSequence, sequence + 1,
+        memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    WorldSnapshot* world = &mWorldSnapshot;
+    world->version = sequence / 2 + 1;
+
+    world->isWorkspaceActive = WorkspaceActive();
+    world->visWorkSpaceCount = mGlobal.NVisWorkSpaces;
+    memcpy(world->visWorkSpaces, mGlobal.VisWorkSpaces,
+        sizeof(long) * mGlobal.NVisWorkSpaces);
+
+    world->snowWinWidth = mGlobal.SnowWinWidth;
+
+    world->wind = mGlobal.Wind;
+    world->newWind = mGlobal.NewWind;
+    world->windMax = mGlobal.WindMax;
+
+    world->actualSantaSpeed = mGlobal.ActualSantaSpeed;
+    world->santaPlowRect = mGlobal.SantaPlowRect;
+    world->santaX = mGlobal.SantaX;
+    world->santaWidth = mGlobal.SantaWidth;
+    world->santaDirection = mGlobal.SantaDirection;
+
+    atomic_store_explicit(&mWorldSnapshotSequence, sequence + 2,
+        memory_order_release);
+}
+
+/** *********************************************************************
+ ** This method copies the last published state. Any thread.
+ ** Before the first publish, it reads as all zero, so an
+ ** inactive workspace.
+ **/
+void readWorldSnapshot(WorldSnapshot* world) {
+    while (true) {
+        const unsigned int before = atomic_load_explicit(
+            &mWorldSnapshotSequence, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        memcpy(world, &mWorldSnapshot, sizeof(WorldSnapshot));
+        atomic_thread_fence(memory_order_acquire);
+
+        const unsigned int after = atomic_load_explicit(
+            &mWorldSnapshotSequence, memory_order_relaxed);
+        if (before == after) {
+            return;
+        }
+    }
+}
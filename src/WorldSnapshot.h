@@ -0,0 +1,67 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#include <gtk/gtk.h>
+
+#include "plasmasnow.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define WORLD_SNAPSHOT_CACHE_LINE 64
+
+
+/***********************************************************
+ * The main thread state background threads act on, copied
+ * once per frame. Readers get a consistent copy instead of
+ * racing the main thread on mGlobal.
+ */
+typedef struct _WorldSnapshot {
+        unsigned int version;
+
+        bool isWorkspaceActive;
+        int visWorkSpaceCount;
+        long visWorkSpaces[MAXVISWORKSPACES];
+
+        int snowWinWidth;
+
+        int wind;
+        float newWind;
+        float windMax;
+
+        float actualSantaSpeed;
+        cairo_rectangle_int_t santaPlowRect;
+        int santaX;
+        int santaWidth;
+        int santaDirection;
+} WorldSnapshot;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void publishWorldSnapshot();
+void readWorldSnapshot(WorldSnapshot* world);
@@ -0,0 +1,62 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <X11/Xlib.h>
+
+#include "plasmasnow.h"
+
+#include "XAtoms.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * All atoms are interned with one XInternAtoms() request at
+ * startup, instead of one round trip per lookup.
+ */
+#define XATOM(id, name) name,
+static const char* XATOM_NAMES[ATOM_COUNT] = {
+    ALL_XATOMS
+};
+#undef XATOM
+
+Atom mXAtoms[ATOM_COUNT];
+
+
+/** *********************************************************************
+ ** This method (re)interns all atoms.
+ **/
+void initXAtoms() {
+    if (!XInternAtoms(mGlobal.display, (char**) XATOM_NAMES,
+        ATOM_COUNT, False, mXAtoms)) {
+        printf("plasmasnow: XAtoms: Could not intern all atoms.\n");
+    }
+}
+
+/** *********************************************************************
+ ** This method returns an interned atom.
+ **/
+Atom getXAtom(XAtomId id) {
+    return mXAtoms[id];
+}
@@ -0,0 +1,66 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+
+
+/***********************************************************
+ * Module consts.
+ *
+ * Every atom the app uses, interned together.
+ */
+#define ALL_XATOMS \
+    XATOM(NET_CLIENT_LIST, "_NET_CLIENT_LIST") \
+    XATOM(WIN_CLIENT_LIST, "_WIN_CLIENT_LIST") \
+    XATOM(NET_CURRENT_DESKTOP, "_NET_CURRENT_DESKTOP") \
+    XATOM(NET_DESKTOP_VIEWPORT, "_NET_DESKTOP_VIEWPORT") \
+    XATOM(NET_SHOWING_DESKTOP, "_NET_SHOWING_DESKTOP") \
+    XATOM(NET_WM_DESKTOP, "_NET_WM_DESKTOP") \
+    XATOM(NET_WM_NAME, "_NET_WM_NAME") \
+    XATOM(WIN_WORKSPACE, "_WIN_WORKSPACE") \
+    XATOM(NET_WM_STATE, "_NET_WM_STATE") \
+    XATOM(NET_WM_STATE_HIDDEN, "_NET_WM_STATE_HIDDEN") \
+    XATOM(NET_WM_STATE_STICKY, "_NET_WM_STATE_STICKY") \
+    XATOM(WM_STATE, "WM_STATE") \
+    XATOM(NET_WM_WINDOW_TYPE, "_NET_WM_WINDOW_TYPE") \
+    XATOM(NET_WM_WINDOW_TYPE_DESKTOP, "_NET_WM_WINDOW_TYPE_DESKTOP") \
+    XATOM(NET_WM_WINDOW_TYPE_DOCK, "_NET_WM_WINDOW_TYPE_DOCK") \
+    XATOM(GTK_FRAME_EXTENTS, "_GTK_FRAME_EXTENTS") \
+    XATOM(NET_FRAME_EXTENTS, "_NET_FRAME_EXTENTS") \
+    XATOM(MOTIF_WM_HINTS, "_MOTIF_WM_HINTS")
+
+#define XATOM(id, name) ATOM_##id,
+typedef enum {
+    ALL_XATOMS
+    ATOM_COUNT
+} XAtomId;
+#undef XATOM
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void initXAtoms();
+Atom getXAtom(XAtomId id);
@@ -0,0 +1,237 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+
+#include <gtk/gtk.h>
+
+#include "clocks.h"
+#include "plasmasnow.h"
+#include "XTraffic.h"
+
+
+/***********************************************************
+ * Module globals.
+ *
+ * X traffic is charged to named sections: each scheduler
+ * task, and the background thread loopers. Requests are the
+ * change of the display's request serial over a section, so
+ * they include xdo, cairo and xcb requests too; blocking round
+ * trips and flushes come from the wrappers in XTraffic.h.
+ * The serial is shared by all threads, so requests made by
+ * one thread inside another's section land in that section.
+ */
+typedef struct _XTrafficSlot {
+        const char* name;
+        atomic_ulong requests;
+        atomic_ulong roundTrips;
+        atomic_ulong flushes;
+} XTrafficSlot;
+
+static XTrafficSlot mXTrafficSlots[XTRAFFIC_SLOT_COUNT] = {
+    { .name = "other" }
+};
+static int mXTrafficSlotCount = 1;
+static pthread_mutex_t mXTrafficSlotMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Section running on this thread, and the serial it started at.
+static _Thread_local int mXTrafficSlot = XTRAFFIC_OTHER;
+static _Thread_local unsigned long mXTrafficSerial = 0;
+
+// Since start, for metrics.
+static atomic_ulong mXTrafficTotalRoundTrips;
+static atomic_ulong mXTrafficTotalFlushes;
+
+// All requests, for the share no section made.
+static unsigned long mXTrafficReportSerial = 0;
+static double mXTrafficReportTime = 0;
+
+
+/** *********************************************************************
+ ** This method returns the slot for a section name, adding
+ ** it on first use. Names are kept, not copied. Past the
+ ** last slot, traffic counts as other.
+ **/
+int getXTrafficSlot(const char* name) {
+    pthread_mutex_lock(&mXTrafficSlotMutex);
+
+    int slot = 1;
+    while (slot < mXTrafficSlotCount &&
+        strcmp(mXTrafficSlots[slot].name, name)) {
+        slot++;
+    }
+    if (slot == mXTrafficSlotCount) {
+        if (slot < XTRAFFIC_SLOT_COUNT) {
+            mXTrafficSlots[slot].name = name;
+            mXTrafficSlotCount++;
+        } else {
+            slot = XTRAFFIC_OTHER;
+        }
+    }
+
+    pthread_mutex_unlock(&mXTrafficSlotMutex);
+    return slot;
+}
+
+/** *********************************************************************
+ ** This method charges requests made since the last mark to
+ ** the running section, and moves the mark to now.
+ **/
+static void chargeXTrafficRequests() {
+    if (!mGlobal.display) {
+        return;
+    }
+
+    const unsigned long serial = XNextRequest(mGlobal.display);
+    if (mXTrafficSlot != XTRAFFIC_OTHER) {
+        atomic_fetch_add_explicit(&mXTrafficSlots[mXTrafficSlot].requests,
+            serial - mXTrafficSerial, memory_order_relaxed);
+    }
+    mXTrafficSerial = serial;
+}
+
+/** *********************************************************************
+ ** This method starts a section on this thread. Returns the
+ ** section it interrupts, for endXTraffic().
+ **/
+int beginXTraffic(int slot) {
+    chargeXTrafficRequests();
+
+    const int outerSlot = mXTrafficSlot;
+    mXTrafficSlot = slot;
+    return outerSlot;
+}
+
+/** *********************************************************************
+ ** This method ends the section on this thread, and resumes
+ ** the one it interrupted.
+ **/
+void endXTraffic(int outerSlot) {
+    chargeXTrafficRequests();
+    mXTrafficSlot = outerSlot;
+}
+
+/** *********************************************************************
+ ** Wrapper counters, for the section on this thread.
+ **/
+void countXRoundTrip() {
+    atomic_fetch_add_explicit(&mXTrafficSlots[mXTrafficSlot].roundTrips,
+        1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&mXTrafficTotalRoundTrips,
+        1, memory_order_relaxed);
+}
+
+void countXFlush() {
+    atomic_fetch_add_explicit(&mXTrafficSlots[mXTrafficSlot].flushes,
+        1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&mXTrafficTotalFlushes,
+        1, memory_order_relaxed);
+}
+
+/** *********************************************************************
+ ** This method returns all traffic since start, never reset.
+ ** Main thread only.
+ **/
+void getXTrafficTotals(unsigned long* requests,
+    unsigned long* roundTrips, unsigned long* flushes) {
+    *requests = mGlobal.display ? XNextRequest(mGlobal.display) : 0;
+    *roundTrips = atomic_load(&mXTrafficTotalRoundTrips);
+    *flushes = atomic_load(&mXTrafficTotalFlushes);
+}
+
+/** *********************************************************************
+ ** This method formats requests, round trips and flushes per
+ ** second for each section with traffic since the last
+ ** report, busiest first, and resets them. Main thread only.
+ **/
+void getXTrafficReport(char* buffer, size_t size) {
+    buffer[0] = '\0';
+    if (!mGlobal.display) {
+        return;
+    }
+
+    const double now = wallclock();
+    const unsigned long serial = XNextRequest(mGlobal.display);
+    const double seconds = now - mXTrafficReportTime;
+    const unsigned long allRequests = serial - mXTrafficReportSerial;
+    const bool isFirstReport = mXTrafficReportTime == 0;
+    mXTrafficReportTime = now;
+    mXTrafficReportSerial = serial;
+    if (isFirstReport || seconds <= 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&mXTrafficSlotMutex);
+    const int slotCount = mXTrafficSlotCount;
+    pthread_mutex_unlock(&mXTrafficSlotMutex);
+
+    unsigned long requests[XTRAFFIC_SLOT_COUNT];
+    unsigned long roundTrips[XTRAFFIC_SLOT_COUNT];
+    unsigned long flushes[XTRAFFIC_SLOT_COUNT];
+    unsigned long sectionRequests = 0;
+    for (int slot = 0; slot < slotCount; slot++) {
+        XTrafficSlot* counts = &mXTrafficSlots[slot];
+        requests[slot] = atomic_exchange(&counts->requests, 0);
+        roundTrips[slot] = atomic_exchange(&counts->roundTrips, 0);
+        flushes[slot] = atomic_exchange(&counts->flushes, 0);
+        sectionRequests += requests[slot];
+    }
+    requests[XTRAFFIC_OTHER] = allRequests > sectionRequests ?
+        allRequests - sectionRequests : 0;
+
+    int written = snprintf(buffer, size, "%-28s req/s %7.1f\n",
+        "all", allRequests / seconds);
+    if (written < 0 || (size_t) written >= size) {
+        return;
+    }
+    size_t used = written;
+
+    // Busiest first, by selection.
+    bool isShown[XTRAFFIC_SLOT_COUNT] = { false };
+    while (true) {
+        int best = -1;
+        for (int slot = 0; slot < slotCount; slot++) {
+            if (!isShown[slot] && (requests[slot] || roundTrips[slot] ||
+                flushes[slot]) && (best < 0 ||
+                requests[slot] > requests[best])) {
+                best = slot;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        isShown[best] = true;
+
+        written = snprintf(buffer + used, size - used,
+            "%-28.28s req/s %7.1f  trips/s %6.1f  flush/s %6.1f\n",
+            mXTrafficSlots[best].name, requests[best] / seconds,
+            roundTrips[best] / seconds, flushes[best] / seconds);
+        if (written < 0 || (size_t) written >= size - used) {
+            break;
+        }
+        used += written;
+    }
+}
@@ -0,0 +1,77 @@
+/* -copyright-
+#-# 
+#-# plasmasnow: Let it snow on your desktop
+#-# Copyright (C) 1984,1988,1990,1993-1995,2000-2001 Rick Jansen
+#-# 	      2019,2020,2021,2022,2023 Willem Vermin
+#-#          2024 Mark Capella
+#-# 
+#-# This program is free software: you can redistribute it and/or modify
+#-# it under the terms of the GNU General Public License as published by
+#-# the Free Software Foundation, either version 3 of the License, or
+#-# (at your option) any later version.
+#-# 
+#-# This program is distributed in the hope that it will be useful,
+#-# but WITHOUT ANY WARRANTY; without even the implied warranty of
+#-# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#-# GNU General Public License for more details.
+#-# 
+#-# You should have received a copy of the GNU General Public License
+#-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#-# 
+*/
+#pragma once
+
+#include <stddef.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+
+/***********************************************************
+ * Module consts.
+ */
+#define XTRAFFIC_SLOT_COUNT 64
+
+// Slot for traffic made outside any section.
+#define XTRAFFIC_OTHER 0
+
+// Xlib calls that block for a reply, and flushes, are
+// counted against the section running on the calling
+// thread. Included after the X11 headers it wraps.
+#define XGetWindowProperty(...) \
+    (countXRoundTrip(), XGetWindowProperty(__VA_ARGS__))
+#define XGetWindowAttributes(...) \
+    (countXRoundTrip(), XGetWindowAttributes(__VA_ARGS__))
+#define XGetGeometry(...) \
+    (countXRoundTrip(), XGetGeometry(__VA_ARGS__))
+#define XQueryTree(...) \
+    (countXRoundTrip(), XQueryTree(__VA_ARGS__))
+#define XQueryPointer(...) \
+    (countXRoundTrip(), XQueryPointer(__VA_ARGS__))
+#define XTranslateCoordinates(...) \
+    (countXRoundTrip(), XTranslateCoordinates(__VA_ARGS__))
+#define XGetWMName(...) \
+    (countXRoundTrip(), XGetWMName(__VA_ARGS__))
+#define XGetInputFocus(...) \
+    (countXRoundTrip(), XGetInputFocus(__VA_ARGS__))
+#define XInternAtom(...) \
+    (countXRoundTrip(), XInternAtom(__VA_ARGS__))
+#define XSync(...) \
+    (countXRoundTrip(), XSync(__VA_ARGS__))
+#define XFlush(...) \
+    (countXFlush(), XFlush(__VA_ARGS__))
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+int getXTrafficSlot(const char* name);
+int beginXTraffic(int slot);
+void endXTraffic(int outerSlot);
+
+void countXRoundTrip();
+void countXFlush();
+void getXTrafficTotals(unsigned long* requests,
+    unsigned long* roundTrips, unsigned long* flushes);
+
+void getXTrafficReport(char* buffer, size_t size);
@@ -28,6 +28,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <gtk/gtk.h>
 
@@ -37,17 +38,37 @@
 #include "debug.h"
 #include "doitb.h"
 #include "Flags.h"
-#include "hashtable.h"
+#include "FlakeKernels.h"
+#include "FrameDamage.h"
+#include "LoadMeasure.h"
 #include "ixpm.h"
-#include "kdtree.h"
 #include "MainWindow.h"
+#include "MemoryStats.h"
+#include "NeighborGrid.h"
 #include "pixmaps.h"
+#include "Random.h"
 #include "Santa.h"
+#include "SpriteCache.h"
+#include "StartupTasks.h"
+#include "Suspend.h"
+#include "ThreadPolicy.h"
 #include "Utils.h"
 #include "windows.h"
+#include "WorldSnapshot.h"
 
 #define NWINGS 8
+#define BIRDS_MAX_WORKERS 8
+#define BIRDS_PER_WORKER_MIN 64
 #define NBIRDPIXBUFS (3 * NWINGS)
+#define BIRD_SPRITE_BUCKETS 64
+
+// Depth LOD by drawn width: tier t is steered every 1 << t
+// speed ticks, integrated in between. Far birds also share
+// every other sprite bucket.
+#define BIRD_LOD_TIERS 3
+#define BIRD_LOD_NEAR_WIDTH 24
+#define BIRD_LOD_FAR_WIDTH 10
+#define BIRD_LOD_FAR_BUCKET_STEP 2
 
 #define INACTIVE (!Flags.ShowBirds || blobals.freeze || !WorkspaceActive())
 
@@ -58,6 +79,7 @@
 /* Surface to store current scribbles */
 
 static GdkPixbuf *bird_pixbufs[NBIRDPIXBUFS];
+static cairo_surface_t *birdSprites[BIRD_SPRITE_BUCKETS][NBIRDPIXBUFS];
 static cairo_surface_t *attrsurface = NULL;
 
 static int
@@ -78,6 +100,12 @@ typedef struct _Birdtype {
         int prevx, prevy, prevw, prevh, prevdrawable;
 } BirdType;
 
+// Position and speed of a bird, as steered by the speed thread.
+typedef struct _BirdState {
+        float x, y, z;
+        float sx, sy, sz;
+} BirdState;
+
 struct _blobals blobals;
 
 static void createAttractionPointSurface(void);
@@ -95,11 +123,31 @@ static int do_update_pos_birds();
 static void *updateBirdSpeed();
 static int do_wings();
 
+// Bird pixbufs built on the startup pool.
+typedef struct _BirdPixbufsJob {
+        char *color;
+        int serial;
+        GdkPixbuf *pixbufs[NBIRDPIXBUFS];
+} BirdPixbufsJob;
+
+// Bumped on every rebuild in place, so a startup job
+// finishing late never overwrites newer pixbufs.
+static int birdPixbufsSerial = 0;
+static BirdPixbufsJob birdPixbufsJob;
+
+// Color of bird_pixbufs, part of the sprite cache key.
+static char *birdPixbufsColor = NULL;
+
+static void create_bird_pixbufs(const char *color, GdkPixbuf **pixbufs);
+static void *build_bird_pixbufs_job(void *arg);
+static void install_bird_pixbufs_job(void *result, void *arg);
 static void init_bird_pixbufs(const char *color);
+static cairo_surface_t *getBirdSprite(int pixbufIndex, int iw, int tier);
+static float getBirdWidth(float y);
+static int getBirdTier(float y);
+static void clearBirdSprites(void);
 static void main_window(void);
 static void normalize_speed(BirdType *bird, float speed);
-static void prefxyz(BirdType *bird, float d, float e, float x, float y, float z,
-    float *prefx, float *prefy, float *prefz);
 static void r2i(BirdType *bird);
 static void i2r(BirdType *bird);
 static int attrbird_erase(int force);
@@ -111,8 +159,37 @@ static int unlock(void);
 static float time_update_pos_birds = 0.01;
 static float time_update_speed_birds = 0.20;
 static float time_wings = 0.10;
-
-static struct kdtree *kd = NULL;
+static FixedStepClock birdStepClock;
+#define BIRD_MAX_CATCHUP_STEPS 8
+
+// The speed thread steers from a snapshot of the birds into
+// a second buffer, split over a pool of workers. Each draws
+// from its own thread's random state.
+typedef struct _BirdWorker {
+        pthread_t thread;
+        sem_t startSemaphore;
+        int first, last;      // range of birds to steer
+        int *neighbours;
+        int steered;          // birds steered this tick
+        // neighbours gathered for the kernel, six rows of
+        // stateCapacity: x, y, z, sx, sy, sz
+        float *gathered;
+        int sumnum;
+        float summeandist;
+} BirdWorker;
+
+static NeighborGrid neighborGrid;
+static BirdState *birdStates = NULL;
+static BirdState *nextBirdStates = NULL;
+static int stateCount = 0;
+static float stateRange = 0;
+static BirdState attrState;
+static int stateCapacity = 0;
+
+static BirdWorker birdWorkers[BIRDS_MAX_WORKERS];
+static unsigned int birdSteerTick = 0;
+static int birdWorkerCount = 0;
+static sem_t birdWorkersDone;
 
 static BirdType *birds = NULL;
 static BirdType attrbird;
@@ -205,6 +282,21 @@ static float scale(float y) {
     return s;
 }
 
+// drawn width in pixels of a bird at depth y
+float getBirdWidth(float y) {
+    return scale(y) * blobals.bird_scale * Flags.BirdsScale * 6.0e-6 *
+           blobals.maxix;
+}
+
+// LOD tier of a bird at depth y, 0 is nearest
+int getBirdTier(float y) {
+    const float width = getBirdWidth(y);
+    if (width >= BIRD_LOD_NEAR_WIDTH) {
+        return 0;
+    }
+    return width >= BIRD_LOD_FAR_WIDTH ? 1 : BIRD_LOD_TIERS - 1;
+}
+
 // #define CO_REAL
 //  given bird, compute screen coordinates ix and iz, and depth iy
 void r2i(BirdType *bird) {
@@ -247,21 +339,6 @@ static void i2r(BirdType *bird) {
     bird->iy = blobals.ay * bird->y;
 }
 
-// given:
-// bird
-// distance d
-// optimal distance e
-// coordinates of other bird x,y,z
-// compute optimal coordinates for bird: prefx, prefy, prefz
-void prefxyz(BirdType *bird, float d, float e, float x, float y, float z,
-    float *prefx, float *prefy, float *prefz) {
-    *prefx = e * (bird->x - x) / d + x;
-    *prefy = e * (bird->y - y) / d + y;
-    *prefz = e * (bird->z - z) / d + z;
-    P("%f %f - %f %f %f, %f %f %f, %f %f %f\n", d, e, bird->x, bird->y, bird->z,
-        x, y, z, *prefx, *prefy, *prefz);
-}
-
 // create a attraction point surface in attrsurface
 // is called when user changes drawing scale
 // and when attraction point is changed
@@ -284,142 +361,284 @@ void createAttractionPointSurface() {
 
 void birds_set_scale() { createAttractionPointSurface(); }
 
-void *updateBirdSpeed() {
-    while (1) {
-        if (!(Flags.shutdownRequested || INACTIVE)) {
+// Steer one bird from the snapshot, write its next speed.
+static void steerBird(BirdWorker *worker, int i) {
+    const BirdState *bird = &birdStates[i];
+    BirdState *next = &nextBirdStates[i];
+    *next = *bird;
 
-            lock();
-            kd_free(kd);
-            kd = kd_create(3);
+    if (randomUniform() < Flags.Anarchy * 0.01) {
+        return;
+    }
 
-            int i;
+    const int numFound = neighborGridQuery(&neighborGrid,
+        &birdStates[0].x, sizeof(BirdState), bird->x, bird->y, bird->z,
+        stateRange, worker->neighbours, stateCount);
+
+    // gather the neighbours into rows, and sum their speeds,
+    // distances and preferred positions in one vectorized
+    // pass
+    float *gx = worker->gathered;
+    float *gy = gx + stateCapacity;
+    float *gz = gy + stateCapacity;
+    float *gsx = gz + stateCapacity;
+    float *gsy = gsx + stateCapacity;
+    float *gsz = gsy + stateCapacity;
+    int num = 0;
+    for (int n = 0; n < numFound; n++) {
+        const BirdState *b = &birdStates[worker->neighbours[n]];
+        if (bird == b) {
+            continue;
+        }
+        gx[num] = b->x;
+        gy[num] = b->y;
+        gz[num] = b->z;
+        gsx[num] = b->sx;
+        gsy[num] = b->sy;
+        gsz[num] = b->sz;
+        num++;
+    }
 
-            for (i = 0; i < Nbirds; i++) {
-                BirdType *bird = &birds[i];
-                kd_insert3f(kd, bird->x, bird->y, bird->z, bird);
-            }
+    NeighbourSums sums;
+    flakeKernelsSumNeighbours(gx, gy, gz, gsx, gsy, gsz, num,
+        bird->x, bird->y, bird->z, Flags.PrefDistance, &sums);
+    const float sumsx = sums.sx;
+    const float sumsy = sums.sy;
+    const float sumsz = sums.sz;
+    const float sumprefx = sums.prefx;
+    const float sumprefy = sums.prefy;
+    const float sumprefz = sums.prefz;
+    const float sumdist = sums.dist;
+
+    // meanprefx,y,z: mean optimal coordinates with respect to other
+    // birds
+    float meanprefx, meanprefy, meanprefz, meandist;
+    P("num: %d\n", num);
+    if (num > 0) {
+        meanprefx = sumprefx / num;
+        meanprefy = sumprefy / num;
+        meanprefz = sumprefz / num;
+        meandist = sumdist / num;
+        worker->summeandist += meandist;
+    }
+    worker->sumnum += num;
+    // adjust speed to other birds, p is weight for own speed
+    if (num > 0) {
+        int p = (100 - Flags.FollowWeight) * 0.1;
+        next->sx = (sumsx + p * bird->sx) / (p + 1 + num);
+        next->sy = (sumsy + p * bird->sy) / (p + 1 + num);
+        next->sz = (sumsz + p * bird->sz) / (p + 1 + num);
+    }
+    // adjust speed to obtain desired distance to other birds
+    if (num > 0) {
+        float q = Flags.DisWeight * 0.4;
+        next->sx += q * (meanprefx - bird->x);
+        next->sy += q * (meanprefy - bird->y);
+        next->sz += q * (meanprefz - bird->z);
+    }
 
-            int sumnum = 0;
-            float summeandist = 0;
-            for (i = 0; i < Nbirds; i++) {
-                if (drand48() < Flags.Anarchy * 0.01) {
-                    continue;
-                }
-                BirdType *bird = &birds[i];
-
-                struct kdres *result = kd_nearest_range3f(
-                    kd, bird->x, bird->y, bird->z, blobals.range);
-                float sumsx = 0;
-                float sumsy = 0;
-                float sumsz = 0;
-                float sumprefx = 0;
-                float sumprefy = 0;
-                float sumprefz = 0;
-                float sumdist = 0;
-                int num = 0;
-                while (!kd_res_end(result)) {
-                    float x, y, z;
-                    BirdType *b = (BirdType *)kd_res_item3f(result, &x, &y, &z);
-                    kd_res_next(result);
-                    if (bird == b) {
-                        continue;
-                    }
-                    num++;
+    // attraction of center:
 
-                    // sum the speeds of neighbour birds:
+    float dx = attrState.x - bird->x;
+    float dy = attrState.y - bird->y;
+    float dz = attrState.z - bird->z;
 
-                    sumsx += b->sx;
-                    sumsy += b->sy;
-                    sumsz += b->sz;
+    float f = Flags.AttrFactor * 0.01f * 0.05f;
 
-                    float dist = sqrtf((bird->x - x) * (bird->x - x) +
-                                       (bird->y - y) * (bird->y - y) +
-                                       (bird->z - z) * (bird->z - z));
+    next->sx += f * dx;
+    next->sy += f * dy;
+    next->sz += f * dz;
 
-                    float prefx = 0, prefy = 0, prefz = 0;
-                    P("prefxyz %f\n", dist);
-                    if (dist > 1e-6) {
-                        prefxyz(bird, dist, Flags.PrefDistance, x, y, z, &prefx,
-                            &prefy, &prefz);
-                    }
-                    sumprefx += prefx;
-                    sumprefy += prefy;
-                    sumprefz += prefz;
-                    sumdist += dist;
-                }
-                kd_res_free(result);
-
-                // meanprefx,y,z: mean optimal coordinates with respect to other
-                // birds
-                float meanprefx, meanprefy, meanprefz, meandist;
-                P("num: %d\n", num);
-                if (num > 0) {
-                    meanprefx = sumprefx / num;
-                    meanprefy = sumprefy / num;
-                    meanprefz = sumprefz / num;
-                    meandist = sumdist / num;
-                    summeandist += meandist;
-                    P("prefx - x ... %f %f %f %f\n", meanprefx - bird->x,
-                        meanprefy - bird->y, meanprefz - bird->z, meandist);
-                }
-                sumnum += num;
-                // adjust speed to other birds, p is weight for own speed
-                if (num > 0) {
-                    int p = (100 - Flags.FollowWeight) * 0.1;
-                    bird->sx = (sumsx + p * bird->sx) / (p + 1 + num);
-                    bird->sy = (sumsy + p * bird->sy) / (p + 1 + num);
-                    bird->sz = (sumsz + p * bird->sz) / (p + 1 + num);
-                }
-                // adjust speed to obtain desired distance to other birds
-                if (num > 0) {
-                    float q = Flags.DisWeight * 0.4;
-                    bird->sx += q * (meanprefx - bird->x);
-                    bird->sy += q * (meanprefy - bird->y);
-                    bird->sz += q * (meanprefz - bird->z);
-                    P("%d %f %f %f, %f %f %f\n", i, meanprefx, meanprefy,
-                        meanprefz, bird->x, bird->y, bird->z);
-                }
+    // limit vertical speed
 
-                // attraction of center:
+    const float phs = 0.8;
+    float hs = sqrtf(sq2(next->sx, next->sy));
+    if (fabs(next->sz) > phs * hs) {
+        next->sz = fsignf(next->sz) * phs * hs;
+    }
 
-                float dx = attrbird.x - bird->x;
-                float dy = attrbird.y - bird->y;
-                float dz = attrbird.z - bird->z;
+    // randomize:
+    {
+        const float p = 0.4; //  0<=p<=1 the higher the more random
+        next->sx += next->sx * p * randomUniform();
+        next->sy += next->sy * p * randomUniform();
+        next->sz += next->sz * p * randomUniform();
+    }
 
-                float f = Flags.AttrFactor * 0.01f * 0.05f;
+    // normalize speed
+    float speed = blobals.meanspeed * (0.9 + randomUniform() * 0.2);
+    float v2 = sq3(next->sx, next->sy, next->sz);
+    if (fabsf(v2) < 1.0e-10) {
+        v2 = blobals.meanspeed;
+    }
+    float a = speed / sqrtf(v2);
+    next->sx *= a;
+    next->sy *= a;
+    next->sz *= a;
+}
 
-                bird->sx += f * dx;
-                bird->sy += f * dy;
-                bird->sz += f * dz;
+static void steerBirds(BirdWorker *worker) {
+    worker->sumnum = 0;
+    worker->summeandist = 0;
+    worker->steered = 0;
+    for (int i = worker->first; i < worker->last; i++) {
+        // far birds keep their speed most ticks, staggered
+        // over the flock
+        const unsigned int interval = 1u << getBirdTier(birdStates[i].y);
+        if ((birdSteerTick + i) & (interval - 1)) {
+            nextBirdStates[i] = birdStates[i];
+            continue;
+        }
+        steerBird(worker, i);
+        worker->steered++;
+    }
+}
 
-                // limit vertical speed
+static void *execBirdWorker(void *arg) {
+    BirdWorker *worker = (BirdWorker *) arg;
+    registerPolicyThread("ps-birds", (int) (worker - birdWorkers), false);
+    seedRandomThread(RANDOM_THREAD_BIRD_WORKERS + (worker - birdWorkers));
 
-                const float phs = 0.8;
-                float hs = sqrtf(sq2(bird->sx, bird->sy));
-                if (fabs(bird->sz) > phs * hs) {
-                    bird->sz = fsignf(bird->sz) * phs * hs;
-                }
+    while (1) {
+        sem_wait(&worker->startSemaphore);
+        steerBirds(worker);
+        sem_post(&birdWorkersDone);
+    }
+    return NULL;
+}
 
-                // randomize:
-                {
-                    const float p = 0.4; //  0<=p<=1 the higher the more random
-                    bird->sx += bird->sx * p * drand48();
-                    bird->sy += bird->sy * p * drand48();
-                    bird->sz += bird->sz * p * drand48();
-                }
+// start the steering workers, one per cpu
+static void initBirdWorkers() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    birdWorkerCount = cpus < 1 ? 1 :
+        (cpus > BIRDS_MAX_WORKERS ? BIRDS_MAX_WORKERS : cpus);
+
+    sem_init(&birdWorkersDone, 0, 0);
+    for (int i = 0; i < birdWorkerCount; i++) {
+        BirdWorker *worker = &birdWorkers[i];
+        // worker 0 is the speed thread itself
+        if (i > 0) {
+            sem_init(&worker->startSemaphore, 0, 0);
+            pthread_create(&worker->thread, NULL, execBirdWorker, worker);
+        }
+    }
+}
+
+// size the double buffers and neighbour lists for n birds
+static void sizeBirdStates(int n) {
+    if (n + 1 <= stateCapacity) {
+        return;
+    }
+    stateCapacity = n + 1;
+    birdStates = (BirdState *)realloc(birdStates,
+        sizeof(BirdState) * stateCapacity);
+    REALLOC_CHECK(birdStates);
+    nextBirdStates = (BirdState *)realloc(nextBirdStates,
+        sizeof(BirdState) * stateCapacity);
+    REALLOC_CHECK(nextBirdStates);
+    for (int i = 0; i < birdWorkerCount; i++) {
+        birdWorkers[i].neighbours = (int *)realloc(
+            birdWorkers[i].neighbours, sizeof(int) * stateCapacity);
+        REALLOC_CHECK(birdWorkers[i].neighbours);
+        birdWorkers[i].gathered = (float *)realloc(
+            birdWorkers[i].gathered, 6 * sizeof(float) * stateCapacity);
+        REALLOC_CHECK(birdWorkers[i].gathered);
+    }
+}
 
-                normalize_speed(
-                    bird, blobals.meanspeed * (0.9 + drand48() * 0.2));
+void *updateBirdSpeed() {
+    registerPolicyThread("ps-birds", -1, false);
+    seedRandomThread(RANDOM_THREAD_BIRDS);
+    initBirdWorkers();
+
+    while (1) {
+        waitWhileSimulationSuspended();
+
+        // INACTIVE, from the published workspace state.
+        WorldSnapshot world;
+        readWorldSnapshot(&world);
+        if (!(Flags.shutdownRequested || !Flags.ShowBirds ||
+            blobals.freeze || !world.isWorkspaceActive)) {
+
+            // snapshot the birds, the main thread only waits for
+            // the copies in and out
+            lock();
+            sizeBirdStates(Nbirds);
+            stateCount = Nbirds;
+            for (int i = 0; i < stateCount; i++) {
+                BirdState *state = &birdStates[i];
+                state->x = birds[i].x;
+                state->y = birds[i].y;
+                state->z = birds[i].z;
+                state->sx = birds[i].sx;
+                state->sy = birds[i].sy;
+                state->sz = birds[i].sz;
             }
-            float meannum = (float)sumnum / (float)Nbirds;
-            blobals.mean_distance = summeandist / Nbirds;
-            P("meannum %f %f\n", meannum, blobals.range);
+            attrState.x = attrbird.x;
+            attrState.y = attrbird.y;
+            attrState.z = attrbird.z;
+            stateRange = blobals.range;
+            unlock();
+
+            neighborGridBuild(&neighborGrid, &birdStates[0].x,
+                sizeof(BirdState), stateCount, stateRange);
 
+            // split the birds over the workers, small flocks
+            // are not worth the handoff
+            int workers = stateCount < BIRDS_PER_WORKER_MIN * 2 ? 1 :
+                stateCount / BIRDS_PER_WORKER_MIN;
+            if (workers > birdWorkerCount) {
+                workers = birdWorkerCount;
+            }
+            for (int w = 0; w < workers; w++) {
+                birdWorkers[w].first = stateCount * w / workers;
+                birdWorkers[w].last = stateCount * (w + 1) / workers;
+            }
+            for (int w = 1; w < workers; w++) {
+                sem_post(&birdWorkers[w].startSemaphore);
+            }
+            steerBirds(&birdWorkers[0]);
+            for (int w = 1; w < workers; w++) {
+                sem_wait(&birdWorkersDone);
+            }
+
+            int sumnum = 0;
+            int steered = 0;
+            float summeandist = 0;
+            for (int w = 0; w < workers; w++) {
+                sumnum += birdWorkers[w].sumnum;
+                steered += birdWorkers[w].steered;
+                summeandist += birdWorkers[w].summeandist;
+            }
+            birdSteerTick++;
+
+            // publish the next speeds; birds added meanwhile keep
+            // their initial speed
+            lock();
+            const int count = stateCount < Nbirds ? stateCount : Nbirds;
+            for (int i = 0; i < count; i++) {
+                birds[i].sx = nextBirdStates[i].sx;
+                birds[i].sy = nextBirdStates[i].sy;
+                birds[i].sz = nextBirdStates[i].sz;
+            }
+            unlock();
+
+            // means over the birds steered this tick
+            if (steered < 1) {
+                steered = 1;
+            }
+            float meannum = (float)sumnum / (float)steered;
+            blobals.mean_distance = summeandist / steered;
+            P("meannum %f %f\n", meannum, stateRange);
+
+            // range is read under the lock elsewhere, write it
+            // under the lock too
+            lock();
             if (meannum < Flags.Neighbours) {
                 if (blobals.range < 0.1) {
                     blobals.range = 0.1;
                 }
-                if (meannum < Nbirds - 1) {
+                if (meannum < stateCount - 1) {
                     blobals.range *= 1.1;
                 }
                 if (blobals.range > blobals.maxrange) {
@@ -428,7 +647,6 @@ void *updateBirdSpeed() {
             } else {
                 blobals.range /= 1.1;
             }
-
             unlock();
         }
         usleep((useconds_t) (time_update_speed_birds * 1.0e6));
@@ -446,8 +664,10 @@ int do_update_pos_birds() {
     lock();
 
     P("do_update_pos_birds %d %d\n", Nbirds, counter++);
-    double dt;
-    dt = time_update_pos_birds;
+
+    // Fixed steps, caught up when the timer ran late.
+    const int steps = advanceFixedStepClock(&birdStepClock);
+    const double dt = birdStepClock.step * steps;
 
     P("%f\n", dt);
 
@@ -466,9 +686,79 @@ int do_update_pos_birds() {
     // (void) d;
 }
 
+// Pre-scaled bird surfaces per width bucket and pixbuf (wing
+// state and orientation), built when first drawn. Widths are
+// bucketed logarithmically, so a flock spread over all
+// depths needs a few dozen surfaces per pixbuf. The far LOD
+// tier uses only every BIRD_LOD_FAR_BUCKET_STEP'th bucket.
+static cairo_surface_t *getBirdSprite(int pixbufIndex, int iw, int tier) {
+    // should be log(1.05) ... log(1.5). The higher, the less
+    // cache will be used
+    const double k = log(1.2);
+    int bucket = log(iw) / k;
+    if (tier == BIRD_LOD_TIERS - 1) {
+        bucket -= bucket % BIRD_LOD_FAR_BUCKET_STEP;
+    }
+    if (bucket < 0 || bucket >= BIRD_SPRITE_BUCKETS) {
+        return NULL;
+    }
+
+    cairo_surface_t **sprite = &birdSprites[bucket][pixbufIndex];
+    if (!*sprite) {
+        GdkPixbuf *bird_pixbuf = bird_pixbufs[pixbufIndex];
+        int w = exp(bucket * k);
+        int h = (float)w * gdk_pixbuf_get_height(bird_pixbuf) /
+                (float)gdk_pixbuf_get_width(bird_pixbuf);
+        if (w < 1) {
+            w = 1;
+        }
+        if (h < 1) {
+            h = 1;
+        }
+        P("bird sprite: width: %d bucket: %d pixbuf: %d\n", w, bucket,
+            pixbufIndex);
+
+        // an earlier run may have left it on disk
+        uint64_t cacheKey = 0;
+        if (isSpriteCacheActive()) {
+            cacheKey = getSpriteCacheKey(
+                hashSpriteXpm((const char **)birds_xpm[pixbufIndex]),
+                w, h, 0, birdPixbufsColor ? birdPixbufsColor : "");
+            *sprite = loadCachedSprite(cacheKey);
+            if (*sprite) {
+                return *sprite;
+            }
+        }
+
+        // since we are caching the surfaces, we go for the highest
+        // quality
+        GdkPixbuf *pixbuf =
+            gdk_pixbuf_scale_simple(bird_pixbuf, w, h, GDK_INTERP_HYPER);
+        *sprite = trackSurface(MEMORY_SPRITES,
+            gdk_cairo_surface_create_from_pixbuf(pixbuf, 0, NULL));
+        g_clear_object(&pixbuf);
+        storeCachedSprite(cacheKey, *sprite);
+    }
+    return *sprite;
+}
+
+static void clearBirdSprites() {
+    for (int bucket = 0; bucket < BIRD_SPRITE_BUCKETS; bucket++) {
+        for (int i = 0; i < NBIRDPIXBUFS; i++) {
+            if (birdSprites[bucket][i]) {
+                cairo_surface_destroy(birdSprites[bucket][i]);
+                birdSprites[bucket][i] = NULL;
+            }
+        }
+    }
+}
+
 int birds_draw(cairo_t *cr) {
     P("birds_draw %d\n", counter++);
     LEAVE_IF_INACTIVE;
+    if (!bird_pixbufs[0]) {
+        return TRUE;
+    }
     P("drawing birds %d\n", counter++);
 
     int before;
@@ -518,6 +808,9 @@ int birds_draw(cairo_t *cr) {
             attrbird.prevy = attrbird.iz - mz / 2;
             attrbird.prevw = mx;
             attrbird.prevh = mz;
+            if (attrbird.drawable) {
+                addDrawnDamage(attrbird.prevx, attrbird.prevy, mx, mz);
+            }
             // #define TESTBIRDS
 #ifdef TESTBIRDS
             {
@@ -559,7 +852,9 @@ int birds_draw(cairo_t *cr) {
             }
 #endif
         }
-        for (i = 0; i < Nbirds; i++) {
+        // The quality governor may draw fewer birds.
+        const int drawnBirds = getQualityBirdCount(Nbirds);
+        for (i = 0; i < drawnBirds; i++) {
             BirdType *bird = &birds[i];
 
             if (before) // before attraction point
@@ -580,8 +875,6 @@ int birds_draw(cairo_t *cr) {
                 bird->ix, bird->iy, bird->iz, bird->drawable);
             bird->prevdrawable = bird->drawable;
             if (bird->drawable) {
-                float p = scale(bird->y);
-
                 cairo_surface_t *surface;
                 int iw, ih, nw;
                 nw = bird->wingstate;
@@ -624,8 +917,7 @@ int birds_draw(cairo_t *cr) {
 
                 P("%f %f %d\n", sxz, bird->sy, orient);
                 GdkPixbuf *bird_pixbuf = bird_pixbufs[nw + orient];
-                iw = p * blobals.bird_scale * Flags.BirdsScale * 6.0e-6 *
-                     blobals.maxix;
+                iw = getBirdWidth(bird->y);
                 P("%d %d\n", Flags.BirdsScale, blobals.maxix);
                 ih = (float)iw * gdk_pixbuf_get_height(bird_pixbuf) /
                      (float)gdk_pixbuf_get_width(bird_pixbuf);
@@ -639,38 +931,11 @@ int birds_draw(cairo_t *cr) {
                     continue;
                 }
 
-                const GdkInterpType interpolation = GDK_INTERP_HYPER;
-                // since we are caching the surfaces, we go for the highest
-                // quality
-
-                // logarithmic caching
-                const double k =
-                    log(1.2); // should be log(1.05) ... log(1.5). The higher,
-                              // the less cache will be used
-                unsigned int key =
-                    ((unsigned int)(log(iw) / k) << 8) + nw + orient;
-
-                if (!table_get(key)) {
-                    static int table_counter = 0;
-                    static double cache = 0;
-                    table_counter++;
-                    cache += iw * ih;
-                    P("Entries: %d Cache: %.0f MB width: %d Wing: %d orient: "
-                      "%d\n",
-                        table_counter, cache * 4.0e-6, iw, nw, orient / 8);
-                    if (iw < 1) {
-                        iw = 1;
-                    }
-                    if (ih < 1) {
-                        ih = 1;
-                    }
-                    GdkPixbuf *pixbuf = gdk_pixbuf_scale_simple(
-                        bird_pixbuf, iw, ih, interpolation);
-                    table_insert(key,
-                        gdk_cairo_surface_create_from_pixbuf(pixbuf, 0, NULL));
-                    g_clear_object(&pixbuf);
+                surface = getBirdSprite(nw + orient, iw,
+                    getBirdTier(bird->y));
+                if (!surface) {
+                    continue;
                 }
-                surface = (cairo_surface_t *)table_get(key);
 
                 int mx = cairo_image_surface_get_width(surface);
                 int mz = cairo_image_surface_get_height(surface);
@@ -681,6 +946,7 @@ int birds_draw(cairo_t *cr) {
                 bird->prevy = bird->iz - mz / 2;
                 bird->prevw = mx;
                 bird->prevh = mz;
+                addDrawnDamage(bird->prevx, bird->prevy, mx, mz);
                 P("draw: %d %d\n", bird->ix - mx / 2, bird->iz - mz / 2);
             } else {
                 static int skipped = 0;
@@ -757,18 +1023,14 @@ void init_birds(int start) {
     // Bbirds+1 to prevent allocating zero bytes:
     birds = (BirdType *)realloc(birds, sizeof(BirdType) * (Flags.Nbirds + 1));
     REALLOC_CHECK(birds);
-    if (kd) {
-        kd_free(kd);
-    }
-    kd = kd_create(3);
     Nbirds = Flags.Nbirds;
     for (i = start; i < Nbirds; i++) {
         BirdType *bird = &birds[i];
-        bird->x = drand48() * blobals.maxx;
-        bird->y = drand48() * blobals.maxy;
-        bird->z = drand48() * blobals.maxz;
+        bird->x = randomUniform() * blobals.maxx;
+        bird->y = randomUniform() * blobals.maxy;
+        bird->z = randomUniform() * blobals.maxz;
 
-        double r = drand48();
+        double r = randomUniform();
         if (r > 0.75) {
             bird->x += blobals.maxx;
         } else if (r > 0.50) {
@@ -783,21 +1045,19 @@ void init_birds(int start) {
         bird->ih = 1;
         r2i(bird);
 
-        bird->sx = (0.5 - drand48());
+        bird->sx = (0.5 - randomUniform());
         P("init %f\n", bird->sx);
-        bird->sy = (0.5 - drand48());
-        bird->sz = (0.5 - drand48());
+        bird->sy = (0.5 - randomUniform());
+        bird->sz = (0.5 - randomUniform());
         normalize_speed(bird, blobals.meanspeed);
         P("speed1: %d %f\n", i, sqrtf(sq3(bird->sx, bird->sy, bird->sz)));
         bird->drawable = 1;
-        bird->wingstate = drand48() * NWINGS;
+        bird->wingstate = randomUniform() * NWINGS;
         bird->prevdrawable = 0;
         bird->prevw = 0;
         bird->prevh = 0;
         bird->prevx = 0;
         bird->prevy = 0;
-
-        kd_insert3f(kd, bird->x, bird->y, bird->z, NULL);
     }
 
     unlock();
@@ -887,23 +1147,61 @@ static void main_window() {
 void birds_init_color() {
     int i;
     for (i = 0; i < NBIRDPIXBUFS; i++) {
-        g_object_unref(bird_pixbufs[i]);
+        g_clear_object(&bird_pixbufs[i]);
     }
     init_bird_pixbufs(Flags.BirdsColor);
-    table_clear((void (*)(void *))cairo_surface_destroy);
+    clearBirdSprites();
 }
 
-static void init_bird_pixbufs(const char *color) {
+// decode the birds in color, touches no shared state
+static void create_bird_pixbufs(const char *color, GdkPixbuf **pixbufs) {
     int i;
     for (i = 0; i < NBIRDPIXBUFS; i++) {
         char **x;
         int lines;
         xpm_set_color((char **)birds_xpm[i], &x, &lines, color);
-        bird_pixbufs[i] = gdk_pixbuf_new_from_xpm_data((const char **)x);
+        pixbufs[i] = gdk_pixbuf_new_from_xpm_data((const char **)x);
         xpm_destroy(x);
     }
 }
 
+static void *build_bird_pixbufs_job(void *arg) {
+    BirdPixbufsJob *job = (BirdPixbufsJob *) arg;
+    create_bird_pixbufs(job->color, job->pixbufs);
+    return job;
+}
+
+static void install_bird_pixbufs_job(void *result, void *arg) {
+    (void) arg;
+    BirdPixbufsJob *job = (BirdPixbufsJob *) result;
+
+    if (job->serial != birdPixbufsSerial) {
+        int i;
+        for (i = 0; i < NBIRDPIXBUFS; i++) {
+            g_clear_object(&job->pixbufs[i]);
+        }
+        free(job->color);
+        job->color = NULL;
+        return;
+    }
+
+    int i;
+    for (i = 0; i < NBIRDPIXBUFS; i++) {
+        bird_pixbufs[i] = job->pixbufs[i];
+    }
+    free(birdPixbufsColor);
+    birdPixbufsColor = job->color;
+    job->color = NULL;
+    clearBirdSprites();
+}
+
+static void init_bird_pixbufs(const char *color) {
+    create_bird_pixbufs(color, bird_pixbufs);
+    free(birdPixbufsColor);
+    birdPixbufsColor = strdup(color);
+    birdPixbufsSerial++;
+}
+
 void init_bird(BirdType *bird) {
     bird->x = 0;
     bird->y = 0;
@@ -973,13 +1271,13 @@ int randomlyChangeAttractionPoint() {
         return TRUE;
     }
 
-    float y = 0.4 + drand48() * 0.2;
+    float y = 0.4 + randomUniform() * 0.2;
 
-    attrbird.ix = (0.1 + drand48() * 0.8) * blobals.maxix;
+    attrbird.ix = (0.1 + randomUniform() * 0.8) * blobals.maxix;
     attrbird.y = y * blobals.maxy;
     attrbird.iz = 120; // of no importance
 
-    float z = drand48() * attr_maxz(attrbird.y) / blobals.maxz;
+    float z = randomUniform() * attr_maxz(attrbird.y) / blobals.maxz;
 
     i2r(&attrbird);
 
@@ -995,8 +1293,12 @@ int randomlyChangeAttractionPoint() {
 }
 
 void birds_init() {
-    init_bird_pixbufs("black"); // just to have pixbufs we can throw away
-    birds_init_color();
+    // Pixbufs come from the startup pool, the birds show
+    // once they are in.
+    birdPixbufsJob.color = strdup(Flags.BirdsColor);
+    birdPixbufsJob.serial = birdPixbufsSerial;
+    addStartupTask(build_bird_pixbufs_job, install_bird_pixbufs_job,
+        &birdPixbufsJob);
     static int running = 0;
 
     if (running) {
@@ -1014,11 +1316,13 @@ void birds_init() {
         blobals.prefdweight = 1;
 
         clear_flags();
-        addMethodToMainloop(
+        initFixedStepClock(&birdStepClock, time_update_pos_birds,
+            BIRD_MAX_CATCHUP_STEPS);
+        addSimulationMethodToMainloop(
             PRIORITY_HIGH, time_update_pos_birds, do_update_pos_birds);
-        addMethodToMainloop(PRIORITY_HIGH, time_wings, do_wings);
-        addMethodToMainloop(PRIORITY_DEFAULT, time_change_attr, randomlyChangeAttractionPoint);
-        addMethodToMainloop(PRIORITY_DEFAULT, time_main_window, do_main_window);
+        addSimulationMethodToMainloop(PRIORITY_HIGH, time_wings, do_wings);
+        addSimulationMethodToMainloop(PRIORITY_DEFAULT, time_change_attr, randomlyChangeAttractionPoint);
+        addSimulationMethodToMainloop(PRIORITY_DEFAULT, time_main_window, do_main_window);
 
         static pthread_t thread;
         P("birds speed thread start\n");
@@ -60,6 +60,7 @@
     BUTTON(togglecode, plasmasnow_celestials, NoWind, -1) /*i*/                     \
     BUTTON(togglecode, plasmasnow_settings, BlackBackground, 1)                     \
     BUTTON(togglecode, plasmasnow_settings, Outline, 1)                             \
+    BUTTON(togglecode, plasmasnow_settings, LowPrio, 1)                             \
     BUTTON(togglecode, plasmasnow_celestials, MoonColor, 1)
 
 #define ALL_SCALES                                                                  \
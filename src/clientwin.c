@@ -44,11 +44,27 @@
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <pthread.h>
+#include <stdint.h>
 
 #include "clientwin.h"
+#include "hashtable.h"
+#include "XTraffic.h"
 
 static Atom atom_wm_state = None;
 
+// Parents of windows asked about. We only get events for
+// root's direct children, so parents seen in CreateNotify /
+// ReparentNotify are kept apart from those asked of the X
+// server. The asked ones may be nested inside a frame, where
+// a reparent never reaches us, and are dropped whenever the
+// window layout may have changed under us.
+// Each is emptied when it grows past this, in case we missed
+// the destroy of many.
+#define PARENT_CACHE_MAX_WINDOWS 4096
+
+static WindowMap* mParentCache = NULL;
+static WindowMap* mQueriedParentCache = NULL;
+
 /*
  * Check if window has given property
  */
@@ -243,3 +259,102 @@ Window Find_Client(Display *dpy, Window root, Window subwin) {
     /* Did not find a client */
     return subwin;
 }
+
+/** *********************************************************************
+ ** This method returns the parent of a window, from the cache
+ ** when known, else asks the X server once and keeps it.
+ ** Returns None if the window is gone.
+ ** threads: main thread only
+ **/
+Window getCachedParent(Display *dpy, Window window) {
+    if (window == None) {
+        return None;
+    }
+    if (!mParentCache) {
+        mParentCache = windowMapCreate();
+        mQueriedParentCache = windowMapCreate();
+    }
+
+    // A cached root has parent None, stored as itself.
+    void* cached = windowMapGet(mParentCache, window);
+    if (!cached) {
+        cached = windowMapGet(mQueriedParentCache, window);
+    }
+    if (cached) {
+        const Window parent = (Window) (uintptr_t) cached;
+        return parent == window ? None : parent;
+    }
+
+    Window root, parent;
+    Window *children = NULL;
+    unsigned int childCount;
+    if (!XQueryTree(dpy, window, &root, &parent, &children, &childCount)) {
+        return None;
+    }
+    if (children) {
+        XFree((char *) children);
+    }
+
+    // Root's direct children are followed by our root events,
+    // anything deeper only until the layout may have changed.
+    WindowMap* cache = (parent == None || parent == root) ?
+        mParentCache : mQueriedParentCache;
+    if (windowMapSize(cache) >= PARENT_CACHE_MAX_WINDOWS) {
+        windowMapClear(cache);
+    }
+    windowMapInsert(cache, window, (void*) (uintptr_t)
+        (parent == None ? window : parent));
+    return parent;
+}
+
+/** *********************************************************************
+ ** This method keeps the parent cache in step with an X event.
+ **
+ ** A reparent anywhere, or a map or configure of a window the
+ ** event cache doesn't know, may mean a window manager has
+ ** rebuilt a frame we can't see into, so the parents we asked
+ ** the X server for are dropped and asked again on next use.
+ ** threads: main thread only
+ **/
+void updateParentCache(XEvent *event) {
+    if (!mParentCache) {
+        return;
+    }
+
+    switch (event->type) {
+        case CreateNotify:
+            if (windowMapSize(mParentCache) >= PARENT_CACHE_MAX_WINDOWS) {
+                windowMapClear(mParentCache);
+            }
+            windowMapInsert(mParentCache, event->xcreatewindow.window,
+                (void*) (uintptr_t) event->xcreatewindow.parent);
+            break;
+
+        case ReparentNotify:
+            if (windowMapSize(mParentCache) >= PARENT_CACHE_MAX_WINDOWS) {
+                windowMapClear(mParentCache);
+            }
+            windowMapInsert(mParentCache, event->xreparent.window,
+                (void*) (uintptr_t) event->xreparent.parent);
+            windowMapClear(mQueriedParentCache);
+            break;
+
+        case ConfigureNotify:
+            if (!windowMapGet(mParentCache, event->xconfigure.window)) {
+                windowMapClear(mQueriedParentCache);
+            }
+            break;
+
+        case MapNotify:
+            if (!windowMapGet(mParentCache, event->xmap.window)) {
+                windowMapClear(mQueriedParentCache);
+            }
+            break;
+
+        case DestroyNotify:
+            windowMapRemove(mParentCache, event->xdestroywindow.window);
+            windowMapRemove(mQueriedParentCache,
+                event->xdestroywindow.window);
+            break;
+    }
+}
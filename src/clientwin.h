@@ -46,3 +46,8 @@
 #include <X11/Xlib.h>
 
 extern Window Find_Client(Display *dpy, Window root, Window target_win);
+
+// Parent lookups answered locally once a window is known,
+// kept current from X events. threads: main thread only
+extern Window getCachedParent(Display *dpy, Window window);
+extern void updateParentCache(XEvent *event);
@@ -24,6 +24,64 @@
 #include <pthread.h>
 #include <stdlib.h>
 
+#include "Benchmark.h"
+
+// A step may be paid out this much early.
+#define FIXED_STEP_EARLY_FRACTION 0.1
+
 double wallcl() { return (double)g_get_real_time() * 1.0e-6; }
 
-double wallclock() { return (double)g_get_monotonic_time() * 1.0e-6; }
+// Simulation time: the simulated clock under -benchmark.
+double wallclock() {
+    if (isBenchmarkActive()) {
+        return getBenchmarkClock();
+    }
+    return (double)g_get_monotonic_time() * 1.0e-6;
+}
+
+/** *********************************************************************
+ ** This method starts a fixed step clock at now.
+ **/
+void initFixedStepClock(FixedStepClock* clock, double step, int maxSteps) {
+    clock->step = step;
+    clock->maxSteps = maxSteps;
+    clock->accumulator = 0;
+    clock->prevTime = wallclock();
+}
+
+/** *********************************************************************
+ ** This method banks the time since the last call, and
+ ** returns the number of whole steps to simulate now.
+ **/
+int advanceFixedStepClock(FixedStepClock* clock) {
+    const double now = wallclock();
+    double elapsed = now - clock->prevTime;
+    clock->prevTime = now;
+
+    // Clock went back, or a suspend: start over.
+    if (elapsed < 0 || elapsed > 1.0) {
+        elapsed = clock->step;
+    }
+
+    // A tick a little early still pays out its step, leaving
+    // the accumulator a little short, instead of 0 then 2.
+    clock->accumulator += elapsed;
+    int steps = (int) (clock->accumulator / clock->step +
+        FIXED_STEP_EARLY_FRACTION);
+    if (steps > clock->maxSteps) {
+        steps = clock->maxSteps;
+        clock->accumulator = clock->step * steps;
+    }
+    clock->accumulator -= clock->step * steps;
+    return steps;
+}
+
+/** *********************************************************************
+ ** This method returns how far now is into the next step,
+ ** 0 to 1, for drawing between the last two states.
+ **/
+double getFixedStepAlpha(const FixedStepClock* clock) {
+    const double alpha = (clock->accumulator +
+        wallclock() - clock->prevTime) / clock->step;
+    return alpha < 0 ? 0 : alpha > 1 ? 1 : alpha;
+}
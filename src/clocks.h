@@ -21,5 +21,21 @@
 */
 #pragma once
 
+// Fixed timestep simulation clock. Elapsed wallclock time is
+// banked and paid out in whole steps, at most maxSteps per
+// advance; time beyond that is dropped, so a stall slows the
+// simulation down instead of bursting.
+typedef struct {
+        double step;
+        int maxSteps;
+        double accumulator;
+        double prevTime;
+} FixedStepClock;
+
 extern double wallclock(void);
 extern double wallcl(void);
+
+extern void initFixedStepClock(FixedStepClock* clock,
+    double step, int maxSteps);
+extern int advanceFixedStepClock(FixedStepClock* clock);
+extern double getFixedStepAlpha(const FixedStepClock* clock);
@@ -183,6 +183,20 @@ void docs_usage(int man) {
         "%d).",
         F(useDoubleBuffers));
     manout(" ", "Only effective with '-root' or '-id' or '-xwininfo'.");
+    manout("-xshm      ",
+        "On a local display, draw client side and send only changed areas");
+    manout(" ", "through MIT-SHM. Replaces -doublebuffer when available.");
+    manout("-tilethreads <n>",
+        "With -xshm, draw snow in <n> horizontal tiles, one thread");
+    manout(" ", "each. 0: draw on one thread (default: %d).", F(TileThreads));
+    manout("-pixelraster",
+        "With -xshm, blend flakes and fallen snow straight into the");
+    manout(" ", "frame memory, rather than through cairo, also without");
+    manout(" ", "-tilethreads.");
+    manout("-gl        ",
+        "With a transparent window, draw through OpenGL: flakes in one");
+    manout(" ", "instanced call from the flake atlas, the rest as one cairo");
+    manout(" ", "layer texture. Falls back to cairo without a GL context.");
     manout("-transparency <n>", "Transparency in % (default: %d)",
         F(Transparency));
     manout("-theme <n>",
@@ -221,11 +235,93 @@ void docs_usage(int man) {
     manout(".", "You probably want to select: Mode: Only One Screen Saver.");
     manout("-bg <f>     ",
         "file to be used as background when running under xscreensaver.");
+    manout("-fullscreensaver",
+        "Under xscreensaver, also run Santa, birds and snow on windows.");
+    manout(" ", "Default is a lean pipeline: sky, scenery, snow and bottom snow.");
     manout("-noisy     ",
         "Write extra info about some mouse clicks, X errors etc, to stdout.");
+    manout(" ", "Also writes memory use per module every 10 seconds.");
+    manout("-perfstats ",
+        "Write p50/p95/p99 draw and tick times per module to stdout,");
+    manout(" ", "with memory use per module, and X requests, round trips");
+    manout(" ", "and flushes per second for each timer and thread.");
+    manout("-metricsfile <file>",
+        "Every 10 seconds, write frame times, flake counts, fallen");
+    manout(" ", "snow, lock waits, thread cpu and X traffic to <file> in");
+    manout(" ", "Prometheus text format, for the node exporter textfile");
+    manout(" ", "collector.");
+    manout("-metricsdbus",
+        "Serve the same metrics on the session bus as");
+    manout(" ", "org.plasmasnow.Metrics, method GetMetrics on object");
+    manout(" ", "/org/plasmasnow/Metrics.");
+    manout("-benchmark <n>",
+        "Run <n> simulated seconds offscreen, as fast as possible,");
+    manout(" ", "with a fixed random seed, then report module times,");
+    manout(" ", "heap use and frames per second. An X display is still");
+    manout(" ", "needed, Xvfb will do.");
+    manout("-benchmarkwidth <n>", "Benchmark screen width (default: %d).",
+        F(BenchmarkWidth));
+    manout("-benchmarkheight <n>", "Benchmark screen height (default: %d).",
+        F(BenchmarkHeight));
+    manout("-benchmarkwindows <n>",
+        "Benchmark synthetic windows to collect snow (default: %d).",
+        F(BenchmarkWindows));
+    manout("-record <file>",
+        "Write the random seed, window geometry, workspace and wind");
+    manout(" ", "changes and settings changes of this session to <file>.");
+    manout("-replay <file>",
+        "Run a session written by -record as a -benchmark, offscreen,");
+    manout(" ", "at the recorded screen size, to compare runs against it.");
+    manout("-nospritecache",
+        "Scale all sprites afresh, instead of mapping the ones");
+    manout(" ", "kept in $XDG_CACHE_HOME/plasmasnow/sprites by earlier runs.");
+    manout("-nosnowstate",
+        "Start with bare windows and desktop, instead of the fallen");
+    manout(" ", "snow saved in $XDG_CACHE_HOME/plasmasnow at the last exit");
+    manout(" ", "or display change, if less than a day old.");
+    manout("-noocclusion",
+        "Draw snow hidden behind other windows too. By default,");
+    manout(" ", "with a transparent window, flakes and fallen snow fully");
+    manout(" ", "covered by windows are not painted.");
+    manout("-frameclock <n>",
+        "Draw on every <n>th display refresh, paced by the GTK frame");
+    manout(" ", "clock, instead of a timer set by -cpuload. Only with a");
+    manout(" ", "transparent window. 0 uses the timer (default: %d).",
+        F(FrameClock));
+    manout("-peroutput",
+        "With several monitors, draw snow only on the monitors, and");
+    manout(" ", "let it settle on the bottom of each monitor, instead of");
+    manout(" ", "the bottom of one box around them all.");
     manout("-cpuload <n>", "How busy is your system with plasmasnow:");
     manout(" ", "the higher, the more load on the system (default: %d).",
         F(CpuLoad));
+    manout("-lowfps <n>",
+        "Frames per second on battery power, or when the user is");
+    manout(" ", "idle. 0 pauses the snow instead. A full screen window");
+    manout(" ", "in front always pauses it (default: %d).", F(LowFps));
+    manout("-idletime <n>",
+        "Seconds without pointer motion or window switch taken as");
+    manout(" ", "idle. 0: never idle (default: %d).", F(IdleTime));
+    manout("-nopowerpolicy",
+        "Keep the full frame rate on battery, when idle, and behind");
+    manout(" ", "full screen windows.");
+    manout("-lowprio",
+        "Run the background threads (fallen snow, birds, aurora and");
+    manout(" ", "others) at niceness -threadnice, so they only get what");
+    manout(" ", "other programs leave over.");
+    manout("-nolowprio", "(Default) Run all threads at normal priority.");
+    manout("-schedidle",
+        "As -lowprio, but under SCHED_IDLE instead of a niceness.");
+    manout("-lowpriorender",
+        "With -lowprio or -schedidle, drawing threads too.");
+    manout("-threadnice <n>",
+        "Niceness of -lowprio threads (default: %d). Lowering it",
+        F(ThreadNice));
+    manout(" ", "again may need a restart.");
+    manout("-threadaffinity <n>",
+        "Bit mask of the cpus background threads run on, for");
+    manout(" ", "example 12 for cpus 2 and 3. 0: all cpus (default: %d).",
+        F(ThreadAffinity));
 
     if (doman) {
         printf(".PP\n");
@@ -376,6 +472,13 @@ void docs_usage(int man) {
     manout("-auroraspeed <n>", "Animation speed of aurora (default: %d).",
         F(AuroraSpeed));
     manout(".", "   10: about real value, 100: timelapse.");
+    manout("-aurorafastfuzz",
+        "Paint the fuzzy edges of aurora once, with double alpha.");
+    manout(" ", "Faster, with slightly harder edges.");
+    manout("-auroraresolution <n>",
+        "Draw aurora at 1/<n> of the screen resolution, <n> is 1, 2");
+    manout(" ", "or 4, and upscale it smoothly (default: %d).",
+        F(AuroraResolution));
     manout("-aurorabrightness <n>", "Brightness of aurora (default: %d).",
         F(AuroraBrightness));
 
@@ -499,6 +602,15 @@ void docs_usage(int man) {
         "          -above  -defaults  -desktop  -fullscreen -noconfig -id");
     manout(".", "          -nomenu -stopafter -xwininfo -display    -noisy    "
                 "-checkgtk");
+    manout(".", "          -perfstats -xshm -tilethreads -pixelraster -gl");
+    manout(".", "          -aurorafastfuzz -auroraresolution");
+    manout(".", "          -benchmark -benchmarkwidth -benchmarkheight "
+                "-benchmarkwindows");
+    manout(".", "          -nospritecache -frameclock -peroutput");
+    manout(".", "          -nosnowstate -noocclusion");
+    manout(".", "          -lowpriorender -schedidle -threadnice -threadaffinity");
+    manout(".", "          -lowfps -idletime -nopowerpolicy -fullscreensaver");
+    manout(".", "          -metricsfile -metricsdbus");
     manout(" ", " ");
     manout("$HOME/plasmasnow/pixmaps/tree.xpm",
         "If present, plasmasnow will try this file for displaying");
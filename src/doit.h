@@ -30,22 +30,50 @@
 // these flags are not written to the config file and
 // are no part of the ui (except BelowAll)
 #define DOITALL                                                                \
+    DOIT_I(AuroraFastFuzz, 0, 0)                                               \
+    DOIT_I(AuroraResolution, 1, 1)                                             \
+    DOIT_I(Benchmark, 0, 0)                                                    \
+    DOIT_I(BenchmarkHeight, 1080, 1080)                                        \
+    DOIT_I(BenchmarkWidth, 1920, 1920)                                         \
+    DOIT_I(BenchmarkWindows, 8, 8)                                             \
     DOIT_I(Changes, 0, 0)       /* not a parameter or button */                \
     DOIT_I(Defaults, 0, 0)                                                     \
     DOIT_I(Desktop, 0, 0)                                                      \
     DOIT_I(shutdownRequested, 0, 0)                                            \
     DOIT_I(ForceRoot, 0, 0)                                                    \
+    DOIT_I(FrameClock, 0, 0)                                                   \
     DOIT_I(FullScreen, 0, 0)                                                   \
+    DOIT_I(FullScreensaver, 0, 0)                                              \
     DOIT_I(HideMenu, 0, 0)                                                     \
+    DOIT_I(IdleTime, 300, 300)                                                 \
+    DOIT_I(LowFps, 10, 10)                                                     \
+    DOIT_I(LowPrioRender, 0, 0)                                                \
+    DOIT_I(MetricsDBus, 0, 0)                                                  \
     DOIT_I(NoConfig, 0, 0)                                                     \
     DOIT_I(NoMenu, 0, 0)                                                       \
+    DOIT_I(NoOcclusion, 0, 0)                                                  \
+    DOIT_I(NoPowerPolicy, 0, 0)                                                \
+    DOIT_I(NoSnowState, 0, 0)                                                  \
+    DOIT_I(NoSpriteCache, 0, 0)                                                \
     DOIT_I(Noisy, 0, 0)                                                        \
+    DOIT_I(PerOutput, 0, 0)                                                    \
+    DOIT_I(PerfStats, 0, 0)                                                    \
+    DOIT_I(PixelRaster, 0, 0)                                                  \
+    DOIT_I(SchedIdle, 0, 0)                                                    \
     DOIT_I(StopAfter, -1, -1)                                                  \
+    DOIT_I(ThreadAffinity, 0, 0)                                               \
+    DOIT_I(ThreadNice, 19, 19)                                                 \
+    DOIT_I(TileThreads, 0, 0)                                                  \
     DOIT_I(useDoubleBuffers, 1, 1) \
+    DOIT_I(UseGL, 0, 0)                                                        \
+    DOIT_I(UseXShm, 0, 0)                                                      \
     DOIT_I(WindNow, 0, 0)                                                      \
     DOIT_I(XWinInfoHandling, 0, 0)                                             \
     DOIT_L(WindowId, 0, 0)                                                     \
     DOIT_S(DisplayName, "", "")                                                \
+    DOIT_S(MetricsFile, "", "")                                                \
+    DOIT_S(RecordFile, "", "")                                                 \
+    DOIT_S(ReplayFile, "", "")                                                 \
     DOIT
 
 // following flags are written to the config file and
@@ -68,6 +96,7 @@
     DOIT_I(BlowOffFactor, 40, 40)                                              \
     DOIT_I(BlowSnow, 1, 0)                                                     \
     DOIT_I(CpuLoad, 100, 100)                                                  \
+    DOIT_I(LowPrio, 0, 0)                                                      \
     DOIT_I(Transparency, 0, 0)                                                 \
     DOIT_I(Screen, -1, -1)                                                     \
     DOIT_I(Scale, 100, 100)                                                    \
@@ -66,6 +66,7 @@
 
 #include "clientwin.h"
 #include "dsimple.h"
+#include "XTraffic.h"
 
 static int screen = 0;
 static Display *dpy = NULL;
@@ -30,4 +30,44 @@ for i in $(seq `ls "$root/src/Pixmaps"/flake*.xpm | wc -l`) ; do
    printf 'SNOW(%d) \\\n' `expr $i - 1` ;
 done >> "$out"
 echo >> "$out"
+# Pre-decoded flakes: one byte per pixel, 0 is transparent
+# and 1.. index the xpm colors in order.
+for f in $(ls "$root/src/Pixmaps"/flake*.xpm) ; do
+   awk '
+      /^[ \t]*"/ {
+         sub(/^[^"]*"/, ""); sub(/"[^"]*$/, "")
+         if (!started) {
+            split($0, hdr, " ")
+            w = hdr[1]; h = hdr[2]; ncolors = hdr[3]
+            started = 1; row = 0
+            name = FILENAME; sub(/^.*flake/, "", name); sub(/\.xpm$/, "", name)
+            printf "static const unsigned char snow%s_pixels[] = {\n", name
+            next
+         }
+         if (ncolors > 0) {
+            c = substr($0, 1, 1)
+            index_of[c] = ($0 ~ /c[ \t]+[Nn]one/) ? 0 : ++npalette
+            ncolors--
+            next
+         }
+         if (row < h) {
+            line = ""
+            for (i = 1; i <= w; i++) {
+               c = substr($0, i, 1)
+               line = line ((c in index_of) ? index_of[c] : 0) ","
+            }
+            print line
+            row++
+         }
+      }
+      END { print "};" }
+   ' "$f"
+done >> "$out"
+echo "#define SNOW_PIXELS_ALL \\" >> "$out"
+for f in $(ls "$root/src/Pixmaps"/flake*.xpm) ; do
+   awk '/^[ \t]*"/ { sub(/^[^"]*"/, ""); split($0, hdr, " ");
+      name = FILENAME; sub(/^.*flake/, "", name); sub(/\.xpm$/, "", name);
+      printf "SNOW_PIXELS(%s, %d, %d) \\\n", name, hdr[1], hdr[2]; exit }' "$f"
+done >> "$out"
+echo >> "$out"
 if [ -x "$root/addcopyright.sh" ] ; then "$root/addcopyright.sh" "$out"  ; fi
@@ -25,67 +25,218 @@
 #include <config.h>
 #endif
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "debug.h"
 #include "hashtable.h"
+#include "safe_malloc.h"
 
-#ifdef HAVE_UNORDERED_MAP
-    #include <unordered_map>
-    #define MAP std::unordered_map
-#else
-    #include <map>
-    #define MAP std::map
-    #pragma message __FILE__                                                       \
-        ": Using map for the hash table, because unordered_map is not available."
-#endif
 
-static MAP<unsigned int, void *> table;
+/***********************************************************
+ * Module consts.
+ */
+// Smallest table, and most used slots per 4 before growing.
+#define WINDOW_MAP_MIN_CAPACITY 16
+#define WINDOW_MAP_MAX_LOAD 3
 
-extern "C" {
-void table_insert(unsigned int key, void *value) { table[key] = value; }
-void *table_get(unsigned int key) { return (table[key]); }
-void table_clear(void (*destroy)(void *p)) {
-    for (MAP<unsigned int, void *>::iterator it = table.begin();
-         it != table.end(); ++it) {
-        P("%d %p\n", it->first, it->second);
-        destroy(it->second);
-        it->second = 0;
+// Open addressing with linear probing. Slots are allocated
+// on reserve or growth only, so insert / remove / clear in a
+// reserved map never allocate.
+typedef struct _WindowMapSlot {
+    unsigned long key;
+    void* value;
+    bool used;
+} WindowMapSlot;
+
+struct _WindowMap {
+    WindowMapSlot* slots;
+    int capacity;   // Power of two, or 0.
+    int count;
+};
+
+
+/** *********************************************************************
+ ** This method returns the home slot of a key.
+ **/
+static int getWindowMapHome(const WindowMap* map, unsigned long key) {
+    // Fibonacci hashing, window ids are mostly sequential.
+    const unsigned long long hash =
+        (unsigned long long) key * 0x9E3779B97F4A7C15ULL;
+    return (int) (hash >> 32) & (map->capacity - 1);
+}
+
+/** *********************************************************************
+ ** This method returns the slot holding a key, or -1.
+ **/
+static int findWindowMapSlot(const WindowMap* map, unsigned long key) {
+    if (map->capacity == 0) {
+        return -1;
+    }
+
+    const int mask = map->capacity - 1;
+    for (int i = getWindowMapHome(map, key); map->slots[i].used;
+            i = (i + 1) & mask) {
+        if (map->slots[i].key == key) {
+            return i;
+        }
     }
+    return -1;
 }
+
+/** *********************************************************************
+ ** This method places a key not yet present, with room known.
+ **/
+static void placeWindowMapSlot(WindowMap* map, unsigned long key,
+    void* value) {
+    const int mask = map->capacity - 1;
+
+    int i = getWindowMapHome(map, key);
+    while (map->slots[i].used) {
+        i = (i + 1) & mask;
+    }
+
+    map->slots[i].key = key;
+    map->slots[i].value = value;
+    map->slots[i].used = true;
+    map->count++;
 }
 
-#ifdef HAVE_UNORDERED_SET
-#include <unordered_set>
-#define SET std::unordered_set
-#else
-#include <set>
-#pragma message __FILE__ ": Using set, because unordered_set is not available."
-#define SET std::set
-#endif
+/** *********************************************************************
+ ** This method rehashes a map into a table of a capacity.
+ **/
+static void resizeWindowMap(WindowMap* map, int capacity) {
+    WindowMapSlot* oldSlots = map->slots;
+    const int oldCapacity = map->capacity;
 
-static SET<void *> myset;
-static SET<void *>::iterator myset_iter;
+    map->slots = (WindowMapSlot*) calloc(capacity, sizeof(WindowMapSlot));
+    MALLOC_CHECK(map->slots);
+    map->capacity = capacity;
+    map->count = 0;
+
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldSlots[i].used) {
+            placeWindowMapSlot(map, oldSlots[i].key, oldSlots[i].value);
+        }
+    }
+    free(oldSlots);
+}
 
 extern "C" {
-void set_insert(void *key) { myset.insert(key); }
-void set_erase(void *key) { myset.erase(key); }
-int set_count(void *key) { return myset.count(key); }
-void set_clear() { myset.clear(); }
-/* example:
- *    set_begin();
- *    void *p;
- *    while ( (p = set_next()) )
- *    {
- *       printf("p=%p\n",p);
- *    }
- */
-void set_begin() { myset_iter = myset.begin(); }
-void *set_next() {
-    if (myset_iter == myset.end()) {
-        return 0;
+
+/** *********************************************************************
+ ** These methods create and destroy a map.
+ **/
+WindowMap *windowMapCreate() {
+    WindowMap* map = (WindowMap*) calloc(1, sizeof(WindowMap));
+    MALLOC_CHECK(map);
+    return map;
+}
+
+void windowMapDestroy(WindowMap *map) {
+    if (map) {
+        free(map->slots);
+        free(map);
+    }
+}
+
+/** *********************************************************************
+ ** This method empties a map, keeping its slots.
+ **/
+void windowMapClear(WindowMap *map) {
+    if (map->count > 0) {
+        memset(map->slots, 0, map->capacity * sizeof(WindowMapSlot));
+        map->count = 0;
     }
-    void *v = *myset_iter;
-    myset_iter++;
-    return v;
 }
-unsigned int set_size() { return myset.size(); }
+
+/** *********************************************************************
+ ** This method sizes a map so count entries fit without
+ ** growing.
+ **/
+void windowMapReserve(WindowMap *map, int count) {
+    int capacity = map->capacity ? map->capacity : WINDOW_MAP_MIN_CAPACITY;
+    while (count * 4 > capacity * WINDOW_MAP_MAX_LOAD) {
+        capacity *= 2;
+    }
+    if (capacity != map->capacity) {
+        resizeWindowMap(map, capacity);
+    }
+}
+
+/** *********************************************************************
+ ** This method adds or replaces the entry of a window.
+ **/
+void windowMapInsert(WindowMap *map, unsigned long window, void *value) {
+    const int slot = findWindowMapSlot(map, window);
+    if (slot >= 0) {
+        map->slots[slot].value = value;
+        return;
+    }
+
+    windowMapReserve(map, map->count + 1);
+    placeWindowMapSlot(map, window, value);
+}
+
+/** *********************************************************************
+ ** This method returns the entry of a window, or NULL.
+ **/
+void *windowMapGet(WindowMap *map, unsigned long window) {
+    const int slot = findWindowMapSlot(map, window);
+    return slot < 0 ? 0 : map->slots[slot].value;
+}
+
+/** *********************************************************************
+ ** This method removes the entry of a window, shifting later
+ ** entries of its probe run back so lookups need no
+ ** tombstones.
+ **/
+void windowMapRemove(WindowMap *map, unsigned long window) {
+    int hole = findWindowMapSlot(map, window);
+    if (hole < 0) {
+        return;
+    }
+
+    const int mask = map->capacity - 1;
+    for (int i = (hole + 1) & mask; map->slots[i].used;
+            i = (i + 1) & mask) {
+        // Move back an entry whose home is not between hole and i.
+        const int home = getWindowMapHome(map, map->slots[i].key);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            map->slots[hole] = map->slots[i];
+            hole = i;
+        }
+    }
+
+    map->slots[hole].used = false;
+    map->count--;
+}
+
+int windowMapSize(WindowMap *map) { return map->count; }
+
+/** *********************************************************************
+ ** These methods walk the entries of a map, in no order.
+ ** Each walk keeps its own position, the map must not change
+ ** during one.
+ **/
+void windowMapIterBegin(WindowMap *map, WindowMapIter *iter) {
+    iter->map = map;
+    iter->slot = 0;
+}
+
+int windowMapIterNext(WindowMapIter *iter, unsigned long *window,
+    void **value) {
+    const WindowMap* map = iter->map;
+
+    while (iter->slot < map->capacity) {
+        const WindowMapSlot* slot = &map->slots[iter->slot++];
+        if (slot->used) {
+            *window = slot->key;
+            *value = slot->value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 }
@@ -24,17 +24,35 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
-extern void table_insert(unsigned int key, void *value);
-extern void *table_get(unsigned int key);
-extern void table_clear(void (*destroy)(void *p));
+// Typed maps from X Window ids to entries, one instance
+// per index. threads: locking by caller
+typedef struct _WindowMap WindowMap;
+
+extern WindowMap* windowMapCreate();
+extern void windowMapDestroy(WindowMap* map);
+extern void windowMapClear(WindowMap* map);
+
+extern void windowMapInsert(WindowMap* map, unsigned long window,
+    void* value);
+extern void* windowMapGet(WindowMap* map, unsigned long window);
+extern void windowMapRemove(WindowMap* map, unsigned long window);
+extern int windowMapSize(WindowMap* map);
+
+// Sizes a map for a count of entries, after which insert
+// doesn't allocate until the count is passed.
+extern void windowMapReserve(WindowMap* map, int count);
+
+// Walk of a map, any number at once. The map must not change
+// during a walk.
+typedef struct _WindowMapIter {
+    WindowMap* map;
+    int slot;
+} WindowMapIter;
+
+extern void windowMapIterBegin(WindowMap* map, WindowMapIter* iter);
+extern int windowMapIterNext(WindowMapIter* iter, unsigned long* window,
+    void** value);
 
-extern void set_insert(void *key);
-extern void set_erase(void *key);
-extern int set_count(void *key);
-extern void set_clear(void);
-extern void set_begin(void);
-extern void *set_next(void);
-extern unsigned int set_size(void);
 #ifdef __cplusplus
 }
 #endif
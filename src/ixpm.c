@@ -289,6 +289,39 @@ void xpm_set_color(char **data, char ***out, int *lines, const char *color) {
     *lines = n + 3;
 }
 
+// expand a palette-indexed sprite into an RGBA pixbuf, as
+// gdk_pixbuf_new_from_xpm_data() would for the same image.
+GdkPixbuf *indexedSpriteToPixbuf(const IndexedSprite *sprite,
+    const GdkRGBA *palette) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8,
+        sprite->width, sprite->height);
+    if (!pixbuf) {
+        return NULL;
+    }
+
+    const int stride = gdk_pixbuf_get_rowstride(pixbuf);
+    guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+
+    const unsigned char *in = sprite->pixels;
+    for (int y = 0; y < sprite->height; y++) {
+        guchar *out = pixels + y * stride;
+        for (int x = 0; x < sprite->width; x++) {
+            const unsigned char index = *in++;
+            if (index == 0) {
+                out[0] = out[1] = out[2] = out[3] = 0;
+            } else {
+                const GdkRGBA *color = &palette[index - 1];
+                out[0] = (guchar) (color->red * 255 + 0.5);
+                out[1] = (guchar) (color->green * 255 + 0.5);
+                out[2] = (guchar) (color->blue * 255 + 0.5);
+                out[3] = 255;
+            }
+            out += 4;
+        }
+    }
+    return pixbuf;
+}
+
 void xpm_destroy(char **data) {
     int h, nc;
     sscanf(data[0], "%*d %d %d", &h, &nc);
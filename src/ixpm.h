@@ -25,6 +25,18 @@
 #include <gtk/gtk.h>
 
 
+// Palette-indexed sprite, one byte per pixel: 0 is
+// transparent, 1.. index palette[0..].
+typedef struct _IndexedSprite {
+        int width;
+        int height;
+        const unsigned char* pixels;
+} IndexedSprite;
+
+GdkPixbuf* indexedSpriteToPixbuf(const IndexedSprite* sprite,
+    const GdkRGBA* palette);
+
+
 Region regionfromxpm(const char** data, int flop,
         float scale);
 
@@ -29,9 +29,11 @@
 #include "clocks.h"
 #include "debug.h"
 #include "Flags.h"
+#include "FrameDamage.h"
 #include "MainWindow.h"
 #include "meteor.h"
 #include "plasmasnow.h"
+#include "Random.h"
 #include "snow.h"
 #include "Utils.h"
 #include "windows.h"
@@ -39,24 +41,30 @@
 
 /** *********************************************************************
  ** Module globals and consts.
+ **
+ ** Meteors live in a small fixed array, driven by one
+ ** scheduler task. Spawn times are sampled ahead into a
+ ** timeline, so intervals shorter than a meteor's life
+ ** give showers of meteors at once.
  **/
 
 #define NUMCOLORS 5
 
 static GdkRGBA colors[NUMCOLORS];
 
-static MeteorMap meteor;
+static MeteorMap mMeteors[METEOR_MAX_ACTIVE];
+
+static double mMeteorTimeline[METEOR_TIMELINE_LENGTH];
+static int mMeteorTimelineFirst = 0;
+static int mMeteorTimelineCount = 0;
 
 /** *********************************************************************
  ** This method initializes the Meteor moduile.
  **/
 void initMeteorModule() {
-    meteor.x1 = 0;
-    meteor.x2 = 0;
-    meteor.y1 = 0;
-    meteor.y2 = 0;
-    meteor.active = 0;
-    meteor.colornum = 0;
+    for (int i = 0; i < METEOR_MAX_ACTIVE; i++) {
+        mMeteors[i].active = 0;
+    }
 
     gdk_rgba_parse(&colors[0], "#f0e0e0");
     gdk_rgba_parse(&colors[1], "#e02020");
@@ -64,107 +72,212 @@ void initMeteorModule() {
     gdk_rgba_parse(&colors[3], "#f0d0a0");
     gdk_rgba_parse(&colors[4], "#f0d040");
 
-    addMethodToMainloop(PRIORITY_DEFAULT, time_emeteor, eraseMeteorFrame);
-    addMethodToMainloop(PRIORITY_DEFAULT, 0.1, updateMeteorFrame);
+    resetMeteorTimeline();
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT, METEOR_TICK,
+        updateMeteorFrame);
 }
 
 /** *********************************************************************
- ** This method erases a single Meteor
- ** frame from Utils.clearGlobalSnowWindow().
+ ** This method samples the time from one meteor to the next.
  **/
-int eraseMeteorFrame() {
-    if (Flags.shutdownRequested) {
-        return FALSE;
+double getMeteorInterval() {
+    if (Flags.MeteorFrequency < 0 || Flags.MeteorFrequency > 100) {
+        Flags.MeteorFrequency = DefaultFlags.MeteorFrequency;
     }
 
-    if (!meteor.active || !WorkspaceActive()) {
-        return TRUE;
+    return (0.5 + randomUniform()) * (Flags.MeteorFrequency *
+        (0.1 - time_meteor) / 100 + time_meteor);
+}
+
+/** *********************************************************************
+ ** These methods keep the timeline of future spawn times
+ ** filled, and restart it from now on a frequency change.
+ **/
+void fillMeteorTimeline(double now) {
+    while (mMeteorTimelineCount < METEOR_TIMELINE_LENGTH) {
+        const double last = mMeteorTimelineCount == 0 ? now :
+            mMeteorTimeline[(mMeteorTimelineFirst +
+            mMeteorTimelineCount - 1) % METEOR_TIMELINE_LENGTH];
+        mMeteorTimeline[(mMeteorTimelineFirst + mMeteorTimelineCount) %
+            METEOR_TIMELINE_LENGTH] = last + getMeteorInterval();
+        mMeteorTimelineCount++;
     }
+}
 
-    if (!mGlobal.isDoubleBuffered) {
-        int x = meteor.x1;
-        int y = meteor.y1;
-        int w = meteor.x2 - x;
-        int h = meteor.y2 - y;
-        if (w < 0) {
-            x += w;
-            w = -w;
-        }
-        if (h < 0) {
-            y += h;
-            h = -h;
-        }
-        x -= 1;
-        y -= 1;
-        w += 2;
-        h += 2;
+void resetMeteorTimeline() {
+    mMeteorTimelineFirst = 0;
+    mMeteorTimelineCount = 0;
+    fillMeteorTimeline(wallclock());
+}
 
+/** *********************************************************************
+ ** This method returns the box one meteor is drawn in.
+ **/
+void getMeteorBox(const MeteorMap* meteor,
+    int* x, int* y, int* w, int* h) {
+    *x = meteor->x1;
+    *y = meteor->y1;
+    *w = meteor->x2 - *x;
+    *h = meteor->y2 - *y;
+    if (*w < 0) {
+        *x += *w;
+        *w = -*w;
+    }
+    if (*h < 0) {
+        *y += *h;
+        *h = -*h;
+    }
+    *x -= 1;
+    *y -= 1;
+    *w += 2;
+    *h += 2;
+}
+
+/** *********************************************************************
+ ** This method clears the area of one meteor.
+ **/
+void eraseMeteor(MeteorMap* meteor) {
+    if (!mGlobal.isDoubleBuffered) {
+        int x, y, w, h;
+        getMeteorBox(meteor, &x, &y, &w, &h);
         clearDisplayArea(mGlobal.display,
             mGlobal.SnowWin, x, y, w, h, mGlobal.xxposures);
     }
 
-    meteor.active = 0;
+    meteor->active = 0;
+}
+
+/** *********************************************************************
+ ** This method erases all meteors, also from
+ ** Utils.clearGlobalSnowWindow().
+ **/
+int eraseMeteorFrame() {
+    if (Flags.shutdownRequested) {
+        return FALSE;
+    }
+
+    for (int i = 0; i < METEOR_MAX_ACTIVE; i++) {
+        if (mMeteors[i].active) {
+            eraseMeteor(&mMeteors[i]);
+        }
+    }
     return TRUE;
 }
 
+/** *********************************************************************
+ ** This method starts a meteor in a free slot, if any.
+ **/
+void spawnMeteor(double now) {
+    MeteorMap* meteor = NULL;
+    for (int i = 0; i < METEOR_MAX_ACTIVE; i++) {
+        if (!mMeteors[i].active) {
+            meteor = &mMeteors[i];
+            break;
+        }
+    }
+    if (!meteor) {
+        return;
+    }
+
+    meteor->x1 = randint(mGlobal.SnowWinWidth);
+    meteor->y1 = randint(mGlobal.SnowWinHeight / 4);
+    meteor->x2 = meteor->x1 + mGlobal.SnowWinWidth / 10 -
+                 randint(mGlobal.SnowWinWidth / 5);
+    if (meteor->x2 == meteor->x1) {
+        meteor->x2 += 5;
+    }
+    meteor->y2 = meteor->y1 + mGlobal.SnowWinHeight / 5 -
+                 randint(mGlobal.SnowWinHeight / 5);
+    if (meteor->y2 == meteor->y1) {
+        meteor->y2 += 5;
+    }
+    meteor->active = 1;
+    meteor->colornum = randomUniform() * NUMCOLORS;
+    meteor->expiresAt = now + time_emeteor;
+}
+
 /** *********************************************************************
  ** This method updates Meteor module between
- ** Erase and Draw cycles.
+ ** Erase and Draw cycles: ends meteors whose time is up,
+ ** and starts those the timeline has come to.
  **/
 int updateMeteorFrame() {
     if (Flags.shutdownRequested) {
         return FALSE;
     }
 
-    if (!(!WorkspaceActive() || meteor.active || Flags.NoMeteors)) {
-        meteor.x1 = randint(mGlobal.SnowWinWidth);
-        meteor.y1 = randint(mGlobal.SnowWinHeight / 4);
-        meteor.x2 = meteor.x1 + mGlobal.SnowWinWidth / 10 -
-                    randint(mGlobal.SnowWinWidth / 5);
-        if (meteor.x2 == meteor.x1) {
-            meteor.x2 += 5;
-        }
-        meteor.y2 = meteor.y1 + mGlobal.SnowWinHeight / 5 -
-                    randint(mGlobal.SnowWinHeight / 5);
-        if (meteor.y2 == meteor.y1) {
-            meteor.y2 += 5;
+    const double now = wallclock();
+    const bool isShowing = WorkspaceActive() && !Flags.NoMeteors;
+
+    for (int i = 0; i < METEOR_MAX_ACTIVE; i++) {
+        MeteorMap* meteor = &mMeteors[i];
+        if (meteor->active &&
+            (now >= meteor->expiresAt || !isShowing)) {
+            eraseMeteor(meteor);
         }
-        meteor.active = 1;
-        meteor.colornum = drand48() * NUMCOLORS;
     }
 
-    if (Flags.MeteorFrequency < 0 || Flags.MeteorFrequency > 100) {
-        Flags.MeteorFrequency = DefaultFlags.MeteorFrequency;
+    // Spawn times passed while hidden, or stalled past a
+    // tick, are dropped rather than shown all at once.
+    while (mMeteorTimelineCount > 0 &&
+        mMeteorTimeline[mMeteorTimelineFirst] <= now) {
+        if (isShowing &&
+            mMeteorTimeline[mMeteorTimelineFirst] >= now - METEOR_TICK) {
+            spawnMeteor(now);
+        }
+        mMeteorTimelineFirst =
+            (mMeteorTimelineFirst + 1) % METEOR_TIMELINE_LENGTH;
+        mMeteorTimelineCount--;
     }
+    fillMeteorTimeline(now);
 
-    float t = (0.5 + drand48()) * (Flags.MeteorFrequency *
-        (0.1 - time_meteor) / 100 + time_meteor);
-    addMethodToMainloop(PRIORITY_DEFAULT, t, updateMeteorFrame);
-
-    return FALSE;
+    return TRUE;
 }
 
 /** *********************************************************************
- ** This method draws a single Meteor frame.
+ ** This method draws a single Meteor frame, one stroked
+ ** path per color in use.
  **/
 void drawMeteorFrame(cairo_t *cr) {
-    if (!meteor.active) {
+    bool isColorUsed[NUMCOLORS] = { false };
+    bool isAnyActive = false;
+    for (int i = 0; i < METEOR_MAX_ACTIVE; i++) {
+        if (mMeteors[i].active) {
+            isColorUsed[mMeteors[i].colornum] = true;
+            isAnyActive = true;
+        }
+    }
+    if (!isAnyActive) {
         return;
     }
 
     cairo_save(cr);
 
-    const int c = meteor.colornum;
-    cairo_set_source_rgba(cr, colors[c].red,
-        colors[c].green, colors[c].blue, ALPHA);
-
     cairo_set_line_width(cr, 2);
     cairo_set_antialias(cr, CAIRO_ANTIALIAS_DEFAULT);
     cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
 
-    cairo_move_to(cr, meteor.x1, meteor.y1);
-    cairo_line_to(cr, meteor.x2, meteor.y2);
-    cairo_stroke(cr);
+    for (int c = 0; c < NUMCOLORS; c++) {
+        if (!isColorUsed[c]) {
+            continue;
+        }
+
+        for (int i = 0; i < METEOR_MAX_ACTIVE; i++) {
+            const MeteorMap* meteor = &mMeteors[i];
+            if (meteor->active && meteor->colornum == c) {
+                cairo_move_to(cr, meteor->x1, meteor->y1);
+                cairo_line_to(cr, meteor->x2, meteor->y2);
+
+                int x, y, w, h;
+                getMeteorBox(meteor, &x, &y, &w, &h);
+                addDrawnDamage(x, y, w, h);
+            }
+        }
+
+        cairo_set_source_rgba(cr, colors[c].red,
+            colors[c].green, colors[c].blue, ALPHA);
+        cairo_stroke(cr);
+    }
 
     cairo_restore(cr);
 }
@@ -175,5 +288,5 @@ void drawMeteorFrame(cairo_t *cr) {
  **/
 void updateMeteorUserSettings() {
     UIDO(NoMeteors, );
-    UIDO(MeteorFrequency, );
+    UIDO(MeteorFrequency, resetMeteorTimeline(););
 }
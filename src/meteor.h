@@ -23,6 +23,19 @@
 
 #include <gtk/gtk.h>
 
+#include "plasmasnow.h"
+
+
+/***********************************************************
+ * Module consts.
+ */
+// Meteors shown at once, and spawn times sampled ahead.
+#define METEOR_MAX_ACTIVE 8
+#define METEOR_TIMELINE_LENGTH 16
+
+// Period of the one meteor task, seconds.
+#define METEOR_TICK 0.05
+
 
 /***********************************************************
  * Module Method stubs.
@@ -30,6 +43,15 @@
 
 void initMeteorModule();
 
+double getMeteorInterval();
+void fillMeteorTimeline(double now);
+void resetMeteorTimeline();
+
+void getMeteorBox(const MeteorMap* meteor,
+    int* x, int* y, int* w, int* h);
+void eraseMeteor(MeteorMap* meteor);
+void spawnMeteor(double now);
+
 int eraseMeteorFrame();
 int updateMeteorFrame();
 void drawMeteorFrame(cairo_t*);
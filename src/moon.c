@@ -24,6 +24,7 @@
 #include "debug.h"
 #include "Flags.h"
 #include "pixmaps.h"
+#include "StartupTasks.h"
 #include "Utils.h"
 #include "windows.h"
 #include <gtk/gtk.h>
@@ -35,27 +36,75 @@
     if (!Flags.Moon || !WorkspaceActive()) \
     return TRUE
 
+// Moon and halo built on the startup pool.
+typedef struct _MoonJob {
+        int whichMoon;
+        double moonR;
+        double haloBright;
+
+        int moonSerial;
+        int haloSerial;
+
+        cairo_surface_t *moon;
+        cairo_surface_t *halo;
+} MoonJob;
+
 static int do_umoon();
+static int get_which_moon();
+static double get_moon_radius();
+static cairo_surface_t *create_moon_surface(int whichmoon, double moonR);
+static cairo_surface_t *create_halo_surface(double moonR, double bright);
+static void *build_moon_job(void *arg);
+static void install_moon_job(void *result, void *arg);
 static void init_moon_surface();
 static void init_halo_surface();
-static void halo_draw(cairo_t *cr);
+static double get_composite_radius();
+static void init_moon_composite();
 static void halo_erase();
 
 static cairo_surface_t *moon_surface = NULL;
 static cairo_surface_t *halo_surface = NULL;
 static double haloR; // radius of halo in pixels
 
+// Bumped on every rebuild in place, so a startup job
+// finishing late never overwrites a newer surface.
+static int mMoonSerial = 0;
+static int mHaloSerial = 0;
+static MoonJob mMoonJob;
+
+// Moon and halo painted once into one surface, so a redraw
+// of the sky is one blit. Rebuilt when either changes.
+static cairo_surface_t *mMoonComposite = NULL;
+static bool mMoonCompositeHasHalo = false;
+static bool mMoonCompositeIsValid = false;
+
+// Where the moon was last drawn.
 static double OldmoonX;
 static double OldmoonY;
+static bool OldmoonHalo = false;
 
 static float moonScale;
 
+// Bumped when the moon would draw differently, on whole
+// pixel moves only, for the backdrop cache.
+static int mMoonVersion = 0;
+
 void moon_init(void) {
     moonScale = (float)Flags.Scale * 0.01 * mGlobal.WindowScale;
 
-    init_moon_surface();
+    // Surfaces come from the startup pool, the moon shows
+    // once they are in.
+    mGlobal.moonR = get_moon_radius();
+    haloR = 1.8 * mGlobal.moonR;
+
+    mMoonJob.whichMoon = get_which_moon();
+    mMoonJob.moonR = mGlobal.moonR;
+    mMoonJob.haloBright = Flags.HaloBright * ALPHA * 0.01;
+    mMoonJob.moonSerial = mMoonSerial;
+    mMoonJob.haloSerial = mHaloSerial;
+    addStartupTask(build_moon_job, install_moon_job, &mMoonJob);
 
-    addMethodToMainloop(PRIORITY_DEFAULT, time_umoon, do_umoon);
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT, time_umoon, do_umoon);
 
     mGlobal.moonX = (mGlobal.SnowWinWidth - 2 * mGlobal.moonR) * drand48();
     mGlobal.moonY = mGlobal.moonR + drand48() * mGlobal.moonR;
@@ -63,18 +112,34 @@ void moon_init(void) {
 
 int moon_draw(cairo_t *cr) {
     LEAVE_IF_INACTIVE;
+    if (!moon_surface) {
+        return TRUE;
+    }
 
-    cairo_set_source_surface(cr, moon_surface, mGlobal.moonX, mGlobal.moonY);
-    my_cairo_paint_with_alpha(cr, ALPHA);
+    const bool withHalo = Flags.Halo && halo_surface;
+    if (!mMoonCompositeIsValid || mMoonCompositeHasHalo != withHalo) {
+        init_moon_composite();
+    }
+
+    // Fractional positions are kept, cairo filters the
+    // composite between pixels.
+    const double r = get_composite_radius();
+    cairo_set_source_surface(cr, mMoonComposite,
+        mGlobal.moonX + mGlobal.moonR - r,
+        mGlobal.moonY + mGlobal.moonR - r);
+    cairo_paint(cr);
 
     OldmoonX = mGlobal.moonX;
     OldmoonY = mGlobal.moonY;
-
-    halo_draw(cr);
+    OldmoonHalo = withHalo;
 
     return TRUE;
 }
 
+int getMoonVersion(void) {
+    return mMoonVersion;
+}
+
 int moon_erase(int force) {
     if (mGlobal.isDoubleBuffered) {
         return 0;
@@ -83,14 +148,27 @@ int moon_erase(int force) {
         LEAVE_IF_INACTIVE;
     }
 
-    if (Flags.Halo) {
-        halo_erase();
-    } else {
-        clearDisplayArea(mGlobal.display, mGlobal.SnowWin,
-            OldmoonX, OldmoonY, 2 * mGlobal.moonR + 1,
-            2 * mGlobal.moonR + 1, mGlobal.xxposures);
+    // The sky repaints only what is cleared, so a moon that
+    // hasn't moved a pixel since it was drawn needs nothing.
+    // A moved one clears its old and new place as one box,
+    // they overlap but for a pixel.
+    const long oldX = lrint(OldmoonX);
+    const long oldY = lrint(OldmoonY);
+    const long newX = lrint(mGlobal.moonX);
+    const long newY = lrint(mGlobal.moonY);
+    if (!force && oldX == newX && oldY == newY &&
+        OldmoonHalo == (Flags.Halo && halo_surface)) {
+        return 0;
     }
 
+    const double r = OldmoonHalo || Flags.Halo ? haloR : mGlobal.moonR;
+    const int x = MIN(oldX, newX) + mGlobal.moonR - r;
+    const int y = MIN(oldY, newY) + mGlobal.moonR - r;
+    const int w = 2 * r + labs(newX - oldX) + 2;
+    const int h = 2 * r + labs(newY - oldY) + 2;
+    clearDisplayArea(mGlobal.display, mGlobal.SnowWin,
+        x, y, w, h, mGlobal.xxposures);
+
     return 0;
 }
 
@@ -117,12 +195,11 @@ void moon_ui() {
 
         prevw = mGlobal.SnowWinWidth;
         prevh = mGlobal.SnowWinHeight;
+        mMoonVersion++;
     }
 }
 
-static void init_moon_surface() {
-    const GdkInterpType interpolation = GDK_INTERP_HYPER;
-
+static int get_which_moon() {
     if (Flags.MoonColor < 0) {
         Flags.MoonColor = 0;
     }
@@ -130,22 +207,24 @@ static void init_moon_surface() {
         Flags.MoonColor = 1;
     }
 
-    const int whichmoon = (Flags.MoonColor == 0) ? 1 : 0;
-
-    static GdkPixbuf *pixbuf, *pixbufscaled;
-    pixbuf = gdk_pixbuf_new_from_xpm_data(
-        (const char**) moons_xpm[whichmoon]);
+    return (Flags.MoonColor == 0) ? 1 : 0;
+}
 
-    // standard moon is some percentage of window width
+// standard moon is some percentage of window width
+static double get_moon_radius() {
     const float p = 30.0;
-    mGlobal.moonR = p * Flags.MoonSize * 0.01 * moonScale;
+    return p * Flags.MoonSize * 0.01 * moonScale;
+}
 
-    if (moon_surface) {
-        cairo_surface_destroy(moon_surface);
-    }
+// decode and scale a moon, touches no shared state
+static cairo_surface_t *create_moon_surface(int whichmoon, double moonR) {
+    const GdkInterpType interpolation = GDK_INTERP_HYPER;
+
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_xpm_data(
+        (const char**) moons_xpm[whichmoon]);
 
     // Get scaling.
-    int w = mGlobal.moonR * 2;
+    int w = moonR * 2;
     int h = w;
     if (w < 1) {
         w = 1;
@@ -155,13 +234,58 @@ static void init_moon_surface() {
         h = 2;
     }
 
-    pixbufscaled = gdk_pixbuf_scale_simple(pixbuf, w, h, interpolation);
-    moon_surface = gdk_cairo_surface_create_from_pixbuf(pixbufscaled, 0, NULL);
+    GdkPixbuf *pixbufscaled =
+        gdk_pixbuf_scale_simple(pixbuf, w, h, interpolation);
+    cairo_surface_t *surface =
+        gdk_cairo_surface_create_from_pixbuf(pixbufscaled, 0, NULL);
 
     g_clear_object(&pixbuf);
     g_clear_object(&pixbufscaled);
+    return surface;
+}
+
+static void *build_moon_job(void *arg) {
+    MoonJob *job = (MoonJob *) arg;
+    job->moon = create_moon_surface(job->whichMoon, job->moonR);
+    job->halo = create_halo_surface(job->moonR, job->haloBright);
+    return job;
+}
+
+static void install_moon_job(void *result, void *arg) {
+    (void) arg;
+    MoonJob *job = (MoonJob *) result;
+
+    if (job->moonSerial == mMoonSerial) {
+        moon_surface = job->moon;
+    } else {
+        cairo_surface_destroy(job->moon);
+    }
+    if (job->haloSerial == mHaloSerial) {
+        halo_surface = job->halo;
+    } else {
+        cairo_surface_destroy(job->halo);
+    }
+    mMoonCompositeIsValid = false;
+    mMoonVersion++;
+
+    if (!mGlobal.isDoubleBuffered) {
+        clearGlobalSnowWindow();
+    }
+}
+
+static void init_moon_surface() {
+    const int whichmoon = get_which_moon();
+    mGlobal.moonR = get_moon_radius();
+
+    if (moon_surface) {
+        cairo_surface_destroy(moon_surface);
+    }
+    moon_surface = create_moon_surface(whichmoon, mGlobal.moonR);
+    mMoonSerial++;
+    mMoonCompositeIsValid = false;
 
     init_halo_surface();
+    mMoonVersion++;
 
     if (!mGlobal.isDoubleBuffered) {
         clearGlobalSnowWindow();
@@ -199,50 +323,87 @@ int do_umoon() {
         ydirection = 1;
     }
 
+    static long prevMoonX, prevMoonY;
+    if (lrint(mGlobal.moonX) != prevMoonX ||
+        lrint(mGlobal.moonY) != prevMoonY) {
+        prevMoonX = lrint(mGlobal.moonX);
+        prevMoonY = lrint(mGlobal.moonY);
+        mMoonVersion++;
+    }
+
     return TRUE;
 }
 
-void init_halo_surface() {
-    if (halo_surface) {
-        cairo_surface_destroy(halo_surface);
-    }
+// draw the halo ring, touches no shared state
+static cairo_surface_t *create_halo_surface(double moonR, double bright) {
+    const double r = 1.8 * moonR;
 
-    cairo_pattern_t *pattern;
-    haloR = 1.8 * mGlobal.moonR;
-
-    pattern = cairo_pattern_create_radial(
-        haloR, haloR, mGlobal.moonR, haloR, haloR, haloR);
-    double bright = Flags.HaloBright * ALPHA * 0.01;
+    cairo_pattern_t *pattern = cairo_pattern_create_radial(
+        r, r, moonR, r, r, r);
 
     cairo_pattern_add_color_stop_rgba(
         pattern, 0.0, 234.0 / 255, 244.0 / 255, 252.0 / 255, bright);
     cairo_pattern_add_color_stop_rgba(
         pattern, 1.0, 234.0 / 255, 244.0 / 255, 252.0 / 255, 0.0);
 
-    halo_surface =
-        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 2 * haloR, 2 * haloR);
-    cairo_t *halocr = cairo_create(halo_surface);
+    cairo_surface_t *surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 2 * r, 2 * r);
+    cairo_t *halocr = cairo_create(surface);
 
     cairo_set_source_rgba(halocr, 0, 0, 0, 0);
     cairo_paint(halocr);
     cairo_set_source(halocr, pattern);
-    cairo_arc(halocr, haloR, haloR, haloR, 0, M_PI * 2);
+    cairo_arc(halocr, r, r, r, 0, M_PI * 2);
     cairo_fill(halocr);
 
     cairo_destroy(halocr);
     cairo_pattern_destroy(pattern);
+    return surface;
 }
 
-void halo_draw(cairo_t *cr) {
-    if (!Flags.Halo) {
-        return;
+void init_halo_surface() {
+    if (halo_surface) {
+        cairo_surface_destroy(halo_surface);
     }
 
-    double xc = mGlobal.moonX + mGlobal.moonR;
-    double yc = mGlobal.moonY + mGlobal.moonR;
+    haloR = 1.8 * mGlobal.moonR;
+    halo_surface = create_halo_surface(mGlobal.moonR,
+        Flags.HaloBright * ALPHA * 0.01);
+    mHaloSerial++;
+    mMoonCompositeIsValid = false;
+    mMoonVersion++;
+}
+
+// half the side of the composite, the halo or the moon
+static double get_composite_radius() {
+    return mMoonCompositeHasHalo ? haloR : mGlobal.moonR;
+}
 
-    cairo_set_source_surface(cr, halo_surface, xc - haloR, yc - haloR);
+// paint moon, then halo over it, into the composite
+void init_moon_composite() {
+    if (mMoonComposite) {
+        cairo_surface_destroy(mMoonComposite);
+    }
+    mMoonCompositeHasHalo = Flags.Halo && halo_surface;
+
+    const double r = get_composite_radius();
+    const int side = 2 * r + 1;
+    mMoonComposite = cairo_image_surface_create(
+        CAIRO_FORMAT_ARGB32, side, side);
+
+    // OVER is associative, so one paint of this equals the
+    // moon and halo painted one after the other.
+    cairo_t *cr = cairo_create(mMoonComposite);
+    cairo_set_source_surface(cr, moon_surface,
+        r - mGlobal.moonR, r - mGlobal.moonR);
     my_cairo_paint_with_alpha(cr, ALPHA);
+    if (mMoonCompositeHasHalo) {
+        cairo_set_source_surface(cr, halo_surface, r - haloR, r - haloR);
+        my_cairo_paint_with_alpha(cr, ALPHA);
+    }
+    cairo_destroy(cr);
+
+    mMoonCompositeIsValid = true;
 }
 
 void halo_erase() {
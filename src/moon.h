@@ -27,3 +27,4 @@ extern int moon_draw(cairo_t *cr);
 extern void moon_init(void);
 extern void moon_ui(void);
 extern int moon_erase(int force);
+extern int getMoonVersion(void);
@@ -181,4 +181,8 @@ XPM_TYPE **moons_xpm[] = {moon1_xpm, moon2_xpm};
 #define SNOW(x) snow##x##_xpm,
 XPM_TYPE **snow_xpm[] = {SNOW_ALL NULL};
 
+// Vintage flakes, decoded at build time.
+#define SNOW_PIXELS(x, w, h) {w, h, snow##x##_pixels},
+const IndexedSprite snow_sprites[] = {SNOW_PIXELS_ALL};
+
 #include "undefall.inc"
@@ -21,6 +21,7 @@
 */
 #pragma once
 
+#include "ixpm.h"
 #include "plasmasnow.h"
 
 extern StarMap starPix;
@@ -31,4 +32,5 @@ extern XPM_TYPE **xpmtrees[];
 extern XPM_TYPE **plasmasnow_logo;
 extern XPM_TYPE **birds_xpm[];
 extern XPM_TYPE **snow_xpm[];
+extern const IndexedSprite snow_sprites[];
 extern XPM_TYPE **moons_xpm[];
@@ -21,7 +21,9 @@
 */
 #pragma once
 
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 // XDO Lib.
 #include "xdo.h"
@@ -38,6 +40,8 @@
 #include "config.h"
 #endif
 
+#include "spline_interpol.h"
+
 
 /***********************************************************
  * App consts.
@@ -69,9 +73,8 @@
 #define time_change_attr 60.0       // time between changing attraction point
 #define time_clean 1.00             // time between cleaning desktop
 #define time_desktop_type 2.0       // time between showing desktop type
-#define time_display_dimensions 0.5 // Time between check of screen dimensions.
 #define time_displaychanged 1.00    // time between checks if display has changed
-#define time_emeteor 0.40           // time between meteors erasures
+#define time_emeteor 0.40           // time a meteor is shown
 
 // Time between handling window configure events.
 #define CONFIGURE_WINDOW_EVENT_TIME 0.1
@@ -83,7 +86,11 @@
 #define time_init_snow  0.2
 #define time_initbaum 0.30          // time between check for (re)create trees
 #define time_main_window 0.5        // time between checks for birds window
+#define TIME_BEFORE_MAIN_WINDOW 0.2 // time from start to building the menu
+#define TIME_BEFORE_HIDDEN_MAIN_WINDOW 5.0 // same, for -hidemenu
 #define TIME_BETWEEN_LOAD_MONITOR_EVENTS  0.1  // time between cpu load measurements
+#define TIME_BETWEEN_PROFILER_REPORTS 2.0 // time between frame profile reports
+#define TIME_BETWEEN_QUALITY_UPDATES 1.0  // time between quality governor checks
 #define time_meteor 3.00            // time between meteors
 #define time_newwind 1.00           // time between changing wind
 #define time_sendevent 0.5          // time between sendEvent() calls
@@ -109,8 +116,9 @@
 // time between updates of snowflakes positions etc
 #define time_snowflakes    (0.02 * mGlobal.cpufactor)
 
-// time between updates of screen
-#define time_draw_all      (0.04 * mGlobal.cpufactor)
+// time between updates of screen, per frame clock if -frameclock
+#define time_draw_all      (mGlobal.frameClockInterval > 0 ? \
+    mGlobal.frameClockInterval : 0.04 * mGlobal.cpufactor)
 
 
 /***********************************************************
@@ -129,30 +137,7 @@
 #define WHIRL            150
 #define MAXVISWORKSPACES 100 // should be enough...
 
-typedef struct _Snow {
-        float rx; // x position
-        float ry; // y position
-
-        GdkRGBA color;
-
-        int ix;
-        int iy;                       // position after draw
-
-        float vx;                     // speed in x-direction, pixels/second
-        float vy;                     // speed in y-direction, pixels/second
-
-        float m;                      // mass of flake
-        float ivy;                    // initial speed in y direction
-        float wsens;                  // wind dependency factor
-        float flufftimer;             // fluff timeout timer
-        float flufftime;              // fluff timeout
-
-        unsigned int whatFlake;       // snowflake index
-        unsigned int cyclic BITS(1);  // flake is cyclic
-        unsigned int fluff BITS(1);   // flake is in fluff state
-        unsigned int freeze BITS(1);  // flake does not move
-        unsigned int testing BITS(2); // for testing purposes
-} SnowFlake;
+// Flake storage lives in FlakePool.h.
 
 typedef struct _SnowMap {
         // Pixmap pixmap;
@@ -160,6 +145,15 @@ typedef struct _SnowMap {
 
         unsigned int width;
         unsigned int height;
+
+        // Placement in the shared flake atlas.
+        int atlasX;
+        int atlasWidth, atlasHeight;
+
+        // Small enough to draw as a filled rect, in the
+        // flake color of colorIndex.
+        bool isLod;
+        int colorIndex;
 } SnowMap;
 
 
@@ -217,6 +211,7 @@ typedef struct _MeteorMap {
 
         int active;
         int colornum;
+        double expiresAt;   // wallcl() time it is erased.
 } MeteorMap;
 
 typedef struct _StarMap {
@@ -241,6 +236,7 @@ typedef struct _StarCoordinate {
  */
 typedef struct _WinInfo {
         Window window;
+        Window frame;      // child of root holding window
         long ws;           // workspace
 
         int x, y;          // x,y coordinates
@@ -249,6 +245,7 @@ typedef struct _WinInfo {
 
         unsigned int sticky BITS(1); // is visible on all workspaces
         unsigned int dock BITS(1);   // is a "dock" (panel)
+        unsigned int desktop BITS(1); // is the desktop background
         unsigned int hidden BITS(1); // is hidden / iconized
 } WinInfo;
 
@@ -270,8 +267,24 @@ typedef struct _FallenSnow {
         int prevw, prevh;         // w, h of last draw.
 
         GdkRGBA* columnColor;     // Color array.
-        short int* snowHeight;    // actual heights.
+        short int* snowHeight;    // actual heights, [-1] .. [w] valid.
         short int* maxSnowHeight; // desired heights.
+        short int* nextMaxSnowHeight; // next desh, see do_change_deshes().
+        short int* heightScratch; // w + 2 scratch heights.
+
+        uint32_t* overMaxBits;    // columns maybe above their max.
+        int overMaxCount;         // bits set in overMaxBits.
+
+        int dirtyStart, dirtyEnd; // x-span changed since render.
+
+        int erosionCursor;        // next column the wind erodes.
+        double erosionCarry;      // columns owed to the wind.
+        int swapPending;          // renderedSurfaceB is newer than A.
+
+        SplineWorkspace splineWorkspace; // render spline points.
+
+        pthread_mutex_t lock;     // heights & render, see
+                                  // lockFallenSnowItem().
 
 } FallenSnow;
 
@@ -306,10 +319,10 @@ extern struct _mGlobal {
         int XscreensaverMode;
         int ForceRestart;
         double cpufactor;
+        double frameClockInterval;
 
         // Cairo defs.
         cairo_region_t *TreeRegion;
-        cairo_region_t *gSnowOnTreesRegion;
 
         // Display defs.
         Display *display;
@@ -363,7 +376,7 @@ extern struct _mGlobal {
 
         // Santa defs.
         float ActualSantaSpeed;
-        Region SantaPlowRegion;
+        cairo_rectangle_int_t SantaPlowRect; // empty: no plow
         int SantaHeight;
         int SantaWidth;
         int SantaX;
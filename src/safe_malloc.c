@@ -24,8 +24,11 @@
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_spline.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // #define USEMUTEX
 
@@ -78,3 +81,206 @@ int safe_XFree(void *data) {
     return XFree(data);
     MUTEXUNLOCK;
 }
+
+// Tracked blocks start with their owner and size, padded so
+// the caller's part keeps malloc's alignment.
+typedef union {
+    struct {
+        size_t size;
+        int owner;
+    } info;
+    max_align_t align;
+} TrackedHeader;
+
+static atomic_long memoryBytes[MEMORY_OWNER_COUNT];
+static atomic_long memoryBlocks[MEMORY_OWNER_COUNT];
+static atomic_long memoryPeakBytes[MEMORY_OWNER_COUNT];
+
+static const char *memoryOwnerNames[MEMORY_OWNER_COUNT] = {
+    "flakes", "fallensnow", "sprites", "aurora", "birds", "scratch"};
+
+void track_memory(MEMORY_OWNER owner, long bytes, long blocks) {
+    const long now = atomic_fetch_add(&memoryBytes[owner], bytes) + bytes;
+    atomic_fetch_add(&memoryBlocks[owner], blocks);
+
+    long peak = atomic_load(&memoryPeakBytes[owner]);
+    while (now > peak &&
+        !atomic_compare_exchange_weak(&memoryPeakBytes[owner], &peak, now)) {
+    }
+}
+
+void get_memory_use(MEMORY_OWNER owner, long *bytes, long *blocks,
+    long *peakBytes) {
+    *bytes = atomic_load(&memoryBytes[owner]);
+    *blocks = atomic_load(&memoryBlocks[owner]);
+    *peakBytes = atomic_load(&memoryPeakBytes[owner]);
+}
+
+const char *get_memory_owner_name(MEMORY_OWNER owner) {
+    return memoryOwnerNames[owner];
+}
+
+void *tracked_malloc(MEMORY_OWNER owner, size_t size) {
+    TrackedHeader *header =
+        (TrackedHeader *)malloc(sizeof(TrackedHeader) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->info.size = size;
+    header->info.owner = owner;
+    track_memory(owner, size, 1);
+    return header + 1;
+}
+
+void *tracked_calloc(MEMORY_OWNER owner, size_t count, size_t size) {
+    if (size && count > ((size_t)-1 - sizeof(TrackedHeader)) / size) {
+        return NULL;
+    }
+    void *p = tracked_malloc(owner, count * size);
+    if (p != NULL) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void *tracked_realloc(MEMORY_OWNER owner, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return tracked_malloc(owner, size);
+    }
+
+    TrackedHeader *old = (TrackedHeader *)ptr - 1;
+    const size_t oldSize = old->info.size;
+    const MEMORY_OWNER oldOwner = (MEMORY_OWNER)old->info.owner;
+
+    TrackedHeader *header =
+        (TrackedHeader *)realloc(old, sizeof(TrackedHeader) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    track_memory(oldOwner, -(long)oldSize, -1);
+    header->info.size = size;
+    header->info.owner = owner;
+    track_memory(owner, size, 1);
+    return header + 1;
+}
+
+void tracked_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    TrackedHeader *header = (TrackedHeader *)ptr - 1;
+    track_memory((MEMORY_OWNER)header->info.owner,
+        -(long)header->info.size, -1);
+    free(header);
+}
+
+// A thread's scratch arena. Requests that don't fit the block
+// get their own malloc, freed on release, and count toward
+// the size the block grows to.
+typedef union _ScratchOverflow {
+    union _ScratchOverflow *prev;
+    max_align_t align;
+} ScratchOverflow;
+
+typedef struct {
+    char *base;
+    size_t size;
+    size_t used;
+    size_t demand;
+    size_t highWater;
+
+    ScratchOverflow *overflow;
+    int overflowCount;
+} ScratchArena;
+
+#define SCRATCH_MIN_SIZE 4096
+
+static _Thread_local ScratchArena mScratch;
+
+ScratchMark scratch_mark(void) {
+    ScratchMark mark = {mScratch.used, mScratch.demand,
+        mScratch.overflowCount};
+    return mark;
+}
+
+void *scratch_alloc(size_t size) {
+    const size_t align = sizeof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    mScratch.demand += size;
+    if (mScratch.demand > mScratch.highWater) {
+        mScratch.highWater = mScratch.demand;
+    }
+
+    if (size <= mScratch.size - mScratch.used) {
+        void *p = mScratch.base + mScratch.used;
+        mScratch.used += size;
+        return p;
+    }
+
+    ScratchOverflow *overflow =
+        (ScratchOverflow *)tracked_malloc(MEMORY_SCRATCH,
+            sizeof(ScratchOverflow) + size);
+    if (overflow == NULL) {
+        mScratch.demand -= size;
+        return NULL;
+    }
+    overflow->prev = mScratch.overflow;
+    mScratch.overflow = overflow;
+    mScratch.overflowCount++;
+    return overflow + 1;
+}
+
+void scratch_release(ScratchMark mark) {
+    while (mScratch.overflowCount > mark.overflowCount) {
+        ScratchOverflow *overflow = mScratch.overflow;
+        mScratch.overflow = overflow->prev;
+        mScratch.overflowCount--;
+        tracked_free(overflow);
+    }
+    mScratch.used = mark.used;
+    mScratch.demand = mark.demand;
+
+    // Idle, so the block may move: grow it to fit the peak.
+    if (mScratch.used == 0 && mScratch.highWater > mScratch.size) {
+        size_t size = SCRATCH_MIN_SIZE;
+        while (size < mScratch.highWater) {
+            size *= 2;
+        }
+        char *base = (char *)tracked_malloc(MEMORY_SCRATCH, size);
+        if (base != NULL) {
+            tracked_free(mScratch.base);
+            mScratch.base = base;
+            mScratch.size = size;
+        }
+    }
+}
+
+void *object_pool_take(ObjectPool *pool) {
+    if (pool->freeList == NULL) {
+        const size_t align = sizeof(void *);
+        size_t objectSize = pool->objectSize < sizeof(void *) ?
+            sizeof(void *) : pool->objectSize;
+        objectSize = (objectSize + align - 1) & ~(align - 1);
+        pool->objectSize = objectSize;
+
+        char *chunk = (char *)tracked_calloc(pool->owner,
+            pool->chunkCount, objectSize);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        for (int i = pool->chunkCount - 1; i >= 0; i--) {
+            object_pool_give(pool, chunk + i * objectSize);
+        }
+    }
+
+    void **object = (void **)pool->freeList;
+    pool->freeList = *object;
+    *object = NULL;
+    return object;
+}
+
+void object_pool_give(ObjectPool *pool, void *object) {
+    *(void **)object = pool->freeList;
+    pool->freeList = object;
+}
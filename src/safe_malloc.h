@@ -23,6 +23,19 @@
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_spline.h>
 #include <stdio.h>
+
+// Owners of tracked memory, for the memory report.
+typedef enum {
+    MEMORY_FLAKES = 0,
+    MEMORY_FALLENSNOW,
+    MEMORY_SPRITES,
+    MEMORY_AURORA,
+    MEMORY_BIRDS,
+    MEMORY_SCRATCH,
+
+    MEMORY_OWNER_COUNT
+} MEMORY_OWNER;
+
 extern void *safe_malloc(size_t size);
 extern void *safe_realloc(void *ptr, size_t size);
 extern void safe_free(void *ptr);
@@ -30,6 +43,48 @@ extern void safe_gsl_spline_free(gsl_spline *spline);
 extern void safe_gsl_interp_accel_free(gsl_interp_accel *acc);
 extern int safe_XFree(void *data);
 
+// Like malloc & co, but counted against an owner. Blocks from
+// these must go back through tracked_realloc or tracked_free.
+extern void *tracked_malloc(MEMORY_OWNER owner, size_t size);
+extern void *tracked_calloc(MEMORY_OWNER owner, size_t count, size_t size);
+extern void *tracked_realloc(MEMORY_OWNER owner, void *ptr, size_t size);
+extern void tracked_free(void *ptr);
+
+extern void track_memory(MEMORY_OWNER owner, long bytes, long blocks);
+extern void get_memory_use(MEMORY_OWNER owner, long *bytes, long *blocks,
+    long *peakBytes);
+extern const char *get_memory_owner_name(MEMORY_OWNER owner);
+
+// Per thread bump arena for scratch that dies before the
+// function that took it returns. Take a mark, allocate, then
+// release back to the mark; marks nest. Once idle, the arena
+// grows to the most ever used, so steady state never mallocs.
+typedef struct _ScratchMark {
+    size_t used;
+    size_t demand;
+    int overflowCount;
+} ScratchMark;
+
+extern ScratchMark scratch_mark(void);
+extern void *scratch_alloc(size_t size);
+extern void scratch_release(ScratchMark mark);
+
+// Fixed size objects carved from chunks that never move or
+// shrink, recycled through a free list. Objects aren't cleared
+// on reuse, only their first pointer is. Locking by caller.
+typedef struct _ObjectPool {
+    size_t objectSize;
+    int chunkCount;
+    MEMORY_OWNER owner;
+    void *freeList;
+} ObjectPool;
+
+#define OBJECT_POOL_INIT(type, chunkCount, owner) \
+    { sizeof(type), (chunkCount), (owner), NULL }
+
+extern void *object_pool_take(ObjectPool *pool);
+extern void object_pool_give(ObjectPool *pool, void *object);
+
 #define REALLOC_CHECK(x)                                                       \
     if (x == NULL) {                                                           \
         fprintf(stderr, "Realloc error in %s:%d\n", __FILE__, __LINE__);       \
@@ -19,6 +19,7 @@
 #-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #-# 
 */
+#include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,9 +36,12 @@
 #include "FallenSnow.h"
 #include "Flags.h"
 #include "ixpm.h"
+#include "MemoryStats.h"
 #include "pixmaps.h"
 #include "safe_malloc.h"
 #include "scenery.h"
+#include "SpriteCache.h"
+#include "StartupTasks.h"
 #include "treesnow.h"
 #include "Utils.h"
 #include "windows.h"
@@ -73,10 +77,15 @@ static int TreeHeight[NUM_ALL_SCENE_TYPES];
 static int ExternalTree = False;
 static bool mSceneryNeedsInit = true;
 
+// Bumped whenever the trees would draw differently,
+// for the backdrop cache.
+static int mSceneryVersion = 0;
+
 static char **TreeXpm = NULL;
 
-static Pixmap mColorableTreePixmap[NUM_ALL_SCENE_TYPES] [2];
-static Pixmap TreeMaskPixmap[NUM_ALL_SCENE_TYPES] [2];
+// Trees face one way, drawSceneryFrame() mirrors the rest.
+static Pixmap mColorableTreePixmap[NUM_ALL_SCENE_TYPES];
+static Pixmap TreeMaskPixmap[NUM_ALL_SCENE_TYPES];
 
 static SceneryInfo** mSceneryInfoArray = NULL;
 
@@ -89,6 +98,25 @@ static float MinScale = 0.6;
 static int mRemoveFluffAttempts = 0;
 static int mCurrentAppScale = 100;
 
+// Scaled tree surfaces and regions, kept across scenery
+// rebuilds. Scales are quantized, so a resize or restart
+// mostly finds its trees here instead of rescaling xpms.
+typedef struct _SceneryCacheItem {
+        const char** xpm;
+        int flip;
+        int scaleKey;
+        cairo_surface_t* surface;
+        cairo_region_t* region;
+} SceneryCacheItem;
+
+static SceneryCacheItem mSceneryCache[SCENERY_CACHE_MAX];
+static int mSceneryCacheCount = 0;
+
+// Trees decoded once on the startup pool, as xpmtrees[],
+// so every scale and flip of a tree skips xpm parsing.
+static GdkPixbuf* mSceneryPixbufs[NUM_ALL_SCENE_TYPES];
+static GdkPixbuf* mSceneryPixbufsJob[NUM_ALL_SCENE_TYPES];
+
 
 /***********************************************************
  * Main Scenery methods.
@@ -118,8 +146,10 @@ void initSceneryModule() {
 
     mGlobal.TreeRegion = cairo_region_create();
     initSceneryPixmaps();
+    addStartupTask(buildSceneryPixbufs, installSceneryPixbufs,
+        mSceneryPixbufsJob);
 
-    addMethodToMainloop(PRIORITY_DEFAULT, time_initbaum,
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT, time_initbaum,
         updateSceneryFrame);
 }
 
@@ -139,16 +169,14 @@ void initSceneryPixmaps() {
     attributes.valuemask = XpmDepth;
     attributes.depth = mGlobal.SnowWinDepth;
 
-    for (int i = 0; i < 2; i++) {
-        for (int tt = 0; tt <= NUM_BASE_SCENE_TYPES; tt++) {
-            iXpmCreatePixmapFromData(mGlobal.display,
-                mGlobal.SnowWin, xpmtrees[tt],
-                &mColorableTreePixmap[tt][i],
-                &TreeMaskPixmap[tt][i], &attributes, i);
+    for (int tt = 0; tt <= NUM_BASE_SCENE_TYPES; tt++) {
+        iXpmCreatePixmapFromData(mGlobal.display,
+            mGlobal.SnowWin, xpmtrees[tt],
+            &mColorableTreePixmap[tt],
+            &TreeMaskPixmap[tt], &attributes, 0);
 
-            sscanf(xpmtrees[tt][0], "%d %d",
-                &TreeWidth[tt], &TreeHeight[tt]);
-        }
+        sscanf(xpmtrees[tt][0], "%d %d",
+            &TreeWidth[tt], &TreeHeight[tt]);
     }
 
     mGlobal.OnTrees = 0;
@@ -168,33 +196,58 @@ void initSceneryModuleSurfaces() {
 
         // Create new surface.
         if (TreeRead) {
-            tree->surface = getNewScenerySurface(tree->rev,
+            tree->surface = getCachedScenerySurface(
                 (const char**) TreeXpm,
                 tree->scale);
         } else {
-            tree->surface = getNewScenerySurface(tree->rev,
+            tree->surface = getCachedScenerySurface(
                 (const char**) xpmtrees[tree->type],
                 tree->scale);
         }
     }
+    mSceneryVersion++;
 }
 
 /***********************************************************
- * This method ...
+ * These methods decode every tree on the startup pool, and
+ * install the pixbufs on the main thread.
  */
-cairo_surface_t* getNewScenerySurface(int flip,
-    const char **xpm, float scale) {
+void* buildSceneryPixbufs(void* arg) {
+    GdkPixbuf** pixbufs = (GdkPixbuf**) arg;
+    for (int tt = 0; tt < NUM_ALL_SCENE_TYPES; tt++) {
+        pixbufs[tt] = gdk_pixbuf_new_from_xpm_data(
+            (const char**) xpmtrees[tt]);
+    }
+    return pixbufs;
+}
 
-    GdkPixbuf *pixbuf, *pixbuf1;
-    pixbuf1 = gdk_pixbuf_new_from_xpm_data(
-        (const char**) xpm);
+void installSceneryPixbufs(void* result, void* arg) {
+    (void) arg;
+    GdkPixbuf** pixbufs = (GdkPixbuf**) result;
+    for (int tt = 0; tt < NUM_ALL_SCENE_TYPES; tt++) {
+        mSceneryPixbufs[tt] = pixbufs[tt];
+    }
+}
 
-    if (flip) {
-        pixbuf = gdk_pixbuf_flip(pixbuf1, 1);
-        g_clear_object(&pixbuf1);
-    } else {
-        pixbuf = pixbuf1;
+/***********************************************************
+ * This method returns a new reference to the decoded xpm,
+ * from the startup pixbufs when it is one of ours.
+ */
+GdkPixbuf* getSceneryPixbuf(const char** xpm) {
+    for (int tt = 0; tt < NUM_ALL_SCENE_TYPES; tt++) {
+        if ((const char**) xpmtrees[tt] == xpm &&
+            mSceneryPixbufs[tt]) {
+            return g_object_ref(mSceneryPixbufs[tt]);
+        }
     }
+    return gdk_pixbuf_new_from_xpm_data(xpm);
+}
+
+/***********************************************************
+ * This method scales a tree, facing the way its xpm does.
+ * Reversed trees are mirrored when drawn.
+ */
+cairo_surface_t* getNewScenerySurface(const char **xpm, float scale) {
 
     int w, h;
     sscanf(xpm[0], "%d %d", &w, &h);
@@ -211,18 +264,95 @@ cairo_surface_t* getNewScenerySurface(int flip,
         h = 2;
     }
 
+    // Mapped from an earlier run?
+    uint64_t cacheKey = 0;
+    if (isSpriteCacheActive()) {
+        cacheKey = getSpriteCacheKey(hashSpriteXpm(xpm), w, h, 0, "");
+        cairo_surface_t* surface = loadCachedSprite(cacheKey);
+        if (surface) {
+            return surface;
+        }
+    }
+
+    GdkPixbuf* pixbuf = getSceneryPixbuf(xpm);
     GdkPixbuf* pixbufscaled =
         gdk_pixbuf_scale_simple(pixbuf, w, h, GDK_INTERP_HYPER);
 
-    cairo_surface_t* surface = 
-        gdk_cairo_surface_create_from_pixbuf(pixbufscaled, 0, NULL);
+    cairo_surface_t* surface = trackSurface(MEMORY_SPRITES,
+        gdk_cairo_surface_create_from_pixbuf(pixbufscaled, 0, NULL));
 
     g_clear_object(&pixbuf);
     g_clear_object(&pixbufscaled);
 
+    if (isSpriteCacheActive()) {
+        storeCachedSprite(cacheKey, surface);
+    }
     return surface;
 }
 
+/***********************************************************
+ * This method finds or adds the cache item for a tree,
+ * NULL if the cache is full.
+ */
+static SceneryCacheItem* getSceneryCacheItem(int flip,
+    const char** xpm, float scale) {
+    const int scaleKey = lrintf(scale * SCENERY_SCALE_STEPS);
+
+    for (int i = 0; i < mSceneryCacheCount; i++) {
+        SceneryCacheItem* item = &mSceneryCache[i];
+        if (item->xpm == xpm && item->flip == flip &&
+            item->scaleKey == scaleKey) {
+            return item;
+        }
+    }
+
+    if (mSceneryCacheCount >= SCENERY_CACHE_MAX) {
+        return NULL;
+    }
+    SceneryCacheItem* item = &mSceneryCache[mSceneryCacheCount++];
+    item->xpm = xpm;
+    item->flip = flip;
+    item->scaleKey = scaleKey;
+    item->surface = NULL;
+    item->region = NULL;
+    return item;
+}
+
+/***********************************************************
+ * This method returns a reference to the scaled surface of
+ * a tree, the caller destroys it. Both ways round share the
+ * unflipped item.
+ */
+cairo_surface_t* getCachedScenerySurface(const char** xpm,
+    float scale) {
+    SceneryCacheItem* item = getSceneryCacheItem(0, xpm, scale);
+    if (!item) {
+        return getNewScenerySurface(xpm, scale);
+    }
+
+    if (!item->surface) {
+        item->surface = getNewScenerySurface(xpm, scale);
+    }
+    return cairo_surface_reference(item->surface);
+}
+
+/***********************************************************
+ * This method returns a copy of the region of a tree, the
+ * caller destroys it.
+ */
+cairo_region_t* getCachedSceneryRegion(int flip,
+    const char** xpm, float scale) {
+    SceneryCacheItem* item = getSceneryCacheItem(flip, xpm, scale);
+    if (!item) {
+        return gregionfromxpm(xpm, flip, scale);
+    }
+
+    if (!item->region) {
+        item->region = gregionfromxpm(xpm, flip, scale);
+    }
+    return cairo_region_copy(item->region);
+}
+
 /***********************************************************
  * Fallen snow and trees must have been initialized
  * tree coordinates and so are recalculated here.
@@ -252,15 +382,15 @@ int updateSceneryFrame() {
 
     mSceneryNeedsInit = false;
     for (int i = 0; i < NTrees; i++) {
+        if (mSceneryInfoArray[i]->surface) {
+            cairo_surface_destroy(mSceneryInfoArray[i]->surface);
+        }
         free(mSceneryInfoArray[i]);
     }
     free(mSceneryInfoArray);
     mSceneryInfoArray = NULL;
 
-    cairo_region_destroy(mGlobal.gSnowOnTreesRegion);
     cairo_region_destroy(mGlobal.TreeRegion);
-
-    mGlobal.gSnowOnTreesRegion = cairo_region_create();
     mGlobal.TreeRegion = cairo_region_create();
 
     // determine which trees are to be used
@@ -354,6 +484,8 @@ int updateSceneryFrame() {
         float myScale = (1 - MinScale) * (y - y2) /
             (y1 - y2) + MinScale;
         myScale *= treeScale * 0.01 * Flags.TreeScale;
+        myScale = roundf(myScale * SCENERY_SCALE_STEPS) /
+            SCENERY_SCALE_STEPS;
 
         cairo_rectangle_int_t grect = {x - 1, y - 1,
             (int) (myScale * w + 2), (int)(myScale * h + 2)};
@@ -386,12 +518,12 @@ int updateSceneryFrame() {
         cairo_region_t *r;
         switch (tt) {
             case -SOMENUMBER:
-                r = gregionfromxpm((const char**) TreeXpm,
-                    tree->rev, tree->scale);
+                r = getCachedSceneryRegion(tree->rev,
+                    (const char**) TreeXpm, tree->scale);
                 break;
             default:
-                r = gregionfromxpm(xpmtrees[tt], tree->rev,
-                    tree->scale);
+                r = getCachedSceneryRegion(tree->rev,
+                    (const char**) xpmtrees[tt], tree->scale);
                 break;
         }
 
@@ -406,6 +538,8 @@ int updateSceneryFrame() {
         mSceneryInfoArray[NTrees - 1] = tree;
     }
 
+    rebuildTreeMask();
+
     // Sort using y+h values of trees, so that higher
     // trees are painted first.
     qsort(mSceneryInfoArray, NTrees, sizeof(*mSceneryInfoArray),
@@ -413,6 +547,7 @@ int updateSceneryFrame() {
 
     initSceneryModuleSurfaces();
     updateColorTree();
+    mSceneryVersion++;
 
     mGlobal.OnTrees = 0;
     return TRUE;
@@ -460,19 +595,20 @@ void updateColorTree() {
     attributes.valuemask = XpmDepth;
     attributes.depth = mGlobal.SnowWinDepth;
 
-    for (int i = 0; i < 2; i++) {
-        XFreePixmap(mGlobal.display, mColorableTreePixmap[0][i]);
+    XFreePixmap(mGlobal.display, mColorableTreePixmap[0]);
 
-        iXpmCreatePixmapFromData(mGlobal.display, mGlobal.SnowWin,
-            (const char**) imageString, &mColorableTreePixmap[0][i],
-            &TreeMaskPixmap[0][i], &attributes, i);
-        sscanf(xpmtrees[0][0], "%d %d", &TreeWidth[0], &TreeHeight[0]);
-    }
+    iXpmCreatePixmapFromData(mGlobal.display, mGlobal.SnowWin,
+        (const char**) imageString, &mColorableTreePixmap[0],
+        &TreeMaskPixmap[0], &attributes, 0);
+    sscanf(xpmtrees[0][0], "%d %d", &TreeWidth[0], &TreeHeight[0]);
 
     for (int i = 0; i < NTrees; i++) {
         SceneryInfo *tree = mSceneryInfoArray[i];
         if (tree->type == 0) {
-            tree->surface = getNewScenerySurface(tree->rev,
+            if (tree->surface) {
+                cairo_surface_destroy(tree->surface);
+            }
+            tree->surface = getNewScenerySurface(
                 (const char**) imageString, tree->scale);
         }
     }
@@ -482,6 +618,15 @@ void updateColorTree() {
         free(imageString[i]);
     }
     free(imageString);
+    mSceneryVersion++;
+}
+
+/***********************************************************
+ * This method returns the scenery version, which changes
+ * whenever drawSceneryFrame() would draw differently.
+ */
+int getSceneryVersion() {
+    return mSceneryVersion;
 }
 
 /***********************************************************
@@ -494,8 +639,20 @@ int drawSceneryFrame(cairo_t *cr) {
 
     for (int i = 0; i < NTrees; i++) {
         SceneryInfo *tree = mSceneryInfoArray[i];
-        cairo_set_source_surface(cr, tree->surface, tree->x, tree->y);
+        if (!tree->rev) {
+            cairo_set_source_surface(cr, tree->surface, tree->x, tree->y);
+            my_cairo_paint_with_alpha(cr, ALPHA);
+            continue;
+        }
+
+        // Mirrored about the tree's own box.
+        cairo_save(cr);
+        cairo_translate(cr, tree->x +
+            cairo_image_surface_get_width(tree->surface), tree->y);
+        cairo_scale(cr, -1, 1);
+        cairo_set_source_surface(cr, tree->surface, 0, 0);
         my_cairo_paint_with_alpha(cr, ALPHA);
+        cairo_restore(cr);
     }
 
     return TRUE;
@@ -546,6 +703,41 @@ void clearAndRedrawScenery() {
     clearGlobalSnowWindow();
 }
 
+/** *********************************************************************
+ ** This method moves the trees with a window resize,
+ ** keeping their surfaces. Across stays relative to the
+ ** width, height stays relative to the bottom.
+ **/
+void rescaleScenery(int oldWidth, int oldHeight) {
+    if (mSceneryNeedsInit || oldWidth < 1) {
+        clearAndRedrawScenery();
+        return;
+    }
+
+    cairo_region_destroy(mGlobal.TreeRegion);
+    mGlobal.TreeRegion = cairo_region_create();
+
+    for (int i = 0; i < NTrees; i++) {
+        SceneryInfo* tree = mSceneryInfoArray[i];
+        tree->x = (long) tree->x * mGlobal.SnowWinWidth / oldWidth;
+        tree->y += mGlobal.SnowWinHeight - oldHeight;
+
+        const char** xpm = tree->type == -SOMENUMBER ?
+            (const char**) TreeXpm : (const char**) xpmtrees[tree->type];
+        cairo_region_t* r = getCachedSceneryRegion(tree->rev,
+            xpm, tree->scale);
+        cairo_region_translate(r, tree->x, tree->y);
+        cairo_region_union(mGlobal.TreeRegion, r);
+        cairo_region_destroy(r);
+    }
+
+    rebuildTreeMask();
+    mSceneryVersion++;
+
+    reinit_treesnow_region(); // treesnow.c.
+    clearGlobalSnowWindow();
+}
+
 //
 //  equal to XpmCreatePixmapFromData, with extra flags:
 //  flop: if 1, reverse the data horizontally
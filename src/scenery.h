@@ -25,12 +25,31 @@
 #include <gtk/gtk.h>
 
 
+/***********************************************************
+ * Module consts.
+ */
+// Tree scales are rounded to 1 / SCENERY_SCALE_STEPS, so
+// scaled trees can be cached.
+#define SCENERY_SCALE_STEPS 128
+#define SCENERY_CACHE_MAX 1024
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
 void initSceneryModule();
 void setSceneryScale();
 void initSceneryPixmaps();
 
 void initSceneryModuleSurfaces();
+void* buildSceneryPixbufs(void* arg);
+void installSceneryPixbufs(void* result, void* arg);
+GdkPixbuf* getSceneryPixbuf(const char** xpm);
 cairo_surface_t* getNewScenerySurface(
+    const char**, float);
+cairo_surface_t* getCachedScenerySurface(
+    const char**, float);
+cairo_region_t* getCachedSceneryRegion(
     int, const char**, float);
 
 int updateSceneryFrame();
@@ -38,9 +57,11 @@ int compareTrees(const void*, const void*);
 void updateColorTree();
 
 int drawSceneryFrame(cairo_t *cr);
+int getSceneryVersion();
 
 void updateSceneryUserSettings();
 void clearAndRedrawScenery();
+void rescaleScenery(int oldWidth, int oldHeight);
 
 int iXpmCreatePixmapFromData(Display* display,
     Drawable d, const char** data,
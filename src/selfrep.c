@@ -19,26 +19,85 @@
 #-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #-# 
 */
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
 #include "selfrep.h"
 #include "mygettext.h"
 #include "Utils.h"
+#include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef SELFREP
+// In read-only data, so -selfrep neither copies it onto the
+// stack nor touches pages it has not written yet.
+static const unsigned char tarfile[] = {
+    #include "tarfile.inc"
+};
+
+// Bytes handed to the kernel per call.
+#define SELFREP_CHUNK (64 * 1024)
+
+// Stream the tarball to fd. Into a pipe the pages are spliced
+// rather than copied, the array never changes, so that is
+// safe. Anything else, or an old kernel, gets plain writes.
+static ssize_t write_tarfile(int fd) {
+    size_t done = 0;
+
+#ifdef __linux__
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        while (done < sizeof(tarfile)) {
+            size_t l = sizeof(tarfile) - done;
+            if (l > SELFREP_CHUNK) {
+                l = SELFREP_CHUNK;
+            }
+            struct iovec iov = {(void *)(tarfile + done), l};
+            ssize_t x = vmsplice(fd, &iov, 1, 0);
+            if (x < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            done += x;
+        }
+    }
+#endif
+
+    while (done < sizeof(tarfile)) {
+        size_t l = sizeof(tarfile) - done;
+        if (l > SELFREP_CHUNK) {
+            l = SELFREP_CHUNK;
+        }
+        if (mywrite(fd, tarfile + done, l) < 0) {
+            return -1;
+        }
+        done += l;
+    }
+    return 0;
+}
+#endif
 
 void selfrep() {
 
 #ifdef SELFREP
-    unsigned char tarfile[] = {
-        #include "tarfile.inc"
-    };
-
     if (sizeof(tarfile) > 1000 && isatty(fileno(stdout))) {
         printf(_("Not sending tar file to terminal.\n"));
         printf(_("Try redirecting to a file (e.g: %s,\n"),
             "plasmasnow -selfrep > plasmasnow.tar.gz)");
         printf(_("or use a %s"), "pipe (e.g: plasmasnow -selfrep | tar zxf -).\n");
     } else {
-        ssize_t rc = mywrite(fileno(stdout), tarfile, sizeof(tarfile));
+        fflush(stdout);
+        ssize_t rc = write_tarfile(fileno(stdout));
         if (rc < 0) {
             fprintf(stderr, "plasmasnow: %s",
                 _("Problems encountered during production of the tar ball.\n"));
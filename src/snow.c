@@ -21,26 +21,40 @@
 */
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <gtk/gtk.h>
 
 #include "plasmasnow.h"
 
 #include "Blowoff.h"
 #include "clocks.h"
+#include "DebrisPool.h"
 #include "FallenSnow.h"
+#include "FlakeKernels.h"
+#include "FlakePool.h"
 #include "Flags.h"
-#include "hashtable.h"
+#include "FrameDamage.h"
+#include "FrameProfiler.h"
+#include "GLRenderer.h"
 #include "ixpm.h"
+#include "LoadMeasure.h"
 #include "MainWindow.h"
+#include "MemoryStats.h"
+#include "Occlusion.h"
+#include "Outputs.h"
 #include "pixmaps.h"
+#include "Random.h"
 #include "safe_malloc.h"
 #include "scenery.h"
 #include "snow.h"
+#include "SpriteCache.h"
+#include "TileRaster.h"
 #include "treesnow.h"
 #include "Utils.h"
 #include "wind.h"
@@ -85,7 +99,7 @@ const float mSpeedMaxValues[] = {
 };
 
 SnowMap* snowPix = NULL;
-char*** plasmasnow_xpm = NULL;
+IndexedSprite* mFlakeSprites = NULL;
 
 int MaxFlakeTypes = 0;
 int NFlakeTypesVintage = 0;
@@ -94,6 +108,73 @@ int NFlakeTypesVintage = 0;
 GdkRGBA mFlakeColor;
 int mFlakeColorToggle = 0;
 
+// All live flakes. The mutex guards against MakeFlake()
+// from the FallenSnow thread (Santa plowing), it is always
+// taken after the FallenSnow semaphore, never before it.
+FlakePool mFlakePool;
+pthread_mutex_t mFlakePoolMutex;
+
+// Flakes made and removed since start, for metrics. Guarded
+// by the flake pool mutex.
+unsigned long mFlakesSpawnedTotal = 0;
+unsigned long mFlakesRemovedTotal = 0;
+
+// Fluff and frozen snow, drifting and fading out, apart
+// from the flakes. Guarded by the flake pool mutex.
+DebrisPool mDebrisPool;
+
+// Flake system tick, steps all live flakes in one pass.
+// The simulation runs in fixed steps of time_snowflakes,
+// catching up late ticks; draws interpolate between steps.
+guint mFlakeSystemTickGUID = 0;
+FixedStepClock mFlakeStepClock;
+#define FLAKE_MAX_CATCHUP_STEPS 4
+
+// Moved further in one step is a jump (wrap, respawn),
+// drawn where it landed.
+#define FLAKE_INTERPOLATE_MAX 32.0f
+
+// Flakes this size or smaller are drawn as a filled rect,
+// all of a color in one path, rather than as sprites.
+#define FLAKE_LOD_MAX_SIZE 3
+GdkRGBA mFlakeLodColors[2];
+
+// Flakes test for landing only once they could reach fallen
+// snow or a tree under their column, MARGIN pixels either
+// side, at their top speeds. Predictions hold until the
+// window set, trees, wind or speed change.
+#define FLAKE_CONTACT_MARGIN 128
+#define FLAKE_CONTACT_SLACK 16
+#define FLAKE_CONTACT_MAX_TIME 2.0f
+#define FLAKE_CONTACT_BUCKET_WIDTH 64
+
+typedef struct _FlakeContactKey {
+        unsigned int fallenEpoch;
+        int sceneryVersion;
+        int wind;
+        int noWind;
+        int width;
+        float speedFactor;
+} FlakeContactKey;
+
+FlakeContactKey mFlakeContactKey;
+short int* mContactTreeTop = NULL;
+int mContactTreeBuckets = 0;
+
+// Batched randoms for the velocity kernel.
+float* mFlakeRandoms = NULL;
+int mFlakeRandomsCapacity = 0;
+
+// One packed surface holding every flake type, one row
+// per pre-multiplied alpha level, so snow_draw() blits
+// rectangles from a single source pattern.
+#define FLAKE_ATLAS_ALPHA_LEVELS 8
+
+cairo_surface_t* mFlakeAtlas = NULL;
+cairo_pattern_t* mFlakeAtlasPattern = NULL;
+int mFlakeAtlasRowHeight = 0;
+unsigned int mFlakeAtlasVersion = 0;
+
 
 /***********************************************************
  ** Init.
@@ -105,6 +186,15 @@ void snow_init() {
     }
     NFlakeTypesVintage = MaxFlakeTypes;
 
+    pthread_mutexattr_t flakePoolMutexAttr;
+    pthread_mutexattr_init(&flakePoolMutexAttr);
+    pthread_mutexattr_settype(&flakePoolMutexAttr,
+        PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mFlakePoolMutex, &flakePoolMutexAttr);
+    pthread_mutexattr_destroy(&flakePoolMutexAttr);
+
+    flakePoolInit(&mFlakePool);
+    debrisPoolClear(&mDebrisPool);
     add_random_flakes(EXTRA_FLAKES);
 
     snowPix = (SnowMap*) malloc(
@@ -120,8 +210,224 @@ void snow_init() {
     InitSnowColor();
     InitSnowSpeedFactor();
 
-    addMethodToMainloop(PRIORITY_DEFAULT,
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT,
         time_genflakes, execStormBackgroundThread);
+    addFlakeSystemTickToMainloop();
+}
+
+/***********************************************************
+ ** This method (re)registers the single flake system tick,
+ ** using the current cpufactor scaled time_snowflakes.
+ **/
+void addFlakeSystemTickToMainloop() {
+    remove_from_mainloop(&mFlakeSystemTickGUID);
+
+    initFixedStepClock(&mFlakeStepClock, time_snowflakes,
+        FLAKE_MAX_CATCHUP_STEPS);
+    mFlakeSystemTickGUID = addSimulationMethodToMainloop(PRIORITY_HIGH,
+        time_snowflakes, execFlakeSystemTick);
+}
+
+/***********************************************************
+ ** This method steps every live flake in a single pass,
+ ** once per whole fixed step due.
+ **
+ ** A step that removes its flake swaps the last flake into
+ ** the same slot, so the index is only advanced for flakes
+ ** that survive. Flakes created during the pass are appended
+ ** and stepped in the same pass.
+ **/
+int execFlakeSystemTick() {
+    if (Flags.shutdownRequested) {
+        mFlakeSystemTickGUID = 0;
+        return false;
+    }
+
+    const int steps = advanceFixedStepClock(&mFlakeStepClock);
+    const double dt = mFlakeStepClock.step;
+
+    if (!WorkspaceActive() || Flags.NoSnowFlakes || steps == 0) {
+        return true;
+    }
+
+    // Step them all. Landing snow is queued to the FallenSnow
+    // thread, so no FallenSnow lock is needed here.
+    const double profileStart = startProfileSample();
+    lockFlakePool();
+
+    rearmFlakeContacts();
+
+    for (int step = 0; step < steps; step++) {
+        flakePoolSavePositions(&mFlakePool);
+
+        int flake = 0;
+        while (flake < mFlakePool.mItemSize) {
+            if (execStormItemBackgroundThread(flake, dt)) {
+                flake++;
+            }
+        }
+
+        // Then update all flake speeds in one batch.
+        integrateFlakeVelocities(dt);
+    }
+
+    // Debris only drifts, in one batch for all steps.
+    if (mKillFlakes || mGlobal.RemoveFluff) {
+        debrisPoolClear(&mDebrisPool);
+    }
+    debrisPoolStep(&mDebrisPool, steps * dt, SnowSpeedFactor);
+    mGlobal.FluffCount = mDebrisPool.mLiveCount;
+
+    unlockFlakePool();
+    endProfileSample(PROFILE_FLAKE_TICK, profileStart);
+
+    return true;
+}
+
+/***********************************************************
+ ** This method updates the speeds of all live flakes for
+ ** the next step, using the batched flake kernel.
+ ** threads: locking by caller
+ **/
+void integrateFlakeVelocities(double dt) {
+    const int n = mFlakePool.mItemSize;
+    if (n > mFlakeRandomsCapacity) {
+        mFlakeRandomsCapacity = mFlakePool.mCapacity;
+        mFlakeRandoms = (float*) realloc(mFlakeRandoms,
+            mFlakeRandomsCapacity * sizeof(float));
+        REALLOC_CHECK(mFlakeRandoms);
+    }
+    randomFill(mFlakeRandoms, n);
+
+    flakeKernelsIntegrateVelocities(&mFlakePool, n, dt,
+        mGlobal.NewWind, getWindGrid(), 2 * mSpeedMaxValues[mGlobal.Wind],
+        !Flags.NoWind, INITIALYSPEED * 0.1, mFlakeRandoms);
+}
+
+/***********************************************************
+ ** This method drops all landing predictions when what they
+ ** were made against has changed, and keeps the tree tops.
+ ** threads: locking by caller
+ **/
+void rearmFlakeContacts() {
+    const FlakeContactKey key = {
+        .fallenEpoch = getFallenSnowColumnIndexEpoch(),
+        .sceneryVersion = getSceneryVersion(),
+        .wind = mGlobal.Wind,
+        .noWind = Flags.NoWind,
+        .width = mGlobal.SnowWinWidth,
+        .speedFactor = SnowSpeedFactor,
+    };
+    if (mContactTreeTop && !memcmp(&key, &mFlakeContactKey, sizeof(key))) {
+        return;
+    }
+    mFlakeContactKey = key;
+
+    // Tree tops from the boxes of the tree region.
+    mContactTreeBuckets = mGlobal.SnowWinWidth /
+        FLAKE_CONTACT_BUCKET_WIDTH + 1;
+    mContactTreeTop = (short int*) realloc(mContactTreeTop,
+        sizeof(short int) * mContactTreeBuckets);
+    REALLOC_CHECK(mContactTreeTop);
+    for (int b = 0; b < mContactTreeBuckets; b++) {
+        mContactTreeTop[b] = SHRT_MAX;
+    }
+    const int rects = mGlobal.TreeRegion ?
+        cairo_region_num_rectangles(mGlobal.TreeRegion) : 0;
+    for (int i = 0; i < rects; i++) {
+        cairo_rectangle_int_t rect;
+        cairo_region_get_rectangle(mGlobal.TreeRegion, i, &rect);
+        const int first = MAX(0, rect.x / FLAKE_CONTACT_BUCKET_WIDTH);
+        const int last = MIN(mContactTreeBuckets - 1,
+            (rect.x + rect.width) / FLAKE_CONTACT_BUCKET_WIDTH);
+        for (int b = first; b <= last; b++) {
+            if (rect.y < mContactTreeTop[b]) {
+                mContactTreeTop[b] = rect.y;
+            }
+        }
+    }
+
+    memset(mFlakePool.contactIn, 0,
+        sizeof(float) * mFlakePool.mItemSize);
+}
+
+/***********************************************************
+ ** This method returns the highest tree pixel between
+ ** screen columns x0 and x1, SHRT_MAX if none.
+ **/
+int getContactTreeTop(int x0, int x1) {
+    const int first = MAX(0, x0 / FLAKE_CONTACT_BUCKET_WIDTH);
+    const int last = MIN(mContactTreeBuckets - 1,
+        x1 / FLAKE_CONTACT_BUCKET_WIDTH);
+
+    int top = SHRT_MAX;
+    for (int b = first; b <= last; b++) {
+        if (mContactTreeTop[b] < top) {
+            top = mContactTreeTop[b];
+        }
+    }
+    return top;
+}
+
+/***********************************************************
+ ** This method returns how long a flake surely can't touch
+ ** anything it may land on, falling at its top speed and
+ ** drifting at the top wind speed. 0 if it may now.
+ ** threads: locking by caller
+ **/
+float getFlakeContactTime(int flake, int flakew, int flakeh) {
+    const int x0 = mFlakePool.rx[flake] - FLAKE_CONTACT_MARGIN;
+    const int x1 = mFlakePool.rx[flake] + flakew + FLAKE_CONTACT_MARGIN;
+
+    // Near a side, a wrap could take it anywhere.
+    if ((mFlakePool.state[flake] & FLAKE_CYCLIC) &&
+        (x0 < 0 || x1 >= mGlobal.SnowWinWidth)) {
+        return 0;
+    }
+
+    const int top = MIN(getFallenSnowColumnTop(x0, x1),
+        getContactTreeTop(x0, x1));
+    const float distance = top - FLAKE_CONTACT_SLACK -
+        (mFlakePool.ry[flake] + flakeh);
+    if (distance <= 0) {
+        return 0;
+    }
+
+    const float vyMax = MAX(mFlakePool.vy[flake],
+        1.5f * mFlakePool.ivy[flake]) * SnowSpeedFactor;
+    const float vxMax = Flags.NoWind ? fabsf(mFlakePool.vx[flake]) *
+        SnowSpeedFactor : MAX(fabsf(mFlakePool.vx[flake]),
+            2 * mSpeedMaxValues[mGlobal.Wind]) * SnowSpeedFactor;
+
+    float contact = FLAKE_CONTACT_MAX_TIME;
+    if (vyMax > 0 && distance / vyMax < contact) {
+        contact = distance / vyMax;
+    }
+    if (vxMax > 0 && FLAKE_CONTACT_MARGIN / vxMax < contact) {
+        contact = FLAKE_CONTACT_MARGIN / vxMax;
+    }
+    return contact;
+}
+
+/***********************************************************
+ ** Flake pool lock helpers.
+ **/
+void lockFlakePool() {
+    pthread_mutex_lock(&mFlakePoolMutex);
+}
+void unlockFlakePool() {
+    pthread_mutex_unlock(&mFlakePoolMutex);
+}
+
+/***********************************************************
+ ** This method returns the flakes made and removed since
+ ** start.
+ **/
+void getFlakeTotals(unsigned long* spawned, unsigned long* removed) {
+    lockFlakePool();
+    *spawned = mFlakesSpawnedTotal;
+    *removed = mFlakesRemovedTotal;
+    unlockFlakePool();
 }
 
 /***********************************************************
@@ -161,7 +467,7 @@ void snow_ui() {
         rgba2color(&color, &Flags.SnowColor);
 
         endQPickerDialog();
-        clearAllFallenSnowItems();
+        discardAllFallenSnowItems();
         clearGlobalSnowWindow();
     }
 
@@ -178,7 +484,7 @@ void snow_ui() {
         rgba2color(&color, &Flags.SnowColor2);
 
         endQPickerDialog();
-        clearAllFallenSnowItems();
+        discardAllFallenSnowItems();
         clearGlobalSnowWindow();
     }
 
@@ -198,8 +504,9 @@ void snow_ui() {
 void init_snow_pix() {
     for (int flake = 0; flake < MaxFlakeTypes; flake++) {
 
-        int w, h;
-        sscanf(plasmasnow_xpm[flake][0], "%d %d", &w, &h);
+        const IndexedSprite* sprite = &mFlakeSprites[flake];
+        int w = sprite->width;
+        int h = sprite->height;
 
         w *= 0.01 * Flags.Scale * mStormScale * mGlobal.WindowScale;
         h *= 0.01 * Flags.Scale * mStormScale * mGlobal.WindowScale;
@@ -209,15 +516,9 @@ void init_snow_pix() {
         rp->height = h;
 
         // Set color, and switch for next.
-        char** data;
-        int lines;
-        xpm_set_color(plasmasnow_xpm[flake],
-            &data, &lines, getNextFlakeColorAsString());
-
-        // Create pixbuf.
-        GdkPixbuf* pixbuf = gdk_pixbuf_new_from_xpm_data(
-            (const char**) data);
-        xpm_destroy(data);
+        const char* colorName = getNextFlakeColorAsString();
+        rp->colorIndex = mFlakeColorToggle;
+        gdk_rgba_parse(&mFlakeLodColors[rp->colorIndex], colorName);
 
         // Guard W & H, then create.
         if (w < 1) {
@@ -229,22 +530,103 @@ void init_snow_pix() {
         if (w == 1 && h == 1) {
             h = 2;
         }
+        rp->isLod = (w <= FLAKE_LOD_MAX_SIZE && h <= FLAKE_LOD_MAX_SIZE);
 
-        // Destroy & recreate surface.
-        GdkPixbuf* pixbufscaled = gdk_pixbuf_scale_simple(
-            pixbuf, w, h, GDK_INTERP_HYPER);
         if (rp->surface) {
             cairo_surface_destroy(rp->surface);
+            rp->surface = NULL;
+        }
+
+        // Vintage flakes are the same every run, so an earlier
+        // run may have left them on disk.
+        uint64_t cacheKey = 0;
+        const bool isCacheable = isSpriteCacheActive() &&
+            flake < NFlakeTypesVintage;
+        if (isCacheable) {
+            uint64_t assetHash = hashSpriteBytes(SPRITE_HASH_SEED,
+                &sprite->width, sizeof(sprite->width));
+            assetHash = hashSpriteBytes(assetHash, sprite->pixels,
+                (size_t) sprite->width * sprite->height);
+            cacheKey = getSpriteCacheKey(assetHash, w, h, 0, colorName);
+            rp->surface = loadCachedSprite(cacheKey);
+        }
+        if (rp->surface) {
+            continue;
         }
-        rp->surface = gdk_cairo_surface_create_from_pixbuf(
-            pixbufscaled, 0, NULL);
+
+        // Create pixbuf.
+        GdkRGBA color = {0.0, 0.0, 0.0, 1.0};
+        gdk_rgba_parse(&color, colorName);
+        GdkPixbuf* pixbuf = indexedSpriteToPixbuf(sprite, &color);
+
+        // Recreate surface.
+        GdkPixbuf* pixbufscaled = gdk_pixbuf_scale_simple(
+            pixbuf, w, h, GDK_INTERP_HYPER);
+        rp->surface = trackSurface(MEMORY_SPRITES,
+            gdk_cairo_surface_create_from_pixbuf(pixbufscaled, 0, NULL));
         g_clear_object(&pixbufscaled);
 
         // Clear pixbuf.
         g_clear_object(&pixbuf);
+
+        if (isCacheable) {
+            storeCachedSprite(cacheKey, rp->surface);
+        }
     }
 
     mGlobal.fluffpix = &snowPix[MaxFlakeTypes - 1];
+    initFlakeAtlas();
+}
+
+/***********************************************************
+ ** This method packs all snowPix[] surfaces into the flake
+ ** atlas. Flake types go left to right, alpha levels top to
+ ** bottom, with a 1 pixel gap so boxes never bleed.
+ **/
+void initFlakeAtlas() {
+    if (mFlakeAtlasPattern) {
+        cairo_pattern_destroy(mFlakeAtlasPattern);
+    }
+    if (mFlakeAtlas) {
+        cairo_surface_destroy(mFlakeAtlas);
+    }
+
+    // Layout.
+    int atlasWidth = 0;
+    mFlakeAtlasRowHeight = 0;
+    for (int flake = 0; flake < MaxFlakeTypes; flake++) {
+        SnowMap* rp = &snowPix[flake];
+        rp->atlasX = atlasWidth;
+        rp->atlasWidth = cairo_image_surface_get_width(rp->surface);
+        rp->atlasHeight = cairo_image_surface_get_height(rp->surface);
+
+        atlasWidth += rp->atlasWidth + 1;
+        mFlakeAtlasRowHeight = MAX(mFlakeAtlasRowHeight,
+            rp->atlasHeight + 1);
+    }
+
+    // Paint every flake once per alpha level.
+    mFlakeAtlas = trackSurface(MEMORY_SPRITES,
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            MAX(atlasWidth, 1),
+            MAX(mFlakeAtlasRowHeight * FLAKE_ATLAS_ALPHA_LEVELS, 1)));
+
+    cairo_t* cr = cairo_create(mFlakeAtlas);
+    for (int level = 1; level <= FLAKE_ATLAS_ALPHA_LEVELS; level++) {
+        const int atlasY = (level - 1) * mFlakeAtlasRowHeight;
+        for (int flake = 0; flake < MaxFlakeTypes; flake++) {
+            SnowMap* rp = &snowPix[flake];
+            cairo_set_source_surface(cr, rp->surface,
+                rp->atlasX, atlasY);
+            my_cairo_paint_with_alpha(cr,
+                (double) level / FLAKE_ATLAS_ALPHA_LEVELS);
+        }
+    }
+    cairo_destroy(cr);
+
+    mFlakeAtlasPattern = cairo_pattern_create_for_surface(mFlakeAtlas);
+    cairo_pattern_set_filter(mFlakeAtlasPattern, CAIRO_FILTER_NEAREST);
+    mFlakeAtlasVersion++;
 }
 
 /***********************************************************
@@ -302,43 +684,163 @@ int snow_draw(cairo_t *cr) {
         return true;
     }
 
-    set_begin();
-    SnowFlake* flake;
+    // Client side frames can spread the blits over threads.
+    const bool isTiled = isTileRasterActive(cr);
+    if (isTiled) {
+        beginTileLayer(cr);
+    }
 
-    while ((flake = (SnowFlake*) set_next())) {
-        cairo_set_source_surface(cr, snowPix[flake->whatFlake].surface,
-            flake->rx, flake->ry);
+    // A GL frame draws them all in one instanced call.
+    const bool isGL = isGLRendererActive();
+    if (isGL) {
+        setGLSpriteAtlas(mFlakeAtlas, mFlakeAtlasVersion);
+    }
 
-        double alpha = ALPHA;
-        if (flake->fluff) {
-            alpha *= (1 - flake->flufftimer / flake->flufftime);
+    lockFlakePool();
+    const float stepAlpha = getFixedStepAlpha(&mFlakeStepClock);
+    const int alphaLevel = lrint(ALPHA * FLAKE_ATLAS_ALPHA_LEVELS);
+    const bool isOccluding = hasOcclusion();
+    int lodFlakeCount = 0;
+    for (int flake = 0; flake < mFlakePool.mItemSize; flake++) {
+        // Between the last two steps, unless it jumped.
+        float drawX = mFlakePool.rx[flake];
+        float drawY = mFlakePool.ry[flake];
+        const float dx = drawX - mFlakePool.px[flake];
+        const float dy = drawY - mFlakePool.py[flake];
+        if (fabsf(dx) < FLAKE_INTERPOLATE_MAX &&
+            fabsf(dy) < FLAKE_INTERPOLATE_MAX) {
+            drawX -= dx * (1 - stepAlpha);
+            drawY -= dy * (1 - stepAlpha);
         }
-        if (alpha < 0) {
-            alpha = 0;
+        mFlakePool.ix[flake] = lrint(drawX);
+        mFlakePool.iy[flake] = lrint(drawY);
+
+        // Tiny ones are filled together below.
+        const SnowMap* pix = &snowPix[mFlakePool.whatFlake[flake]];
+        addDrawnDamage(mFlakePool.ix[flake] - 1, mFlakePool.iy[flake] - 1,
+            pix->width + 2, pix->height + 2);
+        if (!isTiled && !isGL && pix->isLod) {
+            lodFlakeCount++;
+            continue;
         }
 
-        if (mGlobal.isDoubleBuffered ||
-            !(flake->freeze || flake->fluff)) {
-            my_cairo_paint_with_alpha(cr, alpha);
+        // Hidden behind a window, nothing to paint.
+        if (isOccluding && isAreaOccluded(mFlakePool.ix[flake],
+            mFlakePool.iy[flake], pix->atlasWidth, pix->atlasHeight)) {
+            continue;
         }
+        drawFlakeSprite(cr, isTiled, mFlakePool.whatFlake[flake],
+            mFlakePool.ix[flake], mFlakePool.iy[flake], alphaLevel);
+    }
+    if (lodFlakeCount > 0) {
+        drawLodFlakes(cr, isOccluding);
+    }
 
-        flake->ix = lrint(flake->rx);
-        flake->iy = lrint(flake->ry);
+    // Debris fades out, and is only drawn with double
+    // buffering, where nothing must erase it.
+    if (mGlobal.isDoubleBuffered) {
+        for (int i = 0; i < mDebrisPool.mCount; i++) {
+            const int x = lrint(mDebrisPool.x[i]);
+            const int y = lrint(mDebrisPool.y[i]);
+            const SnowMap* pix = &snowPix[mDebrisPool.whatFlake[i]];
+            if (isOccluding && isAreaOccluded(x, y,
+                pix->atlasWidth, pix->atlasHeight)) {
+                continue;
+            }
+
+            const int debrisAlphaLevel = lrint(ALPHA *
+                debrisPoolAlpha(&mDebrisPool, i) *
+                FLAKE_ATLAS_ALPHA_LEVELS);
+            drawFlakeSprite(cr, isTiled, mDebrisPool.whatFlake[i],
+                x, y, debrisAlphaLevel);
+        }
+    }
+    unlockFlakePool();
+
+    if (isTiled) {
+        drawTileLayer();
     }
 
     return true;
 }
 
+/***********************************************************
+ ** This method draws the tiny flakes as rects, one path and
+ ** one fill per flake color, where a sprite blit each would
+ ** cost far more than it shows. Ones hidden behind windows
+ ** are left out.
+ ** threads: locking by caller
+ **/
+void drawLodFlakes(cairo_t* cr, bool isOccluding) {
+    for (int color = 0; color < 2; color++) {
+        bool hasPath = false;
+        for (int flake = 0; flake < mFlakePool.mItemSize; flake++) {
+            const SnowMap* pix = &snowPix[mFlakePool.whatFlake[flake]];
+            if (!pix->isLod || pix->colorIndex != color) {
+                continue;
+            }
+            if (isOccluding && isAreaOccluded(mFlakePool.ix[flake],
+                mFlakePool.iy[flake], pix->atlasWidth, pix->atlasHeight)) {
+                continue;
+            }
+            cairo_rectangle(cr, mFlakePool.ix[flake], mFlakePool.iy[flake],
+                pix->atlasWidth, pix->atlasHeight);
+            hasPath = true;
+        }
+        if (!hasPath) {
+            continue;
+        }
+
+        const GdkRGBA* rgba = &mFlakeLodColors[color];
+        cairo_set_source_rgba(cr, rgba->red, rgba->green,
+            rgba->blue, ALPHA);
+        cairo_fill(cr);
+    }
+}
+
+/***********************************************************
+ ** This method blits one flake sprite from the atlas, at the
+ ** pre-multiplied alpha row given. Zero is invisible.
+ **/
+void drawFlakeSprite(cairo_t* cr, bool isTiled,
+    unsigned int whatFlake, int x, int y, int alphaLevel) {
+    if (alphaLevel <= 0) {
+        return;
+    }
+
+    const SnowMap* pix = &snowPix[whatFlake];
+    if (isGLRendererActive()) {
+        addGLSprite(pix->atlasX, (alphaLevel - 1) * mFlakeAtlasRowHeight,
+            pix->atlasWidth, pix->atlasHeight, x, y);
+        return;
+    }
+    if (isTiled) {
+        addTileBlit(mFlakeAtlas, pix->atlasX,
+            (alphaLevel - 1) * mFlakeAtlasRowHeight,
+            x, y, pix->atlasWidth, pix->atlasHeight, 1.0);
+        return;
+    }
+
+    // Pixel aligned box, cairo blits it without filtering.
+    cairo_matrix_t matrix;
+    cairo_matrix_init_translate(&matrix, pix->atlasX - x,
+        (alphaLevel - 1) * mFlakeAtlasRowHeight - y);
+    cairo_pattern_set_matrix(mFlakeAtlasPattern, &matrix);
+
+    cairo_set_source(cr, mFlakeAtlasPattern);
+    cairo_rectangle(cr, x, y, pix->atlasWidth, pix->atlasHeight);
+    cairo_fill(cr);
+}
+
 /***********************************************************
  ** This method erases all snow flake Storm Items.
  **/
 int removeAllStormItemsInItemset() {
-    set_begin();
-
-    SnowFlake* flake;
-    while ((flake = (SnowFlake*) set_next())) {
+    lockFlakePool();
+    for (int flake = 0; flake < mFlakePool.mItemSize; flake++) {
         eraseStormItem(flake);
     }
+    unlockFlakePool();
 
     return true;
 }
@@ -377,11 +879,13 @@ int execStormBackgroundThread() {
         return true;
     }
 
+    const double profileStart = startProfileSample();
     const int DESIRED_FLAKES =
         lrint((dt + sumdt) * FlakesPerSecond);
     for (int i = 0; i < DESIRED_FLAKES; i++) {
         MakeFlake(-1);
     }
+    endProfileSample(PROFILE_GENFLAKES_TICK, profileStart);
     sumdt = (DESIRED_FLAKES == 0) ?
         sumdt + dt : 0;
 
@@ -392,28 +896,32 @@ int execStormBackgroundThread() {
 /***********************************************************
  ** This method updates window surfaces and / or desktop bottom
  ** if flake drops onto it.
+ **
+ ** Returns true if the flake has been removed.
  */
-void updateFallenSurfacesWithFlake(SnowFlake* flake,
+bool updateFallenSurfacesWithFlake(int flake,
     int xPosition, int yPosition, int flakeWidth) {
 
-    FallenSnow* fsnow = mGlobal.FsnowFirst;
-    while (fsnow) {
+    // Only the items under this column can be hit.
+    int candidateCount;
+    FallenSnow** candidates =
+        getFallenSnowItemsAtColumn(xPosition, &candidateCount);
+
+    for (int c = 0; c < candidateCount; c++) {
+        FallenSnow* fsnow = candidates[c];
         if (fsnow->winInfo.hidden) {
-            fsnow = fsnow->next;
             continue;
         }
 
         if (fsnow->winInfo.window != None &&
             !isFallenSnowVisibleOnWorkspace(fsnow) &&
             !fsnow->winInfo.sticky) {
-            fsnow = fsnow->next;
             continue;
         }
 
         if (xPosition < fsnow->x ||
             xPosition > fsnow->x + fsnow->w ||
             yPosition >= fsnow->y + 2) {
-            fsnow = fsnow->next;
             continue;
         }
 
@@ -430,127 +938,74 @@ void updateFallenSurfacesWithFlake(SnowFlake* flake,
         for (int i = istart; i < imax; i++) {
             if (yPosition > fsnow->y - fsnow->snowHeight[i] - 1) {
                 if (fsnow->snowHeight[i] < fsnow->maxSnowHeight[i]) {
-                    updateFallenSnowWithSnow(fsnow,
+                    queueFallenSnowDeposit(fsnow,
                         xPosition - fsnow->x, flakeWidth);
                 }
 
                 if (canSnowCollectOnFallen(fsnow)) {
-                    fluffify(flake, .9);
-                    if (!flake->fluff) {
-                        removeStormItemInItemset(flake);
-                    }
+                    fluffify(flake, .9, false);
+                    return true;
                 }
-                return;
+                return false;
             }
         }
-
-        // Otherwise, loop thru all.
-        fsnow = fsnow->next;
     }
+
+    return false;
 }
 
 /***********************************************************
- ** This method ...
+ ** This method steps one flake by flakesDT seconds.
+ **
+ ** Returns false if the flake has been removed.
+ ** threads: locking by caller
  **/
-int execStormItemBackgroundThread(SnowFlake* flake) {
-    if (!WorkspaceActive() || Flags.NoSnowFlakes) {
-        return true;
-    }
-
-    if ((flake->freeze || flake->fluff) && mGlobal.RemoveFluff) {
-        eraseStormItem(flake);
-        removeStormItemInItemset(flake);
-        return false;
-    }
+int execStormItemBackgroundThread(int flake,
+    double flakesDT) {
+    const unsigned char state = mFlakePool.state[flake];
 
-    // handle fluff and mKillFlakes
-    if (mKillFlakes || (flake->fluff &&
-            flake->flufftimer > flake->flufftime)) {
+    if (mKillFlakes) {
         eraseStormItem(flake);
         removeStormItemInItemset(flake);
         return false;
     }
 
     // Look ahead to the flakes new x/y position.
-    const double flakesDT = time_snowflakes;
-    float newFlakeXPos = flake->rx +
-        (flake->vx * flakesDT) * SnowSpeedFactor;
-    float newFlakeYPos = flake->ry +
-        (flake->vy * flakesDT) * SnowSpeedFactor;
-
-    // Update flake based on "fluff" status.
-    if (flake->fluff) {
-        if (!flake->freeze) {
-            flake->rx = newFlakeXPos;
-            flake->ry = newFlakeYPos;
-        }
-        flake->flufftimer += flakesDT;
-        return true;
-    }
+    float newFlakeXPos = mFlakePool.rx[flake] +
+        (mFlakePool.vx[flake] * flakesDT) * SnowSpeedFactor;
+    float newFlakeYPos = mFlakePool.ry[flake] +
+        (mFlakePool.vy[flake] * flakesDT) * SnowSpeedFactor;
 
     // Are we over flake max limit & trying to remove them ?
+    // Fluff is debris, and doesn't count.
     const bool shouldKillFlake =
-        ((mGlobal.FlakeCount - mGlobal.FluffCount) >=
-            Flags.FlakeCountMax);
+        (mGlobal.FlakeCount >= getQualityFlakeCountMax());
 
     // Can we remove them?
     if (shouldKillFlake) {
-        if ((!flake->cyclic && drand48() > 0.3) ||
-            (drand48() > 0.9)) {
-            fluffify(flake, 0.51);
-            return true;
-        }
-    }
-
-    // Update flake speed in X Direction.
-    if (!Flags.NoWind) {
-        // Calc speed.
-        float newXVel = flakesDT *
-            flake->wsens / flake->m;
-
-        if (newXVel > 0.9) {
-            newXVel = 0.9;
-        }
-        if (newXVel < -0.9) {
-            newXVel = -0.9;
-        }
-
-        // Apply speed limits.
-        const float xVelMax = 2 * mSpeedMaxValues[mGlobal.Wind];
-        flake->vx += newXVel * (mGlobal.NewWind - flake->vx);
-
-        if (fabs(flake->vx) > xVelMax) {
-            if (flake->vx > xVelMax) {
-                flake->vx = xVelMax;
-            }
-            if (flake->vx < -xVelMax) {
-                flake->vx = -xVelMax;
-            }
+        if ((!(state & FLAKE_CYCLIC) && randomUniform() > 0.3) ||
+            (randomUniform() > 0.9)) {
+            fluffify(flake, 0.51, false);
+            return false;
         }
     }
 
-    // Update flake speed in Y Direction.
-    flake->vy += INITIALYSPEED * (drand48() - 0.4) * 0.1;
-    if (flake->vy > flake->ivy * 1.5) {
-        flake->vy = flake->ivy * 1.5;
-    }
-
-    // If flake is frozen, we're done.
-    if (flake->freeze) {
-        return true;
-    }
+    // Flake speeds are updated after the pass, in
+    // integrateFlakeVelocities().
 
     // Flake w/h.
-    const int flakew = snowPix[flake->whatFlake].width;
-    const int flakeh = snowPix[flake->whatFlake].height;
+    const int flakew = snowPix[mFlakePool.whatFlake[flake]].width;
+    const int flakeh = snowPix[mFlakePool.whatFlake[flake]].height;
 
     // Update flake based on "cyclic" status.
-    if (flake->cyclic) {
+    if (state & FLAKE_CYCLIC) {
         if (newFlakeXPos < -flakew) {
             newFlakeXPos += mGlobal.SnowWinWidth - 1;
+            mFlakePool.contactIn[flake] = 0;
         }
         if (newFlakeXPos >= mGlobal.SnowWinWidth) {
             newFlakeXPos -= mGlobal.SnowWinWidth;
+            mFlakePool.contactIn[flake] = 0;
         }
     } else {
         // Non-cyclic means we remove it when it
@@ -568,39 +1023,46 @@ int execStormItemBackgroundThread(SnowFlake* flake) {
         return false;
     }
 
+    // Far above anything it could land on, skip the tests.
+    float* contactIn = &mFlakePool.contactIn[flake];
+    if (*contactIn <= flakesDT) {
+        *contactIn = getFlakeContactTime(flake, flakew, flakeh);
+    }
+    if (*contactIn > flakesDT) {
+        *contactIn -= flakesDT;
+        mFlakePool.rx[flake] = newFlakeXPos;
+        mFlakePool.ry[flake] = newFlakeYPos;
+        return true;
+    }
+
     // Flake nx/ny.
     int nx = lrintf(newFlakeXPos);
     int ny = lrintf(newFlakeYPos);
 
     // Determine if non-fluffy-flake touches the fallen snow.
-    if (!flake->fluff) {
-        lockFallenSnowSemaphore();
-        updateFallenSurfacesWithFlake(flake, nx, ny, flakew);
-        unlockFallenSnowSemaphore();
+    if (updateFallenSurfacesWithFlake(flake, nx, ny, flakew)) {
+        return false;
     }
 
     // longRound fromFloats.
-    int x = lrintf(flake->rx);
-    int y = lrintf(flake->ry);
+    int x = lrintf(mFlakePool.rx[flake]);
+    int y = lrintf(mFlakePool.ry[flake]);
 
     if (mGlobal.Wind != 2 && !Flags.NoKeepSnowOnTrees && !Flags.NoTrees) {
-        // check if flake is touching or in gSnowOnTreesRegion
+        // check if flake is touching or in snow on trees
         // if so: remove it
 
-        cairo_rectangle_int_t grec = {x, y, flakew, flakeh};
         cairo_region_overlap_t in =
-            cairo_region_contains_rectangle(mGlobal.gSnowOnTreesRegion, &grec);
+            getSnowOnTreesOverlap(x, y, flakew, flakeh);
 
         if (in == CAIRO_REGION_OVERLAP_PART || in == CAIRO_REGION_OVERLAP_IN) {
-            fluffify(flake, 0.4);
-            flake->freeze = 1;
-            return true;
+            fluffify(flake, 0.4, true);
+            return false;
         }
 
         // check if flake is touching TreeRegion. If so: add snow to
-        // gSnowOnTreesRegion.
-        cairo_rectangle_int_t grect = {x, y, flakew, flakeh};
-        in = cairo_region_contains_rectangle(mGlobal.TreeRegion, &grect);
+        // snow on trees.
+        in = getTreeOverlap(x, y, flakew, flakeh);
         if (in == CAIRO_REGION_OVERLAP_PART) {
             // so, part of the flake is in TreeRegion.
             // For each bottom pixel of the flake:
@@ -619,33 +1081,24 @@ int execStormItemBackgroundThread(SnowFlake* flake) {
 
                 int ybot = y + flakeh;
                 int xbot = x + i;
-                cairo_rectangle_int_t grect = {xbot, ybot, 1, 1};
-
-                cairo_region_overlap_t in =
-                    cairo_region_contains_rectangle(mGlobal.TreeRegion, &grect);
 
                 // If bottom pixel not in TreeRegion, skip.
-                if (in != CAIRO_REGION_OVERLAP_IN) {
+                if (!isTreePixel(xbot, ybot)) {
                     continue;
                 }
 
                 // move upwards, until pixel is not in TreeRegion
                 for (int j = ybot - 1; j >= y; j--) {
-                    cairo_rectangle_int_t grect = {xbot, j, 1, 1};
-
-                    cairo_region_overlap_t in = cairo_region_contains_rectangle(
-                        mGlobal.TreeRegion, &grect);
-                    if (in != CAIRO_REGION_OVERLAP_IN) {
+                    if (!isTreePixel(xbot, j)) {
                         // pixel (xbot,j) is snow-on-tree
                         found = 1;
                         cairo_rectangle_int_t grec;
                         grec.x = xbot;
-                        int p = 1 + drand48() * 3;
+                        int p = 1 + randomUniform() * 3;
                         grec.y = j - p + 1;
                         grec.width = p;
                         grec.height = p;
-                        cairo_region_union_rectangle(mGlobal.gSnowOnTreesRegion,
-                            &grec);
+                        addSnowOnTrees(&grec);
 
                         if (Flags.BlowSnow && mGlobal.OnTrees < Flags.MaxOnTrees) {
                             mGlobal.SnowOnTrees[mGlobal.OnTrees].x = grec.x;
@@ -664,28 +1117,20 @@ int execStormItemBackgroundThread(SnowFlake* flake) {
             // Do not erase: this gives bad effects
             // in fvwm-like desktops.
             if (found) {
-                flake->freeze = 1;
-                fluffify(flake, 0.6);
-
-                SnowFlake* newflake;
-                if (Flags.VintageFlakes) {
-                    newflake = MakeFlake(0);
-                } else {
-                    newflake = MakeFlake(-1);
-                }
+                fluffify(flake, 0.6, true);
 
-                newflake->rx = xfound;
-                newflake->ry = yfound - snowPix[1].height * 0.3f;
-                newflake->freeze = 1;
-                fluffify(newflake, 8);
+                // And a frozen flake of snow stays on the tree.
+                addDebris(xfound, yfound - snowPix[1].height * 0.3f,
+                    0, 0, 8, Flags.VintageFlakes ?
+                        0 : getRandomFlakeType());
 
-                return true;
+                return false;
             }
         }
     }
 
-    flake->rx = newFlakeXPos;
-    flake->ry = newFlakeYPos;
+    mFlakePool.rx[flake] = newFlakeXPos;
+    mFlakePool.ry[flake] = newFlakeYPos;
     return true;
 }
 
@@ -694,60 +1139,122 @@ int execStormItemBackgroundThread(SnowFlake* flake) {
  **
  **    0 < type <= SNOWFLAKEMAXTYPE.
  **/
-SnowFlake* MakeFlake(int type) {
+int MakeFlake(int type) {
 
     static int mDebugSnowWhatFlake = 5;
 
+    lockFlakePool();
+
     mGlobal.FlakeCount++;
-    SnowFlake *flake = (SnowFlake *) malloc(sizeof(SnowFlake));
+    mFlakesSpawnedTotal++;
+    const int flake = flakePoolAdd(&mFlakePool);
 
     // If type < 0, create random type.
-    if (type < 0) {
-        type = Flags.VintageFlakes ?
-            drand48() * NFlakeTypesVintage :
-            NFlakeTypesVintage + (drand48() *
-                (MaxFlakeTypes - NFlakeTypesVintage));
-    }
-    flake->whatFlake = type;
+    mFlakePool.whatFlake[flake] = (type < 0) ?
+        getRandomFlakeType() : (unsigned int) type;
 
     // Crashes this way
-    if ((int) flake->whatFlake < 0) {
-        if (mDebugSnowWhatFlake-- > 0) {
-            printf("snow.c: MakeFlake(%lu) "
-                "Has invalid negative type : %i.\n",
-                (unsigned long) pthread_self(),
-                (int) flake->whatFlake);
-        }
-    }
-    if ((int) flake->whatFlake >= MaxFlakeTypes) {
+    if ((int) mFlakePool.whatFlake[flake] >= MaxFlakeTypes) {
         if (mDebugSnowWhatFlake-- > 0) {
             printf("snow.c: MakeFlake(%lu) "
                 "Has invalid positive type : %i.\n",
                 (unsigned long) pthread_self(),
-                (int) flake->whatFlake);
+                (int) mFlakePool.whatFlake[flake]);
         }
     }
 
     InitFlake(flake);
 
-    addMethodWithArgToMainloop(PRIORITY_HIGH, time_snowflakes,
-        (GSourceFunc) execStormItemBackgroundThread, flake);
-
+    unlockFlakePool();
     return flake;
 }
 
+/***********************************************************
+ ** This method sets motion & cyclic state of a flake
+ ** just made by MakeFlake().
+ **/
+void setFlakeMotion(int flake, float rx, float ry,
+    float vx, float vy, bool cyclic) {
+    lockFlakePool();
+    mFlakePool.rx[flake] = rx;
+    mFlakePool.ry[flake] = ry;
+    mFlakePool.vx[flake] = vx;
+    mFlakePool.vy[flake] = vy;
+    mFlakePool.contactIn[flake] = 0;
+    flakePoolSetState(&mFlakePool, flake, FLAKE_CYCLIC, cyclic);
+    unlockFlakePool();
+}
+
+/***********************************************************
+ ** This method spawns random flakes in motion, for avalanches
+ ** and blow-off bursts. Their slots are reserved together,
+ ** under one lock.
+ **/
+void spawnFlakesBulk(const FlakeSpawn* spawns, int n) {
+    if (n <= 0) {
+        return;
+    }
+
+    lockFlakePool();
+
+    const int first = flakePoolAddRange(&mFlakePool, n);
+    mGlobal.FlakeCount += n;
+    mFlakesSpawnedTotal += n;
+
+    for (int i = first; i < first + n; i++) {
+        mFlakePool.whatFlake[i] = getRandomFlakeType();
+        InitFlake(i);
+    }
+
+    // Motion of the whole range, in plain strided loops.
+    float* rx = &mFlakePool.rx[first];
+    float* ry = &mFlakePool.ry[first];
+    float* vx = &mFlakePool.vx[first];
+    float* vy = &mFlakePool.vy[first];
+    unsigned char* state = &mFlakePool.state[first];
+    for (int i = 0; i < n; i++) {
+        rx[i] = spawns[i].rx;
+        ry[i] = spawns[i].ry;
+        vx[i] = spawns[i].vx;
+        vy[i] = spawns[i].vy;
+        state[i] = spawns[i].cyclic ? FLAKE_CYCLIC : 0;
+    }
+
+    unlockFlakePool();
+}
+
+/***********************************************************
+ ** These methods collect a burst of spawns, and spawn them
+ ** a batch at a time.
+ **/
+void initFlakeSpawnBatch(FlakeSpawnBatch* batch) {
+    batch->count = 0;
+}
+
+FlakeSpawn* addFlakeSpawn(FlakeSpawnBatch* batch) {
+    if (batch->count == FLAKE_SPAWN_BATCH) {
+        flushFlakeSpawnBatch(batch);
+    }
+    return &batch->items[batch->count++];
+}
+
+void flushFlakeSpawnBatch(FlakeSpawnBatch* batch) {
+    spawnFlakesBulk(batch->items, batch->count);
+    batch->count = 0;
+}
+
 /***********************************************************
  ** This method ...
  **/
-void eraseStormItem(SnowFlake *flake) {
+void eraseStormItem(int flake) {
     if (mGlobal.isDoubleBuffered) {
         return;
     }
 
-    int x = flake->ix - 1;
-    int y = flake->iy - 1;
-    int flakew = snowPix[flake->whatFlake].width + 2;
-    int flakeh = snowPix[flake->whatFlake].height + 2;
+    int x = mFlakePool.ix[flake] - 1;
+    int y = mFlakePool.iy[flake] - 1;
+    int flakew = snowPix[mFlakePool.whatFlake[flake]].width + 2;
+    int flakeh = snowPix[mFlakePool.whatFlake[flake]].height + 2;
 
     clearDisplayArea(mGlobal.display, mGlobal.SnowWin,
         x, y, flakew, flakeh, mGlobal.xxposures);
@@ -756,51 +1263,57 @@ void eraseStormItem(SnowFlake *flake) {
 /***********************************************************
  ** This method ...
  **/
-// a call to this function must be followed by 'return false' to remove this
-// flake from the g_timeout callback
-void removeStormItemInItemset(SnowFlake *flake) {
-    if (flake->fluff) {
-        mGlobal.FluffCount--;
-    }
-
-    set_erase(flake);
-    free(flake);
+// after this call the last flake has been moved into this
+// flake's index, the caller must not step it as the old flake.
+void removeStormItemInItemset(int flake) {
+    lockFlakePool();
+    flakePoolDelete(&mFlakePool, flake);
     mGlobal.FlakeCount--;
+    mFlakesRemovedTotal++;
+    unlockFlakePool();
 }
 
 /***********************************************************
- ** This method ...
+ ** This method returns a random flake type, vintage or not.
  **/
-void InitFlake(SnowFlake *flake) {
-    flake->color = mFlakeColor;
-
-    int flakew = snowPix[flake->whatFlake].width;
-    int flakeh = snowPix[flake->whatFlake].height;
+unsigned int getRandomFlakeType() {
+    return Flags.VintageFlakes ?
+        randomUniform() * NFlakeTypesVintage :
+        NFlakeTypesVintage + (randomUniform() *
+            (MaxFlakeTypes - NFlakeTypesVintage));
+}
 
-    flake->rx = randint(mGlobal.SnowWinWidth - flakew);
-    flake->ry = -randint(mGlobal.SnowWinHeight / 10) - flakeh;
+/***********************************************************
+ ** This method ...
+ **/
+void InitFlake(int flake) {
+    int flakew = snowPix[mFlakePool.whatFlake[flake]].width;
+    int flakeh = snowPix[mFlakePool.whatFlake[flake]].height;
+
+    if (hasOutputRects()) {
+        const OutputRect* rect = getRandomOutputRect();
+        mFlakePool.rx[flake] = rect->x + randint(rect->width - flakew);
+        mFlakePool.ry[flake] = rect->y -
+            randint(rect->height / 10) - flakeh;
+    } else {
+        mFlakePool.rx[flake] = randint(mGlobal.SnowWinWidth - flakew);
+        mFlakePool.ry[flake] = -randint(mGlobal.SnowWinHeight / 10) - flakeh;
+    }
 
-    flake->cyclic = 1;
-    flake->fluff = 0;
-    flake->flufftimer = 0;
-    flake->flufftime = 0;
+    mFlakePool.state[flake] = FLAKE_CYCLIC;
 
-    flake->m = drand48() + 0.1;
+    mFlakePool.m[flake] = randomUniform() + 0.1;
 
     if (Flags.NoWind) {
-        flake->vx = 0;
+        mFlakePool.vx[flake] = 0;
     } else {
-        flake->vx = randint(mGlobal.NewWind) / 2;
+        mFlakePool.vx[flake] = randint(mGlobal.NewWind) / 2;
     }
 
-    flake->ivy = INITIALYSPEED * sqrt(flake->m);
-    flake->vy = flake->ivy;
-
-    flake->wsens = drand48() * MAXWSENS;
-    flake->testing = 0;
-    flake->freeze = 0;
+    mFlakePool.ivy[flake] = INITIALYSPEED * sqrt(mFlakePool.m[flake]);
+    mFlakePool.vy[flake] = mFlakePool.ivy[flake];
 
-    set_insert(flake);
+    mFlakePool.wsens[flake] = randomUniform() * MAXWSENS;
 }
 
 /***********************************************************
@@ -852,20 +1365,19 @@ int setKillFlakes() {
 }
 
 /***********************************************************
- ** This method ...
+ ** This method generates a random flake sprite with
+ ** dimensions wxh. The flake is rotated, so the w and h of
+ ** the resulting sprite differ from the input w and h.
  **/
-// generate random xpm for flake with dimensions wxh
-// the flake will be rotated, so the w and h of the resulting xpm will
-// be different from the input w and h.
-
-void genxpmflake(char ***xpm, int w, int h) {
-    const char c = '.'; // imposed by xpm_set_color
-
+void genFlakeSprite(IndexedSprite* sprite, int w, int h) {
     int nmax = w * h;
     float *x, *y;
 
-    x = (float *)malloc(nmax * sizeof(float));
-    y = (float *)malloc(nmax * sizeof(float));
+    const ScratchMark mark = scratch_mark();
+    x = (float *)scratch_alloc(nmax * sizeof(float));
+    y = (float *)scratch_alloc(nmax * sizeof(float));
+    MALLOC_CHECK(x);
+    MALLOC_CHECK(y);
 
     int i, j;
     float w2 = 0.5 * w;
@@ -888,7 +1400,7 @@ void genxpmflake(char ***xpm, int w, int h) {
             float px = 2 * xx / w;
             float p = 1.1 - (px * py);
             // printf("%d %d %f %f %f %f %f\n",j,i,y,x,px,py,p);
-            if (drand48() > p) {
+            if (randomUniform() > p) {
                 if (n < nmax) {
                     y[n] = i - w2;
                     x[n] = j - h2;
@@ -898,10 +1410,12 @@ void genxpmflake(char ***xpm, int w, int h) {
         }
     }
     // rotate points with a random angle 0 .. pi
-    float a = drand48() * 355.0 / 113.0;
+    float a = randomUniform() * 355.0 / 113.0;
     float *xa, *ya;
-    xa = (float *)malloc(n * sizeof(float));
-    ya = (float *)malloc(n * sizeof(float));
+    xa = (float *)scratch_alloc(n * sizeof(float));
+    ya = (float *)scratch_alloc(n * sizeof(float));
+    MALLOC_CHECK(xa);
+    MALLOC_CHECK(ya);
 
     for (i = 0; i < n; i++) {
         xa[i] = x[i] * cosf(a) - y[i] * sinf(a);
@@ -937,37 +1451,17 @@ void genxpmflake(char ***xpm, int w, int h) {
     }
     assert(nh > 0);
 
-    *xpm = (char **)malloc((nh + 3) * sizeof(char *));
-    char **X = *xpm;
-
-    X[0] = (char *)malloc(80 * sizeof(char));
-    snprintf(X[0], 80, "%d %d 2 1", nw, nh);
-
-    X[1] = strdup("  c None");
-    X[2] = (char *)malloc(80 * sizeof(char));
-    snprintf(X[2], 80, "%c c black", c);
-
-    int offset = 3;
-    assert(nw >= 0);
-    for (i = 0; i < nh; i++) {
-        X[i + offset] = (char *)malloc((nw + 1) * sizeof(char));
-    }
-
-    for (i = 0; i < nh; i++) {
-        for (j = 0; j < nw; j++) {
-            X[i + offset][j] = ' ';
-        }
-        X[i + offset][nw] = 0;
-    }
-
+    unsigned char* pixels = (unsigned char*) calloc(nw * nh, 1);
+    MALLOC_CHECK(pixels);
     for (i = 0; i < n; i++) {
-        X[offset + (int)(ya[i] - ymin)][(int)(xa[i] - xmin)] = c;
+        pixels[(int)(ya[i] - ymin) * nw + (int)(xa[i] - xmin)] = 1;
     }
 
-    free(x);
-    free(y);
-    free(xa);
-    free(ya);
+    sprite->width = nw;
+    sprite->height = nh;
+    sprite->pixels = pixels;
+
+    scratch_release(mark);
 }
 
 /***********************************************************
@@ -977,62 +1471,76 @@ void add_random_flakes(int n) {
     if (n < 1) {
         n = 1;
     }
+    // A flake stores its type in 16 bits.
+    n = MIN(n, FLAKE_TYPES_MAX - NFlakeTypesVintage);
 
-    // create a new array with snow-xpm's:
-    if (plasmasnow_xpm) {
-        for (int i = 0; i < MaxFlakeTypes; i++) {
-            xpm_destroy(plasmasnow_xpm[i]);
+    // create a new array of flake sprites:
+    if (mFlakeSprites) {
+        for (int i = NFlakeTypesVintage; i < MaxFlakeTypes; i++) {
+            free((void*) mFlakeSprites[i].pixels);
         }
-        free(plasmasnow_xpm);
+        free(mFlakeSprites);
     }
 
-    char ***x;
-    x = (char***) malloc((n + NFlakeTypesVintage + 1) * sizeof(char**));
-    int lines;
+    IndexedSprite* x = (IndexedSprite*) malloc(
+        (n + NFlakeTypesVintage) * sizeof(IndexedSprite));
+    MALLOC_CHECK(x);
 
-    // copy Rick's vintage flakes:
+    // Rick's vintage flakes, decoded at build time:
     for (int i = 0; i < NFlakeTypesVintage; i++) {
-        xpm_set_color((char **)snow_xpm[i], &x[i], &lines, "snow");
+        x[i] = snow_sprites[i];
     }
 
     // add n flakes:
     for (int i = 0; i < n; i++) {
         int m = Flags.SnowSize;
-        int w = m + m * drand48();
-        int h = m + m * drand48();
-        genxpmflake(&x[i + NFlakeTypesVintage], w, h);
+        int w = m + m * randomUniform();
+        int h = m + m * randomUniform();
+        genFlakeSprite(&x[i + NFlakeTypesVintage], w, h);
     }
 
     MaxFlakeTypes = n + NFlakeTypesVintage;
-    x[MaxFlakeTypes] = NULL;
-    plasmasnow_xpm = x;
+    mFlakeSprites = x;
 }
 
 /***********************************************************
- ** This method ...
+ ** This method turns a flake into debris, that fades out
+ ** over t seconds, drifting on or frozen in place. The flake
+ ** is removed.
+ ** threads: locking by caller
  **/
-void fluffify(SnowFlake *flake, float t) {
-    if (flake->fluff) {
-        return;
-    }
-    flake->fluff = 1;
+void fluffify(int flake, float t, bool isFrozen) {
+    eraseStormItem(flake);
+    addDebris(mFlakePool.rx[flake], mFlakePool.ry[flake],
+        isFrozen ? 0 : mFlakePool.vx[flake],
+        isFrozen ? 0 : mFlakePool.vy[flake],
+        t, mFlakePool.whatFlake[flake]);
+
+    removeStormItemInItemset(flake);
+}
 
-    flake->flufftimer = 0;
-    if (t > 0.01) {
-        flake->flufftime = t;
-    } else {
-        flake->flufftime = 0.01;
+/***********************************************************
+ ** This method adds debris, if it can be drawn. Shorter
+ ** fluff lifetimes at lower quality.
+ ** threads: locking by caller
+ **/
+void addDebris(float x, float y, float vx, float vy,
+    float t, unsigned int whatFlake) {
+    if (!mGlobal.isDoubleBuffered) {
+        return;
     }
 
-    mGlobal.FluffCount++;
+    debrisPoolAdd(&mDebrisPool, x, y, vx, vy,
+        t * getQualityFluffTimeFactor(), whatFlake);
 }
 
 /***********************************************************
  ** This method ...
  **/
-void printflake(SnowFlake *flake) {
-    printf("flake: %p rx: %6.0f ry: %6.0f vx: %6.0f vy: %6.0f ws: %6.0f fluff: "
-           "%d freeze: %d ftr: %8.3f ft: %8.3f\n",
-        (void *)flake, flake->rx, flake->ry, flake->vx, flake->vy, flake->wsens,
-        flake->fluff, flake->freeze, flake->flufftimer, flake->flufftime);
+void printflake(int flake) {
+    printf("flake: %d rx: %6.0f ry: %6.0f vx: %6.0f vy: %6.0f ws: %6.0f "
+           "type: %d\n",
+        flake, mFlakePool.rx[flake], mFlakePool.ry[flake],
+        mFlakePool.vx[flake], mFlakePool.vy[flake], mFlakePool.wsens[flake],
+        mFlakePool.whatFlake[flake]);
 }
@@ -21,18 +21,47 @@
 */
 #pragma once
 
+#include "ixpm.h"
 #include "plasmasnow.h"
 #include <gtk/gtk.h>
 
+// Flakes spawned in one bulk call, at most.
+#define FLAKE_SPAWN_BATCH 256
+
+// A random flake to spawn in motion.
+typedef struct _FlakeSpawn {
+        float rx, ry;
+        float vx, vy;
+        bool cyclic;
+} FlakeSpawn;
+
+// Spawns collected by a burst, flushed a batch at a time.
+typedef struct _FlakeSpawnBatch {
+        FlakeSpawn items[FLAKE_SPAWN_BATCH];
+        int count;
+} FlakeSpawnBatch;
+
 int setKillFlakes();
-SnowFlake* MakeFlake(int type);
+int MakeFlake(int type);
+void setFlakeMotion(int flake, float rx, float ry,
+    float vx, float vy, bool cyclic);
+
+void spawnFlakesBulk(const FlakeSpawn* spawns, int n);
+void initFlakeSpawnBatch(FlakeSpawnBatch* batch);
+FlakeSpawn* addFlakeSpawn(FlakeSpawnBatch* batch);
+void flushFlakeSpawnBatch(FlakeSpawnBatch* batch);
 
 int snow_draw(cairo_t *cr);
+void drawLodFlakes(cairo_t* cr, bool isOccluding);
+void drawFlakeSprite(cairo_t* cr, bool isTiled,
+    unsigned int whatFlake, int x, int y, int alphaLevel);
 void snow_init();
 void snow_ui();
 
-void fluffify(SnowFlake *flake, float t);
-void printflake(SnowFlake *flake);
+void fluffify(int flake, float t, bool isFrozen);
+void addDebris(float x, float y, float vx, float vy,
+    float t, unsigned int whatFlake);
+void printflake(int flake);
 int removeAllStormItemsInItemset();
 
 void setGlobalFlakeColor(GdkRGBA);
@@ -42,22 +71,36 @@ GdkRGBA getRGBFromString(char* colorString);
 
 int execStormBackgroundThread();
 
-void InitFlake(SnowFlake *flake);
+void addFlakeSystemTickToMainloop();
+int execFlakeSystemTick();
+void integrateFlakeVelocities(double dt);
+void rearmFlakeContacts();
+int getContactTreeTop(int x0, int x1);
+float getFlakeContactTime(int flake, int flakew, int flakeh);
+void getFlakeTotals(unsigned long* spawned, unsigned long* removed);
+
+void lockFlakePool();
+void unlockFlakePool();
+
+unsigned int getRandomFlakeType();
+void InitFlake(int flake);
 void InitFlakesPerSecond();
 void InitSnowColor();
 void InitSnowSpeedFactor();
 
 void init_snow_pix();
+void initFlakeAtlas();
 
-void genxpmflake(char ***xpm, int w, int h);
+void genFlakeSprite(IndexedSprite* sprite, int w, int h);
 void add_random_flakes(int n);
 
-void removeStormItemInItemset(SnowFlake* flake);
-void eraseStormItem(SnowFlake* flake);
+void removeStormItemInItemset(int flake);
+void eraseStormItem(int flake);
 
 void SetSnowSize();
 
-void updateFallenSurfacesWithFlake(SnowFlake* flake,
+bool updateFallenSurfacesWithFlake(int flake,
     int xPosition, int yPosition, int flakeWidth);
 
-int execStormItemBackgroundThread(SnowFlake* flake);
+int execStormItemBackgroundThread(int flake,
+    double flakesDT);
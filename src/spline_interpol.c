@@ -18,25 +18,184 @@
 #-# You should have received a copy of the GNU General Public License
 #-# along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #-# 
- * */
-#define GSL_INTERP_MESSAGE
+*/
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "safe_malloc.h"
 #include "spline_interpol.h"
-#include "debug.h"
-#include <gsl/gsl_errno.h>
-#include <gsl/gsl_spline.h>
-#include <pthread.h>
 
+
+/** *********************************************************************
+ ** SplineWorkspace lifecycle methods.
+ **/
+void splineWorkspaceInit(SplineWorkspace* ws, int capacity) {
+    memset(ws, 0, sizeof(SplineWorkspace));
+    splineWorkspaceResize(ws, capacity);
+}
+
+void splineWorkspaceResize(SplineWorkspace* ws, int capacity) {
+    if (capacity <= ws->mCapacity) {
+        return;
+    }
+
+    #define SPLINEWORKSPACE_RESIZE(array) \
+        ws->array = realloc(ws->array, \
+            sizeof(*ws->array) * capacity); \
+        REALLOC_CHECK(ws->array);
+
+    SPLINEWORKSPACE_RESIZE(x);
+    SPLINEWORKSPACE_RESIZE(y);
+    SPLINEWORKSPACE_RESIZE(a);
+    SPLINEWORKSPACE_RESIZE(b);
+    SPLINEWORKSPACE_RESIZE(c);
+
+    #undef SPLINEWORKSPACE_RESIZE
+
+    ws->mCapacity = capacity;
+}
+
+void splineWorkspaceFree(SplineWorkspace* ws) {
+    free(ws->x);
+    free(ws->y);
+    free(ws->a);
+    free(ws->b);
+    free(ws->c);
+    memset(ws, 0, sizeof(SplineWorkspace));
+}
+
+/** *********************************************************************
+ ** This method computes cubic coefficients through the points
+ ** ws->x[0..np-1], ws->y[0..np-1] using Steffen's monotone
+ ** method (M. Steffen, Astron. Astrophys. 239, 443-450, 1990),
+ ** the same curve gsl_interp_steffen produces, without overshoots.
+ **
+ ** x must be strictly increasing.
+ **/
+static double steffenSign(double v) {
+    return v < 0 ? -1.0 : 1.0;
+}
+
+void splineWorkspaceBuild(SplineWorkspace* ws, int np) {
+    ws->mPointCount = np;
+    ws->mSegment = 0;
+    if (np < 2) {
+        return;
+    }
+
+    // Slopes at the points, simplest choice at both ends.
+    // Store them in c[] for now, c[i] is also the linear term.
+    double* slope = ws->c;
+    slope[0] = (ws->y[1] - ws->y[0]) / (ws->x[1] - ws->x[0]);
+    for (int i = 1; i < np - 1; i++) {
+        const double hPrev = ws->x[i] - ws->x[i - 1];
+        const double h = ws->x[i + 1] - ws->x[i];
+        const double sPrev = (ws->y[i] - ws->y[i - 1]) / hPrev;
+        const double s = (ws->y[i + 1] - ws->y[i]) / h;
+        const double p = (sPrev * h + s * hPrev) / (hPrev + h);
+
+        slope[i] = (steffenSign(sPrev) + steffenSign(s)) *
+            fmin(fabs(sPrev), fmin(fabs(s), 0.5 * fabs(p)));
+    }
+    slope[np - 1] = (ws->y[np - 1] - ws->y[np - 2]) /
+        (ws->x[np - 1] - ws->x[np - 2]);
+
+    for (int i = 0; i < np - 1; i++) {
+        const double h = ws->x[i + 1] - ws->x[i];
+        const double s = (ws->y[i + 1] - ws->y[i]) / h;
+        ws->a[i] = (slope[i] + slope[i + 1] - 2 * s) / (h * h);
+        ws->b[i] = (3 * s - 2 * slope[i] - slope[i + 1]) / h;
+    }
+}
+
+/** *********************************************************************
+ ** This method evaluates the spline at xi. The segment cursor
+ ** only walks forward from the previous call, so increasing xi
+ ** sequences cost O(1) each. Outside [x0, xn] the end segments
+ ** are extrapolated.
+ **/
+double splineWorkspaceEval(SplineWorkspace* ws, double xi) {
+    const int np = ws->mPointCount;
+    if (np < 2) {
+        return np == 1 ? ws->y[0] : 0;
+    }
+
+    int seg = ws->mSegment;
+    if (xi < ws->x[seg]) {
+        seg = 0;
+    }
+    while (seg < np - 2 && xi >= ws->x[seg + 1]) {
+        seg++;
+    }
+    ws->mSegment = seg;
+
+    const double dx = xi - ws->x[seg];
+    return ws->y[seg] + dx * (ws->c[seg] +
+        dx * (ws->b[seg] + dx * ws->a[seg]));
+}
+
+/** *********************************************************************
+ ** This method evaluates scale times the spline at columns
+ ** 0 .. count - 1 into out, truncated and at least minValue.
+ ** One pass per segment with no cursor or branches in the
+ ** inner loop, so the compiler can vectorize it.
+ **/
+void splineWorkspaceEvalColumns(const SplineWorkspace* ws,
+    double scale, double minValue, short int* out, int count) {
+
+    const int np = ws->mPointCount;
+    if (np < 2) {
+        const double value = fmax(scale *
+            (np == 1 ? ws->y[0] : 0), minValue);
+        for (int i = 0; i < count; i++) {
+            out[i] = (short int) value;
+        }
+        return;
+    }
+
+    int start = 0;
+    for (int seg = 0; seg < np - 1 && start < count; seg++) {
+        // Columns before the next knot, the rest for the last.
+        int end = (seg == np - 2) ? count :
+            (int) ceil(ws->x[seg + 1]);
+        if (end > count) {
+            end = count;
+        }
+
+        const double x0 = ws->x[seg];
+        const double y = ws->y[seg];
+        const double a = ws->a[seg];
+        const double b = ws->b[seg];
+        const double c = ws->c[seg];
+        for (int i = start; i < end; i++) {
+            const double dx = i - x0;
+            out[i] = (short int) fmax(scale *
+                (y + dx * (c + dx * (b + dx * a))), minValue);
+        }
+
+        if (end > start) {
+            start = end;
+        }
+    }
+}
+
+/** *********************************************************************
+ ** This method interpolates y[0..nx-1] at x[0..nx-1] through
+ ** the points (px, py).
+ **/
 void spline_interpol(const double *px, int np, const double *py,
     const double *x, int nx, double *y) {
-    int i;
-    gsl_interp_accel *acc = gsl_interp_accel_alloc();
-    gsl_spline *spline = gsl_spline_alloc(SPLINE_INTERP, np);
-    gsl_spline_init(spline, px, py, np);
+    SplineWorkspace ws;
+    splineWorkspaceInit(&ws, np);
+
+    memcpy(ws.x, px, np * sizeof(double));
+    memcpy(ws.y, py, np * sizeof(double));
+    splineWorkspaceBuild(&ws, np);
 
-    for (i = 0; i < nx; i++) {
-        y[i] = gsl_spline_eval(spline, x[i], acc);
+    for (int i = 0; i < nx; i++) {
+        y[i] = splineWorkspaceEval(&ws, x[i]);
     }
 
-    gsl_spline_free(spline);
-    gsl_interp_accel_free(acc);
+    splineWorkspaceFree(&ws);
 }
@@ -22,6 +22,7 @@
 #pragma once
 #include "config.h"
 
+// Interpolation type for the remaining GSL users (Aurora).
 #ifdef HAVE_GSL_INTERP_STEFFEN
 // steffen's method prevent overshoots:
 #define SPLINE_INTERP gsl_interp_steffen
@@ -48,5 +49,35 @@
 #define SPLINE_INTERP gsl_interp_linear
 #endif
 
+/***********************************************************
+ * Monotone cubic (Steffen) spline, no GSL needed.
+ * Coefficients per segment i, with dx = x - x[i]:
+ *     y[i] + dx * (c[i] + dx * (b[i] + dx * a[i]))
+ */
+typedef struct _SplineWorkspace {
+        int mCapacity;   // allocated points.
+        int mPointCount; // points in use.
+        int mSegment;    // eval cursor.
+
+        double* x;       // knot positions.
+        double* y;       // knot values.
+        double* a;       // cubic terms.
+        double* b;       // quadratic terms.
+        double* c;       // linear terms.
+} SplineWorkspace;
+
+
+/***********************************************************
+ * Module Method stubs.
+ */
+void splineWorkspaceInit(SplineWorkspace*, int capacity);
+void splineWorkspaceResize(SplineWorkspace*, int capacity);
+void splineWorkspaceFree(SplineWorkspace*);
+
+void splineWorkspaceBuild(SplineWorkspace*, int np);
+double splineWorkspaceEval(SplineWorkspace*, double xi);
+void splineWorkspaceEvalColumns(const SplineWorkspace*,
+    double scale, double minValue, short int* out, int count);
+
 void spline_interpol(const double *p, int np, const double *py, const double *x,
     int nx, double *y);
@@ -23,6 +23,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <X11/Intrinsic.h>
 
@@ -31,6 +32,7 @@
 #include "Blowoff.h"
 #include "debug.h"
 #include "Flags.h"
+#include "OccupancyMask.h"
 #include "plasmasnow.h"
 #include "safe_malloc.h"
 #include "scenery.h"
@@ -44,9 +46,22 @@
 static int do_snow_on_trees();
 static void ConvertOnTreeToFlakes(void);
 
+// Bit masks of tree and snow-on-tree pixels, for the flake
+// hit tests. Snow on trees is also stamped into an A8 layer
+// as it lands, drawn with one mask blit.
+static OccupancyMask mTreeMask;
+static OccupancyMask mSnowOnTreesMask;
+static cairo_surface_t* mSnowOnTreesLayer = NULL;
+
+// Snow color, parsed again only when the flag changes.
+static char* mSnowOnTreesColorName = NULL;
+static GdkRGBA mSnowOnTreesColor;
+
 void treesnow_init() {
-    mGlobal.gSnowOnTreesRegion = cairo_region_create();
-    addMethodToMainloop(PRIORITY_DEFAULT, time_snow_on_trees, do_snow_on_trees);
+    occupancyMaskInit(&mTreeMask);
+    occupancyMaskInit(&mSnowOnTreesMask);
+    reinit_treesnow_region();
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT, time_snow_on_trees, do_snow_on_trees);
 }
 
 void treesnow_draw(cairo_t *cr) {
@@ -54,11 +69,17 @@ void treesnow_draw(cairo_t *cr) {
         Flags.NoKeepSnowOnTrees || Flags.NoTrees) {
         return;
     }
-    GdkRGBA color;
-    gdk_rgba_parse(&color, Flags.SnowColor);
-    cairo_set_source_rgba(cr, color.red, color.green, color.blue, ALPHA);
-    gdk_cairo_region(cr, mGlobal.gSnowOnTreesRegion);
-    cairo_fill(cr);
+
+    if (!mSnowOnTreesColorName ||
+        strcmp(mSnowOnTreesColorName, Flags.SnowColor)) {
+        free(mSnowOnTreesColorName);
+        mSnowOnTreesColorName = strdup(Flags.SnowColor);
+        gdk_rgba_parse(&mSnowOnTreesColor, Flags.SnowColor);
+    }
+    const GdkRGBA* color = &mSnowOnTreesColor;
+    cairo_set_source_rgba(cr, color->red, color->green, color->blue, ALPHA);
+
+    cairo_mask_surface(cr, mSnowOnTreesLayer, 0, 0);
 }
 
 void treesnow_ui() {
@@ -85,27 +106,105 @@ int do_snow_on_trees() {
  * This method blows snow off trees.
  */
 void ConvertOnTreeToFlakes() {
+    FlakeSpawnBatch batch;
+    initFlakeSpawnBatch(&batch);
+
     for (int i = 0; i < mGlobal.OnTrees; i++) {
         for (int j = 0; j < 2; j++) {
             int numberOfFlakesToMake = getNumberOfFlakesToBlowoff();
             for (int k = 0; k < numberOfFlakesToMake; k++) {
-                SnowFlake* flake = MakeFlake(-1);
-                flake->rx = mGlobal.SnowOnTrees[i].x;
-                flake->ry = mGlobal.SnowOnTrees[i].y - 5 * j;
-                flake->vx = mGlobal.NewWind / 2;
-                flake->vy = 0;
-                flake->cyclic = 0;
+                FlakeSpawn* spawn = addFlakeSpawn(&batch);
+                spawn->rx = mGlobal.SnowOnTrees[i].x;
+                spawn->ry = mGlobal.SnowOnTrees[i].y - 5 * j;
+                spawn->vx = mGlobal.NewWind / 2;
+                spawn->vy = 0;
+                spawn->cyclic = false;
             }
         }
     }
 
+    flushFlakeSpawnBatch(&batch);
+
     mGlobal.OnTrees = 0;
     reinit_treesnow_region();
 }
 
 void reinit_treesnow_region() {
-    cairo_region_destroy(mGlobal.gSnowOnTreesRegion);
-    mGlobal.gSnowOnTreesRegion = cairo_region_create();
+    occupancyMaskResize(&mSnowOnTreesMask,
+        mGlobal.SnowWinWidth, mGlobal.SnowWinHeight);
+
+    // Keep the layer while the size holds, and clear it.
+    if (mSnowOnTreesLayer &&
+        cairo_image_surface_get_width(mSnowOnTreesLayer) ==
+            mGlobal.SnowWinWidth &&
+        cairo_image_surface_get_height(mSnowOnTreesLayer) ==
+            mGlobal.SnowWinHeight) {
+        cairo_surface_flush(mSnowOnTreesLayer);
+        memset(cairo_image_surface_get_data(mSnowOnTreesLayer), 0,
+            (size_t) cairo_image_surface_get_stride(mSnowOnTreesLayer) *
+            mGlobal.SnowWinHeight);
+        cairo_surface_mark_dirty(mSnowOnTreesLayer);
+        return;
+    }
+
+    // Fresh layer, cleared on creation.
+    if (mSnowOnTreesLayer) {
+        cairo_surface_destroy(mSnowOnTreesLayer);
+    }
+    mSnowOnTreesLayer = cairo_image_surface_create(CAIRO_FORMAT_A8,
+        mGlobal.SnowWinWidth, mGlobal.SnowWinHeight);
+}
+
+/***********************************************************
+ * This method remakes the tree mask from TreeRegion.
+ */
+void rebuildTreeMask() {
+    occupancyMaskResize(&mTreeMask,
+        mGlobal.SnowWinWidth, mGlobal.SnowWinHeight);
+    occupancyMaskSetRegion(&mTreeMask, mGlobal.TreeRegion);
+}
+
+/***********************************************************
+ * Hit tests for flakes, see cairo_region_contains_rectangle().
+ */
+cairo_region_overlap_t getTreeOverlap(int x, int y, int w, int h) {
+    return occupancyMaskOverlap(&mTreeMask, x, y, w, h);
+}
+
+bool isTreePixel(int x, int y) {
+    return occupancyMaskTest(&mTreeMask, x, y);
+}
+
+cairo_region_overlap_t getSnowOnTreesOverlap(int x, int y, int w, int h) {
+    return occupancyMaskOverlap(&mSnowOnTreesMask, x, y, w, h);
+}
+
+/***********************************************************
+ * This method adds snow on a tree.
+ */
+void addSnowOnTrees(cairo_rectangle_int_t* rect) {
+    occupancyMaskSetRect(&mSnowOnTreesMask,
+        rect->x, rect->y, rect->width, rect->height);
+
+    // Stamp the rows into the layer.
+    const int width = cairo_image_surface_get_width(mSnowOnTreesLayer);
+    const int height = cairo_image_surface_get_height(mSnowOnTreesLayer);
+    const int x0 = MAX(rect->x, 0);
+    const int y0 = MAX(rect->y, 0);
+    const int x1 = MIN(rect->x + rect->width, width);
+    const int y1 = MIN(rect->y + rect->height, height);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    cairo_surface_flush(mSnowOnTreesLayer);
+    unsigned char* data = cairo_image_surface_get_data(mSnowOnTreesLayer);
+    const int stride = cairo_image_surface_get_stride(mSnowOnTreesLayer);
+    for (int y = y0; y < y1; y++) {
+        memset(data + y * stride + x0, 0xff, x1 - x0);
+    }
+    cairo_surface_mark_dirty_rectangle(mSnowOnTreesLayer,
+        x0, y0, x1 - x0, y1 - y0);
 }
 
 void InitSnowOnTrees() {
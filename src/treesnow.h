@@ -22,6 +22,8 @@
 
 #pragma once
 
+#include <stdbool.h>
+
 #include <gtk/gtk.h>
 
 extern void reinit_treesnow_region(void);
@@ -29,3 +31,10 @@ extern void InitSnowOnTrees(void);
 extern void treesnow_init(void);
 extern void treesnow_draw(cairo_t *cr);
 extern void treesnow_ui(void);
+
+extern void rebuildTreeMask(void);
+extern cairo_region_overlap_t getTreeOverlap(int x, int y, int w, int h);
+extern bool isTreePixel(int x, int y);
+extern cairo_region_overlap_t getSnowOnTreesOverlap(int x, int y,
+    int w, int h);
+extern void addSnowOnTrees(cairo_rectangle_int_t *rect);
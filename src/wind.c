@@ -23,10 +23,13 @@
 #include <gtk/gtk.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "clocks.h"
 #include "debug.h"
+#include "FlakeKernels.h"
 #include "Flags.h"
+#include "Random.h"
 #include "Utils.h"
 #include "wind.h"
 #include "windows.h"
@@ -37,16 +40,25 @@ static void SetWhirl(void);
 static void SetWindTimer(void);
 static int do_wind();
 static int do_newwind();
+static void updateWindGrid(void);
+
+// Local gusts and currents on top of mGlobal.NewWind.
+#define WIND_GRID_RELAX 0.8f       // keep of a cell per update
+#define WIND_GRID_GUST 0.5f        // of Whirl, per update
+#define WIND_GRID_LIFT 0.15f       // vertical, of horizontal
+
+static WindGrid mWindGrid;
 
 void wind_init() {
     SetWhirl();
     SetWindTimer();
-    addMethodToMainloop(PRIORITY_DEFAULT, time_newwind, do_newwind);
-    addMethodToMainloop(PRIORITY_DEFAULT, time_wind, do_wind);
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT, time_newwind, do_newwind);
+    addSimulationMethodToMainloop(PRIORITY_DEFAULT, time_wind, do_wind);
 }
 
 void wind_ui() {
-    UIDO(NoWind, mGlobal.Wind = 0; mGlobal.NewWind = 0;);
+    UIDO(NoWind, mGlobal.Wind = 0; mGlobal.NewWind = 0;
+        memset(&mWindGrid, 0, sizeof(mWindGrid)););
     UIDO(WhirlFactor, SetWhirl(););
     UIDO(WhirlTimer, SetWindTimer(););
     if (Flags.WindNow) {
@@ -81,11 +93,13 @@ int do_newwind() {
         return TRUE;
     }
 
+    updateWindGrid();
+
     float r;
     switch (mGlobal.Wind) {
     case (0):
     default:
-        r = drand48() * mGlobal.Whirl;
+        r = randomUniform() * mGlobal.Whirl;
         mGlobal.NewWind += r - mGlobal.Whirl / 2;
         if (mGlobal.NewWind > mGlobal.WindMax) {
             mGlobal.NewWind = mGlobal.WindMax;
@@ -129,15 +143,15 @@ int do_wind() {
     // on the average, this function will do something
     // after WhirlTimer secs
 
-    if ((TNow - prevtime) < 2 * mGlobal.WhirlTimer * drand48()) {
+    if ((TNow - prevtime) < 2 * mGlobal.WhirlTimer * randomUniform()) {
         return TRUE;
     }
 
     prevtime = TNow;
 
-    if (drand48() > 0.65) // Now for some of Rick's magic:
+    if (randomUniform() > 0.65) // Now for some of Rick's magic:
     {
-        if (drand48() > 0.4) {
+        if (randomUniform() > 0.4) {
             mGlobal.Direction = 1;
         } else {
             mGlobal.Direction = -1;
@@ -164,6 +178,56 @@ int do_wind() {
     // (void) d;
 }
 
+/** *********************************************************************
+ ** This method moves the wind grid on: each cell relaxes
+ ** toward calm and gets a random kick, then the field is
+ ** smoothed so neighbouring cells blow alike.
+ **/
+void updateWindGrid() {
+    mWindGrid.invCellWidth = (float) WIND_GRID_COLUMNS /
+        MAX(mGlobal.SnowWinWidth, 1);
+    mWindGrid.invCellHeight = (float) WIND_GRID_ROWS /
+        MAX(mGlobal.SnowWinHeight, 1);
+
+    const float gust = WIND_GRID_GUST * mGlobal.Whirl;
+    for (int row = 0; row < WIND_GRID_ROWS; row++) {
+        for (int col = 0; col < WIND_GRID_COLUMNS; col++) {
+            mWindGrid.wx[row][col] = WIND_GRID_RELAX *
+                mWindGrid.wx[row][col] + gust * (randomUniform() - 0.5);
+            mWindGrid.wy[row][col] = WIND_GRID_RELAX *
+                mWindGrid.wy[row][col] + WIND_GRID_LIFT * gust *
+                (randomUniform() - 0.5);
+        }
+    }
+
+    // 3x3 box blur, edges clamped.
+    WindGrid blurred = mWindGrid;
+    for (int row = 0; row < WIND_GRID_ROWS; row++) {
+        for (int col = 0; col < WIND_GRID_COLUMNS; col++) {
+            float sumX = 0;
+            float sumY = 0;
+            for (int dr = -1; dr <= 1; dr++) {
+                const int r = CLAMP(row + dr, 0, WIND_GRID_ROWS - 1);
+                for (int dc = -1; dc <= 1; dc++) {
+                    const int c = CLAMP(col + dc, 0, WIND_GRID_COLUMNS - 1);
+                    sumX += mWindGrid.wx[r][c];
+                    sumY += mWindGrid.wy[r][c];
+                }
+            }
+            blurred.wx[row][col] = sumX / 9;
+            blurred.wy[row][col] = sumY / 9;
+        }
+    }
+    mWindGrid = blurred;
+}
+
+/** *********************************************************************
+ ** This method returns the wind grid, for the flake kernel.
+ **/
+const WindGrid* getWindGrid() {
+    return &mWindGrid;
+}
+
 void SetWhirl() { mGlobal.Whirl = 0.01 * Flags.WhirlFactor * WHIRL; }
 
 void SetWindTimer() {
@@ -21,5 +21,8 @@
  */
 #pragma once
 
+#include "FlakeKernels.h"
+
 extern void wind_init(void);
 extern void wind_ui(void);
+extern const WindGrid* getWindGrid(void);
@@ -23,6 +23,9 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include <X11/Intrinsic.h>
 #include <X11/extensions/Xinerama.h>
@@ -30,20 +33,27 @@
 #include <gdk/gdkx.h>
 #include <gtk/gtk.h>
 
+#include "clientwin.h"
 #include "ColorCodes.h"
 #include "dsimple.h"
 #include "FallenSnow.h"
 #include "Flags.h"
+#include "FrameDamage.h"
 #include "MsgBox.h"
 #include "mygettext.h"
+#include "Occlusion.h"
+#include "Outputs.h"
 #include "plasmasnow.h"
 #include "safe_malloc.h"
 #include "scenery.h"
+#include "ShmPresent.h"
 #include "StormWindow.h"
 #include "Utils.h"
 #include "windows.h"
 #include "WinInfo.h"
+#include "XAtoms.h"
 #include "xdo.h"
+#include "XTraffic.h"
 
 
 /***********************************************************
@@ -61,11 +71,25 @@ Window mActiveAppDragWindowCandidate = None;
 
 int mUpdateWindowsLockCounter = 0;
 
+// Set by a workspace PropertyNotify on the root.
+bool mWorkspaceChanged = false;
+
 Window mActiveAppWindow = None;
 const int mINVALID_POSITION = -1;
 int mActiveAppXPos = mINVALID_POSITION;
 int mActiveAppYPos = mINVALID_POSITION;
 
+// Last position of the dragged window, its snow follows.
+int mDragWindowXPos = mINVALID_POSITION;
+int mDragWindowYPos = mINVALID_POSITION;
+
+// Converted background image on the server, and its key.
+Pixmap mBackgroundPixmap = None;
+char* mBackgroundFile = NULL;
+time_t mBackgroundFileTime = 0;
+int mBackgroundWidth = 0;
+int mBackgroundHeight = 0;
+
 
 /** *********************************************************************
  ** This method ...
@@ -80,7 +104,7 @@ void addWindowsModuleToMainloop() {
     }
 
     if (!mGlobal.isDoubleBuffered) {
-        addMethodToMainloop(PRIORITY_DEFAULT, time_sendevent,
+        addSimulationMethodToMainloop(PRIORITY_DEFAULT, time_sendevent,
             do_sendevent);
     }
 }
@@ -104,23 +128,28 @@ int WorkspaceActive() {
 }
 
 /** *********************************************************************
- ** This method ...
+ ** This method exposes only what frames cleared since the
+ ** last call, instead of the whole window.
  **/
 int do_sendevent() {
-    XExposeEvent event;
-    event.type = Expose;
-
-    event.send_event = True;
-    event.display = mGlobal.display;
-    event.window = mGlobal.SnowWin;
+    sendExposeDamage(mGlobal.display, mGlobal.SnowWin);
+    return TRUE;
+}
 
-    event.x = 0;
-    event.y = 0;
-    event.width = mGlobal.SnowWinWidth;
-    event.height = mGlobal.SnowWinHeight;
+/** *********************************************************************
+ ** This method notes a root property change that may be a
+ ** workspace switch, for updateWindowsList() to read.
+ **/
+void onRootPropertyChanged(XEvent* event) {
+    if (event->xproperty.window != mGlobal.Rootwindow) {
+        return;
+    }
 
-    XSendEvent(mGlobal.display, mGlobal.SnowWin, True, Expose, (XEvent *) &event);
-    return TRUE;
+    const Atom atom = event->xproperty.atom;
+    if (atom == getXAtom(ATOM_NET_CURRENT_DESKTOP) ||
+        atom == getXAtom(ATOM_NET_DESKTOP_VIEWPORT)) {
+        mWorkspaceChanged = true;
+    }
 }
 
 /** *********************************************************************
@@ -151,7 +180,7 @@ void getCurrentWorkspaceData() {
         valuemask = CWBackPixel | CWBorderPixel | CWEventMask;
         class_hints.res_name = (char*) "plasmasnow";
         class_hints.res_class = (char*) "plasmasnow";
-        motif_hints = XInternAtom(mGlobal.display, "_MOTIF_WM_HINTS", False);
+        motif_hints = getXAtom(ATOM_MOTIF_WM_HINTS);
         wmsize.flags = USPosition | USSize;
     }
 
@@ -286,10 +315,12 @@ void initDisplayDimensions() {
     mGlobal.Hroot = h;
 
     updateDisplayDimensions();
+    clearAndRedrawScenery();
 }
 
 /** *********************************************************************
- ** This method ...
+ ** This method reads the snow window size. Scenery is left
+ ** to the caller, to rebuild or rescale.
  **/
 void updateDisplayDimensions() {
     lockFallenSnowSemaphore();
@@ -313,8 +344,8 @@ void updateDisplayDimensions() {
     mGlobal.SnowWinBorderWidth = b;
     mGlobal.SnowWinDepth = d;
 
+    updateOutputRects();
     updateFallenSnowDesktopItemHeight();
-    clearAndRedrawScenery();
     updateFallenSnowDesktopItemDepth();
 
     if (!mGlobal.isDoubleBuffered) {
@@ -325,7 +356,9 @@ void updateDisplayDimensions() {
 }
 
 /** *********************************************************************
- ** This method sets OS desktop background
+ ** This method sets OS desktop background. The converted
+ ** image stays on the server as a pixmap, reused while the
+ ** file, its mtime and the window size stay the same.
  **/
 void SetBackground() {
     char *f = Flags.BackgroundFile;
@@ -340,58 +373,70 @@ void SetBackground() {
 
     int w = mGlobal.SnowWinWidth;
     int h = mGlobal.SnowWinHeight;
+
+    // Gone since the check above, keep what is shown.
+    struct stat fileStat;
+    if (stat(f, &fileStat) != 0) {
+        return;
+    }
+    if (mBackgroundPixmap != None && mBackgroundFile &&
+        !strcmp(mBackgroundFile, f) &&
+        mBackgroundFileTime == fileStat.st_mtime &&
+        mBackgroundWidth == w && mBackgroundHeight == h) {
+        XSetWindowBackgroundPixmap(display, window, mBackgroundPixmap);
+        return;
+    }
+
     GdkPixbuf* pixbuf = gdk_pixbuf_new_from_file_at_scale(
         f, w, h, FALSE, NULL);
     if (!pixbuf) {
         return;
     }
 
-    // pixels1 is freed by XDestroyImage.
-    int n_channels = gdk_pixbuf_get_n_channels(pixbuf);
-    guchar* pixels = gdk_pixbuf_get_pixels(pixbuf);
-    unsigned char* pixels1 = (unsigned char *)
-        malloc(w * h * 4 * sizeof(unsigned char));
-
-    const int ROW_STRIDE = gdk_pixbuf_get_rowstride(pixbuf);
-    if (is_little_endian()) {
-        for (int k = 0, i = 0; i < h; i++) {
-            for (int j = 0; j < w; j++) {
-                guchar *p = &pixels[i * ROW_STRIDE + j * n_channels];
-                pixels1[k++] = p[2];
-                pixels1[k++] = p[1];
-                pixels1[k++] = p[0];
-                pixels1[k++] = 0xff;
-            }
-        }
-    } else {
-        for (int k = 0, i = 0; i < h; i++) {
-            for (int j = 0; j < w; j++) {
-                guchar *p = &pixels[i * ROW_STRIDE + j * n_channels];
-                pixels1[k++] = 0xff;
-                pixels1[k++] = p[0];
-                pixels1[k++] = p[1];
-                pixels1[k++] = p[2];
-            }
-        }
+    // Let cairo (pixman) swizzle to xRGB in host order.
+    cairo_surface_t* surface = cairo_image_surface_create(
+        CAIRO_FORMAT_RGB24, w, h);
+    cairo_t* cr = cairo_create(surface);
+    gdk_cairo_set_source_pixbuf(cr, pixbuf, 0, 0);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    g_object_unref(pixbuf);
+
+    cairo_surface_flush(surface);
+    unsigned char* pixels = cairo_image_surface_get_data(surface);
+    const int stride = cairo_image_surface_get_stride(surface);
+
+    if (mBackgroundPixmap != None) {
+        XFreePixmap(display, mBackgroundPixmap);
     }
+    mBackgroundPixmap = XCreatePixmap(display, window, w, h, depth);
+    GC gc = XCreateGC(display, mBackgroundPixmap, 0, 0);
 
-    XImage* ximage = XCreateImage(display,
-        DefaultVisual(display, screen_num),
-        depth, ZPixmap, 0, (char *) pixels1, w, h,
-        XBitmapPad(display), 0);
-    XInitImage(ximage);
+    if (!putImageThroughShm(display, mBackgroundPixmap, gc,
+        pixels, stride, w, h)) {
+        XImage* ximage = XCreateImage(display,
+            DefaultVisual(display, screen_num),
+            depth, ZPixmap, 0, (char *) pixels, w, h,
+            XBitmapPad(display), stride);
+        XInitImage(ximage);
+        XPutImage(display, mBackgroundPixmap, gc,
+            ximage, 0, 0, 0, 0, w, h);
 
-    Pixmap pixmap = XCreatePixmap(display, window,
-        w, h, DefaultDepth(display, screen_num));
-    XPutImage(display, pixmap, XCreateGC(display, pixmap, 0, 0),
-        ximage, 0, 0, 0, 0, w, h);
-    XSetWindowBackgroundPixmap(display, window, pixmap);
+        // Pixels belong to the cairo surface.
+        ximage->data = NULL;
+        XDestroyImage(ximage);
+    }
+    XFreeGC(display, gc);
+    cairo_surface_destroy(surface);
 
-    g_object_unref(pixbuf);
-    XFreePixmap(display, pixmap);
-    XDestroyImage(ximage);
+    XSetWindowBackgroundPixmap(display, window, mBackgroundPixmap);
 
-    return;
+    free(mBackgroundFile);
+    mBackgroundFile = strdup(f);
+    mBackgroundFileTime = fileStat.st_mtime;
+    mBackgroundWidth = w;
+    mBackgroundHeight = h;
 }
 
 /** *********************************************************************
@@ -408,73 +453,88 @@ int updateWindowsList() {
         return true;
     }
 
-    if (softLockFallenSnowBaseSemaphore(3,
-        &mUpdateWindowsLockCounter)) {
-        return true;
-    }
-
-    // Once in a while, we force updating windows.
+    // X events queue what changed. Once in a while, we still
+    // rescan all windows, for changes no event told us about.
     static int wcounter = 0;
     wcounter++;
-    if (wcounter > 9) {
-        mGlobal.WindowsChanged = 1;
+    if (wcounter >= WINDOWS_FULL_RESCAN_CALLS) {
+        queueWinInfoRescan();
         wcounter = 0;
     }
-    if (!mGlobal.WindowsChanged) {
-        unlockFallenSnowSemaphore();
-        return true;
-    }
-    mGlobal.WindowsChanged = 0;
 
-    // Get current workspace number & sanity check.
-    const long WORKSPACE = getCurrentWorkspaceNumber();
-    if (WORKSPACE < 0) {
-        unlockFallenSnowSemaphore();
-        printf("%splasmasnow: Virtual workspace has been lost - FATAL.%s\n",
-            COLOR_RED, COLOR_NORMAL);
-        displayMessageBox(100, 200, 355, 66, "plasmasnow",
-            "Virtual workspace has been lost - FATAL.");
-        Flags.shutdownRequested = 1;
-        return true;
+    // Workspace switches come as root PropertyNotify events.
+    // Once in a while, we still read it, for window managers
+    // that change it some other way.
+    static int workspaceCounter = 0;
+    workspaceCounter++;
+    if (workspaceCounter >= WORKSPACE_FALLBACK_CALLS) {
+        mWorkspaceChanged = true;
     }
 
-    // Get current workspace data on workspace number change.
-    if (mGlobal.currentWorkspace != WORKSPACE) {
-        mGlobal.currentWorkspace = WORKSPACE;
-        getCurrentWorkspaceData();
-    }
+    if (mWorkspaceChanged) {
+        mWorkspaceChanged = false;
+        workspaceCounter = 0;
 
-    // Don't update windows list until drag stops.
-    if (isWindowBeingDragged()) {
-        doAllFallenSnowWinInfoUpdates();
-        unlockFallenSnowSemaphore();
-        return true;
+        // Get current workspace number & sanity check.
+        const long WORKSPACE = getCurrentWorkspaceNumber();
+        if (WORKSPACE < 0) {
+            printf("%splasmasnow: Virtual workspace has been lost - FATAL.%s\n",
+                COLOR_RED, COLOR_NORMAL);
+            displayMessageBox(100, 200, 355, 66, "plasmasnow",
+                "Virtual workspace has been lost - FATAL.");
+            Flags.shutdownRequested = 1;
+            return true;
+        }
+
+        // Get current workspace data on workspace number change.
+        // The FallenSnow thread reads the visible workspaces.
+        if (mGlobal.currentWorkspace != WORKSPACE) {
+            lockFallenSnowSemaphore();
+            mGlobal.currentWorkspace = WORKSPACE;
+            getCurrentWorkspaceData();
+            unlockFallenSnowSemaphore();
+            mGlobal.WindowsChanged++;
+        }
     }
 
-    // Update windows list.
-    getWinInfoForAllWindows();
-    for (int i = 0; i < mGlobal.winInfoListLength; i++) {
-        mGlobal.winInfoList[i].x += mGlobal.WindowOffsetX - mGlobal.SnowWinX;
-        mGlobal.winInfoList[i].y += mGlobal.WindowOffsetY - mGlobal.SnowWinY;
+    if (!mGlobal.WindowsChanged) {
+        return true;
     }
+    mGlobal.WindowsChanged = 0;
 
-    // Sanity check Snow window every time.
-    if (mGlobal.SnowWin != mGlobal.Rootwindow) {
-        WinInfo* winInfo = getWinInfoForWindow(mGlobal.SnowWin);
-        if (!winInfo && !mGlobal.hasTransparentWindow) {
-            printf("%splasmasnow: SnowWindow has been lost - FATAL.%s\n",
-                COLOR_RED, COLOR_NORMAL);
-            displayMessageBox(100, 200, 310, 66, "plasmasnow",
-                "SnowWindow has been lost - FATAL.");
-            Flags.shutdownRequested = 1;
+    // Don't update windows list until drag stops. Until
+    // then, nothing is taken as hidden behind windows.
+    if (isWindowBeingDragged()) {
+        clearOcclusionRegion();
+    } else {
+        // Update windows list. The list is main thread only,
+        // so its X round trips run unlocked.
+        doPendingWinInfoUpdates();
+        updateOcclusionRegion();
+
+        // Sanity check Snow window every time.
+        if (mGlobal.SnowWin != mGlobal.Rootwindow) {
+            WinInfo* winInfo = getWinInfoForWindow(mGlobal.SnowWin);
+            if (!winInfo && !mGlobal.hasTransparentWindow) {
+                printf("%splasmasnow: SnowWindow has been lost - FATAL.%s\n",
+                    COLOR_RED, COLOR_NORMAL);
+                displayMessageBox(100, 200, 310, 66, "plasmasnow",
+                    "SnowWindow has been lost - FATAL.");
+                Flags.shutdownRequested = 1;
+            }
         }
     }
 
-    // Resolve fallensnow surfaces states with
-    // new windows WinInfo surfaces list.
+    // Resolve fallensnow surfaces states with new windows
+    // WinInfo surfaces list. Busy, try again next call.
+    if (softLockFallenSnowBaseSemaphore(3,
+        &mUpdateWindowsLockCounter)) {
+        mGlobal.WindowsChanged++;
+        return true;
+    }
     doAllFallenSnowWinInfoUpdates();
-
     unlockFallenSnowSemaphore();
+
     return true;
 }
 
@@ -540,20 +600,7 @@ void setActiveAppWindow(Window window) {
 
 // Active App Window parent.
 Window getParentOfActiveAppWindow() {
-    Window rootWindow = None;
-    Window parentWindow = None;
-    Window* childrenWindow = NULL;
-    unsigned int windowChildCount = 0;
-
-    XQueryTree(mGlobal.display, getActiveAppWindow(),
-        &rootWindow, &parentWindow,
-        &childrenWindow, &windowChildCount);
-
-    if (childrenWindow) {
-        XFree((char *) childrenWindow);
-    }
-
-    return parentWindow;
+    return getCachedParent(mGlobal.display, getActiveAppWindow());
 }
 
 // Active App Window x/y value.
@@ -603,7 +650,8 @@ void onAppWindowChange(Window window) {
  **/
 void onWindowCreated(XEvent* event) {
     // Update our list to include the created one.
-    getWinInfoForAllWindows();
+    updateParentCache(event);
+    queueWinInfoSync();
 
     // Is this a signature of a transient Plasma DRAG Window
     // being created? If not, early exit.
@@ -640,13 +688,42 @@ void onWindowCreated(XEvent* event) {
 /** *********************************************************************
  ** This method handles X11 Windows being reparented.
  **/
-void onWindowReparent(__attribute__((unused)) XEvent* event) {
+void onWindowReparent(XEvent* event) {
+    // A client entering a frame changes which window
+    // moves it, and may change the client list.
+    updateParentCache(event);
+    queueWinInfoSync();
+    queueWinInfoUpdate(event->xreparent.window);
 }
 
 /** *********************************************************************
  ** This method handles X11 Windows being moved, sized, changed.
  **/
-void onWindowChanged(__attribute__((unused)) XEvent* event) {
+void onWindowChanged(XEvent* event) {
+    updateParentCache(event);
+    queueWinInfoUpdate(event->xconfigure.window);
+
+    // Snow on a dragged window moves with it. Under a
+    // reparenting window manager, it's the frame that moves.
+    if (isWindowBeingDragged() &&
+        event->xconfigure.window == getDraggedWindowFrame()) {
+        onDraggedWindowMoved(event->xconfigure.x,
+            event->xconfigure.y);
+    }
+}
+
+/** *********************************************************************
+ ** This method moves the fallen snow of the dragged window
+ ** by how far it moved since the last ConfigureNotify.
+ **/
+void onDraggedWindowMoved(int x, int y) {
+    if (mDragWindowXPos != mINVALID_POSITION) {
+        translateFallenSnowForWindow(getWindowBeingDragged(),
+            x - mDragWindowXPos, y - mDragWindowYPos);
+    }
+
+    mDragWindowXPos = x;
+    mDragWindowYPos = y;
 }
 
 /** *********************************************************************
@@ -655,8 +732,10 @@ void onWindowChanged(__attribute__((unused)) XEvent* event) {
  ** Determine if user is dragging a window, and clear it's fallensnow.
  **/
 void onWindowMapped(XEvent* event) {
+    updateParentCache(event);
+
     // Update our list for visibility change.
-    getWinInfoForAllWindows();
+    queueWinInfoUpdate(event->xmap.window);
 
     // Determine window drag state.
     if (!isWindowBeingDragged()) {
@@ -671,7 +750,7 @@ void onWindowMapped(XEvent* event) {
                     if (dragWindow != None) {
                         setIsWindowBeingDragged(true);
                         setWindowBeingDragged(dragWindow);
-                        removeFallenSnowFromWindow(getWindowBeingDragged());
+                        startDraggedWindowTracking();
                         return;
                     }
                 }
@@ -727,9 +806,9 @@ void onWindowBlurred(__attribute__((unused)) XEvent* event) {
  **
  ** Our main job is to clear window drag state.
  **/
-void onWindowUnmapped(__attribute__((unused)) XEvent* event) {
+void onWindowUnmapped(XEvent* event) {
     // Update our list for visibility change.
-    getWinInfoForAllWindows();
+    queueWinInfoUpdate(event->xunmap.window);
 
     // Clear window drag state.
     if (isWindowBeingDragged()) {
@@ -740,9 +819,10 @@ void onWindowUnmapped(__attribute__((unused)) XEvent* event) {
 /** *********************************************************************
  ** This method handles X11 Windows being destroyed.
  **/
-void onWindowDestroyed(__attribute__((unused)) XEvent* event) {
+void onWindowDestroyed(XEvent* event) {
     // Update our list to reflect the destroyed one.
-    getWinInfoForAllWindows();
+    updateParentCache(event);
+    queueWinInfoSync();
 
     // Clear window drag state.
     if (isWindowBeingDragged()) {
@@ -780,6 +860,45 @@ void clearAllDragFields() {
     setIsWindowBeingDragged(false);
     setWindowBeingDragged(None);
     setActiveAppDragWindowCandidate(None);
+
+    mDragWindowXPos = mINVALID_POSITION;
+    mDragWindowYPos = mINVALID_POSITION;
+}
+
+/** *********************************************************************
+ ** This method returns the child of root that moves with the
+ ** dragged window: its frame, or itself when not reparented.
+ **/
+Window getDraggedWindowFrame() {
+    const WinInfo* winInfo = getWinInfoForWindow(getWindowBeingDragged());
+    if (winInfo && winInfo->frame != None) {
+        return winInfo->frame;
+    }
+    return getWindowBeingDragged();
+}
+
+/** *********************************************************************
+ ** This method notes where the dragged window starts, so its
+ ** fallen snow can follow it rather than be shaken off. In
+ ** root coordinates, of the outer corner, as ConfigureNotify
+ ** of a child of root gives them.
+ **/
+void startDraggedWindowTracking() {
+    const Window frame = getDraggedWindowFrame();
+
+    Window root, child;
+    int x, y;
+    unsigned int w, h, b, d;
+    if (!XGetGeometry(mGlobal.display, frame,
+            &root, &x, &y, &w, &h, &b, &d) ||
+        !XTranslateCoordinates(mGlobal.display, frame, root,
+            0, 0, &x, &y, &child)) {
+        removeFallenSnowFromWindow(getWindowBeingDragged());
+        return;
+    }
+
+    mDragWindowXPos = x - (int) b;
+    mDragWindowYPos = y - (int) b;
 }
 
 bool isWindowBeingDragged() {
@@ -812,30 +931,17 @@ void setActiveAppDragWindowCandidate(Window candidate) {
 Window getDragWindowOf(Window window) {
     Window windowNode = window;
 
-    while (true) {
+    for (int depth = 0; windowNode != None &&
+        depth < DRAG_WINDOW_MAX_DEPTH; depth++) {
         // Is current node in windows list?
-        WinInfo* windowListItem = mGlobal.winInfoList;
-        for (int i = 0; i < mGlobal.winInfoListLength; i++) {
-            if (windowNode == windowListItem->window) {
-                return windowNode;
-            }
-            windowListItem++;
+        if (getWinInfoForWindow(windowNode)) {
+            return windowNode;
         }
 
         // If not in list, move up to parent and loop.
-        Window root, parent;
-        Window* children = NULL;
-        unsigned int windowChildCount;
-        if (!(XQueryTree(mGlobal.display, windowNode,
-                &root, &parent, &children, &windowChildCount))) {
-            return None;
-        }
-        if (children) {
-            XFree((char *) children);
-        }
-
-        windowNode = parent;
+        windowNode = getCachedParent(mGlobal.display, windowNode);
     }
+    return None;
 }
 /** *********************************************************************
  ** This method logs a timestamp in seconds & milliseconds.
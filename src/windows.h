@@ -28,6 +28,22 @@
 #include "plasmasnow.h"
 
 
+/***********************************************************
+ * Module consts.
+ */
+// Calls of updateWindowsList() between full rescans of all
+// windows, about five seconds at time_wupdate.
+#define WINDOWS_FULL_RESCAN_CALLS 250
+
+// Calls of updateWindowsList() between workspace reads when
+// no PropertyNotify told of a switch, about one second.
+#define WORKSPACE_FALLBACK_CALLS 50
+
+// Most parents getDragWindowOf() climbs, so a stale parent
+// cache with a cycle can't hang it.
+#define DRAG_WINDOW_MAX_DEPTH 16
+
+
 /***********************************************************
  * Module Method stubs.
  */
@@ -50,6 +66,7 @@ int getXineramaScreenInfo(Display *display,
 
 // Workspace.
 void getCurrentWorkspaceData();
+void onRootPropertyChanged(XEvent* event);
 int do_sendevent();
 int updateWindowsList();
 
@@ -80,6 +97,7 @@ void onWindowCreated(XEvent*);
 void onWindowReparent(XEvent*);
 void onWindowChanged(XEvent*);
 
+void onDraggedWindowMoved(int x, int y);
 void onWindowMapped(XEvent*);
 void onWindowFocused(XEvent*);
 void onWindowBlurred(XEvent*);
@@ -92,11 +110,13 @@ bool isMouseClickedAndHeldInWindow();
 
 // Window dragging methods.
 void clearAllDragFields();
+void startDraggedWindowTracking();
 
 bool isWindowBeingDragged();
 void setIsWindowBeingDragged(bool);
 
 Window getWindowBeingDragged();
+Window getDraggedWindowFrame();
 void setWindowBeingDragged(Window);
 
 Window getActiveAppDragWindowCandidate();
@@ -64,6 +64,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "xdo_util.h"
 
 #include "ColorCodes.h"
+#include "XTraffic.h"
 
 #define DEFAULT_DELAY 12
 
@@ -16,6 +16,7 @@
 
 #include "xdo.h"
 #include "xdo_search.h"
+#include "XTraffic.h"
 
 
 /** *********************************************************************